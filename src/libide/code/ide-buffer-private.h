@@ -63,5 +63,8 @@ void                    _ide_buffer_sync_to_unsaved_files    (IdeBuffer
 void                    _ide_buffer_set_file                 (IdeBuffer            *self,
                                                               GFile                *file);
 void                    _ide_buffer_request_scroll_to_cursor (IdeBuffer            *self);
+gboolean                _ide_buffer_get_has_focus            (IdeBuffer            *self);
+void                    _ide_buffer_set_has_focus            (IdeBuffer            *self,
+                                                              gboolean              has_focus);
 
 G_END_DECLS
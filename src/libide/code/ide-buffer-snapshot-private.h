@@ -0,0 +1,50 @@
+/* ide-buffer-snapshot-private.h
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "ide-buffer-snapshot.h"
+
+G_BEGIN_DECLS
+
+typedef struct _IdeBufferPieces IdeBufferPieces;
+
+IdeBufferPieces   *_ide_buffer_pieces_new             (void);
+void               _ide_buffer_pieces_free            (IdeBufferPieces *self);
+void               _ide_buffer_pieces_insert          (IdeBufferPieces *self,
+                                                       gsize            offset,
+                                                       const gchar     *text,
+                                                       gsize            len);
+void               _ide_buffer_pieces_delete          (IdeBufferPieces *self,
+                                                       gsize            begin,
+                                                       gsize            end);
+gsize              _ide_buffer_pieces_get_line_offset (IdeBufferPieces *self,
+                                                       guint            line);
+IdeBufferSnapshot *_ide_buffer_pieces_snapshot        (IdeBufferPieces *self,
+                                                       gboolean         implicit_newline,
+                                                       guint            change_count);
+IdeBufferSnapshot *_ide_buffer_snapshot_new_for_text  (const gchar     *text,
+                                                       gsize            len,
+                                                       gboolean         implicit_newline,
+                                                       guint            change_count);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeBufferPieces, _ide_buffer_pieces_free)
+
+G_END_DECLS
@@ -0,0 +1,889 @@
+/* ide-buffer-snapshot.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ide-buffer-snapshot"
+
+#include "config.h"
+
+#include <dazzle.h>
+#include <string.h>
+
+#include "ide-buffer-snapshot.h"
+#include "ide-buffer-snapshot-private.h"
+
+/*
+ * IdeBuffer mirrors its text in a piece table so that snapshots can be
+ * taken without copying the buffer. Text lives in immutable chunks, and
+ * the table is a list of pieces, each a range of a chunk.
+ *
+ * Small insertions are appended to a shared "add" chunk. Bytes already
+ * covered by a piece are never written again, so a snapshot on another
+ * thread may keep reading the chunk while the main thread appends to it.
+ * Large insertions get a chunk of their own with an index of its
+ * newlines, so that lines can be found without scanning it.
+ *
+ * Lines are separated by \n, which matches GtkTextBuffer as long as the
+ * text has no other line separators. IdeBuffer stops using the table
+ * when that is not the case.
+ */
+
+#define ADD_CHUNK_SIZE    (64 * 1024)
+#define MAX_ADD_INSERTION (4 * 1024)
+#define MAX_PIECES        2048
+
+typedef struct
+{
+  volatile gint  ref_count;
+  /* Only grows, and only for the add chunk */
+  gsize          len;
+  gsize          capacity;
+  /* Positions of \n, or %NULL to scan for them */
+  GArray        *newlines;
+  gchar          data[];
+} Chunk;
+
+typedef struct
+{
+  Chunk *chunk;
+  gsize  offset;
+  gsize  len;
+  gsize  n_newlines;
+} Piece;
+
+struct _IdeBufferPieces
+{
+  GArray *pieces;
+  Chunk  *add;
+  gsize   length;
+};
+
+struct _IdeBufferSnapshot
+{
+  volatile gint  ref_count;
+  guint          change_count;
+  guint          n_pieces;
+  guint          n_lines;
+  gsize          length;
+  Piece         *pieces;
+  /* Byte offset and number of newlines before each piece */
+  gsize         *starts;
+  gsize         *lines;
+};
+
+G_DEFINE_BOXED_TYPE (IdeBufferSnapshot, ide_buffer_snapshot, ide_buffer_snapshot_ref, ide_buffer_snapshot_unref)
+
+DZL_DEFINE_COUNTER (full_copies, "IdeBuffer", "Full Copies", "Number of times the complete contents of a buffer were copied")
+DZL_DEFINE_COUNTER (full_copies_per_minute, "IdeBuffer", "Full Copies/min", "Complete copies of buffer contents during the last full minute")
+
+G_LOCK_DEFINE_STATIC (full_copies_minute);
+
+static void
+count_full_copy (void)
+{
+  static gint64 minute_begin;
+  static guint n_this_minute;
+  gint64 now = g_get_monotonic_time ();
+
+  DZL_COUNTER_INC (full_copies);
+
+  G_LOCK (full_copies_minute);
+
+  if (minute_begin == 0)
+    {
+      minute_begin = now;
+    }
+  else if (now - minute_begin >= G_USEC_PER_SEC * 60)
+    {
+      /* There may have been no copies for several minutes, so average
+       * over the time that actually elapsed. Counters can only be added
+       * to, so clear the previous value first.
+       */
+      gint64 per_minute = n_this_minute * G_USEC_PER_SEC * 60 / (now - minute_begin);
+
+      dzl_counter_reset (&full_copies_per_minute_counter);
+      DZL_COUNTER_ADD (full_copies_per_minute, per_minute);
+
+      minute_begin = now;
+      n_this_minute = 0;
+    }
+
+  n_this_minute++;
+
+  G_UNLOCK (full_copies_minute);
+}
+
+static Chunk *
+chunk_new (gsize capacity)
+{
+  Chunk *chunk = g_malloc (sizeof *chunk + capacity);
+
+  chunk->ref_count = 1;
+  chunk->len = 0;
+  chunk->capacity = capacity;
+  chunk->newlines = NULL;
+
+  return chunk;
+}
+
+static Chunk *
+chunk_new_indexed (const gchar *text,
+                   gsize        len)
+{
+  Chunk *chunk = chunk_new (len);
+  const gchar *iter = text;
+  const gchar *end = text + len;
+
+  memcpy (chunk->data, text, len);
+  chunk->len = len;
+  chunk->newlines = g_array_new (FALSE, FALSE, sizeof (gsize));
+
+  while ((iter = memchr (iter, '\n', end - iter)))
+    {
+      gsize pos = iter - text;
+      g_array_append_val (chunk->newlines, pos);
+      iter++;
+    }
+
+  return chunk;
+}
+
+static Chunk *
+chunk_ref (Chunk *chunk)
+{
+  g_atomic_int_inc (&chunk->ref_count);
+  return chunk;
+}
+
+static void
+chunk_unref (Chunk *chunk)
+{
+  if (g_atomic_int_dec_and_test (&chunk->ref_count))
+    {
+      g_clear_pointer (&chunk->newlines, g_array_unref);
+      g_free (chunk);
+    }
+}
+
+static Chunk *
+get_newline_chunk (void)
+{
+  static Chunk *newline;
+
+  if (g_once_init_enter (&newline))
+    g_once_init_leave (&newline, chunk_new_indexed ("\n", 1));
+
+  return newline;
+}
+
+/* Index of the first newline at or after @pos in an indexed chunk */
+static guint
+chunk_lower_bound (const Chunk *chunk,
+                   gsize        pos)
+{
+  const gsize *newlines = (const gsize *)(gpointer)chunk->newlines->data;
+  guint lo = 0;
+  guint hi = chunk->newlines->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (newlines[mid] < pos)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static gsize
+count_newlines (const Chunk *chunk,
+                gsize        offset,
+                gsize        len)
+{
+  const gchar *iter;
+  const gchar *end;
+  gsize count = 0;
+
+  if (chunk->newlines != NULL)
+    return chunk_lower_bound (chunk, offset + len) - chunk_lower_bound (chunk, offset);
+
+  iter = chunk->data + offset;
+  end = iter + len;
+
+  while ((iter = memchr (iter, '\n', end - iter)))
+    {
+      count++;
+      iter++;
+    }
+
+  return count;
+}
+
+static Piece
+piece_new (Chunk *chunk,
+           gsize  offset,
+           gsize  len)
+{
+  Piece piece;
+
+  piece.chunk = chunk_ref (chunk);
+  piece.offset = offset;
+  piece.len = len;
+  piece.n_newlines = count_newlines (chunk, offset, len);
+
+  return piece;
+}
+
+static void
+piece_clear (gpointer data)
+{
+  Piece *piece = data;
+
+  g_clear_pointer (&piece->chunk, chunk_unref);
+}
+
+/* Offset within @piece just after its @nth newline, counting from zero */
+static gsize
+piece_line_offset (const Piece *piece,
+                   gsize        nth)
+{
+  const Chunk *chunk = piece->chunk;
+  const gchar *iter;
+
+  g_assert (nth < piece->n_newlines);
+
+  if (chunk->newlines != NULL)
+    {
+      guint first = chunk_lower_bound (chunk, piece->offset);
+      return g_array_index (chunk->newlines, gsize, first + nth) - piece->offset + 1;
+    }
+
+  iter = chunk->data + piece->offset;
+
+  for (;;)
+    {
+      iter = memchr (iter, '\n', chunk->data + piece->offset + piece->len - iter);
+      g_assert (iter != NULL);
+
+      if (nth-- == 0)
+        return iter - (chunk->data + piece->offset) + 1;
+
+      iter++;
+    }
+}
+
+IdeBufferPieces *
+_ide_buffer_pieces_new (void)
+{
+  IdeBufferPieces *self;
+
+  self = g_slice_new0 (IdeBufferPieces);
+  self->pieces = g_array_new (FALSE, FALSE, sizeof (Piece));
+  g_array_set_clear_func (self->pieces, piece_clear);
+
+  return self;
+}
+
+void
+_ide_buffer_pieces_free (IdeBufferPieces *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->pieces, g_array_unref);
+      g_clear_pointer (&self->add, chunk_unref);
+      g_slice_free (IdeBufferPieces, self);
+    }
+}
+
+static void
+ide_buffer_pieces_compact (IdeBufferPieces *self)
+{
+  g_autofree gchar *text = g_malloc (self->length + 1);
+  Chunk *chunk;
+  Piece piece;
+  gsize pos = 0;
+
+  g_assert (self != NULL);
+
+  for (guint i = 0; i < self->pieces->len; i++)
+    {
+      const Piece *p = &g_array_index (self->pieces, Piece, i);
+
+      memcpy (text + pos, p->chunk->data + p->offset, p->len);
+      pos += p->len;
+    }
+
+  count_full_copy ();
+
+  chunk = chunk_new_indexed (text, self->length);
+  piece = piece_new (chunk, 0, self->length);
+  chunk_unref (chunk);
+
+  g_array_set_size (self->pieces, 0);
+  g_array_append_val (self->pieces, piece);
+}
+
+void
+_ide_buffer_pieces_insert (IdeBufferPieces *self,
+                           gsize            offset,
+                           const gchar     *text,
+                           gsize            len)
+{
+  Piece *prev = NULL;
+  Piece piece;
+  gsize pos = 0;
+  guint i;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (offset <= self->length);
+
+  if (len == 0)
+    return;
+
+  for (i = 0; i < self->pieces->len; i++)
+    {
+      Piece *p = &g_array_index (self->pieces, Piece, i);
+
+      if (offset < pos + p->len)
+        break;
+
+      pos += p->len;
+    }
+
+  if (offset > pos)
+    {
+      Piece *p = &g_array_index (self->pieces, Piece, i);
+      Piece right = piece_new (p->chunk, p->offset + (offset - pos), p->len - (offset - pos));
+
+      /* Split the piece containing @offset */
+      p->len = offset - pos;
+      p->n_newlines -= right.n_newlines;
+
+      g_array_insert_val (self->pieces, ++i, right);
+    }
+  else if (i > 0)
+    {
+      prev = &g_array_index (self->pieces, Piece, i - 1);
+    }
+
+  self->length += len;
+
+  /* Typing appends to the previous insertion when possible */
+  if (prev != NULL &&
+      prev->chunk == self->add &&
+      prev->offset + prev->len == self->add->len &&
+      self->add->capacity - self->add->len >= len)
+    {
+      memcpy (self->add->data + self->add->len, text, len);
+      self->add->len += len;
+      prev->len += len;
+      prev->n_newlines += count_newlines (self->add, self->add->len - len, len);
+      return;
+    }
+
+  if (len > MAX_ADD_INSERTION)
+    {
+      Chunk *chunk = chunk_new_indexed (text, len);
+      piece = piece_new (chunk, 0, len);
+      chunk_unref (chunk);
+    }
+  else
+    {
+      if (self->add == NULL || self->add->capacity - self->add->len < len)
+        {
+          g_clear_pointer (&self->add, chunk_unref);
+          self->add = chunk_new (ADD_CHUNK_SIZE);
+        }
+
+      memcpy (self->add->data + self->add->len, text, len);
+      self->add->len += len;
+      piece = piece_new (self->add, self->add->len - len, len);
+    }
+
+  g_array_insert_val (self->pieces, i, piece);
+
+  if (self->pieces->len > MAX_PIECES)
+    ide_buffer_pieces_compact (self);
+}
+
+void
+_ide_buffer_pieces_delete (IdeBufferPieces *self,
+                           gsize            begin,
+                           gsize            end)
+{
+  g_autoptr(GArray) pieces = NULL;
+  gsize pos = 0;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (begin <= end);
+  g_return_if_fail (end <= self->length);
+
+  if (begin == end)
+    return;
+
+  pieces = g_array_sized_new (FALSE, FALSE, sizeof (Piece), self->pieces->len + 1);
+  g_array_set_clear_func (pieces, piece_clear);
+
+  for (guint i = 0; i < self->pieces->len; i++)
+    {
+      Piece *p = &g_array_index (self->pieces, Piece, i);
+      gsize p_end = pos + p->len;
+
+      if (end <= pos || begin >= p_end)
+        {
+          /* Move the piece, along with its reference */
+          g_array_append_val (pieces, *p);
+          p->chunk = NULL;
+        }
+      else
+        {
+          gsize left = begin > pos ? begin - pos : 0;
+          gsize right = end < p_end ? end - pos : p->len;
+
+          if (left > 0)
+            {
+              Piece piece = piece_new (p->chunk, p->offset, left);
+              g_array_append_val (pieces, piece);
+            }
+
+          if (right < p->len)
+            {
+              Piece piece = piece_new (p->chunk, p->offset + right, p->len - right);
+              g_array_append_val (pieces, piece);
+            }
+        }
+
+      pos = p_end;
+    }
+
+  g_clear_pointer (&self->pieces, g_array_unref);
+  self->pieces = g_steal_pointer (&pieces);
+  self->length -= end - begin;
+
+  if (self->pieces->len > MAX_PIECES)
+    ide_buffer_pieces_compact (self);
+}
+
+/**
+ * _ide_buffer_pieces_get_line_offset:
+ * @self: an #IdeBufferPieces
+ * @line: a line number starting from zero
+ *
+ * Gets the byte offset of the beginning of @line. This walks the list of
+ * pieces, which is kept short by compacting it when it grows too long.
+ *
+ * Returns: the offset, or the length of the text if @line is past the end
+ */
+gsize
+_ide_buffer_pieces_get_line_offset (IdeBufferPieces *self,
+                                    guint            line)
+{
+  gsize pos = 0;
+  gsize seen = 0;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  if (line == 0)
+    return 0;
+
+  for (guint i = 0; i < self->pieces->len; i++)
+    {
+      const Piece *p = &g_array_index (self->pieces, Piece, i);
+
+      if (seen + p->n_newlines >= line)
+        return pos + piece_line_offset (p, line - seen - 1);
+
+      seen += p->n_newlines;
+      pos += p->len;
+    }
+
+  return self->length;
+}
+
+/**
+ * _ide_buffer_pieces_snapshot:
+ * @self: an #IdeBufferPieces
+ * @implicit_newline: if a \n should be added when the text does not end with one
+ * @change_count: the change count of the buffer
+ *
+ * Creates an immutable snapshot of the text. The pieces are shared rather
+ * than copied, so this is proportional to the number of pieces.
+ *
+ * Returns: (transfer full): an #IdeBufferSnapshot
+ */
+IdeBufferSnapshot *
+_ide_buffer_pieces_snapshot (IdeBufferPieces *self,
+                             gboolean         implicit_newline,
+                             guint            change_count)
+{
+  IdeBufferSnapshot *snapshot;
+  gsize pos = 0;
+  gsize lines = 0;
+  guint n_pieces;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  n_pieces = self->pieces->len;
+
+  if (implicit_newline)
+    {
+      const Piece *last = n_pieces ? &g_array_index (self->pieces, Piece, n_pieces - 1) : NULL;
+
+      if (last == NULL || last->chunk->data[last->offset + last->len - 1] != '\n')
+        n_pieces++;
+      else
+        implicit_newline = FALSE;
+    }
+
+  snapshot = g_slice_new0 (IdeBufferSnapshot);
+  snapshot->ref_count = 1;
+  snapshot->change_count = change_count;
+  snapshot->n_pieces = n_pieces;
+  snapshot->pieces = g_new (Piece, n_pieces);
+  snapshot->starts = g_new (gsize, n_pieces);
+  snapshot->lines = g_new (gsize, n_pieces);
+
+  for (guint i = 0; i < self->pieces->len; i++)
+    {
+      const Piece *p = &g_array_index (self->pieces, Piece, i);
+
+      snapshot->pieces[i] = *p;
+      chunk_ref (p->chunk);
+    }
+
+  if (implicit_newline)
+    snapshot->pieces[n_pieces - 1] = piece_new (get_newline_chunk (), 0, 1);
+
+  for (guint i = 0; i < n_pieces; i++)
+    {
+      snapshot->starts[i] = pos;
+      snapshot->lines[i] = lines;
+      pos += snapshot->pieces[i].len;
+      lines += snapshot->pieces[i].n_newlines;
+    }
+
+  snapshot->length = pos;
+  snapshot->n_lines = lines + 1;
+
+  return snapshot;
+}
+
+/**
+ * _ide_buffer_snapshot_new_for_text:
+ * @text: the text
+ * @len: the length of @text in bytes
+ * @implicit_newline: if a \n should be added when @text does not end with one
+ * @change_count: the change count of the buffer
+ *
+ * Creates a snapshot by copying @text, for buffers that cannot use a
+ * piece table.
+ *
+ * Returns: (transfer full): an #IdeBufferSnapshot
+ */
+IdeBufferSnapshot *
+_ide_buffer_snapshot_new_for_text (const gchar *text,
+                                   gsize        len,
+                                   gboolean     implicit_newline,
+                                   guint        change_count)
+{
+  g_autoptr(IdeBufferPieces) pieces = _ide_buffer_pieces_new ();
+
+  count_full_copy ();
+
+  _ide_buffer_pieces_insert (pieces, 0, text, len);
+
+  return _ide_buffer_pieces_snapshot (pieces, implicit_newline, change_count);
+}
+
+IdeBufferSnapshot *
+ide_buffer_snapshot_ref (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+ide_buffer_snapshot_unref (IdeBufferSnapshot *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      for (guint i = 0; i < self->n_pieces; i++)
+        piece_clear (&self->pieces[i]);
+
+      g_clear_pointer (&self->pieces, g_free);
+      g_clear_pointer (&self->starts, g_free);
+      g_clear_pointer (&self->lines, g_free);
+      g_slice_free (IdeBufferSnapshot, self);
+    }
+}
+
+/**
+ * ide_buffer_snapshot_get_change_count:
+ * @self: an #IdeBufferSnapshot
+ *
+ * Gets the value of #IdeBuffer:change-count when the snapshot was taken.
+ *
+ * Returns: the change count
+ *
+ * Since: 3.40
+ */
+guint
+ide_buffer_snapshot_get_change_count (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->change_count;
+}
+
+/**
+ * ide_buffer_snapshot_get_length:
+ * @self: an #IdeBufferSnapshot
+ *
+ * Gets the length of the text in bytes, including the trailing newline
+ * added when the buffer has an implicit trailing newline.
+ *
+ * Returns: the number of bytes
+ *
+ * Since: 3.40
+ */
+gsize
+ide_buffer_snapshot_get_length (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->length;
+}
+
+/**
+ * ide_buffer_snapshot_get_n_lines:
+ * @self: an #IdeBufferSnapshot
+ *
+ * Gets the number of lines. A line begins after every \n, so text ending
+ * with a newline has an empty last line.
+ *
+ * Returns: the number of lines, at least 1
+ *
+ * Since: 3.40
+ */
+guint
+ide_buffer_snapshot_get_n_lines (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->n_lines;
+}
+
+/**
+ * ide_buffer_snapshot_get_line_offset:
+ * @self: an #IdeBufferSnapshot
+ * @line: a line number starting from zero
+ *
+ * Gets the byte offset of the beginning of @line.
+ *
+ * Returns: the offset, or the length of the text if @line is past the end
+ *
+ * Since: 3.40
+ */
+gsize
+ide_buffer_snapshot_get_line_offset (IdeBufferSnapshot *self,
+                                     guint              line)
+{
+  guint lo = 0;
+  guint hi;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  if (line == 0)
+    return 0;
+
+  if (line >= self->n_lines)
+    return self->length;
+
+  /* Find the last piece with fewer than @line newlines before it */
+  hi = self->n_pieces;
+
+  while (hi - lo > 1)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (self->lines[mid] < line)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  return self->starts[lo] + piece_line_offset (&self->pieces[lo], line - self->lines[lo] - 1);
+}
+
+/**
+ * ide_buffer_snapshot_foreach:
+ * @self: an #IdeBufferSnapshot
+ * @begin: the byte offset to start at
+ * @end: the byte offset to stop at
+ * @foreach_func: (scope call): a function to call for each part of the range
+ * @user_data: closure data for @foreach_func
+ *
+ * Calls @foreach_func with the text between @begin and @end, in order,
+ * without copying it.
+ *
+ * Since: 3.40
+ */
+void
+ide_buffer_snapshot_foreach (IdeBufferSnapshot        *self,
+                             gsize                     begin,
+                             gsize                     end,
+                             IdeBufferSnapshotForeach  foreach_func,
+                             gpointer                  user_data)
+{
+  guint lo = 0;
+  guint hi;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (foreach_func != NULL);
+
+  end = MIN (end, self->length);
+
+  if (begin >= end)
+    return;
+
+  /* Find the piece containing @begin */
+  hi = self->n_pieces;
+
+  while (hi - lo > 1)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (self->starts[mid] <= begin)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  for (guint i = lo; i < self->n_pieces && self->starts[i] < end; i++)
+    {
+      const Piece *p = &self->pieces[i];
+      gsize p_begin = MAX (begin, self->starts[i]) - self->starts[i];
+      gsize p_end = MIN (end, self->starts[i] + p->len) - self->starts[i];
+
+      if (p_end > p_begin)
+        foreach_func (p->chunk->data + p->offset + p_begin, p_end - p_begin, user_data);
+    }
+}
+
+static void
+copy_foreach (const gchar *data,
+              gsize        len,
+              gpointer     user_data)
+{
+  gchar **dest = user_data;
+
+  memcpy (*dest, data, len);
+  *dest += len;
+}
+
+/**
+ * ide_buffer_snapshot_dup_range:
+ * @self: an #IdeBufferSnapshot
+ * @begin: the byte offset to start at
+ * @end: the byte offset to stop at
+ *
+ * Copies the text between @begin and @end.
+ *
+ * Returns: (transfer full): a newly allocated, \0 terminated string
+ *
+ * Since: 3.40
+ */
+gchar *
+ide_buffer_snapshot_dup_range (IdeBufferSnapshot *self,
+                               gsize              begin,
+                               gsize              end)
+{
+  gchar *ret;
+  gchar *dest;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  end = MIN (end, self->length);
+  begin = MIN (begin, end);
+
+  dest = ret = g_malloc (end - begin + 1);
+  ide_buffer_snapshot_foreach (self, begin, end, copy_foreach, &dest);
+  *dest = '\0';
+
+  return ret;
+}
+
+/**
+ * ide_buffer_snapshot_dup_lines:
+ * @self: an #IdeBufferSnapshot
+ * @begin_line: the first line
+ * @end_line: the line after the last line
+ *
+ * Copies the lines from @begin_line up to, but not including, @end_line,
+ * with their newlines.
+ *
+ * Returns: (transfer full): a newly allocated, \0 terminated string
+ *
+ * Since: 3.40
+ */
+gchar *
+ide_buffer_snapshot_dup_lines (IdeBufferSnapshot *self,
+                               guint              begin_line,
+                               guint              end_line)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return ide_buffer_snapshot_dup_range (self,
+                                        ide_buffer_snapshot_get_line_offset (self, begin_line),
+                                        ide_buffer_snapshot_get_line_offset (self, end_line));
+}
+
+/**
+ * ide_buffer_snapshot_dup_bytes:
+ * @self: an #IdeBufferSnapshot
+ *
+ * Copies the complete text. Prefer ide_buffer_snapshot_foreach() or
+ * ide_buffer_snapshot_dup_range() when only part of it is needed.
+ *
+ * The data is followed by a \0 which is not included in the size of
+ * the #GBytes.
+ *
+ * Returns: (transfer full): a #GBytes
+ *
+ * Since: 3.40
+ */
+GBytes *
+ide_buffer_snapshot_dup_bytes (IdeBufferSnapshot *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  count_full_copy ();
+
+  return g_bytes_new_take (ide_buffer_snapshot_dup_range (self, 0, self->length), self->length);
+}
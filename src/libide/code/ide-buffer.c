@@ -33,6 +33,7 @@
 #include "ide-buffer-addin-private.h"
 #include "ide-buffer-manager.h"
 #include "ide-buffer-private.h"
+#include "ide-buffer-snapshot-private.h"
 #include "ide-code-enums.h"
 #include "ide-diagnostic.h"
 #include "ide-diagnostics.h"
@@ -77,6 +78,8 @@ struct _IdeBuffer
   IdeBufferManager       *buffer_manager;
   IdeBufferChangeMonitor *change_monitor;
   GBytes                 *content;
+  IdeBufferPieces        *pieces;
+  IdeBufferSnapshot      *snapshot;
   IdeDiagnostics         *diagnostics;
   GError                 *failure;
   IdeFileSettings        *file_settings;
@@ -99,6 +102,8 @@ struct _IdeBuffer
   guint                   changed_on_volume : 1;
   guint                   read_only : 1;
   guint                   highlight_diagnostics : 1;
+  guint                   pieces_disabled : 1;
+  guint                   has_focus : 1;
 };
 
 typedef struct
@@ -196,6 +201,12 @@ static void     ide_buffer_changed                 (GtkTextBuffer          *buff
 static void     ide_buffer_delete_range            (GtkTextBuffer          *buffer,
                                                     GtkTextIter            *start,
                                                     GtkTextIter            *end);
+static void     ide_buffer_insert_child_anchor     (GtkTextBuffer          *buffer,
+                                                    GtkTextIter            *location,
+                                                    GtkTextChildAnchor     *anchor);
+static void     ide_buffer_insert_pixbuf           (GtkTextBuffer          *buffer,
+                                                    GtkTextIter            *location,
+                                                    GdkPixbuf              *pixbuf);
 static void     ide_buffer_insert_text             (GtkTextBuffer          *buffer,
                                                     GtkTextIter            *location,
                                                     const gchar            *text,
@@ -225,8 +236,6 @@ static void     ide_buffer_symbol_resolver_added   (IdeExtensionSetAdapter *adap
                                                     PeasPluginInfo         *plugin_info,
                                                     PeasExtension          *extension,
                                                     gpointer                user_data);
-static gboolean ide_buffer_can_do_newline_hack     (IdeBuffer              *self,
-                                                    guint                   len);
 static void     ide_buffer_guess_language          (IdeBuffer              *self);
 static void     ide_buffer_real_loaded             (IdeBuffer              *self);
 static void     settle_async                       (IdeBuffer              *self,
@@ -418,6 +427,7 @@ ide_buffer_dispose (GObject *object)
   g_clear_object (&self->buffer_manager);
   ide_clear_and_destroy_object (&self->change_monitor);
   g_clear_pointer (&self->content, g_bytes_unref);
+  g_clear_pointer (&self->snapshot, ide_buffer_snapshot_unref);
   g_clear_object (&self->diagnostics);
   ide_clear_and_destroy_object (&self->file_settings);
 
@@ -432,6 +442,7 @@ ide_buffer_finalize (GObject *object)
   g_clear_object (&self->source_file);
   g_clear_object (&self->readlink_file);
   g_clear_pointer (&self->failure, g_error_free);
+  g_clear_pointer (&self->pieces, _ide_buffer_pieces_free);
 
   G_OBJECT_CLASS (ide_buffer_parent_class)->finalize (object);
 }
@@ -572,6 +583,8 @@ ide_buffer_class_init (IdeBufferClass *klass)
 
   buffer_class->changed = ide_buffer_changed;
   buffer_class->delete_range = ide_buffer_delete_range;
+  buffer_class->insert_child_anchor = ide_buffer_insert_child_anchor;
+  buffer_class->insert_pixbuf = ide_buffer_insert_pixbuf;
   buffer_class->insert_text = ide_buffer_insert_text;
   buffer_class->mark_set = ide_buffer_mark_set;
 
@@ -952,6 +965,7 @@ ide_buffer_init (IdeBuffer *self)
   self->source_file = gtk_source_file_new ();
   self->can_restore_cursor = TRUE;
   self->highlight_diagnostics = TRUE;
+  self->pieces = _ide_buffer_pieces_new ();
 
   g_assert (IDE_IS_MAIN_THREAD ());
 
@@ -1882,14 +1896,69 @@ ide_buffer_changed (GtkTextBuffer *buffer)
 
   self->change_count++;
   g_clear_pointer (&self->content, g_bytes_unref);
+  g_clear_pointer (&self->snapshot, ide_buffer_snapshot_unref);
   ide_buffer_delay_settling (self);
 }
 
+static void
+ide_buffer_disable_pieces (IdeBuffer *self)
+{
+  g_assert (IDE_IS_BUFFER (self));
+
+  /*
+   * The piece table can only follow text where lines are separated by \n
+   * and that has no embedded objects. Otherwise snapshots are created by
+   * copying the whole buffer.
+   */
+  if (!self->pieces_disabled)
+    {
+      g_debug ("Buffer contains text the piece table cannot follow, copying instead");
+      self->pieces_disabled = TRUE;
+      g_clear_pointer (&self->pieces, _ide_buffer_pieces_free);
+    }
+}
+
+static gsize
+ide_buffer_get_byte_offset (IdeBuffer         *self,
+                            const GtkTextIter *iter)
+{
+  g_assert (IDE_IS_BUFFER (self));
+  g_assert (self->pieces != NULL);
+  g_assert (iter != NULL);
+
+  return _ide_buffer_pieces_get_line_offset (self->pieces, gtk_text_iter_get_line (iter)) +
+         gtk_text_iter_get_line_index (iter);
+}
+
+static void
+ide_buffer_insert_child_anchor (GtkTextBuffer      *buffer,
+                                GtkTextIter        *location,
+                                GtkTextChildAnchor *anchor)
+{
+  ide_buffer_disable_pieces (IDE_BUFFER (buffer));
+
+  GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_child_anchor (buffer, location, anchor);
+}
+
+static void
+ide_buffer_insert_pixbuf (GtkTextBuffer *buffer,
+                          GtkTextIter   *location,
+                          GdkPixbuf     *pixbuf)
+{
+  ide_buffer_disable_pieces (IDE_BUFFER (buffer));
+
+  GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_pixbuf (buffer, location, pixbuf);
+}
+
 static void
 ide_buffer_delete_range (GtkTextBuffer *buffer,
                          GtkTextIter   *begin,
                          GtkTextIter   *end)
 {
+  IdeBuffer *self = (IdeBuffer *)buffer;
+  gsize begin_offset = 0;
+  gsize end_offset = 0;
+
   IDE_ENTRY;
 
   g_assert (IDE_IS_MAIN_THREAD ());
@@ -1913,6 +1982,18 @@ ide_buffer_delete_range (GtkTextBuffer *buffer,
   }
 #endif
 
+  /*
+   * The pieces are updated before chaining up, as GtkTextBuffer emits
+   * "changed" from its default handler and snapshots taken from there
+   * must see the new contents.
+   */
+  if (self->pieces != NULL)
+    {
+      begin_offset = ide_buffer_get_byte_offset (self, begin);
+      end_offset = ide_buffer_get_byte_offset (self, end);
+      _ide_buffer_pieces_delete (self->pieces, MIN (begin_offset, end_offset), MAX (begin_offset, end_offset));
+    }
+
   GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->delete_range (buffer, begin, end);
 
   ide_buffer_emit_cursor_moved (IDE_BUFFER (buffer));
@@ -1926,7 +2007,9 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
                         const gchar   *text,
                         gint           len)
 {
+  IdeBuffer *self = (IdeBuffer *)buffer;
   gboolean recheck_language = FALSE;
+  gsize offset = 0;
 
   IDE_ENTRY;
 
@@ -1945,6 +2028,18 @@ ide_buffer_insert_text (GtkTextBuffer *buffer,
       ((text [0] == '\n') || ((len > 1) && (strchr (text, '\n') != NULL))))
     recheck_language = TRUE;
 
+  /* GtkTextBuffer also breaks lines at \r and U+2029 */
+  if (self->pieces != NULL &&
+      (memchr (text, '\r', len) != NULL || g_strstr_len (text, len, "\xe2\x80\xa9") != NULL))
+    ide_buffer_disable_pieces (self);
+
+  /* Before chaining up, so that "changed" handlers see the new text */
+  if (self->pieces != NULL)
+    {
+      offset = ide_buffer_get_byte_offset (self, location);
+      _ide_buffer_pieces_insert (self->pieces, offset, text, len);
+    }
+
   GTK_TEXT_BUFFER_CLASS (ide_buffer_parent_class)->insert_text (buffer, location, text, len);
 
   ide_buffer_emit_cursor_moved (IDE_BUFFER (buffer));
@@ -2655,38 +2750,6 @@ ide_buffer_set_change_monitor (IdeBuffer              *self,
     }
 }
 
-static gboolean
-ide_buffer_can_do_newline_hack (IdeBuffer *self,
-                                guint      len)
-{
-  guint next_pow2;
-
-  g_assert (IDE_IS_MAIN_THREAD ());
-  g_assert (IDE_IS_BUFFER (self));
-
-  /*
-   * If adding two bytes to our length (one for \n and one for \0) is still
-   * under the next power of two, then we can avoid making a copy of the buffer
-   * when saving the buffer to our drafts.
-   *
-   * HACK: This relies on the fact that GtkTextBuffer returns a GString
-   *       allocated string which grows the string in powers of two.
-   */
-
-  if ((len == 0) || (len & (len - 1)) == 0)
-    return FALSE;
-
-  next_pow2 = len;
-  next_pow2 |= next_pow2 >> 1;
-  next_pow2 |= next_pow2 >> 2;
-  next_pow2 |= next_pow2 >> 4;
-  next_pow2 |= next_pow2 >> 8;
-  next_pow2 |= next_pow2 >> 16;
-  next_pow2++;
-
-  return ((len + 2) < next_pow2);
-}
-
 /**
  * ide_buffer_dup_content:
  * @self: an #IdeBuffer.
@@ -2712,49 +2775,20 @@ ide_buffer_dup_content (IdeBuffer *self)
 
   if (self->content == NULL)
     {
+      g_autoptr(IdeBufferSnapshot) snapshot = NULL;
       g_autoptr(IdeContext) context = NULL;
       IdeUnsavedFiles *unsaved_files;
-      GtkTextIter begin;
-      GtkTextIter end;
       GFile *file;
-      gchar *text;
-      gsize len;
-
-      gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self), &begin, &end);
-      text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (self), &begin, &end, TRUE);
-
-      /*
-       * If implicit newline is set, add a \n in place of the \0 and avoid
-       * duplicating the buffer. Make sure to track length beforehand, since we
-       * would overwrite afterwards. Since conversion to \r\n is dealth with
-       * during save operations, this should be fine for both. The unsaved
-       * files will restore to a buffer, for which \n is acceptable.
-       */
-      len = strlen (text);
-      if (gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (self)) &&
-          (len == 0 || text[len - 1] != '\n'))
-        {
-          if (!ide_buffer_can_do_newline_hack (self, len))
-            {
-              gchar *copy;
-
-              copy = g_malloc (len + 2);
-              memcpy (copy, text, len);
-              g_free (text);
-              text = copy;
-            }
-
-          text [len] = '\n';
-          text [++len] = '\0';
-        }
 
       /*
-       * We pass a buffer that is longer than the length we tell GBytes about.
-       * This way, compilers that don't want to see the trailing \0 can ignore
-       * that data, but compilers that rely on valid C strings can also rely
-       * on the buffer to be valid.
+       * The snapshot includes the implicit trailing newline, and the bytes
+       * are followed by a \0 which is not part of their size. This way,
+       * compilers that don't want to see the trailing \0 can ignore that
+       * data, but compilers that rely on valid C strings can also rely on
+       * the buffer to be valid.
        */
-      self->content = g_bytes_new_take (g_steal_pointer (&text), len);
+      snapshot = ide_buffer_ref_snapshot (self);
+      self->content = ide_buffer_snapshot_dup_bytes (snapshot);
 
       /* Only persist if we have access to the object tree */
       if (self->buffer_manager != NULL &&
@@ -2770,6 +2804,54 @@ ide_buffer_dup_content (IdeBuffer *self)
   return g_bytes_ref (self->content);
 }
 
+/**
+ * ide_buffer_ref_snapshot:
+ * @self: an #IdeBuffer
+ *
+ * Gets an immutable snapshot of the contents of the buffer. Unlike
+ * ide_buffer_dup_content(), this does not copy the text, and the snapshot
+ * may be read from any thread. Use it when only some lines or a range of
+ * the buffer are needed.
+ *
+ * As with ide_buffer_dup_content(), a trailing newline is added when the
+ * buffer has an implicit trailing newline.
+ *
+ * Returns: (transfer full): an #IdeBufferSnapshot
+ *
+ * Since: 3.40
+ */
+IdeBufferSnapshot *
+ide_buffer_ref_snapshot (IdeBuffer *self)
+{
+  gboolean implicit_newline;
+
+  g_return_val_if_fail (IDE_IS_MAIN_THREAD (), NULL);
+  g_return_val_if_fail (IDE_IS_BUFFER (self), NULL);
+
+  if (self->snapshot != NULL)
+    return ide_buffer_snapshot_ref (self->snapshot);
+
+  implicit_newline = gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (self));
+
+  if (self->pieces != NULL)
+    {
+      self->snapshot = _ide_buffer_pieces_snapshot (self->pieces, implicit_newline, self->change_count);
+    }
+  else
+    {
+      g_autofree gchar *text = NULL;
+      GtkTextIter begin;
+      GtkTextIter end;
+
+      gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (self), &begin, &end);
+      text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (self), &begin, &end, TRUE);
+
+      self->snapshot = _ide_buffer_snapshot_new_for_text (text, strlen (text), implicit_newline, self->change_count);
+    }
+
+  return ide_buffer_snapshot_ref (self->snapshot);
+}
+
 static void
 ide_buffer_format_selection_cb (GObject      *object,
                                 GAsyncResult *result,
@@ -3894,6 +3976,29 @@ _ide_buffer_request_scroll_to_cursor (IdeBuffer *self)
   g_signal_emit (self, signals [REQUEST_SCROLL_TO_INSERT], 0);
 }
 
+gboolean
+_ide_buffer_get_has_focus (IdeBuffer *self)
+{
+  g_return_val_if_fail (IDE_IS_MAIN_THREAD (), FALSE);
+  g_return_val_if_fail (IDE_IS_BUFFER (self), FALSE);
+
+  return self->has_focus;
+}
+
+/*
+ * Set by the view that has keyboard focus, so that work for the buffer
+ * the user is editing can be prioritized over other buffers.
+ */
+void
+_ide_buffer_set_has_focus (IdeBuffer *self,
+                           gboolean   has_focus)
+{
+  g_return_if_fail (IDE_IS_MAIN_THREAD ());
+  g_return_if_fail (IDE_IS_BUFFER (self));
+
+  self->has_focus = !!has_focus;
+}
+
 gboolean
 _ide_buffer_is_file (IdeBuffer *self,
                      GFile     *nolink_file)
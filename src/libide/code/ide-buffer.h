@@ -28,6 +28,7 @@
 #include <libide-core.h>
 
 #include "ide-buffer-change-monitor.h"
+#include "ide-buffer-snapshot.h"
 #include "ide-diagnostics.h"
 #include "ide-file-settings.h"
 #include "ide-formatter.h"
@@ -145,6 +146,8 @@ IDE_AVAILABLE_IN_3_32
 IdeBuffer              *ide_buffer_hold                          (IdeBuffer               *self);
 IDE_AVAILABLE_IN_3_32
 IdeContext             *ide_buffer_ref_context                   (IdeBuffer               *self);
+IDE_AVAILABLE_IN_3_40
+IdeBufferSnapshot      *ide_buffer_ref_snapshot                  (IdeBuffer               *self);
 IDE_AVAILABLE_IN_3_32
 void                    ide_buffer_rehighlight                   (IdeBuffer               *self);
 IDE_AVAILABLE_IN_3_32
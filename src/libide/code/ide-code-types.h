@@ -31,6 +31,7 @@ G_BEGIN_DECLS
 typedef struct _IdeBuffer IdeBuffer;
 typedef struct _IdeBufferAddin IdeBufferAddin;
 typedef struct _IdeBufferChangeMonitor IdeBufferChangeMonitor;
+typedef struct _IdeBufferSnapshot IdeBufferSnapshot;
 typedef struct _IdeCodeIndexEntries IdeCodeIndexEntries;
 typedef struct _IdeCodeIndexEntry IdeCodeIndexEntry;
 typedef struct _IdeCodeIndexer IdeCodeIndexer;
@@ -37,5 +37,7 @@ void _ide_diagnostics_manager_file_changed     (IdeDiagnosticsManager *self,
                                                 GFile                 *file,
                                                 GBytes                *contents,
                                                 const gchar           *lang_id);
+void _ide_diagnostics_manager_buffer_changed   (IdeDiagnosticsManager *self,
+                                                IdeBuffer             *buffer);
 
 G_END_DECLS
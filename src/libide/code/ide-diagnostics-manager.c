@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include <dazzle.h>
 #include <gtksourceview/gtksource.h>
 #include <libide-plugins.h>
 
@@ -34,10 +35,45 @@
 #include "ide-diagnostics-manager.h"
 #include "ide-diagnostics-manager-private.h"
 
-#define DEFAULT_DIAGNOSE_DELAY 333
-#define DIAG_GROUP_MAGIC       0xF1282727
+#define DEFAULT_DIAGNOSE_DELAY  333
+#define MIN_DIAGNOSE_DELAY      50
+#define MAX_DIAGNOSE_DELAY      2000
+#define BACKGROUND_DELAY_FACTOR 4
+#define DIAG_GROUP_MAGIC        0xF1282727
 #define IS_DIAGNOSTICS_GROUP(g) ((g) && (g)->magic == DIAG_GROUP_MAGIC)
 
+/*
+ * The delay before diagnosing a file depends on how long its providers
+ * took to diagnose it recently, and how often those diagnoses were made
+ * stale by further changes. A provider that takes 20 msec can run almost
+ * as soon as the user stops typing, while one that takes seconds should
+ * wait for a real pause. Files that are not focused wait longer, and do
+ * not start while the focused file is being diagnosed.
+ */
+
+DZL_DEFINE_COUNTER (latency_50, "Diagnostics", "Latency < 50ms", "Number of diagnoses that completed in less than 50 msec")
+DZL_DEFINE_COUNTER (latency_100, "Diagnostics", "Latency < 100ms", "Number of diagnoses that completed in 50 to 100 msec")
+DZL_DEFINE_COUNTER (latency_250, "Diagnostics", "Latency < 250ms", "Number of diagnoses that completed in 100 to 250 msec")
+DZL_DEFINE_COUNTER (latency_500, "Diagnostics", "Latency < 500ms", "Number of diagnoses that completed in 250 to 500 msec")
+DZL_DEFINE_COUNTER (latency_1000, "Diagnostics", "Latency < 1s", "Number of diagnoses that completed in 500 msec to 1 sec")
+DZL_DEFINE_COUNTER (latency_2500, "Diagnostics", "Latency < 2.5s", "Number of diagnoses that completed in 1 to 2.5 sec")
+DZL_DEFINE_COUNTER (latency_max, "Diagnostics", "Latency >= 2.5s", "Number of diagnoses that took 2.5 sec or more")
+DZL_DEFINE_COUNTER (cancelled, "Diagnostics", "N Cancelled", "Number of diagnoses made stale by changes to the file")
+
+typedef struct
+{
+  /* Moving averages of the latency and of the rate of cancellation */
+  gdouble latency_msec;
+  gdouble cancel_rate;
+} DiagnoseStats;
+
+typedef struct
+{
+  IdeDiagnosticsManager *self;
+  GCancellable          *cancellable;
+  gint64                 begin_time;
+} DiagnoseState;
+
 typedef struct
 {
   /*
@@ -72,6 +108,21 @@ typedef struct
   /* The most recent bytes we received for a future diagnosis. */
   GBytes *contents;
 
+  /*
+   * The buffer for the file, if it is open. When @contents is %NULL, the
+   * contents are taken from the buffer when the diagnosis begins.
+   */
+  IdeBuffer *buffer;
+
+  /* Cancelled when the contents change during a diagnosis */
+  GCancellable *cancellable;
+
+  /* The DiagnoseStats for each provider, keyed by GType */
+  GHashTable *stats_by_type;
+
+  /* The monotonic time at which the next diagnosis may begin */
+  gint64 ready_time;
+
   /* The last language id we were notified about */
   const gchar *lang_id;
 
@@ -125,9 +176,11 @@ struct _IdeDiagnosticsManager
 
   /*
    * If any group has a queued diagnose in process, this will be set so
-   * we can coalesce the dispatch of everything at the same time.
+   * we can coalesce the dispatch of everything at the same time. It fires
+   * at @queued_ready_time, the earliest ready time of the groups.
    */
   guint queued_diagnose_source;
+  gint64 queued_ready_time;
 };
 
 enum {
@@ -149,6 +202,7 @@ static void     ide_diagnostics_manager_add_diagnostic    (IdeDiagnosticsManager
                                                            IdeDiagnostic         *diagnostic);
 static void     ide_diagnostics_group_queue_diagnose      (IdeDiagnosticsGroup   *group,
                                                            IdeDiagnosticsManager *self);
+static void     ide_diagnostics_manager_schedule          (IdeDiagnosticsManager *self);
 
 
 static GParamSpec *properties [N_PROPS];
@@ -170,6 +224,33 @@ diagnostics_get_size (IdeDiagnostics *diags)
   return diags ? g_list_model_get_n_items (G_LIST_MODEL (diags)) : 0;
 }
 
+static void
+diagnose_state_free (DiagnoseState *state)
+{
+  g_clear_object (&state->self);
+  g_clear_object (&state->cancellable);
+  g_slice_free (DiagnoseState, state);
+}
+
+static void
+record_latency (gint64 msec)
+{
+  if (msec < 50)
+    DZL_COUNTER_INC (latency_50);
+  else if (msec < 100)
+    DZL_COUNTER_INC (latency_100);
+  else if (msec < 250)
+    DZL_COUNTER_INC (latency_250);
+  else if (msec < 500)
+    DZL_COUNTER_INC (latency_500);
+  else if (msec < 1000)
+    DZL_COUNTER_INC (latency_1000);
+  else if (msec < 2500)
+    DZL_COUNTER_INC (latency_2500);
+  else
+    DZL_COUNTER_INC (latency_max);
+}
+
 static void
 ide_diagnostics_group_finalize (IdeDiagnosticsGroup *group)
 {
@@ -179,8 +260,14 @@ ide_diagnostics_group_finalize (IdeDiagnosticsGroup *group)
 
   group->magic = 0;
 
+  if (group->cancellable != NULL)
+    g_cancellable_cancel (group->cancellable);
+
   g_clear_pointer (&group->diagnostics_by_provider, g_hash_table_unref);
   g_clear_pointer (&group->contents, g_bytes_unref);
+  g_clear_pointer (&group->stats_by_type, g_hash_table_unref);
+  g_clear_weak_pointer (&group->buffer);
+  g_clear_object (&group->cancellable);
   ide_clear_and_destroy_object (&group->adapter);
   g_clear_object (&group->file);
 }
@@ -263,6 +350,118 @@ ide_diagnostics_group_can_dispose (IdeDiagnosticsGroup *group)
          group->has_diagnostics == FALSE;
 }
 
+static gboolean
+ide_diagnostics_group_has_focus (IdeDiagnosticsGroup *group)
+{
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (group != NULL);
+  g_assert (IS_DIAGNOSTICS_GROUP (group));
+
+  return group->buffer != NULL && _ide_buffer_get_has_focus (group->buffer);
+}
+
+static gboolean
+ide_diagnostics_group_can_begin (IdeDiagnosticsGroup *group)
+{
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (group != NULL);
+  g_assert (IS_DIAGNOSTICS_GROUP (group));
+
+  return group->needs_diagnose && group->adapter != NULL && group->in_diagnose == 0;
+}
+
+static void
+ide_diagnostics_group_cancel (IdeDiagnosticsGroup *group)
+{
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (group != NULL);
+  g_assert (IS_DIAGNOSTICS_GROUP (group));
+
+  if (group->cancellable != NULL)
+    {
+      g_cancellable_cancel (group->cancellable);
+      g_clear_object (&group->cancellable);
+    }
+}
+
+static void
+ide_diagnostics_group_record (IdeDiagnosticsGroup   *group,
+                              IdeDiagnosticProvider *provider,
+                              gboolean               was_cancelled,
+                              gint64                 latency_msec)
+{
+  DiagnoseStats *stats;
+  gpointer key;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (group != NULL);
+  g_assert (IS_DIAGNOSTICS_GROUP (group));
+  g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
+
+  if (group->stats_by_type == NULL)
+    group->stats_by_type = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  key = GSIZE_TO_POINTER (G_OBJECT_TYPE (provider));
+
+  if (!(stats = g_hash_table_lookup (group->stats_by_type, key)))
+    {
+      stats = g_new0 (DiagnoseStats, 1);
+      stats->latency_msec = DEFAULT_DIAGNOSE_DELAY;
+      g_hash_table_insert (group->stats_by_type, key, stats);
+    }
+
+  /* Recent diagnoses weigh the most, as edits change the cost */
+  stats->cancel_rate = stats->cancel_rate * .75 + (was_cancelled ? .25 : 0);
+
+  if (was_cancelled)
+    {
+      DZL_COUNTER_INC (cancelled);
+    }
+  else
+    {
+      stats->latency_msec = stats->latency_msec * .75 + latency_msec * .25;
+      record_latency (latency_msec);
+    }
+}
+
+static gint64
+ide_diagnostics_group_get_delay (IdeDiagnosticsGroup *group)
+{
+  gdouble delay = DEFAULT_DIAGNOSE_DELAY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (group != NULL);
+  g_assert (IS_DIAGNOSTICS_GROUP (group));
+
+  if (group->stats_by_type != NULL && g_hash_table_size (group->stats_by_type) > 0)
+    {
+      GHashTableIter iter;
+      gpointer value;
+
+      delay = 0;
+
+      g_hash_table_iter_init (&iter, group->stats_by_type);
+
+      /*
+       * Wait about half as long as the slowest provider takes, and up to
+       * three times that when most of its diagnoses go stale.
+       */
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          const DiagnoseStats *stats = value;
+
+          delay = MAX (delay, stats->latency_msec / 2 * (1 + 2 * stats->cancel_rate));
+        }
+    }
+
+  delay = CLAMP (delay, MIN_DIAGNOSE_DELAY, MAX_DIAGNOSE_DELAY);
+
+  if (!ide_diagnostics_group_has_focus (group))
+    delay *= BACKGROUND_DELAY_FACTOR;
+
+  return delay;
+}
+
 static void
 ide_diagnostics_group_add (IdeDiagnosticsGroup   *group,
                            IdeDiagnosticProvider *provider,
@@ -299,28 +498,41 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
                                    gpointer      user_data)
 {
   IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)object;
-  g_autoptr(IdeDiagnosticsManager) self = user_data;
+  DiagnoseState *state = user_data;
+  IdeDiagnosticsManager *self = state->self;
   g_autoptr(IdeDiagnostics) diagnostics = NULL;
   g_autoptr(GError) error = NULL;
   IdeDiagnosticsGroup *group;
-  gboolean changed;
+  gboolean was_cancelled;
+  gboolean changed = FALSE;
+  gint64 latency_msec;
 
   IDE_ENTRY;
 
   g_assert (IDE_IS_MAIN_THREAD ());
   g_assert (IDE_IS_DIAGNOSTIC_PROVIDER (provider));
   g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (state != NULL);
   g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
 
   IDE_TRACE_MSG ("%s diagnosis completed", G_OBJECT_TYPE_NAME (provider));
 
   diagnostics = ide_diagnostic_provider_diagnose_finish (provider, result, &error);
+  latency_msec = (g_get_monotonic_time () - state->begin_time) / 1000;
 
   if (error != NULL &&
       !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
       !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
     g_debug ("%s", error->message);
 
+  /*
+   * Providers that do not support cancellation still finish with results
+   * for the old contents. Those are kept as they are the newest we have,
+   * but the diagnosis counts as cancelled either way.
+   */
+  was_cancelled = g_cancellable_is_cancelled (state->cancellable) ||
+                  g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
   /*
    * This fetches the group our provider belongs to. Since the group is
    * reference counted (and we only release it when our provider is
@@ -335,15 +547,20 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
        * so it is probably related to disposal.
        */
       g_warning ("Failed to locate group, possibly disposed.");
+      diagnose_state_free (state);
       IDE_EXIT;
     }
 
   g_assert (IS_DIAGNOSTICS_GROUP (group));
 
+  ide_diagnostics_group_record (group, provider, was_cancelled, latency_msec);
+
   /*
-   * Clear all of our old diagnostics no matter where they ended up.
+   * Clear all of our old diagnostics no matter where they ended up,
+   * unless the provider gave up because they are about to be replaced.
    */
-  changed = ide_diagnostics_manager_clear_by_provider (self, provider);
+  if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    changed = ide_diagnostics_manager_clear_by_provider (self, provider);
 
   /*
    * The following adds diagnostics to the appropriate group, but tries the
@@ -393,7 +610,8 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
 
   /*
    * If there are no more diagnostics providers active and the group needs
-   * another diagnosis, then we can start the next one now.
+   * another diagnosis, then we can schedule the next one now. Files that
+   * waited for this one to complete may also begin.
    *
    * If we are completing this diagnosis and the buffer was already released
    * (and other diagnose providers have unloaded), we might be able to clean
@@ -401,14 +619,19 @@ ide_diagnostics_group_diagnose_cb (GObject      *object,
    */
   if (group->was_removed == FALSE && group->in_diagnose == 0 && group->needs_diagnose)
     {
-      ide_diagnostics_group_queue_diagnose (group, self);
+      ide_diagnostics_manager_schedule (self);
     }
   else if (ide_diagnostics_group_can_dispose (group))
     {
       group->was_removed = TRUE;
       g_hash_table_remove (self->groups_by_file, group->file);
-      IDE_EXIT;
     }
+  else if (group->in_diagnose == 0)
+    {
+      ide_diagnostics_manager_schedule (self);
+    }
+
+  diagnose_state_free (state);
 
   IDE_EXIT;
 }
@@ -422,6 +645,7 @@ ide_diagnostics_group_diagnose_foreach (IdeExtensionSetAdapter *adapter,
   IdeDiagnosticProvider *provider = (IdeDiagnosticProvider *)exten;
   IdeDiagnosticsManager *self = user_data;
   IdeDiagnosticsGroup *group;
+  DiagnoseState *state;
 
   IDE_ENTRY;
 
@@ -446,13 +670,18 @@ ide_diagnostics_group_diagnose_foreach (IdeExtensionSetAdapter *adapter,
   }
 #endif
 
+  state = g_slice_new0 (DiagnoseState);
+  state->self = g_object_ref (self);
+  state->cancellable = g_object_ref (group->cancellable);
+  state->begin_time = g_get_monotonic_time ();
+
   ide_diagnostic_provider_diagnose_async (provider,
                                           group->file,
                                           group->contents,
                                           group->lang_id,
-                                          NULL,
+                                          state->cancellable,
                                           ide_diagnostics_group_diagnose_cb,
-                                          g_object_ref (self));
+                                          state);
 
   IDE_EXIT;
 }
@@ -471,9 +700,15 @@ ide_diagnostics_group_diagnose (IdeDiagnosticsGroup   *group,
   group->needs_diagnose = FALSE;
   group->has_diagnostics = FALSE;
 
+  if (group->contents == NULL && group->buffer != NULL)
+    group->contents = ide_buffer_dup_content (group->buffer);
+
   if (group->contents == NULL)
     group->contents = g_bytes_new ("", 0);
 
+  g_clear_object (&group->cancellable);
+  group->cancellable = g_cancellable_new ();
+
   ide_extension_set_adapter_foreach (group->adapter,
                                      ide_diagnostics_group_diagnose_foreach,
                                      self);
@@ -484,18 +719,93 @@ ide_diagnostics_group_diagnose (IdeDiagnosticsGroup   *group,
 }
 
 static gboolean
-ide_diagnostics_manager_begin_diagnose (gpointer data)
+ide_diagnostics_manager_focused_busy (IdeDiagnosticsManager *self)
 {
-  IdeDiagnosticsManager *self = data;
   GHashTableIter iter;
   gpointer value;
 
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  g_hash_table_iter_init (&iter, self->groups_by_file);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      IdeDiagnosticsGroup *group = value;
+
+      if (group->in_diagnose > 0 && ide_diagnostics_group_has_focus (group))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+ide_diagnostics_manager_begin_diagnose (gpointer data)
+{
+  IdeDiagnosticsManager *self = data;
+  gboolean focused_busy;
+  gint64 now;
+
   IDE_ENTRY;
 
   g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
 
   self->queued_diagnose_source = 0;
 
+  now = g_get_monotonic_time ();
+  focused_busy = ide_diagnostics_manager_focused_busy (self);
+
+  /* Focused files first, then the others unless they would compete */
+  for (guint pass = 0; pass < 2; pass++)
+    {
+      GHashTableIter iter;
+      gpointer value;
+
+      g_hash_table_iter_init (&iter, self->groups_by_file);
+
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        {
+          IdeDiagnosticsGroup *group = value;
+          gboolean has_focus;
+
+          g_assert (group != NULL);
+          g_assert (IS_DIAGNOSTICS_GROUP (group));
+
+          if (!ide_diagnostics_group_can_begin (group) || group->ready_time > now)
+            continue;
+
+          has_focus = ide_diagnostics_group_has_focus (group);
+
+          if (pass == 0 && has_focus)
+            {
+              ide_diagnostics_group_diagnose (group, self);
+              focused_busy = TRUE;
+            }
+          else if (pass == 1 && !has_focus && !focused_busy)
+            {
+              ide_diagnostics_group_diagnose (group, self);
+            }
+        }
+    }
+
+  ide_diagnostics_manager_schedule (self);
+
+  IDE_RETURN (G_SOURCE_REMOVE);
+}
+
+static void
+ide_diagnostics_manager_schedule (IdeDiagnosticsManager *self)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gboolean focused_busy;
+  gint64 ready_time = G_MAXINT64;
+  gint64 now;
+
+  g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
+
+  focused_busy = ide_diagnostics_manager_focused_busy (self);
+
   g_hash_table_iter_init (&iter, self->groups_by_file);
 
   while (g_hash_table_iter_next (&iter, NULL, &value))
@@ -505,11 +815,32 @@ ide_diagnostics_manager_begin_diagnose (gpointer data)
       g_assert (group != NULL);
       g_assert (IS_DIAGNOSTICS_GROUP (group));
 
-      if (group->needs_diagnose && group->adapter != NULL && group->in_diagnose == 0)
-        ide_diagnostics_group_diagnose (group, self);
+      /* Completion of the focused diagnosis reschedules the others */
+      if (!ide_diagnostics_group_can_begin (group) ||
+          (focused_busy && !ide_diagnostics_group_has_focus (group)))
+        continue;
+
+      ready_time = MIN (ready_time, group->ready_time);
     }
 
-  IDE_RETURN (G_SOURCE_REMOVE);
+  if (ready_time == G_MAXINT64)
+    {
+      g_clear_handle_id (&self->queued_diagnose_source, g_source_remove);
+      return;
+    }
+
+  /* A timer firing early will just reschedule */
+  if (self->queued_diagnose_source != 0 && self->queued_ready_time <= ready_time)
+    return;
+
+  now = g_get_monotonic_time ();
+
+  g_clear_handle_id (&self->queued_diagnose_source, g_source_remove);
+  self->queued_ready_time = ready_time;
+  self->queued_diagnose_source = g_timeout_add_full (G_PRIORITY_LOW,
+                                                     MAX (0, ready_time - now) / 1000,
+                                                     ide_diagnostics_manager_begin_diagnose,
+                                                     self, NULL);
 }
 
 static void
@@ -521,19 +852,15 @@ ide_diagnostics_group_queue_diagnose (IdeDiagnosticsGroup   *group,
   g_assert (IDE_IS_DIAGNOSTICS_MANAGER (self));
 
   /*
-   * This checks to see if we are diagnosing and if not queues a diagnose.
-   * If a diagnosis is already running, we don't need to do anything now
-   * because the completion of the diagnose will tick off the next diagnose
-   * upon seening group->needs_diagnose==TRUE.
+   * This restarts the delay for the group and schedules a diagnose. If a
+   * diagnosis is already running, the completion of the diagnose will
+   * schedule the next one upon seeing group->needs_diagnose==TRUE.
    */
 
   group->needs_diagnose = TRUE;
+  group->ready_time = g_get_monotonic_time () + ide_diagnostics_group_get_delay (group) * 1000;
 
-  if (group->in_diagnose == 0 && self->queued_diagnose_source == 0)
-    self->queued_diagnose_source = g_timeout_add_full (G_PRIORITY_LOW,
-                                                       DEFAULT_DIAGNOSE_DELAY,
-                                                       ide_diagnostics_manager_begin_diagnose,
-                                                       self, NULL);
+  ide_diagnostics_manager_schedule (self);
 }
 
 static void
@@ -1050,6 +1377,7 @@ _ide_diagnostics_manager_file_closed (IdeDiagnosticsManager *self,
 
   /* Clear some state we've been tracking */
   g_clear_pointer (&group->contents, g_bytes_unref);
+  g_clear_weak_pointer (&group->buffer);
   group->lang_id = NULL;
   group->needs_diagnose = FALSE;
 
@@ -1104,6 +1432,33 @@ _ide_diagnostics_manager_file_changed (IdeDiagnosticsManager *self,
   group->lang_id = g_intern_string (lang_id);
   group->contents = contents ? g_bytes_ref (contents) : NULL;
 
+  ide_diagnostics_group_cancel (group);
+  ide_diagnostics_group_queue_diagnose (group, self);
+}
+
+/*
+ * Like _ide_diagnostics_manager_file_changed() but the contents are only
+ * copied from @buffer when the diagnosis begins, so that this may be
+ * called for every change to the buffer.
+ */
+void
+_ide_diagnostics_manager_buffer_changed (IdeDiagnosticsManager *self,
+                                         IdeBuffer             *buffer)
+{
+  IdeDiagnosticsGroup *group;
+
+  g_return_if_fail (IDE_IS_MAIN_THREAD ());
+  g_return_if_fail (IDE_IS_DIAGNOSTICS_MANAGER (self));
+  g_return_if_fail (IDE_IS_BUFFER (buffer));
+
+  group = ide_diagnostics_manager_find_group (self, ide_buffer_get_file (buffer));
+
+  g_clear_pointer (&group->contents, g_bytes_unref);
+  g_set_weak_pointer (&group->buffer, buffer);
+
+  group->lang_id = g_intern_string (ide_buffer_get_language_id (buffer));
+
+  ide_diagnostics_group_cancel (group);
   ide_diagnostics_group_queue_diagnose (group, self);
 }
 
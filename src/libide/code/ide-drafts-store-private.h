@@ -0,0 +1,57 @@
+/* ide-drafts-store-private.h
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _IdeDraftsStore IdeDraftsStore;
+
+typedef struct
+{
+  const gchar *uri;
+  GBytes      *content;
+} IdeDraft;
+
+typedef struct
+{
+  guint n_written;
+  guint n_chunks_written;
+  gsize bytes_written;
+} IdeDraftsStoreStats;
+
+IdeDraftsStore *_ide_drafts_store_new     (const gchar          *directory);
+void            _ide_drafts_store_free    (IdeDraftsStore       *self);
+gboolean        _ide_drafts_store_exists  (IdeDraftsStore       *self);
+GHashTable     *_ide_drafts_store_load    (IdeDraftsStore       *self,
+                                           GError              **error);
+gboolean        _ide_drafts_store_save    (IdeDraftsStore       *self,
+                                           const IdeDraft       *drafts,
+                                           guint                 n_drafts,
+                                           IdeDraftsStoreStats  *stats,
+                                           GError              **error);
+void            _ide_drafts_store_remove  (IdeDraftsStore       *self,
+                                           const gchar          *uri);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeDraftsStore, _ide_drafts_store_free)
+
+G_END_DECLS
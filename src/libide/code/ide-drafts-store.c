@@ -0,0 +1,895 @@
+/* ide-drafts-store.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ide-drafts-store"
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ide-drafts-store-private.h"
+
+/*
+ * Drafts are kept in a single append-only journal. The contents of a
+ * draft are cut into chunks at positions chosen by a rolling hash, so an
+ * edit only changes the chunks around it. Chunks are addressed by their
+ * SHA-1 and are shared between drafts and between versions of a draft.
+ *
+ * Saving appends the chunks that are not in the journal yet, followed by
+ * a record listing the chunks of each draft that changed. Loading reads
+ * the journal once from start to end; a record that was only partially
+ * written is ignored and overwritten by the next save. The journal is
+ * rewritten with only the chunks still in use once most of it is garbage.
+ */
+
+#define JOURNAL_NAME     "journal"
+#define JOURNAL_MAGIC    "IDEDRFT1"
+#define MAGIC_LEN        8
+#define DIGEST_LEN       20
+#define MIN_CHUNK_SIZE   (2 * 1024)
+#define MAX_CHUNK_SIZE   (64 * 1024)
+#define CHUNK_BITS       13
+#define MIN_COMPACT_SIZE (4 * 1024 * 1024)
+
+enum {
+  RECORD_CHUNK  = 1,
+  RECORD_DRAFT  = 2,
+  RECORD_REMOVE = 3,
+};
+
+typedef struct
+{
+  guint32 type;
+  guint32 len;
+} RecordHeader;
+
+typedef struct
+{
+  /* Position of the chunk record within the journal */
+  guint64 offset;
+  guint32 len;
+} ChunkRef;
+
+typedef struct
+{
+  GArray *chunks;
+  /* The contents last saved or loaded, compared by address only */
+  GBytes *content;
+} Draft;
+
+struct _IdeDraftsStore
+{
+  GMutex      mutex;
+  gchar      *directory;
+  gchar      *path;
+  GHashTable *chunks;
+  GHashTable *drafts;
+  GHashTable *pending_removals;
+  guint64     length;
+  guint       loaded : 1;
+};
+
+static guint64 gear[256];
+
+static void
+init_gear (void)
+{
+  static gsize initialized;
+
+  if (g_once_init_enter (&initialized))
+    {
+      guint64 state = G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+
+      /* splitmix64, so the table and therefore chunk boundaries are stable */
+      for (guint i = 0; i < G_N_ELEMENTS (gear); i++)
+        {
+          guint64 z = (state += G_GUINT64_CONSTANT (0x9e3779b97f4a7c15));
+
+          z = (z ^ (z >> 30)) * G_GUINT64_CONSTANT (0xbf58476d1ce4e5b9);
+          z = (z ^ (z >> 27)) * G_GUINT64_CONSTANT (0x94d049bb133111eb);
+          gear[i] = z ^ (z >> 31);
+        }
+
+      g_once_init_leave (&initialized, TRUE);
+    }
+}
+
+static gsize
+next_chunk_len (const guint8 *data,
+                gsize         len)
+{
+  guint64 hash = 0;
+
+  if (len <= MIN_CHUNK_SIZE)
+    return len;
+
+  len = MIN (len, MAX_CHUNK_SIZE);
+
+  /* The hash only depends on the last 64 bytes */
+  for (gsize i = MIN_CHUNK_SIZE - 64; i < len; i++)
+    {
+      hash = (hash << 1) + gear[data[i]];
+
+      if (i >= MIN_CHUNK_SIZE && (hash >> (64 - CHUNK_BITS)) == 0)
+        return i + 1;
+    }
+
+  return len;
+}
+
+static void
+chunk_ref_free (gpointer data)
+{
+  g_slice_free (ChunkRef, data);
+}
+
+static void
+draft_free (gpointer data)
+{
+  Draft *draft = data;
+
+  g_clear_pointer (&draft->chunks, g_array_unref);
+  g_clear_pointer (&draft->content, g_bytes_unref);
+  g_slice_free (Draft, draft);
+}
+
+static Draft *
+draft_new (GArray *chunks)
+{
+  Draft *draft = g_slice_new0 (Draft);
+  draft->chunks = chunks;
+  return draft;
+}
+
+static gboolean
+chunks_equal (const GArray *a,
+              const GArray *b)
+{
+  if (a->len != b->len)
+    return FALSE;
+
+  for (guint i = 0; i < a->len; i++)
+    {
+      if (g_array_index (a, ChunkRef, i).offset != g_array_index (b, ChunkRef, i).offset)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+append_record_header (GByteArray *buf,
+                      guint32     type,
+                      gsize       len)
+{
+  RecordHeader header = { GUINT32_TO_LE (type), GUINT32_TO_LE ((guint32)len) };
+
+  g_byte_array_append (buf, (const guint8 *)&header, sizeof header);
+}
+
+static void
+append_uint32 (GByteArray *buf,
+               guint32     value)
+{
+  value = GUINT32_TO_LE (value);
+  g_byte_array_append (buf, (const guint8 *)&value, sizeof value);
+}
+
+static void
+append_uint64 (GByteArray *buf,
+               guint64     value)
+{
+  value = GUINT64_TO_LE (value);
+  g_byte_array_append (buf, (const guint8 *)&value, sizeof value);
+}
+
+static guint32
+read_uint32 (const guint8 *data)
+{
+  guint32 value;
+  memcpy (&value, data, sizeof value);
+  return GUINT32_FROM_LE (value);
+}
+
+static guint64
+read_uint64 (const guint8 *data)
+{
+  guint64 value;
+  memcpy (&value, data, sizeof value);
+  return GUINT64_FROM_LE (value);
+}
+
+static void
+append_draft_record (GByteArray   *buf,
+                     const gchar  *uri,
+                     const GArray *chunks)
+{
+  gsize uri_len = strlen (uri);
+
+  append_record_header (buf, RECORD_DRAFT, 4 + uri_len + 4 + chunks->len * 8);
+  append_uint32 (buf, uri_len);
+  g_byte_array_append (buf, (const guint8 *)uri, uri_len);
+  append_uint32 (buf, chunks->len);
+
+  for (guint i = 0; i < chunks->len; i++)
+    append_uint64 (buf, g_array_index (chunks, ChunkRef, i).offset);
+}
+
+static void
+append_remove_record (GByteArray  *buf,
+                      const gchar *uri)
+{
+  gsize uri_len = strlen (uri);
+
+  append_record_header (buf, RECORD_REMOVE, uri_len);
+  g_byte_array_append (buf, (const guint8 *)uri, uri_len);
+}
+
+static Draft *
+parse_draft_record (const guint8  *data,
+                    gsize          len,
+                    GHashTable    *chunks_by_offset,
+                    gchar        **uri)
+{
+  g_autoptr(GArray) chunks = NULL;
+  guint32 uri_len;
+  guint32 n_chunks;
+
+  if (len < 8 || (uri_len = read_uint32 (data)) > len - 8)
+    return NULL;
+
+  n_chunks = read_uint32 (data + 4 + uri_len);
+
+  if ((gsize)n_chunks * 8 != len - 8 - uri_len)
+    return NULL;
+
+  chunks = g_array_sized_new (FALSE, FALSE, sizeof (ChunkRef), n_chunks);
+
+  for (guint i = 0; i < n_chunks; i++)
+    {
+      guint64 offset = read_uint64 (data + 8 + uri_len + i * 8);
+      const ChunkRef *ref;
+
+      /* Chunks must have been written before the drafts using them */
+      if (!(ref = g_hash_table_lookup (chunks_by_offset, &offset)))
+        return NULL;
+
+      g_array_append_vals (chunks, ref, 1);
+    }
+
+  *uri = g_strndup ((const gchar *)data + 4, uri_len);
+
+  return draft_new (g_steal_pointer (&chunks));
+}
+
+static void
+ide_drafts_store_parse_locked (IdeDraftsStore *self,
+                               const guint8   *data,
+                               gsize           len)
+{
+  g_autoptr(GHashTable) chunks_by_offset = NULL;
+  gsize pos = MAGIC_LEN;
+
+  g_assert (self != NULL);
+
+  g_hash_table_remove_all (self->chunks);
+  g_hash_table_remove_all (self->drafts);
+  self->length = 0;
+
+  if (len < MAGIC_LEN || memcmp (data, JOURNAL_MAGIC, MAGIC_LEN) != 0)
+    {
+      if (len > 0)
+        g_warning ("Discarding drafts journal with unknown format");
+      return;
+    }
+
+  chunks_by_offset = g_hash_table_new (g_int64_hash, g_int64_equal);
+
+  while (pos + sizeof (RecordHeader) <= len)
+    {
+      const guint8 *payload = data + pos + sizeof (RecordHeader);
+      guint32 type = read_uint32 (data + pos);
+      guint32 record_len = read_uint32 (data + pos + 4);
+
+      /* A record cut short by a crash ends the journal */
+      if (record_len > len - pos - sizeof (RecordHeader))
+        break;
+
+      if (type == RECORD_CHUNK && record_len >= DIGEST_LEN)
+        {
+          g_autoptr(GBytes) digest = g_bytes_new (payload, DIGEST_LEN);
+
+          if (!g_hash_table_contains (self->chunks, digest))
+            {
+              ChunkRef *ref = g_slice_new (ChunkRef);
+
+              ref->offset = pos;
+              ref->len = record_len - DIGEST_LEN;
+
+              g_hash_table_insert (self->chunks, g_steal_pointer (&digest), ref);
+              g_hash_table_insert (chunks_by_offset, &ref->offset, ref);
+            }
+        }
+      else if (type == RECORD_DRAFT)
+        {
+          g_autofree gchar *uri = NULL;
+          Draft *draft;
+
+          if ((draft = parse_draft_record (payload, record_len, chunks_by_offset, &uri)))
+            g_hash_table_insert (self->drafts, g_steal_pointer (&uri), draft);
+        }
+      else if (type == RECORD_REMOVE)
+        {
+          g_autofree gchar *uri = g_strndup ((const gchar *)payload, record_len);
+
+          g_hash_table_remove (self->drafts, uri);
+        }
+
+      pos += sizeof (RecordHeader) + record_len;
+    }
+
+  self->length = pos;
+}
+
+static gboolean
+ide_drafts_store_read_locked (IdeDraftsStore  *self,
+                              gchar          **contents,
+                              gsize           *len,
+                              GError         **error)
+{
+  g_autoptr(GError) local_error = NULL;
+  GHashTableIter iter;
+  gpointer key;
+
+  g_assert (self != NULL);
+  g_assert (contents != NULL);
+  g_assert (len != NULL);
+
+  if (!g_file_get_contents (self->path, contents, len, &local_error))
+    {
+      if (!g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+          g_propagate_error (error, g_steal_pointer (&local_error));
+          return FALSE;
+        }
+
+      *contents = NULL;
+      *len = 0;
+    }
+
+  ide_drafts_store_parse_locked (self, (const guint8 *)*contents, *len);
+
+  /* Drafts removed before the journal was read stay removed */
+  g_hash_table_iter_init (&iter, self->pending_removals);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_hash_table_remove (self->drafts, key);
+
+  self->loaded = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+ide_drafts_store_write_locked (IdeDraftsStore    *self,
+                               const GByteArray  *buf,
+                               gboolean           sync,
+                               GError           **error)
+{
+  gsize pos = 0;
+  gint errsv;
+  gint fd;
+
+  g_assert (self != NULL);
+  g_assert (buf != NULL);
+
+  if (g_mkdir_with_parents (self->directory, 0700) != 0)
+    goto failure;
+
+  if (-1 == (fd = g_open (self->path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600)))
+    goto failure;
+
+  /* Drop anything after the last complete record */
+  if (ftruncate (fd, self->length) != 0 || lseek (fd, self->length, SEEK_SET) == -1)
+    goto close_failure;
+
+  while (pos < buf->len)
+    {
+      gssize n_written = write (fd, buf->data + pos, buf->len - pos);
+
+      if (n_written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          goto close_failure;
+        }
+
+      pos += n_written;
+    }
+
+  if (sync && fsync (fd) != 0)
+    goto close_failure;
+
+  close (fd);
+
+  self->length += buf->len;
+
+  return TRUE;
+
+close_failure:
+  errsv = errno;
+  close (fd);
+  errno = errsv;
+
+failure:
+  errsv = errno;
+
+  g_set_error (error,
+               G_IO_ERROR,
+               g_io_error_from_errno (errsv),
+               "Failed to write drafts journal: %s",
+               g_strerror (errsv));
+
+  /* Our tables no longer match the journal, read it again next time */
+  self->loaded = FALSE;
+
+  return FALSE;
+}
+
+static gboolean
+ide_drafts_store_maybe_compact_locked (IdeDraftsStore  *self,
+                                       GError         **error)
+{
+  g_autoptr(GHashTable) offsets = NULL;
+  g_autoptr(GHashTable) contents = NULL;
+  g_autoptr(GByteArray) buf = NULL;
+  g_autofree gchar *old_data = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  gsize old_len = 0;
+  gsize live = 0;
+
+  g_assert (self != NULL);
+
+  if (self->length < MIN_COMPACT_SIZE)
+    return TRUE;
+
+  offsets = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, g_free);
+
+  g_hash_table_iter_init (&iter, self->drafts);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      const Draft *draft = value;
+
+      for (guint i = 0; i < draft->chunks->len; i++)
+        {
+          const ChunkRef *ref = &g_array_index (draft->chunks, ChunkRef, i);
+
+          if (!g_hash_table_contains (offsets, &ref->offset))
+            {
+              g_hash_table_insert (offsets, g_memdup2 (&ref->offset, sizeof ref->offset), NULL);
+              live += sizeof (RecordHeader) + DIGEST_LEN + ref->len;
+            }
+        }
+    }
+
+  if (self->length < live * 2)
+    return TRUE;
+
+  g_debug ("Compacting drafts journal from %"G_GUINT64_FORMAT" to about %"G_GSIZE_FORMAT" bytes",
+           self->length, live);
+
+  if (!g_file_get_contents (self->path, &old_data, &old_len, error))
+    return FALSE;
+
+  if (old_len < self->length)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Drafts journal was truncated");
+      self->loaded = FALSE;
+      return FALSE;
+    }
+
+  /* Copy the chunks in use, then a draft record using their new offsets */
+  buf = g_byte_array_sized_new (live + MAGIC_LEN);
+  g_byte_array_append (buf, (const guint8 *)JOURNAL_MAGIC, MAGIC_LEN);
+
+  g_hash_table_iter_init (&iter, offsets);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      guint64 offset = *(guint64 *)key;
+      guint32 record_len = read_uint32 ((const guint8 *)old_data + offset + 4);
+      guint64 *new_offset = g_new (guint64, 1);
+
+      *new_offset = buf->len;
+      g_hash_table_iter_replace (&iter, new_offset);
+      g_byte_array_append (buf, (const guint8 *)old_data + offset, sizeof (RecordHeader) + record_len);
+    }
+
+  contents = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_bytes_unref);
+
+  g_hash_table_iter_init (&iter, self->drafts);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const Draft *draft = value;
+
+      for (guint i = 0; i < draft->chunks->len; i++)
+        {
+          ChunkRef *ref = &g_array_index (draft->chunks, ChunkRef, i);
+          ref->offset = *(guint64 *)g_hash_table_lookup (offsets, &ref->offset);
+        }
+
+      append_draft_record (buf, key, draft->chunks);
+
+      if (draft->content != NULL)
+        g_hash_table_insert (contents, g_strdup (key), g_bytes_ref (draft->content));
+    }
+
+  if (!g_file_set_contents (self->path, (const gchar *)buf->data, buf->len, error))
+    {
+      self->loaded = FALSE;
+      return FALSE;
+    }
+
+  ide_drafts_store_parse_locked (self, buf->data, buf->len);
+
+  /* Parsing loses the contents we already know to be saved */
+  g_hash_table_iter_init (&iter, contents);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      Draft *draft = g_hash_table_lookup (self->drafts, key);
+
+      if (draft != NULL)
+        draft->content = g_bytes_ref (value);
+    }
+
+  return TRUE;
+}
+
+IdeDraftsStore *
+_ide_drafts_store_new (const gchar *directory)
+{
+  IdeDraftsStore *self;
+
+  g_return_val_if_fail (directory != NULL, NULL);
+
+  init_gear ();
+
+  self = g_slice_new0 (IdeDraftsStore);
+  g_mutex_init (&self->mutex);
+  self->directory = g_strdup (directory);
+  self->path = g_build_filename (directory, JOURNAL_NAME, NULL);
+  self->chunks = g_hash_table_new_full ((GHashFunc)g_bytes_hash,
+                                        (GEqualFunc)g_bytes_equal,
+                                        (GDestroyNotify)g_bytes_unref,
+                                        chunk_ref_free);
+  self->drafts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, draft_free);
+  self->pending_removals = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  return self;
+}
+
+void
+_ide_drafts_store_free (IdeDraftsStore *self)
+{
+  if (self == NULL)
+    return;
+
+  g_clear_pointer (&self->chunks, g_hash_table_unref);
+  g_clear_pointer (&self->drafts, g_hash_table_unref);
+  g_clear_pointer (&self->pending_removals, g_hash_table_unref);
+  g_clear_pointer (&self->directory, g_free);
+  g_clear_pointer (&self->path, g_free);
+  g_mutex_clear (&self->mutex);
+  g_slice_free (IdeDraftsStore, self);
+}
+
+/**
+ * _ide_drafts_store_exists:
+ * @self: an #IdeDraftsStore
+ *
+ * Checks if the journal has been written, so that drafts in the previous
+ * format can be migrated.
+ *
+ * Returns: %TRUE if the journal file exists
+ */
+gboolean
+_ide_drafts_store_exists (IdeDraftsStore *self)
+{
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  return g_file_test (self->path, G_FILE_TEST_IS_REGULAR);
+}
+
+/**
+ * _ide_drafts_store_load:
+ * @self: an #IdeDraftsStore
+ * @error: a location for a #GError, or %NULL
+ *
+ * Reads the journal and reassembles every draft. This blocks on I/O and
+ * should be called from a worker thread.
+ *
+ * Returns: (transfer full) (element-type utf8 GBytes): a #GHashTable of
+ *   uri to contents, or %NULL and @error is set
+ */
+GHashTable *
+_ide_drafts_store_load (IdeDraftsStore  *self,
+                        GError         **error)
+{
+  g_autoptr(GHashTable) ret = NULL;
+  g_autofree gchar *data = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  gsize len = 0;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (!ide_drafts_store_read_locked (self, &data, &len, error))
+    {
+      g_mutex_unlock (&self->mutex);
+      return NULL;
+    }
+
+  ret = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_bytes_unref);
+
+  g_hash_table_iter_init (&iter, self->drafts);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      Draft *draft = value;
+      GByteArray *content;
+      gsize size = 0;
+
+      for (guint i = 0; i < draft->chunks->len; i++)
+        size += g_array_index (draft->chunks, ChunkRef, i).len;
+
+      content = g_byte_array_sized_new (size + 1);
+
+      for (guint i = 0; i < draft->chunks->len; i++)
+        {
+          const ChunkRef *ref = &g_array_index (draft->chunks, ChunkRef, i);
+
+          g_byte_array_append (content,
+                               (const guint8 *)data + ref->offset + sizeof (RecordHeader) + DIGEST_LEN,
+                               ref->len);
+        }
+
+      /* Keep contents \0 terminated like buffers do, without counting it */
+      g_byte_array_append (content, (const guint8 *)"", 1);
+      g_byte_array_set_size (content, size);
+
+      g_clear_pointer (&draft->content, g_bytes_unref);
+      draft->content = g_byte_array_free_to_bytes (content);
+
+      g_hash_table_insert (ret, g_strdup (key), g_bytes_ref (draft->content));
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return g_steal_pointer (&ret);
+}
+
+/**
+ * _ide_drafts_store_save:
+ * @self: an #IdeDraftsStore
+ * @drafts: (array length=n_drafts): the drafts to keep
+ * @n_drafts: the number of elements in @drafts
+ * @stats: (out) (optional): location for what was written
+ * @error: a location for a #GError, or %NULL
+ *
+ * Updates the journal so that it contains exactly @drafts. Only chunks
+ * that are not already in the journal are written, and drafts whose
+ * contents are the same #GBytes as last time are not chunked again. This
+ * blocks on I/O and should be called from a worker thread.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set
+ */
+gboolean
+_ide_drafts_store_save (IdeDraftsStore       *self,
+                        const IdeDraft       *drafts,
+                        guint                 n_drafts,
+                        IdeDraftsStoreStats  *stats,
+                        GError              **error)
+{
+  g_autoptr(GHashTable) seen = NULL;
+  g_autoptr(GByteArray) buf = NULL;
+  g_autoptr(GChecksum) checksum = NULL;
+  g_autoptr(GError) compact_error = NULL;
+  IdeDraftsStoreStats local_stats = {0};
+  GHashTableIter iter;
+  gpointer key;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (drafts != NULL || n_drafts == 0, FALSE);
+
+  g_mutex_lock (&self->mutex);
+
+  if (!self->loaded)
+    {
+      g_autofree gchar *data = NULL;
+      gsize len = 0;
+
+      if (!ide_drafts_store_read_locked (self, &data, &len, error))
+        goto unlock;
+    }
+
+  buf = g_byte_array_new ();
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+  if (self->length == 0)
+    g_byte_array_append (buf, (const guint8 *)JOURNAL_MAGIC, MAGIC_LEN);
+
+  for (guint i = 0; i < n_drafts; i++)
+    {
+      const IdeDraft *item = &drafts[i];
+      const guint8 *data = g_bytes_get_data (item->content, NULL);
+      gsize len = g_bytes_get_size (item->content);
+      g_autoptr(GArray) chunks = NULL;
+      gsize pos = 0;
+      Draft *draft;
+
+      g_hash_table_add (seen, (gpointer)item->uri);
+
+      draft = g_hash_table_lookup (self->drafts, item->uri);
+
+      if (draft != NULL && draft->content == item->content)
+        continue;
+
+      chunks = g_array_new (FALSE, FALSE, sizeof (ChunkRef));
+
+      /* Empty drafts are a single empty chunk */
+      do
+        {
+          g_autoptr(GBytes) digest = NULL;
+          guint8 digest_data[DIGEST_LEN];
+          gsize digest_len = sizeof digest_data;
+          gsize chunk_len = next_chunk_len (data + pos, len - pos);
+          ChunkRef *ref;
+
+          g_checksum_reset (checksum);
+          g_checksum_update (checksum, data + pos, chunk_len);
+          g_checksum_get_digest (checksum, digest_data, &digest_len);
+          digest = g_bytes_new (digest_data, DIGEST_LEN);
+
+          if (!(ref = g_hash_table_lookup (self->chunks, digest)))
+            {
+              ref = g_slice_new (ChunkRef);
+              ref->offset = self->length + buf->len;
+              ref->len = chunk_len;
+
+              append_record_header (buf, RECORD_CHUNK, DIGEST_LEN + chunk_len);
+              g_byte_array_append (buf, digest_data, DIGEST_LEN);
+              g_byte_array_append (buf, data + pos, chunk_len);
+
+              g_hash_table_insert (self->chunks, g_steal_pointer (&digest), ref);
+
+              local_stats.n_chunks_written++;
+            }
+
+          g_array_append_vals (chunks, ref, 1);
+
+          pos += chunk_len;
+        }
+      while (pos < len);
+
+      if (draft == NULL || !chunks_equal (draft->chunks, chunks))
+        {
+          append_draft_record (buf, item->uri, chunks);
+          draft = draft_new (g_steal_pointer (&chunks));
+          g_hash_table_insert (self->drafts, g_strdup (item->uri), draft);
+          local_stats.n_written++;
+        }
+
+      g_clear_pointer (&draft->content, g_bytes_unref);
+      draft->content = g_bytes_ref (item->content);
+    }
+
+  /* Everything that is not part of this save has been discarded */
+  g_hash_table_iter_init (&iter, self->drafts);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (!g_hash_table_contains (seen, key))
+        {
+          append_remove_record (buf, key);
+          g_hash_table_iter_remove (&iter);
+        }
+    }
+
+  g_hash_table_iter_init (&iter, self->pending_removals);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (!g_hash_table_contains (seen, key))
+        append_remove_record (buf, key);
+    }
+
+  local_stats.bytes_written = buf->len;
+
+  if (buf->len > 0 && !ide_drafts_store_write_locked (self, buf, TRUE, error))
+    goto unlock;
+
+  g_hash_table_remove_all (self->pending_removals);
+
+  if (stats != NULL)
+    *stats = local_stats;
+
+  /* The drafts are saved even if the journal could not be compacted */
+  if (!ide_drafts_store_maybe_compact_locked (self, &compact_error))
+    g_warning ("Failed to compact drafts journal: %s", compact_error->message);
+
+  ret = TRUE;
+
+unlock:
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/**
+ * _ide_drafts_store_remove:
+ * @self: an #IdeDraftsStore
+ * @uri: the uri of the draft
+ *
+ * Removes the draft for @uri. This only appends a small record to the
+ * journal, without waiting for it to reach the disk. If the journal has
+ * not been read yet, the removal is written by the next save.
+ */
+void
+_ide_drafts_store_remove (IdeDraftsStore *self,
+                          const gchar    *uri)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (uri != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (!self->loaded)
+    {
+      g_hash_table_add (self->pending_removals, g_strdup (uri));
+    }
+  else if (g_hash_table_remove (self->drafts, uri))
+    {
+      g_autoptr(GByteArray) buf = g_byte_array_new ();
+      g_autoptr(GError) error = NULL;
+
+      if (self->length == 0)
+        g_byte_array_append (buf, (const guint8 *)JOURNAL_MAGIC, MAGIC_LEN);
+
+      append_remove_record (buf, uri);
+
+      if (!ide_drafts_store_write_locked (self, buf, FALSE, &error))
+        {
+          g_debug ("%s", error->message);
+          g_hash_table_add (self->pending_removals, g_strdup (uri));
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+}
@@ -31,6 +31,7 @@
 #include "ide-buffer.h"
 #include "ide-buffer-private.h"
 #include "ide-highlight-engine.h"
+#include "ide-highlight-engine-private.h"
 #include "ide-highlight-index.h"
 #include "ide-highlighter.h"
 
@@ -49,17 +50,38 @@ struct _IdeHighlightEngine
 
   IdeExtensionAdapter *extension;
 
-  GtkTextMark         *invalid_begin;
-  GtkTextMark         *invalid_end;
+  /* The ranges of the buffer which still need to be highlighted */
+  GtkSourceRegion     *invalid;
 
   GSList              *private_tags;
   GSList              *public_tags;
 
+  /*
+   * GtkTextViews displaying the buffer, without a reference. Invalid
+   * ranges within their visible area are highlighted first, and the
+   * work is driven by the frame clock of @tick_view while one of them
+   * shows invalid ranges.
+   */
+  GPtrArray           *views;
+  GtkWidget           *tick_view;
+  guint                tick_handler;
+
   gint64               quanta_expiration;
 
+  /*
+   * Tracks how long it takes from the visible area being invalidated
+   * until it has been highlighted again.
+   */
+  gint64               visible_invalid_at;
+  gint64               visible_latency_last;
+  gint64               visible_latency_max;
+  gint64               visible_latency_total;
+  guint                visible_latency_count;
+
   guint                work_timeout;
 
   guint                enabled : 1;
+  guint                visible_dirty : 1;
 };
 
 G_DEFINE_TYPE (IdeHighlightEngine, ide_highlight_engine, IDE_TYPE_OBJECT)
@@ -310,6 +332,182 @@ ide_highlight_engine_apply_style (const GtkTextIter *begin,
   return IDE_HIGHLIGHT_CONTINUE;
 }
 
+static gboolean
+get_visible_range (GtkTextView *view,
+                   GtkTextIter *begin,
+                   GtkTextIter *end)
+{
+  GdkRectangle rect;
+
+  g_assert (GTK_IS_TEXT_VIEW (view));
+
+  if (!gtk_widget_get_mapped (GTK_WIDGET (view)))
+    return FALSE;
+
+  gtk_text_view_get_visible_rect (view, &rect);
+  gtk_text_view_get_line_at_y (view, begin, rect.y, NULL);
+  gtk_text_view_get_line_at_y (view, end, rect.y + rect.height, NULL);
+  gtk_text_iter_forward_line (end);
+
+  return TRUE;
+}
+
+static gboolean
+get_first_invalid (IdeHighlightEngine *self,
+                   const GtkTextIter  *begin,
+                   const GtkTextIter  *end,
+                   GtkTextIter        *invalid_begin,
+                   GtkTextIter        *invalid_end)
+{
+  g_autoptr(GtkSourceRegion) region = NULL;
+  GtkSourceRegionIter iter;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (gtk_text_iter_compare (begin, end) >= 0)
+    return FALSE;
+
+  if (!(region = gtk_source_region_intersect_subregion (self->invalid, begin, end)))
+    return FALSE;
+
+  gtk_source_region_get_start_region_iter (region, &iter);
+
+  return gtk_source_region_iter_get_subregion (&iter, invalid_begin, invalid_end);
+}
+
+/*
+ * Finds the next range to highlight. Invalid ranges within the visible
+ * area of our views come first, followed by those nearest to it, in
+ * windows which double in size each time. Without any visible views,
+ * the buffer is processed from the top.
+ */
+static gboolean
+get_next_range (IdeHighlightEngine *self,
+                GtkTextBuffer      *buffer,
+                GtkTextIter        *begin,
+                GtkTextIter        *end,
+                gboolean           *visible)
+{
+  struct {
+    GtkTextIter begin;
+    GtkTextIter end;
+    gint        n_lines;
+  } ranges[8];
+  GtkSourceRegionIter iter;
+  guint n_ranges = 0;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (GTK_IS_TEXT_BUFFER (buffer));
+  g_assert (begin != NULL);
+  g_assert (end != NULL);
+  g_assert (visible != NULL);
+
+  *visible = FALSE;
+
+  if (gtk_source_region_is_empty (self->invalid))
+    return FALSE;
+
+  for (guint i = 0; i < self->views->len && n_ranges < G_N_ELEMENTS (ranges); i++)
+    {
+      GtkTextView *view = g_ptr_array_index (self->views, i);
+
+      if (get_visible_range (view, &ranges[n_ranges].begin, &ranges[n_ranges].end))
+        {
+          ranges[n_ranges].n_lines = MAX (1, gtk_text_iter_get_line (&ranges[n_ranges].end) -
+                                             gtk_text_iter_get_line (&ranges[n_ranges].begin));
+          n_ranges++;
+        }
+    }
+
+  for (guint i = 0; i < n_ranges; i++)
+    {
+      if (get_first_invalid (self, &ranges[i].begin, &ranges[i].end, begin, end))
+        {
+          *visible = TRUE;
+          return TRUE;
+        }
+    }
+
+  for (guint scale = 1; n_ranges > 0; scale *= 2)
+    {
+      gboolean covered = TRUE;
+
+      for (guint i = 0; i < n_ranges; i++)
+        {
+          GtkTextIter above = ranges[i].begin;
+          GtkTextIter below = ranges[i].end;
+          gint distance = ranges[i].n_lines * scale;
+
+          /* Prefer below the view, as that is where reading continues */
+          gtk_text_iter_forward_lines (&below, distance);
+          if (get_first_invalid (self, &ranges[i].end, &below, begin, end))
+            return TRUE;
+
+          gtk_text_iter_backward_lines (&above, distance);
+          if (get_first_invalid (self, &above, &ranges[i].begin, begin, end))
+            return TRUE;
+
+          covered &= gtk_text_iter_is_start (&above) && gtk_text_iter_is_end (&below);
+        }
+
+      if (covered)
+        break;
+    }
+
+  gtk_source_region_get_start_region_iter (self->invalid, &iter);
+
+  return gtk_source_region_iter_get_subregion (&iter, begin, end);
+}
+
+/*
+ * Returns the first mapped view with an invalid range in its visible
+ * area, or %NULL if they are all up to date.
+ */
+static GtkWidget *
+find_view_with_visible_invalid (IdeHighlightEngine *self)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (gtk_source_region_is_empty (self->invalid))
+    return NULL;
+
+  for (guint i = 0; i < self->views->len; i++)
+    {
+      GtkTextView *view = g_ptr_array_index (self->views, i);
+      GtkTextIter begin, end;
+      GtkTextIter invalid_begin, invalid_end;
+
+      if (get_visible_range (view, &begin, &end) &&
+          get_first_invalid (self, &begin, &end, &invalid_begin, &invalid_end))
+        return GTK_WIDGET (view);
+    }
+
+  return NULL;
+}
+
+static void
+record_visible_latency (IdeHighlightEngine *self)
+{
+  gint64 latency;
+
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (self->visible_dirty && self->visible_invalid_at != 0)
+    {
+      latency = g_get_monotonic_time () - self->visible_invalid_at;
+
+      self->visible_latency_last = latency;
+      self->visible_latency_max = MAX (self->visible_latency_max, latency);
+      self->visible_latency_total += latency;
+      self->visible_latency_count++;
+
+      IDE_TRACE_MSG ("Visible area highlighted after %"G_GINT64_FORMAT" usec", latency);
+    }
+
+  self->visible_dirty = FALSE;
+  self->visible_invalid_at = 0;
+}
+
 static gboolean
 ide_highlight_engine_tick (IdeHighlightEngine *self)
 {
@@ -318,13 +516,13 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
   GtkTextIter invalid_begin;
   GtkTextIter invalid_end;
   GSList *tags_iter;
+  gboolean visible;
 
   IDE_PROBE;
 
   g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
   g_assert (self->highlighter != NULL);
-  g_assert (self->invalid_begin != NULL);
-  g_assert (self->invalid_end != NULL);
+  g_assert (self->invalid != NULL);
 
   buffer = g_weak_ref_get (&self->buffer_wref);
   if (buffer == NULL)
@@ -332,8 +530,20 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
 
   self->quanta_expiration = g_get_monotonic_time () + HIGHLIGHT_QUANTA_USEC;
 
-  gtk_text_buffer_get_iter_at_mark (buffer, &invalid_begin, self->invalid_begin);
-  gtk_text_buffer_get_iter_at_mark (buffer, &invalid_end, self->invalid_end);
+  if (!get_next_range (self, buffer, &invalid_begin, &invalid_end, &visible))
+    IDE_GOTO (up_to_date);
+
+  if (visible)
+    {
+      /* We may have scrolled into an area that is not yet highlighted */
+      if (self->visible_invalid_at == 0)
+        self->visible_invalid_at = g_get_monotonic_time ();
+      self->visible_dirty = TRUE;
+    }
+  else
+    {
+      record_visible_latency (self);
+    }
 
   IDE_TRACE_MSG ("Highlight Range [%u:%u,%u:%u] (%s)",
                  gtk_text_iter_get_line (&invalid_begin),
@@ -342,9 +552,6 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
                  gtk_text_iter_get_line_offset (&invalid_end),
                  G_OBJECT_TYPE_NAME (self->highlighter));
 
-  if (gtk_text_iter_compare (&invalid_begin, &invalid_end) >= 0)
-    IDE_GOTO (up_to_date);
-
   /* Clear all our tags */
   for (tags_iter = self->private_tags; tags_iter; tags_iter = tags_iter->next)
     gtk_text_buffer_remove_tag (buffer,
@@ -357,25 +564,98 @@ ide_highlight_engine_tick (IdeHighlightEngine *self)
   ide_highlighter_update (self->highlighter, ide_highlight_engine_apply_style,
                           &invalid_begin, &invalid_end, &iter);
 
-  if (gtk_text_iter_compare (&iter, &invalid_end) >= 0)
-    IDE_GOTO (up_to_date);
-
   /* Stop processing until further instruction if no movement was made */
   if (gtk_text_iter_equal (&iter, &invalid_begin))
     return G_SOURCE_REMOVE;
 
-  gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
+  if (gtk_text_iter_compare (&iter, &invalid_end) > 0)
+    iter = invalid_end;
+
+  gtk_source_region_subtract_subregion (self->invalid, &invalid_begin, &iter);
+
+  if (gtk_source_region_is_empty (self->invalid))
+    IDE_GOTO (up_to_date);
 
   return G_SOURCE_CONTINUE;
 
 up_to_date:
-  gtk_text_buffer_get_start_iter (buffer, &iter);
-  gtk_text_buffer_move_mark (buffer, self->invalid_begin, &iter);
-  gtk_text_buffer_move_mark (buffer, self->invalid_end, &iter);
+  record_visible_latency (self);
 
   return G_SOURCE_REMOVE;
 }
 
+static void ide_highlight_engine_queue_work (IdeHighlightEngine *self);
+
+/*
+ * Runs quanta from the start of a frame until about half of the frame
+ * interval is used, leaving the rest for layout and drawing. This is
+ * only used while the visible area is invalid, after which we return
+ * to the idle so that the rest of the buffer does not compete with
+ * drawing on every frame.
+ */
+static gboolean
+ide_highlight_engine_tick_cb (GtkWidget     *widget,
+                              GdkFrameClock *frame_clock,
+                              gpointer       user_data)
+{
+  IdeHighlightEngine *self = user_data;
+  gint64 refresh_interval = 0;
+  gint64 frame_time;
+  gint64 deadline;
+
+  g_assert (GTK_IS_WIDGET (widget));
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (self->tick_view == widget);
+
+  frame_time = gdk_frame_clock_get_frame_time (frame_clock);
+  gdk_frame_clock_get_refresh_info (frame_clock, frame_time, &refresh_interval, NULL);
+  if (refresh_interval <= 0)
+    refresh_interval = G_USEC_PER_SEC / 60;
+  deadline = frame_time + refresh_interval / 2;
+
+  if (self->enabled)
+    {
+      do
+        {
+          if (!ide_highlight_engine_tick (self))
+            goto stop;
+
+          if (!self->visible_dirty)
+            {
+              /* Only invisible ranges are left, use the idle */
+              self->tick_handler = 0;
+              self->tick_view = NULL;
+              ide_highlight_engine_queue_work (self);
+              return G_SOURCE_REMOVE;
+            }
+        }
+      while (g_get_monotonic_time () + HIGHLIGHT_QUANTA_USEC <= deadline);
+
+      return G_SOURCE_CONTINUE;
+    }
+
+stop:
+  self->tick_handler = 0;
+  self->tick_view = NULL;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_highlight_engine_clear_work (IdeHighlightEngine *self)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  dzl_clear_source (&self->work_timeout);
+
+  if (self->tick_handler != 0)
+    {
+      gtk_widget_remove_tick_callback (self->tick_view, self->tick_handler);
+      self->tick_handler = 0;
+      self->tick_view = NULL;
+    }
+}
+
 static gboolean
 ide_highlight_engine_work_timeout_handler (gpointer data)
 {
@@ -385,10 +665,19 @@ ide_highlight_engine_work_timeout_handler (gpointer data)
 
   if (self->enabled)
     {
-      if (ide_highlight_engine_tick (self))
+      if (!ide_highlight_engine_tick (self))
+        goto stop;
+
+      if (!self->visible_dirty)
         return G_SOURCE_CONTINUE;
+
+      /* We scrolled into an invalid area, use the frame clock */
+      self->work_timeout = 0;
+      ide_highlight_engine_queue_work (self);
+      return G_SOURCE_REMOVE;
     }
 
+stop:
   self->work_timeout = 0;
 
   return G_SOURCE_REMOVE;
@@ -398,21 +687,32 @@ static void
 ide_highlight_engine_queue_work (IdeHighlightEngine *self)
 {
   g_autoptr(GtkTextBuffer) buffer = NULL;
+  GtkWidget *view;
 
   g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
 
   buffer = g_weak_ref_get (&self->buffer_wref);
-  if (self->highlighter == NULL || buffer == NULL || self->work_timeout != 0)
+  if (self->highlighter == NULL ||
+      buffer == NULL ||
+      self->work_timeout != 0 ||
+      self->tick_handler != 0)
     return;
 
   /*
-   * NOTE: It would be really nice if we could use the GdkFrameClock here to
-   *       drive the next update instead of a timeout. It's possible that our
-   *       callback could get scheduled right before the frame processing would
-   *       begin. However, since that gets driven by something like a Wayland
-   *       callback, it won't yet be scheduled. So instead our function gets
-   *       called and we potentially cause a frame to drop.
+   * While the visible area of a view is invalid, use its GdkFrameClock to
+   * drive the next update so that our work happens at the beginning of a
+   * frame rather than potentially right before the frame is drawn,
+   * causing it to be dropped. Otherwise, use a low priority idle.
    */
+  if ((view = find_view_with_visible_invalid (self)))
+    {
+      self->tick_view = view;
+      self->tick_handler = gtk_widget_add_tick_callback (view,
+                                                         ide_highlight_engine_tick_cb,
+                                                         self,
+                                                         NULL);
+      return;
+    }
 
   self->work_timeout = gdk_threads_add_idle_full (G_PRIORITY_LOW + 1,
                                                   ide_highlight_engine_work_timeout_handler,
@@ -440,13 +740,27 @@ ide_highlight_engine_advance (IdeHighlightEngine *self)
   ide_highlight_engine_queue_work (self);
 }
 
+static void
+add_invalid_range (IdeHighlightEngine *self,
+                   const GtkTextIter  *begin,
+                   const GtkTextIter  *end)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (self->invalid != NULL);
+
+  gtk_source_region_add_subregion (self->invalid, begin, end);
+
+  if (self->visible_invalid_at == 0)
+    self->visible_invalid_at = g_get_monotonic_time ();
+
+  ide_highlight_engine_queue_work (self);
+}
+
 static gboolean
 invalidate_and_highlight (IdeHighlightEngine *self,
                           GtkTextIter        *begin,
                           GtkTextIter        *end)
 {
-  GtkTextBuffer *text_buffer;
-
   g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
   g_assert (begin != NULL);
   g_assert (end != NULL);
@@ -454,31 +768,9 @@ invalidate_and_highlight (IdeHighlightEngine *self,
   if (!self->enabled)
     return FALSE;
 
-  text_buffer = gtk_text_iter_get_buffer (begin);
-
   if (get_invalidation_area (begin, end))
     {
-      GtkTextIter begin_tmp;
-      GtkTextIter end_tmp;
-
-      gtk_text_buffer_get_iter_at_mark (text_buffer, &begin_tmp, self->invalid_begin);
-      gtk_text_buffer_get_iter_at_mark (text_buffer, &end_tmp, self->invalid_end);
-
-      if (gtk_text_iter_equal (&begin_tmp, &end_tmp))
-        {
-          gtk_text_buffer_move_mark (text_buffer, self->invalid_begin, begin);
-          gtk_text_buffer_move_mark (text_buffer, self->invalid_end, end);
-        }
-      else
-        {
-          if (gtk_text_iter_compare (begin, &begin_tmp) < 0)
-            gtk_text_buffer_move_mark (text_buffer, self->invalid_begin, begin);
-          if (gtk_text_iter_compare (end, &end_tmp) > 0)
-            gtk_text_buffer_move_mark (text_buffer, self->invalid_end, end);
-        }
-
-      ide_highlight_engine_queue_work (self);
-
+      add_invalid_range (self, begin, end);
       return TRUE;
     }
 
@@ -497,7 +789,7 @@ ide_highlight_engine_reload (IdeHighlightEngine *self)
 
   g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
 
-  dzl_clear_source (&self->work_timeout);
+  ide_highlight_engine_clear_work (self);
 
   buffer = g_weak_ref_get (&self->buffer_wref);
   if (buffer == NULL)
@@ -508,8 +800,9 @@ ide_highlight_engine_reload (IdeHighlightEngine *self)
   /*
    * Invalidate the whole buffer.
    */
-  gtk_text_buffer_move_mark (buffer, self->invalid_begin, &begin);
-  gtk_text_buffer_move_mark (buffer, self->invalid_end, &end);
+  gtk_source_region_add_subregion (self->invalid, &begin, &end);
+  if (self->visible_invalid_at == 0)
+    self->visible_invalid_at = g_get_monotonic_time ();
 
   /*
    * Remove our highlight tags from the buffer.
@@ -683,30 +976,20 @@ ide_highlight_engine__bind_buffer_cb (IdeHighlightEngine *self,
                                       DzlSignalGroup     *group)
 {
   GtkTextBuffer *text_buffer = (GtkTextBuffer *)buffer;
-  GtkTextIter begin;
-  GtkTextIter end;
 
   IDE_ENTRY;
 
   g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
   g_assert (IDE_IS_BUFFER (buffer));
   g_assert (DZL_IS_SIGNAL_GROUP (group));
-  g_assert (self->invalid_begin == NULL);
-  g_assert (self->invalid_end == NULL);
+  g_assert (self->invalid == NULL);
 
   g_weak_ref_set (&self->buffer_wref, buffer);
 
-  gtk_text_buffer_get_bounds (text_buffer, &begin, &end);
-
-  self->invalid_begin = gtk_text_buffer_create_mark (text_buffer, NULL, &begin, TRUE);
-  self->invalid_end = gtk_text_buffer_create_mark (text_buffer, NULL, &end, FALSE);
-
-  /* We can hold a full reference to the text marks, without
-   * taking a reference to the buffer. We want to avoid a reference
-   * to the buffer for cyclic reasons.
+  /* The region only holds a weak reference to the buffer, which we
+   * want to avoid a reference to for cyclic reasons.
    */
-  g_object_ref (self->invalid_begin);
-  g_object_ref (self->invalid_end);
+  self->invalid = gtk_source_region_new (text_buffer);
 
   ide_highlight_engine__notify_style_scheme_cb (self, NULL, buffer);
   ide_highlight_engine__notify_language_cb (self, NULL, buffer);
@@ -729,7 +1012,7 @@ ide_highlight_engine__unbind_buffer_cb (IdeHighlightEngine  *self,
 
   text_buffer = g_weak_ref_get (&self->buffer_wref);
 
-  dzl_clear_source (&self->work_timeout);
+  ide_highlight_engine_clear_work (self);
 
   if (text_buffer != NULL)
     {
@@ -741,9 +1024,6 @@ ide_highlight_engine__unbind_buffer_cb (IdeHighlightEngine  *self,
 
       tag_table = gtk_text_buffer_get_tag_table (text_buffer);
 
-      gtk_text_buffer_delete_mark (text_buffer, self->invalid_begin);
-      gtk_text_buffer_delete_mark (text_buffer, self->invalid_end);
-
       gtk_text_buffer_get_bounds (text_buffer, &begin, &end);
 
       private_tags = g_steal_pointer (&self->private_tags);
@@ -765,8 +1045,7 @@ ide_highlight_engine__unbind_buffer_cb (IdeHighlightEngine  *self,
   g_clear_pointer (&self->public_tags, g_slist_free);
   g_clear_pointer (&self->private_tags, g_slist_free);
 
-  g_clear_object (&self->invalid_begin);
-  g_clear_object (&self->invalid_end);
+  g_clear_object (&self->invalid);
 
   IDE_EXIT;
 }
@@ -854,6 +1133,11 @@ ide_highlight_engine_dispose (GObject *object)
 {
   IdeHighlightEngine *self = (IdeHighlightEngine *)object;
 
+  ide_highlight_engine_clear_work (self);
+
+  while (self->views->len > 0)
+    _ide_highlight_engine_remove_view (self, g_ptr_array_index (self->views, 0));
+
   g_weak_ref_set (&self->buffer_wref, NULL);
   g_clear_object (&self->signal_group);
   g_clear_object (&self->extension);
@@ -869,6 +1153,7 @@ ide_highlight_engine_finalize (GObject *object)
   IdeHighlightEngine *self = (IdeHighlightEngine *)object;
 
   g_weak_ref_clear (&self->buffer_wref);
+  g_clear_pointer (&self->views, g_ptr_array_unref);
 
   G_OBJECT_CLASS (ide_highlight_engine_parent_class)->finalize (object);
 }
@@ -950,6 +1235,7 @@ ide_highlight_engine_init (IdeHighlightEngine *self)
 {
   g_weak_ref_init (&self->buffer_wref, NULL);
 
+  self->views = g_ptr_array_new ();
   self->settings = g_settings_new ("org.gnome.builder.code-insight");
   self->enabled = g_settings_get_boolean (self->settings, "semantic-highlighting");
   self->signal_group = dzl_signal_group_new (IDE_TYPE_BUFFER);
@@ -1075,10 +1361,7 @@ ide_highlight_engine_rebuild (IdeHighlightEngine *self)
       GtkTextIter end;
 
       gtk_text_buffer_get_bounds (buffer, &begin, &end);
-      gtk_text_buffer_move_mark (buffer, self->invalid_begin, &begin);
-      gtk_text_buffer_move_mark (buffer, self->invalid_end, &end);
-
-      ide_highlight_engine_queue_work (self);
+      add_invalid_range (self, &begin, &end);
     }
 
   IDE_EXIT;
@@ -1107,35 +1390,14 @@ ide_highlight_engine_invalidate (IdeHighlightEngine *self,
                                  const GtkTextIter  *begin,
                                  const GtkTextIter  *end)
 {
-  GtkTextBuffer *buffer;
-  GtkTextIter mark_begin;
-  GtkTextIter mark_end;
-
   IDE_ENTRY;
 
   g_return_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self));
   g_return_if_fail (begin != NULL);
   g_return_if_fail (end != NULL);
 
-  buffer = gtk_text_iter_get_buffer (begin);
-
-  gtk_text_buffer_get_iter_at_mark (buffer, &mark_begin, self->invalid_begin);
-  gtk_text_buffer_get_iter_at_mark (buffer, &mark_end, self->invalid_end);
-
-  if (gtk_text_iter_equal (&mark_begin, &mark_end))
-    {
-      gtk_text_buffer_move_mark (buffer, self->invalid_begin, begin);
-      gtk_text_buffer_move_mark (buffer, self->invalid_end, end);
-    }
-  else
-    {
-      if (gtk_text_iter_compare (begin, &mark_begin) < 0)
-        gtk_text_buffer_move_mark (buffer, self->invalid_begin, begin);
-      if (gtk_text_iter_compare (end, &mark_end) > 0)
-        gtk_text_buffer_move_mark (buffer, self->invalid_end, end);
-    }
-
-  ide_highlight_engine_queue_work (self);
+  if (self->invalid != NULL)
+    add_invalid_range (self, begin, end);
 
   IDE_EXIT;
 }
@@ -1187,3 +1449,131 @@ ide_highlight_engine_unpause (IdeHighlightEngine *self)
       ide_highlight_engine_reload (self);
     }
 }
+
+static void
+ide_highlight_engine_view_unmap_cb (IdeHighlightEngine *self,
+                                    GtkWidget          *view)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (GTK_IS_TEXT_VIEW (view));
+
+  /* The frame clock stops ticking once unmapped, so move the work
+   * to another view (or an idle) if it was driven by this view.
+   */
+  if (self->tick_view == view)
+    {
+      ide_highlight_engine_clear_work (self);
+      ide_highlight_engine_queue_work (self);
+    }
+}
+
+static void
+ide_highlight_engine_view_map_cb (IdeHighlightEngine *self,
+                                  GtkWidget          *view)
+{
+  g_assert (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_assert (GTK_IS_TEXT_VIEW (view));
+
+  /* Switch from the idle to the frame clock if the view shows invalid ranges */
+  if (self->work_timeout != 0)
+    {
+      ide_highlight_engine_clear_work (self);
+      ide_highlight_engine_queue_work (self);
+    }
+}
+
+/**
+ * _ide_highlight_engine_add_view:
+ * @self: an #IdeHighlightEngine
+ * @view: a #GtkTextView displaying the buffer of @self
+ *
+ * Adds @view to the views whose visible area is highlighted before
+ * the rest of the buffer. No reference to @view is held, so it must
+ * be removed with _ide_highlight_engine_remove_view() before it is
+ * finalized.
+ */
+void
+_ide_highlight_engine_add_view (IdeHighlightEngine *self,
+                                GtkTextView        *view)
+{
+  g_return_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_return_if_fail (GTK_IS_TEXT_VIEW (view));
+
+  if (g_ptr_array_find (self->views, view, NULL))
+    return;
+
+  g_ptr_array_add (self->views, view);
+
+  g_signal_connect_object (view,
+                           "map",
+                           G_CALLBACK (ide_highlight_engine_view_map_cb),
+                           self,
+                           G_CONNECT_SWAPPED | G_CONNECT_AFTER);
+  g_signal_connect_object (view,
+                           "unmap",
+                           G_CALLBACK (ide_highlight_engine_view_unmap_cb),
+                           self,
+                           G_CONNECT_SWAPPED);
+  g_signal_connect_object (view,
+                           "destroy",
+                           G_CALLBACK (_ide_highlight_engine_remove_view),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  if (gtk_widget_get_mapped (GTK_WIDGET (view)))
+    ide_highlight_engine_view_map_cb (self, GTK_WIDGET (view));
+}
+
+void
+_ide_highlight_engine_remove_view (IdeHighlightEngine *self,
+                                   GtkTextView        *view)
+{
+  g_return_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self));
+  g_return_if_fail (GTK_IS_TEXT_VIEW (view));
+
+  if (!g_ptr_array_remove (self->views, view))
+    return;
+
+  g_signal_handlers_disconnect_by_func (view, G_CALLBACK (ide_highlight_engine_view_map_cb), self);
+  g_signal_handlers_disconnect_by_func (view, G_CALLBACK (ide_highlight_engine_view_unmap_cb), self);
+  g_signal_handlers_disconnect_by_func (view, G_CALLBACK (_ide_highlight_engine_remove_view), self);
+
+  ide_highlight_engine_view_unmap_cb (self, GTK_WIDGET (view));
+}
+
+/**
+ * ide_highlight_engine_get_visible_latency:
+ * @self: an #IdeHighlightEngine
+ * @n_samples: (out) (optional): the number of measurements
+ * @last_usec: (out) (optional): the most recent measurement
+ * @max_usec: (out) (optional): the largest measurement
+ * @total_usec: (out) (optional): the sum of all measurements
+ *
+ * Gets statistics about how long it took for the visible area of the
+ * views displaying the buffer to be highlighted after it was invalidated,
+ * such as after loading the buffer, editing it, or scrolling to an area
+ * that was not yet highlighted.
+ *
+ * Since: 3.40
+ */
+void
+ide_highlight_engine_get_visible_latency (IdeHighlightEngine *self,
+                                          guint              *n_samples,
+                                          gint64             *last_usec,
+                                          gint64             *max_usec,
+                                          gint64             *total_usec)
+{
+  g_return_if_fail (IDE_IS_HIGHLIGHT_ENGINE (self));
+
+  if (n_samples != NULL)
+    *n_samples = self->visible_latency_count;
+
+  if (last_usec != NULL)
+    *last_usec = self->visible_latency_last;
+
+  if (max_usec != NULL)
+    *max_usec = self->visible_latency_max;
+
+  if (total_usec != NULL)
+    *total_usec = self->visible_latency_total;
+}
@@ -58,5 +58,11 @@ IDE_AVAILABLE_IN_3_32
 void                ide_highlight_engine_unpause         (IdeHighlightEngine *self);
 IDE_AVAILABLE_IN_3_32
 void                ide_highlight_engine_advance         (IdeHighlightEngine *self);
+IDE_AVAILABLE_IN_3_40
+void                ide_highlight_engine_get_visible_latency (IdeHighlightEngine *self,
+                                                              guint              *n_samples,
+                                                              gint64             *last_usec,
+                                                              gint64             *max_usec,
+                                                              gint64             *total_usec);
 
 G_END_DECLS
@@ -30,17 +30,111 @@
 G_DEFINE_BOXED_TYPE (IdeHighlightIndex, ide_highlight_index,
                      ide_highlight_index_ref, ide_highlight_index_unref)
 
+/*
+ * The compact form of the index is a flat, immutable, native-endian
+ * file which can be mapped and used without any parsing. All strings
+ * are stored NUL-terminated in a single pool; the word table is sorted
+ * so that two indexes can be compared or merged cheaply, and the bucket
+ * table is an open-addressed hash table (at most half full) with the
+ * full hash stored to avoid most string comparisons.
+ *
+ * The bucket tag is an index into the tag table plus one, or zero for
+ * an empty bucket.
+ */
+
+#define COMPACT_MAGIC   "IDEHLIX"
+#define COMPACT_VERSION 1
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+  guint32 length;
+  guint32 n_tags;
+  guint32 n_words;
+  guint32 n_buckets;
+  guint32 tags_offset;
+  guint32 words_offset;
+  guint32 buckets_offset;
+} CompactHeader;
+
+typedef struct
+{
+  guint32 hash;
+  guint32 offset;
+  guint16 len;
+  guint16 tag;
+} CompactBucket;
+
+G_STATIC_ASSERT (sizeof (CompactHeader) == 40);
+G_STATIC_ASSERT (sizeof (CompactBucket) == 12);
+
 struct _IdeHighlightIndex
 {
   /* For debugging info */
-  guint          count;
-  gsize          chunk_size;
-
-  GStringChunk  *strings;
-  GHashTable    *index;
-  GVariant      *variant;
+  guint                count;
+  gsize                chunk_size;
+
+  GStringChunk        *strings;
+  GHashTable          *index;
+  GVariant            *variant;
+
+  /* Set when using the compact form, in which case the above are unused */
+  GBytes              *bytes;
+  const gchar         *base;
+  const CompactHeader *header;
+  const guint32       *tags;
+  const guint32       *words;
+  const CompactBucket *buckets;
 };
 
+static inline guint32
+compact_hash (const gchar *word,
+              gsize        len)
+{
+  guint32 h = 2166136261u;
+
+  /* FNV-1a, which must not change without bumping COMPACT_VERSION */
+  for (gsize i = 0; i < len; i++)
+    {
+      h ^= (guchar)word[i];
+      h *= 16777619u;
+    }
+
+  return h;
+}
+
+static const gchar *
+compact_lookup (IdeHighlightIndex *self,
+                const gchar       *word,
+                gsize              len)
+{
+  guint32 hash = compact_hash (word, len);
+  guint32 mask = self->header->n_buckets - 1;
+
+  for (guint32 i = hash & mask; ; i = (i + 1) & mask)
+    {
+      const CompactBucket *bucket = &self->buckets[i];
+
+      if (bucket->tag == 0)
+        return NULL;
+
+      if (bucket->hash == hash &&
+          bucket->len == len &&
+          memcmp (self->base + bucket->offset, word, len) == 0)
+        return self->base + self->tags[bucket->tag - 1];
+    }
+}
+
+static inline gboolean
+compact_string_is_valid (const gchar *base,
+                         gsize        length,
+                         guint32      offset,
+                         gsize        len)
+{
+  return offset < length && len < length - offset && base[offset + len] == '\0';
+}
+
 IdeHighlightIndex *
 ide_highlight_index_new (void)
 {
@@ -117,6 +211,7 @@ ide_highlight_index_insert (IdeHighlightIndex *self,
 
   g_assert (self);
   g_assert (tag != NULL);
+  g_return_if_fail (self->bytes == NULL);
 
   if (word == NULL || word[0] == '\0')
     return;
@@ -150,9 +245,51 @@ ide_highlight_index_lookup (IdeHighlightIndex *self,
   g_assert (self);
   g_assert (word);
 
+  if (self->bytes != NULL)
+    return (gpointer)compact_lookup (self, word, strlen (word));
+
   return g_hash_table_lookup (self->index, word);
 }
 
+/**
+ * ide_highlight_index_lookup_len:
+ * @self: An #IdeHighlightIndex.
+ * @word: the word to lookup, which does not need to be %NULL-terminated
+ * @len: the length of @word in bytes
+ *
+ * Like ide_highlight_index_lookup() but allows looking up a word within
+ * a larger string without copying it first.
+ *
+ * Returns: (transfer none) (nullable): Highlighter specific tag.
+ *
+ * Since: 3.40
+ */
+gpointer
+ide_highlight_index_lookup_len (IdeHighlightIndex *self,
+                                const gchar       *word,
+                                gsize              len)
+{
+  gchar stack[128];
+  g_autofree gchar *heap = NULL;
+  gchar *copy;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (word != NULL || len == 0, NULL);
+
+  if (self->bytes != NULL)
+    return (gpointer)compact_lookup (self, word, len);
+
+  if (len < sizeof stack)
+    copy = stack;
+  else
+    copy = heap = g_malloc (len + 1);
+
+  memcpy (copy, word, len);
+  copy[len] = 0;
+
+  return g_hash_table_lookup (self->index, copy);
+}
+
 IdeHighlightIndex *
 ide_highlight_index_ref (IdeHighlightIndex *self)
 {
@@ -169,6 +306,7 @@ ide_highlight_index_finalize (IdeHighlightIndex *self)
   g_clear_pointer (&self->strings, g_string_chunk_free);
   g_clear_pointer (&self->index, g_hash_table_unref);
   g_clear_pointer (&self->variant, g_variant_unref);
+  g_clear_pointer (&self->bytes, g_bytes_unref);
 
   IDE_EXIT;
 }
@@ -188,7 +326,11 @@ ide_highlight_index_dump (IdeHighlightIndex *self)
 
   g_assert (self);
 
-  format = g_format_size (self->chunk_size);
+  if (self->bytes != NULL)
+    format = g_format_size (g_bytes_get_size (self->bytes));
+  else
+    format = g_format_size (self->chunk_size);
+
   g_debug ("IdeHighlightIndex (%p) contains %u items and consumes %s.",
            self, self->count, format);
 }
@@ -216,16 +358,40 @@ ide_highlight_index_to_variant (IdeHighlightIndex *self)
 
   arrays = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_ptr_array_unref);
 
-  g_hash_table_iter_init (&iter, self->index);
-  while (g_hash_table_iter_next (&iter, (gpointer *)&k, (gpointer *)&v))
+  if (self->bytes != NULL)
     {
-      if G_UNLIKELY (!(ar = g_hash_table_lookup (arrays, v)))
+      for (guint32 i = 0; i < self->header->n_buckets; i++)
         {
-          ar = g_ptr_array_new ();
-          g_hash_table_insert (arrays, (gchar *)v, ar);
+          const CompactBucket *bucket = &self->buckets[i];
+
+          if (bucket->tag == 0)
+            continue;
+
+          k = self->base + bucket->offset;
+          v = self->base + self->tags[bucket->tag - 1];
+
+          if G_UNLIKELY (!(ar = g_hash_table_lookup (arrays, v)))
+            {
+              ar = g_ptr_array_new ();
+              g_hash_table_insert (arrays, (gchar *)v, ar);
+            }
+
+          g_ptr_array_add (ar, (gchar *)k);
         }
+    }
+  else
+    {
+      g_hash_table_iter_init (&iter, self->index);
+      while (g_hash_table_iter_next (&iter, (gpointer *)&k, (gpointer *)&v))
+        {
+          if G_UNLIKELY (!(ar = g_hash_table_lookup (arrays, v)))
+            {
+              ar = g_ptr_array_new ();
+              g_hash_table_insert (arrays, (gchar *)v, ar);
+            }
 
-      g_ptr_array_add (ar, (gchar *)k);
+          g_ptr_array_add (ar, (gchar *)k);
+        }
     }
 
   g_variant_dict_init (&dict, NULL);
@@ -243,3 +409,230 @@ ide_highlight_index_to_variant (IdeHighlightIndex *self)
 
   return g_variant_take_ref (g_variant_dict_end (&dict));
 }
+
+static gint
+compare_words (gconstpointer a,
+               gconstpointer b)
+{
+  return strcmp (*(const gchar * const *)a, *(const gchar * const *)b);
+}
+
+/**
+ * ide_highlight_index_to_bytes:
+ * @self: a #IdeHighlightIndex
+ *
+ * Serializes the index into its compact form, which can be written to
+ * a file and later loaded with ide_highlight_index_new_from_bytes().
+ *
+ * Tags must be strings, as is the case for indexes built by
+ * highlighters which transport them across IPC boundaries.
+ *
+ * Returns: (transfer full): a #GBytes
+ *
+ * Since: 3.40
+ */
+GBytes *
+ide_highlight_index_to_bytes (IdeHighlightIndex *self)
+{
+  g_autoptr(GHashTable) tag_ids = NULL;
+  g_autoptr(GPtrArray) words = NULL;
+  g_autoptr(GPtrArray) tags = NULL;
+  g_autoptr(GByteArray) strings = NULL;
+  g_autofree guint32 *word_offsets = NULL;
+  g_autofree guint32 *tag_offsets = NULL;
+  g_autofree CompactBucket *buckets = NULL;
+  GHashTableIter iter;
+  CompactHeader header = {{0}};
+  GByteArray *buf;
+  const gchar *k, *v;
+  guint32 strings_offset;
+  guint32 n_buckets = 16;
+
+  g_return_val_if_fail (self != NULL, NULL);
+
+  if (self->bytes != NULL)
+    return g_bytes_ref (self->bytes);
+
+  tag_ids = g_hash_table_new (g_str_hash, g_str_equal);
+  words = g_ptr_array_sized_new (g_hash_table_size (self->index));
+  tags = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&iter, self->index);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&k, (gpointer *)&v))
+    {
+      if (strlen (k) > G_MAXUINT16)
+        continue;
+
+      if (!g_hash_table_contains (tag_ids, v))
+        {
+          /* Leave room for the empty bucket marker */
+          if (tags->len == G_MAXUINT16 - 1)
+            continue;
+
+          g_ptr_array_add (tags, (gchar *)v);
+          g_hash_table_insert (tag_ids, (gchar *)v, GUINT_TO_POINTER (tags->len));
+        }
+
+      g_ptr_array_add (words, (gchar *)k);
+    }
+
+  g_ptr_array_sort (words, compare_words);
+
+  while (n_buckets < words->len * 2)
+    n_buckets *= 2;
+
+  header.n_tags = tags->len;
+  header.n_words = words->len;
+  header.n_buckets = n_buckets;
+  header.tags_offset = sizeof header;
+  header.words_offset = header.tags_offset + tags->len * sizeof (guint32);
+  header.buckets_offset = header.words_offset + words->len * sizeof (guint32);
+  strings_offset = header.buckets_offset + n_buckets * sizeof (CompactBucket);
+
+  strings = g_byte_array_new ();
+  tag_offsets = g_new (guint32, tags->len + 1);
+  word_offsets = g_new (guint32, words->len + 1);
+  buckets = g_new0 (CompactBucket, n_buckets);
+
+  for (guint i = 0; i < tags->len; i++)
+    {
+      const gchar *tag = g_ptr_array_index (tags, i);
+
+      tag_offsets[i] = strings_offset + strings->len;
+      g_byte_array_append (strings, (const guint8 *)tag, strlen (tag) + 1);
+    }
+
+  for (guint i = 0; i < words->len; i++)
+    {
+      const gchar *word = g_ptr_array_index (words, i);
+      gsize len = strlen (word);
+      guint32 hash = compact_hash (word, len);
+      guint32 j;
+
+      word_offsets[i] = strings_offset + strings->len;
+      g_byte_array_append (strings, (const guint8 *)word, len + 1);
+
+      for (j = hash & (n_buckets - 1); buckets[j].tag != 0; j = (j + 1) & (n_buckets - 1))
+        { /* Do Nothing */ }
+
+      buckets[j].hash = hash;
+      buckets[j].offset = word_offsets[i];
+      buckets[j].len = len;
+      buckets[j].tag = GPOINTER_TO_UINT (g_hash_table_lookup (tag_ids, g_hash_table_lookup (self->index, word)));
+    }
+
+  memcpy (header.magic, COMPACT_MAGIC, sizeof header.magic);
+  header.version = COMPACT_VERSION;
+  header.length = strings_offset + strings->len;
+
+  buf = g_byte_array_sized_new (header.length);
+  g_byte_array_append (buf, (const guint8 *)&header, sizeof header);
+  g_byte_array_append (buf, (const guint8 *)tag_offsets, tags->len * sizeof (guint32));
+  g_byte_array_append (buf, (const guint8 *)word_offsets, words->len * sizeof (guint32));
+  g_byte_array_append (buf, (const guint8 *)buckets, n_buckets * sizeof (CompactBucket));
+  g_byte_array_append (buf, strings->data, strings->len);
+
+  g_assert (buf->len == header.length);
+
+  return g_byte_array_free_to_bytes (buf);
+}
+
+/**
+ * ide_highlight_index_new_from_bytes:
+ * @bytes: a #GBytes created with ide_highlight_index_to_bytes()
+ * @error: a location for a #GError, or %NULL
+ *
+ * Creates a new immutable #IdeHighlightIndex backed by @bytes. The data is
+ * used in place, so @bytes may come from a #GMappedFile to share a single
+ * copy of the index between processes and buffers.
+ *
+ * Returns: (transfer full): an #IdeHighlightIndex or %NULL and @error is set
+ *
+ * Since: 3.40
+ */
+IdeHighlightIndex *
+ide_highlight_index_new_from_bytes (GBytes  *bytes,
+                                    GError **error)
+{
+  g_autoptr(IdeHighlightIndex) self = NULL;
+  const CompactHeader *header;
+  const CompactBucket *buckets;
+  const guint32 *tags;
+  const guint32 *words;
+  const gchar *base;
+  guint32 n_used = 0;
+  gsize length;
+
+  g_return_val_if_fail (bytes != NULL, NULL);
+
+  base = g_bytes_get_data (bytes, &length);
+  header = (const CompactHeader *)(gconstpointer)base;
+
+  if (length < sizeof *header ||
+      ((gsize)base % G_ALIGNOF (CompactHeader)) != 0 ||
+      memcmp (header->magic, COMPACT_MAGIC, sizeof header->magic) != 0 ||
+      header->version != COMPACT_VERSION ||
+      header->length != length)
+    goto invalid;
+
+  /* Validate the table locations before touching them */
+  if (header->n_buckets == 0 ||
+      (header->n_buckets & (header->n_buckets - 1)) != 0 ||
+      header->n_words >= header->n_buckets ||
+      header->tags_offset != sizeof *header ||
+      header->words_offset != header->tags_offset + (guint64)header->n_tags * sizeof (guint32) ||
+      header->buckets_offset != header->words_offset + (guint64)header->n_words * sizeof (guint32) ||
+      (guint64)header->buckets_offset + (guint64)header->n_buckets * sizeof (CompactBucket) > length)
+    goto invalid;
+
+  tags = (const guint32 *)(gconstpointer)(base + header->tags_offset);
+  words = (const guint32 *)(gconstpointer)(base + header->words_offset);
+  buckets = (const CompactBucket *)(gconstpointer)(base + header->buckets_offset);
+
+  for (guint32 i = 0; i < header->n_tags; i++)
+    {
+      if (tags[i] >= length || !memchr (base + tags[i], 0, length - tags[i]))
+        goto invalid;
+    }
+
+  for (guint32 i = 0; i < header->n_words; i++)
+    {
+      if (words[i] >= length || !memchr (base + words[i], 0, length - words[i]))
+        goto invalid;
+    }
+
+  for (guint32 i = 0; i < header->n_buckets; i++)
+    {
+      if (buckets[i].tag == 0)
+        continue;
+
+      if (buckets[i].tag > header->n_tags ||
+          !compact_string_is_valid (base, length, buckets[i].offset, buckets[i].len))
+        goto invalid;
+
+      n_used++;
+    }
+
+  /* Lookups rely on there being at least one empty bucket */
+  if (n_used != header->n_words)
+    goto invalid;
+
+  self = g_atomic_rc_box_new0 (IdeHighlightIndex);
+  self->bytes = g_bytes_ref (bytes);
+  self->base = base;
+  self->header = header;
+  self->tags = tags;
+  self->words = words;
+  self->buckets = buckets;
+  self->count = header->n_words;
+
+  return g_steal_pointer (&self);
+
+invalid:
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_INVALID_DATA,
+               "Invalid highlight index");
+
+  return NULL;
+}
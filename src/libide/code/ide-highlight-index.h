@@ -40,6 +40,9 @@ IDE_AVAILABLE_IN_3_32
 IdeHighlightIndex *ide_highlight_index_new              (void);
 IDE_AVAILABLE_IN_3_32
 IdeHighlightIndex *ide_highlight_index_new_from_variant (GVariant          *variant);
+IDE_AVAILABLE_IN_3_40
+IdeHighlightIndex *ide_highlight_index_new_from_bytes   (GBytes            *bytes,
+                                                         GError           **error);
 IDE_AVAILABLE_IN_3_32
 IdeHighlightIndex *ide_highlight_index_ref              (IdeHighlightIndex *self);
 IDE_AVAILABLE_IN_3_32
@@ -51,10 +54,16 @@ void               ide_highlight_index_insert           (IdeHighlightIndex *self
 IDE_AVAILABLE_IN_3_32
 gpointer           ide_highlight_index_lookup           (IdeHighlightIndex *self,
                                                          const gchar       *word);
+IDE_AVAILABLE_IN_3_40
+gpointer           ide_highlight_index_lookup_len       (IdeHighlightIndex *self,
+                                                         const gchar       *word,
+                                                         gsize              len);
 IDE_AVAILABLE_IN_3_32
 void               ide_highlight_index_dump             (IdeHighlightIndex *self);
 IDE_AVAILABLE_IN_3_32
 GVariant          *ide_highlight_index_to_variant       (IdeHighlightIndex *self);
+IDE_AVAILABLE_IN_3_40
+GBytes            *ide_highlight_index_to_bytes         (IdeHighlightIndex *self);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeHighlightIndex, ide_highlight_index_unref)
 
@@ -32,6 +32,7 @@
 #include <libide-io.h>
 #include <libide-threading.h>
 
+#include "ide-drafts-store-private.h"
 #include "ide-unsaved-file.h"
 #include "ide-unsaved-file-private.h"
 #include "ide-unsaved-files.h"
@@ -48,17 +49,20 @@ typedef struct
 
 struct _IdeUnsavedFiles
 {
-  IdeObject  parent_instance;
-  GMutex     mutex;
-  GPtrArray *unsaved_files;
-  gint64     sequence;
-  gchar     *project_id;
+  IdeObject       parent_instance;
+  GMutex          mutex;
+  GPtrArray      *unsaved_files;
+  gint64          sequence;
+  gchar          *project_id;
+  IdeDraftsStore *drafts;
 };
 
 typedef struct
 {
-  GPtrArray *unsaved_files;
-  gchar     *drafts_directory;
+  GPtrArray      *unsaved_files;
+  gchar          *drafts_directory;
+  /* Owned by the IdeUnsavedFiles, which the task keeps alive */
+  IdeDraftsStore *drafts;
 } AsyncState;
 
 G_DEFINE_TYPE (IdeUnsavedFiles, ide_unsaved_files, IDE_TYPE_OBJECT)
@@ -88,6 +92,21 @@ get_drafts_directory (IdeUnsavedFiles *self)
                            NULL);
 }
 
+static IdeDraftsStore *
+get_drafts_store (IdeUnsavedFiles *self)
+{
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_UNSAVED_FILES (self));
+
+  if (self->drafts == NULL)
+    {
+      g_autofree gchar *drafts_directory = get_drafts_directory (self);
+      self->drafts = _ide_drafts_store_new (drafts_directory);
+    }
+
+  return self->drafts;
+}
+
 static void
 async_state_free (gpointer data)
 {
@@ -144,37 +163,6 @@ unsaved_file_copy (const UnsavedFile *uf)
   return copy;
 }
 
-static gboolean
-unsaved_file_save (UnsavedFile  *uf,
-                   const gchar  *path,
-                   GError      **error)
-{
-  g_autoptr(GFile) file = NULL;
-
-  g_assert (uf != NULL);
-  g_assert (uf->content != NULL);
-  g_assert (path != NULL);
-
-  /*
-   * These files can be accessed by third-party programs. So we need to ensure
-   * those programs see either the old version of the file or the new version
-   * of the file. g_file_replace_contents() conveniently provides the atomic
-   * rename() for us.
-   */
-
-  file = g_file_new_for_path (path);
-
-  return g_file_replace_contents (file,
-                                  g_bytes_get_data (uf->content, NULL),
-                                  g_bytes_get_size (uf->content),
-                                  NULL,
-                                  FALSE,
-                                  G_FILE_CREATE_REPLACE_DESTINATION,
-                                  NULL,
-                                  NULL,
-                                  error);
-}
-
 static gchar *
 hash_uri (const gchar *uri)
 {
@@ -199,15 +187,55 @@ get_buffers_dir (IdeContext *context)
   return ide_context_cache_filename (context, "buffers", NULL);
 }
 
+static void
+remove_legacy_drafts (const gchar *drafts_directory)
+{
+  g_autofree gchar *manifest_contents = NULL;
+  g_autofree gchar *manifest_path = NULL;
+  IdeLineReader reader;
+  gchar *line;
+  gsize line_len;
+  gsize len;
+
+  g_assert (drafts_directory != NULL);
+
+  /* Drafts used to be saved as one file per buffer, listed in a manifest */
+  manifest_path = g_build_filename (drafts_directory, "manifest", NULL);
+
+  if (!g_file_get_contents (manifest_path, &manifest_contents, &len, NULL))
+    return;
+
+  ide_line_reader_init (&reader, manifest_contents, len);
+
+  while (NULL != (line = ide_line_reader_next (&reader, &line_len)))
+    {
+      g_autofree gchar *hash = NULL;
+      g_autofree gchar *path = NULL;
+
+      line[line_len] = '\0';
+
+      if (ide_str_empty0 (line))
+        continue;
+
+      hash = hash_uri (line);
+      path = g_build_filename (drafts_directory, hash, NULL);
+
+      g_unlink (path);
+    }
+
+  g_unlink (manifest_path);
+}
+
 static void
 ide_unsaved_files_save_worker (IdeTask      *task,
                                gpointer      source_object,
                                gpointer      task_data,
                                GCancellable *cancellable)
 {
-  g_autofree gchar *manifest_path = NULL;
-  g_autoptr(GString) manifest = NULL;
-  g_autoptr(GError) write_error = NULL;
+  g_autoptr(GPtrArray) uris = NULL;
+  g_autoptr(GArray) drafts = NULL;
+  g_autoptr(GError) error = NULL;
+  IdeDraftsStoreStats stats;
   AsyncState *state = task_data;
 
   IDE_ENTRY;
@@ -216,49 +244,44 @@ ide_unsaved_files_save_worker (IdeTask      *task,
   g_assert (IDE_IS_UNSAVED_FILES (source_object));
   g_assert (state != NULL);
   g_assert (state->drafts_directory != NULL);
+  g_assert (state->drafts != NULL);
   g_assert (state->unsaved_files != NULL);
 
-  /* ensure that the directory exists */
-  if (g_mkdir_with_parents (state->drafts_directory, 0700) != 0)
-    {
-      ide_task_return_new_error (task,
-                                 G_IO_ERROR,
-                                 g_io_error_from_errno (errno),
-                                 "Failed to create drafts directory");
-      IDE_EXIT;
-    }
-
-  manifest = g_string_new (NULL);
-  manifest_path = g_build_filename (state->drafts_directory, "manifest", NULL);
+  uris = g_ptr_array_new_with_free_func (g_free);
+  drafts = g_array_sized_new (FALSE, FALSE, sizeof (IdeDraft), state->unsaved_files->len);
 
   for (guint i = 0; i < state->unsaved_files->len; i++)
     {
       UnsavedFile *uf = g_ptr_array_index (state->unsaved_files, i);
-      g_autoptr(GError) error = NULL;
-      g_autofree gchar *path = NULL;
-      g_autofree gchar *uri = NULL;
-      g_autofree gchar *hash = NULL;
+      IdeDraft draft;
 
-      uri = g_file_get_uri (uf->file);
+      draft.uri = g_file_get_uri (uf->file);
+      draft.content = uf->content;
 
-      IDE_TRACE_MSG ("saving draft for unsaved file \"%s\"", uri);
+      g_ptr_array_add (uris, (gchar *)draft.uri);
+      g_array_append_val (drafts, draft);
+    }
 
-      g_string_append_printf (manifest, "%s\n", uri);
+  /*
+   * Only the parts of drafts that changed since the last save are written,
+   * so this stays cheap even with many large modified buffers.
+   */
+  if (!_ide_drafts_store_save (state->drafts,
+                               (const IdeDraft *)(gpointer)drafts->data,
+                               drafts->len,
+                               &stats,
+                               &error))
+    {
+      ide_task_return_error (task, g_steal_pointer (&error));
+      IDE_EXIT;
+    }
 
-      hash = hash_uri (uri);
-      path = g_build_filename (state->drafts_directory, hash, NULL);
+  IDE_TRACE_MSG ("Saved %u of %u drafts, %u new chunks, %"G_GSIZE_FORMAT" bytes",
+                 stats.n_written, drafts->len, stats.n_chunks_written, stats.bytes_written);
 
-      if (!unsaved_file_save (uf, path, &error))
-        ide_object_warning (source_object,
-                            /* translators: %s is replaced with the error message */
-                            _("Failed to save draft: %s"),
-                            error->message);
-    }
+  remove_legacy_drafts (state->drafts_directory);
 
-  if (!g_file_set_contents (manifest_path, manifest->str, manifest->len, &write_error))
-    ide_task_return_error (task, g_steal_pointer (&write_error));
-  else
-    ide_task_return_boolean (task, TRUE);
+  ide_task_return_boolean (task, TRUE);
 
   IDE_EXIT;
 }
@@ -274,6 +297,7 @@ async_state_new (IdeUnsavedFiles *files)
   state = g_slice_new0 (AsyncState);
   state->unsaved_files = g_ptr_array_new_with_free_func (unsaved_file_free);
   state->drafts_directory = get_drafts_directory (files);
+  state->drafts = get_drafts_store (files);
 
   return state;
 }
@@ -339,12 +363,10 @@ ide_unsaved_files_save_finish (IdeUnsavedFiles  *files,
 }
 
 static void
-ide_unsaved_files_restore_worker (IdeTask      *task,
+ide_unsaved_files_restore_legacy (IdeTask      *task,
                                   gpointer      source_object,
-                                  gpointer      task_data,
-                                  GCancellable *cancellable)
+                                  AsyncState   *state)
 {
-  AsyncState *state = task_data;
   g_autofree gchar *manifest_contents = NULL;
   g_autofree gchar *manifest_path = NULL;
   g_autoptr(GError) read_error = NULL;
@@ -431,6 +453,64 @@ ide_unsaved_files_restore_worker (IdeTask      *task,
   IDE_EXIT;
 }
 
+static void
+ide_unsaved_files_restore_worker (IdeTask      *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  AsyncState *state = task_data;
+  g_autoptr(GHashTable) drafts = NULL;
+  g_autoptr(GError) error = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_TASK (task));
+  g_assert (IDE_IS_UNSAVED_FILES (source_object));
+  g_assert (state != NULL);
+  g_assert (state->drafts != NULL);
+
+  /* Drafts from before the journal are migrated by the next save */
+  if (!_ide_drafts_store_exists (state->drafts))
+    {
+      ide_unsaved_files_restore_legacy (task, source_object, state);
+      IDE_EXIT;
+    }
+
+  g_debug ("Loading drafts from %s", state->drafts_directory);
+
+  if (!(drafts = _ide_drafts_store_load (state->drafts, &error)))
+    {
+      ide_task_return_error (task, g_steal_pointer (&error));
+      IDE_EXIT;
+    }
+
+  g_hash_table_iter_init (&iter, drafts);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      g_autoptr(GFile) file = g_file_new_for_uri (key);
+      UnsavedFile *unsaved;
+
+      if (!g_file_query_exists (file, NULL))
+        continue;
+
+      g_debug ("Loaded draft for \"%s\"", (const gchar *)key);
+
+      unsaved = g_slice_new0 (UnsavedFile);
+      unsaved->file = g_steal_pointer (&file);
+      unsaved->content = g_bytes_ref (value);
+
+      g_ptr_array_add (state->unsaved_files, g_steal_pointer (&unsaved));
+    }
+
+  ide_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
 void
 ide_unsaved_files_restore_async (IdeUnsavedFiles     *files,
                                  GCancellable        *cancellable,
@@ -523,11 +603,14 @@ ide_unsaved_files_remove_draft_locked (IdeUnsavedFiles *self,
 
   drafts_directory = get_drafts_directory (self);
   uri = g_file_get_uri (file);
-  hash = hash_uri (uri);
-  path = g_build_filename (drafts_directory, hash, NULL);
 
   g_debug ("Removing draft for \"%s\"", uri);
 
+  _ide_drafts_store_remove (get_drafts_store (self), uri);
+
+  /* In case the draft has not been migrated from the old format yet */
+  hash = hash_uri (uri);
+  path = g_build_filename (drafts_directory, hash, NULL);
   g_unlink (path);
 
   IDE_EXIT;
@@ -866,6 +949,7 @@ ide_unsaved_files_finalize (GObject *object)
 
   g_clear_pointer (&self->unsaved_files, g_ptr_array_unref);
   g_clear_pointer (&self->project_id, g_free);
+  g_clear_pointer (&self->drafts, _ide_drafts_store_free);
   g_mutex_clear (&self->mutex);
 
   G_OBJECT_CLASS (ide_unsaved_files_parent_class)->finalize (object);
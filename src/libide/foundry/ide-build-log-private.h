@@ -41,6 +41,8 @@ guint        ide_build_log_add_observer     (IdeBuildLog         *self,
                                              GDestroyNotify       observer_data_destroy);
 gboolean     ide_build_log_remove_observer  (IdeBuildLog         *self,
                                              guint                observer_id);
+gsize        ide_build_log_get_n_dropped    (IdeBuildLog         *self);
+gsize        ide_build_log_get_backlog      (IdeBuildLog         *self);
 
 
 G_END_DECLS
@@ -28,19 +28,69 @@
 #include "ide-build-log.h"
 #include "ide-build-log-private.h"
 
-#define POINTER_MARK(p)   GSIZE_TO_POINTER(GPOINTER_TO_SIZE(p)|1)
-#define POINTER_UNMARK(p) GSIZE_TO_POINTER(GPOINTER_TO_SIZE(p)&~(gsize)1)
-#define POINTER_MARKED(p) (GPOINTER_TO_SIZE(p)&1)
-#define DISPATCH_MAX      20
+/*
+ * Log lines from worker threads are copied into a ring buffer and later
+ * dispatched to observers from the main thread. Writers are serialized
+ * with a mutex so the ring has a single producer at a time, and the main
+ * thread consumes without taking any lock. Observers are given pointers
+ * directly into the ring rather than a copy of each line.
+ *
+ * Each record is a Record header followed by the message and a trailing
+ * \0, padded to RECORD_ALIGN. Records never wrap around the end of the
+ * ring; a RECORD_WRAP record fills the remainder instead.
+ *
+ * If the main thread falls too far behind, new lines are dropped rather
+ * than growing memory without bound or blocking the build.
+ */
+
+#define RING_SIZE         (4 * 1024 * 1024)
+#define RING_MASK         (RING_SIZE - 1)
+#define RECORD_ALIGN      8
+#define RECORD_WRAP       G_MAXUINT32
+#define MAX_MESSAGE_LEN   (RING_SIZE / 16)
+#define DISPATCH_BUDGET   (G_USEC_PER_SEC / 200)
+#define DEADLINE_INTERVAL 32
+
+G_STATIC_ASSERT ((RING_SIZE & RING_MASK) == 0);
+
+typedef struct
+{
+  guint32 len;
+  guint32 stream;
+  gchar   message[];
+} Record;
+
+G_STATIC_ASSERT (sizeof (Record) == RECORD_ALIGN);
 
 struct _IdeBuildLog
 {
   GObject      parent_instance;
 
   GArray      *observers;
-  GAsyncQueue *log_queue;
   GSource     *log_source;
 
+  /* Allocated on first use from a worker thread */
+  gchar       *ring;
+
+  /* Serializes writers so the ring has a single producer */
+  GMutex       write_mutex;
+
+  /* Byte positions which only increase, masked to index the ring. head
+   * is only advanced by writers and tail by the main thread, always with
+   * atomic operations.
+   */
+  gsize        head;
+  gsize        tail;
+
+  /* Counters of lines, also accessed with atomic operations */
+  gsize        n_written;
+  gsize        n_dispatched;
+  gsize        n_dropped;
+  gsize        n_dropped_reported;
+
+  /* Set when a writer has requested dispatch from the main thread */
+  gint         dispatch_pending;
+
   guint        sequence;
 };
 
@@ -54,54 +104,78 @@ typedef struct
 
 G_DEFINE_TYPE (IdeBuildLog, ide_build_log, G_TYPE_OBJECT)
 
+static inline gsize
+record_size (gsize message_len)
+{
+  return (sizeof (Record) + message_len + 1 + RECORD_ALIGN - 1) & ~(gsize)(RECORD_ALIGN - 1);
+}
+
 static gboolean
 emit_log_from_main (gpointer user_data)
 {
   IdeBuildLog *self = user_data;
-  g_autoptr(GPtrArray) ar = g_ptr_array_new ();
-  gpointer item;
+  gint64 deadline;
+  gsize n_dispatched = 0;
+  gsize n_dropped;
+  gsize head;
+  gsize tail;
 
   g_assert (IDE_IS_BUILD_LOG (self));
 
   /*
-   * Pull up to DISPATCH_MAX items from the log queue. We have an upper
-   * bound here so that we don't stall the main loop. Additionally, we
-   * update the ready-time when we run out of items while holding the
-   * async queue lock to synchronize with the caller for further wakeups.
+   * Reset the ready-time before clearing dispatch_pending so that a writer
+   * which sees the flag cleared will always reschedule us after this.
    */
-  g_async_queue_lock (self->log_queue);
-  for (guint i = 0; i < DISPATCH_MAX; i++)
+  g_source_set_ready_time (self->log_source, -1);
+  g_atomic_int_set (&self->dispatch_pending, FALSE);
+
+  deadline = g_get_monotonic_time () + DISPATCH_BUDGET;
+  head = g_atomic_pointer_get (&self->head);
+  tail = self->tail;
+
+  /*
+   * Dispatch as many lines as we can within our time budget rather than a
+   * fixed number, so that we keep up with noisy builds without stalling
+   * the main loop.
+   */
+  while (tail < head)
     {
-      if (NULL == (item = g_async_queue_try_pop_unlocked (self->log_queue)))
+      const Record *record = (const Record *)(gpointer)&self->ring[tail & RING_MASK];
+
+      if (record->stream == RECORD_WRAP)
         {
-          g_source_set_ready_time (self->log_source, -1);
-          break;
+          tail += RING_SIZE - (tail & RING_MASK);
+          continue;
         }
-      g_ptr_array_add (ar, item);
-    }
-  g_async_queue_unlock (self->log_queue);
 
-  for (guint i = 0; i < ar->len; i++)
-    {
-      IdeBuildLogStream stream = IDE_BUILD_LOG_STDOUT;
-      gchar *message;
-      gsize message_len;
+      for (guint i = 0; i < self->observers->len; i++)
+        {
+          const Observer *observer = &g_array_index (self->observers, Observer, i);
 
-      item = g_ptr_array_index (ar, i);
-      message = POINTER_UNMARK (item);
-      message_len = strlen (message);
+          observer->callback (record->stream, record->message, record->len, observer->data);
+        }
 
-      if (POINTER_MARKED (item))
-        stream = IDE_BUILD_LOG_STDERR;
+      tail += record_size (record->len);
+      n_dispatched++;
 
-      for (guint j = 0; j < self->observers->len; j++)
-        {
-          const Observer *observer = &g_array_index (self->observers, Observer, j);
+      if (n_dispatched % DEADLINE_INTERVAL == 0 && g_get_monotonic_time () >= deadline)
+        break;
+    }
 
-          observer->callback (stream, message, message_len, observer->data);
-        }
+  /* Release the space back to writers */
+  g_atomic_pointer_set (&self->tail, tail);
+  g_atomic_pointer_add (&self->n_dispatched, n_dispatched);
 
-      g_free (message);
+  if (tail < head)
+    g_source_set_ready_time (self->log_source, 0);
+
+  n_dropped = g_atomic_pointer_get (&self->n_dropped);
+
+  if G_UNLIKELY (n_dropped != self->n_dropped_reported)
+    {
+      g_debug ("Dropped %"G_GSIZE_FORMAT" build log lines because the log was not dispatched quickly enough",
+               n_dropped - self->n_dropped_reported);
+      self->n_dropped_reported = n_dropped;
     }
 
   return G_SOURCE_CONTINUE;
@@ -112,9 +186,10 @@ ide_build_log_finalize (GObject *object)
 {
   IdeBuildLog *self = (IdeBuildLog *)object;
 
-  g_clear_pointer (&self->log_queue, g_async_queue_unref);
   g_clear_pointer (&self->log_source, g_source_destroy);
   g_clear_pointer (&self->observers, g_array_unref);
+  g_clear_pointer (&self->ring, g_free);
+  g_mutex_clear (&self->write_mutex);
 
   G_OBJECT_CLASS (ide_build_log_parent_class)->finalize (object);
 }
@@ -132,7 +207,7 @@ ide_build_log_init (IdeBuildLog *self)
 {
   self->observers = g_array_new (FALSE, FALSE, sizeof (Observer));
 
-  self->log_queue = g_async_queue_new ();
+  g_mutex_init (&self->write_mutex);
 
   self->log_source = g_timeout_source_new (G_MAXINT);
   g_source_set_priority (self->log_source, G_PRIORITY_LOW);
@@ -148,24 +223,64 @@ ide_build_log_via_main (IdeBuildLog       *self,
                         const gchar       *message,
                         gsize              message_len)
 {
-  gchar *copied = g_strndup (message, message_len);
+  Record *record;
+  gsize needed;
+  gsize offset;
+  gsize head;
+  gsize tail;
+  gsize wrap = 0;
 
-  if G_UNLIKELY (stream == IDE_BUILD_LOG_STDERR)
-    copied = POINTER_MARK (copied);
+  if G_UNLIKELY (message_len > MAX_MESSAGE_LEN)
+    message_len = MAX_MESSAGE_LEN;
 
-  /*
-   * Add the log entry to our queue to be dispatched in the main thread.
-   * However, we hold the async queue lock while updating the source ready
-   * time so we are synchronized with the main thread for setting the
-   * ready time. This is needed because the main thread may not dispatch
-   * all available items in a single dispatch (to avoid stalling the
-   * main loop).
-   */
+  needed = record_size (message_len);
+
+  g_mutex_lock (&self->write_mutex);
+
+  if G_UNLIKELY (self->ring == NULL)
+    self->ring = g_malloc (RING_SIZE);
+
+  head = self->head;
+  tail = g_atomic_pointer_get (&self->tail);
+  offset = head & RING_MASK;
+
+  /* Records must be contiguous, so skip to the start of the ring */
+  if (RING_SIZE - offset < needed)
+    wrap = RING_SIZE - offset;
+
+  if G_UNLIKELY (RING_SIZE - (head - tail) < wrap + needed)
+    {
+      g_mutex_unlock (&self->write_mutex);
+      g_atomic_pointer_add (&self->n_dropped, 1);
+      return;
+    }
+
+  if (wrap > 0)
+    {
+      record = (Record *)(gpointer)&self->ring[offset];
+      record->len = 0;
+      record->stream = RECORD_WRAP;
+      head += wrap;
+      offset = 0;
+    }
+
+  record = (Record *)(gpointer)&self->ring[offset];
+  record->len = message_len;
+  record->stream = stream;
+  memcpy (record->message, message, message_len);
+  record->message[message_len] = 0;
+
+  /* Publish the record to the main thread */
+  g_atomic_pointer_set (&self->head, head + needed);
+  g_atomic_pointer_add (&self->n_written, 1);
 
-  g_async_queue_lock (self->log_queue);
-  g_async_queue_push_unlocked (self->log_queue, copied);
-  g_source_set_ready_time (self->log_source, 0);
-  g_async_queue_unlock (self->log_queue);
+  g_mutex_unlock (&self->write_mutex);
+
+  /* Only the first writer after a dispatch needs to wake up the main
+   * thread, which avoids taking the main context lock for every line.
+   */
+  if (g_atomic_int_compare_and_exchange (&self->dispatch_pending, FALSE, TRUE))
+    g_source_set_ready_time (self->log_source, 0);
 }
 
 void
@@ -245,3 +360,33 @@ ide_build_log_new (void)
 {
   return g_object_new (IDE_TYPE_BUILD_LOG, NULL);
 }
+
+/**
+ * ide_build_log_get_n_dropped:
+ * @self: an #IdeBuildLog
+ *
+ * Gets the number of lines logged from worker threads which were dropped
+ * because the main thread did not dispatch them quickly enough.
+ */
+gsize
+ide_build_log_get_n_dropped (IdeBuildLog *self)
+{
+  g_return_val_if_fail (IDE_IS_BUILD_LOG (self), 0);
+
+  return g_atomic_pointer_get (&self->n_dropped);
+}
+
+/**
+ * ide_build_log_get_backlog:
+ * @self: an #IdeBuildLog
+ *
+ * Gets the number of lines logged from worker threads which have not yet
+ * been dispatched to observers.
+ */
+gsize
+ide_build_log_get_backlog (IdeBuildLog *self)
+{
+  g_return_val_if_fail (IDE_IS_BUILD_LOG (self), 0);
+
+  return g_atomic_pointer_get (&self->n_written) - g_atomic_pointer_get (&self->n_dispatched);
+}
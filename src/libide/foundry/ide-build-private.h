@@ -22,26 +22,28 @@
 
 #include <vte/vte.h>
 
+#include "ide-build-log-private.h"
 #include "ide-foundry-types.h"
 
 G_BEGIN_DECLS
 
-guint8 *_ide_build_utils_filter_color_codes (const guint8    *data,
-                                             gsize            len,
-                                             gsize           *out_len);
-void    _ide_build_manager_start            (IdeBuildManager *self);
-void    _ide_pipeline_cancel                (IdePipeline     *self);
-void    _ide_pipeline_set_runtime           (IdePipeline     *self,
-                                             IdeRuntime      *runtime);
-void    _ide_pipeline_set_toolchain         (IdePipeline     *self,
-                                             IdeToolchain    *toolchain);
-void    _ide_pipeline_set_message           (IdePipeline     *self,
-                                             const gchar     *message);
-void    _ide_pipeline_mark_broken           (IdePipeline     *self);
-void    _ide_pipeline_check_toolchain       (IdePipeline     *self,
-                                             IdeDeviceInfo   *info);
-void    _ide_pipeline_set_pty_size          (IdePipeline     *self,
-                                             guint            rows,
-                                             guint            columns);
+guint8      *_ide_build_utils_filter_color_codes (const guint8    *data,
+                                                  gsize            len,
+                                                  gsize           *out_len);
+void         _ide_build_manager_start            (IdeBuildManager *self);
+void         _ide_pipeline_cancel                (IdePipeline     *self);
+void         _ide_pipeline_set_runtime           (IdePipeline     *self,
+                                                  IdeRuntime      *runtime);
+void         _ide_pipeline_set_toolchain         (IdePipeline     *self,
+                                                  IdeToolchain    *toolchain);
+void         _ide_pipeline_set_message           (IdePipeline     *self,
+                                                  const gchar     *message);
+void         _ide_pipeline_mark_broken           (IdePipeline     *self);
+void         _ide_pipeline_check_toolchain       (IdePipeline     *self,
+                                                  IdeDeviceInfo   *info);
+void         _ide_pipeline_set_pty_size          (IdePipeline     *self,
+                                                  guint            rows,
+                                                  guint            columns);
+IdeBuildLog *_ide_pipeline_get_build_log         (IdePipeline     *self);
 
 G_END_DECLS
@@ -48,6 +48,13 @@
  * of the compile commands. On larger projects, this can be the order
  * of a couple of megabytes.
  *
+ * To avoid that, and parsing the JSON again each time it is loaded, a
+ * cache file may be set with ide_compile_commands_set_cache_file(). The
+ * filtered flags for each file are written there after parsing, with
+ * identical flag vectors stored only once. As long as the JSON file has
+ * the same modification time and size, later loads map the cache file
+ * instead of parsing the JSON.
+ *
  * Since: 3.32
  */
 
@@ -70,6 +77,18 @@ struct _IdeCompileCommands
    */
   GPtrArray *vala_info;
 
+  /*
+   * If @cache_file is set, the parsed commands are written there and
+   * reused by later loads while the JSON file is unchanged. When the
+   * cache was loaded instead of the JSON, @cache is set along with its
+   * directories ("as") and flag vectors ("aas"), and both @info_by_file
+   * and @vala_info are %NULL.
+   */
+  GFile            *cache_file;
+  IdePersistentMap *cache;
+  GVariant         *cache_directories;
+  GVariant         *cache_commands;
+
   /*
    * The has_loaded field determines if we've had a load (async or sync
    * variant) operation called. We can only do this safely once because
@@ -86,8 +105,42 @@ typedef struct
   gchar *command;
 } CompileInfo;
 
+/*
+ * The cache is an #IdePersistentMap whose values are all variants. Files
+ * are keyed by absolute path and map to a CacheEntry "(uuy)" with the
+ * index of the directory, the index of the flag vector (or
+ * CACHE_INVALID_INDEX if the command could not be parsed), and the kind
+ * of filtering that was applied to the flags. Keys that are not
+ * absolute paths hold the shared tables.
+ */
+#define CACHE_VERSION         1
+#define CACHE_INVALID_INDEX   G_MAXUINT32
+#define CACHE_KEY_DIRECTORIES "directories"
+#define CACHE_KEY_COMMANDS    "commands"
+#define CACHE_KEY_VALA        "vala"
+#define CACHE_KIND_C          'c'
+#define CACHE_KIND_VALA       'v'
+#define CACHE_KIND_RAW        'r'
+
+typedef struct
+{
+  GHashTable      *directories;
+  GHashTable      *commands;
+  GVariantBuilder  directories_builder;
+  GVariantBuilder  commands_builder;
+  guint            n_directories;
+  guint            n_commands;
+} CacheBuilder;
+
 G_DEFINE_TYPE (IdeCompileCommands, ide_compile_commands, G_TYPE_OBJECT)
 
+static gboolean ide_compile_commands_load_cache  (IdeCompileCommands *self,
+                                                  GFileInfo          *file_info,
+                                                  GCancellable       *cancellable);
+static void     ide_compile_commands_write_cache (IdeCompileCommands *self,
+                                                  GFileInfo          *file_info,
+                                                  GCancellable       *cancellable);
+
 static void
 compile_info_free (gpointer data)
 {
@@ -109,6 +162,10 @@ ide_compile_commands_finalize (GObject *object)
 
   g_clear_pointer (&self->info_by_file, g_hash_table_unref);
   g_clear_pointer (&self->vala_info, g_ptr_array_unref);
+  g_clear_pointer (&self->cache_directories, g_variant_unref);
+  g_clear_pointer (&self->cache_commands, g_variant_unref);
+  g_clear_object (&self->cache);
+  g_clear_object (&self->cache_file);
 
   G_OBJECT_CLASS (ide_compile_commands_parent_class)->finalize (object);
 }
@@ -142,6 +199,62 @@ ide_compile_commands_new (void)
   return g_object_new (IDE_TYPE_COMPILE_COMMANDS, NULL);
 }
 
+/**
+ * ide_compile_commands_new_for_builddir:
+ * @builddir: the build directory containing compile_commands.json
+ *
+ * Creates a new #IdeCompileCommands like ide_compile_commands_new() which
+ * caches the parsed commands in "compile_commands.cache" within @builddir.
+ *
+ * Returns: The newly created #IdeCompileCommands
+ *
+ * Since: 3.40
+ */
+IdeCompileCommands *
+ide_compile_commands_new_for_builddir (const gchar *builddir)
+{
+  g_autoptr(GFile) cache_file = NULL;
+  g_autofree gchar *cache_path = NULL;
+  IdeCompileCommands *self;
+
+  g_return_val_if_fail (builddir != NULL, NULL);
+
+  self = ide_compile_commands_new ();
+  cache_path = g_build_filename (builddir, "compile_commands.cache", NULL);
+  cache_file = g_file_new_for_path (cache_path);
+  ide_compile_commands_set_cache_file (self, cache_file);
+
+  return self;
+}
+
+/**
+ * ide_compile_commands_set_cache_file:
+ * @self: An #IdeCompileCommands
+ * @cache_file: (nullable): a #GFile or %NULL
+ *
+ * Sets the file used to cache the parsed compile commands. This must be
+ * called before loading.
+ *
+ * When loading, if @cache_file was written for the same version of the
+ * compile_commands.json, it is used instead of parsing the JSON.
+ * Otherwise, it is replaced after the JSON has been parsed.
+ *
+ * Build systems should place it next to the compile_commands.json in
+ * the build directory, see ide_compile_commands_new_for_builddir().
+ *
+ * Since: 3.40
+ */
+void
+ide_compile_commands_set_cache_file (IdeCompileCommands *self,
+                                     GFile              *cache_file)
+{
+  g_return_if_fail (IDE_IS_COMPILE_COMMANDS (self));
+  g_return_if_fail (!cache_file || G_IS_FILE (cache_file));
+  g_return_if_fail (self->has_loaded == FALSE);
+
+  g_set_object (&self->cache_file, cache_file);
+}
+
 static void
 ide_compile_commands_load_worker (IdeTask      *task,
                                   gpointer      source_object,
@@ -155,6 +268,7 @@ ide_compile_commands_load_worker (IdeTask      *task,
   g_autoptr(GHashTable) info_by_file = NULL;
   g_autoptr(GHashTable) directories_by_path = NULL;
   g_autoptr(GPtrArray) vala_info = NULL;
+  g_autoptr(GFileInfo) file_info = NULL;
   g_autofree gchar *contents = NULL;
   JsonNode *root;
   JsonArray *ar;
@@ -168,6 +282,25 @@ ide_compile_commands_load_worker (IdeTask      *task,
   g_assert (G_IS_FILE (gfile));
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
+  /* Query before reading so a change while parsing invalidates the cache */
+  if (self->cache_file != NULL)
+    {
+      file_info = g_file_query_info (gfile,
+                                     G_FILE_ATTRIBUTE_STANDARD_SIZE","
+                                     G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                                     G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                     G_FILE_QUERY_INFO_NONE,
+                                     cancellable,
+                                     NULL);
+
+      if (file_info != NULL &&
+          ide_compile_commands_load_cache (self, file_info, cancellable))
+        {
+          ide_task_return_boolean (task, TRUE);
+          IDE_EXIT;
+        }
+    }
+
   parser = json_parser_new ();
 
   if (!g_file_load_contents (gfile, cancellable, &contents, &len, NULL, &error) ||
@@ -295,6 +428,9 @@ ide_compile_commands_load_worker (IdeTask      *task,
   self->info_by_file = g_steal_pointer (&info_by_file);
   self->vala_info = g_steal_pointer (&vala_info);
 
+  if (file_info != NULL)
+    ide_compile_commands_write_cache (self, file_info, cancellable);
+
   ide_task_return_boolean (task, TRUE);
 
   IDE_EXIT;
@@ -607,10 +743,55 @@ ide_compile_commands_filter_vala (IdeCompileCommands   *self,
   *argv = (gchar **)g_ptr_array_free (ar, FALSE);
 }
 
+/* Files whose command may be used to compile @file, in order of preference */
+static GPtrArray *
+get_alternates (GFile *file)
+{
+  g_autofree gchar *path = g_file_get_path (file);
+  GPtrArray *ar = g_ptr_array_new_with_free_func (g_object_unref);
+  gchar *dot;
+  gsize len;
+
+  g_assert (G_IS_FILE (file));
+
+  g_ptr_array_add (ar, g_object_ref (file));
+
+  if (path == NULL)
+    return ar;
+
+  dot = strrchr (path, '.');
+  len = strlen (path);
+
+  if (g_str_has_suffix (path, "-private.h"))
+    {
+      g_autofree gchar *other_path = NULL;
+
+      path[len - strlen ("-private.h")] = 0;
+
+      other_path = g_strconcat (path, ".c", NULL);
+      g_ptr_array_add (ar, g_file_new_for_path (other_path));
+    }
+  else if (ide_path_is_c_like (dot) || ide_path_is_cpp_like (dot))
+    {
+      static const gchar *tries[] = { ".c", ".cc", ".cpp", ".cxx", ".c++" };
+
+      *dot = 0;
+
+      for (guint i = 0; i < G_N_ELEMENTS (tries); i++)
+        {
+          g_autofree gchar *other_path = g_strconcat (path, tries[i], NULL);
+          g_ptr_array_add (ar, g_file_new_for_path (other_path));
+        }
+    }
+
+  return ar;
+}
+
 static const CompileInfo *
 find_with_alternates (IdeCompileCommands *self,
                       GFile              *file)
 {
+  g_autoptr(GPtrArray) alternates = NULL;
   const CompileInfo *info;
 
   g_assert (IDE_IS_COMPILE_COMMANDS (self));
@@ -622,42 +803,318 @@ find_with_alternates (IdeCompileCommands *self,
   if (NULL != (info = g_hash_table_lookup (self->info_by_file, file)))
     return info;
 
-  {
-    g_autofree gchar *path = g_file_get_path (file);
-    gchar *dot = strrchr (path, '.');
-    gsize len = strlen (path);
+  alternates = get_alternates (file);
+
+  for (guint i = 1; i < alternates->len; i++)
+    {
+      if ((info = g_hash_table_lookup (self->info_by_file, g_ptr_array_index (alternates, i))))
+        return info;
+    }
+
+  return NULL;
+}
+
+static guint
+cache_builder_add_directory (CacheBuilder *state,
+                             GFile        *directory)
+{
+  gpointer value;
 
-    if (g_str_has_suffix (path, "-private.h"))
-      {
-        g_autofree gchar *other_path = NULL;
-        g_autoptr(GFile) other = NULL;
+  if (!(value = g_hash_table_lookup (state->directories, directory)))
+    {
+      g_autofree gchar *path = g_file_get_path (directory);
 
-        path[len - strlen ("-private.h")] = 0;
+      g_variant_builder_add (&state->directories_builder, "s", path ? path : "");
+      value = GUINT_TO_POINTER (++state->n_directories);
+      g_hash_table_insert (state->directories, g_object_ref (directory), value);
+    }
 
-        other_path = g_strconcat (path, ".c", NULL);
-        other = g_file_new_for_path (other_path);
+  return GPOINTER_TO_UINT (value) - 1;
+}
 
-        if (NULL != (info = g_hash_table_lookup (self->info_by_file, other)))
-          return info;
-      }
-    else if (ide_path_is_c_like (dot) || ide_path_is_cpp_like (dot))
-      {
-        static const gchar *tries[] = { ".c", ".cc", ".cpp", ".cxx", ".c++" };
+static guint
+cache_builder_add_command (CacheBuilder        *state,
+                           const gchar * const *argv)
+{
+  g_autofree gchar *key = g_strjoinv ("\x1f", (gchar **)argv);
+  gpointer value;
 
-        *dot = 0;
+  if (!(value = g_hash_table_lookup (state->commands, key)))
+    {
+      g_variant_builder_add_value (&state->commands_builder, g_variant_new_strv (argv, -1));
+      value = GUINT_TO_POINTER (++state->n_commands);
+      g_hash_table_insert (state->commands, g_steal_pointer (&key), value);
+    }
 
-        for (guint i = 0; i < G_N_ELEMENTS (tries); i++)
-          {
-            g_autofree gchar *other_path = g_strconcat (path, tries[i], NULL);
-            g_autoptr(GFile) other = g_file_new_for_path (other_path);
+  return GPOINTER_TO_UINT (value) - 1;
+}
 
-            if ((info = g_hash_table_lookup (self->info_by_file, other)))
-              return info;
-          }
-      }
-  }
+/*
+ * Stores the flags as ide_compile_commands_lookup() would return them for
+ * @info->file. System includes are added back when looking up.
+ */
+static GVariant *
+cache_builder_add_info (CacheBuilder       *state,
+                        IdeCompileCommands *self,
+                        const CompileInfo  *info,
+                        gboolean            is_vala)
+{
+  g_autofree gchar *base = g_file_get_basename (info->file);
+  g_auto(GStrv) argv = NULL;
+  const gchar *dot = strrchr (base, '.');
+  guint command = CACHE_INVALID_INDEX;
+  guchar kind = CACHE_KIND_RAW;
 
-  return NULL;
+  if (g_shell_parse_argv (info->command, NULL, &argv, NULL))
+    {
+      if (is_vala || suffix_is_vala (dot))
+        {
+          ide_compile_commands_filter_vala (self, info, &argv);
+          kind = CACHE_KIND_VALA;
+        }
+      else if (ide_path_is_c_like (dot) || ide_path_is_cpp_like (dot))
+        {
+          ide_compile_commands_filter_c (self, info, NULL, &argv);
+          kind = CACHE_KIND_C;
+        }
+
+      command = cache_builder_add_command (state, (const gchar * const *)argv);
+    }
+
+  return g_variant_new_variant (g_variant_new ("(uuy)",
+                                               cache_builder_add_directory (state, info->directory),
+                                               command,
+                                               kind));
+}
+
+static void
+ide_compile_commands_write_cache (IdeCompileCommands *self,
+                                  GFileInfo          *file_info,
+                                  GCancellable       *cancellable)
+{
+  g_autoptr(IdePersistentMapBuilder) builder = NULL;
+  g_autoptr(GError) error = NULL;
+  CacheBuilder state = {0};
+  GHashTableIter iter;
+  CompileInfo *info;
+  GFile *file;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+  g_assert (G_IS_FILE (self->cache_file));
+  g_assert (G_IS_FILE_INFO (file_info));
+  g_assert (self->info_by_file != NULL);
+  g_assert (self->vala_info != NULL);
+
+  builder = ide_persistent_map_builder_new ();
+
+  state.directories = g_hash_table_new_full (g_file_hash, (GEqualFunc)g_file_equal, g_object_unref, NULL);
+  state.commands = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_variant_builder_init (&state.directories_builder, G_VARIANT_TYPE_STRING_ARRAY);
+  g_variant_builder_init (&state.commands_builder, G_VARIANT_TYPE ("aas"));
+
+  g_hash_table_iter_init (&iter, self->info_by_file);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *)&file, (gpointer *)&info))
+    {
+      g_autofree gchar *path = g_file_get_path (file);
+
+      if (path != NULL && g_path_is_absolute (path))
+        ide_persistent_map_builder_insert (builder,
+                                           path,
+                                           cache_builder_add_info (&state, self, info, FALSE),
+                                           FALSE);
+    }
+
+  /* Matches the fallback for .vala files in ide_compile_commands_lookup() */
+  for (guint i = 0; i < self->vala_info->len; i++)
+    {
+      const CompileInfo *vala = g_ptr_array_index (self->vala_info, i);
+
+      if (g_shell_parse_argv (vala->command, NULL, NULL, NULL))
+        {
+          ide_persistent_map_builder_insert (builder,
+                                             CACHE_KEY_VALA,
+                                             cache_builder_add_info (&state, self, vala, TRUE),
+                                             FALSE);
+          break;
+        }
+    }
+
+  ide_persistent_map_builder_insert (builder,
+                                     CACHE_KEY_DIRECTORIES,
+                                     g_variant_new_variant (g_variant_builder_end (&state.directories_builder)),
+                                     FALSE);
+  ide_persistent_map_builder_insert (builder,
+                                     CACHE_KEY_COMMANDS,
+                                     g_variant_new_variant (g_variant_builder_end (&state.commands_builder)),
+                                     FALSE);
+
+  ide_persistent_map_builder_set_metadata_int64 (builder, "version", CACHE_VERSION);
+  ide_persistent_map_builder_set_metadata_int64 (builder, "size", g_file_info_get_size (file_info));
+  ide_persistent_map_builder_set_metadata_int64 (builder, "mtime",
+                                                 g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+                                                 g_file_info_get_attribute_uint32 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC));
+
+  if (!ide_persistent_map_builder_write (builder, self->cache_file, G_PRIORITY_LOW, cancellable, &error))
+    g_debug ("Failed to write compile commands cache: %s", error->message);
+
+  g_hash_table_unref (state.directories);
+  g_hash_table_unref (state.commands);
+
+  IDE_EXIT;
+}
+
+static gboolean
+ide_compile_commands_load_cache (IdeCompileCommands *self,
+                                 GFileInfo          *file_info,
+                                 GCancellable       *cancellable)
+{
+  g_autoptr(IdePersistentMap) cache = NULL;
+  g_autoptr(GVariant) directories = NULL;
+  g_autoptr(GVariant) commands = NULL;
+  g_autoptr(GError) error = NULL;
+  gint64 mtime;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+  g_assert (G_IS_FILE (self->cache_file));
+  g_assert (G_IS_FILE_INFO (file_info));
+
+  cache = ide_persistent_map_new ();
+
+  if (!ide_persistent_map_load_file (cache, self->cache_file, cancellable, &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        g_debug ("Failed to load compile commands cache: %s", error->message);
+      return FALSE;
+    }
+
+  mtime = g_file_info_get_attribute_uint64 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+          g_file_info_get_attribute_uint32 (file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+  if (ide_persistent_map_builder_get_metadata_int64 (cache, "version") != CACHE_VERSION ||
+      ide_persistent_map_builder_get_metadata_int64 (cache, "size") != g_file_info_get_size (file_info) ||
+      ide_persistent_map_builder_get_metadata_int64 (cache, "mtime") != mtime)
+    return FALSE;
+
+  if (!(directories = ide_persistent_map_lookup_value (cache, CACHE_KEY_DIRECTORIES)) ||
+      !(commands = ide_persistent_map_lookup_value (cache, CACHE_KEY_COMMANDS)))
+    return FALSE;
+
+  self->cache_directories = g_variant_get_variant (directories);
+  self->cache_commands = g_variant_get_variant (commands);
+
+  if (!g_variant_is_of_type (self->cache_directories, G_VARIANT_TYPE_STRING_ARRAY) ||
+      !g_variant_is_of_type (self->cache_commands, G_VARIANT_TYPE ("aas")))
+    {
+      g_clear_pointer (&self->cache_directories, g_variant_unref);
+      g_clear_pointer (&self->cache_commands, g_variant_unref);
+      return FALSE;
+    }
+
+  self->cache = g_steal_pointer (&cache);
+
+  return TRUE;
+}
+
+static gboolean
+lookup_cache_entry (IdeCompileCommands *self,
+                    const gchar        *key,
+                    guint              *directory,
+                    guint              *command,
+                    guchar             *kind)
+{
+  g_autoptr(GVariant) value = NULL;
+  g_autoptr(GVariant) entry = NULL;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+  g_assert (self->cache != NULL);
+
+  if (key == NULL ||
+      !(value = ide_persistent_map_lookup_value (self->cache, key)) ||
+      !(entry = g_variant_get_variant (value)) ||
+      !g_variant_is_of_type (entry, G_VARIANT_TYPE ("(uuy)")))
+    return FALSE;
+
+  g_variant_get (entry, "(uuy)", directory, command, kind);
+
+  return *directory < g_variant_n_children (self->cache_directories);
+}
+
+static gchar **
+ide_compile_commands_lookup_cache (IdeCompileCommands   *self,
+                                   GFile                *file,
+                                   const gchar          *dot,
+                                   const gchar * const  *system_includes,
+                                   GFile               **directory,
+                                   GError              **error)
+{
+  g_autoptr(GPtrArray) alternates = NULL;
+  g_autoptr(GVariant) flags = NULL;
+  g_autofree const gchar **strv = NULL;
+  const gchar *dir;
+  GPtrArray *ar;
+  gboolean found = FALSE;
+  guint dir_index = 0;
+  guint command = 0;
+  guchar kind = 0;
+  gsize len = 0;
+
+  g_assert (IDE_IS_COMPILE_COMMANDS (self));
+  g_assert (self->cache != NULL);
+
+  alternates = get_alternates (file);
+
+  for (guint i = 0; !found && i < alternates->len; i++)
+    {
+      g_autofree gchar *path = g_file_get_path (g_ptr_array_index (alternates, i));
+
+      found = lookup_cache_entry (self, path, &dir_index, &command, &kind);
+    }
+
+  if (!found && ide_str_equal0 (dot, ".vala"))
+    found = lookup_cache_entry (self, CACHE_KEY_VALA, &dir_index, &command, &kind);
+
+  if (!found)
+    {
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_NOT_FOUND,
+                           "Failed to locate command for requested file");
+      return NULL;
+    }
+
+  if (command >= g_variant_n_children (self->cache_commands))
+    {
+      g_set_error_literal (error,
+                           G_SHELL_ERROR,
+                           G_SHELL_ERROR_FAILED,
+                           "Failed to parse command for requested file");
+      return NULL;
+    }
+
+  g_variant_get_child (self->cache_directories, dir_index, "&s", &dir);
+  flags = g_variant_get_child_value (self->cache_commands, command);
+  strv = g_variant_get_strv (flags, &len);
+
+  ar = g_ptr_array_new ();
+
+  if (kind == CACHE_KIND_C && system_includes != NULL)
+    {
+      for (guint i = 0; system_includes[i]; i++)
+        g_ptr_array_add (ar, g_strdup_printf ("-I%s", system_includes[i]));
+    }
+
+  for (gsize i = 0; i < len; i++)
+    g_ptr_array_add (ar, g_strdup (strv[i]));
+
+  g_ptr_array_add (ar, NULL);
+
+  if (directory != NULL)
+    *directory = g_file_new_for_path (dir);
+
+  return (gchar **)g_ptr_array_free (ar, FALSE);
 }
 
 /**
@@ -695,6 +1152,9 @@ ide_compile_commands_lookup (IdeCompileCommands   *self,
   base = g_file_get_basename (file);
   dot = strrchr (base, '.');
 
+  if (self->cache != NULL)
+    return ide_compile_commands_lookup_cache (self, file, dot, system_includes, directory, error);
+
   if (NULL != (info = find_with_alternates (self, file)))
     {
       g_auto(GStrv) argv = NULL;
@@ -35,6 +35,13 @@ G_DECLARE_FINAL_TYPE (IdeCompileCommands, ide_compile_commands, IDE, COMPILE_COM
 
 IDE_AVAILABLE_IN_3_32
 IdeCompileCommands  *ide_compile_commands_new         (void);
+IDE_AVAILABLE_IN_3_40
+IdeCompileCommands  *ide_compile_commands_new_for_builddir
+                                                      (const gchar          *builddir);
+IDE_AVAILABLE_IN_3_40
+void                 ide_compile_commands_set_cache_file
+                                                      (IdeCompileCommands   *self,
+                                                       GFile                *cache_file);
 IDE_AVAILABLE_IN_3_32
 gboolean             ide_compile_commands_load        (IdeCompileCommands   *self,
                                                        GFile                *file,
@@ -0,0 +1,59 @@
+/* ide-error-matcher-private.h
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _IdeErrorMatcher IdeErrorMatcher;
+
+typedef struct
+{
+  /* A line of the form "make: Entering directory '...'" was found */
+  void     (*directory_changed) (const gchar *directory,
+                                 gsize        directory_len,
+                                 gpointer     user_data);
+  /* Return %TRUE if the match was used and no other format should run */
+  gboolean (*matched)           (GMatchInfo  *match_info,
+                                 gpointer     user_data);
+} IdeErrorMatcherCallbacks;
+
+IdeErrorMatcher *_ide_error_matcher_new           (void);
+void             _ide_error_matcher_free          (IdeErrorMatcher                *self);
+guint            _ide_error_matcher_add           (IdeErrorMatcher                *self,
+                                                   const gchar                    *regex,
+                                                   GRegexCompileFlags              flags,
+                                                   GError                        **error);
+gboolean         _ide_error_matcher_remove        (IdeErrorMatcher                *self,
+                                                   guint                           id);
+gboolean         _ide_error_matcher_is_empty      (IdeErrorMatcher                *self);
+void             _ide_error_matcher_set_prefilter (IdeErrorMatcher                *self,
+                                                   gboolean                        prefilter);
+void             _ide_error_matcher_match         (IdeErrorMatcher                *self,
+                                                   const gchar                    *data,
+                                                   gsize                           len,
+                                                   const IdeErrorMatcherCallbacks *callbacks,
+                                                   gpointer                        user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeErrorMatcher, _ide_error_matcher_free)
+
+G_END_DECLS
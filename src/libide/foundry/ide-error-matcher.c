@@ -0,0 +1,429 @@
+/* ide-error-matcher.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ide-error-matcher"
+
+#include "config.h"
+
+#include <libide-io.h>
+#include <string.h>
+
+#include "ide-error-matcher-private.h"
+#include "ide-regex-private.h"
+
+/*
+ * IdeErrorMatcher runs a set of error format regexes against build
+ * output. Most lines of build output match none of them, so rather than
+ * running every regex against every line, we find literal "anchors" that
+ * any match of a format must contain (such as ": " for GCC-style
+ * diagnostics) and search for each anchor once across the whole chunk.
+ * Only the formats whose anchors appear within a line are run on it.
+ *
+ * Formats for which no anchor can be determined are always run.
+ */
+
+#define ENTERING_DIRECTORY     "Entering directory '"
+#define ENTERING_DIRECTORY_LEN (sizeof ENTERING_DIRECTORY - 1)
+
+typedef struct
+{
+  gchar *text;
+  gsize  len;
+  guint  caseless : 1;
+} Anchor;
+
+typedef struct
+{
+  guint    id;
+  guint    caseless : 1;
+  GRegex  *regex;
+  /* Literals of which any match contains one, or %NULL */
+  gchar  **literals;
+  /* Indexes into IdeErrorMatcher.anchors for @literals */
+  GArray  *anchors;
+} Format;
+
+struct _IdeErrorMatcher
+{
+  GMutex  mutex;
+  GArray *formats;
+  /* The first anchor is always ENTERING_DIRECTORY */
+  GArray *anchors;
+  guint   last_id;
+  guint   prefilter : 1;
+};
+
+static void
+anchor_clear (gpointer data)
+{
+  Anchor *anchor = data;
+
+  g_clear_pointer (&anchor->text, g_free);
+}
+
+static void
+format_clear (gpointer data)
+{
+  Format *format = data;
+
+  g_clear_pointer (&format->regex, g_regex_unref);
+  g_clear_pointer (&format->literals, g_strfreev);
+  g_clear_pointer (&format->anchors, g_array_unref);
+}
+
+static guint
+add_anchor (IdeErrorMatcher *self,
+            const gchar     *text,
+            gboolean         caseless)
+{
+  Anchor anchor;
+
+  g_assert (self != NULL);
+  g_assert (text != NULL);
+
+  /* Folding case is only needed if there is something to fold */
+  if (caseless)
+    {
+      caseless = FALSE;
+
+      for (const gchar *p = text; *p; p++)
+        caseless |= g_ascii_isalpha (*p);
+    }
+
+  for (guint i = 0; i < self->anchors->len; i++)
+    {
+      const Anchor *other = &g_array_index (self->anchors, Anchor, i);
+
+      if (other->caseless == caseless &&
+          (caseless ? g_ascii_strcasecmp (other->text, text) : strcmp (other->text, text)) == 0)
+        return i;
+    }
+
+  anchor.text = caseless ? g_ascii_strdown (text, -1) : g_strdup (text);
+  anchor.len = strlen (text);
+  anchor.caseless = !!caseless;
+  g_array_append_val (self->anchors, anchor);
+
+  return self->anchors->len - 1;
+}
+
+static void
+rebuild_anchors (IdeErrorMatcher *self)
+{
+  g_assert (self != NULL);
+
+  g_array_set_size (self->anchors, 0);
+  add_anchor (self, ENTERING_DIRECTORY, FALSE);
+
+  for (guint i = 0; i < self->formats->len; i++)
+    {
+      Format *format = &g_array_index (self->formats, Format, i);
+
+      g_clear_pointer (&format->anchors, g_array_unref);
+
+      if (format->literals == NULL)
+        continue;
+
+      format->anchors = g_array_new (FALSE, FALSE, sizeof (guint));
+
+      for (guint j = 0; format->literals[j]; j++)
+        {
+          guint index = add_anchor (self, format->literals[j], format->caseless);
+          g_array_append_val (format->anchors, index);
+        }
+    }
+}
+
+static inline const gchar *
+find_anchor (const Anchor *anchor,
+             const gchar  *begin,
+             const gchar  *end)
+{
+  const gchar *last;
+  gchar first;
+
+  if ((gsize)(end - begin) < anchor->len)
+    return NULL;
+
+  if (!anchor->caseless)
+    return memmem (begin, end - begin, anchor->text, anchor->len);
+
+  /* Anchor text is stored in lower case */
+  first = anchor->text[0];
+  last = end - anchor->len;
+
+  for (const gchar *p = begin; p <= last; p++)
+    {
+      if (g_ascii_tolower (*p) == first &&
+          g_ascii_strncasecmp (p, anchor->text, anchor->len) == 0)
+        return p;
+    }
+
+  return NULL;
+}
+
+static gboolean
+extract_directory_change (const gchar                    *line,
+                          gsize                           line_len,
+                          const IdeErrorMatcherCallbacks *callbacks,
+                          gpointer                        user_data)
+{
+  const gchar *begin;
+  const gchar *end;
+
+  if (line_len == 0 || line[line_len - 1] != '\'')
+    return FALSE;
+
+  if (!(begin = memmem (line, line_len, ENTERING_DIRECTORY, ENTERING_DIRECTORY_LEN)))
+    return FALSE;
+
+  begin += ENTERING_DIRECTORY_LEN;
+  end = &line[line_len - 1];
+
+  if (begin > end || !g_utf8_validate (begin, end - begin, NULL))
+    return FALSE;
+
+  if (callbacks->directory_changed != NULL)
+    callbacks->directory_changed (begin, end - begin, user_data);
+
+  return TRUE;
+}
+
+IdeErrorMatcher *
+_ide_error_matcher_new (void)
+{
+  IdeErrorMatcher *self;
+
+  self = g_slice_new0 (IdeErrorMatcher);
+  g_mutex_init (&self->mutex);
+  self->prefilter = TRUE;
+  self->formats = g_array_new (FALSE, FALSE, sizeof (Format));
+  g_array_set_clear_func (self->formats, format_clear);
+  self->anchors = g_array_new (FALSE, FALSE, sizeof (Anchor));
+  g_array_set_clear_func (self->anchors, anchor_clear);
+
+  rebuild_anchors (self);
+
+  return self;
+}
+
+void
+_ide_error_matcher_free (IdeErrorMatcher *self)
+{
+  if (self != NULL)
+    {
+      g_clear_pointer (&self->formats, g_array_unref);
+      g_clear_pointer (&self->anchors, g_array_unref);
+      g_mutex_clear (&self->mutex);
+      g_slice_free (IdeErrorMatcher, self);
+    }
+}
+
+/**
+ * _ide_error_matcher_add:
+ * @self: an #IdeErrorMatcher
+ * @regex: the regex for the error format
+ * @flags: flags for compiling @regex
+ * @error: a location for a #GError, or %NULL
+ *
+ * Adds an error format to the matcher.
+ *
+ * Returns: an identifier for the format, or 0 and @error is set
+ */
+guint
+_ide_error_matcher_add (IdeErrorMatcher     *self,
+                        const gchar         *regex,
+                        GRegexCompileFlags   flags,
+                        GError             **error)
+{
+  Format format = {0};
+
+  g_return_val_if_fail (self != NULL, 0);
+  g_return_val_if_fail (regex != NULL, 0);
+
+  if (!(format.regex = g_regex_new (regex, G_REGEX_OPTIMIZE | flags, 0, error)))
+    return 0;
+
+  format.caseless = !!(flags & G_REGEX_CASELESS);
+
+  /* Whitespace and comments are not literal in extended patterns */
+  if (!(flags & G_REGEX_EXTENDED))
+    format.literals = _ide_regex_extract_literals (regex, format.caseless);
+
+  g_mutex_lock (&self->mutex);
+  format.id = ++self->last_id;
+  g_array_append_val (self->formats, format);
+  rebuild_anchors (self);
+  g_mutex_unlock (&self->mutex);
+
+  return format.id;
+}
+
+gboolean
+_ide_error_matcher_remove (IdeErrorMatcher *self,
+                           guint            id)
+{
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  g_mutex_lock (&self->mutex);
+
+  for (guint i = 0; i < self->formats->len; i++)
+    {
+      if (g_array_index (self->formats, Format, i).id == id)
+        {
+          g_array_remove_index (self->formats, i);
+          rebuild_anchors (self);
+          ret = TRUE;
+          break;
+        }
+    }
+
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+gboolean
+_ide_error_matcher_is_empty (IdeErrorMatcher *self)
+{
+  gboolean ret;
+
+  g_return_val_if_fail (self != NULL, TRUE);
+
+  g_mutex_lock (&self->mutex);
+  ret = self->formats->len == 0;
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
+
+/*
+ * Disabling the prefilter runs every format against every line, which
+ * is only useful to compare the two.
+ */
+void
+_ide_error_matcher_set_prefilter (IdeErrorMatcher *self,
+                                  gboolean         prefilter)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->prefilter = !!prefilter;
+  g_mutex_unlock (&self->mutex);
+}
+
+/**
+ * _ide_error_matcher_match:
+ * @self: an #IdeErrorMatcher
+ * @data: the build output
+ * @len: the length of @data in bytes
+ * @callbacks: callbacks for directory changes and matches
+ * @user_data: closure data for @callbacks
+ *
+ * Runs the error formats against each line of @data, in the order they
+ * were added, until @callbacks->matched returns %TRUE.
+ *
+ * This may be called from any thread, but @callbacks must not add or
+ * remove formats.
+ */
+void
+_ide_error_matcher_match (IdeErrorMatcher                *self,
+                          const gchar                    *data,
+                          gsize                           len,
+                          const IdeErrorMatcherCallbacks *callbacks,
+                          gpointer                        user_data)
+{
+  const gchar *end = data + len;
+  const gchar **next;
+  gboolean *present;
+  IdeLineReader reader;
+  gchar *line;
+  gsize line_len;
+  guint n_anchors;
+
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (data != NULL || len == 0);
+  g_return_if_fail (callbacks != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (len == 0 || self->formats->len == 0)
+    goto unlock;
+
+  n_anchors = self->prefilter ? self->anchors->len : 0;
+  next = g_newa (const gchar *, n_anchors + 1);
+  present = g_newa (gboolean, n_anchors + 1);
+
+  /* The next occurrence of each anchor, or @end if there are no more */
+  for (guint i = 0; i < n_anchors; i++)
+    {
+      const Anchor *anchor = &g_array_index (self->anchors, Anchor, i);
+
+      if (!(next[i] = find_anchor (anchor, data, end)))
+        next[i] = end;
+    }
+
+  ide_line_reader_init (&reader, (gchar *)data, len);
+
+  while (NULL != (line = ide_line_reader_next (&reader, &line_len)))
+    {
+      const gchar *eol = line + line_len;
+
+      for (guint i = 0; i < n_anchors; i++)
+        {
+          const Anchor *anchor = &g_array_index (self->anchors, Anchor, i);
+
+          if (next[i] < line && !(next[i] = find_anchor (anchor, line, end)))
+            next[i] = end;
+
+          present[i] = next[i] < eol && (gsize)(eol - next[i]) >= anchor->len;
+        }
+
+      if ((n_anchors == 0 || present[0]) &&
+          extract_directory_change (line, line_len, callbacks, user_data))
+        continue;
+
+      for (guint i = 0; i < self->formats->len; i++)
+        {
+          const Format *format = &g_array_index (self->formats, Format, i);
+          g_autoptr(GMatchInfo) match_info = NULL;
+
+          if (n_anchors > 0 && format->anchors != NULL)
+            {
+              gboolean found = FALSE;
+
+              for (guint j = 0; !found && j < format->anchors->len; j++)
+                found = present[g_array_index (format->anchors, guint, j)];
+
+              if (!found)
+                continue;
+            }
+
+          if (g_regex_match_full (format->regex, line, line_len, 0, 0, &match_info, NULL) &&
+              callbacks->matched (match_info, user_data))
+            break;
+        }
+    }
+
+unlock:
+  g_mutex_unlock (&self->mutex);
+}
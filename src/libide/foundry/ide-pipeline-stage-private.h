@@ -37,5 +37,8 @@ void          _ide_pipeline_stage_build_with_query_async  (IdePipelineStage
 gboolean      _ide_pipeline_stage_build_with_query_finish (IdePipelineStage     *self,
                                                            GAsyncResult         *result,
                                                            GError              **error);
+gboolean      _ide_pipeline_stage_get_has_dependencies    (IdePipelineStage     *self);
+gboolean      _ide_pipeline_stage_depends_on              (IdePipelineStage     *self,
+                                                           IdePipelineStage     *earlier);
 
 G_END_DECLS
@@ -40,6 +40,9 @@ typedef struct
   GOutputStream       *stdout_stream;
   gint                 n_pause;
   IdePipelinePhase        phase;
+  GPtrArray           *dependencies;
+  GPtrArray           *inputs;
+  GPtrArray           *outputs;
   guint                completed : 1;
   guint                disabled : 1;
   guint                transient : 1;
@@ -261,6 +264,9 @@ ide_pipeline_stage_finalize (GObject *object)
   g_clear_pointer (&priv->stdout_path, g_free);
   g_clear_object (&priv->queued_build);
   g_clear_object (&priv->stdout_stream);
+  g_clear_pointer (&priv->dependencies, g_ptr_array_unref);
+  g_clear_pointer (&priv->inputs, g_ptr_array_unref);
+  g_clear_pointer (&priv->outputs, g_ptr_array_unref);
 
   G_OBJECT_CLASS (ide_pipeline_stage_parent_class)->finalize (object);
 }
@@ -1218,3 +1224,144 @@ _ide_pipeline_stage_set_phase (IdePipelineStage *self,
 
   priv->phase = phase;
 }
+
+/**
+ * ide_pipeline_stage_add_dependency:
+ * @self: a #IdePipelineStage
+ * @dependency: an #IdePipelineStage that must complete before @self
+ *
+ * Declares that @self must not run until @dependency has completed.
+ * @dependency must be attached to the pipeline before @self.
+ *
+ * Stages that declare their dependencies, inputs, or outputs may run
+ * concurrently with other such stages they do not depend upon. Stages
+ * that declare none of them run by themselves, in pipeline order.
+ *
+ * Since: 3.40
+ */
+void
+ide_pipeline_stage_add_dependency (IdePipelineStage *self,
+                                   IdePipelineStage *dependency)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_PIPELINE_STAGE (self));
+  g_return_if_fail (IDE_IS_PIPELINE_STAGE (dependency));
+  g_return_if_fail (self != dependency);
+
+  if (priv->dependencies == NULL)
+    priv->dependencies = g_ptr_array_new_with_free_func (g_object_unref);
+  g_ptr_array_add (priv->dependencies, g_object_ref (dependency));
+}
+
+/**
+ * ide_pipeline_stage_add_input:
+ * @self: a #IdePipelineStage
+ * @resource: a path or other name for something @self reads
+ *
+ * Declares that @self reads @resource, so that it will not run
+ * concurrently with an earlier stage that declares @resource as an
+ * output. See ide_pipeline_stage_add_dependency().
+ *
+ * Since: 3.40
+ */
+void
+ide_pipeline_stage_add_input (IdePipelineStage *self,
+                              const gchar      *resource)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_PIPELINE_STAGE (self));
+  g_return_if_fail (resource != NULL);
+
+  if (priv->inputs == NULL)
+    priv->inputs = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (priv->inputs, g_strdup (resource));
+}
+
+/**
+ * ide_pipeline_stage_add_output:
+ * @self: a #IdePipelineStage
+ * @resource: a path or other name for something @self writes
+ *
+ * Declares that @self writes @resource, so that it will not run
+ * concurrently with an earlier stage that reads or writes @resource.
+ * See ide_pipeline_stage_add_dependency().
+ *
+ * Since: 3.40
+ */
+void
+ide_pipeline_stage_add_output (IdePipelineStage *self,
+                               const gchar      *resource)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_PIPELINE_STAGE (self));
+  g_return_if_fail (resource != NULL);
+
+  if (priv->outputs == NULL)
+    priv->outputs = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (priv->outputs, g_strdup (resource));
+}
+
+gboolean
+_ide_pipeline_stage_get_has_dependencies (IdePipelineStage *self)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_PIPELINE_STAGE (self), FALSE);
+
+  return priv->dependencies != NULL || priv->inputs != NULL || priv->outputs != NULL;
+}
+
+static gboolean
+resources_intersect (GPtrArray *a,
+                     GPtrArray *b)
+{
+  if (a == NULL || b == NULL)
+    return FALSE;
+
+  for (guint i = 0; i < a->len; i++)
+    {
+      for (guint j = 0; j < b->len; j++)
+        {
+          if (g_str_equal (g_ptr_array_index (a, i), g_ptr_array_index (b, j)))
+            return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/*
+ * Checks if @self must wait for @earlier, a stage attached before it.
+ * Stages that have not declared any dependencies are ordered with
+ * respect to every other stage.
+ */
+gboolean
+_ide_pipeline_stage_depends_on (IdePipelineStage *self,
+                                IdePipelineStage *earlier)
+{
+  IdePipelineStagePrivate *priv = ide_pipeline_stage_get_instance_private (self);
+  IdePipelineStagePrivate *epriv = ide_pipeline_stage_get_instance_private (earlier);
+
+  g_return_val_if_fail (IDE_IS_PIPELINE_STAGE (self), TRUE);
+  g_return_val_if_fail (IDE_IS_PIPELINE_STAGE (earlier), TRUE);
+
+  if (!_ide_pipeline_stage_get_has_dependencies (self) ||
+      !_ide_pipeline_stage_get_has_dependencies (earlier))
+    return TRUE;
+
+  if (priv->dependencies != NULL)
+    {
+      for (guint i = 0; i < priv->dependencies->len; i++)
+        {
+          if (g_ptr_array_index (priv->dependencies, i) == (gpointer)earlier)
+            return TRUE;
+        }
+    }
+
+  return resources_intersect (epriv->outputs, priv->inputs) ||
+         resources_intersect (epriv->outputs, priv->outputs) ||
+         resources_intersect (epriv->inputs, priv->outputs);
+}
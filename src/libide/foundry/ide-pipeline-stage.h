@@ -211,5 +211,14 @@ void         ide_pipeline_stage_unpause          (IdePipelineStage     *self);
 IDE_AVAILABLE_IN_3_32
 void         ide_pipeline_stage_emit_reap        (IdePipelineStage     *self,
                                                   DzlDirectoryReaper   *reaper);
+IDE_AVAILABLE_IN_3_40
+void         ide_pipeline_stage_add_dependency   (IdePipelineStage     *self,
+                                                  IdePipelineStage     *dependency);
+IDE_AVAILABLE_IN_3_40
+void         ide_pipeline_stage_add_input        (IdePipelineStage     *self,
+                                                  const gchar          *resource);
+IDE_AVAILABLE_IN_3_40
+void         ide_pipeline_stage_add_output       (IdePipelineStage     *self,
+                                                  const gchar          *resource);
 
 G_END_DECLS
@@ -47,6 +47,7 @@
 #include "ide-build-system.h"
 #include "ide-device-info.h"
 #include "ide-device.h"
+#include "ide-error-matcher-private.h"
 #include "ide-foundry-compat.h"
 #include "ide-foundry-enums.h"
 #include "ide-run-manager-private.h"
@@ -55,6 +56,8 @@
 #include "ide-toolchain.h"
 #include "ide-triplet.h"
 
+#define MAX_CONCURRENT_STAGES 4
+
 DZL_DEFINE_COUNTER (Instances, "Pipeline", "N Pipelines", "Number of Pipeline instances")
 G_DEFINE_QUARK (ide_build_error, ide_build_error)
 
@@ -90,6 +93,16 @@ G_DEFINE_QUARK (ide_build_error, ide_build_error)
  * precise ordering is required, you may use the priority parameter to order
  * the operation with regards to other stages in that phase.
  *
+ * Stages run one at a time in that order, unless they declare what they
+ * depend upon with ide_pipeline_stage_add_dependency(),
+ * ide_pipeline_stage_add_input(), or ide_pipeline_stage_add_output().
+ * Adjacent stages that do so may run concurrently when they do not depend
+ * on each other. Diagnostics are extracted from the output of each stage
+ * separately, except for the output of subprocesses attached to the
+ * pipeline's PTY, which cannot be told apart. So while error formats are
+ * registered, only one stage using the PTY runs at a time. When stages
+ * overlap, the critical path of the build is reported in the build log.
+ *
  * Transient stages may be added to the pipeline and they will be removed after
  * the ide_pipeline_build_async() operation has completed successfully
  * or has failed. You can mark a stage as trandient with
@@ -114,11 +127,67 @@ typedef struct
   GPtrArray        *addins;
 } IdleLoadState;
 
+typedef enum
+{
+  STAGE_PENDING,
+  STAGE_RUNNING,
+  STAGE_DONE,
+  STAGE_SKIPPED,
+} StageState;
+
+typedef struct
+{
+  StageState        state;
+  gint64            begin_time;
+  gint64            end_time;
+  /* The stage it waited for last, used to find the critical path */
+  IdePipelineStage *waited_for;
+} StageRun;
+
+typedef enum
+{
+  EXTRACT_OUTPUT,
+  EXTRACT_RESET,
+  EXTRACT_FLUSH,
+} ExtractKind;
+
+typedef void (*ExtractFlushFunc) (IdePipeline *self,
+                                  gpointer     user_data);
+
+typedef struct
+{
+  ExtractKind       kind;
+  /* The build the request belongs to */
+  guint             sequence;
+  /* EXTRACT_OUTPUT: a chunk of build output, and the stage that logged
+   * it or %NULL if it came from the PTY. The stage is only used as a key.
+   */
+  GBytes           *bytes;
+  gconstpointer     source;
+  /* EXTRACT_RESET: directories to resolve relative filenames */
+  gchar            *builddir;
+  gchar            *srcdir;
+  /* EXTRACT_FLUSH: called from the main loop once earlier requests
+   * were extracted and their diagnostics emitted.
+   */
+  IdePipeline      *self;
+  ExtractFlushFunc  flush_func;
+  gpointer          flush_data;
+  GDestroyNotify    flush_data_destroy;
+} ExtractRequest;
+
+/* Directory enter/leave tracking for the output of one source */
 typedef struct
 {
-  guint   id;
-  GRegex *regex;
-} ErrorFormat;
+  gchar *current_dir;
+  gchar *top_dir;
+} ExtractDirs;
+
+typedef struct
+{
+  IdePipeline      *self;
+  IdePipelineStage *stage;
+} StageObserver;
 
 struct _IdePipeline
 {
@@ -203,15 +272,38 @@ struct _IdePipeline
   GPtrArray *chained_bindings;
 
   /*
-   * This are used for ErrorFormat registration so that we have a
+   * This are used for error format registration so that we have a
    * single place to extract "GCC-style" warnings and errors. Other
    * languages can also register these so they show up in the build
    * errors panel.
+   *
+   * Unless disabled with the "extract-errors-in-thread" setting, build
+   * output is matched against the formats on @extract_pool so that the
+   * regexes never run on the main loop. Otherwise it is matched from the
+   * thread producing it while holding @extract_mutex. The errfmt fields
+   * belong to whichever is extracting, and the directories are copied
+   * when a build starts so the pipeline is never read from there.
+   * Directories are tracked separately for the output of each stage, and
+   * for the PTY, in @errfmt_dirs.
+   *
+   * Resulting diagnostics are queued in @pending_diagnostics and emitted
+   * from @diagnostics_source. They are tagged with @build_sequence so
+   * that those of a previous build are dropped.
    */
-  GArray *errfmts;
-  gchar  *errfmt_current_dir;
-  gchar  *errfmt_top_dir;
-  guint   errfmt_seqnum;
+  IdeErrorMatcher *error_matcher;
+  GThreadPool     *extract_pool;
+  GMutex           extract_mutex;
+  GHashTable      *errfmt_dirs;
+  ExtractDirs     *errfmt_current;
+  gchar           *errfmt_builddir;
+  gchar           *errfmt_srcdir;
+  guint            errfmt_sequence;
+  GMutex           diagnostics_mutex;
+  GPtrArray       *pending_diagnostics;
+  guint            pending_sequence;
+  guint            diagnostics_source;
+  gint             build_sequence;
+  gint             extract_disposed;
 
   /*
    * The VtePty is used to connect to a VteTerminal. It's basically
@@ -222,10 +314,17 @@ struct _IdePipeline
    * we created that will get attached to stdin/stdout/stderr in our
    * spawned subprocesses. It is a slave to the PTY master owned by
    * the IdePtyIntercept.
+   *
+   * Unless disabled with the "intercept-pty-in-thread" setting, the
+   * intercept is driven by @intercept_context from @intercept_thread
+   * so that build output is never copied on the UI thread.
    */
   VtePty          *pty;
   IdePtyIntercept  intercept;
   IdePtyFd         pty_slave;
+  GMainContext    *intercept_context;
+  GMainLoop       *intercept_loop;
+  GThread         *intercept_thread;
 
   /*
    * If the terminal interpreting our Pty has received a terminal
@@ -242,10 +341,25 @@ struct _IdePipeline
 
   /*
    * The index of our current PipelineEntry. This should start at -1
-   * to indicate that no stage is currently active.
+   * to indicate that no stage is currently active. While building, it
+   * is the first stage that has not completed.
    */
   gint position;
 
+  /*
+   * The StageRun of each stage during a build, keyed by stage. Stages
+   * that declare their dependencies may run concurrently, so we track
+   * how many are running and the first error to stop the build.
+   *
+   * Output logged by a stage is extracted with its own directory
+   * tracking. Output on the PTY cannot be attributed to a stage, so
+   * stages using it do not overlap while there are error formats.
+   */
+  GHashTable *schedule;
+  guint       n_running;
+  GError     *build_error;
+  gint64      build_begin_time;
+
   /*
    * This is the requested mask to be built. It should be reset after
    * performing a build so that a followup build_async() would be
@@ -309,6 +423,12 @@ struct _IdePipeline
    * has been marked as ready).
    */
   guint loaded : 1;
+
+  /*
+   * If stages ran concurrently during the current build, so that the
+   * critical path is worth reporting.
+   */
+  guint stages_overlapped : 1;
 };
 
 typedef enum
@@ -469,12 +589,31 @@ task_data_new (IdeTask  *task,
 }
 
 static void
-clear_error_format (gpointer data)
+extract_dirs_free (gpointer data)
+{
+  ExtractDirs *dirs = data;
+
+  g_clear_pointer (&dirs->current_dir, g_free);
+  g_clear_pointer (&dirs->top_dir, g_free);
+  g_slice_free (ExtractDirs, dirs);
+}
+
+static void
+stage_observer_free (gpointer data)
 {
-  ErrorFormat *errfmt = data;
+  g_slice_free (StageObserver, data);
+}
 
-  errfmt->id = 0;
-  g_clear_pointer (&errfmt->regex, g_regex_unref);
+static void
+extract_request_free (ExtractRequest *request)
+{
+  g_clear_pointer (&request->bytes, g_bytes_unref);
+  g_clear_pointer (&request->builddir, g_free);
+  g_clear_pointer (&request->srcdir, g_free);
+  if (request->flush_data_destroy != NULL)
+    request->flush_data_destroy (request->flush_data);
+  g_clear_object (&request->self);
+  g_slice_free (ExtractRequest, request);
 }
 
 static inline const gchar *
@@ -536,7 +675,6 @@ create_diagnostic (IdePipeline *self,
   g_autofree gchar *level = NULL;
   g_autoptr(GFile) file = NULL;
   g_autoptr(IdeLocation) location = NULL;
-  IdeContext *context;
   struct {
     gint64 line;
     gint64 column;
@@ -591,13 +729,13 @@ create_diagnostic (IdePipeline *self,
     {
       gchar *path;
 
-      if (self->errfmt_current_dir != NULL)
+      if (self->errfmt_current->current_dir != NULL && self->errfmt_current->top_dir != NULL)
         {
-          const gchar *basedir = self->errfmt_current_dir;
+          const gchar *basedir = self->errfmt_current->current_dir;
 
-          if (g_str_has_prefix (basedir, self->errfmt_top_dir))
+          if (g_str_has_prefix (basedir, self->errfmt_current->top_dir))
             {
-              basedir += strlen (self->errfmt_top_dir);
+              basedir += strlen (self->errfmt_current->top_dir);
               if (*basedir == G_DIR_SEPARATOR)
                 basedir++;
             }
@@ -606,99 +744,143 @@ create_diagnostic (IdePipeline *self,
           g_free (filename);
           filename = path;
         }
-      else
+      else if (self->errfmt_builddir != NULL)
         {
-          path = g_build_filename (self->builddir, filename, NULL);
+          path = g_build_filename (self->errfmt_builddir, filename, NULL);
           g_free (filename);
           filename = path;
         }
     }
 
-  context = ide_object_get_context (IDE_OBJECT (self));
-
   if (!g_path_is_absolute (filename))
     {
-      g_autoptr(GFile) child = NULL;
-      g_autoptr(GFile) workdir = NULL;
       gchar *path;
 
-      workdir = ide_context_ref_workdir (context);
-      child = g_file_get_child (workdir, filename);
-      path = g_file_get_path (child);
+      if (self->errfmt_srcdir == NULL)
+        return NULL;
 
+      path = g_build_filename (self->errfmt_srcdir, filename, NULL);
       g_free (filename);
       filename = path;
     }
 
-  file = ide_context_build_file (context, filename);
+  file = g_file_new_for_path (filename);
   location = ide_location_new (file, parsed.line, parsed.column);
 
   return ide_diagnostic_new (parsed.severity, message, location);
 }
 
-static gboolean
-extract_directory_change (IdePipeline  *self,
-                          const guint8 *data,
-                          gsize         len)
+static void
+extract_directory_changed_cb (const gchar *dir,
+                              gsize        len,
+                              gpointer     user_data)
 {
-  g_autofree gchar *dir = NULL;
-  const guint8 *begin;
+  IdePipeline *self = user_data;
+  ExtractDirs *dirs;
 
   g_assert (IDE_IS_PIPELINE (self));
+  g_assert (self->errfmt_current != NULL);
+
+  dirs = self->errfmt_current;
+
+  g_free (dirs->current_dir);
 
   if (len == 0)
-    return FALSE;
+    dirs->current_dir = g_strdup (dirs->top_dir);
+  else
+    dirs->current_dir = g_strndup (dir, len);
 
-#define ENTERING_DIRECTORY_BEGIN "Entering directory '"
-#define ENTERING_DIRECTORY_END   "'"
+  if (dirs->top_dir == NULL)
+    dirs->top_dir = g_strdup (dirs->current_dir);
+}
 
-  begin = memmem (data, len, ENTERING_DIRECTORY_BEGIN, strlen (ENTERING_DIRECTORY_BEGIN));
-  if (begin == NULL)
-    return FALSE;
+static void
+emit_pending_diagnostics (IdePipeline *self)
+{
+  g_autoptr(GPtrArray) pending = NULL;
+  guint sequence;
 
-  begin += strlen (ENTERING_DIRECTORY_BEGIN);
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (IDE_IS_MAIN_THREAD ());
+
+  g_mutex_lock (&self->diagnostics_mutex);
+  pending = g_steal_pointer (&self->pending_diagnostics);
+  sequence = self->pending_sequence;
+  self->pending_diagnostics = g_ptr_array_new_with_free_func (g_object_unref);
+  g_clear_handle_id (&self->diagnostics_source, g_source_remove);
+  g_mutex_unlock (&self->diagnostics_mutex);
+
+  /* Drop diagnostics from a previous build or a destroyed pipeline */
+  if (sequence != (guint)g_atomic_int_get (&self->build_sequence) ||
+      g_atomic_int_get (&self->extract_disposed))
+    return;
 
-  if (data[len - 1] != '\'')
-    return FALSE;
+  for (guint i = 0; i < pending->len; i++)
+    ide_pipeline_emit_diagnostic (self, g_ptr_array_index (pending, i));
+}
 
-  len = &data[len - 1] - begin;
-  dir = g_strndup ((gchar *)begin, len);
+static gboolean
+emit_pending_diagnostics_cb (gpointer data)
+{
+  IdePipeline *self = data;
 
-  if (g_utf8_validate (dir, len, NULL))
-    {
-      g_free (self->errfmt_current_dir);
+  g_assert (IDE_IS_PIPELINE (self));
 
-      if (len == 0)
-        self->errfmt_current_dir = g_strdup (self->errfmt_top_dir);
-      else
-        self->errfmt_current_dir = g_strndup (dir, len);
+  g_mutex_lock (&self->diagnostics_mutex);
+  self->diagnostics_source = 0;
+  g_mutex_unlock (&self->diagnostics_mutex);
 
-      if (self->errfmt_top_dir == NULL)
-        self->errfmt_top_dir = g_strdup (self->errfmt_current_dir);
+  emit_pending_diagnostics (self);
 
-      return TRUE;
-    }
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+extract_matched_cb (GMatchInfo *match_info,
+                    gpointer    user_data)
+{
+  IdePipeline *self = user_data;
+  IdeDiagnostic *diagnostic;
 
-#undef ENTERING_DIRECTORY_BEGIN
-#undef ENTERING_DIRECTORY_END
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (match_info != NULL);
 
-  return FALSE;
+  if (!(diagnostic = create_diagnostic (self, match_info)))
+    return FALSE;
+
+  g_mutex_lock (&self->diagnostics_mutex);
+  if (self->pending_sequence != self->errfmt_sequence)
+    {
+      g_ptr_array_set_size (self->pending_diagnostics, 0);
+      self->pending_sequence = self->errfmt_sequence;
+    }
+  g_ptr_array_add (self->pending_diagnostics, diagnostic);
+  if (self->diagnostics_source == 0)
+    self->diagnostics_source = g_idle_add_full (G_PRIORITY_DEFAULT,
+                                                emit_pending_diagnostics_cb,
+                                                g_object_ref (self),
+                                                g_object_unref);
+  g_mutex_unlock (&self->diagnostics_mutex);
+
+  return TRUE;
 }
 
+static const IdeErrorMatcherCallbacks extract_callbacks = {
+  extract_directory_changed_cb,
+  extract_matched_cb,
+};
+
 static void
 extract_diagnostics (IdePipeline  *self,
                      const guint8 *data,
                      gsize         len)
 {
   g_autofree guint8 *unescaped = NULL;
-  IdeLineReader reader;
-  gchar *line;
-  gsize line_len;
 
   g_assert (IDE_IS_PIPELINE (self));
   g_assert (data != NULL);
 
-  if (len == 0 || self->errfmts->len == 0)
+  if (len == 0)
     return;
 
   /* If we have any color escape sequences, remove them */
@@ -714,30 +896,204 @@ extract_diagnostics (IdePipeline  *self,
       len = out_len;
     }
 
-  ide_line_reader_init (&reader, (gchar *)data, len);
+  _ide_error_matcher_match (self->error_matcher,
+                            (const gchar *)data,
+                            len,
+                            &extract_callbacks,
+                            self);
+}
 
-  while (NULL != (line = ide_line_reader_next (&reader, &line_len)))
+static gboolean
+extract_flushed_cb (gpointer data)
+{
+  ExtractRequest *request = data;
+
+  g_assert (request != NULL);
+  g_assert (request->kind == EXTRACT_FLUSH);
+  g_assert (IDE_IS_PIPELINE (request->self));
+
+  emit_pending_diagnostics (request->self);
+  request->flush_func (request->self, request->flush_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+process_extract (IdePipeline    *self,
+                 ExtractRequest *request)
+{
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (request != NULL);
+
+  if (g_atomic_int_get (&self->extract_disposed))
+    return;
+
+  switch (request->kind)
     {
-      if (extract_directory_change (self, (const guint8 *)line, line_len))
-        continue;
+    case EXTRACT_RESET:
+      g_hash_table_remove_all (self->errfmt_dirs);
+      g_clear_pointer (&self->errfmt_builddir, g_free);
+      g_clear_pointer (&self->errfmt_srcdir, g_free);
+      self->errfmt_builddir = g_steal_pointer (&request->builddir);
+      self->errfmt_srcdir = g_steal_pointer (&request->srcdir);
+      break;
 
-      for (guint i = 0; i < self->errfmts->len; i++)
-        {
-          const ErrorFormat *errfmt = &g_array_index (self->errfmts, ErrorFormat, i);
-          g_autoptr(GMatchInfo) match_info = NULL;
+    case EXTRACT_OUTPUT:
+      {
+        gsize len;
+        const guint8 *buf = g_bytes_get_data (request->bytes, &len);
 
-          if (g_regex_match_full (errfmt->regex, line, line_len, 0, 0, &match_info, NULL))
-            {
-              g_autoptr(IdeDiagnostic) diagnostic = create_diagnostic (self, match_info);
+        if (!(self->errfmt_current = g_hash_table_lookup (self->errfmt_dirs, request->source)))
+          {
+            self->errfmt_current = g_slice_new0 (ExtractDirs);
+            g_hash_table_insert (self->errfmt_dirs, (gpointer)request->source, self->errfmt_current);
+          }
 
-              if (diagnostic != NULL)
-                {
-                  ide_pipeline_emit_diagnostic (self, diagnostic);
-                  break;
-                }
-            }
-        }
+        self->errfmt_sequence = request->sequence;
+        extract_diagnostics (self, buf, len);
+        self->errfmt_current = NULL;
+      }
+      break;
+
+    case EXTRACT_FLUSH:
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+ide_pipeline_extract_worker (gpointer data,
+                             gpointer user_data)
+{
+  ExtractRequest *request = data;
+  IdePipeline *self = user_data;
+
+  g_assert (request != NULL);
+  g_assert (IDE_IS_PIPELINE (self));
+
+  /* Flushes always complete so that their callers may continue */
+  if (request->kind == EXTRACT_FLUSH)
+    {
+      g_idle_add_full (G_PRIORITY_DEFAULT,
+                       extract_flushed_cb,
+                       request,
+                       (GDestroyNotify)extract_request_free);
+      return;
+    }
+
+  process_extract (self, request);
+  extract_request_free (request);
+}
+
+static void
+push_extract (IdePipeline    *self,
+              ExtractRequest *request)
+{
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (request != NULL);
+
+  if (self->extract_pool != NULL)
+    {
+      g_thread_pool_push (self->extract_pool, request, NULL);
+      return;
+    }
+
+  if (request->kind == EXTRACT_FLUSH)
+    {
+      g_assert (IDE_IS_MAIN_THREAD ());
+
+      extract_flushed_cb (request);
+    }
+  else
+    {
+      g_mutex_lock (&self->extract_mutex);
+      process_extract (self, request);
+      g_mutex_unlock (&self->extract_mutex);
     }
+
+  extract_request_free (request);
+}
+
+/*
+ * Copies @data so that diagnostics can be extracted from it, on the
+ * extraction thread unless it is disabled. @source is the stage that
+ * logged @data, or %NULL for output from the PTY.
+ */
+static void
+queue_extract (IdePipeline      *self,
+               IdePipelineStage *source,
+               const guint8     *data,
+               gsize             len)
+{
+  ExtractRequest *request;
+
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (data != NULL);
+
+  if (len == 0 ||
+      g_atomic_int_get (&self->extract_disposed) ||
+      _ide_error_matcher_is_empty (self->error_matcher))
+    return;
+
+  request = g_slice_new0 (ExtractRequest);
+  request->kind = EXTRACT_OUTPUT;
+  request->sequence = g_atomic_int_get (&self->build_sequence);
+  request->bytes = g_bytes_new (data, len);
+  request->source = source;
+
+  push_extract (self, request);
+}
+
+/*
+ * Resets directory tracking once previously queued output has been
+ * extracted, and copies the directories used to resolve filenames so
+ * that the extraction never needs to read them from @self.
+ */
+static void
+queue_extract_reset (IdePipeline *self)
+{
+  ExtractRequest *request;
+
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (IDE_IS_MAIN_THREAD ());
+
+  if (g_atomic_int_get (&self->extract_disposed))
+    return;
+
+  request = g_slice_new0 (ExtractRequest);
+  request->kind = EXTRACT_RESET;
+  request->sequence = g_atomic_int_get (&self->build_sequence);
+  request->builddir = g_strdup (self->builddir);
+  request->srcdir = g_strdup (self->srcdir);
+
+  push_extract (self, request);
+}
+
+/*
+ * Calls @flush_func from the main loop once all previously queued output
+ * has been extracted and its diagnostics emitted.
+ */
+static void
+queue_extract_flush (IdePipeline      *self,
+                     ExtractFlushFunc  flush_func,
+                     gpointer          flush_data,
+                     GDestroyNotify    flush_data_destroy)
+{
+  ExtractRequest *request;
+
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (flush_func != NULL);
+
+  request = g_slice_new0 (ExtractRequest);
+  request->kind = EXTRACT_FLUSH;
+  request->sequence = g_atomic_int_get (&self->build_sequence);
+  request->self = g_object_ref (self);
+  request->flush_func = flush_func;
+  request->flush_data = flush_data;
+  request->flush_data_destroy = flush_data_destroy;
+
+  push_extract (self, request);
 }
 
 static void
@@ -746,19 +1102,23 @@ ide_pipeline_log_observer (IdeBuildLogStream  stream,
                            gssize             message_len,
                            gpointer           user_data)
 {
-  IdePipeline *self = user_data;
+  StageObserver *observer = user_data;
+  IdePipeline *self;
 
   g_assert (stream == IDE_BUILD_LOG_STDOUT || stream == IDE_BUILD_LOG_STDERR);
-  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (observer != NULL);
+  g_assert (IDE_IS_PIPELINE (observer->self));
   g_assert (message != NULL);
 
+  self = observer->self;
+
   if (message_len < 0)
     message_len = strlen (message);
 
   if (self->log != NULL)
     ide_build_log_observer (stream, message, message_len, self->log);
 
-  extract_diagnostics (self, (const guint8 *)message, message_len);
+  queue_extract (self, observer->stage, (const guint8 *)message, message_len);
 }
 
 static void
@@ -776,7 +1136,8 @@ ide_pipeline_intercept_pty_master_cb (const IdePtyIntercept     *intercept,
   g_assert (len > 0);
   g_assert (IDE_IS_PIPELINE (self));
 
-  extract_diagnostics (self, data, len);
+  /* This may be called from the intercept thread */
+  queue_extract (self, NULL, data, len);
 }
 
 static void
@@ -1404,11 +1765,17 @@ ide_pipeline_finalize (GObject *object)
   g_clear_pointer (&self->pipeline, g_array_unref);
   g_clear_pointer (&self->srcdir, g_free);
   g_clear_pointer (&self->builddir, g_free);
-  g_clear_pointer (&self->errfmts, g_array_unref);
-  g_clear_pointer (&self->errfmt_top_dir, g_free);
-  g_clear_pointer (&self->errfmt_current_dir, g_free);
+  g_clear_pointer (&self->error_matcher, _ide_error_matcher_free);
+  g_clear_pointer (&self->errfmt_dirs, g_hash_table_unref);
+  g_clear_pointer (&self->errfmt_builddir, g_free);
+  g_clear_pointer (&self->errfmt_srcdir, g_free);
+  g_clear_pointer (&self->pending_diagnostics, g_ptr_array_unref);
+  g_mutex_clear (&self->diagnostics_mutex);
+  g_mutex_clear (&self->extract_mutex);
   g_clear_pointer (&self->chained_bindings, g_ptr_array_unref);
   g_clear_pointer (&self->host_triplet, ide_triplet_unref);
+  g_clear_pointer (&self->schedule, g_hash_table_unref);
+  g_clear_error (&self->build_error);
 
   G_OBJECT_CLASS (ide_pipeline_parent_class)->finalize (object);
 
@@ -1417,6 +1784,16 @@ ide_pipeline_finalize (GObject *object)
   IDE_EXIT;
 }
 
+static gboolean
+ide_pipeline_intercept_quit_cb (gpointer data)
+{
+  GMainLoop *main_loop = data;
+
+  g_main_loop_quit (main_loop);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
 ide_pipeline_destroy (IdeObject *object)
 {
@@ -1436,20 +1813,64 @@ ide_pipeline_destroy (IdeObject *object)
   g_clear_object (&self->pty);
   fd = pty_fd_steal (&self->pty_slave);
 
+  /* Stop the intercept thread before tearing down its sources. The loop
+   * is quit from within the thread, since quitting it before the thread
+   * starts running it would be lost.
+   */
+  if (self->intercept_thread != NULL)
+    {
+      g_main_context_invoke (self->intercept_context,
+                             ide_pipeline_intercept_quit_cb,
+                             self->intercept_loop);
+      g_thread_join (g_steal_pointer (&self->intercept_thread));
+    }
+
   if (IDE_IS_PTY_INTERCEPT (&self->intercept))
     ide_pty_intercept_clear (&self->intercept);
 
+  g_clear_pointer (&self->intercept_loop, g_main_loop_unref);
+  g_clear_pointer (&self->intercept_context, g_main_context_unref);
+
+  /* Drop any queued output and wait for the extraction thread. Queued
+   * flushes still complete from the main loop, but emit nothing.
+   */
+  g_atomic_int_set (&self->extract_disposed, TRUE);
+  if (self->extract_pool != NULL)
+    g_thread_pool_free (g_steal_pointer (&self->extract_pool), FALSE, TRUE);
+
+  /* The pool is gone, so nothing can schedule the idle again */
+  g_mutex_lock (&self->diagnostics_mutex);
+  g_clear_handle_id (&self->diagnostics_source, g_source_remove);
+  g_ptr_array_set_size (self->pending_diagnostics, 0);
+  g_mutex_unlock (&self->diagnostics_mutex);
+
   IDE_OBJECT_CLASS (ide_pipeline_parent_class)->destroy (object);
 
   IDE_EXIT;
 }
 
+static gpointer
+ide_pipeline_intercept_thread (gpointer data)
+{
+  GMainLoop *main_loop = data;
+  GMainContext *main_context = g_main_loop_get_context (main_loop);
+
+  g_main_context_push_thread_default (main_context);
+  g_main_loop_run (main_loop);
+  g_main_context_pop_thread_default (main_context);
+
+  g_main_loop_unref (main_loop);
+
+  return NULL;
+}
+
 static gboolean
 ide_pipeline_initable_init (GInitable     *initable,
                             GCancellable  *cancellable,
                             GError       **error)
 {
   IdePipeline *self = (IdePipeline *)initable;
+  g_autoptr(GSettings) settings = NULL;
   IdePtyFd master_fd;
 
   IDE_ENTRY;
@@ -1482,7 +1903,20 @@ ide_pipeline_initable_init (GInitable     *initable,
 
   master_fd = vte_pty_get_fd (self->pty);
 
-  if (!ide_pty_intercept_init (&self->intercept, master_fd, NULL))
+  settings = g_settings_new ("org.gnome.builder.build");
+  if (g_settings_get_boolean (settings, "intercept-pty-in-thread"))
+    {
+      self->intercept_context = g_main_context_new ();
+      self->intercept_loop = g_main_loop_new (self->intercept_context, FALSE);
+    }
+
+  /* A single thread keeps output in order and serializes access to
+   * the errfmt fields.
+   */
+  if (g_settings_get_boolean (settings, "extract-errors-in-thread"))
+    self->extract_pool = g_thread_pool_new (ide_pipeline_extract_worker, self, 1, FALSE, NULL);
+
+  if (!ide_pty_intercept_init (&self->intercept, master_fd, self->intercept_context))
     {
       g_set_error_literal (error,
                            G_IO_ERROR,
@@ -1496,6 +1930,14 @@ ide_pipeline_initable_init (GInitable     *initable,
                               ide_pipeline_intercept_pty_master_cb,
                               self);
 
+  /* Start the thread only after the callback is set, as it will
+   * begin copying output immediately.
+   */
+  if (self->intercept_loop != NULL)
+    self->intercept_thread = g_thread_new ("ide-pty-intercept",
+                                           ide_pipeline_intercept_thread,
+                                           g_main_loop_ref (self->intercept_loop));
+
   g_signal_connect_object (self->config,
                            "notify::ready",
                            G_CALLBACK (ide_pipeline_notify_ready),
@@ -1810,14 +2252,39 @@ ide_pipeline_init (IdePipeline *self)
   self->pipeline = g_array_new (FALSE, FALSE, sizeof (PipelineEntry));
   g_array_set_clear_func (self->pipeline, clear_pipeline_entry);
 
-  self->errfmts = g_array_new (FALSE, FALSE, sizeof (ErrorFormat));
-  g_array_set_clear_func (self->errfmts, clear_error_format);
+  self->error_matcher = _ide_error_matcher_new ();
+  self->pending_diagnostics = g_ptr_array_new_with_free_func (g_object_unref);
+  g_mutex_init (&self->diagnostics_mutex);
+  g_mutex_init (&self->extract_mutex);
+  self->errfmt_dirs = g_hash_table_new_full (NULL, NULL, NULL, extract_dirs_free);
 
   self->chained_bindings = g_ptr_array_new_with_free_func ((GDestroyNotify)chained_binding_clear);
 
   self->log = ide_build_log_new ();
 }
 
+static void ide_pipeline_schedule_stages (IdePipeline *self,
+                                          IdeTask     *task);
+
+static void
+ide_pipeline_stage_flushed_cb (IdePipeline *self,
+                               gpointer     user_data)
+{
+  IdeTask *task = user_data;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (IDE_IS_TASK (task));
+  g_assert (self->n_running > 0);
+
+  self->n_running--;
+
+  ide_pipeline_schedule_stages (self, task);
+
+  IDE_EXIT;
+}
+
 static void
 ide_pipeline_stage_build_cb (GObject      *object,
                                      GAsyncResult *result,
@@ -1827,6 +2294,8 @@ ide_pipeline_stage_build_cb (GObject      *object,
   IdePipeline *self;
   g_autoptr(IdeTask) task = user_data;
   g_autoptr(GError) error = NULL;
+  gboolean succeeded;
+  StageRun *run;
 
   IDE_ENTRY;
 
@@ -1836,23 +2305,39 @@ ide_pipeline_stage_build_cb (GObject      *object,
 
   self = ide_task_get_source_object (task);
   g_assert (IDE_IS_PIPELINE (self));
+  g_assert (self->n_running > 0);
 
-  if (!_ide_pipeline_stage_build_with_query_finish (stage, result, &error))
+  if ((run = g_hash_table_lookup (self->schedule, stage)))
+    {
+      run->state = STAGE_DONE;
+      run->end_time = g_get_monotonic_time ();
+    }
+
+  if (!(succeeded = _ide_pipeline_stage_build_with_query_finish (stage, result, &error)))
     {
       g_debug ("stage of type %s failed: %s",
                G_OBJECT_TYPE_NAME (stage),
                error->message);
       self->failed = TRUE;
-      ide_task_return_error (task, g_steal_pointer (&error));
+
+      /* Other stages may still be running, so keep the first error */
+      if (self->build_error == NULL)
+        self->build_error = g_steal_pointer (&error);
     }
 
-  ide_pipeline_stage_set_completed (stage, !self->failed);
+  ide_pipeline_stage_set_completed (stage, succeeded);
 
   g_clear_pointer (&self->chained_bindings, g_ptr_array_unref);
   self->chained_bindings = g_ptr_array_new_with_free_func (g_object_unref);
 
-  if (self->failed == FALSE)
-    ide_pipeline_tick_build (self, task);
+  /*
+   * The stage still counts as running until the diagnostics from its
+   * output have been emitted, so the build cannot complete before them.
+   */
+  queue_extract_flush (self,
+                       ide_pipeline_stage_flushed_cb,
+                       g_steal_pointer (&task),
+                       g_object_unref);
 
   IDE_EXIT;
 }
@@ -1870,6 +2355,7 @@ ide_pipeline_try_chain (IdePipeline      *self,
       const PipelineEntry *entry = &g_array_index (self->pipeline, PipelineEntry, position);
       gboolean chained;
       GBinding *chained_binding;
+      StageRun *run;
 
       /*
        * Ignore all future stages if they were not requested by the current
@@ -1882,6 +2368,10 @@ ide_pipeline_try_chain (IdePipeline      *self,
       if (ide_pipeline_stage_get_disabled (entry->stage))
         continue;
 
+      /* Stages that may run concurrently are scheduled on their own */
+      if (_ide_pipeline_stage_get_has_dependencies (entry->stage))
+        return;
+
       chained = ide_pipeline_stage_chain (stage, entry->stage);
 
       IDE_TRACE_MSG ("Checking if %s chains to stage[%d] (%s) = %s",
@@ -1896,7 +2386,13 @@ ide_pipeline_try_chain (IdePipeline      *self,
       chained_binding = g_object_bind_property (stage, "completed", entry->stage, "completed", 0);
       g_ptr_array_add (self->chained_bindings, g_object_ref (chained_binding));
 
-      self->position = position;
+      /*
+       * Nothing runs after @stage until it completes, so the chained stage
+       * may be considered done already.
+       */
+      run = g_new0 (StageRun, 1);
+      run->state = STAGE_DONE;
+      g_hash_table_insert (self->schedule, entry->stage, run);
     }
 }
 
@@ -1941,6 +2437,307 @@ complete_queued_before_phase (IdePipeline      *self,
     }
 }
 
+static void
+ide_pipeline_log_critical_path (IdePipeline *self)
+{
+  g_autoptr(GPtrArray) path = NULL;
+  g_autoptr(GString) str = NULL;
+  IdePipelineStage *last = NULL;
+  gint64 last_end = 0;
+  gint64 total = 0;
+  guint n_ran = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_assert (IDE_IS_PIPELINE (self));
+
+  if (self->schedule == NULL || self->log == NULL || !self->stages_overlapped)
+    return;
+
+  g_hash_table_iter_init (&iter, self->schedule);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      const StageRun *run = value;
+
+      if (run->begin_time == 0 || run->end_time == 0)
+        continue;
+
+      total += run->end_time - run->begin_time;
+      n_ran++;
+
+      if (run->end_time > last_end)
+        {
+          last = key;
+          last_end = run->end_time;
+        }
+    }
+
+  if (last == NULL || n_ran < 2)
+    return;
+
+  path = g_ptr_array_new ();
+
+  for (IdePipelineStage *stage = last; stage != NULL; )
+    {
+      const StageRun *run = g_hash_table_lookup (self->schedule, stage);
+
+      g_ptr_array_insert (path, 0, stage);
+      stage = run->waited_for;
+    }
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str,
+                          _("Critical path: %.1lf seconds of %.1lf seconds of stages"),
+                          (last_end - self->build_begin_time) / (gdouble)G_USEC_PER_SEC,
+                          total / (gdouble)G_USEC_PER_SEC);
+  ide_build_log_observer (IDE_BUILD_LOG_STDOUT, str->str, str->len, self->log);
+
+  for (guint i = 0; i < path->len; i++)
+    {
+      IdePipelineStage *stage = g_ptr_array_index (path, i);
+      const StageRun *run = g_hash_table_lookup (self->schedule, stage);
+      const gchar *name = ide_pipeline_stage_get_name (stage);
+
+      g_string_printf (str, "  %8.1lfs  %s",
+                       (run->end_time - run->begin_time) / (gdouble)G_USEC_PER_SEC,
+                       name ? name : G_OBJECT_TYPE_NAME (stage));
+      ide_build_log_observer (IDE_BUILD_LOG_STDOUT, str->str, str->len, self->log);
+    }
+}
+
+static gboolean
+ide_pipeline_begin_stage (IdePipeline      *self,
+                          IdeTask          *task,
+                          guint             position,
+                          StageRun         *run)
+{
+  const PipelineEntry *entry = &g_array_index (self->pipeline, PipelineEntry, position);
+  GCancellable *cancellable = ide_task_get_cancellable (task);
+  TaskData *td = ide_task_get_task_data (task);
+  GPtrArray *targets = NULL;
+  gint64 waited_end = 0;
+
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (IDE_IS_TASK (task));
+  g_assert (run->state == STAGE_PENDING);
+
+  run->waited_for = NULL;
+
+  /*
+   * The stage can begin once every earlier stage it depends upon is done.
+   * Remember which of them finished last to report the critical path.
+   */
+  for (guint i = 0; i < position; i++)
+    {
+      const PipelineEntry *prev = &g_array_index (self->pipeline, PipelineEntry, i);
+      const StageRun *prev_run = g_hash_table_lookup (self->schedule, prev->stage);
+
+      if (prev_run == NULL || prev_run->state == STAGE_SKIPPED)
+        continue;
+
+      if (!_ide_pipeline_stage_depends_on (entry->stage, prev->stage))
+        continue;
+
+      if (prev_run->state != STAGE_DONE)
+        return FALSE;
+
+      if (prev_run->end_time > waited_end)
+        {
+          run->waited_for = prev->stage;
+          waited_end = prev_run->end_time;
+        }
+    }
+
+  if (td->type == TASK_BUILD)
+    targets = td->build.targets;
+  else if (td->type == TASK_REBUILD)
+    targets = td->rebuild.targets;
+
+  if (self->n_running == 0)
+    {
+      /* Clear any message from the previous stage */
+      _ide_pipeline_set_message (self, NULL);
+
+      /* Clear cached directory enter/leave tracking */
+      queue_extract_reset (self);
+    }
+  else
+    {
+      self->stages_overlapped = TRUE;
+    }
+
+  run->state = STAGE_RUNNING;
+  run->begin_time = g_get_monotonic_time ();
+  self->n_running++;
+
+  /*
+   * We might be able to chain upcoming stages to this stage and avoid
+   * duplicate work. Only stages that run by themselves are chained.
+   */
+  if (!_ide_pipeline_stage_get_has_dependencies (entry->stage))
+    ide_pipeline_try_chain (self, entry->stage, position + 1);
+
+  _ide_pipeline_stage_build_with_query_async (entry->stage,
+                                             self,
+                                             targets,
+                                             cancellable,
+                                             ide_pipeline_stage_build_cb,
+                                             g_object_ref (task));
+
+  return TRUE;
+}
+
+/*
+ * Only launchers attach subprocesses to the PTY, and they say so up front.
+ */
+static gboolean
+stage_uses_pty (IdePipelineStage *stage)
+{
+  g_assert (IDE_IS_PIPELINE_STAGE (stage));
+
+  return IDE_IS_PIPELINE_STAGE_LAUNCHER (stage) &&
+         ide_pipeline_stage_launcher_get_use_pty (IDE_PIPELINE_STAGE_LAUNCHER (stage));
+}
+
+static gboolean
+ide_pipeline_pty_stage_running (IdePipeline *self)
+{
+  GHashTableIter iter;
+  IdePipelineStage *stage;
+  StageRun *run;
+
+  g_assert (IDE_IS_PIPELINE (self));
+
+  g_hash_table_iter_init (&iter, self->schedule);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&stage, (gpointer *)&run))
+    {
+      if (run->state == STAGE_RUNNING && stage_uses_pty (stage))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Starts every stage that can run now, and completes @task when there is
+ * nothing left to run. Stages that have not declared their dependencies
+ * run alone and in order, which was the only behavior before stages
+ * could declare them. Stages that have may run with any others they do
+ * not depend upon, with their ::query checks also running concurrently.
+ * While error formats are registered, only one stage using the PTY runs
+ * at a time.
+ */
+static void
+ide_pipeline_schedule_stages (IdePipeline *self,
+                              IdeTask     *task)
+{
+  GCancellable *cancellable;
+  IdePipelinePhase first_phase = 0;
+  gint first_unfinished = -1;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_PIPELINE (self));
+  g_assert (IDE_IS_TASK (task));
+  g_assert (self->schedule != NULL);
+
+  cancellable = ide_task_get_cancellable (task);
+
+  if (!self->failed && !g_cancellable_is_cancelled (cancellable))
+    {
+      for (guint i = 0; i < self->pipeline->len; i++)
+        {
+          const PipelineEntry *entry = &g_array_index (self->pipeline, PipelineEntry, i);
+          StageRun *run;
+
+          g_assert (entry->stage != NULL);
+          g_assert (IDE_IS_PIPELINE_STAGE (entry->stage));
+
+          if (!(run = g_hash_table_lookup (self->schedule, entry->stage)))
+            {
+              run = g_new0 (StageRun, 1);
+              run->state = STAGE_PENDING;
+              g_hash_table_insert (self->schedule, entry->stage, run);
+            }
+
+          if (run->state != STAGE_PENDING)
+            continue;
+
+          if (ide_pipeline_stage_get_disabled (entry->stage) ||
+              !((entry->phase & IDE_PIPELINE_PHASE_MASK) & self->requested_mask))
+            {
+              run->state = STAGE_SKIPPED;
+              continue;
+            }
+
+          if (self->n_running >= MAX_CONCURRENT_STAGES)
+            break;
+
+          /*
+           * Output on the PTY is extracted with the same directory
+           * tracking whichever stage it came from, so do not mix it.
+           */
+          if (!_ide_error_matcher_is_empty (self->error_matcher) &&
+              stage_uses_pty (entry->stage) &&
+              ide_pipeline_pty_stage_running (self))
+            continue;
+
+          ide_pipeline_begin_stage (self, task, i, run);
+
+          /* Nothing after a stage without dependencies may start before it */
+          if (!_ide_pipeline_stage_get_has_dependencies (entry->stage))
+            break;
+        }
+    }
+
+  /* Find the first stage that is not done, and the stage to report */
+  self->current_stage = NULL;
+
+  for (guint i = 0; i < self->pipeline->len; i++)
+    {
+      const PipelineEntry *entry = &g_array_index (self->pipeline, PipelineEntry, i);
+      const StageRun *run = g_hash_table_lookup (self->schedule, entry->stage);
+
+      if (run == NULL || run->state == STAGE_PENDING || run->state == STAGE_RUNNING)
+        {
+          if (first_unfinished < 0)
+            {
+              first_unfinished = i;
+              first_phase = entry->phase;
+            }
+
+          if (run != NULL && run->state == STAGE_RUNNING && self->current_stage == NULL)
+            self->current_stage = entry->stage;
+        }
+    }
+
+  if (self->n_running > 0)
+    {
+      self->position = first_unfinished;
+
+      /* Complete any tasks that are waiting for this to complete */
+      complete_queued_before_phase (self, first_phase);
+
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_MESSAGE]);
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PHASE]);
+
+      IDE_EXIT;
+    }
+
+  /* Everything has stopped, so the task can complete */
+  self->position = self->pipeline->len;
+
+  ide_pipeline_log_critical_path (self);
+
+  if (self->build_error != NULL)
+    ide_task_return_error (task, g_steal_pointer (&self->build_error));
+  else if (!ide_task_return_error_if_cancelled (task))
+    ide_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
 static void
 ide_pipeline_tick_build (IdePipeline *self,
                          IdeTask     *task)
@@ -1967,9 +2764,11 @@ ide_pipeline_tick_build (IdePipeline *self,
   /* Clear any message from the previous stage */
   _ide_pipeline_set_message (self, NULL);
 
-  /* Clear cached directory enter/leave tracking */
-  g_clear_pointer (&self->errfmt_current_dir, g_free);
-  g_clear_pointer (&self->errfmt_top_dir, g_free);
+  /* Diagnostics still queued from a previous build are dropped, and
+   * directory enter/leave tracking is cleared.
+   */
+  g_atomic_int_inc (&self->build_sequence);
+  queue_extract_reset (self);
 
   /* Short circuit now if the task was cancelled */
   if (ide_task_return_error_if_cancelled (task))
@@ -1983,59 +2782,20 @@ ide_pipeline_tick_build (IdePipeline *self,
     }
 
   /*
-   * Walk forward to the next stage requiring execution and asynchronously
-   * build it. The stage may also need to perform an async ::query signal
-   * delaying pipeline execution. _ide_pipeline_stage_build_with_query_async()
-   * will handle all of that for us, in cause they call ide_pipeline_stage_pause()
-   * during the ::query callback.
+   * Start the stages requiring execution. Each stage may also need to
+   * perform an async ::query signal delaying its execution.
+   * _ide_pipeline_stage_build_with_query_async() will handle all of that
+   * for us, in cause they call ide_pipeline_stage_pause() during the
+   * ::query callback.
    */
-  for (self->position++; (guint)self->position < self->pipeline->len; self->position++)
-    {
-      const PipelineEntry *entry = &g_array_index (self->pipeline, PipelineEntry, self->position);
-
-      g_assert (entry->stage != NULL);
-      g_assert (IDE_IS_PIPELINE_STAGE (entry->stage));
-
-      /* Complete any tasks that are waiting for this to complete */
-      complete_queued_before_phase (self, entry->phase);
-
-      /* Ignore the stage if it is disabled */
-      if (ide_pipeline_stage_get_disabled (entry->stage))
-        continue;
-
-      if ((entry->phase & IDE_PIPELINE_PHASE_MASK) & self->requested_mask)
-        {
-          GPtrArray *targets = NULL;
-
-          self->current_stage = entry->stage;
-
-          if (td->type == TASK_BUILD)
-            targets = td->build.targets;
-          else if (td->type == TASK_REBUILD)
-            targets = td->rebuild.targets;
-
-          /*
-           * We might be able to chain upcoming stages to this stage and avoid
-           * duplicate work. This will also advance self->position based on
-           * how many stages were chained.
-           */
-          ide_pipeline_try_chain (self, entry->stage, self->position + 1);
-
-          _ide_pipeline_stage_build_with_query_async (entry->stage,
-                                                     self,
-                                                     targets,
-                                                     cancellable,
-                                                     ide_pipeline_stage_build_cb,
-                                                     g_object_ref (task));
+  g_clear_pointer (&self->schedule, g_hash_table_unref);
+  g_clear_error (&self->build_error);
+  self->schedule = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  self->n_running = 0;
+  self->stages_overlapped = FALSE;
+  self->build_begin_time = g_get_monotonic_time ();
 
-          g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_MESSAGE]);
-          g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PHASE]);
-
-          IDE_EXIT;
-        }
-    }
-
-  ide_task_return_boolean (task, TRUE);
+  ide_pipeline_schedule_stages (self, task);
 
   IDE_EXIT;
 }
@@ -2057,6 +2817,9 @@ ide_pipeline_task_notify_completed (IdePipeline *self,
   self->requested_mask = 0;
   self->in_clean = FALSE;
 
+  g_clear_pointer (&self->schedule, g_hash_table_unref);
+  g_clear_error (&self->build_error);
+
   g_clear_pointer (&self->message, g_free);
   g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_MESSAGE]);
 
@@ -2507,6 +3270,7 @@ ide_pipeline_attach (IdePipeline      *self,
       if ((phase & IDE_PIPELINE_PHASE_MASK) == value->value)
         {
           PipelineEntry entry = { 0 };
+          StageObserver *observer;
 
           _ide_pipeline_stage_set_phase (stage, phase);
 
@@ -2523,10 +3287,14 @@ ide_pipeline_attach (IdePipeline      *self,
 
           ret = entry.id;
 
+          observer = g_slice_new (StageObserver);
+          observer->self = self;
+          observer->stage = stage;
+
           ide_pipeline_stage_set_log_observer (stage,
-                                            ide_pipeline_log_observer,
-                                            self,
-                                            NULL);
+                                               ide_pipeline_log_observer,
+                                               observer,
+                                               stage_observer_free);
 
           /*
            * We need to emit items-changed for the newly added entry, but we relied
@@ -3138,24 +3906,15 @@ ide_pipeline_add_error_format (IdePipeline        *self,
                                const gchar        *regex,
                                GRegexCompileFlags  flags)
 {
-  ErrorFormat errfmt = { 0 };
   g_autoptr(GError) error = NULL;
+  guint id;
 
   g_return_val_if_fail (IDE_IS_PIPELINE (self), 0);
 
-  errfmt.regex = g_regex_new (regex, G_REGEX_OPTIMIZE | flags, 0, &error);
-
-  if (errfmt.regex == NULL)
-    {
-      g_warning ("%s", error->message);
-      return 0;
-    }
-
-  errfmt.id = ++self->errfmt_seqnum;
-
-  g_array_append_val (self->errfmts, errfmt);
+  if (!(id = _ide_error_matcher_add (self->error_matcher, regex, flags, &error)))
+    g_warning ("%s", error->message);
 
-  return errfmt.id;
+  return id;
 }
 
 /**
@@ -3177,18 +3936,7 @@ ide_pipeline_remove_error_format (IdePipeline *self,
   g_return_val_if_fail (IDE_IS_PIPELINE (self), FALSE);
   g_return_val_if_fail (error_format_id > 0, FALSE);
 
-  for (guint i = 0; i < self->errfmts->len; i++)
-    {
-      const ErrorFormat *errfmt = &g_array_index (self->errfmts, ErrorFormat, i);
-
-      if (errfmt->id == error_format_id)
-        {
-          g_array_remove_index (self->errfmts, i);
-          return TRUE;
-        }
-    }
-
-  return FALSE;
+  return _ide_error_matcher_remove (self->error_matcher, error_format_id);
 }
 
 gboolean
@@ -3986,6 +4734,33 @@ ide_pipeline_get_requested_phase (IdePipeline *self)
   return (IdePipelinePhase)(1 << msb);
 }
 
+typedef struct
+{
+  IdePipeline *self;
+  guint        rows;
+  guint        columns;
+} SetPtySize;
+
+static void
+set_pty_size_free (gpointer data)
+{
+  SetPtySize *state = data;
+
+  g_object_unref (state->self);
+  g_slice_free (SetPtySize, state);
+}
+
+static gboolean
+set_pty_size_cb (gpointer data)
+{
+  SetPtySize *state = data;
+
+  if (IDE_IS_PTY_INTERCEPT (&state->self->intercept))
+    ide_pty_intercept_set_size (&state->self->intercept, state->rows, state->columns);
+
+  return G_SOURCE_REMOVE;
+}
+
 void
 _ide_pipeline_set_pty_size (IdePipeline *self,
                                   guint             rows,
@@ -3993,8 +4768,36 @@ _ide_pipeline_set_pty_size (IdePipeline *self,
 {
   g_return_if_fail (IDE_IS_PIPELINE (self));
 
-  if (self->pty_slave != IDE_PTY_FD_INVALID)
-    ide_pty_intercept_set_size (&self->intercept, rows, columns);
+  if (self->pty_slave == IDE_PTY_FD_INVALID)
+    return;
+
+  /* The intercept channels belong to the intercept thread, if any */
+  if (self->intercept_thread != NULL)
+    {
+      SetPtySize *state;
+
+      state = g_slice_new0 (SetPtySize);
+      state->self = g_object_ref (self);
+      state->rows = rows;
+      state->columns = columns;
+
+      g_main_context_invoke_full (self->intercept_context,
+                                  G_PRIORITY_DEFAULT,
+                                  set_pty_size_cb,
+                                  state,
+                                  set_pty_size_free);
+      return;
+    }
+
+  ide_pty_intercept_set_size (&self->intercept, rows, columns);
+}
+
+IdeBuildLog *
+_ide_pipeline_get_build_log (IdePipeline *self)
+{
+  g_return_val_if_fail (IDE_IS_PIPELINE (self), NULL);
+
+  return self->log;
 }
 
 void
@@ -23,9 +23,13 @@
 #include "config.h"
 
 #include <dazzle.h>
+#include <errno.h>
+#include <glib/gi18n.h>
 #include <libide-io.h>
 #include <libide-threading.h>
 #include <libpeas/peas.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "ide-build-manager.h"
 #include "ide-pipeline.h"
@@ -34,7 +38,10 @@
 #include "ide-test-private.h"
 #include "ide-test-provider.h"
 
-#define MAX_UNIT_TESTS 4
+/* Meson's default, used to estimate tests that have never been run */
+#define DEFAULT_TIMEOUT_SECONDS 30
+#define MEMORY_PER_TEST         (G_GINT64_CONSTANT (256) * 1024 * 1024)
+#define DURATIONS_TYPE          G_VARIANT_TYPE ("a{sx}")
 
 /**
  * SECTION:ide-test-manager
@@ -48,6 +55,13 @@
  * You can access the test manager using ide_context_get_text_manager()
  * using the #IdeContext for the loaded project.
  *
+ * When running all tests, the tests that are expected to take the longest
+ * are started first so that they do not hold up the end of the run. The
+ * expected time comes from the previous run of the test, which is kept in
+ * the cache directory of the project, or the test timeout when the test
+ * has not been run before. The number of tests to run at once defaults to
+ * what the available CPU and memory allow.
+ *
  * Since: 3.32
  */
 
@@ -62,6 +76,22 @@ struct _IdeTestManager
   VtePty           *pty;
   gint              child_pty;
   gint              n_active;
+
+  /*
+   * Durations of previous runs by test key, in microseconds. This is
+   * loaded from the project cache the first time tests are run and
+   * saved again once no tests are running.
+   */
+  GHashTable       *durations;
+
+  /* The time each running test changed to IDE_TEST_STATUS_RUNNING */
+  GHashTable       *started;
+
+  /* The sum of the durations of every test run so far */
+  gint64            run_time;
+
+  guint             durations_loaded : 1;
+  guint             durations_dirty : 1;
 };
 
 typedef struct
@@ -74,6 +104,9 @@ typedef struct
 {
   GQueue queue;
   guint  n_active;
+  guint  n_tests;
+  gint64 begin_time;
+  gint64 begin_run_time;
 } RunAllTaskData;
 
 enum {
@@ -138,6 +171,9 @@ ide_test_manager_destroy (IdeObject *object)
 
   g_clear_object (&self->pty);
 
+  g_clear_pointer (&self->durations, g_hash_table_unref);
+  g_clear_pointer (&self->started, g_hash_table_unref);
+
   IDE_OBJECT_CLASS (ide_test_manager_parent_class)->destroy (object);
 }
 
@@ -195,10 +231,345 @@ ide_test_manager_init (IdeTestManager *self)
   self->cancellable = g_cancellable_new ();
   self->tests_by_provider = g_ptr_array_new_with_free_func (tests_by_provider_free);
   self->tests_store = gtk_tree_store_new (2, G_TYPE_STRING, IDE_TYPE_TEST);
+  self->durations = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  self->started = g_hash_table_new_full (NULL, NULL, NULL, g_free);
 
   ide_test_manager_set_action_enabled (self, "cancel", FALSE);
 }
 
+static gchar *
+get_test_key (IdeTest *test)
+{
+  const gchar *group = ide_test_get_group (test);
+  const gchar *id = ide_test_get_id (test);
+
+  return g_strdup_printf ("%s/%s", group ? group : "", id ? id : "");
+}
+
+static gchar *
+ide_test_manager_get_durations_path (IdeTestManager *self)
+{
+  IdeContext *context = ide_object_get_context (IDE_OBJECT (self));
+
+  if (context == NULL)
+    return NULL;
+
+  return ide_context_cache_filename (context, "tests", "durations.gvariant", NULL);
+}
+
+/*
+ * Durations are stored as a GVariant dictionary of test key to duration
+ * in microseconds. The file is only a cache on this machine, so it is in
+ * host byte order.
+ */
+static void
+ide_test_manager_load_durations (IdeTestManager *self)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *contents = NULL;
+  GVariantIter iter;
+  const gchar *key;
+  gint64 duration;
+  gsize len;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TEST_MANAGER (self));
+
+  if (self->durations_loaded)
+    return;
+
+  self->durations_loaded = TRUE;
+
+  if (!(path = ide_test_manager_get_durations_path (self)))
+    return;
+
+  if (!g_file_get_contents (path, &contents, &len, &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_debug ("Failed to load test durations: %s", error->message);
+      return;
+    }
+
+  bytes = g_bytes_new_take (g_steal_pointer (&contents), len);
+  variant = g_variant_take_ref (g_variant_new_from_bytes (DURATIONS_TYPE, bytes, FALSE));
+
+  g_variant_iter_init (&iter, variant);
+
+  while (g_variant_iter_next (&iter, "{&sx}", &key, &duration))
+    {
+      /* Don't replace durations measured before we loaded */
+      if (duration > 0 && !g_hash_table_contains (self->durations, key))
+        g_hash_table_insert (self->durations,
+                             g_strdup (key),
+                             g_memdup2 (&duration, sizeof duration));
+    }
+}
+
+static void
+ide_test_manager_save_durations (IdeTestManager *self)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *dir = NULL;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const gchar *key;
+  gint64 *duration;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TEST_MANAGER (self));
+
+  if (!self->durations_dirty)
+    return;
+
+  self->durations_dirty = FALSE;
+
+  if (!(path = ide_test_manager_get_durations_path (self)))
+    return;
+
+  /* Merge with what is on disk before replacing it */
+  ide_test_manager_load_durations (self);
+
+  g_variant_builder_init (&builder, DURATIONS_TYPE);
+
+  g_hash_table_iter_init (&iter, self->durations);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&duration))
+    g_variant_builder_add (&builder, "{sx}", key, *duration);
+
+  variant = g_variant_take_ref (g_variant_builder_end (&builder));
+  dir = g_path_get_dirname (path);
+
+  if (g_mkdir_with_parents (dir, 0750) != 0 ||
+      !g_file_set_contents (path,
+                            g_variant_get_data (variant),
+                            g_variant_get_size (variant),
+                            &error))
+    g_debug ("Failed to save test durations: %s",
+             error ? error->message : g_strerror (errno));
+}
+
+/*
+ * Gets the expected run time of @test in microseconds, which is used to
+ * start longer tests first. Tests that have not been run are expected to
+ * take as long as their timeout, so that they are not left for last.
+ */
+static gint64
+ide_test_manager_get_expected_duration (IdeTestManager *self,
+                                        IdeTest        *test)
+{
+  g_autofree gchar *key = NULL;
+  const gint64 *duration;
+  guint timeout;
+
+  g_assert (IDE_IS_TEST_MANAGER (self));
+  g_assert (IDE_IS_TEST (test));
+
+  if (ide_test_get_duration (test) > 0)
+    return ide_test_get_duration (test);
+
+  key = get_test_key (test);
+
+  if ((duration = g_hash_table_lookup (self->durations, key)))
+    return *duration;
+
+  if (!(timeout = ide_test_get_timeout (test)))
+    timeout = DEFAULT_TIMEOUT_SECONDS;
+
+  return (gint64)timeout * G_USEC_PER_SEC;
+}
+
+typedef struct
+{
+  IdeTest *test;
+  gint     priority;
+  gint64   expected;
+} SortItem;
+
+static gint
+compare_sort_item (gconstpointer a,
+                   gconstpointer b)
+{
+  const SortItem *item_a = a;
+  const SortItem *item_b = b;
+
+  if (item_a->priority != item_b->priority)
+    return item_a->priority > item_b->priority ? -1 : 1;
+
+  if (item_a->expected != item_b->expected)
+    return item_a->expected > item_b->expected ? -1 : 1;
+
+  return 0;
+}
+
+/*
+ * Sorts @tests so that higher priorities come first, followed by the
+ * tests expected to take the longest. Looking up an expected duration
+ * needs the test key, so they are all computed once before sorting.
+ */
+void
+_ide_test_manager_sort_tests (IdeTestManager *self,
+                              GPtrArray      *tests)
+{
+  g_autoptr(GArray) items = NULL;
+
+  g_return_if_fail (IDE_IS_TEST_MANAGER (self));
+  g_return_if_fail (tests != NULL);
+
+  ide_test_manager_load_durations (self);
+
+  items = g_array_sized_new (FALSE, FALSE, sizeof (SortItem), tests->len);
+
+  for (guint i = 0; i < tests->len; i++)
+    {
+      SortItem item;
+
+      item.test = g_ptr_array_index (tests, i);
+      item.priority = ide_test_get_priority (item.test);
+      item.expected = ide_test_manager_get_expected_duration (self, item.test);
+
+      g_array_append_val (items, item);
+    }
+
+  g_array_sort (items, compare_sort_item);
+
+  for (guint i = 0; i < items->len; i++)
+    g_ptr_array_index (tests, i) = g_array_index (items, SortItem, i).test;
+}
+
+/*
+ * Gets how much memory new processes may use in bytes, or -1 if unknown.
+ * MemAvailable counts the page cache that can be reclaimed, unlike the
+ * free pages, and the limit of our cgroup (such as a container or a
+ * systemd slice) may be lower than that.
+ */
+static gint64
+get_available_memory (void)
+{
+  g_autofree gchar *meminfo = NULL;
+  g_autofree gchar *cgroup = NULL;
+  gint64 available = -1;
+
+  if (g_file_get_contents ("/proc/meminfo", &meminfo, NULL, NULL))
+    {
+      const gchar *line = strstr (meminfo, "MemAvailable:");
+
+      if (line != NULL)
+        {
+          gint64 kb = g_ascii_strtoll (line + strlen ("MemAvailable:"), NULL, 10);
+
+          if (kb > 0)
+            available = kb * 1024;
+        }
+    }
+
+  /* With cgroup v2, our group is the line starting with "0::" */
+  if (g_file_get_contents ("/proc/self/cgroup", &cgroup, NULL, NULL))
+    {
+      const gchar *line = g_str_has_prefix (cgroup, "0::") ? cgroup : strstr (cgroup, "\n0::");
+
+      if (line != NULL)
+        {
+          g_autofree gchar *group = NULL;
+          g_autofree gchar *max_path = NULL;
+          g_autofree gchar *current_path = NULL;
+          g_autofree gchar *max = NULL;
+          g_autofree gchar *current = NULL;
+
+          line = strstr (line, "0::") + strlen ("0::");
+          group = g_strndup (line, strcspn (line, "\n"));
+          max_path = g_build_filename ("/sys/fs/cgroup", group, "memory.max", NULL);
+          current_path = g_build_filename ("/sys/fs/cgroup", group, "memory.current", NULL);
+
+          /* memory.max is "max" when there is no limit */
+          if (g_file_get_contents (max_path, &max, NULL, NULL) &&
+              g_ascii_isdigit (*max) &&
+              g_file_get_contents (current_path, &current, NULL, NULL))
+            {
+              gint64 limit = g_ascii_strtoll (max, NULL, 10) - g_ascii_strtoll (current, NULL, 10);
+
+              limit = MAX (0, limit);
+
+              if (available < 0 || limit < available)
+                available = limit;
+            }
+        }
+    }
+
+  return available;
+}
+
+guint
+_ide_test_manager_get_max_active (IdeTestManager *self)
+{
+  g_autoptr(GSettings) settings = NULL;
+  guint n_cpu = g_get_num_processors ();
+  gint64 available;
+  gint parallel;
+
+  g_return_val_if_fail (IDE_IS_TEST_MANAGER (self), 1);
+
+  settings = g_settings_new ("org.gnome.builder.build");
+  parallel = g_settings_get_int (settings, "test-parallel");
+
+  if (parallel > 0)
+    return parallel;
+
+  if (parallel == 0)
+    return n_cpu;
+
+  /* Don't start more tests than fit in the memory that is available */
+  if ((available = get_available_memory ()) >= 0)
+    {
+      gint64 n_memory = available / MEMORY_PER_TEST;
+
+      if (n_memory < n_cpu)
+        return MAX (1, n_memory);
+    }
+
+  return MAX (1, n_cpu);
+}
+
+static void
+ide_test_manager_update_duration (IdeTestManager *self,
+                                  IdeTest        *test)
+{
+  IdeTestStatus status;
+  gint64 *started;
+
+  g_assert (IDE_IS_TEST_MANAGER (self));
+  g_assert (IDE_IS_TEST (test));
+
+  status = ide_test_get_status (test);
+
+  if (status == IDE_TEST_STATUS_RUNNING)
+    {
+      gint64 now = g_get_monotonic_time ();
+
+      g_hash_table_insert (self->started, test, g_memdup2 (&now, sizeof now));
+    }
+  else if ((started = g_hash_table_lookup (self->started, test)))
+    {
+      gint64 duration = MAX (1, g_get_monotonic_time () - *started);
+
+      g_hash_table_remove (self->started, test);
+
+      if (status == IDE_TEST_STATUS_SUCCESS || status == IDE_TEST_STATUS_FAILED)
+        {
+          g_hash_table_insert (self->durations,
+                               get_test_key (test),
+                               g_memdup2 (&duration, sizeof duration));
+          self->durations_dirty = TRUE;
+          self->run_time += duration;
+
+          ide_test_set_duration (test, duration);
+        }
+    }
+}
+
 static void
 ide_test_manager_locate_group (IdeTestManager *self,
                                GtkTreeIter    *iter,
@@ -243,6 +614,8 @@ ide_test_manager_test_notify_status (IdeTestManager *self,
   g_assert (IDE_IS_TEST_MANAGER (self));
   g_assert (IDE_IS_TEST (test));
 
+  ide_test_manager_update_duration (self, test);
+
   group = ide_test_get_group (test);
 
   ide_test_manager_locate_group (self, &parent, group);
@@ -349,6 +722,7 @@ ide_test_manager_remove_test (IdeTestManager        *self,
       while (gtk_tree_model_iter_next (GTK_TREE_MODEL (self->tests_store), &iter));
     }
 
+  g_hash_table_remove (self->started, test);
   g_ptr_array_remove (info->tests, test);
 
   IDE_EXIT;
@@ -567,7 +941,19 @@ ide_test_manager_run_all_cb (GObject      *object,
   task_data->n_active--;
 
   if (task_data->n_active == 0)
-    g_task_return_boolean (task, TRUE);
+    {
+      gint64 wall_time = g_get_monotonic_time () - task_data->begin_time;
+      gint64 run_time = self->run_time - task_data->begin_run_time;
+
+      ide_object_message (self,
+                          _("Ran %u unit tests in %.1lf seconds, %.1lf seconds of test time (%.1lf× parallelism)"),
+                          task_data->n_tests,
+                          wall_time / (gdouble)G_USEC_PER_SEC,
+                          run_time / (gdouble)G_USEC_PER_SEC,
+                          wall_time > 0 ? run_time / (gdouble)wall_time : 0.0);
+
+      g_task_return_boolean (task, TRUE);
+    }
 
   IDE_EXIT;
 }
@@ -579,7 +965,12 @@ ide_test_manager_run_all_cb (GObject      *object,
  * @callback: a callback to execute upon completion
  * @user_data: user data for @callback
  *
- * Executes all tests in an undefined order.
+ * Executes all tests.
+ *
+ * Tests with a higher #IdeTest:priority are started first, followed by the
+ * tests that are expected to take the longest. Multiple tests are run at
+ * once, based on the available CPU and memory unless the
+ * "test-parallel" setting overrides it.
  *
  * Upon completion, @callback will be executed which must call
  * ide_test_manager_run_all_finish() to get the result.
@@ -596,7 +987,9 @@ ide_test_manager_run_all_async (IdeTestManager      *self,
                                 gpointer             user_data)
 {
   g_autoptr(GTask) task = NULL;
+  g_autoptr(GPtrArray) tests = NULL;
   RunAllTaskData *task_data;
+  guint max_active;
 
   IDE_ENTRY;
 
@@ -608,21 +1001,31 @@ ide_test_manager_run_all_async (IdeTestManager      *self,
   g_task_set_source_tag (task, ide_test_manager_run_all_async);
 
   task_data = g_new0 (RunAllTaskData, 1);
+  task_data->begin_time = g_get_monotonic_time ();
+  task_data->begin_run_time = self->run_time;
   g_task_set_task_data (task, task_data, g_free);
 
+  tests = g_ptr_array_new ();
+
   for (guint i = 0; i < self->tests_by_provider->len; i++)
     {
       TestsByProvider *info = g_ptr_array_index (self->tests_by_provider, i);
 
       for (guint j = 0; j < info->tests->len; j++)
-        {
-          IdeTest *test = g_ptr_array_index (info->tests, j);
-
-          g_queue_push_tail (&task_data->queue, g_object_ref (test));
-        }
+        g_ptr_array_add (tests, g_ptr_array_index (info->tests, j));
     }
 
-  task_data->n_active = MIN (MAX_UNIT_TESTS, task_data->queue.length);
+  _ide_test_manager_sort_tests (self, tests);
+
+  for (guint i = 0; i < tests->len; i++)
+    g_queue_push_tail (&task_data->queue, g_object_ref (g_ptr_array_index (tests, i)));
+
+  max_active = _ide_test_manager_get_max_active (self);
+
+  task_data->n_tests = task_data->queue.length;
+  task_data->n_active = MIN (max_active, task_data->queue.length);
+
+  IDE_TRACE_MSG ("Running %u tests, %u at a time", task_data->n_tests, task_data->n_active);
 
   if (task_data->n_active == 0)
     {
@@ -630,7 +1033,7 @@ ide_test_manager_run_all_async (IdeTestManager      *self,
       IDE_EXIT;
     }
 
-  for (guint i = 0; i < MAX_UNIT_TESTS; i++)
+  for (guint i = 0; i < max_active; i++)
     {
       g_autoptr(IdeTest) test = g_queue_pop_head (&task_data->queue);
 
@@ -692,6 +1095,9 @@ run_task_completed_cb (IdeTestManager *self,
   self->n_active--;
 
   ide_test_manager_set_action_enabled (self, "cancel", self->n_active > 0);
+
+  if (self->n_active == 0)
+    ide_test_manager_save_durations (self);
 }
 
 static void
@@ -34,10 +34,13 @@ typedef enum
   IDE_TEST_COLUMN_TEST,
 } IdeTestColumn;
 
-GtkTreeModel    *_ide_test_manager_get_model (IdeTestManager  *self);
-void             _ide_test_set_provider      (IdeTest         *self,
-                                                               IdeTestProvider *provider);
-IdeTestProvider *_ide_test_get_provider      (IdeTest         *self);
+GtkTreeModel    *_ide_test_manager_get_model      (IdeTestManager  *self);
+void             _ide_test_manager_sort_tests     (IdeTestManager  *self,
+                                                   GPtrArray       *tests);
+guint            _ide_test_manager_get_max_active (IdeTestManager  *self);
+void             _ide_test_set_provider           (IdeTest         *self,
+                                                   IdeTestProvider *provider);
+IdeTestProvider *_ide_test_get_provider           (IdeTest         *self);
 
 
 G_END_DECLS
@@ -38,6 +38,10 @@ typedef struct
   gchar *group;
   gchar *id;
 
+  gint64 duration;
+  gint priority;
+  guint timeout;
+
   IdeTestStatus status;
 } IdeTestPrivate;
 
@@ -46,9 +50,12 @@ G_DEFINE_TYPE_WITH_PRIVATE (IdeTest, ide_test, G_TYPE_OBJECT)
 enum {
   PROP_0,
   PROP_DISPLAY_NAME,
+  PROP_DURATION,
   PROP_GROUP,
   PROP_ID,
+  PROP_PRIORITY,
   PROP_STATUS,
+  PROP_TIMEOUT,
   N_PROPS
 };
 
@@ -101,6 +108,18 @@ ide_test_get_property (GObject    *object,
       g_value_set_enum (value, ide_test_get_status (self));
       break;
 
+    case PROP_DURATION:
+      g_value_set_int64 (value, ide_test_get_duration (self));
+      break;
+
+    case PROP_PRIORITY:
+      g_value_set_int (value, ide_test_get_priority (self));
+      break;
+
+    case PROP_TIMEOUT:
+      g_value_set_uint (value, ide_test_get_timeout (self));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -132,6 +151,18 @@ ide_test_set_property (GObject      *object,
       ide_test_set_status (self, g_value_get_enum (value));
       break;
 
+    case PROP_DURATION:
+      ide_test_set_duration (self, g_value_get_int64 (value));
+      break;
+
+    case PROP_PRIORITY:
+      ide_test_set_priority (self, g_value_get_int (value));
+      break;
+
+    case PROP_TIMEOUT:
+      ide_test_set_timeout (self, g_value_get_uint (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -206,6 +237,57 @@ ide_test_class_init (IdeTestClass *klass)
                        IDE_TEST_STATUS_NONE,
                        (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * IdeTest:duration:
+   *
+   * The "duration" property contains the time the test took to run, in
+   * microseconds, or 0 if it has not been run.
+   *
+   * Since: 3.40
+   */
+  properties [PROP_DURATION] =
+    g_param_spec_int64 ("duration",
+                        "Duration",
+                        "The duration of the last run in microseconds",
+                        0,
+                        G_MAXINT64,
+                        0,
+                        (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * IdeTest:priority:
+   *
+   * The "priority" property is used to start tests with a higher priority
+   * before other tests when running many tests.
+   *
+   * Since: 3.40
+   */
+  properties [PROP_PRIORITY] =
+    g_param_spec_int ("priority",
+                      "Priority",
+                      "The priority of the test, higher runs first",
+                      G_MININT,
+                      G_MAXINT,
+                      0,
+                      (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * IdeTest:timeout:
+   *
+   * The "timeout" property contains the number of seconds the test may
+   * run, or 0 if there is no timeout.
+   *
+   * Since: 3.40
+   */
+  properties [PROP_TIMEOUT] =
+    g_param_spec_uint ("timeout",
+                       "Timeout",
+                       "The timeout in seconds, or 0 for none",
+                       0,
+                       G_MAXUINT,
+                       0,
+                       (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 }
 
@@ -402,6 +484,141 @@ ide_test_set_status (IdeTest       *self,
     }
 }
 
+/**
+ * ide_test_get_duration:
+ * @self: a #IdeTest
+ *
+ * Gets the #IdeTest:duration property.
+ *
+ * Returns: the duration of the last run in microseconds, or 0
+ *
+ * Since: 3.40
+ */
+gint64
+ide_test_get_duration (IdeTest *self)
+{
+  IdeTestPrivate *priv = ide_test_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_TEST (self), 0);
+
+  return priv->duration;
+}
+
+/**
+ * ide_test_set_duration:
+ * @self: a #IdeTest
+ * @duration: the duration in microseconds
+ *
+ * Sets the #IdeTest:duration property.
+ *
+ * This is updated by #IdeTestManager after running the test.
+ *
+ * Since: 3.40
+ */
+void
+ide_test_set_duration (IdeTest *self,
+                       gint64   duration)
+{
+  IdeTestPrivate *priv = ide_test_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_TEST (self));
+  g_return_if_fail (duration >= 0);
+
+  if (priv->duration != duration)
+    {
+      priv->duration = duration;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_DURATION]);
+    }
+}
+
+/**
+ * ide_test_get_priority:
+ * @self: a #IdeTest
+ *
+ * Gets the #IdeTest:priority property.
+ *
+ * Returns: the priority of the test
+ *
+ * Since: 3.40
+ */
+gint
+ide_test_get_priority (IdeTest *self)
+{
+  IdeTestPrivate *priv = ide_test_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_TEST (self), 0);
+
+  return priv->priority;
+}
+
+/**
+ * ide_test_set_priority:
+ * @self: a #IdeTest
+ * @priority: the priority, higher values run first
+ *
+ * Sets the #IdeTest:priority property.
+ *
+ * Since: 3.40
+ */
+void
+ide_test_set_priority (IdeTest *self,
+                       gint     priority)
+{
+  IdeTestPrivate *priv = ide_test_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_TEST (self));
+
+  if (priv->priority != priority)
+    {
+      priv->priority = priority;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_PRIORITY]);
+    }
+}
+
+/**
+ * ide_test_get_timeout:
+ * @self: a #IdeTest
+ *
+ * Gets the #IdeTest:timeout property.
+ *
+ * Returns: the timeout in seconds, or 0 for none
+ *
+ * Since: 3.40
+ */
+guint
+ide_test_get_timeout (IdeTest *self)
+{
+  IdeTestPrivate *priv = ide_test_get_instance_private (self);
+
+  g_return_val_if_fail (IDE_IS_TEST (self), 0);
+
+  return priv->timeout;
+}
+
+/**
+ * ide_test_set_timeout:
+ * @self: a #IdeTest
+ * @timeout: the timeout in seconds, or 0 for none
+ *
+ * Sets the #IdeTest:timeout property.
+ *
+ * Since: 3.40
+ */
+void
+ide_test_set_timeout (IdeTest *self,
+                      guint    timeout)
+{
+  IdeTestPrivate *priv = ide_test_get_instance_private (self);
+
+  g_return_if_fail (IDE_IS_TEST (self));
+
+  if (priv->timeout != timeout)
+    {
+      priv->timeout = timeout;
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_TIMEOUT]);
+    }
+}
+
 const gchar *
 ide_test_get_icon_name (IdeTest *self)
 {
@@ -73,5 +73,20 @@ IdeTestStatus  ide_test_get_status       (IdeTest       *self);
 IDE_AVAILABLE_IN_3_32
 void           ide_test_set_status       (IdeTest       *self,
                                           IdeTestStatus  status);
+IDE_AVAILABLE_IN_3_40
+gint64         ide_test_get_duration     (IdeTest       *self);
+IDE_AVAILABLE_IN_3_40
+void           ide_test_set_duration     (IdeTest       *self,
+                                          gint64         duration);
+IDE_AVAILABLE_IN_3_40
+gint           ide_test_get_priority     (IdeTest       *self);
+IDE_AVAILABLE_IN_3_40
+void           ide_test_set_priority     (IdeTest       *self,
+                                          gint           priority);
+IDE_AVAILABLE_IN_3_40
+guint          ide_test_get_timeout      (IdeTest       *self);
+IDE_AVAILABLE_IN_3_40
+void           ide_test_set_timeout      (IdeTest       *self,
+                                          guint          timeout);
 
 G_END_DECLS
@@ -406,7 +406,17 @@ ide_preferences_builtin_register_build (DzlPreferences *preferences)
   g_signal_connect (widget, "input", G_CALLBACK (workers_input), NULL);
   g_signal_connect (widget, "output", G_CALLBACK (workers_output), NULL);
 
+  id = dzl_preferences_add_spin_button (preferences, "build", "basic", "org.gnome.builder.build", "test-parallel", "/org/gnome/builder/build/", _("Unit Test Workers"), _("Number of unit tests to run at once"), NULL, 5);
+
+  bin = dzl_preferences_get_widget (preferences, id);
+  widget = dzl_preferences_spin_button_get_spin_button (DZL_PREFERENCES_SPIN_BUTTON (bin));
+  gtk_entry_set_width_chars (GTK_ENTRY (widget), 20);
+  g_signal_connect (widget, "input", G_CALLBACK (workers_input), NULL);
+  g_signal_connect (widget, "output", G_CALLBACK (workers_output), NULL);
+
   dzl_preferences_add_switch (preferences, "build", "basic", "org.gnome.builder", "clear-cache-at-startup", NULL, NULL, _("Clear build cache at startup"), _("Expired caches will be purged when Builder is started"), NULL, 10);
+  dzl_preferences_add_switch (preferences, "build", "basic", "org.gnome.builder.build", "intercept-pty-in-thread", NULL, NULL, _("Process build output in a thread"), _("Copy build output to the terminal from a separate thread to keep the editor responsive"), NULL, 20);
+  dzl_preferences_add_switch (preferences, "build", "basic", "org.gnome.builder.build", "extract-errors-in-thread", NULL, NULL, _("Extract diagnostics in a thread"), _("Match build output against error formats from a separate thread to keep the editor responsive"), NULL, 30);
 
   dzl_preferences_add_list_group (preferences, "build", "network", _("Network"), GTK_SELECTION_NONE, 100);
   dzl_preferences_add_switch (preferences, "build", "network", "org.gnome.builder.build", "allow-network-when-metered", NULL, NULL, _("Allow downloads over metered connections"), _("Allow the use of metered network connections when automatically downloading dependencies"), NULL, 10);
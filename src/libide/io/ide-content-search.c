@@ -0,0 +1,1470 @@
+/* ide-content-search.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ide-content-search"
+
+#include "config.h"
+
+#include <libide-threading.h>
+#include <string.h>
+
+#include "ide-content-search.h"
+#include "ide-gfile.h"
+#include "ide-regex-private.h"
+
+/**
+ * SECTION:ide-content-search
+ * @title: IdeContentSearch
+ * @short_description: search the contents of files in a directory
+ *
+ * #IdeContentSearch searches the contents of files within a directory
+ * without spawning an external grep process.
+ *
+ * The directory is walked on an I/O worker, and then files are memory
+ * mapped and searched in parallel across the %IDE_THREAD_POOL_IO workers.
+ * When possible, a literal which must be present in every match is
+ * extracted from the query so that files may be scanned with memchr() and
+ * memmem(), which are vectorized by the C library. Only the lines which
+ * contain that literal are given to #GRegex.
+ *
+ * Matches are delivered to the main thread in batches, which is signaled
+ * with #IdeContentSearch::matches-added, so that results may be displayed
+ * before the search has completed.
+ *
+ * Since: 3.40
+ */
+
+/* How often to deliver matches found by workers to the main thread */
+#define FLUSH_INTERVAL_MSEC 50
+
+/* Files with a \0 within this many bytes are considered binary */
+#define BINARY_CHECK_LEN 8192
+
+/* Give up on the literal prefilter when there are too many alternatives */
+#define MAX_LITERALS 16
+
+/* Workers run until every file is searched, so a search only gets a
+ * fraction of the IO pool and file loading, VCS and indexers keep the rest.
+ */
+#define WORKER_POOL_DIVISOR 4
+
+struct _IdeContentSearch
+{
+  GObject                     parent_instance;
+
+  GFile                      *directory;
+  gchar                      *query;
+
+  IdeContentSearchIgnoreFunc  ignore_func;
+  gpointer                    ignore_func_data;
+  GDestroyNotify              ignore_func_data_destroy;
+
+  /* All of the matches delivered so far, in delivery order */
+  GPtrArray                  *matches;
+
+  guint                       max_results;
+  guint                       max_line_length;
+  guint                       context_after;
+
+  guint                       has_run : 1;
+  guint                       use_regex : 1;
+  guint                       case_sensitive : 1;
+  guint                       at_word_boundaries : 1;
+  guint                       recursive : 1;
+  guint                       truncated : 1;
+};
+
+typedef struct
+{
+  gchar *text;
+  gsize  len;
+} Literal;
+
+typedef struct
+{
+  /* Immutable once the search has started */
+  gchar                      *root_path;
+  GFile                      *root;
+  GFile                      *directory;
+  GRegex                     *regex;
+  GArray                     *literals;
+  IdeContentSearchIgnoreFunc  ignore_func;
+  gpointer                    ignore_func_data;
+  guint                       max_results;
+  guint                       max_line_length;
+  guint                       context_after;
+  guint                       caseless : 1;
+  guint                       recursive : 1;
+
+  /* Owned by the walker until it completes, then immutable */
+  GPtrArray                  *files;
+
+  /* Shared between workers */
+  gint                        next_file;
+  gint                        n_matches;
+  gint                        truncated;
+
+  /* Matches that have not yet been delivered to the main thread */
+  GMutex                      mutex;
+  GPtrArray                  *pending;
+
+  /* Only accessed from the main thread */
+  guint                       n_active;
+  guint                       flush_source;
+  gint64                      begin_time;
+  gint64                      first_match_time;
+} Search;
+
+enum {
+  PROP_0,
+  PROP_AT_WORD_BOUNDARIES,
+  PROP_CASE_SENSITIVE,
+  PROP_CONTEXT_AFTER,
+  PROP_DIRECTORY,
+  PROP_MAX_LINE_LENGTH,
+  PROP_MAX_RESULTS,
+  PROP_QUERY,
+  PROP_RECURSIVE,
+  PROP_USE_REGEX,
+  N_PROPS
+};
+
+enum {
+  MATCHES_ADDED,
+  N_SIGNALS
+};
+
+G_DEFINE_TYPE (IdeContentSearch, ide_content_search, G_TYPE_OBJECT)
+G_DEFINE_BOXED_TYPE (IdeContentSearchMatch,
+                     ide_content_search_match,
+                     ide_content_search_match_copy,
+                     ide_content_search_match_free)
+
+static GParamSpec *properties [N_PROPS];
+static guint signals [N_SIGNALS];
+
+static void
+literal_clear (gpointer data)
+{
+  Literal *lit = data;
+
+  g_clear_pointer (&lit->text, g_free);
+}
+
+static void
+search_finalize (gpointer data)
+{
+  Search *search = data;
+
+  g_clear_pointer (&search->root_path, g_free);
+  g_clear_object (&search->root);
+  g_clear_object (&search->directory);
+  g_clear_pointer (&search->regex, g_regex_unref);
+  g_clear_pointer (&search->literals, g_array_unref);
+  g_clear_pointer (&search->files, g_ptr_array_unref);
+  g_clear_pointer (&search->pending, g_ptr_array_unref);
+  g_mutex_clear (&search->mutex);
+
+  g_assert (search->flush_source == 0);
+}
+
+static Search *
+search_ref (Search *search)
+{
+  return g_atomic_rc_box_acquire (search);
+}
+
+static void
+search_unref (Search *search)
+{
+  g_atomic_rc_box_release_full (search, search_finalize);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (Search, search_unref)
+
+/**
+ * ide_content_search_match_copy:
+ * @match: an #IdeContentSearchMatch
+ *
+ * Returns: (transfer full): a copy of @match
+ *
+ * Since: 3.40
+ */
+IdeContentSearchMatch *
+ide_content_search_match_copy (const IdeContentSearchMatch *match)
+{
+  IdeContentSearchMatch *copy;
+
+  if (match == NULL)
+    return NULL;
+
+  copy = g_slice_new0 (IdeContentSearchMatch);
+  copy->path = g_strdup (match->path);
+  copy->line = match->line;
+  copy->text = g_strdup (match->text);
+  copy->context_after = g_strdupv (match->context_after);
+
+  if (match->ranges != NULL)
+    {
+      copy->ranges = g_array_sized_new (FALSE, FALSE, sizeof (IdeContentSearchRange), match->ranges->len);
+      g_array_append_vals (copy->ranges, match->ranges->data, match->ranges->len);
+    }
+
+  return copy;
+}
+
+/**
+ * ide_content_search_match_free:
+ * @match: an #IdeContentSearchMatch
+ *
+ * Frees @match.
+ *
+ * Since: 3.40
+ */
+void
+ide_content_search_match_free (IdeContentSearchMatch *match)
+{
+  if (match != NULL)
+    {
+      g_clear_pointer (&match->path, g_free);
+      g_clear_pointer (&match->text, g_free);
+      g_clear_pointer (&match->ranges, g_array_unref);
+      g_clear_pointer (&match->context_after, g_strfreev);
+      g_slice_free (IdeContentSearchMatch, match);
+    }
+}
+
+/* Query parsing {{{1 */
+
+/*
+ * Returns an array of literals where every match of the query contains
+ * at least one of them, or %NULL if no such set could be determined.
+ */
+static GArray *
+extract_literals (const gchar *query,
+                  gboolean     use_regex,
+                  gboolean     caseless)
+{
+  g_autoptr(GArray) literals = NULL;
+  g_auto(GStrv) strv = NULL;
+
+  if (use_regex)
+    {
+      if (!(strv = _ide_regex_extract_literals (query, caseless)))
+        return NULL;
+    }
+  else
+    {
+      if (!_ide_regex_literal_is_usable (query, -1, caseless))
+        return NULL;
+
+      strv = g_new0 (gchar *, 2);
+      strv[0] = g_strdup (query);
+    }
+
+  if (g_strv_length (strv) > MAX_LITERALS)
+    return NULL;
+
+  literals = g_array_new (FALSE, FALSE, sizeof (Literal));
+  g_array_set_clear_func (literals, literal_clear);
+
+  for (guint i = 0; strv[i]; i++)
+    {
+      Literal lit;
+
+      lit.text = g_steal_pointer (&strv[i]);
+      lit.len = strlen (lit.text);
+      g_array_append_val (literals, lit);
+    }
+
+  return g_steal_pointer (&literals);
+}
+
+static GRegex *
+build_regex (IdeContentSearch  *self,
+             GError           **error)
+{
+  GRegexCompileFlags compile_flags = G_REGEX_OPTIMIZE;
+  g_autofree gchar *escaped = NULL;
+  g_autofree gchar *bounded = NULL;
+  const gchar *query;
+
+  g_assert (IDE_IS_CONTENT_SEARCH (self));
+  g_assert (self->query != NULL);
+
+  if (self->use_regex)
+    query = self->query;
+  else
+    query = escaped = g_regex_escape_string (self->query, -1);
+
+  if (self->at_word_boundaries)
+    query = bounded = g_strdup_printf ("\\b(?:%s)\\b", query);
+
+  if (!self->case_sensitive)
+    compile_flags |= G_REGEX_CASELESS;
+
+  return g_regex_new (query, compile_flags, 0, error);
+}
+
+/* Walking {{{1 */
+
+static gboolean
+search_is_ignored (Search *search,
+                   GFile  *file)
+{
+  if (search->ignore_func == NULL)
+    return FALSE;
+
+  return search->ignore_func (file, search->ignore_func_data);
+}
+
+/*
+ * Collects the regular files of @directory, which is @relative to the
+ * search root, and recurses into its subdirectories. Ignored directories
+ * are never enumerated, so large trees such as build directories do not
+ * slow down the search.
+ */
+static void
+ide_content_search_walk (Search       *search,
+                         GFile        *directory,
+                         const gchar  *relative,
+                         gboolean      recursive,
+                         GCancellable *cancellable,
+                         GError      **error)
+{
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+  g_autoptr(GPtrArray) directories = NULL;
+  g_autoptr(GPtrArray) names = NULL;
+  gpointer infoptr;
+
+  g_assert (search != NULL);
+  g_assert (G_IS_FILE (directory));
+
+  if (g_cancellable_is_cancelled (cancellable))
+    return;
+
+  enumerator = g_file_enumerate_children (directory,
+                                          G_FILE_ATTRIBUTE_STANDARD_NAME","
+                                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          cancellable,
+                                          error);
+
+  if (enumerator == NULL)
+    return;
+
+  directories = g_ptr_array_new_with_free_func (g_object_unref);
+  names = g_ptr_array_new_with_free_func (g_free);
+
+  while ((infoptr = g_file_enumerator_next_file (enumerator, cancellable, NULL)))
+    {
+      g_autoptr(GFileInfo) info = infoptr;
+      g_autoptr(GFile) child = g_file_enumerator_get_child (enumerator, info);
+      const gchar *name = g_file_info_get_name (info);
+
+      if (ide_g_file_is_ignored (child))
+        continue;
+
+      /* Like grep -r, symlinks are not followed. Files are checked against
+       * the ignore func by the search workers so that it runs in parallel.
+       */
+      switch (g_file_info_get_file_type (info))
+        {
+        case G_FILE_TYPE_REGULAR:
+          if (relative != NULL)
+            g_ptr_array_add (search->files, g_build_filename (relative, name, NULL));
+          else
+            g_ptr_array_add (search->files, g_strdup (name));
+          break;
+
+        case G_FILE_TYPE_DIRECTORY:
+          if (recursive && !search_is_ignored (search, child))
+            {
+              g_ptr_array_add (directories, g_steal_pointer (&child));
+              g_ptr_array_add (names, g_strdup (name));
+            }
+          break;
+
+        default:
+          break;
+        }
+    }
+
+  g_clear_object (&enumerator);
+
+  for (guint i = 0; i < directories->len; i++)
+    {
+      const gchar *name = g_ptr_array_index (names, i);
+      g_autofree gchar *child_relative = NULL;
+
+      if (relative != NULL)
+        child_relative = g_build_filename (relative, name, NULL);
+      else
+        child_relative = g_strdup (name);
+
+      ide_content_search_walk (search,
+                               g_ptr_array_index (directories, i),
+                               child_relative,
+                               TRUE,
+                               cancellable,
+                               NULL);
+    }
+}
+
+static void
+ide_content_search_walk_worker (IdeTask      *task,
+                                gpointer      source_object,
+                                gpointer      task_data,
+                                GCancellable *cancellable)
+{
+  Search *search = task_data;
+  g_autoptr(GError) error = NULL;
+  GFileType file_type;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_TASK (task));
+  g_assert (IDE_IS_CONTENT_SEARCH (source_object));
+  g_assert (search != NULL);
+
+  file_type = g_file_query_file_type (search->directory, 0, cancellable);
+
+  if (file_type != G_FILE_TYPE_DIRECTORY)
+    {
+      /* Searching a single file */
+      g_ptr_array_add (search->files, g_file_get_basename (search->directory));
+    }
+  else
+    {
+      g_autofree gchar *relative = g_file_get_relative_path (search->root, search->directory);
+
+      ide_content_search_walk (search,
+                               search->directory,
+                               relative,
+                               search->recursive,
+                               cancellable,
+                               &error);
+
+      if (error != NULL)
+        {
+          ide_task_return_error (task, g_steal_pointer (&error));
+          IDE_EXIT;
+        }
+    }
+
+  if (ide_task_return_error_if_cancelled (task))
+    IDE_EXIT;
+
+  ide_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
+/* Searching {{{1 */
+
+static const gchar *
+find_literal_caseless (const gchar *haystack,
+                       gsize        haystack_len,
+                       const gchar *needle,
+                       gsize        needle_len)
+{
+  const gchar *end = haystack + haystack_len;
+  const gchar *iter = haystack;
+  gchar lower = g_ascii_tolower (needle[0]);
+  gchar upper = g_ascii_toupper (needle[0]);
+
+  while ((gsize)(end - iter) >= needle_len)
+    {
+      const gchar *limit = end - needle_len + 1;
+      const gchar *a = memchr (iter, lower, limit - iter);
+      const gchar *b = NULL;
+      const gchar *hit;
+
+      if (upper != lower)
+        b = memchr (iter, upper, (a ? a : limit) - iter);
+
+      if (!(hit = b ? b : a))
+        return NULL;
+
+      if (g_ascii_strncasecmp (hit + 1, needle + 1, needle_len - 1) == 0)
+        return hit;
+
+      iter = hit + 1;
+    }
+
+  return NULL;
+}
+
+static const gchar *
+find_literal (const Literal *lit,
+              const gchar   *haystack,
+              gsize          haystack_len,
+              gboolean       caseless)
+{
+  if (caseless)
+    return find_literal_caseless (haystack, haystack_len, lit->text, lit->len);
+  else if (lit->len == 1)
+    return memchr (haystack, lit->text[0], haystack_len);
+  else
+    return memmem (haystack, haystack_len, lit->text, lit->len);
+}
+
+static gsize
+count_newlines (const gchar *data,
+                gsize        len)
+{
+  const gchar *end = data + len;
+  gsize count = 0;
+
+  while ((data = memchr (data, '\n', end - data)))
+    {
+      count++;
+      data++;
+    }
+
+  return count;
+}
+
+static gchar *
+dup_line (const gchar *data,
+          gsize        len)
+{
+  if (len > 0 && data[len - 1] == '\r')
+    len--;
+
+  if (g_utf8_validate (data, len, NULL))
+    return g_strndup (data, len);
+
+  return g_utf8_make_valid (data, len);
+}
+
+static gchar **
+collect_context (Search      *search,
+                 const gchar *data,
+                 gsize        len,
+                 gsize        pos)
+{
+  GPtrArray *lines;
+
+  if (search->context_after == 0 || pos >= len)
+    return NULL;
+
+  lines = g_ptr_array_new ();
+
+  while (pos < len && lines->len < search->context_after)
+    {
+      const gchar *eol = memchr (data + pos, '\n', len - pos);
+      gsize end = eol ? (gsize)(eol - data) : len;
+
+      g_ptr_array_add (lines, dup_line (data + pos, end - pos));
+      pos = end + 1;
+    }
+
+  g_ptr_array_add (lines, NULL);
+
+  return (gchar **)g_ptr_array_free (lines, FALSE);
+}
+
+static void
+search_file (Search      *search,
+             const gchar *relative,
+             GPtrArray   *found)
+{
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autofree gchar *path = NULL;
+  const Literal *literals = NULL;
+  const gchar *hits[MAX_LITERALS];
+  const gchar *data;
+  gsize counted = 0;
+  gsize line = 0;
+  gsize pos = 0;
+  gsize len;
+
+  g_assert (search != NULL);
+  g_assert (relative != NULL);
+  g_assert (found != NULL);
+
+  path = g_build_filename (search->root_path, relative, NULL);
+
+  if (search->ignore_func != NULL)
+    {
+      g_autoptr(GFile) file = g_file_new_for_path (path);
+
+      if (search_is_ignored (search, file))
+        return;
+    }
+
+  if (!(mapped = g_mapped_file_new (path, FALSE, NULL)))
+    return;
+
+  data = g_mapped_file_get_contents (mapped);
+  len = g_mapped_file_get_length (mapped);
+
+  /* Skip binary files, like grep -I */
+  if (len == 0 || memchr (data, 0, MIN (len, BINARY_CHECK_LEN)))
+    return;
+
+  if (search->literals != NULL)
+    {
+      literals = (const Literal *)(gpointer)search->literals->data;
+
+      /* Position of the next occurrence of each literal, or NULL */
+      for (guint i = 0; i < search->literals->len; i++)
+        hits[i] = find_literal (&literals[i], data, len, search->caseless);
+    }
+
+  while (pos < len)
+    {
+      g_autoptr(GMatchInfo) match_info = NULL;
+      IdeContentSearchMatch *match;
+      g_autoptr(GArray) ranges = NULL;
+      const gchar *bol;
+      const gchar *eol;
+      gsize line_len;
+      gsize hit = pos;
+
+      if (literals != NULL)
+        {
+          const gchar *first = NULL;
+
+          for (guint i = 0; i < search->literals->len; i++)
+            {
+              if (hits[i] != NULL && hits[i] < data + pos)
+                hits[i] = find_literal (&literals[i], data + pos, len - pos, search->caseless);
+
+              if (hits[i] != NULL && (first == NULL || hits[i] < first))
+                first = hits[i];
+            }
+
+          /* Nothing more in this file can match */
+          if (first == NULL)
+            break;
+
+          hit = first - data;
+        }
+
+      /* pos is always at the start of a line */
+      if ((bol = memrchr (data + pos, '\n', hit - pos)))
+        bol++;
+      else
+        bol = data + pos;
+
+      if (!(eol = memchr (data + hit, '\n', len - hit)))
+        eol = data + len;
+
+      line += count_newlines (data + counted, bol - data - counted);
+      counted = bol - data;
+      pos = eol - data + 1;
+
+      line_len = eol - bol;
+      if (line_len > 0 && bol[line_len - 1] == '\r')
+        line_len--;
+
+      if (search->max_line_length > 0 && line_len > search->max_line_length)
+        continue;
+
+      if (!g_utf8_validate (bol, line_len, NULL))
+        continue;
+
+      if (!g_regex_match_full (search->regex, bol, line_len, 0, 0, &match_info, NULL))
+        continue;
+
+      ranges = g_array_new (FALSE, FALSE, sizeof (IdeContentSearchRange));
+
+      do
+        {
+          gint begin = -1;
+          gint end = -1;
+
+          if (g_match_info_fetch_pos (match_info, 0, &begin, &end) && end > begin)
+            {
+              IdeContentSearchRange range = { begin, end };
+              g_array_append_val (ranges, range);
+            }
+        }
+      while (g_match_info_next (match_info, NULL));
+
+      if (search->max_results > 0 &&
+          g_atomic_int_add (&search->n_matches, 1) >= (gint)search->max_results)
+        {
+          g_atomic_int_set (&search->truncated, TRUE);
+          break;
+        }
+
+      match = g_slice_new0 (IdeContentSearchMatch);
+      match->path = g_strdup (relative);
+      match->line = line;
+      match->text = g_strndup (bol, line_len);
+      match->ranges = g_steal_pointer (&ranges);
+      match->context_after = collect_context (search, data, len, pos);
+
+      g_ptr_array_add (found, match);
+    }
+}
+
+static void
+ide_content_search_worker (IdeTask      *task,
+                           gpointer      source_object,
+                           gpointer      task_data,
+                           GCancellable *cancellable)
+{
+  Search *search = task_data;
+
+  g_assert (IDE_IS_TASK (task));
+  g_assert (IDE_IS_CONTENT_SEARCH (source_object));
+  g_assert (search != NULL);
+  g_assert (search->files != NULL);
+
+  while (!g_cancellable_is_cancelled (cancellable) &&
+         !g_atomic_int_get (&search->truncated))
+    {
+      g_autoptr(GPtrArray) found = NULL;
+      guint i = g_atomic_int_add (&search->next_file, 1);
+
+      if (i >= search->files->len)
+        break;
+
+      found = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_content_search_match_free);
+      search_file (search, g_ptr_array_index (search->files, i), found);
+
+      /* Keep matches from a single file together */
+      if (found->len > 0)
+        {
+          g_mutex_lock (&search->mutex);
+          g_ptr_array_extend_and_steal (search->pending, g_steal_pointer (&found));
+          g_mutex_unlock (&search->mutex);
+        }
+    }
+
+  ide_task_return_boolean (task, TRUE);
+}
+
+static void
+ide_content_search_flush (IdeContentSearch *self,
+                          Search           *search)
+{
+  g_autoptr(GPtrArray) pending = NULL;
+  guint position;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_CONTENT_SEARCH (self));
+  g_assert (search != NULL);
+
+  g_mutex_lock (&search->mutex);
+  if (search->pending->len > 0)
+    {
+      pending = g_steal_pointer (&search->pending);
+      search->pending = g_ptr_array_new ();
+    }
+  g_mutex_unlock (&search->mutex);
+
+  if (pending == NULL)
+    return;
+
+  if (search->first_match_time == 0)
+    {
+      search->first_match_time = g_get_monotonic_time ();
+      g_debug ("First match after %.2lf msec",
+               (search->first_match_time - search->begin_time) / 1000.0);
+    }
+
+  position = self->matches->len;
+  g_ptr_array_extend_and_steal (self->matches, g_steal_pointer (&pending));
+
+  g_signal_emit (self, signals [MATCHES_ADDED], 0, position, self->matches->len - position);
+}
+
+static gboolean
+ide_content_search_flush_cb (gpointer data)
+{
+  IdeTask *task = data;
+  IdeContentSearch *self = ide_task_get_source_object (task);
+  Search *search = ide_task_get_task_data (task);
+
+  ide_content_search_flush (self, search);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+ide_content_search_worker_cb (GObject      *object,
+                              GAsyncResult *result,
+                              gpointer      user_data)
+{
+  IdeContentSearch *self = (IdeContentSearch *)object;
+  g_autoptr(IdeTask) task = user_data;
+  Search *search;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CONTENT_SEARCH (self));
+  g_assert (IDE_IS_TASK (result));
+  g_assert (IDE_IS_TASK (task));
+
+  search = ide_task_get_task_data (task);
+
+  g_assert (search != NULL);
+  g_assert (search->n_active > 0);
+
+  ide_task_propagate_boolean (IDE_TASK (result), NULL);
+
+  if (--search->n_active > 0)
+    IDE_EXIT;
+
+  g_clear_handle_id (&search->flush_source, g_source_remove);
+  ide_content_search_flush (self, search);
+
+  self->truncated = !!g_atomic_int_get (&search->truncated);
+
+  g_debug ("Searched %u files in %.2lf msec, found %u matches%s",
+           search->files->len,
+           (g_get_monotonic_time () - search->begin_time) / 1000.0,
+           self->matches->len,
+           self->truncated ? " (truncated)" : "");
+
+  if (ide_task_return_error_if_cancelled (task))
+    IDE_EXIT;
+
+  ide_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
+static void
+ide_content_search_walk_done_cb (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  IdeContentSearch *self = (IdeContentSearch *)object;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+  GCancellable *cancellable;
+  Search *search;
+  guint n_workers;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_CONTENT_SEARCH (self));
+  g_assert (IDE_IS_TASK (result));
+  g_assert (IDE_IS_TASK (task));
+
+  search = ide_task_get_task_data (task);
+  cancellable = ide_task_get_cancellable (task);
+
+  if (!ide_task_propagate_boolean (IDE_TASK (result), &error))
+    {
+      ide_task_return_error (task, g_steal_pointer (&error));
+      IDE_EXIT;
+    }
+
+  if (search->files->len == 0)
+    {
+      ide_task_return_boolean (task, TRUE);
+      IDE_EXIT;
+    }
+
+  n_workers = ide_thread_pool_get_max_threads (IDE_THREAD_POOL_IO) / WORKER_POOL_DIVISOR;
+  n_workers = CLAMP (n_workers, 1, search->files->len);
+
+  search->flush_source = g_timeout_add_full (G_PRIORITY_DEFAULT,
+                                             FLUSH_INTERVAL_MSEC,
+                                             ide_content_search_flush_cb,
+                                             g_object_ref (task),
+                                             g_object_unref);
+
+  for (guint i = 0; i < n_workers; i++)
+    {
+      g_autoptr(IdeTask) worker = NULL;
+
+      worker = ide_task_new (self, cancellable, ide_content_search_worker_cb, g_object_ref (task));
+      ide_task_set_source_tag (worker, ide_content_search_worker);
+      ide_task_set_kind (worker, IDE_TASK_KIND_IO);
+      ide_task_set_task_data (worker, search_ref (search), search_unref);
+
+      search->n_active++;
+
+      ide_task_run_in_thread (worker, ide_content_search_worker);
+    }
+
+  IDE_EXIT;
+}
+
+/* IdeContentSearch {{{1 */
+
+static void
+ide_content_search_finalize (GObject *object)
+{
+  IdeContentSearch *self = (IdeContentSearch *)object;
+
+  if (self->ignore_func_data_destroy != NULL)
+    g_clear_pointer (&self->ignore_func_data, self->ignore_func_data_destroy);
+
+  g_clear_object (&self->directory);
+  g_clear_pointer (&self->query, g_free);
+  g_clear_pointer (&self->matches, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (ide_content_search_parent_class)->finalize (object);
+}
+
+static void
+ide_content_search_get_property (GObject    *object,
+                                 guint       prop_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  IdeContentSearch *self = IDE_CONTENT_SEARCH (object);
+
+  switch (prop_id)
+    {
+    case PROP_AT_WORD_BOUNDARIES:
+      g_value_set_boolean (value, self->at_word_boundaries);
+      break;
+
+    case PROP_CASE_SENSITIVE:
+      g_value_set_boolean (value, self->case_sensitive);
+      break;
+
+    case PROP_CONTEXT_AFTER:
+      g_value_set_uint (value, self->context_after);
+      break;
+
+    case PROP_DIRECTORY:
+      g_value_set_object (value, self->directory);
+      break;
+
+    case PROP_MAX_LINE_LENGTH:
+      g_value_set_uint (value, self->max_line_length);
+      break;
+
+    case PROP_MAX_RESULTS:
+      g_value_set_uint (value, self->max_results);
+      break;
+
+    case PROP_QUERY:
+      g_value_set_string (value, self->query);
+      break;
+
+    case PROP_RECURSIVE:
+      g_value_set_boolean (value, self->recursive);
+      break;
+
+    case PROP_USE_REGEX:
+      g_value_set_boolean (value, self->use_regex);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+ide_content_search_set_property (GObject      *object,
+                                 guint         prop_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  IdeContentSearch *self = IDE_CONTENT_SEARCH (object);
+
+  switch (prop_id)
+    {
+    case PROP_AT_WORD_BOUNDARIES:
+      ide_content_search_set_at_word_boundaries (self, g_value_get_boolean (value));
+      break;
+
+    case PROP_CASE_SENSITIVE:
+      ide_content_search_set_case_sensitive (self, g_value_get_boolean (value));
+      break;
+
+    case PROP_CONTEXT_AFTER:
+      ide_content_search_set_context_after (self, g_value_get_uint (value));
+      break;
+
+    case PROP_DIRECTORY:
+      self->directory = g_value_dup_object (value);
+      break;
+
+    case PROP_MAX_LINE_LENGTH:
+      ide_content_search_set_max_line_length (self, g_value_get_uint (value));
+      break;
+
+    case PROP_MAX_RESULTS:
+      ide_content_search_set_max_results (self, g_value_get_uint (value));
+      break;
+
+    case PROP_QUERY:
+      ide_content_search_set_query (self, g_value_get_string (value));
+      break;
+
+    case PROP_RECURSIVE:
+      ide_content_search_set_recursive (self, g_value_get_boolean (value));
+      break;
+
+    case PROP_USE_REGEX:
+      ide_content_search_set_use_regex (self, g_value_get_boolean (value));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+ide_content_search_class_init (IdeContentSearchClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ide_content_search_finalize;
+  object_class->get_property = ide_content_search_get_property;
+  object_class->set_property = ide_content_search_set_property;
+
+  properties [PROP_AT_WORD_BOUNDARIES] =
+    g_param_spec_boolean ("at-word-boundaries",
+                          "At Word Boundaries",
+                          "If matches must begin and end at word boundaries",
+                          FALSE,
+                          (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_CASE_SENSITIVE] =
+    g_param_spec_boolean ("case-sensitive",
+                          "Case Sensitive",
+                          "If the query is case sensitive",
+                          FALSE,
+                          (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_CONTEXT_AFTER] =
+    g_param_spec_uint ("context-after",
+                       "Context After",
+                       "The number of lines following a match to include",
+                       0, G_MAXUINT, 0,
+                       (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_DIRECTORY] =
+    g_param_spec_object ("directory",
+                         "Directory",
+                         "The directory, or file, to search",
+                         G_TYPE_FILE,
+                         (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_MAX_LINE_LENGTH] =
+    g_param_spec_uint ("max-line-length",
+                       "Max Line Length",
+                       "Lines longer than this many bytes are skipped, or 0 for unlimited",
+                       0, G_MAXUINT, 0,
+                       (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_MAX_RESULTS] =
+    g_param_spec_uint ("max-results",
+                       "Max Results",
+                       "The search stops after this many matches, or 0 for unlimited",
+                       0, G_MAXUINT, 0,
+                       (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_QUERY] =
+    g_param_spec_string ("query",
+                         "Query",
+                         "The text or regex to search for",
+                         NULL,
+                         (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_RECURSIVE] =
+    g_param_spec_boolean ("recursive",
+                          "Recursive",
+                          "If subdirectories should be searched",
+                          TRUE,
+                          (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_USE_REGEX] =
+    g_param_spec_boolean ("use-regex",
+                          "Use Regex",
+                          "If the query is a regular expression",
+                          FALSE,
+                          (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
+
+  /**
+   * IdeContentSearch::matches-added:
+   * @self: an #IdeContentSearch
+   * @position: the position of the first new match
+   * @n_added: the number of matches added
+   *
+   * The "matches-added" signal is emitted on the main thread when a batch
+   * of matches has been found. Use ide_content_search_get_match() to
+   * access them.
+   *
+   * Since: 3.40
+   */
+  signals [MATCHES_ADDED] =
+    g_signal_new ("matches-added",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 2, G_TYPE_UINT, G_TYPE_UINT);
+}
+
+static void
+ide_content_search_init (IdeContentSearch *self)
+{
+  self->recursive = TRUE;
+  self->matches = g_ptr_array_new_with_free_func ((GDestroyNotify)ide_content_search_match_free);
+}
+
+/**
+ * ide_content_search_new:
+ * @directory: a #GFile
+ *
+ * Creates a new #IdeContentSearch to search the files within @directory.
+ * If @directory is a regular file, only that file is searched.
+ *
+ * Returns: (transfer full): a new #IdeContentSearch
+ *
+ * Since: 3.40
+ */
+IdeContentSearch *
+ide_content_search_new (GFile *directory)
+{
+  g_return_val_if_fail (G_IS_FILE (directory), NULL);
+
+  return g_object_new (IDE_TYPE_CONTENT_SEARCH,
+                       "directory", directory,
+                       NULL);
+}
+
+/**
+ * ide_content_search_get_directory:
+ * @self: an #IdeContentSearch
+ *
+ * Returns: (transfer none): a #GFile
+ *
+ * Since: 3.40
+ */
+GFile *
+ide_content_search_get_directory (IdeContentSearch *self)
+{
+  g_return_val_if_fail (IDE_IS_CONTENT_SEARCH (self), NULL);
+
+  return self->directory;
+}
+
+const gchar *
+ide_content_search_get_query (IdeContentSearch *self)
+{
+  g_return_val_if_fail (IDE_IS_CONTENT_SEARCH (self), NULL);
+
+  return self->query;
+}
+
+void
+ide_content_search_set_query (IdeContentSearch *self,
+                              const gchar      *query)
+{
+  g_return_if_fail (IDE_IS_CONTENT_SEARCH (self));
+  g_return_if_fail (self->has_run == FALSE);
+
+  if (g_strcmp0 (query, self->query) != 0)
+    {
+      g_free (self->query);
+      self->query = g_strdup (query);
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_QUERY]);
+    }
+}
+
+#define DEFINE_BOOLEAN_PROPERTY(name, NAME)                                    \
+gboolean                                                                       \
+ide_content_search_get_##name (IdeContentSearch *self)                         \
+{                                                                              \
+  g_return_val_if_fail (IDE_IS_CONTENT_SEARCH (self), FALSE);                  \
+  return self->name;                                                           \
+}                                                                              \
+                                                                               \
+void                                                                           \
+ide_content_search_set_##name (IdeContentSearch *self,                         \
+                               gboolean          name)                         \
+{                                                                              \
+  g_return_if_fail (IDE_IS_CONTENT_SEARCH (self));                             \
+  g_return_if_fail (self->has_run == FALSE);                                   \
+                                                                               \
+  name = !!name;                                                               \
+                                                                               \
+  if (name != self->name)                                                      \
+    {                                                                          \
+      self->name = name;                                                       \
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_##NAME]);    \
+    }                                                                          \
+}
+
+#define DEFINE_UINT_PROPERTY(name, NAME)                                       \
+guint                                                                          \
+ide_content_search_get_##name (IdeContentSearch *self)                         \
+{                                                                              \
+  g_return_val_if_fail (IDE_IS_CONTENT_SEARCH (self), 0);                      \
+  return self->name;                                                           \
+}                                                                              \
+                                                                               \
+void                                                                           \
+ide_content_search_set_##name (IdeContentSearch *self,                         \
+                               guint             name)                         \
+{                                                                              \
+  g_return_if_fail (IDE_IS_CONTENT_SEARCH (self));                             \
+  g_return_if_fail (self->has_run == FALSE);                                   \
+                                                                               \
+  if (name != self->name)                                                      \
+    {                                                                          \
+      self->name = name;                                                       \
+      g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_##NAME]);    \
+    }                                                                          \
+}
+
+DEFINE_BOOLEAN_PROPERTY (use_regex, USE_REGEX)
+DEFINE_BOOLEAN_PROPERTY (case_sensitive, CASE_SENSITIVE)
+DEFINE_BOOLEAN_PROPERTY (at_word_boundaries, AT_WORD_BOUNDARIES)
+DEFINE_BOOLEAN_PROPERTY (recursive, RECURSIVE)
+DEFINE_UINT_PROPERTY (max_results, MAX_RESULTS)
+DEFINE_UINT_PROPERTY (max_line_length, MAX_LINE_LENGTH)
+DEFINE_UINT_PROPERTY (context_after, CONTEXT_AFTER)
+
+#undef DEFINE_BOOLEAN_PROPERTY
+#undef DEFINE_UINT_PROPERTY
+
+/**
+ * ide_content_search_set_ignore_func:
+ * @self: an #IdeContentSearch
+ * @ignore_func: (nullable) (scope notified): an #IdeContentSearchIgnoreFunc
+ * @ignore_func_data: closure data for @ignore_func
+ * @ignore_func_data_destroy: destroy notify for @ignore_func_data
+ *
+ * Sets a function used to skip files and directories, such as those
+ * ignored by the version control system. Directories are checked before
+ * their children, so an ignored directory is skipped entirely.
+ *
+ * Since: 3.40
+ */
+void
+ide_content_search_set_ignore_func (IdeContentSearch           *self,
+                                    IdeContentSearchIgnoreFunc  ignore_func,
+                                    gpointer                    ignore_func_data,
+                                    GDestroyNotify              ignore_func_data_destroy)
+{
+  g_return_if_fail (IDE_IS_CONTENT_SEARCH (self));
+  g_return_if_fail (self->has_run == FALSE);
+
+  if (self->ignore_func_data_destroy != NULL)
+    g_clear_pointer (&self->ignore_func_data, self->ignore_func_data_destroy);
+
+  self->ignore_func = ignore_func;
+  self->ignore_func_data = ignore_func_data;
+  self->ignore_func_data_destroy = ignore_func_data_destroy;
+}
+
+/**
+ * ide_content_search_get_n_matches:
+ * @self: an #IdeContentSearch
+ *
+ * Gets the number of matches delivered so far.
+ *
+ * Since: 3.40
+ */
+guint
+ide_content_search_get_n_matches (IdeContentSearch *self)
+{
+  g_return_val_if_fail (IDE_IS_CONTENT_SEARCH (self), 0);
+
+  return self->matches->len;
+}
+
+/**
+ * ide_content_search_get_match:
+ * @self: an #IdeContentSearch
+ * @position: the index of the match
+ *
+ * Returns: (transfer none): an #IdeContentSearchMatch which is valid for
+ *   the lifetime of @self
+ *
+ * Since: 3.40
+ */
+const IdeContentSearchMatch *
+ide_content_search_get_match (IdeContentSearch *self,
+                              guint             position)
+{
+  g_return_val_if_fail (IDE_IS_CONTENT_SEARCH (self), NULL);
+  g_return_val_if_fail (position < self->matches->len, NULL);
+
+  return g_ptr_array_index (self->matches, position);
+}
+
+/**
+ * ide_content_search_get_truncated:
+ * @self: an #IdeContentSearch
+ *
+ * Returns: %TRUE if the search stopped because #IdeContentSearch:max-results
+ *   was reached
+ *
+ * Since: 3.40
+ */
+gboolean
+ide_content_search_get_truncated (IdeContentSearch *self)
+{
+  g_return_val_if_fail (IDE_IS_CONTENT_SEARCH (self), FALSE);
+
+  return self->truncated;
+}
+
+/**
+ * ide_content_search_run_async:
+ * @self: an #IdeContentSearch
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: a #GAsyncReadyCallback
+ * @user_data: closure data for @callback
+ *
+ * Starts searching. Matches are delivered as they are found using the
+ * #IdeContentSearch::matches-added signal, and @callback is called after
+ * all files have been searched.
+ *
+ * This may only be called once.
+ *
+ * Since: 3.40
+ */
+void
+ide_content_search_run_async (IdeContentSearch    *self,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
+{
+  g_autoptr(IdeTask) task = NULL;
+  g_autoptr(IdeTask) walk = NULL;
+  g_autoptr(GRegex) regex = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(Search) search = NULL;
+  g_autofree gchar *path = NULL;
+  GFileType file_type;
+
+  IDE_ENTRY;
+
+  g_return_if_fail (IDE_IS_CONTENT_SEARCH (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = ide_task_new (self, cancellable, callback, user_data);
+  ide_task_set_source_tag (task, ide_content_search_run_async);
+
+  if (self->has_run)
+    {
+      ide_task_return_new_error (task,
+                                 G_IO_ERROR,
+                                 G_IO_ERROR_INVAL,
+                                 "ide_content_search_run_async() may only be called once");
+      IDE_EXIT;
+    }
+
+  self->has_run = TRUE;
+
+  if (ide_str_empty0 (self->query))
+    {
+      ide_task_return_new_error (task,
+                                 G_IO_ERROR,
+                                 G_IO_ERROR_INVAL,
+                                 "No query has been set to search for");
+      IDE_EXIT;
+    }
+
+  if (!(path = g_file_get_path (self->directory)))
+    {
+      ide_task_return_new_error (task,
+                                 G_IO_ERROR,
+                                 G_IO_ERROR_NOT_SUPPORTED,
+                                 "Only local files may be searched");
+      IDE_EXIT;
+    }
+
+  if (!(regex = build_regex (self, &error)))
+    {
+      ide_task_return_error (task, g_steal_pointer (&error));
+      IDE_EXIT;
+    }
+
+  search = g_atomic_rc_box_new0 (Search);
+  g_mutex_init (&search->mutex);
+  search->directory = g_object_ref (self->directory);
+  search->regex = g_steal_pointer (&regex);
+  search->literals = extract_literals (self->query, self->use_regex, !self->case_sensitive);
+  search->ignore_func = self->ignore_func;
+  search->ignore_func_data = self->ignore_func_data;
+  search->max_results = self->max_results;
+  search->max_line_length = self->max_line_length;
+  search->context_after = self->context_after;
+  search->caseless = !self->case_sensitive;
+  search->recursive = self->recursive;
+  search->files = g_ptr_array_new_with_free_func (g_free);
+  search->pending = g_ptr_array_new ();
+  search->begin_time = g_get_monotonic_time ();
+
+  /* Paths are relative to the directory, or its parent for a single file */
+  file_type = g_file_query_file_type (self->directory, 0, NULL);
+  if (file_type == G_FILE_TYPE_DIRECTORY)
+    {
+      search->root = g_object_ref (self->directory);
+      search->root_path = g_steal_pointer (&path);
+    }
+  else
+    {
+      search->root = g_file_get_parent (self->directory);
+      search->root_path = g_path_get_dirname (path);
+    }
+
+  g_debug ("Searching %s for \"%s\" using %u literal(s)",
+           search->root_path,
+           self->query,
+           search->literals ? search->literals->len : 0);
+
+  ide_task_set_task_data (task, search_ref (search), search_unref);
+
+  walk = ide_task_new (self, cancellable, ide_content_search_walk_done_cb, g_object_ref (task));
+  ide_task_set_source_tag (walk, ide_content_search_run_async);
+  ide_task_set_kind (walk, IDE_TASK_KIND_IO);
+  ide_task_set_task_data (walk, search_ref (search), search_unref);
+  ide_task_run_in_thread (walk, ide_content_search_walk_worker);
+
+  IDE_EXIT;
+}
+
+/**
+ * ide_content_search_run_finish:
+ * @self: an #IdeContentSearch
+ * @result: a #GAsyncResult provided to callback
+ * @error: a location for a #GError, or %NULL
+ *
+ * Completes a request to ide_content_search_run_async(). All matches have
+ * been delivered by the time this is called.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set
+ *
+ * Since: 3.40
+ */
+gboolean
+ide_content_search_run_finish (IdeContentSearch  *self,
+                               GAsyncResult      *result,
+                               GError           **error)
+{
+  g_return_val_if_fail (IDE_IS_CONTENT_SEARCH (self), FALSE);
+  g_return_val_if_fail (IDE_IS_TASK (result), FALSE);
+
+  return ide_task_propagate_boolean (IDE_TASK (result), error);
+}
@@ -0,0 +1,158 @@
+/* ide-content-search.h
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#if !defined (IDE_IO_INSIDE) && !defined (IDE_IO_COMPILATION)
+# error "Only <libide-io.h> can be included directly."
+#endif
+
+#include <libide-core.h>
+
+G_BEGIN_DECLS
+
+#define IDE_TYPE_CONTENT_SEARCH       (ide_content_search_get_type())
+#define IDE_TYPE_CONTENT_SEARCH_MATCH (ide_content_search_match_get_type())
+
+/**
+ * IdeContentSearchRange:
+ * @begin: byte offset of the beginning of the match within the line
+ * @end: byte offset of the end of the match within the line
+ *
+ * Since: 3.40
+ */
+typedef struct
+{
+  guint begin;
+  guint end;
+} IdeContentSearchRange;
+
+/**
+ * IdeContentSearchMatch:
+ * @path: the path of the file, relative to the searched directory
+ * @line: the line number, starting from zero
+ * @text: the contents of the line, without the trailing newline
+ * @ranges: (element-type IdeContentSearchRange): the matches within @text
+ * @context_after: (nullable): lines following @line, if requested
+ *
+ * Since: 3.40
+ */
+typedef struct
+{
+  gchar   *path;
+  guint    line;
+  gchar   *text;
+  GArray  *ranges;
+  gchar  **context_after;
+} IdeContentSearchMatch;
+
+/**
+ * IdeContentSearchIgnoreFunc:
+ * @file: a #GFile for a file or directory
+ * @user_data: closure data
+ *
+ * This function is called from a worker thread and therefore must be
+ * thread-safe.
+ *
+ * Returns: %TRUE if @file should not be searched
+ *
+ * Since: 3.40
+ */
+typedef gboolean (*IdeContentSearchIgnoreFunc) (GFile    *file,
+                                                gpointer  user_data);
+
+IDE_AVAILABLE_IN_3_40
+G_DECLARE_FINAL_TYPE (IdeContentSearch, ide_content_search, IDE, CONTENT_SEARCH, GObject)
+
+IDE_AVAILABLE_IN_3_40
+GType                        ide_content_search_match_get_type         (void);
+IDE_AVAILABLE_IN_3_40
+IdeContentSearchMatch       *ide_content_search_match_copy             (const IdeContentSearchMatch *match);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_match_free             (IdeContentSearchMatch       *match);
+IDE_AVAILABLE_IN_3_40
+IdeContentSearch            *ide_content_search_new                    (GFile                       *directory);
+IDE_AVAILABLE_IN_3_40
+GFile                       *ide_content_search_get_directory          (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+const gchar                 *ide_content_search_get_query              (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_set_query              (IdeContentSearch            *self,
+                                                                        const gchar                 *query);
+IDE_AVAILABLE_IN_3_40
+gboolean                     ide_content_search_get_use_regex          (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_set_use_regex          (IdeContentSearch            *self,
+                                                                        gboolean                     use_regex);
+IDE_AVAILABLE_IN_3_40
+gboolean                     ide_content_search_get_case_sensitive     (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_set_case_sensitive     (IdeContentSearch            *self,
+                                                                        gboolean                     case_sensitive);
+IDE_AVAILABLE_IN_3_40
+gboolean                     ide_content_search_get_at_word_boundaries (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_set_at_word_boundaries (IdeContentSearch            *self,
+                                                                        gboolean                     at_word_boundaries);
+IDE_AVAILABLE_IN_3_40
+gboolean                     ide_content_search_get_recursive          (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_set_recursive          (IdeContentSearch            *self,
+                                                                        gboolean                     recursive);
+IDE_AVAILABLE_IN_3_40
+guint                        ide_content_search_get_max_results        (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_set_max_results        (IdeContentSearch            *self,
+                                                                        guint                        max_results);
+IDE_AVAILABLE_IN_3_40
+guint                        ide_content_search_get_max_line_length    (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_set_max_line_length    (IdeContentSearch            *self,
+                                                                        guint                        max_line_length);
+IDE_AVAILABLE_IN_3_40
+guint                        ide_content_search_get_context_after      (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_set_context_after      (IdeContentSearch            *self,
+                                                                        guint                        context_after);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_set_ignore_func        (IdeContentSearch            *self,
+                                                                        IdeContentSearchIgnoreFunc   ignore_func,
+                                                                        gpointer                     ignore_func_data,
+                                                                        GDestroyNotify               ignore_func_data_destroy);
+IDE_AVAILABLE_IN_3_40
+guint                        ide_content_search_get_n_matches          (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+const IdeContentSearchMatch *ide_content_search_get_match              (IdeContentSearch            *self,
+                                                                        guint                        position);
+IDE_AVAILABLE_IN_3_40
+gboolean                     ide_content_search_get_truncated          (IdeContentSearch            *self);
+IDE_AVAILABLE_IN_3_40
+void                         ide_content_search_run_async              (IdeContentSearch            *self,
+                                                                        GCancellable                *cancellable,
+                                                                        GAsyncReadyCallback          callback,
+                                                                        gpointer                     user_data);
+IDE_AVAILABLE_IN_3_40
+gboolean                     ide_content_search_run_finish             (IdeContentSearch            *self,
+                                                                        GAsyncResult                *result,
+                                                                        GError                     **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (IdeContentSearchMatch, ide_content_search_match_free)
+
+G_END_DECLS
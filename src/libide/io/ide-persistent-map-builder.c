@@ -27,6 +27,7 @@
 #include <string.h>
 
 #include "ide-persistent-map-builder.h"
+#include "ide-persistent-map-private.h"
 
 typedef struct
 {
@@ -158,6 +159,36 @@ compare_keys (KVPair      *a,
   return g_strcmp0 (keys + a->key, keys + b->key);
 }
 
+static GVariant *
+build_slots (GArray      *kvpairs,
+             const gchar *keys)
+{
+  g_autofree guint64 *slots = NULL;
+  gsize n_slots;
+  gsize mask;
+
+  g_assert (kvpairs != NULL);
+  g_assert (keys != NULL);
+
+  n_slots = _ide_persistent_map_get_n_slots (kvpairs->len);
+  mask = n_slots - 1;
+  slots = g_new0 (guint64, n_slots);
+
+  for (guint i = 0; i < kvpairs->len; i++)
+    {
+      const KVPair *kvpair = &g_array_index (kvpairs, KVPair, i);
+      guint64 hash = _ide_persistent_map_hash (keys + kvpair->key);
+      gsize pos = hash & mask;
+
+      while (slots[pos] != 0)
+        pos = (pos + 1) & mask;
+
+      slots[pos] = _ide_persistent_map_make_slot (hash, i);
+    }
+
+  return g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64, slots, n_slots, sizeof (guint64));
+}
+
 static void
 ide_persistent_map_builder_write_worker (IdeTask      *task,
                                          gpointer      source_object,
@@ -172,6 +203,7 @@ ide_persistent_map_builder_write_worker (IdeTask      *task,
   GVariant *values;
   GVariant *kvpairs;
   GVariant *metadata;
+  GVariant *slots;
 
   g_assert (IDE_IS_TASK (task));
   g_assert (IDE_IS_PERSISTENT_MAP_BUILDER (source_object));
@@ -219,13 +251,17 @@ ide_persistent_map_builder_write_worker (IdeTask      *task,
                                        state->kvpairs->len,
                                        sizeof (KVPair));
 
+  /* Indexes into the sorted kvpairs, so this must come after sorting */
+  slots = build_slots (state->kvpairs, (const gchar *)state->keys->data);
+
   metadata = g_variant_dict_end (state->metadata);
 
   g_variant_dict_insert_value (&dict, "keys", keys);
   g_variant_dict_insert_value (&dict, "values", values);
   g_variant_dict_insert_value (&dict, "kvpairs", kvpairs);
   g_variant_dict_insert_value (&dict, "metadata", metadata);
-  g_variant_dict_insert (&dict, "version", "i", 2);
+  g_variant_dict_insert_value (&dict, "slots", slots);
+  g_variant_dict_insert (&dict, "version", "i", IDE_PERSISTENT_MAP_VERSION_HASHED);
   g_variant_dict_insert (&dict, "byte-order", "i", G_BYTE_ORDER);
 
   data = g_variant_take_ref (g_variant_dict_end (&dict));
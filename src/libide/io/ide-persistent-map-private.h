@@ -0,0 +1,89 @@
+/* ide-persistent-map-private.h
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Version 3 of the persistent map adds a "slots" array to the file, which
+ * is an open-addressing hash table (linear probing) of guint64 entries.
+ * The upper 32 bits of each entry contain a fingerprint of the key, which
+ * always has the low bit set so that an empty slot is 0. The lower 32 bits
+ * contain the index into the sorted "kvpairs" array.
+ *
+ * Lookups generally touch a single cache line of the table and then
+ * verify the key once, rather than comparing strings at every step of a
+ * binary search.
+ */
+
+#define IDE_PERSISTENT_MAP_VERSION_SORTED 2
+#define IDE_PERSISTENT_MAP_VERSION_HASHED 3
+
+static inline guint64
+_ide_persistent_map_hash (const gchar *key)
+{
+  guint64 h = 0xcbf29ce484222325ULL;
+
+  /* FNV-1a, which must be stable across platforms since it is stored */
+  for (const guint8 *p = (const guint8 *)key; *p; p++)
+    {
+      h ^= *p;
+      h *= 0x100000001b3ULL;
+    }
+
+  /* Finalizer from MurmurHash3 so that low bits are usable for the slot */
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+static inline guint32
+_ide_persistent_map_fingerprint (guint64 hash)
+{
+  return (guint32)(hash >> 32) | 1;
+}
+
+static inline guint64
+_ide_persistent_map_make_slot (guint64 hash,
+                               guint32 kvpair)
+{
+  return ((guint64)_ide_persistent_map_fingerprint (hash) << 32) | kvpair;
+}
+
+static inline gsize
+_ide_persistent_map_get_n_slots (gsize n_kvpairs)
+{
+  gsize n_slots = 8;
+
+  /* Keep the load factor at or below 0.5 so probe sequences are short */
+  while (n_slots < n_kvpairs * 2)
+    n_slots <<= 1;
+
+  return n_slots;
+}
+
+G_END_DECLS
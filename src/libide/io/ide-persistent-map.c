@@ -26,6 +26,7 @@
 #include <libide-threading.h>
 
 #include "ide-persistent-map.h"
+#include "ide-persistent-map-private.h"
 
 typedef struct
 {
@@ -49,9 +50,13 @@ struct _IdePersistentMap
   GVariant          *kvpairs_var;
   const KVPair      *kvpairs;
 
+  GVariant          *slots_var;
+  const guint64     *slots;
+
   GVariantDict      *metadata;
 
   gsize              n_kvpairs;
+  gsize              n_slots;
 
   gint32             byte_order;
 
@@ -78,9 +83,10 @@ ide_persistent_map_load_file_worker (IdeTask      *task,
   g_autoptr(GVariant) values = NULL;
   g_autoptr(GVariant) metadata = NULL;
   g_autoptr(GVariant) kvpairs = NULL;
+  g_autoptr(GVariant) slots = NULL;
   g_autoptr(GError) error = NULL;
   g_autoptr(GVariantDict) dict = NULL;
-  gint32 version;
+  gint32 version = 0;
   gsize n_elements;
 
   g_assert (IDE_IS_TASK (task));
@@ -126,13 +132,16 @@ ide_persistent_map_load_file_worker (IdeTask      *task,
 
   dict = g_variant_dict_new (data);
 
-  if (!g_variant_dict_lookup (dict, "version", "i", &version) || version != 2)
+  if (!g_variant_dict_lookup (dict, "version", "i", &version) ||
+      (version != IDE_PERSISTENT_MAP_VERSION_SORTED &&
+       version != IDE_PERSISTENT_MAP_VERSION_HASHED))
     {
       ide_task_return_new_error (task,
                                  G_IO_ERROR,
                                  G_IO_ERROR_INVAL,
-                                 "Version mismatch in gvariant. Got %d, expected 1",
-                                 version);
+                                 "Version mismatch in gvariant. Got %d, expected %d",
+                                 version,
+                                 IDE_PERSISTENT_MAP_VERSION_HASHED);
       return;
     }
 
@@ -156,11 +165,45 @@ ide_persistent_map_load_file_worker (IdeTask      *task,
   self->keys = g_variant_get_fixed_array (keys, &n_elements, sizeof (guint8));
   self->kvpairs = g_variant_get_fixed_array (kvpairs, &self->n_kvpairs, sizeof (KVPair));
 
+  /* The hash table is only usable when it was written with our byte-order,
+   * otherwise we fallback to the binary search used by version 2.
+   */
+  if (version >= IDE_PERSISTENT_MAP_VERSION_HASHED && self->byte_order == G_BYTE_ORDER)
+    {
+      slots = g_variant_dict_lookup_value (dict, "slots", G_VARIANT_TYPE ("at"));
+
+      if (slots == NULL)
+        {
+          ide_task_return_new_error (task,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_INVAL,
+                                     "Invalid GVariant index");
+          return;
+        }
+
+      self->slots = g_variant_get_fixed_array (slots, &self->n_slots, sizeof (guint64));
+
+      /* Must be a power of two with at least one empty slot */
+      if (self->n_slots == 0 ||
+          (self->n_slots & (self->n_slots - 1)) != 0 ||
+          self->n_slots <= self->n_kvpairs)
+        {
+          self->slots = NULL;
+          self->n_slots = 0;
+          ide_task_return_new_error (task,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_INVAL,
+                                     "Invalid GVariant index");
+          return;
+        }
+    }
+
   self->mapped_file = g_steal_pointer (&mapped_file);
   self->data = g_steal_pointer (&data);
   self->keys_var = g_steal_pointer (&keys);
   self->values = g_steal_pointer (&values);
   self->kvpairs_var = g_steal_pointer (&kvpairs);
+  self->slots_var = g_steal_pointer (&slots);
   self->metadata = g_variant_dict_new (metadata);
 
   g_assert (!g_variant_is_floating (self->data));
@@ -271,6 +314,40 @@ ide_persistent_map_lookup_value (IdePersistentMap *self,
   if (self->n_kvpairs == 0)
     return NULL;
 
+  if (self->slots != NULL)
+    {
+      guint64 hash = _ide_persistent_map_hash (key);
+      guint32 fingerprint = _ide_persistent_map_fingerprint (hash);
+      gsize mask = self->n_slots - 1;
+      gsize pos = hash & mask;
+
+      /* Probing terminates because the table always has an empty slot, but
+       * guard against corrupt files by limiting to the table size.
+       */
+      for (gsize i = 0; i < self->n_slots; i++)
+        {
+          guint64 slot = self->slots[pos];
+          guint32 m;
+
+          if (slot == 0)
+            break;
+
+          m = slot & G_MAXUINT32;
+
+          if ((slot >> 32) == fingerprint &&
+              m < self->n_kvpairs &&
+              g_strcmp0 (key, &self->keys [self->kvpairs [m].key]) == 0)
+            {
+              value = g_variant_get_child_value (self->values, self->kvpairs [m].value);
+              break;
+            }
+
+          pos = (pos + 1) & mask;
+        }
+
+      return g_steal_pointer (&value);
+    }
+
   /* unsigned long to signed long */
   r = (gint64)self->n_kvpairs - 1;
   l = 0;
@@ -329,11 +406,13 @@ ide_persistent_map_finalize (GObject *object)
 
   self->keys = NULL;
   self->kvpairs = NULL;
+  self->slots = NULL;
 
   g_clear_pointer (&self->data, g_variant_unref);
   g_clear_pointer (&self->keys_var, g_variant_unref);
   g_clear_pointer (&self->values, g_variant_unref);
   g_clear_pointer (&self->kvpairs_var, g_variant_unref);
+  g_clear_pointer (&self->slots_var, g_variant_unref);
   g_clear_pointer (&self->metadata, g_variant_dict_unref);
   g_clear_pointer (&self->mapped_file, g_mapped_file_unref);
 
@@ -42,6 +42,9 @@
  * kernel memory that is non-pageable and therefore small in size. 4k is what
  * it appears to be. Anything more than that is really just an opportunity for
  * us to break some deadlock scenarios.
+ *
+ * We do read up to this much at a time though, so that a burst of output
+ * from a parallel build is copied across in fewer wakeups.
  */
 #define CHANNEL_BUFFER_SIZE (4096 * 4)
 #define SLAVE_READ_PRIORITY   G_PRIORITY_HIGH
@@ -49,14 +52,24 @@
 #define MASTER_READ_PRIORITY  G_PRIORITY_DEFAULT_IDLE
 #define MASTER_WRITE_PRIORITY G_PRIORITY_HIGH
 
-static void     _ide_pty_intercept_side_close (IdePtyInterceptSide *side);
+static void     _ide_pty_intercept_side_close (IdePtyIntercept     *self,
+                                               IdePtyInterceptSide *side);
 static gboolean _ide_pty_intercept_in_cb      (GIOChannel          *channel,
                                                GIOCondition         condition,
                                                gpointer             user_data);
 static gboolean _ide_pty_intercept_out_cb     (GIOChannel          *channel,
                                                GIOCondition         condition,
                                                gpointer             user_data);
-static void     clear_source                  (guint               *source_id);
+static void     clear_source                  (GMainContext        *main_context,
+                                               guint               *source_id);
+static guint    _g_io_add_watch_full_with_context
+                                              (GMainContext        *main_context,
+                                               GIOChannel          *channel,
+                                               gint                 priority,
+                                               GIOCondition         condition,
+                                               GIOFunc              func,
+                                               gpointer             user_data,
+                                               GDestroyNotify       notify);
 
 static gboolean
 _ide_pty_intercept_set_raw (IdePtyFd fd)
@@ -209,22 +222,35 @@ ide_pty_intercept_create_master (void)
   return pty_fd_steal (&master_fd);
 }
 
+/*
+ * The watches may be attached to a #GMainContext other than the default
+ * (such as one driven by a worker thread), so g_source_remove() cannot
+ * be used to find them.
+ */
 static void
-clear_source (guint *source_id)
+clear_source (GMainContext *main_context,
+              guint        *source_id)
 {
   guint id = *source_id;
   *source_id = 0;
   if (id != 0)
-    g_source_remove (id);
+    {
+      GSource *source = g_main_context_find_source_by_id (main_context, id);
+
+      if (source != NULL)
+        g_source_destroy (source);
+    }
 }
 
 static void
-_ide_pty_intercept_side_close (IdePtyInterceptSide *side)
+_ide_pty_intercept_side_close (IdePtyIntercept     *self,
+                               IdePtyInterceptSide *side)
 {
+  g_assert (self != NULL);
   g_assert (side != NULL);
 
-  clear_source (&side->in_watch);
-  clear_source (&side->out_watch);
+  clear_source (self->main_context, &side->in_watch);
+  clear_source (self->main_context, &side->out_watch);
   g_clear_pointer (&side->channel, g_io_channel_unref);
   g_clear_pointer (&side->out_bytes, g_bytes_unref);
 }
@@ -288,18 +314,19 @@ _ide_pty_intercept_out_cb (GIOChannel   *channel,
    */
   us->out_watch = 0;
   them->in_watch =
-    g_io_add_watch_full (them->channel,
-                         them->read_prio,
-                         G_IO_IN | G_IO_ERR | G_IO_HUP,
-                         _ide_pty_intercept_in_cb,
-                         self, NULL);
+    _g_io_add_watch_full_with_context (self->main_context,
+                                       them->channel,
+                                       them->read_prio,
+                                       G_IO_IN | G_IO_ERR | G_IO_HUP,
+                                       _ide_pty_intercept_in_cb,
+                                       self, NULL);
 
   return G_SOURCE_REMOVE;
 
 close_and_cleanup:
 
-  _ide_pty_intercept_side_close (us);
-  _ide_pty_intercept_side_close (them);
+  _ide_pty_intercept_side_close (self, us);
+  _ide_pty_intercept_side_close (self, them);
 
   return G_SOURCE_REMOVE;
 }
@@ -324,7 +351,7 @@ _ide_pty_intercept_in_cb (GIOChannel   *channel,
   IdePtyIntercept *self = user_data;
   IdePtyInterceptSide *us, *them;
   GIOStatus status = G_IO_STATUS_AGAIN;
-  gchar buf[4096];
+  gchar buf[CHANNEL_BUFFER_SIZE];
   gchar *wrbuf = buf;
   gsize n_read;
 
@@ -382,11 +409,12 @@ _ide_pty_intercept_in_cb (GIOChannel   *channel,
            * to make forward progress.
            */
           them->out_bytes = g_bytes_new (wrbuf, n_read);
-          them->out_watch = g_io_add_watch_full (them->channel,
-                                                 them->write_prio,
-                                                 G_IO_OUT | G_IO_ERR | G_IO_HUP,
-                                                 _ide_pty_intercept_out_cb,
-                                                 self, NULL);
+          them->out_watch = _g_io_add_watch_full_with_context (self->main_context,
+                                                               them->channel,
+                                                               them->write_prio,
+                                                               G_IO_OUT | G_IO_ERR | G_IO_HUP,
+                                                               _ide_pty_intercept_out_cb,
+                                                               self, NULL);
           us->in_watch = 0;
 
           return G_SOURCE_REMOVE;
@@ -402,8 +430,8 @@ _ide_pty_intercept_in_cb (GIOChannel   *channel,
 
 close_and_cleanup:
 
-  _ide_pty_intercept_side_close (us);
-  _ide_pty_intercept_side_close (them);
+  _ide_pty_intercept_side_close (self, us);
+  _ide_pty_intercept_side_close (self, them);
 
   return G_SOURCE_REMOVE;
 }
@@ -482,6 +510,11 @@ _g_io_add_watch_full_with_context (GMainContext   *main_context,
  * with another side, and will pass that information to @fd after
  * extracting any necessary information.
  *
+ * All I/O happens from @main_context, so callbacks registered with
+ * ide_pty_intercept_set_callback() are run on whichever thread is
+ * iterating it. That allows moving the copying of output off of the
+ * UI thread by using a #GMainContext driven by a worker thread.
+ *
  * Returns: %TRUE if successful; otherwise %FALSE
  *
  * Since: 3.32
@@ -523,6 +556,11 @@ ide_pty_intercept_init (IdePtyIntercept *self,
   if (main_context == NULL)
     main_context = g_main_context_get_thread_default ();
 
+  if (main_context == NULL)
+    main_context = g_main_context_default ();
+
+  self->main_context = g_main_context_ref (main_context);
+
   self->master.read_prio = MASTER_READ_PRIORITY;
   self->master.write_prio = MASTER_WRITE_PRIORITY;
   self->slave.read_prio = SLAVE_READ_PRIORITY;
@@ -571,6 +609,9 @@ ide_pty_intercept_init (IdePtyIntercept *self,
  *
  * It is invalid to use @self after calling this function.
  *
+ * If the #GMainContext provided to ide_pty_intercept_init() is iterated
+ * by another thread, that thread must have stopped iterating it first.
+ *
  * Since: 3.32
  */
 void
@@ -578,16 +619,18 @@ ide_pty_intercept_clear (IdePtyIntercept *self)
 {
   g_return_if_fail (IDE_IS_PTY_INTERCEPT (self));
 
-  clear_source (&self->slave.in_watch);
-  clear_source (&self->slave.out_watch);
+  clear_source (self->main_context, &self->slave.in_watch);
+  clear_source (self->main_context, &self->slave.out_watch);
   g_clear_pointer (&self->slave.channel, g_io_channel_unref);
   g_clear_pointer (&self->slave.out_bytes, g_bytes_unref);
 
-  clear_source (&self->master.in_watch);
-  clear_source (&self->master.out_watch);
+  clear_source (self->main_context, &self->master.in_watch);
+  clear_source (self->main_context, &self->master.out_watch);
   g_clear_pointer (&self->master.channel, g_io_channel_unref);
   g_clear_pointer (&self->master.out_bytes, g_bytes_unref);
 
+  g_clear_pointer (&self->main_context, g_main_context_unref);
+
   memset (self, 0, sizeof *self);
 }
 
@@ -59,6 +59,7 @@ struct _IdePtyIntercept
   gsize               magic;
   IdePtyInterceptSide master;
   IdePtyInterceptSide slave;
+  GMainContext       *main_context;
 };
 
 static inline IdePtyFd
@@ -0,0 +1,375 @@
+/* ide-regex.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ide-regex"
+
+#include "config.h"
+
+#include <string.h>
+
+#include "ide-regex-private.h"
+
+/*
+ * These helpers inspect a PCRE pattern (as accepted by GRegex) to find
+ * literal strings that any match must contain. Callers can then use a
+ * cheap substring search to rule out input before running the regex.
+ *
+ * Anything we do not understand results in no literal rather than a
+ * wrong one, since a wrong literal would cause matches to be missed.
+ */
+
+gboolean
+_ide_regex_literal_is_usable (const gchar *literal,
+                              gssize       len,
+                              gboolean     caseless)
+{
+  if (len < 0)
+    len = strlen (literal);
+
+  if (len == 0)
+    return FALSE;
+
+  /* We can only fold case of ASCII without help from GRegex */
+  if (caseless)
+    {
+      for (gssize i = 0; i < len; i++)
+        {
+          if ((guchar)literal[i] >= 0x80)
+            return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static const gchar *
+skip_quantifier (const gchar *p)
+{
+  if (*p == '{')
+    {
+      const gchar *end = strchr (p, '}');
+      p = end ? end + 1 : p + strlen (p);
+    }
+  else if (*p == '*' || *p == '+' || *p == '?')
+    p++;
+
+  /* Lazy and possessive modifiers */
+  if (*p == '?' || *p == '+')
+    p++;
+
+  return p;
+}
+
+static const gchar *
+skip_class (const gchar *p)
+{
+  g_assert (*p == '[');
+
+  p++;
+
+  if (*p == '^')
+    p++;
+
+  /* A leading ] is part of the class */
+  if (*p == ']')
+    p++;
+
+  for (; *p && *p != ']'; p++)
+    {
+      if (*p == '\\' && p[1])
+        p++;
+    }
+
+  return *p ? p + 1 : p;
+}
+
+static const gchar *
+skip_group (const gchar *p)
+{
+  guint depth = 0;
+
+  g_assert (*p == '(');
+
+  for (; *p; p++)
+    {
+      if (*p == '\\' && p[1])
+        p++;
+      else if (*p == '[')
+        p = skip_class (p) - 1;
+      else if (*p == '(')
+        depth++;
+      else if (*p == ')' && --depth == 0)
+        return p + 1;
+    }
+
+  return p;
+}
+
+/* Returns the first '|' or ')' at the current depth, or the trailing NUL */
+static const gchar *
+find_alternation (const gchar *p)
+{
+  for (; *p; p++)
+    {
+      if (*p == '\\' && p[1])
+        p++;
+      else if (*p == '[')
+        p = skip_class (p) - 1;
+      else if (*p == '(')
+        p = skip_group (p) - 1;
+      else if (*p == '|' || *p == ')')
+        break;
+    }
+
+  return p;
+}
+
+/*
+ * Skips the prefix of a group which is always matched, such as a
+ * capturing group name. Returns %NULL for lookaround assertions and
+ * other constructs which do not consume their contents.
+ */
+static const gchar *
+skip_group_prefix (const gchar *p)
+{
+  if (*p != '?')
+    return p;
+
+  p++;
+
+  if (*p == ':' || *p == '>')
+    return p + 1;
+
+  if (*p == 'P' && p[1] == '<')
+    p++;
+
+  if ((*p == '<' && p[1] != '=' && p[1] != '!') || *p == '\'')
+    {
+      gchar close = *p == '<' ? '>' : '\'';
+
+      for (p++; g_ascii_isalnum (*p) || *p == '_'; p++)
+        { /* Do Nothing */ }
+
+      return *p == close ? p + 1 : NULL;
+    }
+
+  return NULL;
+}
+
+/* Escapes which never consume input or always consume exactly one character */
+static gboolean
+is_simple_escape (gchar ch)
+{
+  return strchr ("dDwWsShHvVRXbBAzZGntrfea", ch) != NULL;
+}
+
+/*
+ * Finds the longest run of characters that any match of @branch must
+ * contain. @branch must not contain a top-level alternation.
+ */
+static gchar *
+extract_branch_literal (const gchar *branch,
+                        gsize        len,
+                        gboolean     caseless)
+{
+  g_autofree gchar *copy = g_strndup (branch, len);
+  g_autoptr(GString) best = g_string_new (NULL);
+  g_autoptr(GString) cur = g_string_new (NULL);
+  const gchar *p = copy;
+
+  /* Characters are walked with g_utf8_next_char() */
+  if (!g_utf8_validate (copy, -1, NULL))
+    return NULL;
+
+#define COMMIT(run) \
+  G_STMT_START { \
+    if ((run)->len > best->len && _ide_regex_literal_is_usable ((run)->str, (run)->len, caseless)) \
+      g_string_assign (best, (run)->str); \
+  } G_STMT_END
+#define COMMIT_RUN() \
+  G_STMT_START { \
+    COMMIT (cur); \
+    g_string_truncate (cur, 0); \
+  } G_STMT_END
+
+  while (*p)
+    {
+      const gchar *end;
+      const gchar *inner;
+      const gchar *ch;
+
+      switch (*p)
+        {
+        case '(':
+          COMMIT_RUN ();
+
+          /* A group which must match at least once, and has a single
+           * branch, contributes its own literal.
+           */
+          end = skip_group (p);
+          if (end[-1] == ')' &&
+              (*end == 0 || !strchr ("*?{", *end)) &&
+              (inner = skip_group_prefix (p + 1)) &&
+              inner < end - 1 &&
+              *find_alternation (inner) == ')')
+            {
+              g_autofree gchar *sub = extract_branch_literal (inner, end - 1 - inner, caseless);
+
+              if (sub != NULL)
+                {
+                  g_autoptr(GString) str = g_string_new (sub);
+                  COMMIT (str);
+                }
+            }
+
+          p = skip_quantifier (end);
+          continue;
+
+        case '[':
+          COMMIT_RUN ();
+          p = skip_quantifier (skip_class (p));
+          continue;
+
+        case '.': case '^': case '$':
+          COMMIT_RUN ();
+          p = skip_quantifier (p + 1);
+          continue;
+
+        case '*': case '+': case '?': case '{': case ')':
+          /* Not something we understand, don't risk a wrong answer */
+          return NULL;
+
+        case '\\':
+          if (p[1] == 0)
+            return NULL;
+
+          if (g_ascii_isalnum (p[1]))
+            {
+              /* Escapes such as \x41 or \Q...\E would require parsing
+               * their arguments, so only allow those without any.
+               */
+              if (!is_simple_escape (p[1]))
+                return NULL;
+
+              COMMIT_RUN ();
+              p = skip_quantifier (p + 2);
+              continue;
+            }
+
+          ch = p + 1;
+          p = g_utf8_next_char (ch);
+          break;
+
+        default:
+          ch = p;
+          p = g_utf8_next_char (ch);
+          break;
+        }
+
+      if (*p == '*' || *p == '?' || *p == '{')
+        {
+          /* The character is optional (or we don't know how many times it
+           * must appear), so it ends the run without being part of it.
+           * Quantifiers apply to the whole character, not its last byte.
+           */
+          COMMIT_RUN ();
+          p = skip_quantifier (p);
+          continue;
+        }
+
+      g_string_append_len (cur, ch, p - ch);
+
+      if (*p == '+')
+        {
+          COMMIT_RUN ();
+          p = skip_quantifier (p);
+        }
+    }
+
+  COMMIT_RUN ();
+
+#undef COMMIT_RUN
+#undef COMMIT
+
+  if (best->len == 0)
+    return NULL;
+
+  return g_string_free (g_steal_pointer (&best), FALSE);
+}
+
+/**
+ * _ide_regex_extract_literals:
+ * @pattern: a regular expression
+ * @caseless: if the regex will be compiled with %G_REGEX_CASELESS
+ *
+ * Finds a set of literals such that every match of @pattern contains at
+ * least one of them. There is one literal for each top-level branch of
+ * @pattern.
+ *
+ * When @caseless is set, the literals only contain ASCII and should be
+ * compared with ASCII case folding.
+ *
+ * Returns: (transfer full) (nullable): a %NULL-terminated array of
+ *   literals, or %NULL if they could not be determined.
+ */
+gchar **
+_ide_regex_extract_literals (const gchar *pattern,
+                             gboolean     caseless)
+{
+  g_autoptr(GPtrArray) literals = NULL;
+  const gchar *branch;
+
+  g_return_val_if_fail (pattern != NULL, NULL);
+
+  /* Inline options may change case sensitivity or whitespace handling,
+   * so don't guess. Named and non-capturing groups are fine.
+   */
+  for (const gchar *p = pattern; (p = strstr (p, "(?")); p += 2)
+    {
+      if (p[2] != 0 && strchr ("imsxJUX-", p[2]))
+        return NULL;
+    }
+
+  literals = g_ptr_array_new_with_free_func (g_free);
+  branch = pattern;
+
+  for (;;)
+    {
+      const gchar *end = find_alternation (branch);
+      gchar *literal;
+
+      if (*end == ')')
+        return NULL;
+
+      if (!(literal = extract_branch_literal (branch, end - branch, caseless)))
+        return NULL;
+
+      g_ptr_array_add (literals, literal);
+
+      if (*end == 0)
+        break;
+
+      branch = end + 1;
+    }
+
+  g_ptr_array_add (literals, NULL);
+
+  return (gchar **)g_ptr_array_free (g_steal_pointer (&literals), FALSE);
+}
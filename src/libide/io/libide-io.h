@@ -27,6 +27,7 @@ G_BEGIN_DECLS
 
 #define IDE_IO_INSIDE
 
+#include "ide-content-search.h"
 #include "ide-content-type.h"
 #include "ide-gfile.h"
 #include "ide-line-reader.h"
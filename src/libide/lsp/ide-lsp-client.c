@@ -50,6 +50,31 @@ typedef struct
   GCancellable *cancellable;
 } PendingMessage;
 
+typedef struct
+{
+  gint line;
+  gint column;
+} ChangePosition;
+
+typedef struct
+{
+  /* Range replaced, relative to the document after previous changes */
+  ChangePosition  begin;
+  ChangePosition  end;
+  gint            length;
+
+  /* Where the inserted text ends once the change has been applied */
+  ChangePosition  after;
+
+  GString        *text;
+} ContentChange;
+
+typedef struct
+{
+  IdeBuffer *buffer;
+  GArray    *changes;
+} DocumentChanges;
+
 typedef struct
 {
   DzlSignalGroup *buffer_manager_signals;
@@ -63,6 +88,8 @@ typedef struct
   gchar          *root_uri;
   gboolean        initialized;
   GQueue          pending_messages;
+  GHashTable     *pending_changes;
+  guint           flush_changes_source;
 } IdeLspClientPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (IdeLspClient, ide_lsp_client, IDE_TYPE_OBJECT)
@@ -104,9 +131,13 @@ enum {
   N_SIGNALS
 };
 
-static void ide_lsp_client_call_cb (GObject      *object,
-                                    GAsyncResult *result,
-                                    gpointer      user_data);
+/* How long to wait for more edits before notifying the server */
+#define FLUSH_CHANGES_DELAY_MSEC 50
+
+static void ide_lsp_client_call_cb       (GObject      *object,
+                                          GAsyncResult *result,
+                                          gpointer      user_data);
+static void ide_lsp_client_flush_changes (IdeLspClient *self);
 
 static GParamSpec *properties [N_PROPS];
 static guint signals [N_SIGNALS];
@@ -186,6 +217,115 @@ pending_message_submit (PendingMessage *message,
   g_slice_free (PendingMessage, message);
 }
 
+static void
+content_change_clear (gpointer data)
+{
+  ContentChange *change = data;
+
+  if (change->text != NULL)
+    g_string_free (g_steal_pointer (&change->text), TRUE);
+}
+
+static void
+document_changes_free (DocumentChanges *doc)
+{
+  g_clear_object (&doc->buffer);
+  g_clear_pointer (&doc->changes, g_array_unref);
+  g_slice_free (DocumentChanges, doc);
+}
+
+static inline gboolean
+change_position_equal (const ChangePosition *a,
+                       const ChangePosition *b)
+{
+  return a->line == b->line && a->column == b->column;
+}
+
+static ChangePosition
+change_position_advance (ChangePosition  pos,
+                         const gchar    *text,
+                         gssize          len)
+{
+  const gchar *end = text + len;
+
+  /* Line breaks must match what GtkTextBuffer considers a line break */
+  for (const gchar *iter = text; iter < end; iter = g_utf8_next_char (iter))
+    {
+      gunichar ch = g_utf8_get_char (iter);
+
+      if (ch == '\r' && iter + 1 < end && iter[1] == '\n')
+        continue;
+
+      if (ch == '\n' || ch == '\r' || ch == 0x2029)
+        {
+          pos.line++;
+          pos.column = 0;
+        }
+      else
+        {
+          pos.column++;
+        }
+    }
+
+  return pos;
+}
+
+static void
+document_changes_add (DocumentChanges *doc,
+                      ContentChange   *change)
+{
+  ContentChange *last = NULL;
+
+  g_assert (doc != NULL);
+  g_assert (change != NULL);
+
+  if (doc->changes->len > 0)
+    last = &g_array_index (doc->changes, ContentChange, doc->changes->len - 1);
+
+  if (last != NULL && last->length == 0 && change->length == 0 &&
+      change_position_equal (&change->begin, &last->after))
+    {
+      /* Typing more text after the previous insertion */
+      g_string_append_len (last->text, change->text->str, change->text->len);
+      last->after = change->after;
+      content_change_clear (change);
+      return;
+    }
+
+  if (last != NULL && last->text->len == 0 && change->text->len == 0 &&
+      change_position_equal (&change->end, &last->begin))
+    {
+      /* Deleting backwards from the previous deletion */
+      last->begin = change->begin;
+      last->after = change->after;
+      last->length += change->length;
+      content_change_clear (change);
+      return;
+    }
+
+  if (last != NULL && last->length == 0 && change->text->len == 0 &&
+      change_position_equal (&change->end, &last->after) &&
+      change->length <= (gint)g_utf8_strlen (last->text->str, last->text->len))
+    {
+      const gchar *tail = last->text->str + last->text->len;
+
+      /* Deleting text that was just inserted, such as correcting a typo */
+      for (gint i = 0; i < change->length; i++)
+        tail = g_utf8_prev_char (tail);
+
+      g_string_truncate (last->text, tail - last->text->str);
+      last->after = change->begin;
+      content_change_clear (change);
+
+      if (last->text->len == 0)
+        g_array_set_size (doc->changes, doc->changes->len - 1);
+
+      return;
+    }
+
+  g_array_append_vals (doc->changes, change, 1);
+}
+
 static gboolean
 ide_lsp_client_supports_buffer (IdeLspClient *self,
                                 IdeBuffer    *buffer)
@@ -267,109 +407,253 @@ ide_lsp_client_buffer_saved (IdeLspClient     *self,
   IDE_EXIT;
 }
 
-/*
- * TODO: This should all be delayed and buffered so we coalesce multiple
- *       events into a single dispatch.
- */
-
-static void
-ide_lsp_client_buffer_insert_text (IdeLspClient *self,
-                                   GtkTextIter  *location,
-                                   const gchar  *new_text,
-                                   gint          len,
-                                   IdeBuffer    *buffer)
+static gint64
+ide_lsp_client_get_text_document_sync (IdeLspClient *self)
 {
-  g_autoptr(GVariant) params = NULL;
-  g_autofree gchar *uri = NULL;
-  GVariant *capabilities = NULL;
-  gint64 version;
+  GVariant *capabilities;
   gint64 text_document_sync = TEXT_DOCUMENT_SYNC_NONE;
 
-  IDE_ENTRY;
+  g_assert (IDE_IS_LSP_CLIENT (self));
+
+  capabilities = ide_lsp_client_get_server_capabilities (self);
+
+  if (capabilities != NULL)
+    {
+      gint64 tds = 0;
+
+      // for backwards compatibility reasons LS can stick to a number instead of the structure
+      if (JSONRPC_MESSAGE_PARSE (capabilities, "textDocumentSync", JSONRPC_MESSAGE_GET_INT64 (&tds))
+          | JSONRPC_MESSAGE_PARSE (capabilities, "textDocumentSync", "{", "change", JSONRPC_MESSAGE_GET_INT64 (&tds), "}"))
+        {
+          text_document_sync = tds;
+        }
+    }
+
+  return text_document_sync;
+}
+
+static gboolean
+ide_lsp_client_flush_changes_cb (gpointer data)
+{
+  IdeLspClient *self = data;
+  IdeLspClientPrivate *priv = ide_lsp_client_get_instance_private (self);
+
+  g_assert (IDE_IS_LSP_CLIENT (self));
+
+  priv->flush_changes_source = 0;
+
+  ide_lsp_client_flush_changes (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+ide_lsp_client_queue_change (IdeLspClient  *self,
+                             IdeBuffer     *buffer,
+                             ContentChange *change)
+{
+  IdeLspClientPrivate *priv = ide_lsp_client_get_instance_private (self);
+  DocumentChanges *doc;
+  gint64 text_document_sync;
 
   g_assert (IDE_IS_MAIN_THREAD ());
   g_assert (IDE_IS_LSP_CLIENT (self));
-  g_assert (location != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (change != NULL);
 
-  capabilities = ide_lsp_client_get_server_capabilities (self);
-  if (capabilities != NULL) {
-    gint64 tds = 0;
-
-    // for backwards compatibility reasons LS can stick to a number instead of the structure
-    if (JSONRPC_MESSAGE_PARSE (capabilities, "textDocumentSync", JSONRPC_MESSAGE_GET_INT64 (&tds))
-        | JSONRPC_MESSAGE_PARSE (capabilities, "textDocumentSync", "{", "change", JSONRPC_MESSAGE_GET_INT64 (&tds), "}"))
-      {
-        text_document_sync = tds;
-      }
-  }
+  text_document_sync = ide_lsp_client_get_text_document_sync (self);
 
-  uri = ide_buffer_dup_uri (buffer);
+  if (text_document_sync == TEXT_DOCUMENT_SYNC_NONE)
+    {
+      content_change_clear (change);
+      return;
+    }
 
-  /* We get called before this change is registered */
-  version = (gint64)ide_buffer_get_change_count (buffer) + 1;
+  if (!(doc = g_hash_table_lookup (priv->pending_changes, buffer)))
+    {
+      doc = g_slice_new0 (DocumentChanges);
+      doc->buffer = g_object_ref (buffer);
+      doc->changes = g_array_new (FALSE, FALSE, sizeof (ContentChange));
+      g_array_set_clear_func (doc->changes, content_change_clear);
+      g_hash_table_insert (priv->pending_changes, buffer, doc);
+    }
 
+  /* Full synchronization sends a single snapshot of the buffer when the
+   * changes are flushed, so there is no need to track individual edits.
+   */
   if (text_document_sync == TEXT_DOCUMENT_SYNC_INCREMENTAL)
-    {
-      g_autofree gchar *copy = NULL;
-      gint line;
-      gint column;
+    document_changes_add (doc, change);
+  else
+    content_change_clear (change);
+
+  if (priv->flush_changes_source == 0)
+    priv->flush_changes_source =
+      g_timeout_add_full (G_PRIORITY_DEFAULT,
+                          FLUSH_CHANGES_DELAY_MSEC,
+                          ide_lsp_client_flush_changes_cb,
+                          self,
+                          NULL);
+}
+
+static GVariant *
+ide_lsp_client_build_did_change (IdeLspClient    *self,
+                                 DocumentChanges *doc,
+                                 gint64           text_document_sync)
+{
+  g_autofree gchar *uri = NULL;
+  GVariantBuilder builder;
+  gint64 version;
 
-      copy = g_strndup (new_text, len);
+  g_assert (IDE_IS_LSP_CLIENT (self));
+  g_assert (doc != NULL);
+  g_assert (IDE_IS_BUFFER (doc->buffer));
 
-      line = gtk_text_iter_get_line (location);
-      column = gtk_text_iter_get_line_offset (location);
+  uri = ide_buffer_dup_uri (doc->buffer);
 
-      params = JSONRPC_MESSAGE_NEW (
-        "textDocument", "{",
-          "uri", JSONRPC_MESSAGE_PUT_STRING (uri),
-          "version", JSONRPC_MESSAGE_PUT_INT64 (version),
-        "}",
-        "contentChanges", "[",
-          "{",
-            "range", "{",
-              "start", "{",
-                "line", JSONRPC_MESSAGE_PUT_INT64 (line),
-                "character", JSONRPC_MESSAGE_PUT_INT64 (column),
-              "}",
-              "end", "{",
-                "line", JSONRPC_MESSAGE_PUT_INT64 (line),
-                "character", JSONRPC_MESSAGE_PUT_INT64 (column),
+  /* All of the changes have been applied to the buffer by now */
+  version = (gint64)ide_buffer_get_change_count (doc->buffer);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
+
+  if (text_document_sync == TEXT_DOCUMENT_SYNC_INCREMENTAL)
+    {
+      for (guint i = 0; i < doc->changes->len; i++)
+        {
+          const ContentChange *change = &g_array_index (doc->changes, ContentChange, i);
+
+          g_variant_builder_add (&builder, "v",
+            JSONRPC_MESSAGE_NEW (
+              "range", "{",
+                "start", "{",
+                  "line", JSONRPC_MESSAGE_PUT_INT64 (change->begin.line),
+                  "character", JSONRPC_MESSAGE_PUT_INT64 (change->begin.column),
+                "}",
+                "end", "{",
+                  "line", JSONRPC_MESSAGE_PUT_INT64 (change->end.line),
+                  "character", JSONRPC_MESSAGE_PUT_INT64 (change->end.column),
+                "}",
               "}",
-            "}",
-            "rangeLength", JSONRPC_MESSAGE_PUT_INT64 (0),
-            "text", JSONRPC_MESSAGE_PUT_STRING (copy),
-          "}",
-        "]");
+              "rangeLength", JSONRPC_MESSAGE_PUT_INT64 (change->length),
+              "text", JSONRPC_MESSAGE_PUT_STRING (change->text->str)
+            ));
+        }
+
+      if (doc->changes->len == 0)
+        {
+          g_variant_builder_clear (&builder);
+          return NULL;
+        }
     }
   else if (text_document_sync == TEXT_DOCUMENT_SYNC_FULL)
     {
       g_autoptr(GBytes) content = NULL;
       const gchar *text;
-      g_autoptr(GString) str = NULL;
 
-      content = ide_buffer_dup_content (buffer);
+      content = ide_buffer_dup_content (doc->buffer);
       text = (const gchar *)g_bytes_get_data (content, NULL);
-      str = g_string_new (text);
-      g_string_insert_len (str, gtk_text_iter_get_offset (location), new_text, len);
 
-      params = JSONRPC_MESSAGE_NEW (
-        "textDocument", "{",
-          "uri", JSONRPC_MESSAGE_PUT_STRING (uri),
-          "version", JSONRPC_MESSAGE_PUT_INT64 (version),
-        "}",
-        "contentChanges", "[",
-          "{",
-            "text", JSONRPC_MESSAGE_PUT_STRING (str->str),
-          "}",
-        "]");
+      g_variant_builder_add (&builder, "v",
+        JSONRPC_MESSAGE_NEW (
+          "text", JSONRPC_MESSAGE_PUT_STRING (text)
+        ));
+    }
+  else
+    {
+      g_variant_builder_clear (&builder);
+      return NULL;
     }
 
+  return JSONRPC_MESSAGE_NEW (
+    "textDocument", "{",
+      "uri", JSONRPC_MESSAGE_PUT_STRING (uri),
+      "version", JSONRPC_MESSAGE_PUT_INT64 (version),
+    "}",
+    "contentChanges", JSONRPC_MESSAGE_PUT_VARIANT (g_variant_builder_end (&builder))
+  );
+}
+
+/*
+ * Changes to buffers are queued and coalesced so that a burst of edits
+ * (such as pasting or reformatting) results in a single didChange per
+ * document. The queue is flushed after a short delay, and before any other
+ * message is sent to the server so that it always sees the latest content.
+ */
+static void
+ide_lsp_client_flush_changes (IdeLspClient *self)
+{
+  IdeLspClientPrivate *priv = ide_lsp_client_get_instance_private (self);
+  g_autoptr(GHashTable) pending = NULL;
+  GHashTableIter iter;
+  gint64 text_document_sync;
+  gpointer value;
 
-  ide_lsp_client_send_notification_async (self,
-                                          "textDocument/didChange",
-                                          params,
-                                          NULL, NULL, NULL);
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_LSP_CLIENT (self));
+
+  g_clear_handle_id (&priv->flush_changes_source, g_source_remove);
+
+  if (priv->pending_changes == NULL || g_hash_table_size (priv->pending_changes) == 0)
+    IDE_EXIT;
+
+  /* Swap the queue out first, as sending the notifications below will
+   * re-enter this function.
+   */
+  pending = g_steal_pointer (&priv->pending_changes);
+  priv->pending_changes = g_hash_table_new_full (NULL, NULL, NULL,
+                                                 (GDestroyNotify)document_changes_free);
+
+  text_document_sync = ide_lsp_client_get_text_document_sync (self);
+
+  g_hash_table_iter_init (&iter, pending);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      DocumentChanges *doc = value;
+      g_autoptr(GVariant) params = NULL;
+
+      if (!(params = ide_lsp_client_build_did_change (self, doc, text_document_sync)))
+        continue;
+
+      IDE_TRACE_MSG ("Sending %u coalesced changes", doc->changes->len);
+
+      ide_lsp_client_send_notification_async (self,
+                                              "textDocument/didChange",
+                                              params,
+                                              NULL, NULL, NULL);
+    }
+
+  IDE_EXIT;
+}
+
+static void
+ide_lsp_client_buffer_insert_text (IdeLspClient *self,
+                                   GtkTextIter  *location,
+                                   const gchar  *new_text,
+                                   gint          len,
+                                   IdeBuffer    *buffer)
+{
+  ContentChange change;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_LSP_CLIENT (self));
+  g_assert (location != NULL);
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  if (len < 0)
+    len = strlen (new_text);
+
+  change.begin.line = gtk_text_iter_get_line (location);
+  change.begin.column = gtk_text_iter_get_line_offset (location);
+  change.end = change.begin;
+  change.length = 0;
+  change.after = change_position_advance (change.begin, new_text, len);
+  change.text = g_string_new_len (new_text, len);
+
+  ide_lsp_client_queue_change (self, buffer, &change);
 
   IDE_EXIT;
 }
@@ -380,17 +664,9 @@ ide_lsp_client_buffer_delete_range (IdeLspClient *self,
                                     GtkTextIter  *end_iter,
                                     IdeBuffer    *buffer)
 {
-
-  g_autoptr(GVariant) params = NULL;
-  g_autofree gchar *uri = NULL;
+  ContentChange change;
   GtkTextIter copy_begin;
   GtkTextIter copy_end;
-  struct {
-    gint line;
-    gint column;
-  } begin, end;
-  gint version;
-  gint length;
 
   IDE_ENTRY;
 
@@ -400,49 +676,19 @@ ide_lsp_client_buffer_delete_range (IdeLspClient *self,
   g_assert (end_iter != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
 
-  uri = ide_buffer_dup_uri (buffer);
-
-  /* We get called before this change is registered */
-  version = (gint)ide_buffer_get_change_count (buffer) + 1;
-
   copy_begin = *begin_iter;
   copy_end = *end_iter;
   gtk_text_iter_order (&copy_begin, &copy_end);
 
-  begin.line = gtk_text_iter_get_line (&copy_begin);
-  begin.column = gtk_text_iter_get_line_offset (&copy_begin);
-
-  end.line = gtk_text_iter_get_line (&copy_end);
-  end.column = gtk_text_iter_get_line_offset (&copy_end);
+  change.begin.line = gtk_text_iter_get_line (&copy_begin);
+  change.begin.column = gtk_text_iter_get_line_offset (&copy_begin);
+  change.end.line = gtk_text_iter_get_line (&copy_end);
+  change.end.column = gtk_text_iter_get_line_offset (&copy_end);
+  change.length = gtk_text_iter_get_offset (&copy_end) - gtk_text_iter_get_offset (&copy_begin);
+  change.after = change.begin;
+  change.text = g_string_new (NULL);
 
-  length = gtk_text_iter_get_offset (&copy_end) - gtk_text_iter_get_offset (&copy_begin);
-
-  params = JSONRPC_MESSAGE_NEW (
-    "textDocument", "{",
-      "uri", JSONRPC_MESSAGE_PUT_STRING (uri),
-      "version", JSONRPC_MESSAGE_PUT_INT64 (version),
-    "}",
-    "contentChanges", "[",
-      "{",
-        "range", "{",
-          "start", "{",
-            "line", JSONRPC_MESSAGE_PUT_INT64 (begin.line),
-            "character", JSONRPC_MESSAGE_PUT_INT64 (begin.column),
-          "}",
-          "end", "{",
-            "line", JSONRPC_MESSAGE_PUT_INT64 (end.line),
-            "character", JSONRPC_MESSAGE_PUT_INT64 (end.column),
-          "}",
-        "}",
-        "rangeLength", JSONRPC_MESSAGE_PUT_INT64 (length),
-        "text", JSONRPC_MESSAGE_PUT_STRING (""),
-      "}",
-    "]");
-
-  ide_lsp_client_send_notification_async (self,
-                                          "textDocument/didChange",
-                                          params,
-                                          NULL, NULL, NULL);
+  ide_lsp_client_queue_change (self, buffer, &change);
 
   IDE_EXIT;
 }
@@ -1097,6 +1343,11 @@ ide_lsp_client_dispose (GObject *object)
 
   g_assert (IDE_IS_MAIN_THREAD ());
 
+  g_clear_handle_id (&priv->flush_changes_source, g_source_remove);
+
+  if (priv->pending_changes != NULL)
+    g_hash_table_remove_all (priv->pending_changes);
+
   while (priv->pending_messages.length > 0)
     {
       PendingMessage *message = priv->pending_messages.head->data;
@@ -1117,6 +1368,7 @@ ide_lsp_client_finalize (GObject *object)
   g_assert (IDE_IS_MAIN_THREAD ());
 
   g_clear_pointer (&priv->diagnostics_by_file, g_hash_table_unref);
+  g_clear_pointer (&priv->pending_changes, g_hash_table_unref);
   g_clear_pointer (&priv->server_capabilities, g_variant_unref);
   g_clear_pointer (&priv->languages, g_ptr_array_unref);
   g_clear_pointer (&priv->root_uri, g_free);
@@ -1335,6 +1587,9 @@ ide_lsp_client_init (IdeLspClient *self)
                                                      g_object_unref,
                                                      (GDestroyNotify)g_object_unref);
 
+  priv->pending_changes = g_hash_table_new_full (NULL, NULL, NULL,
+                                                 (GDestroyNotify)document_changes_free);
+
   priv->buffer_manager_signals = dzl_signal_group_new (IDE_TYPE_BUFFER_MANAGER);
 
   dzl_signal_group_connect_object (priv->buffer_manager_signals,
@@ -1733,6 +1988,8 @@ ide_lsp_client_stop (IdeLspClient *self)
 
   if (priv->rpc_client != NULL)
     {
+      ide_lsp_client_flush_changes (self);
+
       jsonrpc_client_call_async (priv->rpc_client,
                                  "shutdown",
                                  NULL,
@@ -1838,6 +2095,9 @@ ide_lsp_client_call_async (IdeLspClient        *self,
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
   g_return_if_fail (!priv->rpc_client || JSONRPC_IS_CLIENT (priv->rpc_client));
 
+  /* Make sure the server has seen all edits before our request */
+  ide_lsp_client_flush_changes (self);
+
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_source_tag (task, ide_lsp_client_call_async);
 
@@ -1945,6 +2205,8 @@ ide_lsp_client_send_notification_async (IdeLspClient        *self,
   g_return_if_fail (method != NULL);
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
+  ide_lsp_client_flush_changes (self);
+
   task = ide_task_new (self, cancellable, notificationback, user_data);
   ide_task_set_source_tag (task, ide_lsp_client_send_notification_async);
 
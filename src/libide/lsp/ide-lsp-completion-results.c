@@ -139,21 +139,15 @@ list_model_iface_init (GListModelInterface *iface)
   iface->get_item_type = ide_lsp_completion_results_get_item_type;
 }
 
-static gint
-compare_items (const Item *a,
-               const Item *b)
-{
-  return (gint)a->priority - (gint)b->priority;
-}
-
 void
 ide_lsp_completion_results_refilter (IdeLspCompletionResults *self,
                                           const gchar                  *typed_text)
 {
+  g_autoptr(GPtrArray) labels = NULL;
+  g_autoptr(GArray) matches = NULL;
   g_autofree gchar *query = NULL;
   GVariantIter iter;
   GVariant *node;
-  guint index = 0;
   guint old_len;
 
   g_return_if_fail (IDE_IS_LSP_COMPLETION_RESULTS (self));
@@ -180,27 +174,33 @@ ide_lsp_completion_results_refilter (IdeLspCompletionResults *self,
     }
 
   query = g_utf8_casefold (typed_text, -1);
+  labels = g_ptr_array_sized_new (g_variant_n_children (self->results));
 
+  /* Labels point into self->results and remain valid while we hold it */
   g_variant_iter_init (&iter, self->results);
-
-  while (g_variant_iter_loop (&iter, "v", &node))
+  while ((node = g_variant_iter_next_value (&iter)))
     {
-      const gchar *label;
-      guint priority;
-
-      if (!g_variant_lookup (node, "label", "&s", &label))
-        continue;
+      g_autoptr(GVariant) unboxed = g_variant_get_variant (node);
+      const gchar *label = NULL;
 
-      if (ide_completion_fuzzy_match (label, query, &priority))
-        {
-          Item item = { .index = index, .priority = priority };
-          g_array_append_val (self->items, item);
-        }
+      g_variant_lookup (unboxed, "label", "&s", &label);
+      g_ptr_array_add (labels, (gchar *)label);
 
-      index++;
+      g_variant_unref (node);
     }
 
-  g_array_sort (self->items, (GCompareFunc)compare_items);
+  matches = ide_completion_fuzzy_match_batch ((const gchar * const *)labels->pdata,
+                                              labels->len,
+                                              query,
+                                              0);
+
+  for (guint i = 0; i < matches->len; i++)
+    {
+      const IdeCompletionFuzzyMatch *match = &g_array_index (matches, IdeCompletionFuzzyMatch, i);
+      Item item = { .index = match->index, .priority = match->priority };
+
+      g_array_append_val (self->items, item);
+    }
 
-  g_list_model_items_changed (G_LIST_MODEL (self), 0, old_len, index);
+  g_list_model_items_changed (G_LIST_MODEL (self), 0, old_len, self->items->len);
 }
@@ -1642,32 +1642,115 @@ _ide_completion_set_font_description (IdeCompletion              *self,
     }
 }
 
-/**
- * ide_completion_fuzzy_match:
- * @haystack: (nullable): the string to be searched.
- * @casefold_needle: A g_utf8_casefold() version of the needle.
- * @priority: (out) (allow-none): An optional location for the score of the match
- *
- * This helper function can do a fuzzy match for you giving a haystack and
- * casefolded needle. Casefold your needle using g_utf8_casefold() before
- * running the query.
- *
- * Score will be set with the score of the match upon success. Otherwise,
- * it will be set to zero.
- *
- * Returns: %TRUE if @haystack matched @casefold_needle, otherwise %FALSE.
- *
- * Since: 3.32
+#define FUZZY_ONES G_GUINT64_CONSTANT (0x0101010101010101)
+#define FUZZY_LOW7 G_GUINT64_CONSTANT (0x7f7f7f7f7f7f7f7f)
+
+static gboolean
+fuzzy_is_ascii (const gchar *str,
+                gsize       *len)
+{
+  const gchar *begin = str;
+
+  for (; *str; str++)
+    {
+      if (*str & 0x80)
+        return FALSE;
+    }
+
+  *len = str - begin;
+
+  return TRUE;
+}
+
+/*
+ * Sets the high bit of every byte in @word which is zero. Unlike the
+ * cheaper (x - 0x01..) & ~x & 0x80.. form this has no false positives,
+ * so it does not matter which end of the word we look at first.
  */
-gboolean
-ide_completion_fuzzy_match (const gchar *haystack,
-                            const gchar *casefold_needle,
-                            guint       *priority)
+static inline guint64
+fuzzy_zero_bytes (guint64 word)
 {
-  gint real_score = 0;
+  return ~(((word & FUZZY_LOW7) + FUZZY_LOW7) | word | FUZZY_LOW7);
+}
 
-  if (haystack == NULL || haystack[0] == 0)
-    return FALSE;
+/*
+ * Locates the first byte of @haystack which is either @lower or @upper,
+ * testing eight bytes per iteration. We never read past @len, so this is
+ * safe for strings at the end of a page or inside a packed arena.
+ */
+static inline const gchar *
+fuzzy_find_ascii (const gchar *haystack,
+                  const gchar *end,
+                  guint8       lower,
+                  guint8       upper)
+{
+  const guint64 lower_mask = FUZZY_ONES * lower;
+  const guint64 upper_mask = FUZZY_ONES * upper;
+
+  for (; end - haystack >= 8; haystack += 8)
+    {
+      guint64 word;
+
+      memcpy (&word, haystack, sizeof word);
+
+      if (fuzzy_zero_bytes (word ^ lower_mask) | fuzzy_zero_bytes (word ^ upper_mask))
+        break;
+    }
+
+  for (; haystack < end; haystack++)
+    {
+      guint8 ch = *haystack;
+
+      if (ch == lower || ch == upper)
+        return haystack;
+    }
+
+  return NULL;
+}
+
+/*
+ * This is the same algorithm as fuzzy_match_utf8() (and must produce the
+ * same scores) but for the common case of an ASCII needle. Since UTF-8
+ * never uses ASCII bytes within a multi-byte sequence, @haystack may
+ * still contain any UTF-8.
+ */
+static gboolean
+fuzzy_match_ascii (const gchar *haystack,
+                   gsize        haystack_len,
+                   const gchar *casefold_needle,
+                   guint       *priority)
+{
+  const gchar *end = haystack + haystack_len;
+  guint real_score = 0;
+
+  for (; *casefold_needle; casefold_needle++)
+    {
+      guint8 ch = *casefold_needle;
+      guint8 chup = g_ascii_toupper (ch);
+      const gchar *tmp;
+
+      if (!(tmp = fuzzy_find_ascii (haystack, end, ch, chup)))
+        return FALSE;
+
+      real_score += (tmp - haystack) * 2;
+
+      if ((guint8)*haystack == chup)
+        real_score += 1;
+
+      haystack = tmp + 1;
+    }
+
+  *priority = real_score + (end - haystack);
+
+  return TRUE;
+}
+
+static gboolean
+fuzzy_match_utf8 (const gchar *haystack,
+                  const gchar *casefold_needle,
+                  guint       *priority)
+{
+  gint real_score = 0;
 
   for (; *casefold_needle; casefold_needle = g_utf8_next_char (casefold_needle))
     {
@@ -1721,12 +1804,201 @@ ide_completion_fuzzy_match (const gchar *haystack,
       haystack = tmp + 1;
     }
 
-  if (priority != NULL)
-    *priority = real_score + strlen (haystack);
+  *priority = real_score + strlen (haystack);
 
   return TRUE;
 }
 
+/**
+ * ide_completion_fuzzy_match:
+ * @haystack: (nullable): the string to be searched.
+ * @casefold_needle: A g_utf8_casefold() version of the needle.
+ * @priority: (out) (allow-none): An optional location for the score of the match
+ *
+ * This helper function can do a fuzzy match for you giving a haystack and
+ * casefolded needle. Casefold your needle using g_utf8_casefold() before
+ * running the query.
+ *
+ * Score will be set with the score of the match upon success. Otherwise,
+ * it will be set to zero.
+ *
+ * If you are matching many haystacks against the same needle, use
+ * ide_completion_fuzzy_match_batch() instead.
+ *
+ * Returns: %TRUE if @haystack matched @casefold_needle, otherwise %FALSE.
+ *
+ * Since: 3.32
+ */
+gboolean
+ide_completion_fuzzy_match (const gchar *haystack,
+                            const gchar *casefold_needle,
+                            guint       *priority)
+{
+  guint real_priority = 0;
+  gsize needle_len;
+  gboolean ret;
+
+  if (haystack == NULL || haystack[0] == 0)
+    return FALSE;
+
+  if (fuzzy_is_ascii (casefold_needle, &needle_len))
+    ret = fuzzy_match_ascii (haystack, strlen (haystack), casefold_needle, &real_priority);
+  else
+    ret = fuzzy_match_utf8 (haystack, casefold_needle, &real_priority);
+
+  if (ret && priority != NULL)
+    *priority = real_priority;
+
+  return ret;
+}
+
+static gint
+fuzzy_match_compare (gconstpointer a,
+                     gconstpointer b)
+{
+  const IdeCompletionFuzzyMatch *ma = a;
+  const IdeCompletionFuzzyMatch *mb = b;
+
+  if (ma->priority < mb->priority)
+    return -1;
+  else if (ma->priority > mb->priority)
+    return 1;
+  else if (ma->index < mb->index)
+    return -1;
+  else if (ma->index > mb->index)
+    return 1;
+  else
+    return 0;
+}
+
+/*
+ * @heap is a max-heap of the best matches so far, so the root is the
+ * match to be evicted when a better one comes along.
+ */
+static void
+fuzzy_heap_push (GArray                        *heap,
+                 guint                          max_results,
+                 const IdeCompletionFuzzyMatch *match)
+{
+  IdeCompletionFuzzyMatch *items;
+  guint pos;
+
+  if (heap->len < max_results)
+    {
+      g_array_append_val (heap, *match);
+      items = (IdeCompletionFuzzyMatch *)(gpointer)heap->data;
+
+      for (pos = heap->len - 1; pos > 0; )
+        {
+          guint parent = (pos - 1) / 2;
+
+          if (fuzzy_match_compare (&items[parent], &items[pos]) >= 0)
+            break;
+
+          items[pos] = items[parent];
+          items[parent] = *match;
+          pos = parent;
+        }
+
+      return;
+    }
+
+  items = (IdeCompletionFuzzyMatch *)(gpointer)heap->data;
+
+  if (fuzzy_match_compare (match, &items[0]) >= 0)
+    return;
+
+  items[0] = *match;
+
+  for (pos = 0;;)
+    {
+      guint child = pos * 2 + 1;
+
+      if (child >= heap->len)
+        break;
+
+      if (child + 1 < heap->len &&
+          fuzzy_match_compare (&items[child + 1], &items[child]) > 0)
+        child++;
+
+      if (fuzzy_match_compare (&items[child], &items[pos]) <= 0)
+        break;
+
+      items[pos] = items[child];
+      items[child] = *match;
+      pos = child;
+    }
+}
+
+/**
+ * ide_completion_fuzzy_match_batch:
+ * @haystacks: (array length=n_haystacks) (nullable): the strings to be searched,
+ *   which may contain %NULL elements
+ * @n_haystacks: the number of elements in @haystacks
+ * @casefold_needle: A g_utf8_casefold() version of the needle.
+ * @max_results: the maximum number of matches to return, or 0 for no limit
+ *
+ * Scores every element of @haystacks against @casefold_needle in the same
+ * manner as ide_completion_fuzzy_match().
+ *
+ * This is much faster than calling ide_completion_fuzzy_match() for each
+ * element when filtering large result sets, as the needle is inspected
+ * once and ASCII needles are matched several bytes at a time. When
+ * @max_results is non-zero, only the best @max_results matches are kept
+ * which avoids sorting matches the user will never see.
+ *
+ * Returns: (transfer full) (element-type IdeCompletionFuzzyMatch): a #GArray
+ *   of #IdeCompletionFuzzyMatch sorted by priority, then by index.
+ *
+ * Since: 3.40
+ */
+GArray *
+ide_completion_fuzzy_match_batch (const gchar * const *haystacks,
+                                  guint                n_haystacks,
+                                  const gchar         *casefold_needle,
+                                  guint                max_results)
+{
+  GArray *ret;
+  gsize needle_len = 0;
+  gboolean is_ascii;
+
+  g_return_val_if_fail (haystacks != NULL || n_haystacks == 0, NULL);
+  g_return_val_if_fail (casefold_needle != NULL, NULL);
+
+  ret = g_array_sized_new (FALSE, FALSE, sizeof (IdeCompletionFuzzyMatch),
+                           max_results ? MIN (max_results, n_haystacks) : 0);
+  is_ascii = fuzzy_is_ascii (casefold_needle, &needle_len);
+
+  for (guint i = 0; i < n_haystacks; i++)
+    {
+      const gchar *haystack = haystacks[i];
+      IdeCompletionFuzzyMatch match = { i, 0 };
+
+      if (haystack == NULL || haystack[0] == 0)
+        continue;
+
+      if (is_ascii)
+        {
+          gsize haystack_len = strlen (haystack);
+
+          if (haystack_len < needle_len ||
+              !fuzzy_match_ascii (haystack, haystack_len, casefold_needle, &match.priority))
+            continue;
+        }
+      else if (!fuzzy_match_utf8 (haystack, casefold_needle, &match.priority))
+        continue;
+
+      if (max_results == 0)
+        g_array_append_val (ret, match);
+      else
+        fuzzy_heap_push (ret, max_results, &match);
+    }
+
+  g_array_sort (ret, fuzzy_match_compare);
+
+  return ret;
+}
+
 /**
  * ide_completion_fuzzy_highlight:
  * @haystack: the string to be highlighted
@@ -34,6 +34,19 @@ G_BEGIN_DECLS
 
 #define IDE_TYPE_COMPLETION (ide_completion_get_type())
 
+/**
+ * IdeCompletionFuzzyMatch:
+ * @index: the position of the matched haystack in the batch
+ * @priority: the score of the match, lower is better
+ *
+ * Since: 3.40
+ */
+typedef struct
+{
+  guint index;
+  guint priority;
+} IdeCompletionFuzzyMatch;
+
 IDE_AVAILABLE_IN_3_32
 G_DECLARE_FINAL_TYPE (IdeCompletion, ide_completion, IDE, COMPLETION, GObject)
 
@@ -74,6 +87,11 @@ IDE_AVAILABLE_IN_3_32
 gboolean              ide_completion_fuzzy_match          (const gchar           *haystack,
                                                            const gchar           *casefold_needle,
                                                            guint                 *priority);
+IDE_AVAILABLE_IN_3_40
+GArray               *ide_completion_fuzzy_match_batch    (const gchar * const   *haystacks,
+                                                           guint                  n_haystacks,
+                                                           const gchar           *casefold_needle,
+                                                           guint                  max_results);
 IDE_AVAILABLE_IN_3_32
 gchar                *ide_completion_fuzzy_highlight      (const gchar           *haystack,
                                                            const gchar           *casefold_query);
@@ -32,6 +32,7 @@
 #include <string.h>
 
 #include "ide-buffer-private.h"
+#include "ide-highlight-engine-private.h"
 
 #include "ide-completion-private.h"
 #include "ide-completion.h"
@@ -1266,6 +1267,7 @@ ide_source_view_bind_buffer (IdeSourceView  *self,
 {
   IdeSourceViewPrivate *priv = ide_source_view_get_instance_private (self);
   g_autoptr(IdeContext) context = NULL;
+  IdeHighlightEngine *engine;
   GtkTextMark *insert;
   IdeObjectBox *box;
   GtkTextIter iter;
@@ -1279,10 +1281,17 @@ ide_source_view_bind_buffer (IdeSourceView  *self,
 
   priv->buffer = buffer;
 
+  /* Highlight what we display before the rest of the buffer */
+  if ((engine = _ide_buffer_get_highlight_engine (buffer)))
+    _ide_highlight_engine_add_view (engine, GTK_TEXT_VIEW (self));
+
   ide_source_view_reset_definition_highlight (self);
 
   ide_buffer_hold (buffer);
 
+  if (gtk_widget_has_focus (GTK_WIDGET (self)))
+    _ide_buffer_set_has_focus (buffer, TRUE);
+
   if (ide_buffer_get_loading (buffer))
     {
       block_interactive (self);
@@ -1336,6 +1345,7 @@ ide_source_view_unbind_buffer (IdeSourceView  *self,
                                DzlSignalGroup *group)
 {
   IdeSourceViewPrivate *priv = ide_source_view_get_instance_private (self);
+  IdeHighlightEngine *engine;
 
   IDE_ENTRY;
 
@@ -1345,6 +1355,9 @@ ide_source_view_unbind_buffer (IdeSourceView  *self,
   if (priv->buffer == NULL)
     IDE_EXIT;
 
+  if ((engine = _ide_buffer_get_highlight_engine (priv->buffer)))
+    _ide_highlight_engine_remove_view (engine, GTK_TEXT_VIEW (self));
+
   priv->scroll_mark = NULL;
 
   if (priv->completion_blocked)
@@ -1363,6 +1376,9 @@ ide_source_view_unbind_buffer (IdeSourceView  *self,
   g_clear_object (&priv->definition_highlight_start_mark);
   g_clear_object (&priv->definition_highlight_end_mark);
 
+  if (gtk_widget_has_focus (GTK_WIDGET (self)))
+    _ide_buffer_set_has_focus (priv->buffer, FALSE);
+
   ide_buffer_release (priv->buffer);
 
   IDE_EXIT;
@@ -4101,6 +4117,9 @@ ide_source_view_focus_in_event (GtkWidget     *widget,
   if (priv->highlight_current_line)
     gtk_source_view_set_highlight_current_line (GTK_SOURCE_VIEW (self), TRUE);
 
+  if (priv->buffer != NULL)
+    _ide_buffer_set_has_focus (priv->buffer, TRUE);
+
   ret = GTK_WIDGET_CLASS (ide_source_view_parent_class)->focus_in_event (widget, event);
 
   return ret;
@@ -4121,6 +4140,9 @@ ide_source_view_focus_out_event (GtkWidget     *widget,
    */
   ide_source_view_real_save_insert_mark (self);
 
+  if (priv->buffer != NULL)
+    _ide_buffer_set_has_focus (priv->buffer, FALSE);
+
   ret = GTK_WIDGET_CLASS (ide_source_view_parent_class)->focus_out_event (widget, event);
 
   /*
@@ -24,6 +24,12 @@
 
 #include <libide-core.h>
 
+#ifdef __linux__
+# include <sys/resource.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
 #include "ide-thread-pool.h"
 #include "ide-thread-private.h"
 
@@ -50,16 +56,37 @@ struct _IdeThreadPool
   guint              max_threads;
   guint              worker_max_threads;
   gboolean           exclusive;
+  gboolean           background;
+  guint              limit;
 };
 
+/* A max_threads of zero means "half of the available processors" so that
+ * indexing can scale with the machine while leaving room for the UI and
+ * any interactive work such as completion or diagnostics.
+ *
+ * Background pools must be exclusive, as their threads have their priority
+ * lowered and we cannot raise it again to share them with other pools.
+ * Exclusive pools start without any thread and grow towards their limit
+ * as work is queued, so that idle processes do not keep parked threads.
+ */
 static IdeThreadPool thread_pools[] = {
-  { NULL, IDE_THREAD_POOL_DEFAULT, 10, 1, FALSE },
-  { NULL, IDE_THREAD_POOL_COMPILER, 2, 2, FALSE },
-  { NULL, IDE_THREAD_POOL_INDEXER,  1, 1, FALSE },
-  { NULL, IDE_THREAD_POOL_IO,       8, 1, FALSE },
-  { NULL, IDE_THREAD_POOL_LAST,     0, 0, FALSE }
+  { NULL, IDE_THREAD_POOL_DEFAULT, 10, 1, FALSE, FALSE },
+  { NULL, IDE_THREAD_POOL_COMPILER, 2, 2, FALSE, FALSE },
+  { NULL, IDE_THREAD_POOL_INDEXER,  0, 0, TRUE,  TRUE },
+  { NULL, IDE_THREAD_POOL_IO,       8, 1, FALSE, FALSE },
+  { NULL, IDE_THREAD_POOL_LAST,     0, 0, FALSE, FALSE }
 };
 
+/* Nice value and I/O class used for threads of background pools */
+#define BACKGROUND_NICE     10
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_CLASS_SHIFT  13
+
+static GPrivate background_thread;
+
+G_LOCK_DEFINE_STATIC (exclusive_pools);
+
 enum {
   TYPE_TASK,
   TYPE_FUNC,
@@ -75,6 +102,22 @@ ide_thread_pool_get_pool (IdeThreadPoolKind kind)
   return thread_pools [kind].pool;
 }
 
+static void
+ide_thread_pool_maybe_grow (IdeThreadPoolKind kind)
+{
+  IdeThreadPool *p = &thread_pools [kind];
+  guint max_threads;
+
+  if (!p->exclusive || g_thread_pool_unprocessed (p->pool) == 0)
+    return;
+
+  G_LOCK (exclusive_pools);
+  max_threads = g_thread_pool_get_max_threads (p->pool);
+  if (max_threads < p->limit)
+    g_thread_pool_set_max_threads (p->pool, max_threads + 1, NULL);
+  G_UNLOCK (exclusive_pools);
+}
+
 /**
  * ide_thread_pool_push_task:
  * @kind: The task kind.
@@ -113,6 +156,7 @@ ide_thread_pool_push_task (IdeThreadPoolKind  kind,
       work_item->task.func = func;
 
       g_thread_pool_push (pool, work_item, NULL);
+      ide_thread_pool_maybe_grow (kind);
     }
   else
     {
@@ -178,6 +222,7 @@ ide_thread_pool_push_with_priority (IdeThreadPoolKind kind,
       work_item->func.data = func_data;
 
       g_thread_pool_push (pool, work_item, NULL);
+      ide_thread_pool_maybe_grow (kind);
     }
   else
     {
@@ -187,13 +232,57 @@ ide_thread_pool_push_with_priority (IdeThreadPoolKind kind,
   IDE_EXIT;
 }
 
+static guint
+ide_thread_pool_get_default_max_threads (void)
+{
+  return MAX (1, g_get_num_processors () / 2);
+}
+
+static void
+ide_thread_pool_lower_priority (void)
+{
+  /* Only do this once per thread, since threads are reused by the pool
+   * and the priority sticks to the thread.
+   */
+  if (g_private_get (&background_thread) != NULL)
+    return;
+
+  g_private_set (&background_thread, GINT_TO_POINTER (TRUE));
+
+#ifdef __linux__
+  {
+    /* On Linux, these apply to the calling thread rather than the whole
+     * process when given the thread id, which is what we want here.
+     */
+    pid_t tid = syscall (SYS_gettid);
+    gint nice_value = getpriority (PRIO_PROCESS, tid);
+
+    if (nice_value < BACKGROUND_NICE)
+      setpriority (PRIO_PROCESS, tid, BACKGROUND_NICE);
+
+# ifdef SYS_ioprio_set
+    syscall (SYS_ioprio_set,
+             IOPRIO_WHO_PROCESS,
+             tid,
+             IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+# endif
+  }
+#endif
+}
+
 static void
 ide_thread_pool_worker (gpointer data,
                         gpointer user_data)
 {
+  IdeThreadPool *p = user_data;
   WorkItem *work_item = data;
 
   g_assert (work_item != NULL);
+  g_assert (p != NULL);
+  g_assert (!p->background || p->exclusive);
+
+  if (p->background)
+    ide_thread_pool_lower_priority ();
 
   if (work_item->type == TYPE_TASK)
     {
@@ -214,6 +303,80 @@ ide_thread_pool_worker (gpointer data,
   g_slice_free (WorkItem, work_item);
 }
 
+/**
+ * ide_thread_pool_set_max_threads:
+ * @kind: the threadpool kind to use.
+ * @max_threads: the max number of threads, or 0 for the default
+ *
+ * Changes the number of threads that may run concurrently for the
+ * threadpool denoted by @kind.
+ *
+ * This is generally used by worker processes which want to scale the
+ * number of indexer threads based on user preferences. If @max_threads
+ * is 0, half of the available processors will be used.
+ *
+ * Since: 3.40
+ */
+void
+ide_thread_pool_set_max_threads (IdeThreadPoolKind kind,
+                                 guint             max_threads)
+{
+  GThreadPool *pool;
+
+  g_return_if_fail (kind >= 0);
+  g_return_if_fail (kind < IDE_THREAD_POOL_LAST);
+
+  if (max_threads == 0)
+    max_threads = ide_thread_pool_get_default_max_threads ();
+
+  if (!(pool = ide_thread_pool_get_pool (kind)))
+    return;
+
+  if (thread_pools [kind].exclusive)
+    {
+      G_LOCK (exclusive_pools);
+      thread_pools [kind].limit = max_threads;
+      if (g_thread_pool_get_max_threads (pool) > max_threads)
+        g_thread_pool_set_max_threads (pool, max_threads, NULL);
+      G_UNLOCK (exclusive_pools);
+
+      ide_thread_pool_maybe_grow (kind);
+    }
+  else
+    {
+      g_thread_pool_set_max_threads (pool, max_threads, NULL);
+    }
+}
+
+/**
+ * ide_thread_pool_get_max_threads:
+ * @kind: the threadpool kind to use.
+ *
+ * Gets the number of threads that may run concurrently for the threadpool
+ * denoted by @kind.
+ *
+ * Returns: the max number of threads
+ *
+ * Since: 3.40
+ */
+guint
+ide_thread_pool_get_max_threads (IdeThreadPoolKind kind)
+{
+  GThreadPool *pool;
+
+  g_return_val_if_fail (kind >= 0, 0);
+  g_return_val_if_fail (kind < IDE_THREAD_POOL_LAST, 0);
+
+  if ((pool = ide_thread_pool_get_pool (kind)))
+    {
+      if (thread_pools [kind].exclusive)
+        return MAX (1, thread_pools [kind].limit);
+      return MAX (1, g_thread_pool_get_max_threads (pool));
+    }
+
+  return 1;
+}
+
 static gint
 thread_pool_sort_func (gconstpointer a,
                        gconstpointer b,
@@ -238,10 +401,15 @@ _ide_thread_pool_init (gboolean is_worker)
         {
           IdeThreadPool *p = &thread_pools[kind];
           g_autoptr(GError) error = NULL;
+          guint max_threads;
+
+          if (!(max_threads = is_worker ? p->worker_max_threads : p->max_threads))
+            max_threads = ide_thread_pool_get_default_max_threads ();
 
+          p->limit = max_threads;
           p->pool = g_thread_pool_new (ide_thread_pool_worker,
-                                       NULL,
-                                       is_worker ? p->worker_max_threads : p->max_threads,
+                                       p,
+                                       p->exclusive ? 0 : max_threads,
                                        p->exclusive,
                                        &error);
           g_thread_pool_set_sort_function (p->pool, thread_pool_sort_func, NULL);
@@ -50,17 +50,22 @@ typedef enum
 typedef void (*IdeThreadFunc) (gpointer user_data);
 
 IDE_AVAILABLE_IN_3_32
-void ide_thread_pool_push               (IdeThreadPoolKind  kind,
-                                         IdeThreadFunc      func,
-                                         gpointer           func_data);
+void  ide_thread_pool_push               (IdeThreadPoolKind  kind,
+                                          IdeThreadFunc      func,
+                                          gpointer           func_data);
 IDE_AVAILABLE_IN_3_32
-void ide_thread_pool_push_with_priority (IdeThreadPoolKind  kind,
-                                         gint               priority,
-                                         IdeThreadFunc      func,
-                                         gpointer           func_data);
+void  ide_thread_pool_push_with_priority (IdeThreadPoolKind  kind,
+                                          gint               priority,
+                                          IdeThreadFunc      func,
+                                          gpointer           func_data);
 IDE_AVAILABLE_IN_3_32
-void ide_thread_pool_push_task          (IdeThreadPoolKind  kind,
-                                         GTask             *task,
-                                         GTaskThreadFunc    func);
+void  ide_thread_pool_push_task          (IdeThreadPoolKind  kind,
+                                          GTask             *task,
+                                          GTaskThreadFunc    func);
+IDE_AVAILABLE_IN_3_40
+void  ide_thread_pool_set_max_threads    (IdeThreadPoolKind  kind,
+                                          guint              max_threads);
+IDE_AVAILABLE_IN_3_40
+guint ide_thread_pool_get_max_threads    (IdeThreadPoolKind  kind);
 
 G_END_DECLS
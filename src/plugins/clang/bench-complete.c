@@ -0,0 +1,199 @@
+/* bench-complete.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <jsonrpc-glib.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ide-clang-completion-results.h"
+
+/*
+ * Measures the size of clang/complete replies and the time until the first
+ * proposal could be displayed for a member completion on a
+ * std::vector<std::string>. Each configuration is run once cold (which
+ * includes parsing the translation unit) and several times warm.
+ */
+
+#define N_WARM_RUNS 5
+
+static const gchar source[] =
+  "#include <string>\n"
+  "#include <vector>\n"
+  "\n"
+  "int\n"
+  "main (void)\n"
+  "{\n"
+  "  std::vector<std::string> v;\n"
+  "  v.\n"
+  "}\n";
+
+typedef struct
+{
+  const gchar *name;
+  const gchar *prefix;
+  guint        max_results;
+} Config;
+
+static const Config configs[] = {
+  { "unfiltered", "", 0 },
+  { "prefix", "e", 0 },
+  { "truncated", "", 25 },
+};
+
+static JsonrpcClient *client;
+static GMainLoop *main_loop;
+static gchar *path;
+static const Config *config;
+static guint config_pos;
+static guint run;
+static gint64 begin;
+
+static void next_request (void);
+
+static void
+complete_cb (GObject      *object,
+             GAsyncResult *result,
+             gpointer      user_data)
+{
+  g_autoptr(GVariant) reply = NULL;
+  g_autoptr(GError) error = NULL;
+  IdeClangCompletionResults view;
+  const gchar *first = NULL;
+  gint64 replied;
+  gint64 decoded;
+
+  if (!jsonrpc_client_call_finish (JSONRPC_CLIENT (object), result, &reply, &error))
+    g_error ("complete: %s", error->message);
+
+  replied = g_get_monotonic_time ();
+
+  if (!ide_clang_completion_results_init (&view, reply))
+    g_error ("complete: invalid reply");
+
+  if (view.n_records > 0)
+    first = ide_clang_completion_results_get_string (&view, view.records[0].keyword);
+
+  decoded = g_get_monotonic_time ();
+
+  g_print ("{\"config\": \"%s\", \"run\": \"%s\", \"bytes\": %"G_GSIZE_FORMAT", "
+           "\"results\": %"G_GSIZE_FORMAT", \"total\": %u, \"truncated\": %s, "
+           "\"reply_msec\": %.3lf, \"first_proposal_msec\": %.3lf, \"first\": \"%s\"}\n",
+           config->name,
+           run == 0 ? "cold" : "warm",
+           g_variant_get_size (reply),
+           view.n_records,
+           view.total,
+           view.truncated ? "true" : "false",
+           (replied - begin) / 1000.0,
+           (decoded - begin) / 1000.0,
+           first ? first : "");
+
+  run++;
+
+  next_request ();
+}
+
+static void
+next_request (void)
+{
+  g_autoptr(GVariant) params = NULL;
+
+  if (config == NULL || run > N_WARM_RUNS)
+    {
+      if (config_pos >= G_N_ELEMENTS (configs))
+        {
+          g_main_loop_quit (main_loop);
+          return;
+        }
+
+      config = &configs[config_pos++];
+      run = 0;
+    }
+
+  params = JSONRPC_MESSAGE_NEW (
+    "path", JSONRPC_MESSAGE_PUT_STRING (path),
+    "flags", "[", "-xc++", "-std=c++17", "]",
+    "line", JSONRPC_MESSAGE_PUT_INT64 (8),
+    "column", JSONRPC_MESSAGE_PUT_INT64 (5),
+    "prefix", JSONRPC_MESSAGE_PUT_STRING (config->prefix),
+    "maxResults", JSONRPC_MESSAGE_PUT_INT64 (config->max_results)
+  );
+
+  begin = g_get_monotonic_time ();
+
+  jsonrpc_client_call_async (client, "clang/complete", params, NULL, complete_cb, NULL);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GSubprocess) subprocess = NULL;
+  g_autoptr(GIOStream) stream = NULL;
+  g_autoptr(GError) error = NULL;
+  gint fd;
+
+  if (argc != 2)
+    {
+      g_printerr ("usage: %s path-to-daemon\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (-1 == (fd = g_file_open_tmp ("bench-complete-XXXXXX.cpp", &path, &error)) ||
+      !g_file_set_contents (path, source, -1, &error))
+    {
+      g_printerr ("Failed to create source file: %s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  close (fd);
+
+  subprocess = g_subprocess_new (G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_PIPE,
+                                 &error,
+                                 argv[1],
+                                 NULL);
+
+  if (subprocess == NULL)
+    {
+      g_printerr ("Failed to spawn daemon: %s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+  stream = g_simple_io_stream_new (g_subprocess_get_stdout_pipe (subprocess),
+                                   g_subprocess_get_stdin_pipe (subprocess));
+  client = jsonrpc_client_new (stream);
+  jsonrpc_client_set_use_gvariant (client, TRUE);
+
+  next_request ();
+
+  g_main_loop_run (main_loop);
+
+  g_subprocess_force_exit (subprocess);
+  g_unlink (path);
+  g_clear_pointer (&path, g_free);
+  g_clear_object (&client);
+
+  return EXIT_SUCCESS;
+}
@@ -643,9 +643,11 @@ handle_complete (JsonrpcServer *server,
   g_autoptr(ClientOp) op = NULL;
   g_auto(GStrv) flags = NULL;
   const gchar *path;
+  const gchar *prefix = NULL;
   gboolean r;
   gint64 line = 0;
   gint64 column = 0;
+  gint64 max_results = 0;
 
   g_assert (JSONRPC_IS_SERVER (server));
   g_assert (JSONRPC_IS_CLIENT (client));
@@ -668,11 +670,19 @@ handle_complete (JsonrpcServer *server,
       return;
     }
 
+  /* Optional, used to filter and truncate results before transfer */
+  if (!JSONRPC_MESSAGE_PARSE (params, "prefix", JSONRPC_MESSAGE_GET_STRING (&prefix)))
+    prefix = NULL;
+  if (!JSONRPC_MESSAGE_PARSE (params, "maxResults", JSONRPC_MESSAGE_GET_INT64 (&max_results)))
+    max_results = 0;
+
   ide_clang_complete_async (clang,
                             path,
                             line,
                             column,
                             (const gchar * const *)flags,
+                            prefix,
+                            CLAMP (max_results, 0, G_MAXUINT),
                             op->cancellable,
                             (GAsyncReadyCallback)handle_complete_cb,
                             client_op_ref (op));
@@ -689,13 +699,22 @@ handle_get_highlight_index_cb (IdeClang     *clang,
   g_autoptr(IdeHighlightIndex) index = NULL;
   g_autoptr(GVariant) ret = NULL;
   g_autoptr(GError) error = NULL;
+  g_autofree gchar *cache_path = NULL;
 
   g_assert (IDE_IS_CLANG (clang));
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (op != NULL);
 
-  if ((index = ide_clang_get_highlight_index_finish (clang, result, &error)))
-    ret = ide_highlight_index_to_variant (index);
+  /* Prefer handing the client a path to the mappable form of the index
+   * and only fallback to serializing the whole thing over the wire.
+   */
+  if ((index = ide_clang_get_highlight_index_finish (clang, result, &cache_path, &error)))
+    {
+      if (cache_path != NULL)
+        ret = JSONRPC_MESSAGE_NEW ("highlight-index", JSONRPC_MESSAGE_PUT_STRING (cache_path));
+      else
+        ret = ide_highlight_index_to_variant (index);
+    }
 
   if (!ret)
     client_op_error (op, error);
@@ -795,6 +814,8 @@ handle_initialize (JsonrpcServer *server,
 {
   g_autoptr(ClientOp) op = NULL;
   const gchar *uri = NULL;
+  gint64 cache_size = 0;
+  gint64 indexer_threads = 0;
 
   g_assert (JSONRPC_IS_SERVER (server));
   g_assert (JSONRPC_IS_CLIENT (client));
@@ -811,9 +832,47 @@ handle_initialize (JsonrpcServer *server,
       ide_clang_set_workdir (clang, file);
     }
 
+  if (JSONRPC_MESSAGE_PARSE (params,
+        "initializationOptions", "{",
+          "unitCacheSize", JSONRPC_MESSAGE_GET_INT64 (&cache_size),
+        "}"))
+    ide_clang_set_cache_size (clang, MAX (0, cache_size));
+
+  if (JSONRPC_MESSAGE_PARSE (params,
+        "initializationOptions", "{",
+          "indexerThreads", JSONRPC_MESSAGE_GET_INT64 (&indexer_threads),
+        "}"))
+    ide_thread_pool_set_max_threads (IDE_THREAD_POOL_INDEXER,
+                                     CLAMP (indexer_threads, 0, G_MAXINT));
+
   client_op_reply (op, NULL);
 }
 
+/* Get Cache Stats {{{1 */
+
+static void
+handle_get_cache_stats (JsonrpcServer *server,
+                        JsonrpcClient *client,
+                        const gchar   *method,
+                        GVariant      *id,
+                        GVariant      *params,
+                        IdeClang      *clang)
+{
+  g_autoptr(ClientOp) op = NULL;
+  g_autoptr(GVariant) stats = NULL;
+
+  g_assert (JSONRPC_IS_SERVER (server));
+  g_assert (JSONRPC_IS_CLIENT (client));
+  g_assert (g_str_equal (method, "clang/getCacheStats"));
+  g_assert (id != NULL);
+  g_assert (IDE_IS_CLANG (clang));
+
+  op = client_op_new (client, id);
+  stats = ide_clang_get_cache_stats (clang);
+
+  client_op_reply (op, stats);
+}
+
 /* Cancel Request {{{1 */
 
 static void
@@ -930,6 +989,7 @@ main (gint argc,
   ADD_HANDLER ("clang/indexFile", handle_index_file);
   ADD_HANDLER ("clang/locateSymbol", handle_locate_symbol);
   ADD_HANDLER ("clang/getHighlightIndex", handle_get_highlight_index);
+  ADD_HANDLER ("clang/getCacheStats", handle_get_cache_stats);
   ADD_HANDLER ("clang/setBuffer", handle_set_buffer);
   ADD_HANDLER ("$/cancelRequest", handle_cancel_request);
 
@@ -41,9 +41,14 @@ struct _IdeClangClient
   JsonrpcClient            *rpc_client;
   GFile                    *root_uri;
   GHashTable               *seq_by_file;
+  GHashTable               *highlight_indexes;
+  GQueue                    highlight_lru;
   gint                      state;
 };
 
+/* Number of mapped highlight indexes to keep around for other buffers */
+#define MAX_HIGHLIGHT_INDEXES 32
+
 enum {
   STATE_INITIAL,
   STATE_SPAWNING,
@@ -171,6 +176,8 @@ ide_clang_client_subprocess_spawned (IdeClangClient          *self,
                                      IdeSubprocess           *subprocess,
                                      IdeSubprocessSupervisor *supervisor)
 {
+  g_autoptr(GSettings) settings = NULL;
+  g_autoptr(GSettings) insight_settings = NULL;
   g_autoptr(GIOStream) stream = NULL;
   g_autoptr(GVariant) params = NULL;
   g_autofree gchar *path = NULL;
@@ -178,6 +185,8 @@ ide_clang_client_subprocess_spawned (IdeClangClient          *self,
   GOutputStream *output;
   GInputStream *input;
   GList *queued;
+  guint cache_size;
+  guint indexer_threads;
   gint fd;
 
   IDE_ENTRY;
@@ -223,11 +232,20 @@ ide_clang_client_subprocess_spawned (IdeClangClient          *self,
 
   uri = g_file_get_uri (self->root_uri);
   path = g_file_get_path (self->root_uri);
+  settings = g_settings_new ("org.gnome.builder.clang");
+  cache_size = g_settings_get_uint (settings, "unit-cache-size");
+  insight_settings = g_settings_new ("org.gnome.builder.code-insight");
+  indexer_threads = g_settings_get_uint (insight_settings, "indexer-workers");
+
   params = JSONRPC_MESSAGE_NEW (
     "rootUri", JSONRPC_MESSAGE_PUT_STRING (uri),
     "rootPath", JSONRPC_MESSAGE_PUT_STRING (path),
     "processId", JSONRPC_MESSAGE_PUT_INT64 (getpid ()),
-    "capabilities", "{", "}"
+    "capabilities", "{", "}",
+    "initializationOptions", "{",
+      "unitCacheSize", JSONRPC_MESSAGE_PUT_INT64 ((gint64)cache_size * 1024 * 1024),
+      "indexerThreads", JSONRPC_MESSAGE_PUT_INT64 (indexer_threads),
+    "}"
   );
 
   jsonrpc_client_call_async (self->rpc_client,
@@ -394,6 +412,9 @@ ide_clang_client_destroy (IdeObject *object)
   if (self->seq_by_file != NULL)
     g_hash_table_remove_all (self->seq_by_file);
 
+  g_hash_table_remove_all (self->highlight_indexes);
+  g_queue_clear_full (&self->highlight_lru, g_free);
+
   if (self->supervisor != NULL)
     {
       g_autoptr(IdeSubprocessSupervisor) supervisor = g_steal_pointer (&self->supervisor);
@@ -430,6 +451,8 @@ ide_clang_client_finalize (GObject *object)
   IdeClangClient *self = (IdeClangClient *)object;
 
   g_clear_pointer (&self->seq_by_file, g_hash_table_unref);
+  g_clear_pointer (&self->highlight_indexes, g_hash_table_unref);
+  g_queue_clear_full (&self->highlight_lru, g_free);
   g_clear_object (&self->rpc_client);
   g_clear_object (&self->root_uri);
   g_clear_object (&self->supervisor);
@@ -456,6 +479,9 @@ ide_clang_client_class_init (IdeClangClientClass *klass)
 static void
 ide_clang_client_init (IdeClangClient *self)
 {
+  /* Keys are owned by highlight_lru */
+  self->highlight_indexes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                                   (GDestroyNotify)ide_highlight_index_unref);
 }
 
 static void
@@ -1161,6 +1187,53 @@ ide_clang_client_diagnose_finish (IdeClangClient  *self,
   return ide_task_propagate_pointer (IDE_TASK (result), error);
 }
 
+static IdeHighlightIndex *
+ide_clang_client_load_highlight_index (IdeClangClient  *self,
+                                       const gchar     *path,
+                                       GError         **error)
+{
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  IdeHighlightIndex *index;
+  GList *link;
+
+  g_assert (IDE_IS_CLANG_CLIENT (self));
+  g_assert (path != NULL);
+
+  /* The daemon names indexes by their contents, so buffers sharing the
+   * same includes end up sharing a single mapping of the index.
+   */
+  if ((index = g_hash_table_lookup (self->highlight_indexes, path)))
+    {
+      link = g_queue_find_custom (&self->highlight_lru, path, (GCompareFunc)g_strcmp0);
+      g_queue_unlink (&self->highlight_lru, link);
+      g_queue_push_head_link (&self->highlight_lru, link);
+
+      return ide_highlight_index_ref (index);
+    }
+
+  if (!(mf = g_mapped_file_new (path, FALSE, error)))
+    return NULL;
+
+  bytes = g_mapped_file_get_bytes (mf);
+
+  if (!(index = ide_highlight_index_new_from_bytes (bytes, error)))
+    return NULL;
+
+  link = g_list_alloc ();
+  link->data = g_strdup (path);
+  g_queue_push_head_link (&self->highlight_lru, link);
+  g_hash_table_insert (self->highlight_indexes, link->data, ide_highlight_index_ref (index));
+
+  if (self->highlight_lru.length > MAX_HIGHLIGHT_INDEXES)
+    {
+      g_autofree gchar *oldest = g_queue_pop_tail (&self->highlight_lru);
+      g_hash_table_remove (self->highlight_indexes, oldest);
+    }
+
+  return index;
+}
+
 static void
 ide_clang_client_get_highlight_index_cb (GObject      *object,
                                          GAsyncResult *result,
@@ -1170,17 +1243,33 @@ ide_clang_client_get_highlight_index_cb (GObject      *object,
   g_autoptr(GVariant) reply = NULL;
   g_autoptr(IdeTask) task = user_data;
   g_autoptr(GError) error = NULL;
+  const gchar *path = NULL;
+  IdeHighlightIndex *index;
 
   g_assert (IDE_IS_CLANG_CLIENT (self));
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (IDE_IS_TASK (task));
 
   if (!ide_clang_client_call_finish (self, result, &reply, &error))
-    ide_task_return_error (task, g_steal_pointer (&error));
+    {
+      ide_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  if (JSONRPC_MESSAGE_PARSE (reply, "highlight-index", JSONRPC_MESSAGE_GET_STRING (&path)))
+    {
+      if (!(index = ide_clang_client_load_highlight_index (self, path, &error)))
+        {
+          ide_task_return_error (task, g_steal_pointer (&error));
+          return;
+        }
+    }
   else
-    ide_task_return_pointer (task,
-                             ide_highlight_index_new_from_variant (reply),
-                             ide_highlight_index_unref);
+    {
+      index = ide_highlight_index_new_from_variant (reply);
+    }
+
+  ide_task_return_pointer (task, index, ide_highlight_index_unref);
 }
 
 void
@@ -1266,6 +1355,8 @@ ide_clang_client_complete_async (IdeClangClient      *self,
                                  const gchar * const *flags,
                                  guint                line,
                                  guint                column,
+                                 const gchar         *prefix,
+                                 guint                max_results,
                                  GCancellable        *cancellable,
                                  GAsyncReadyCallback  callback,
                                  gpointer             user_data)
@@ -1299,7 +1390,9 @@ ide_clang_client_complete_async (IdeClangClient      *self,
     "path", JSONRPC_MESSAGE_PUT_STRING (path),
     "flags", JSONRPC_MESSAGE_PUT_STRV (flags),
     "line", JSONRPC_MESSAGE_PUT_INT64 (line),
-    "column", JSONRPC_MESSAGE_PUT_INT64 (column)
+    "column", JSONRPC_MESSAGE_PUT_INT64 (column),
+    "prefix", JSONRPC_MESSAGE_PUT_STRING (prefix ?: ""),
+    "maxResults", JSONRPC_MESSAGE_PUT_INT64 (max_results)
   );
 
   ide_clang_client_call_async (self,
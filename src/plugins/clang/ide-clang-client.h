@@ -112,6 +112,8 @@ void               ide_clang_client_complete_async             (IdeClangClient
                                                                 const gchar * const  *flags,
                                                                 guint                 line,
                                                                 guint                 column,
+                                                                const gchar          *prefix,
+                                                                guint                 max_results,
                                                                 GCancellable         *cancellable,
                                                                 GAsyncReadyCallback   callback,
                                                                 gpointer              user_data);
@@ -32,19 +32,14 @@ G_DEFINE_TYPE_WITH_CODE (IdeClangCompletionItem, ide_clang_completion_item, G_TY
 static void
 ide_clang_completion_item_do_init (IdeClangCompletionItem *self)
 {
-  g_autoptr(GVariant) result = NULL;
-  g_autoptr(GVariant) chunks = NULL;
+  const IdeClangCompletionChunk *chunks;
   g_autoptr(GString) markup = NULL;
   enum CXCursorKind kind;
-  GVariantIter iter;
-  GVariant *chunk;
+  guint n_chunks;
 
   g_assert (IDE_IS_CLANG_COMPLETION_ITEM (self));
 
-  result = ide_clang_completion_item_get_result (self);
-
-  if (!g_variant_lookup (result, "kind", "u", &kind))
-    kind = 0;
+  kind = ide_clang_completion_item_get_record (self)->kind;
 
   switch ((int)kind)
     {
@@ -141,23 +136,17 @@ ide_clang_completion_item_do_init (IdeClangCompletionItem *self)
       break;
     }
 
-  if (!(chunks = g_variant_lookup_value (result, "chunks", NULL)))
+  chunks = ide_clang_completion_results_get_chunks (&self->view, self->index, &n_chunks);
+
+  if (n_chunks == 0)
     return;
 
   markup = g_string_new (NULL);
 
-  g_variant_iter_init (&iter, chunks);
-
-  while ((chunk = g_variant_iter_next_value (&iter)))
+  for (guint i = 0; i < n_chunks; i++)
     {
-      const gchar *text;
-      enum CXCompletionChunkKind ckind;
-
-      if (!g_variant_lookup (chunk, "kind", "u", &ckind))
-        ckind = 0;
-
-      if (!g_variant_lookup (chunk, "text", "&s", &text))
-        text = NULL;
+      enum CXCompletionChunkKind ckind = chunks[i].kind;
+      const gchar *text = ide_clang_completion_results_get_string (&self->view, chunks[i].text);
 
       switch ((int)ckind)
         {
@@ -201,8 +190,6 @@ ide_clang_completion_item_do_init (IdeClangCompletionItem *self)
         default:
           break;
         }
-
-      g_variant_unref (chunk);
     }
 
   self->params = g_string_free (g_steal_pointer (&markup), FALSE);
@@ -258,41 +245,32 @@ ide_clang_completion_item_create_snippet (IdeClangCompletionItem *self,
                                           IdeFileSettings        *file_settings)
 {
   g_autoptr(IdeSnippet) snippet = NULL;
-  g_autoptr(GVariant) result = NULL;
-  g_autoptr(GVariant) chunks = NULL;
   g_autoptr(GSettings) settings = NULL;
-  GVariantIter iter;
-  GVariant *vchunk;
+  const IdeClangCompletionChunk *chunks;
   IdeSpacesStyle spaces = 0;
   guint tab_stop = 0;
+  guint n_chunks;
 
   g_assert (IDE_IS_CLANG_COMPLETION_ITEM (self));
   g_assert (!file_settings || IDE_IS_FILE_SETTINGS (file_settings));
 
   settings = g_settings_new ("org.gnome.builder.clang");
 
-  result = ide_clang_completion_item_get_result (self);
   snippet = ide_snippet_new (NULL, NULL);
 
   if (file_settings != NULL)
     spaces = ide_file_settings_get_spaces_style (file_settings);
 
-  if (!(chunks = g_variant_lookup_value (result, "chunks", NULL)))
-    return NULL;
+  chunks = ide_clang_completion_results_get_chunks (&self->view, self->index, &n_chunks);
 
-  g_variant_iter_init (&iter, chunks);
+  if (n_chunks == 0)
+    return NULL;
 
-  while ((vchunk = g_variant_iter_next_value (&iter)))
+  for (guint i = 0; i < n_chunks; i++)
     {
-      enum CXCompletionChunkKind kind;
+      enum CXCompletionChunkKind kind = chunks[i].kind;
+      const gchar *text = ide_clang_completion_results_get_string (&self->view, chunks[i].text);
       IdeSnippetChunk *chunk;
-      const gchar *text;
-
-      if (!g_variant_lookup (vchunk, "kind", "u", &kind))
-        kind = 0;
-
-      if (!g_variant_lookup (vchunk, "text", "&s", &text))
-        text = NULL;
 
       if (!g_settings_get_boolean (settings, "complete-parens"))
         {
@@ -396,8 +374,6 @@ ide_clang_completion_item_create_snippet (IdeClangCompletionItem *self,
         default:
           break;
         }
-
-      g_variant_unref (vchunk);
     }
 
   return g_steal_pointer (&snippet);
@@ -453,6 +429,7 @@ ide_clang_completion_item_get_snippet (IdeClangCompletionItem *self,
 /**
  * ide_clang_completion_item_new:
  * @variant: the toplevel variant of all results
+ * @view: the view of the columnar results within @variant
  * @index: the index of the item
  * @keyword: pointer to folded form of the text
  *
@@ -463,17 +440,21 @@ ide_clang_completion_item_get_snippet (IdeClangCompletionItem *self,
  * Since: 3.32
  */
 IdeClangCompletionItem *
-ide_clang_completion_item_new (GVariant    *variant,
-                               guint        index,
-                               const gchar *keyword)
+ide_clang_completion_item_new (GVariant                        *variant,
+                               const IdeClangCompletionResults *view,
+                               guint                            index,
+                               const gchar                     *keyword)
 {
   IdeClangCompletionItem *ret;
 
   g_assert (variant != NULL);
+  g_assert (view != NULL);
+  g_assert (index < view->n_records);
   g_assert (keyword != NULL);
 
   ret = g_object_new (IDE_TYPE_CLANG_COMPLETION_ITEM, NULL);
   ret->results = g_variant_ref (variant);
+  ret->view = *view;
   ret->index = index;
   ret->typed_text = keyword;
 
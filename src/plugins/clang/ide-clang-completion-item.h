@@ -23,6 +23,8 @@
 #include <libide-code.h>
 #include <libide-sourceview.h>
 
+#include "ide-clang-completion-results.h"
+
 G_BEGIN_DECLS
 
 #define IDE_TYPE_CLANG_COMPLETION_ITEM (ide_clang_completion_item_get_type())
@@ -41,6 +43,9 @@ struct _IdeClangCompletionItem
   gchar            *params;
   GVariant         *results;
 
+  /* Points into @results */
+  IdeClangCompletionResults view;
+
   /* Unowned references */
   const gchar      *keyword;
   const gchar      *return_type;
@@ -48,21 +53,25 @@ struct _IdeClangCompletionItem
   const gchar      *typed_text;
 };
 
-static inline GVariant *
-ide_clang_completion_item_get_result (const IdeClangCompletionItem *self)
+static inline const IdeClangCompletionRecord *
+ide_clang_completion_item_get_record (const IdeClangCompletionItem *self)
 {
-  g_autoptr(GVariant) child = g_variant_get_child_value (self->results, self->index);
+  return &self->view.records[self->index];
+}
 
-  if (g_variant_is_of_type (child, G_VARIANT_TYPE_VARIANT))
-    return g_variant_get_variant (child);
+static inline const gchar *
+ide_clang_completion_item_get_comment (const IdeClangCompletionItem *self)
+{
+  const IdeClangCompletionRecord *record = ide_clang_completion_item_get_record (self);
 
-  return g_steal_pointer (&child);
+  return ide_clang_completion_results_get_string (&self->view, record->comment);
 }
 
-IdeClangCompletionItem *ide_clang_completion_item_new         (GVariant               *results,
-                                                               guint                   index,
-                                                               const gchar            *keyword);
-IdeSnippet             *ide_clang_completion_item_get_snippet (IdeClangCompletionItem *self,
-                                                               IdeFileSettings        *file_settings);
+IdeClangCompletionItem *ide_clang_completion_item_new         (GVariant                        *results,
+                                                               const IdeClangCompletionResults *view,
+                                                               guint                            index,
+                                                               const gchar                     *keyword);
+IdeSnippet             *ide_clang_completion_item_get_snippet (IdeClangCompletionItem          *self,
+                                                               IdeFileSettings                 *file_settings);
 
 G_END_DECLS
@@ -390,12 +390,8 @@ ide_clang_completion_provider_get_comment (IdeCompletionProvider *provider,
                                            IdeCompletionProposal *proposal)
 {
   IdeClangCompletionItem *item = IDE_CLANG_COMPLETION_ITEM (proposal);
-  g_autoptr(GVariant) result = ide_clang_completion_item_get_result (item);
-  gchar *str = NULL;
 
-  g_variant_lookup (result, "comment", "s", &str);
-
-  return str;
+  return g_strdup (ide_clang_completion_item_get_comment (item));
 }
 
 static void
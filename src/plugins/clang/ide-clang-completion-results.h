@@ -0,0 +1,160 @@
+/* ide-clang-completion-results.h
+ *
+ * Copyright 2018-2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <string.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Completion results are transferred from gnome-builder-clang as a
+ * columnar payload rather than a dictionary per result. The reply is
+ * an a{sv} containing:
+ *
+ *   "records"   a(uuuuuuu)  one IdeClangCompletionRecord per result
+ *   "chunks"    a(uu)       IdeClangCompletionChunk, referenced by records
+ *   "strings"   ay          deduplicated, \0 terminated string table
+ *   "total"     u           number of results before filtering
+ *   "truncated" b           if results were dropped due to maxResults
+ *
+ * Both arrays are fixed-width so they may be accessed in place with
+ * g_variant_get_fixed_array() without creating a GVariant per row.
+ * String fields are byte offsets into "strings".
+ */
+
+#define IDE_CLANG_COMPLETION_RECORD_TYPE "(uuuuuuu)"
+#define IDE_CLANG_COMPLETION_CHUNK_TYPE  "(uu)"
+#define IDE_CLANG_COMPLETION_NO_STRING   G_MAXUINT32
+
+typedef struct
+{
+  guint32 kind;
+  guint32 availability;
+  guint32 priority;
+  guint32 keyword;
+  guint32 comment;
+  guint32 chunks_begin;
+  guint32 n_chunks;
+} IdeClangCompletionRecord;
+
+typedef struct
+{
+  guint32 kind;
+  guint32 text;
+} IdeClangCompletionChunk;
+
+G_STATIC_ASSERT (sizeof (IdeClangCompletionRecord) == 7 * sizeof (guint32));
+G_STATIC_ASSERT (sizeof (IdeClangCompletionChunk) == 2 * sizeof (guint32));
+
+typedef struct
+{
+  const IdeClangCompletionRecord *records;
+  const IdeClangCompletionChunk  *chunks;
+  const gchar                    *strings;
+  gsize                           n_records;
+  gsize                           n_chunks;
+  gsize                           strings_len;
+  guint                           total;
+  guint                           truncated : 1;
+} IdeClangCompletionResults;
+
+static inline const gchar *
+ide_clang_completion_results_get_string (const IdeClangCompletionResults *results,
+                                         guint32                          offset)
+{
+  if (offset >= results->strings_len)
+    return NULL;
+  return &results->strings[offset];
+}
+
+static inline const IdeClangCompletionChunk *
+ide_clang_completion_results_get_chunks (const IdeClangCompletionResults *results,
+                                         guint                            index,
+                                         guint                           *n_chunks)
+{
+  const IdeClangCompletionRecord *record = &results->records[index];
+
+  *n_chunks = record->n_chunks;
+
+  return &results->chunks[record->chunks_begin];
+}
+
+/*
+ * ide_clang_completion_results_init:
+ * @results: location for the view
+ * @variant: the reply from clang/complete
+ *
+ * Initializes @results to point into the data of @variant. The view is only
+ * valid for as long as @variant is alive. Malformed payloads are rejected so
+ * that accessors do not need to bounds-check chunk ranges.
+ *
+ * Returns: %TRUE if @variant contained a valid payload
+ */
+static inline gboolean
+ide_clang_completion_results_init (IdeClangCompletionResults *results,
+                                   GVariant                  *variant)
+{
+  g_autoptr(GVariant) records = NULL;
+  g_autoptr(GVariant) chunks = NULL;
+  g_autoptr(GVariant) strings = NULL;
+  gboolean truncated = FALSE;
+  guint total = 0;
+
+  memset (results, 0, sizeof *results);
+
+  if (variant == NULL ||
+      !g_variant_is_of_type (variant, G_VARIANT_TYPE_VARDICT) ||
+      !(records = g_variant_lookup_value (variant, "records", G_VARIANT_TYPE ("a" IDE_CLANG_COMPLETION_RECORD_TYPE))) ||
+      !(chunks = g_variant_lookup_value (variant, "chunks", G_VARIANT_TYPE ("a" IDE_CLANG_COMPLETION_CHUNK_TYPE))) ||
+      !(strings = g_variant_lookup_value (variant, "strings", G_VARIANT_TYPE_BYTESTRING)))
+    return FALSE;
+
+  g_variant_lookup (variant, "total", "u", &total);
+  g_variant_lookup (variant, "truncated", "b", &truncated);
+
+  results->records = g_variant_get_fixed_array (records, &results->n_records, sizeof (IdeClangCompletionRecord));
+  results->chunks = g_variant_get_fixed_array (chunks, &results->n_chunks, sizeof (IdeClangCompletionChunk));
+  results->strings = g_variant_get_fixed_array (strings, &results->strings_len, 1);
+  results->total = total;
+  results->truncated = !!truncated;
+
+  if (results->strings_len > 0 && results->strings[results->strings_len - 1] != 0)
+    goto failure;
+
+  for (gsize i = 0; i < results->n_records; i++)
+    {
+      const IdeClangCompletionRecord *record = &results->records[i];
+
+      if (record->chunks_begin > results->n_chunks ||
+          record->n_chunks > results->n_chunks - record->chunks_begin)
+        goto failure;
+    }
+
+  return TRUE;
+
+failure:
+  memset (results, 0, sizeof *results);
+
+  return FALSE;
+}
+
+G_END_DECLS
@@ -51,28 +51,6 @@ accepts_char (gunichar ch)
   return (ch == '_' || g_unichar_isalnum (ch));
 }
 
-static gboolean
-select_next_word (GtkTextIter *begin,
-                  GtkTextIter *end)
-{
-  g_assert (begin);
-  g_assert (end);
-
-  *end = *begin;
-
-  while (!accepts_char (gtk_text_iter_get_char (begin)))
-    if (!gtk_text_iter_forward_char (begin))
-      return FALSE;
-
-  *end = *begin;
-
-  while (accepts_char (gtk_text_iter_get_char (end)))
-    if (!gtk_text_iter_forward_char (end))
-      return !gtk_text_iter_equal (begin, end);
-
-  return TRUE;
-}
-
 static void
 get_highlight_index_cb (GObject      *object,
                         GAsyncResult *result,
@@ -208,6 +186,7 @@ ide_clang_highlighter_real_update (IdeHighlighter       *highlighter,
   g_autoptr(IdeHighlightIndex) index = NULL;
   GtkSourceBuffer *source_buffer;
   GtkTextBuffer *text_buffer;
+  GtkTextIter line_start;
   GtkTextIter begin;
   GtkTextIter end;
   gboolean transient = FALSE;
@@ -227,41 +206,71 @@ ide_clang_highlighter_real_update (IdeHighlighter       *highlighter,
 
   source_buffer = GTK_SOURCE_BUFFER (text_buffer);
 
-  begin = end = *location = *range_begin;
+  *location = *range_begin;
+  line_start = *range_begin;
 
-  while (gtk_text_iter_compare (&begin, range_end) < 0)
+  /* Walk a line at a time so that we only copy text out of the buffer once
+   * per line, and find words by scanning bytes rather than moving iters
+   * a character at a time.
+   */
+  while (gtk_text_iter_compare (&line_start, range_end) < 0)
     {
-      if (!select_next_word (&begin, &end))
-        goto completed;
+      g_autofree gchar *text = NULL;
+      GtkTextIter line_end = line_start;
+      const gchar *iter;
+      gint base;
 
-      if (gtk_text_iter_compare (&begin, range_end) >= 0)
-        goto completed;
+      if (!gtk_text_iter_ends_line (&line_end))
+        gtk_text_iter_forward_to_line_end (&line_end);
 
-      g_assert (!gtk_text_iter_equal (&begin, &end));
+      text = gtk_text_iter_get_slice (&line_start, &line_end);
+      base = gtk_text_iter_get_line_index (&line_start);
 
-      if (!gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "string") &&
-          !gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "path") &&
-          !gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "comment"))
+      for (iter = text; *iter; )
         {
+          const gchar *word;
           const gchar *tag;
-          gchar *word;
 
-          word = gtk_text_iter_get_slice (&begin, &end);
-          tag = ide_highlight_index_lookup (index, word);
-          g_free (word);
+          if (!accepts_char (g_utf8_get_char (iter)))
+            {
+              iter = g_utf8_next_char (iter);
+              continue;
+            }
+
+          word = iter;
+
+          while (*iter && accepts_char (g_utf8_get_char (iter)))
+            iter = g_utf8_next_char (iter);
+
+          begin = line_start;
+          gtk_text_iter_set_line_index (&begin, base + (word - text));
 
-          if (tag != NULL)
+          if (gtk_text_iter_compare (&begin, range_end) >= 0)
+            goto completed;
+
+          if (!(tag = ide_highlight_index_lookup_len (index, word, iter - word)))
+            continue;
+
+          if (gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "string") ||
+              gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "path") ||
+              gtk_source_buffer_iter_has_context_class (source_buffer, &begin, "comment"))
+            continue;
+
+          end = line_start;
+          gtk_text_iter_set_line_index (&end, base + (iter - text));
+
+          if (callback (&begin, &end, tag) == IDE_HIGHLIGHT_STOP)
             {
-              if (callback (&begin, &end, tag) == IDE_HIGHLIGHT_STOP)
-                {
-                  if (!transient)
-                    *location = end;
-                  return;
-                }
+              if (!transient)
+                *location = end;
+              return;
             }
         }
 
-      begin = end;
+      line_start = line_end;
+
+      if (!gtk_text_iter_forward_line (&line_start))
+        break;
     }
 
 completed:
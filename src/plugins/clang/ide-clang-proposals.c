@@ -32,6 +32,12 @@
 #include "ide-clang-completion-item.h"
 #include "ide-clang-proposals.h"
 
+/* Ask the daemon to truncate results so that completing at global scope
+ * does not transfer (and inflate) every symbol from every header. If the
+ * results were truncated we requery as the user continues typing.
+ */
+#define MAX_RESULTS 2500
+
 struct _IdeClangProposals
 {
   GObject parent_instance;
@@ -53,9 +59,12 @@ struct _IdeClangProposals
   IdeClangClient *client;
 
   /*
-   * The most recent GVariant we received from the peer.
+   * The most recent GVariant we received from the peer, and a view into
+   * its columnar records so that we can filter without creating a GVariant
+   * for each result.
    */
   GVariant *results;
+  IdeClangCompletionResults view;
 
   /*
    * Instead of inflating GObjects for each of our matches, we instead keep
@@ -73,6 +82,13 @@ struct _IdeClangProposals
    */
   gchar *filter;
 
+  /*
+   * The word that was sent to the daemon with our last query. The daemon
+   * filters results using it, so we can only reuse results while the
+   * user continues typing after it.
+   */
+  gchar *query_prefix;
+
   /*
    * @line is the line we last performed a completion request upon. We cannot
    * reuse results that are on a different line or are not a continuation of
@@ -112,6 +128,7 @@ typedef struct
 {
   IdeClangClient *client;
   GFile          *file;
+  gchar          *prefix;
   guint           line;
   guint           column;
   guint           query_id;
@@ -145,6 +162,7 @@ query_free (gpointer data)
 
   g_clear_object (&q->client);
   g_clear_object (&q->file);
+  g_clear_pointer (&q->prefix, g_free);
   g_slice_free (Query, q);
 }
 
@@ -160,6 +178,7 @@ ide_clang_proposals_finalize (GObject *object)
   g_clear_object (&self->client);
   g_clear_object (&self->cancellable);
   g_clear_pointer (&self->filter, g_free);
+  g_clear_pointer (&self->query_prefix, g_free);
   g_clear_pointer (&self->match_indexes, g_array_unref);
   g_clear_pointer (&self->results, g_variant_unref);
 
@@ -243,6 +262,7 @@ ide_clang_proposals_clear (IdeClangProposals *self)
   self->line_offset = -1;
 
   ide_clear_string (&self->filter);
+  ide_clear_string (&self->query_prefix);
 
   if ((old_len = self->match_indexes->len))
     g_array_remove_range (self->match_indexes, 0, self->match_indexes->len);
@@ -337,13 +357,6 @@ ide_clang_proposals_do_refilter (IdeClangProposals *self,
           const gchar *keyword = item->keyword;
           guint priority;
 
-          if G_UNLIKELY (keyword == NULL)
-            {
-              g_autoptr(GVariant) child = g_variant_get_child_value (self->results, item->index);
-              if (!g_variant_lookup (child, "keyword", "&s", &keyword))
-                keyword = NULL;
-            }
-
           if (keyword == NULL || !ide_completion_fuzzy_match (keyword, folded, &priority))
             g_array_remove_index_fast (self->match_indexes, i - 1);
           else
@@ -360,54 +373,41 @@ ide_clang_proposals_do_refilter (IdeClangProposals *self,
   if (old_len > 0)
     g_array_remove_range (self->match_indexes, 0, old_len);
 
-  n_items = self->results ? g_variant_n_children (self->results) : 0;
+  n_items = self->view.n_records;
 
   if (self->filter == NULL || self->filter[0] == 0)
     {
       for (guint i = 0; i < n_items; i++)
         {
+          const IdeClangCompletionRecord *record = &self->view.records[i];
           Item item = { i, i, 0 };
+
+          item.keyword = ide_clang_completion_results_get_string (&self->view, record->keyword);
           g_array_append_val (self->match_indexes, item);
         }
     }
-  else if (self->results != NULL)
+  else
     {
-      GVariantIter iter;
-      GVariant *value;
-      guint index = 0;
-
-      g_variant_iter_init (&iter, self->results);
-
-      while ((value = g_variant_iter_next_value (&iter)))
+      for (guint i = 0; i < n_items; i++)
         {
+          const IdeClangCompletionRecord *record = &self->view.records[i];
           const gchar *typed_text;
+          guint priority;
 
           /*
-           * We get a typed_text pointer into the larger buffer, which is
-           * kept around for the lifetime of @variant (so that we don't need
-           * to copy more strings.
+           * We get a typed_text pointer into the string table, which is
+           * kept around for the lifetime of @results (so that we don't
+           * need to copy more strings).
            */
+          typed_text = ide_clang_completion_results_get_string (&self->view, record->keyword);
 
-          if (g_variant_lookup (value, "keyword", "&s", &typed_text))
+          if (typed_text != NULL &&
+              ide_completion_fuzzy_match (typed_text, folded, &priority))
             {
-              Item item = { index, 0, 0, typed_text };
-              guint priority;
+              Item item = { i, priority, kind_priority (record->kind), typed_text };
 
-              if (ide_completion_fuzzy_match (typed_text, folded, &priority))
-                {
-                  enum CXCursorKind kind = 0;
-
-                  g_variant_lookup (value, "kind", "u", &kind);
-
-                  item.priority = priority;
-                  item.kind = kind_priority (kind);
-                  g_array_append_val (self->match_indexes, item);
-                }
+              g_array_append_val (self->match_indexes, item);
             }
-
-          g_variant_unref (value);
-
-          index++;
         }
 
       g_array_sort (self->match_indexes, sort_by_priority);
@@ -430,6 +430,9 @@ ide_clang_proposals_flush (IdeClangProposals *self,
     {
       g_clear_pointer (&self->results, g_variant_unref);
       self->results = results ? g_variant_ref (results) : NULL;
+
+      if (!ide_clang_completion_results_init (&self->view, self->results))
+        g_clear_pointer (&self->results, g_variant_unref);
     }
 
   ide_clang_proposals_do_refilter (self, FALSE);
@@ -510,6 +513,8 @@ ide_clang_proposals_query_build_flags_cb (GObject      *object,
                                    (const gchar * const *)flags,
                                    query->line,
                                    query->column,
+                                   query->prefix,
+                                   MAX_RESULTS,
                                    cancellable,
                                    ide_clang_proposals_query_complete_cb,
                                    g_steal_pointer (&task));
@@ -520,6 +525,7 @@ ide_clang_proposals_query_async (IdeClangProposals   *self,
                                  GFile               *file,
                                  guint                line,
                                  guint                column,
+                                 const gchar         *prefix,
                                  GCancellable        *cancellable,
                                  GAsyncReadyCallback  callback,
                                  gpointer             user_data)
@@ -539,6 +545,7 @@ ide_clang_proposals_query_async (IdeClangProposals   *self,
   q = g_slice_new0 (Query);
   q->client = g_object_ref (self->client);
   q->file = g_object_ref (file);
+  q->prefix = g_strdup (prefix);
   q->line = line;
   q->column = column;
   q->query_id = ++self->query_id;
@@ -645,6 +652,20 @@ ide_clang_proposals_populate_async (IdeClangProposals   *self,
   if (!gtk_text_iter_equal (&previous, &begin))
     IDE_GOTO (query_client);
 
+  /*
+   * The daemon filtered results using the word at the time of the query,
+   * so if the user backspaced past that we need to requery. Likewise, if
+   * the results were truncated, a different word may need results that
+   * were dropped.
+   */
+  if (self->query_prefix != NULL && !(word && g_str_has_prefix (word, self->query_prefix)))
+    IDE_GOTO (query_client);
+
+  if (self->view.truncated &&
+      g_queue_is_empty (&self->queued_tasks) &&
+      !ide_str_equal0 (self->filter, word))
+    IDE_GOTO (query_client);
+
   /*
    * At this point, we know we can refilter results. However, we may not have
    * have received those yet from the subprocess. If that is the case, queue
@@ -702,6 +723,7 @@ query_client:
   g_queue_push_tail (&self->queued_tasks, g_steal_pointer (&task));
 
   ide_set_string (&self->filter, word);
+  ide_set_string (&self->query_prefix, word);
 
   /* If we have previous results, refilter them immediately so that if we're
    * attached as intermediate results, we have something useful to display.
@@ -713,6 +735,7 @@ query_client:
                                    file,
                                    self->line + 1,
                                    self->line_offset + 1,
+                                   word,
                                    self->cancellable,
                                    query_subprocess_cb,
                                    NULL);
@@ -764,14 +787,14 @@ ide_clang_proposals_get_item (GListModel *model,
 {
   IdeClangProposals *self = IDE_CLANG_PROPOSALS (model);
   Item *item = &g_array_index (self->match_indexes, Item, position);
-  g_autoptr(GVariant) child = g_variant_get_child_value (self->results, item->index);
-  const gchar *keyword = NULL;
-
-  /* Very unlikely, but I've seen it once from libclang, so protect against it */
-  if (!g_variant_lookup (child, "keyword", "&s", &keyword))
-    keyword = "";
 
-  return ide_clang_completion_item_new (self->results, item->index, keyword);
+  /* Missing keywords are very unlikely, but I've seen it once from libclang,
+   * so protect against it.
+   */
+  return ide_clang_completion_item_new (self->results,
+                                        &self->view,
+                                        item->index,
+                                        item->keyword ?: "");
 }
 
 static void
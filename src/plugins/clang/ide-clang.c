@@ -22,9 +22,12 @@
 
 #define G_LOG_DOMAIN "ide-clang"
 
+#include <errno.h>
+#include <glib/gstdio.h>
 #include <libide-code.h>
 
 #include "ide-clang.h"
+#include "ide-clang-completion-results.h"
 #include "ide-clang-util.h"
 
 #define IDE_CLANG_HIGHLIGHTER_TYPE          "c:type"
@@ -40,6 +43,12 @@
 #define PRIORITY_INDEX_FILE   (500)
 #define PRIORITY_HIGHLIGHT    (300)
 
+/* Translation units are kept around (and reparsed) between requests so
+ * that a keystroke does not cost several full parses of the same file.
+ * The ceiling is checked against clang_getCXTUResourceUsage().
+ */
+#define DEFAULT_UNIT_CACHE_SIZE (256 * 1024 * 1024)
+
 #if 0
 # define PROBE G_STMT_START { g_printerr ("PROBE: %s\n", G_STRFUNC); } G_STMT_END
 #else
@@ -52,8 +61,33 @@ struct _IdeClang
   GFile      *workdir;
   GHashTable *unsaved_files;
   CXIndex     index;
+
+  /* Cached translation units, protected by units_mutex. Units that are
+   * checked out by a worker are not in @units (nor @units_lru) until
+   * they are released again.
+   */
+  GMutex      units_mutex;
+  GHashTable *units;
+  GQueue      units_lru;
+  gsize       units_size;
+  gsize       units_max_size;
+  guint64     units_hits;
+  guint64     units_misses;
+  guint64     units_reparses;
+  guint64     units_failed_reparses;
+  guint64     units_evictions;
 };
 
+typedef struct
+{
+  GList              link;
+  IdeClang          *self;
+  gchar             *key;
+  gchar             *path;
+  CXTranslationUnit  unit;
+  gsize              size;
+} CachedUnit;
+
 typedef struct
 {
   struct CXUnsavedFile *files;
@@ -64,6 +98,10 @@ typedef struct
 
 G_DEFINE_TYPE (IdeClang, ide_clang, G_TYPE_OBJECT)
 
+static void ide_clang_release_unit (CachedUnit *cached);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (CachedUnit, ide_clang_release_unit)
+
 static void
 unsaved_files_free (UnsavedFiles *uf)
 {
@@ -297,6 +335,318 @@ ide_clang_get_unsaved_files (IdeClang *self)
   return g_steal_pointer (&ret);
 }
 
+/* Translation Unit Cache {{{1 */
+
+static void
+cached_unit_free (CachedUnit *cached)
+{
+  g_assert (cached != NULL);
+  g_assert (cached->link.prev == NULL);
+  g_assert (cached->link.next == NULL);
+
+  g_clear_pointer (&cached->unit, clang_disposeTranslationUnit);
+  g_clear_pointer (&cached->key, g_free);
+  g_clear_pointer (&cached->path, g_free);
+  g_slice_free (CachedUnit, cached);
+}
+
+static unsigned
+ide_clang_get_unit_options (void)
+{
+  /* All of the editing requests share a single set of options so that
+   * they can share the same cached translation unit.
+   */
+  return clang_defaultEditingTranslationUnitOptions ()
+#if CINDEX_VERSION >= CINDEX_VERSION_ENCODE(0, 35)
+       | CXTranslationUnit_KeepGoing
+       | CXTranslationUnit_CreatePreambleOnFirstParse
+#endif
+       | CXTranslationUnit_DetailedPreprocessingRecord;
+}
+
+static gchar *
+ide_clang_get_unit_key (const gchar         *path,
+                        const gchar * const *argv,
+                        gint                 argc)
+{
+  GString *str = g_string_new (path);
+
+  for (gint i = 0; i < argc; i++)
+    {
+      g_string_append_c (str, '\n');
+      g_string_append (str, argv[i]);
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+static gsize
+ide_clang_get_unit_size (CXTranslationUnit unit)
+{
+  CXTUResourceUsage usage;
+  gsize size = 0;
+
+  g_assert (unit != NULL);
+
+  usage = clang_getCXTUResourceUsage (unit);
+  for (guint i = 0; i < usage.numEntries; i++)
+    size += usage.entries[i].amount;
+  clang_disposeCXTUResourceUsage (usage);
+
+  return size;
+}
+
+/* Must be called with units_mutex held. Evicted units are appended to
+ * @evicted so that they may be disposed after releasing the lock.
+ */
+static void
+ide_clang_evict_units_locked (IdeClang *self,
+                              GQueue   *evicted)
+{
+  g_assert (IDE_IS_CLANG (self));
+  g_assert (evicted != NULL);
+
+  /* Always keep the most recently used unit, even if it alone is
+   * larger than the ceiling. Otherwise we would thrash on every
+   * request to a large file.
+   */
+  while (self->units_size > self->units_max_size &&
+         self->units_lru.length > (self->units_max_size ? 1 : 0))
+    {
+      GList *link = g_queue_pop_tail_link (&self->units_lru);
+      CachedUnit *cached = link->data;
+
+      g_hash_table_remove (self->units, cached->key);
+      self->units_size -= cached->size;
+      self->units_evictions++;
+
+      g_queue_push_tail (evicted, cached);
+    }
+}
+
+static void
+ide_clang_dispose_evicted (GQueue *evicted)
+{
+  CachedUnit *cached;
+
+  while ((cached = g_queue_pop_head (evicted)))
+    cached_unit_free (cached);
+}
+
+/*
+ * ide_clang_acquire_unit:
+ *
+ * Checks out a translation unit for @path, either by reparsing a unit
+ * from the cache with the current unsaved files or by parsing a new one.
+ * The unit is exclusively owned by the caller until it is returned with
+ * ide_clang_release_unit() (generally via g_autoptr()).
+ */
+static CachedUnit *
+ide_clang_acquire_unit (IdeClang            *self,
+                        const gchar         *path,
+                        const gchar * const *argv,
+                        gint                 argc,
+                        UnsavedFiles        *ufs,
+                        enum CXErrorCode    *code)
+{
+  g_autofree gchar *key = NULL;
+  CachedUnit *cached;
+
+  g_assert (IDE_IS_CLANG (self));
+  g_assert (path != NULL);
+  g_assert (ufs != NULL);
+  g_assert (code != NULL);
+
+  key = ide_clang_get_unit_key (path, argv, argc);
+
+  g_mutex_lock (&self->units_mutex);
+  if ((cached = g_hash_table_lookup (self->units, key)))
+    {
+      g_hash_table_remove (self->units, key);
+      g_queue_unlink (&self->units_lru, &cached->link);
+      self->units_size -= cached->size;
+      self->units_hits++;
+    }
+  else
+    {
+      self->units_misses++;
+    }
+  g_mutex_unlock (&self->units_mutex);
+
+  if (cached != NULL)
+    {
+      int ret;
+
+      ret = clang_reparseTranslationUnit (cached->unit,
+                                          ufs->len,
+                                          ufs->files,
+                                          clang_defaultReparseOptions (cached->unit));
+
+      g_mutex_lock (&self->units_mutex);
+      if (ret == 0)
+        self->units_reparses++;
+      else
+        self->units_failed_reparses++;
+      g_mutex_unlock (&self->units_mutex);
+
+      if (ret == 0)
+        {
+          *code = CXError_Success;
+          return cached;
+        }
+
+      /* The unit is invalid after a failed reparse, start over */
+      cached_unit_free (cached);
+    }
+
+  cached = g_slice_new0 (CachedUnit);
+  cached->link.data = cached;
+  cached->self = self;
+  cached->key = g_steal_pointer (&key);
+  cached->path = g_strdup (path);
+
+  *code = clang_parseTranslationUnit2 (self->index,
+                                       path,
+                                       argv,
+                                       argc,
+                                       ufs->files,
+                                       ufs->len,
+                                       ide_clang_get_unit_options (),
+                                       &cached->unit);
+
+  if (*code != CXError_Success)
+    {
+      cached_unit_free (cached);
+      return NULL;
+    }
+
+  return cached;
+}
+
+static void
+ide_clang_release_unit (CachedUnit *cached)
+{
+  GQueue evicted = G_QUEUE_INIT;
+  IdeClang *self;
+
+  g_assert (cached != NULL);
+  g_assert (IDE_IS_CLANG (cached->self));
+  g_assert (cached->unit != NULL);
+
+  self = cached->self;
+  cached->size = ide_clang_get_unit_size (cached->unit);
+
+  g_mutex_lock (&self->units_mutex);
+  if (self->units_max_size == 0 ||
+      g_hash_table_contains (self->units, cached->key))
+    {
+      /* Caching is disabled or a concurrent request already returned
+       * a unit for the same key. Keep the existing one.
+       */
+      g_queue_push_tail (&evicted, cached);
+    }
+  else
+    {
+      g_hash_table_insert (self->units, cached->key, cached);
+      g_queue_push_head_link (&self->units_lru, &cached->link);
+      self->units_size += cached->size;
+      ide_clang_evict_units_locked (self, &evicted);
+    }
+  g_mutex_unlock (&self->units_mutex);
+
+  ide_clang_dispose_evicted (&evicted);
+}
+
+static void
+ide_clang_evict_path (IdeClang    *self,
+                      const gchar *path)
+{
+  GQueue evicted = G_QUEUE_INIT;
+  GList *iter;
+
+  g_assert (IDE_IS_CLANG (self));
+  g_assert (path != NULL);
+
+  g_mutex_lock (&self->units_mutex);
+  iter = self->units_lru.head;
+  while (iter != NULL)
+    {
+      CachedUnit *cached = iter->data;
+
+      iter = iter->next;
+
+      if (g_str_equal (cached->path, path))
+        {
+          g_hash_table_remove (self->units, cached->key);
+          g_queue_unlink (&self->units_lru, &cached->link);
+          self->units_size -= cached->size;
+          g_queue_push_tail (&evicted, cached);
+        }
+    }
+  g_mutex_unlock (&self->units_mutex);
+
+  ide_clang_dispose_evicted (&evicted);
+}
+
+/**
+ * ide_clang_set_cache_size:
+ * @self: a #IdeClang
+ * @max_size: the maximum number of bytes, or 0 to disable caching
+ *
+ * Sets the ceiling for memory used by cached translation units. Units
+ * are evicted in least-recently-used order when the ceiling is reached.
+ *
+ * Since: 3.40
+ */
+void
+ide_clang_set_cache_size (IdeClang *self,
+                          gsize     max_size)
+{
+  GQueue evicted = G_QUEUE_INIT;
+
+  g_return_if_fail (IDE_IS_CLANG (self));
+
+  g_mutex_lock (&self->units_mutex);
+  self->units_max_size = max_size;
+  ide_clang_evict_units_locked (self, &evicted);
+  g_mutex_unlock (&self->units_mutex);
+
+  ide_clang_dispose_evicted (&evicted);
+}
+
+/**
+ * ide_clang_get_cache_stats:
+ * @self: a #IdeClang
+ *
+ * Gets statistics about the translation unit cache.
+ *
+ * Returns: (transfer full): a #GVariant vardict
+ *
+ * Since: 3.40
+ */
+GVariant *
+ide_clang_get_cache_stats (IdeClang *self)
+{
+  GVariantDict dict;
+
+  g_return_val_if_fail (IDE_IS_CLANG (self), NULL);
+
+  g_variant_dict_init (&dict, NULL);
+
+  g_mutex_lock (&self->units_mutex);
+  g_variant_dict_insert (&dict, "size", "t", (guint64)self->units_size);
+  g_variant_dict_insert (&dict, "max-size", "t", (guint64)self->units_max_size);
+  g_variant_dict_insert (&dict, "n-units", "u", self->units_lru.length);
+  g_variant_dict_insert (&dict, "hits", "t", self->units_hits);
+  g_variant_dict_insert (&dict, "misses", "t", self->units_misses);
+  g_variant_dict_insert (&dict, "reparses", "t", self->units_reparses);
+  g_variant_dict_insert (&dict, "failed-reparses", "t", self->units_failed_reparses);
+  g_variant_dict_insert (&dict, "evictions", "t", self->units_evictions);
+  g_mutex_unlock (&self->units_mutex);
+
+  return g_variant_take_ref (g_variant_dict_end (&dict));
+}
+
 static gboolean
 is_ignored_kind (enum CXCursorKind kind)
 {
@@ -496,6 +846,13 @@ static void
 ide_clang_finalize (GObject *object)
 {
   IdeClang *self = (IdeClang *)object;
+  GList *link;
+
+  while ((link = g_queue_pop_head_link (&self->units_lru)))
+    cached_unit_free (link->data);
+
+  g_clear_pointer (&self->units, g_hash_table_unref);
+  g_mutex_clear (&self->units_mutex);
 
   g_clear_object (&self->workdir);
   g_clear_pointer (&self->unsaved_files, g_hash_table_unref);
@@ -518,6 +875,10 @@ ide_clang_init (IdeClang *self)
   self->index = clang_createIndex (0, 0);
   self->unsaved_files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
                                                (GDestroyNotify)g_bytes_unref);
+
+  g_mutex_init (&self->units_mutex);
+  self->units = g_hash_table_new (g_str_hash, g_str_equal);
+  self->units_max_size = DEFAULT_UNIT_CACHE_SIZE;
 }
 
 IdeClang *
@@ -924,7 +1285,6 @@ ide_clang_index_file_finish (IdeClang      *self,
 
 typedef struct
 {
-  CXIndex       index;
   UnsavedFiles *ufs;
   GPtrArray    *diagnostics;
   GFile        *workdir;
@@ -1113,11 +1473,12 @@ ide_clang_diagnose_worker (IdeTask      *task,
                            gpointer      task_data,
                            GCancellable *cancellable)
 {
+  IdeClang *self = source_object;
   Diagnose *state = task_data;
   g_autoptr(GFile) file = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnit) cached = NULL;
+  CXTranslationUnit unit;
   enum CXErrorCode code;
-  unsigned options;
   guint n_diags;
 
   g_assert (IDE_IS_CLANG (source_object));
@@ -1126,20 +1487,12 @@ ide_clang_diagnose_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (state->diagnostics != NULL);
 
-  options = clang_defaultEditingTranslationUnitOptions ()
-#if CINDEX_VERSION >= CINDEX_VERSION_ENCODE(0, 35)
-          | CXTranslationUnit_KeepGoing
-#endif
-          | CXTranslationUnit_DetailedPreprocessingRecord;
-
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      options,
-                                      &unit);
+  cached = ide_clang_acquire_unit (self,
+                                   state->path,
+                                   (const char * const *)state->argv,
+                                   state->argc,
+                                   state->ufs,
+                                   &code);
 
   if (code != CXError_Success)
     {
@@ -1151,6 +1504,8 @@ ide_clang_diagnose_worker (IdeTask      *task,
       return;
     }
 
+  unit = cached->unit;
+
   n_diags = clang_getNumDiagnostics (unit);
   file = g_file_new_for_path (state->path);
 
@@ -1205,7 +1560,6 @@ ide_clang_diagnose_async (IdeClang            *self,
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   state = g_slice_new0 (Diagnose);
-  state->index = self->index;
   state->ufs = ide_clang_get_unsaved_files (self);
   state->path = g_strdup (path);
   state->argv = ide_clang_cook_flags (path, argv);
@@ -1256,15 +1610,24 @@ ide_clang_diagnose_finish (IdeClang      *self,
 
 typedef struct
 {
-  CXIndex        index;
   UnsavedFiles  *ufs;
   gchar         *path;
+  gchar         *prefix;
   gchar        **argv;
   gint           argc;
   guint          line;
   guint          column;
+  guint          max_results;
 } Complete;
 
+typedef struct
+{
+  GArray     *records;
+  GArray     *chunks;
+  GByteArray *strings;
+  GHashTable *offsets;
+} CompletionBuilder;
+
 static void
 complete_free (gpointer data)
 {
@@ -1272,57 +1635,147 @@ complete_free (gpointer data)
 
   g_clear_pointer (&state->ufs, unsaved_files_free);
   g_clear_pointer (&state->path, g_free);
+  g_clear_pointer (&state->prefix, g_free);
   g_clear_pointer (&state->argv, g_strfreev);
   g_slice_free (Complete, state);
 }
 
+static guint32
+completion_builder_add_string (CompletionBuilder *builder,
+                               const gchar       *str)
+{
+  gpointer offset;
+
+  g_assert (builder != NULL);
+
+  if (str == NULL)
+    return IDE_CLANG_COMPLETION_NO_STRING;
+
+  /* Chunk text such as "(", ", " or "const " is repeated for nearly
+   * every result, so deduplicate the string table.
+   */
+  if (g_hash_table_lookup_extended (builder->offsets, str, NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  offset = GUINT_TO_POINTER (builder->strings->len);
+  g_byte_array_append (builder->strings, (const guint8 *)str, strlen (str) + 1);
+  g_hash_table_insert (builder->offsets, g_strdup (str), offset);
+
+  return GPOINTER_TO_UINT (offset);
+}
+
 static void
-ide_clang_build_completion (GVariantBuilder    *builder,
-                            CXCompletionResult *result)
+ide_clang_build_completion (CompletionBuilder  *builder,
+                            CXCompletionResult *result,
+                            const gchar        *keyword)
 {
-  GVariantBuilder chunks_builder;
-  g_autofree gchar *typed_text = NULL;
+  IdeClangCompletionRecord record;
   g_auto(CXString) comment = {0};
   const gchar *comment_cstr;
-  guint n_chunks;
 
   g_assert (builder != NULL);
   g_assert (result != NULL);
 
-  g_variant_builder_add_parsed (builder, "{%s,<%u>}", "kind", result->CursorKind);
-
   comment = clang_getCompletionBriefComment (result->CompletionString);
   comment_cstr = clang_getCString (comment);
-  if (comment_cstr && *comment_cstr)
-    g_variant_builder_add_parsed (builder, "{%s,<%s>}", "comment", comment_cstr);
+  if (comment_cstr != NULL && *comment_cstr == 0)
+    comment_cstr = NULL;
+
+  record.kind = result->CursorKind;
+  record.availability = clang_getCompletionAvailability (result->CompletionString);
+  record.priority = clang_getCompletionPriority (result->CompletionString);
+  record.keyword = completion_builder_add_string (builder, keyword);
+  record.comment = completion_builder_add_string (builder, comment_cstr);
+  record.chunks_begin = builder->chunks->len;
+  record.n_chunks = clang_getNumCompletionChunks (result->CompletionString);
+
+  for (guint i = 0; i < record.n_chunks; i++)
+    {
+      g_auto(CXString) str = clang_getCompletionChunkText (result->CompletionString, i);
+      IdeClangCompletionChunk chunk;
 
-  if (clang_getCompletionAvailability (result->CompletionString))
-    g_variant_builder_add_parsed (builder, "{%s,<%u>}", "avail",
-                                  clang_getCompletionAvailability (result->CompletionString));
+      chunk.kind = clang_getCompletionChunkKind (result->CompletionString, i);
+      chunk.text = completion_builder_add_string (builder, clang_getCString (str));
 
-  n_chunks = clang_getNumCompletionChunks (result->CompletionString);
+      g_array_append_val (builder->chunks, chunk);
+    }
 
-  g_variant_builder_init (&chunks_builder, G_VARIANT_TYPE ("aa{sv}"));
+  g_array_append_val (builder->records, record);
+}
+
+static gchar *
+ide_clang_get_completion_keyword (CXCompletionResult *result)
+{
+  guint n_chunks;
+
+  g_assert (result != NULL);
+
+  n_chunks = clang_getNumCompletionChunks (result->CompletionString);
 
   for (guint i = 0; i < n_chunks; i++)
     {
-      g_auto(CXString) str = clang_getCompletionChunkText (result->CompletionString, i);
-      const gchar *text = clang_getCString (str);
-      guint kind = clang_getCompletionChunkKind (result->CompletionString, i);
+      if (clang_getCompletionChunkKind (result->CompletionString, i) == CXCompletionChunk_TypedText)
+        {
+          g_auto(CXString) str = clang_getCompletionChunkText (result->CompletionString, i);
+          const gchar *text = clang_getCString (str);
+
+          return text ? g_utf8_casefold (text, -1) : NULL;
+        }
+    }
+
+  return NULL;
+}
+
+/* This must never reject something ide_completion_fuzzy_match() would
+ * accept since the UI process refilters (but never requeries) as the
+ * user continues typing the same word.
+ */
+static gboolean
+keyword_matches_prefix (const gchar *keyword,
+                        const gchar *folded_prefix)
+{
+  for (; *folded_prefix; folded_prefix = g_utf8_next_char (folded_prefix))
+    {
+      gunichar ch = g_utf8_get_char (folded_prefix);
+      const gchar *tmp;
 
-      if (kind == CXCompletionChunk_TypedText && typed_text == NULL)
-        typed_text = g_utf8_casefold (text, -1);
+      if (!(tmp = g_utf8_strchr (keyword, -1, ch)))
+        return FALSE;
 
-      g_variant_builder_open (&chunks_builder, G_VARIANT_TYPE_VARDICT);
-      g_variant_builder_add_parsed (&chunks_builder, "{%s,<%s>}", "text", text);
-      g_variant_builder_add_parsed (&chunks_builder, "{%s,<%u>}", "kind", kind);
-      g_variant_builder_close (&chunks_builder);
+      keyword = g_utf8_next_char (tmp);
     }
 
-  if (typed_text != NULL)
-    g_variant_builder_add_parsed (builder, "{%s,<%s>}", "keyword", typed_text);
+  return TRUE;
+}
 
-  g_variant_builder_add (builder, "{sv}", "chunks", g_variant_builder_end (&chunks_builder));
+typedef struct
+{
+  guint  index;
+  guint  priority;
+  gchar *keyword;
+} CompletionMatch;
+
+static void
+completion_match_clear (gpointer data)
+{
+  CompletionMatch *match = data;
+
+  g_clear_pointer (&match->keyword, g_free);
+}
+
+static gint
+completion_match_compare (gconstpointer a,
+                          gconstpointer b)
+{
+  const CompletionMatch *am = a;
+  const CompletionMatch *bm = b;
+
+  if (am->priority < bm->priority)
+    return -1;
+  else if (am->priority > bm->priority)
+    return 1;
+  else
+    return (gint)am->index - (gint)bm->index;
 }
 
 static void
@@ -1331,28 +1784,29 @@ ide_clang_complete_worker (IdeTask      *task,
                            gpointer      task_data,
                            GCancellable *cancellable)
 {
+  IdeClang *self = source_object;
   Complete *state = task_data;
+  g_autoptr(CachedUnit) cached = NULL;
   g_autoptr(CXCodeCompleteResults) results = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
-  GVariantBuilder builder;
+  g_autoptr(GArray) matches = NULL;
+  g_autofree gchar *folded_prefix = NULL;
+  CompletionBuilder builder;
+  CXTranslationUnit unit;
+  GVariantDict dict;
   enum CXErrorCode code;
-  unsigned options;
+  gboolean truncated = FALSE;
 
   g_assert (IDE_IS_TASK (task));
   g_assert (IDE_IS_CLANG (source_object));
   g_assert (state != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  options = clang_defaultEditingTranslationUnitOptions ();
-
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      options,
-                                      &unit);
+  cached = ide_clang_acquire_unit (self,
+                                   state->path,
+                                   (const char * const *)state->argv,
+                                   state->argc,
+                                   state->ufs,
+                                   &code);
 
   if (code != CXError_Success)
     {
@@ -1364,6 +1818,8 @@ ide_clang_complete_worker (IdeTask      *task,
       return;
     }
 
+  unit = cached->unit;
+
   results = clang_codeCompleteAt (unit,
                                   state->path,
                                   state->line,
@@ -1382,30 +1838,105 @@ ide_clang_complete_worker (IdeTask      *task,
       return;
     }
 
-#if 0
-  clang_sortCodeCompletionResults (results->Results, results->NumResults);
-#endif
+  if (state->prefix != NULL && state->prefix[0] != 0)
+    folded_prefix = g_utf8_casefold (state->prefix, -1);
 
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+  matches = g_array_new (FALSE, FALSE, sizeof (CompletionMatch));
+  g_array_set_clear_func (matches, completion_match_clear);
 
   for (guint i = 0; i < results->NumResults; i++)
     {
-      g_variant_builder_open (&builder, G_VARIANT_TYPE_VARDICT);
-      ide_clang_build_completion (&builder, &results->Results[i]);
-      g_variant_builder_close (&builder);
+      CompletionMatch match;
+
+      match.index = i;
+      match.priority = clang_getCompletionPriority (results->Results[i].CompletionString);
+      match.keyword = ide_clang_get_completion_keyword (&results->Results[i]);
+
+      if (folded_prefix != NULL &&
+          (match.keyword == NULL || !keyword_matches_prefix (match.keyword, folded_prefix)))
+        {
+          g_free (match.keyword);
+          continue;
+        }
+
+      g_array_append_val (matches, match);
+    }
+
+  /* Keep the results clang thinks are most likely when truncating */
+  if (state->max_results > 0 && matches->len > state->max_results)
+    {
+      g_array_sort (matches, completion_match_compare);
+      g_array_set_size (matches, state->max_results);
+      truncated = TRUE;
+    }
+
+  builder.records = g_array_sized_new (FALSE, FALSE, sizeof (IdeClangCompletionRecord), matches->len);
+  builder.chunks = g_array_sized_new (FALSE, FALSE, sizeof (IdeClangCompletionChunk), matches->len * 4);
+  builder.strings = g_byte_array_new ();
+  builder.offsets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (guint i = 0; i < matches->len; i++)
+    {
+      const CompletionMatch *match = &g_array_index (matches, CompletionMatch, i);
+
+      ide_clang_build_completion (&builder, &results->Results[match->index], match->keyword);
     }
 
+  g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert_value (&dict, "records",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE (IDE_CLANG_COMPLETION_RECORD_TYPE),
+                                                          builder.records->data,
+                                                          builder.records->len,
+                                                          sizeof (IdeClangCompletionRecord)));
+  g_variant_dict_insert_value (&dict, "chunks",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE (IDE_CLANG_COMPLETION_CHUNK_TYPE),
+                                                          builder.chunks->data,
+                                                          builder.chunks->len,
+                                                          sizeof (IdeClangCompletionChunk)));
+  g_variant_dict_insert_value (&dict, "strings",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                                          builder.strings->data,
+                                                          builder.strings->len,
+                                                          1));
+  g_variant_dict_insert (&dict, "total", "u", results->NumResults);
+  g_variant_dict_insert (&dict, "truncated", "b", truncated);
+
+  g_clear_pointer (&builder.records, g_array_unref);
+  g_clear_pointer (&builder.chunks, g_array_unref);
+  g_clear_pointer (&builder.strings, g_byte_array_unref);
+  g_clear_pointer (&builder.offsets, g_hash_table_unref);
+
   ide_task_return_pointer (task,
-                           g_variant_ref_sink (g_variant_builder_end (&builder)),
+                           g_variant_take_ref (g_variant_dict_end (&dict)),
                            g_variant_unref);
 }
 
+/**
+ * ide_clang_complete_async:
+ * @self: a #IdeClang
+ * @path: the path to the C/C++/Obj-C file on local disk
+ * @line: the line to complete, starting from 1
+ * @column: the column to complete, starting from 1
+ * @argv: the command line arguments for clang
+ * @prefix: (nullable): the word being typed, used to filter results
+ * @max_results: the maximum number of results, or 0 for no limit
+ * @cancellable: (nullable): a #GCancellable or %NULL
+ * @callback: a callback to execute up on completion
+ * @user_data: closure data for @callback
+ *
+ * Asynchronously requests completion results. See
+ * ide-clang-completion-results.h for the format of the result.
+ *
+ * Since: 3.32
+ */
 void
 ide_clang_complete_async (IdeClang            *self,
                           const gchar         *path,
                           guint                line,
                           guint                column,
                           const gchar * const *argv,
+                          const gchar         *prefix,
+                          guint                max_results,
                           GCancellable        *cancellable,
                           GAsyncReadyCallback  callback,
                           gpointer             user_data)
@@ -1420,13 +1951,14 @@ ide_clang_complete_async (IdeClang            *self,
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   state = g_slice_new0 (Complete);
-  state->index = self->index;
   state->ufs = ide_clang_get_unsaved_files (self);
   state->path = g_strdup (path);
   state->argv = ide_clang_cook_flags (path, argv);
   state->argc = state->argv ? g_strv_length (state->argv) : 0;
+  state->prefix = g_strdup (prefix);
   state->line = line;
   state->column = column;
+  state->max_results = max_results;
 
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_check_cancellable (task, FALSE);
@@ -1452,7 +1984,6 @@ ide_clang_complete_finish (IdeClang      *self,
 
 typedef struct
 {
-  CXIndex        index;
   UnsavedFiles  *ufs;
   gchar         *path;
   gchar        **argv;
@@ -1478,9 +2009,11 @@ ide_clang_find_nearest_scope_worker (IdeTask      *task,
                                      gpointer      task_data,
                                      GCancellable *cancellable)
 {
+  IdeClang *self = source_object;
   FindNearestScope *state = task_data;
   g_autoptr(IdeSymbol) ret = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnit) cached = NULL;
+  CXTranslationUnit unit;
   g_autoptr(GError) error = NULL;
   enum CXCursorKind kind;
   enum CXErrorCode code;
@@ -1493,14 +2026,12 @@ ide_clang_find_nearest_scope_worker (IdeTask      *task,
   g_assert (state != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      clang_defaultEditingTranslationUnitOptions (),
-                                      &unit);
+  cached = ide_clang_acquire_unit (self,
+                                   state->path,
+                                   (const char * const *)state->argv,
+                                   state->argc,
+                                   state->ufs,
+                                   &code);
 
   if (code != CXError_Success)
     {
@@ -1512,6 +2043,8 @@ ide_clang_find_nearest_scope_worker (IdeTask      *task,
       return;
     }
 
+  unit = cached->unit;
+
   file = clang_getFile (unit, state->path);
   loc = clang_getLocation (unit, file, state->line, state->column);
   cursor = clang_getCursor (unit, loc);
@@ -1573,7 +2106,6 @@ ide_clang_find_nearest_scope_async (IdeClang            *self,
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   state = g_slice_new0 (FindNearestScope);
-  state->index = self->index;
   state->ufs = ide_clang_get_unsaved_files (self);
   state->path = g_strdup (path);
   state->argv = ide_clang_cook_flags (path, argv);
@@ -1604,7 +2136,6 @@ ide_clang_find_nearest_scope_finish (IdeClang      *self,
 
 typedef struct
 {
-  CXIndex        index;
   UnsavedFiles  *ufs;
   GFile         *workdir;
   gchar         *path;
@@ -1632,11 +2163,13 @@ ide_clang_locate_symbol_worker (IdeTask      *task,
                                 gpointer      task_data,
                                 GCancellable *cancellable)
 {
+  IdeClang *self = source_object;
   LocateSymbol *state = task_data;
   g_autoptr(IdeLocation) declaration = NULL;
   g_autoptr(IdeLocation) definition = NULL;
   g_autoptr(IdeSymbol) ret = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnit) cached = NULL;
+  CXTranslationUnit unit;
   g_auto(CXString) cxstr = {0};
   CXSourceLocation cxlocation;
   enum CXErrorCode code;
@@ -1645,7 +2178,6 @@ ide_clang_locate_symbol_worker (IdeTask      *task,
   CXCursor cursor;
   CXCursor tmpcursor;
   CXFile cxfile;
-  unsigned options;
 
   g_assert (IDE_IS_TASK (task));
   g_assert (IDE_IS_CLANG (source_object));
@@ -1653,17 +2185,12 @@ ide_clang_locate_symbol_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  options = clang_defaultEditingTranslationUnitOptions ()
-          | CXTranslationUnit_DetailedPreprocessingRecord;
-
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      options,
-                                      &unit);
+  cached = ide_clang_acquire_unit (self,
+                                   state->path,
+                                   (const char * const *)state->argv,
+                                   state->argc,
+                                   state->ufs,
+                                   &code);
 
   if (code != CXError_Success)
     {
@@ -1675,6 +2202,8 @@ ide_clang_locate_symbol_worker (IdeTask      *task,
       return;
     }
 
+  unit = cached->unit;
+
   cxfile = clang_getFile (unit, state->path);
   cxlocation = clang_getLocation (unit, cxfile, state->line, state->column);
   cursor = clang_getCursor (unit, cxlocation);
@@ -1759,7 +2288,6 @@ ide_clang_locate_symbol_async (IdeClang            *self,
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   state = g_slice_new0 (LocateSymbol);
-  state->index = self->index;
   state->ufs = ide_clang_get_unsaved_files (self);
   state->path = g_strdup (path);
   state->argv = ide_clang_cook_flags (path, argv);
@@ -1795,7 +2323,6 @@ ide_clang_locate_symbol_finish (IdeClang      *self,
 
 typedef struct
 {
-  CXIndex          index;
   UnsavedFiles    *ufs;
   GFile           *workdir;
   gchar           *path;
@@ -1903,9 +2430,11 @@ ide_clang_get_symbol_tree_worker (IdeTask      *task,
                                   gpointer      task_data,
                                   GCancellable *cancellable)
 {
+  IdeClang *self = source_object;
   GetSymbolTree *state = task_data;
   g_autoptr(GVariant) ret = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnit) cached = NULL;
+  CXTranslationUnit unit;
   GVariantBuilder builder;
   enum CXErrorCode code;
   CXCursor cursor;
@@ -1916,14 +2445,12 @@ ide_clang_get_symbol_tree_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      clang_defaultEditingTranslationUnitOptions (),
-                                      &unit);
+  cached = ide_clang_acquire_unit (self,
+                                   state->path,
+                                   (const char * const *)state->argv,
+                                   state->argc,
+                                   state->ufs,
+                                   &code);
 
   if (code != CXError_Success)
     {
@@ -1934,6 +2461,8 @@ ide_clang_get_symbol_tree_worker (IdeTask      *task,
       return;
     }
 
+  unit = cached->unit;
+
   state->current = &builder;
 
   cursor = clang_getTranslationUnitCursor (unit);
@@ -1964,7 +2493,6 @@ ide_clang_get_symbol_tree_async (IdeClang            *self,
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   state = g_slice_new0 (GetSymbolTree);
-  state->index = self->index;
   state->ufs = ide_clang_get_unsaved_files (self);
   state->path = g_strdup (path);
   state->argv = ide_clang_cook_flags (path, argv);
@@ -1998,12 +2526,12 @@ ide_clang_get_symbol_tree_finish (IdeClang      *self,
 
 typedef struct
 {
-  CXIndex        index;
   UnsavedFiles  *ufs;
   GFile         *workdir;
   gchar         *path;
   gchar        **argv;
   gint           argc;
+  gchar         *cache_path;
 } GetHighlightIndex;
 
 static void
@@ -2015,9 +2543,95 @@ get_highlight_index_free (gpointer data)
   g_clear_object (&state->workdir);
   g_clear_pointer (&state->path, g_free);
   g_clear_pointer (&state->argv, g_strfreev);
+  g_clear_pointer (&state->cache_path, g_free);
   g_slice_free (GetHighlightIndex, state);
 }
 
+#define HIGHLIGHT_CACHE_MAX_AGE (G_TIME_SPAN_DAY * 7)
+
+static void
+prune_highlight_cache (const gchar *dir)
+{
+  g_autoptr(GDir) gdir = NULL;
+  const gchar *name;
+  gint64 now;
+
+  g_assert (dir != NULL);
+
+  if (!(gdir = g_dir_open (dir, 0, NULL)))
+    return;
+
+  now = g_get_real_time ();
+
+  while ((name = g_dir_read_name (gdir)))
+    {
+      g_autofree gchar *path = NULL;
+      GStatBuf st;
+
+      if (!g_str_has_suffix (name, ".idx"))
+        continue;
+
+      path = g_build_filename (dir, name, NULL);
+
+      if (g_stat (path, &st) == 0 &&
+          now - (gint64)st.st_mtime * G_USEC_PER_SEC > HIGHLIGHT_CACHE_MAX_AGE)
+        g_unlink (path);
+    }
+}
+
+/*
+ * Writes the compact form of @index to the user cache so that the client
+ * can map it rather than decoding a (potentially very large) variant. Files
+ * are named by their contents, so unchanged indexes are simply reused and
+ * shared by every buffer asking for them.
+ */
+static gchar *
+write_highlight_cache (IdeHighlightIndex *index)
+{
+  static gsize pruned;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *checksum = NULL;
+  g_autofree gchar *dir = NULL;
+  g_autofree gchar *name = NULL;
+  g_autofree gchar *path = NULL;
+
+  g_assert (index != NULL);
+
+  dir = g_build_filename (g_get_user_cache_dir (), "gnome-builder", "clang", "highlight", NULL);
+
+  if (g_once_init_enter (&pruned))
+    {
+      prune_highlight_cache (dir);
+      g_once_init_leave (&pruned, TRUE);
+    }
+
+  bytes = ide_highlight_index_to_bytes (index);
+  checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, bytes);
+  name = g_strdup_printf ("%s.idx", checksum);
+  path = g_build_filename (dir, name, NULL);
+
+  if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    {
+      /* Keep it from being pruned */
+      g_utime (path, NULL);
+      return g_steal_pointer (&path);
+    }
+
+  if (g_mkdir_with_parents (dir, 0750) != 0 ||
+      !g_file_set_contents (path,
+                            g_bytes_get_data (bytes, NULL),
+                            g_bytes_get_size (bytes),
+                            &error))
+    {
+      g_debug ("Failed to write highlight index: %s",
+               error ? error->message : g_strerror (errno));
+      return NULL;
+    }
+
+  return g_steal_pointer (&path);
+}
+
 static enum CXChildVisitResult
 build_index_visitor (CXCursor cursor,
                      CXCursor     parent,
@@ -2081,11 +2695,12 @@ ide_clang_get_highlight_index_worker (IdeTask      *task,
                                       GCancellable *cancellable)
 {
   static const gchar *common_defines[] = { "NULL", "MIN", "MAX", "__LINE__", "__FILE__" };
+  IdeClang *self = source_object;
   GetHighlightIndex *state = task_data;
   g_autoptr(IdeHighlightIndex) highlight = NULL;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnit) cached = NULL;
+  CXTranslationUnit unit;
   enum CXErrorCode code;
-  unsigned options;
   CXCursor cursor;
 
   g_assert (IDE_IS_TASK (task));
@@ -2094,20 +2709,12 @@ ide_clang_get_highlight_index_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  options = clang_defaultEditingTranslationUnitOptions ()
-#if CINDEX_VERSION >= CINDEX_VERSION_ENCODE(0, 35)
-          | CXTranslationUnit_KeepGoing
-#endif
-          | CXTranslationUnit_DetailedPreprocessingRecord;
-
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      options,
-                                      &unit);
+  cached = ide_clang_acquire_unit (self,
+                                   state->path,
+                                   (const char * const *)state->argv,
+                                   state->argc,
+                                   state->ufs,
+                                   &code);
 
   if (code != CXError_Success)
     {
@@ -2118,6 +2725,8 @@ ide_clang_get_highlight_index_worker (IdeTask      *task,
       return;
     }
 
+  unit = cached->unit;
+
   highlight = ide_highlight_index_new ();
 
   for (guint i = 0; i < G_N_ELEMENTS (common_defines); i++)
@@ -2134,6 +2743,8 @@ ide_clang_get_highlight_index_worker (IdeTask      *task,
   cursor = clang_getTranslationUnitCursor (unit);
   clang_visitChildren (cursor, build_index_visitor, highlight);
 
+  state->cache_path = write_highlight_cache (highlight);
+
   ide_task_return_pointer (task,
                            g_steal_pointer (&highlight),
                            ide_highlight_index_unref);
@@ -2158,7 +2769,6 @@ ide_clang_get_highlight_index_async (IdeClang            *self,
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   state = g_slice_new0 (GetHighlightIndex);
-  state->index = self->index;
   state->ufs = ide_clang_get_unsaved_files (self);
   state->path = g_strdup (path);
   state->argv = ide_clang_cook_flags (path, argv);
@@ -2177,22 +2787,40 @@ ide_clang_get_highlight_index_async (IdeClang            *self,
   ide_task_run_in_thread (task, ide_clang_get_highlight_index_worker);
 }
 
+/**
+ * ide_clang_get_highlight_index_finish:
+ * @cache_path: (out) (optional): location for the path of the compact
+ *   index within the user cache, or %NULL if it could not be written
+ *
+ * Returns: (transfer full): an #IdeHighlightIndex or %NULL
+ */
 IdeHighlightIndex *
 ide_clang_get_highlight_index_finish (IdeClang      *self,
                                       GAsyncResult  *result,
+                                      gchar        **cache_path,
                                       GError       **error)
 {
+  IdeHighlightIndex *ret;
+
   g_return_val_if_fail (IDE_IS_CLANG (self), NULL);
   g_return_val_if_fail (IDE_IS_TASK (result), NULL);
 
-  return ide_task_propagate_pointer (IDE_TASK (result), error);
+  ret = ide_task_propagate_pointer (IDE_TASK (result), error);
+
+  if (cache_path != NULL)
+    {
+      GetHighlightIndex *state = ide_task_get_task_data (IDE_TASK (result));
+
+      *cache_path = ret ? g_strdup (state->cache_path) : NULL;
+    }
+
+  return ret;
 }
 
 /* Get Index Key {{{1 */
 
 typedef struct
 {
-  CXIndex        index;
   UnsavedFiles  *ufs;
   gchar         *path;
   gchar        **argv;
@@ -2218,8 +2846,10 @@ ide_clang_get_index_key_worker (IdeTask      *task,
                                 gpointer      task_data,
                                 GCancellable *cancellable)
 {
+  IdeClang *self = source_object;
   GetIndexKey *state = task_data;
-  g_auto(CXTranslationUnit) unit = NULL;
+  g_autoptr(CachedUnit) cached = NULL;
+  CXTranslationUnit unit;
   g_auto(CXString) cxusr = {0};
   const gchar *usr = NULL;
   enum CXErrorCode code;
@@ -2235,14 +2865,12 @@ ide_clang_get_index_key_worker (IdeTask      *task,
   g_assert (state->path != NULL);
   g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  code = clang_parseTranslationUnit2 (state->index,
-                                      state->path,
-                                      (const char * const *)state->argv,
-                                      state->argc,
-                                      state->ufs->files,
-                                      state->ufs->len,
-                                      clang_defaultEditingTranslationUnitOptions (),
-                                      &unit);
+  cached = ide_clang_acquire_unit (self,
+                                   state->path,
+                                   (const char * const *)state->argv,
+                                   state->argc,
+                                   state->ufs,
+                                   &code);
 
   if (code != CXError_Success)
     {
@@ -2253,6 +2881,8 @@ ide_clang_get_index_key_worker (IdeTask      *task,
       return;
     }
 
+  unit = cached->unit;
+
   file = clang_getFile (unit, state->path);
   loc = clang_getLocation (unit, file, state->line, state->column);
   cursor = clang_getCursor (unit, loc);
@@ -2290,7 +2920,6 @@ ide_clang_get_index_key_async (IdeClang            *self,
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
 
   state = g_slice_new0 (GetIndexKey);
-  state->index = self->index;
   state->ufs = ide_clang_get_unsaved_files (self);
   state->path = g_strdup (path);
   state->argv = ide_clang_cook_flags (path, argv);
@@ -2346,7 +2975,11 @@ ide_clang_set_unsaved_file (IdeClang *self,
   path = g_file_get_path (file);
 
   if (bytes == NULL)
-    g_hash_table_remove (self->unsaved_files, path);
+    {
+      /* The buffer was closed, so the cached unit is unlikely to be needed */
+      ide_clang_evict_path (self, path);
+      g_hash_table_remove (self->unsaved_files, path);
+    }
   else
     g_hash_table_insert (self->unsaved_files, g_steal_pointer (&path), g_bytes_ref (bytes));
 }
@@ -31,6 +31,9 @@ G_DECLARE_FINAL_TYPE (IdeClang, ide_clang, IDE, CLANG, GObject)
 IdeClang          *ide_clang_new                        (void);
 void               ide_clang_set_workdir                (IdeClang             *self,
                                                          GFile                *workdir);
+void               ide_clang_set_cache_size             (IdeClang             *self,
+                                                         gsize                 max_size);
+GVariant          *ide_clang_get_cache_stats            (IdeClang             *self);
 void               ide_clang_index_file_async           (IdeClang             *self,
                                                          const gchar          *path,
                                                          const gchar * const  *argv,
@@ -56,6 +59,8 @@ void               ide_clang_complete_async             (IdeClang             *s
                                                          guint                 line,
                                                          guint                 column,
                                                          const gchar * const  *argv,
+                                                         const gchar          *prefix,
+                                                         guint                 max_results,
                                                          GCancellable         *cancellable,
                                                          GAsyncReadyCallback   callback,
                                                          gpointer              user_data);
@@ -110,6 +115,7 @@ void               ide_clang_get_highlight_index_async  (IdeClang             *s
                                                          gpointer              user_data);
 IdeHighlightIndex *ide_clang_get_highlight_index_finish (IdeClang             *self,
                                                          GAsyncResult         *result,
+                                                         gchar               **cache_path,
                                                          GError              **error);
 void               ide_clang_set_unsaved_file           (IdeClang             *self,
                                                          GFile                *file,
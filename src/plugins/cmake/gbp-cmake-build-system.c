@@ -233,7 +233,7 @@ gbp_cmake_build_system_load_commands_config_cb (GObject      *object,
       return;
     }
 
-  compile_commands = ide_compile_commands_new ();
+  compile_commands = ide_compile_commands_new_for_builddir (ide_pipeline_get_builddir (pipeline));
   file = g_file_new_for_path (path);
   cancellable = ide_task_get_cancellable (task);
 
@@ -299,7 +299,7 @@ gbp_cmake_build_system_load_commands_async (GbpCMakeBuildSystem *self,
           g_autoptr(IdeCompileCommands) compile_commands = NULL;
           g_autoptr(GFile) file = NULL;
 
-          compile_commands = ide_compile_commands_new ();
+          compile_commands = ide_compile_commands_new_for_builddir (ide_pipeline_get_builddir (pipeline));
           file = g_file_new_for_path (path);
 
           ide_compile_commands_load_async (compile_commands,
@@ -31,6 +31,24 @@
 #include "gbp-code-index-builder.h"
 #include "gbp-code-index-plan.h"
 
+/*
+ * Alongside SymbolKeys and SymbolNames we keep a SymbolCache file which
+ * contains the entries produced for each file of the directory as well as
+ * the mtime (in microseconds), size, and content hash of the file at the
+ * time it was indexed.
+ *
+ * When a directory is re-indexed, files which have not changed are loaded
+ * from the cache rather than passed through the IdeCodeIndexer again. Only
+ * the (cheap) SymbolKeys/SymbolNames serialization touches every file.
+ *
+ * A matching mtime and size is only trusted when the file system provides
+ * sub-second timestamps. Otherwise a same-size edit within the same second
+ * would look unchanged, so the content hash is checked instead.
+ */
+#define SYMBOL_CACHE_VERSION     2
+#define SYMBOL_CACHE_RECORD_TYPE "(ttsa(ssuuuu))"
+#define SYMBOL_CACHE_TYPE        "(ua{s" SYMBOL_CACHE_RECORD_TYPE "})"
+
 struct _GbpCodeIndexBuilder
 {
   IdeObject                parent_instance;
@@ -39,24 +57,64 @@ struct _GbpCodeIndexBuilder
   GPtrArray               *items;
   IdePersistentMapBuilder *map;
   DzlFuzzyIndexBuilder    *fuzzy;
+  GHashTable              *records;
+  GHashTable              *stamps;
   guint                    next_file_id;
+  guint                    max_active;
   guint                    has_run : 1;
 };
 
 typedef struct
 {
-  guint n_active;
-  guint completed;
+  GHashTable *indexers;
+  guint       pos;
+  guint       n_active;
+  guint       completed;
 } Run;
 
+typedef struct
+{
+  guint64  mtime;
+  guint64  size;
+  gchar   *hash;
+} FileStamp;
+
+typedef struct
+{
+  GFile      *source_dir;
+  GFile      *cache_file;
+  GPtrArray  *items;
+  GHashTable *records;
+  GHashTable *stamps;
+} LoadCache;
+
 G_DEFINE_TYPE (GbpCodeIndexBuilder, gbp_code_index_builder, IDE_TYPE_OBJECT)
 
 static void
 run_free (Run *state)
 {
+  g_clear_pointer (&state->indexers, g_hash_table_unref);
   g_slice_free (Run, state);
 }
 
+static void
+file_stamp_free (FileStamp *stamp)
+{
+  g_clear_pointer (&stamp->hash, g_free);
+  g_slice_free (FileStamp, stamp);
+}
+
+static void
+load_cache_free (LoadCache *state)
+{
+  g_clear_object (&state->source_dir);
+  g_clear_object (&state->cache_file);
+  g_clear_pointer (&state->items, g_ptr_array_unref);
+  g_clear_pointer (&state->records, g_hash_table_unref);
+  g_clear_pointer (&state->stamps, g_hash_table_unref);
+  g_slice_free (LoadCache, state);
+}
+
 static void
 gbp_code_index_builder_finalize (GObject *object)
 {
@@ -65,6 +123,10 @@ gbp_code_index_builder_finalize (GObject *object)
   g_clear_object (&self->index_dir);
   g_clear_object (&self->source_dir);
   g_clear_pointer (&self->items, g_ptr_array_unref);
+  g_clear_pointer (&self->records, g_hash_table_unref);
+  g_clear_pointer (&self->stamps, g_hash_table_unref);
+  g_clear_object (&self->map);
+  g_clear_object (&self->fuzzy);
 
   G_OBJECT_CLASS (gbp_code_index_builder_parent_class)->finalize (object);
 }
@@ -80,15 +142,17 @@ gbp_code_index_builder_class_init (GbpCodeIndexBuilderClass *klass)
 static void
 gbp_code_index_builder_init (GbpCodeIndexBuilder *self)
 {
+  self->max_active = 1;
   self->items = g_ptr_array_new_with_free_func ((GDestroyNotify)gbp_code_index_plan_item_free);
   self->map = ide_persistent_map_builder_new ();
   self->fuzzy = dzl_fuzzy_index_builder_new ();
+  self->records = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+  self->stamps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)file_stamp_free);
 }
 
-static void
-gbp_code_index_builder_submit (GbpCodeIndexBuilder *self,
-                               GFile               *file,
-                               GPtrArray           *entries)
+static guint
+gbp_code_index_builder_add_file (GbpCodeIndexBuilder *self,
+                                 GFile               *file)
 {
   g_autofree gchar *filename = NULL;
   gchar num[16];
@@ -113,10 +177,67 @@ gbp_code_index_builder_submit (GbpCodeIndexBuilder *self,
   dzl_fuzzy_index_builder_set_metadata_uint32 (self->fuzzy, filename, file_id);
   dzl_fuzzy_index_builder_set_metadata_string (self->fuzzy, num, filename);
 
+  return file_id;
+}
+
+static void
+gbp_code_index_builder_insert (GbpCodeIndexBuilder *self,
+                               guint                file_id,
+                               const gchar         *key,
+                               const gchar         *name,
+                               IdeSymbolKind        kind,
+                               IdeSymbolFlags       flags,
+                               guint                begin_line,
+                               guint                begin_line_offset)
+{
+  g_assert (GBP_IS_CODE_INDEX_BUILDER (self));
+
+  /* In our index lines and offsets are 1-based */
+
+  if (key != NULL)
+    ide_persistent_map_builder_insert (self->map,
+                                       key,
+                                       g_variant_new ("(uuuu)",
+                                                      file_id,
+                                                      begin_line,
+                                                      begin_line_offset,
+                                                      flags),
+                                       !!(flags & IDE_SYMBOL_FLAGS_IS_DEFINITION));
+
+  if (name != NULL)
+    dzl_fuzzy_index_builder_insert (self->fuzzy,
+                                    name,
+                                    g_variant_new ("(uuuuu)",
+                                                   file_id,
+                                                   begin_line,
+                                                   begin_line_offset,
+                                                   flags,
+                                                   kind),
+                                    0);
+}
+
+static void
+gbp_code_index_builder_submit (GbpCodeIndexBuilder *self,
+                               GFile               *file,
+                               GPtrArray           *entries)
+{
+  g_autofree gchar *basename = NULL;
+  GVariantBuilder builder;
+  FileStamp *stamp;
+  guint file_id;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_CODE_INDEX_BUILDER (self));
+  g_assert (G_IS_FILE (file));
+
+  file_id = gbp_code_index_builder_add_file (self, file);
+
   if (entries == NULL)
     return;
 
-  IDE_TRACE_MSG ("Adding %u entries for %s", entries->len, filename);
+  IDE_TRACE_MSG ("Adding %u entries for %s", entries->len, g_file_peek_path (file));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssuuuu)"));
 
   for (guint i = 0; i < entries->len; i++)
     {
@@ -139,29 +260,73 @@ gbp_code_index_builder_submit (GbpCodeIndexBuilder *self,
                                       NULL,
                                       NULL);
 
-      /* In our index lines and offsets are 1-based */
-
-      if (key != NULL)
-        ide_persistent_map_builder_insert (self->map,
-                                           key,
-                                           g_variant_new ("(uuuu)",
-                                                          file_id,
-                                                          begin_line,
-                                                          begin_line_offset,
-                                                          flags),
-                                           !!(flags & IDE_SYMBOL_FLAGS_IS_DEFINITION));
-
-      if (name != NULL)
-        dzl_fuzzy_index_builder_insert (self->fuzzy,
-                                        name,
-                                        g_variant_new ("(uuuuu)",
-                                                       file_id,
-                                                       begin_line,
-                                                       begin_line_offset,
-                                                       flags,
-                                                       kind),
-                                        0);
+      gbp_code_index_builder_insert (self, file_id, key, name, kind, flags,
+                                     begin_line, begin_line_offset);
+
+      g_variant_builder_add (&builder, "(ssuuuu)",
+                             key ? key : "",
+                             name ? name : "",
+                             kind,
+                             flags,
+                             begin_line,
+                             begin_line_offset);
     }
+
+  /* Only cache the entries if we know what the file looked like when it
+   * was indexed, otherwise we could never tell whether they are stale.
+   */
+  basename = g_file_get_basename (file);
+
+  if ((stamp = g_hash_table_lookup (self->stamps, basename)))
+    g_hash_table_insert (self->records,
+                         g_steal_pointer (&basename),
+                         g_variant_take_ref (g_variant_new ("(tts@a(ssuuuu))",
+                                                            stamp->mtime,
+                                                            stamp->size,
+                                                            stamp->hash,
+                                                            g_variant_builder_end (&builder))));
+  else
+    g_variant_builder_clear (&builder);
+}
+
+static void
+gbp_code_index_builder_submit_cached (GbpCodeIndexBuilder *self,
+                                      GFile               *file,
+                                      GVariant            *record)
+{
+  g_autoptr(GVariant) entries = NULL;
+  GVariantIter iter;
+  const gchar *key;
+  const gchar *name;
+  guint32 kind;
+  guint32 flags;
+  guint32 begin_line;
+  guint32 begin_line_offset;
+  guint file_id;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_CODE_INDEX_BUILDER (self));
+  g_assert (G_IS_FILE (file));
+  g_assert (record != NULL);
+
+  file_id = gbp_code_index_builder_add_file (self, file);
+  entries = g_variant_get_child_value (record, 3);
+
+  IDE_TRACE_MSG ("Reusing %"G_GSIZE_FORMAT" cached entries for %s",
+                 g_variant_n_children (entries), g_file_peek_path (file));
+
+  g_variant_iter_init (&iter, entries);
+
+  while (g_variant_iter_next (&iter, "(&s&suuuu)",
+                              &key, &name, &kind, &flags, &begin_line, &begin_line_offset))
+    gbp_code_index_builder_insert (self,
+                                   file_id,
+                                   key[0] ? key : NULL,
+                                   name[0] ? name : NULL,
+                                   kind,
+                                   flags,
+                                   begin_line,
+                                   begin_line_offset);
 }
 
 GbpCodeIndexBuilder *
@@ -180,6 +345,27 @@ gbp_code_index_builder_new (GFile *source_dir,
   return g_steal_pointer (&self);
 }
 
+/**
+ * gbp_code_index_builder_set_max_active:
+ * @self: a #GbpCodeIndexBuilder
+ * @max_active: the max number of files to index concurrently
+ *
+ * Sets the number of files that may be submitted to indexers at once.
+ *
+ * Files are handed out to indexers as previous files complete so that
+ * the indexers' worker threads remain busy without flooding them with
+ * every file of the directory up-front.
+ */
+void
+gbp_code_index_builder_set_max_active (GbpCodeIndexBuilder *self,
+                                       guint                max_active)
+{
+  g_return_if_fail (GBP_IS_CODE_INDEX_BUILDER (self));
+  g_return_if_fail (self->has_run == FALSE);
+
+  self->max_active = MAX (1, max_active);
+}
+
 void
 gbp_code_index_builder_add_item (GbpCodeIndexBuilder        *self,
                                  const GbpCodeIndexPlanItem *item)
@@ -304,6 +490,8 @@ gbp_code_index_builder_index_file_finish (GbpCodeIndexBuilder  *self,
   return ide_task_propagate_boolean (IDE_TASK (result), error);
 }
 
+static void gbp_code_index_builder_aggregate_next (IdeTask *task);
+
 static void
 gbp_code_index_builder_index_file_cb (GObject      *object,
                                       GAsyncResult *result,
@@ -325,58 +513,49 @@ gbp_code_index_builder_index_file_cb (GObject      *object,
   state->n_active--;
   state->completed++;
 
-  if (state->n_active == 0)
-    ide_task_return_boolean (task, TRUE);
+  gbp_code_index_builder_aggregate_next (task);
 }
 
 static void
-gbp_code_index_builder_aggregate_async (GbpCodeIndexBuilder *self,
-                                        GCancellable        *cancellable,
-                                        GAsyncReadyCallback  callback,
-                                        gpointer             user_data)
+gbp_code_index_builder_aggregate_next (IdeTask *task)
 {
-  g_autoptr(IdeTask) task = NULL;
-  g_autoptr(GHashTable) indexers = NULL;
+  GbpCodeIndexBuilder *self;
+  GCancellable *cancellable;
   PeasEngine *engine;
   Run *state;
 
-  IDE_ENTRY;
-
-  g_return_if_fail (GBP_IS_CODE_INDEX_BUILDER (self));
-  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
-
-  task = ide_task_new (self, cancellable, callback, user_data);
-  ide_task_set_source_tag (task, gbp_code_index_builder_aggregate_async);
-
-  if (self->items->len == 0)
-    {
-      ide_task_return_boolean (task, TRUE);
-      IDE_EXIT;
-    }
-
-  state = g_slice_new0 (Run);
-  state->n_active = 1;
-  ide_task_set_task_data (task, state, run_free);
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TASK (task));
 
+  self = ide_task_get_source_object (task);
+  state = ide_task_get_task_data (task);
+  cancellable = ide_task_get_cancellable (task);
   engine = peas_engine_get_default ();
-  indexers = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
 
-  /* We just queue up all of our indexer work up-front, and let the various
-   * backends manage their own queue-depth. That way, we don't waste time
-   * coordinating back and forth for async-but-serial processing.
+  g_assert (GBP_IS_CODE_INDEX_BUILDER (self));
+  g_assert (state != NULL);
+
+  /* Rather than queuing all of our work up-front, we keep up to max_active
+   * files in flight and hand out the next file as each one completes. The
+   * backends run their indexers on a pool of worker threads, so this keeps
+   * every worker busy while allowing cancellation to take effect quickly.
    */
 
-  for (guint i = 0; i < self->items->len; i++)
+  while (state->n_active < self->max_active &&
+         state->pos < self->items->len &&
+         !g_cancellable_is_cancelled (cancellable))
     {
-      const GbpCodeIndexPlanItem *item = g_ptr_array_index (self->items, i);
+      const GbpCodeIndexPlanItem *item = g_ptr_array_index (self->items, state->pos);
       const gchar *name = g_file_info_get_name (item->file_info);
       g_autoptr(GFile) child = NULL;
       IdeCodeIndexer *indexer;
 
+      state->pos++;
+
       if (name == NULL)
         continue;
 
-      if (!(indexer = g_hash_table_lookup (indexers, item->indexer_module_name)))
+      if (!(indexer = g_hash_table_lookup (state->indexers, item->indexer_module_name)))
         {
           PeasPluginInfo *plugin_info;
 
@@ -391,7 +570,7 @@ gbp_code_index_builder_aggregate_async (GbpCodeIndexBuilder *self,
           if (indexer == NULL)
             continue;
 
-          g_hash_table_insert (indexers, (gchar *)item->indexer_module_name, indexer);
+          g_hash_table_insert (state->indexers, (gchar *)item->indexer_module_name, indexer);
         }
 
       state->n_active++;
@@ -407,12 +586,47 @@ gbp_code_index_builder_aggregate_async (GbpCodeIndexBuilder *self,
                                                g_object_ref (task));
     }
 
-  state->n_active--;
+  if (state->n_active == 0)
+    {
+      /* The indexers borrow item->indexer_module_name as keys */
+      g_clear_pointer (&state->indexers, g_hash_table_unref);
+      g_ptr_array_remove_range (self->items, 0, self->items->len);
 
-  g_ptr_array_remove_range (self->items, 0, self->items->len);
+      if (ide_task_return_error_if_cancelled (task))
+        return;
 
-  if (state->n_active == 0)
-    ide_task_return_boolean (task, TRUE);
+      ide_task_return_boolean (task, TRUE);
+    }
+}
+
+static void
+gbp_code_index_builder_aggregate_async (GbpCodeIndexBuilder *self,
+                                        GCancellable        *cancellable,
+                                        GAsyncReadyCallback  callback,
+                                        gpointer             user_data)
+{
+  g_autoptr(IdeTask) task = NULL;
+  Run *state;
+
+  IDE_ENTRY;
+
+  g_return_if_fail (GBP_IS_CODE_INDEX_BUILDER (self));
+  g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  task = ide_task_new (self, cancellable, callback, user_data);
+  ide_task_set_source_tag (task, gbp_code_index_builder_aggregate_async);
+
+  if (self->items->len == 0)
+    {
+      ide_task_return_boolean (task, TRUE);
+      IDE_EXIT;
+    }
+
+  state = g_slice_new0 (Run);
+  state->indexers = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+  ide_task_set_task_data (task, state, run_free);
+
+  gbp_code_index_builder_aggregate_next (task);
 
   IDE_EXIT;
 }
@@ -429,6 +643,258 @@ gbp_code_index_builder_aggregate_finish (GbpCodeIndexBuilder  *self,
   return ide_task_propagate_boolean (IDE_TASK (result), error);
 }
 
+static gchar *
+compute_file_hash (GFile        *file,
+                   GCancellable *cancellable)
+{
+  g_autoptr(GBytes) bytes = NULL;
+
+  if (!(bytes = g_file_load_bytes (file, cancellable, NULL, NULL)))
+    return NULL;
+
+  return g_compute_checksum_for_bytes (G_CHECKSUM_SHA1, bytes);
+}
+
+static void
+gbp_code_index_builder_load_cache_worker (IdeTask      *task,
+                                          gpointer      source_object,
+                                          gpointer      task_data,
+                                          GCancellable *cancellable)
+{
+  LoadCache *state = task_data;
+  g_autoptr(GHashTable) cached = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_TASK (task));
+  g_assert (GBP_IS_CODE_INDEX_BUILDER (source_object));
+  g_assert (state != NULL);
+  g_assert (G_IS_FILE (state->source_dir));
+  g_assert (G_IS_FILE (state->cache_file));
+
+  cached = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_variant_unref);
+
+  if ((bytes = g_file_load_bytes (state->cache_file, cancellable, NULL, NULL)))
+    {
+      guint32 version = 0;
+
+      variant = g_variant_new_from_bytes (G_VARIANT_TYPE (SYMBOL_CACHE_TYPE), bytes, FALSE);
+      g_variant_ref_sink (variant);
+      g_variant_get_child (variant, 0, "u", &version);
+
+      if (version == SYMBOL_CACHE_VERSION)
+        {
+          g_autoptr(GVariant) files = g_variant_get_child_value (variant, 1);
+          GVariantIter iter;
+          const gchar *name;
+          GVariant *record;
+
+          g_variant_iter_init (&iter, files);
+
+          while (g_variant_iter_next (&iter, "{&s@" SYMBOL_CACHE_RECORD_TYPE "}", &name, &record))
+            g_hash_table_insert (cached, (gchar *)name, record);
+        }
+    }
+
+  for (guint i = 0; i < state->items->len; i++)
+    {
+      const GbpCodeIndexPlanItem *item = g_ptr_array_index (state->items, i);
+      const gchar *name = g_file_info_get_name (item->file_info);
+      g_autoptr(GVariant) entries = NULL;
+      g_autoptr(GFile) file = NULL;
+      const gchar *cached_hash = NULL;
+      guint64 cached_mtime = 0;
+      guint64 cached_size = 0;
+      FileStamp *stamp;
+      GVariant *record;
+      guint64 mtime;
+      guint64 size;
+      guint32 usec;
+
+      if (ide_task_return_error_if_cancelled (task))
+        IDE_EXIT;
+
+      if (name == NULL)
+        continue;
+
+      usec = g_file_info_get_attribute_uint32 (item->file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+      mtime = g_file_info_get_attribute_uint64 (item->file_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC + usec;
+      size = g_file_info_get_size (item->file_info);
+
+      if ((record = g_hash_table_lookup (cached, name)))
+        {
+          g_variant_get (record, "(tt&s@a(ssuuuu))",
+                         &cached_mtime, &cached_size, &cached_hash, &entries);
+
+          if (usec != 0 && cached_mtime == mtime && cached_size == size)
+            {
+              g_hash_table_insert (state->records, g_strdup (name), g_variant_ref (record));
+              continue;
+            }
+        }
+
+      file = g_file_get_child (state->source_dir, name);
+
+      stamp = g_slice_new0 (FileStamp);
+      stamp->mtime = mtime;
+      stamp->size = size;
+
+      if (!(stamp->hash = compute_file_hash (file, cancellable)))
+        {
+          /* Let the indexer deal with (and report) unreadable files */
+          file_stamp_free (stamp);
+          continue;
+        }
+
+      /* The content did not change, such as when switching branches or
+       * when the file system has no sub-second mtime, so the previous
+       * entries are still valid for the file.
+       */
+      if (record != NULL && cached_size == size && g_str_equal (cached_hash, stamp->hash))
+        {
+          g_hash_table_insert (state->records,
+                               g_strdup (name),
+                               g_variant_take_ref (g_variant_new ("(tts@a(ssuuuu))",
+                                                                  mtime,
+                                                                  size,
+                                                                  cached_hash,
+                                                                  entries)));
+          file_stamp_free (stamp);
+          continue;
+        }
+
+      g_hash_table_insert (state->stamps, g_strdup (name), stamp);
+    }
+
+  ide_task_return_boolean (task, TRUE);
+
+  IDE_EXIT;
+}
+
+static void
+gbp_code_index_builder_load_cache_async (GbpCodeIndexBuilder *self,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+  g_autoptr(IdeTask) task = NULL;
+  LoadCache *state;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_CODE_INDEX_BUILDER (self));
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+
+  state = g_slice_new0 (LoadCache);
+  state->source_dir = g_object_ref (self->source_dir);
+  state->cache_file = g_file_get_child (self->index_dir, "SymbolCache");
+  state->items = g_ptr_array_ref (self->items);
+  state->records = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+  state->stamps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)file_stamp_free);
+
+  task = ide_task_new (self, cancellable, callback, user_data);
+  ide_task_set_source_tag (task, gbp_code_index_builder_load_cache_async);
+  ide_task_set_kind (task, IDE_TASK_KIND_IO);
+  ide_task_set_task_data (task, state, load_cache_free);
+  ide_task_run_in_thread (task, gbp_code_index_builder_load_cache_worker);
+}
+
+static gboolean
+gbp_code_index_builder_load_cache_finish (GbpCodeIndexBuilder  *self,
+                                          GAsyncResult         *result,
+                                          GError              **error)
+{
+  LoadCache *state;
+  guint n_cached = 0;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_CODE_INDEX_BUILDER (self));
+  g_assert (IDE_IS_TASK (result));
+
+  if (!ide_task_propagate_boolean (IDE_TASK (result), error))
+    return FALSE;
+
+  state = ide_task_get_task_data (IDE_TASK (result));
+
+  g_clear_pointer (&self->records, g_hash_table_unref);
+  g_clear_pointer (&self->stamps, g_hash_table_unref);
+  self->records = g_steal_pointer (&state->records);
+  self->stamps = g_steal_pointer (&state->stamps);
+
+  /* Submit unchanged files straight from the cache so that only the
+   * remaining items are passed to the indexers.
+   */
+  for (guint i = 0; i < self->items->len; )
+    {
+      const GbpCodeIndexPlanItem *item = g_ptr_array_index (self->items, i);
+      const gchar *name = g_file_info_get_name (item->file_info);
+      GVariant *record;
+
+      if (name != NULL && (record = g_hash_table_lookup (self->records, name)))
+        {
+          g_autoptr(GFile) file = g_file_get_child (self->source_dir, name);
+
+          gbp_code_index_builder_submit_cached (self, file, record);
+          g_ptr_array_remove_index (self->items, i);
+          n_cached++;
+
+          continue;
+        }
+
+      i++;
+    }
+
+  IDE_TRACE_MSG ("%u files unchanged, %u to index in %s",
+                 n_cached, self->items->len, g_file_peek_path (self->source_dir));
+
+  return TRUE;
+}
+
+static GBytes *
+gbp_code_index_builder_serialize_cache (GbpCodeIndexBuilder *self)
+{
+  g_autoptr(GVariant) variant = NULL;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_assert (GBP_IS_CODE_INDEX_BUILDER (self));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s" SYMBOL_CACHE_RECORD_TYPE "}"));
+
+  g_hash_table_iter_init (&iter, self->records);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    g_variant_builder_add (&builder, "{s@" SYMBOL_CACHE_RECORD_TYPE "}", (const gchar *)key, (GVariant *)value);
+
+  variant = g_variant_new ("(u@a{s" SYMBOL_CACHE_RECORD_TYPE "})",
+                           SYMBOL_CACHE_VERSION,
+                           g_variant_builder_end (&builder));
+  g_variant_ref_sink (variant);
+
+  return g_variant_get_data_as_bytes (variant);
+}
+
+static void
+gbp_code_index_builder_persist_write_cache_cb (GObject      *object,
+                                               GAsyncResult *result,
+                                               gpointer      user_data)
+{
+  GFile *file = (GFile *)object;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (G_IS_FILE (file));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (IDE_IS_TASK (task));
+
+  if (!g_file_replace_contents_finish (file, result, NULL, &error))
+    ide_task_return_error (task, g_steal_pointer (&error));
+  else
+    ide_task_return_boolean (task, TRUE);
+}
+
 static void
 gbp_code_index_builder_persist_write_fuzzy_cb (GObject      *object,
                                                GAsyncResult *result,
@@ -437,6 +903,9 @@ gbp_code_index_builder_persist_write_fuzzy_cb (GObject      *object,
   DzlFuzzyIndexBuilder *fuzzy = (DzlFuzzyIndexBuilder *)object;
   g_autoptr(IdeTask) task = user_data;
   g_autoptr(GError) error = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GFile) file = NULL;
+  GbpCodeIndexBuilder *self;
 
   g_assert (IDE_IS_MAIN_THREAD ());
   g_assert (DZL_IS_FUZZY_INDEX_BUILDER (fuzzy));
@@ -444,9 +913,25 @@ gbp_code_index_builder_persist_write_fuzzy_cb (GObject      *object,
   g_assert (IDE_IS_TASK (task));
 
   if (!dzl_fuzzy_index_builder_write_finish (fuzzy, result, &error))
-    ide_task_return_error (task, g_steal_pointer (&error));
-  else
-    ide_task_return_boolean (task, TRUE);
+    {
+      ide_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
+
+  self = ide_task_get_source_object (task);
+  file = g_file_get_child (self->index_dir, "SymbolCache");
+  bytes = gbp_code_index_builder_serialize_cache (self);
+
+  IDE_TRACE_MSG ("Writing %s", g_file_peek_path (file));
+
+  g_file_replace_contents_bytes_async (file,
+                                       bytes,
+                                       NULL,
+                                       FALSE,
+                                       G_FILE_CREATE_REPLACE_DESTINATION,
+                                       ide_task_get_cancellable (task),
+                                       gbp_code_index_builder_persist_write_cache_cb,
+                                       g_object_ref (task));
 }
 
 static void
@@ -571,6 +1056,29 @@ gbp_code_index_builder_aggregate_cb (GObject      *object,
                                           g_object_ref (task));
 }
 
+static void
+gbp_code_index_builder_load_cache_cb (GObject      *object,
+                                      GAsyncResult *result,
+                                      gpointer      user_data)
+{
+  GbpCodeIndexBuilder *self = (GbpCodeIndexBuilder *)object;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_CODE_INDEX_BUILDER (self));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (IDE_IS_TASK (task));
+
+  if (!gbp_code_index_builder_load_cache_finish (self, result, &error))
+    ide_task_return_error (task, g_steal_pointer (&error));
+  else
+    gbp_code_index_builder_aggregate_async (self,
+                                            ide_task_get_cancellable (task),
+                                            gbp_code_index_builder_aggregate_cb,
+                                            g_object_ref (task));
+}
+
 void
 gbp_code_index_builder_run_async (GbpCodeIndexBuilder *self,
                                   GCancellable        *cancellable,
@@ -590,10 +1098,10 @@ gbp_code_index_builder_run_async (GbpCodeIndexBuilder *self,
 
   self->has_run = TRUE;
 
-  gbp_code_index_builder_aggregate_async (self,
-                                          cancellable,
-                                          gbp_code_index_builder_aggregate_cb,
-                                          g_steal_pointer (&task));
+  gbp_code_index_builder_load_cache_async (self,
+                                           cancellable,
+                                           gbp_code_index_builder_load_cache_cb,
+                                           g_steal_pointer (&task));
 
   IDE_EXIT;
 }
@@ -30,17 +30,19 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (GbpCodeIndexBuilder, gbp_code_index_builder, GBP, CODE_INDEX_BUILDER, IdeObject)
 
-GbpCodeIndexBuilder *gbp_code_index_builder_new         (GFile                       *source_dir,
-                                                         GFile                       *index_dir);
-void                 gbp_code_index_builder_add_item    (GbpCodeIndexBuilder         *self,
-                                                         const GbpCodeIndexPlanItem  *item);
-void                 gbp_code_index_builder_run_async   (GbpCodeIndexBuilder         *self,
-                                                         GCancellable                *cancellable,
-                                                         GAsyncReadyCallback          callback,
-                                                         gpointer                     user_data);
-gboolean             gbp_code_index_builder_run_finish  (GbpCodeIndexBuilder         *self,
-                                                         GAsyncResult                *result,
-                                                         GError                     **error);
+GbpCodeIndexBuilder *gbp_code_index_builder_new            (GFile                       *source_dir,
+                                                            GFile                       *index_dir);
+void                 gbp_code_index_builder_set_max_active (GbpCodeIndexBuilder         *self,
+                                                            guint                        max_active);
+void                 gbp_code_index_builder_add_item       (GbpCodeIndexBuilder         *self,
+                                                            const GbpCodeIndexPlanItem  *item);
+void                 gbp_code_index_builder_run_async      (GbpCodeIndexBuilder         *self,
+                                                            GCancellable                *cancellable,
+                                                            GAsyncReadyCallback          callback,
+                                                            gpointer                     user_data);
+gboolean             gbp_code_index_builder_run_finish     (GbpCodeIndexBuilder         *self,
+                                                            GAsyncResult                *result,
+                                                            GError                     **error);
 
 
 G_END_DECLS
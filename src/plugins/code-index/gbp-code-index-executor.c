@@ -45,12 +45,16 @@ typedef struct
   GFile            *workdir;
   GPtrArray        *builders;
   guint             pos;
+  guint             n_active;
+  guint             n_workers;
   guint64           num_ops;
   guint64           num_completed;
 } Execute;
 
 G_DEFINE_TYPE (GbpCodeIndexExecutor, gbp_code_index_executor, IDE_TYPE_OBJECT)
 
+static void gbp_code_index_executor_run_next (IdeTask *task);
+
 static void
 execute_free (Execute *exec)
 {
@@ -148,9 +152,11 @@ gbp_code_index_executor_collect_cb (GFile              *directory,
     {
       g_autoptr(GFile) names = g_file_get_child (index_dir, "SymbolNames");
       g_autoptr(GFile) keys = g_file_get_child (index_dir, "SymbolKeys");
+      g_autoptr(GFile) cache = g_file_get_child (index_dir, "SymbolCache");
 
       g_file_delete_async (names, G_PRIORITY_DEFAULT, NULL, NULL, NULL);
       g_file_delete_async (keys, G_PRIORITY_DEFAULT, NULL, NULL, NULL);
+      g_file_delete_async (cache, G_PRIORITY_DEFAULT, NULL, NULL, NULL);
 
       state->num_completed++;
 
@@ -190,22 +196,53 @@ gbp_code_index_executor_run_cb (GObject      *object,
 
   state = ide_task_get_task_data (task);
 
-  state->pos++;
+  state->n_active--;
   state->num_completed++;
 
   ide_notification_set_progress (state->notif,
                                  (gdouble)state->num_completed / (gdouble)state->num_ops);
 
-  if (state->pos >= state->builders->len)
+  gbp_code_index_executor_run_next (task);
+}
+
+static void
+gbp_code_index_executor_run_next (IdeTask *task)
+{
+  Execute *state;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IDE_IS_TASK (task));
+
+  state = ide_task_get_task_data (task);
+
+  /* Each builder produces the index for a single directory, so they are
+   * independent of each other and we can keep several of them running.
+   * Directories often contain only a handful of files, which would otherwise
+   * leave most of the indexer workers idle.
+   */
+
+  while (state->n_active < state->n_workers &&
+         state->pos < state->builders->len)
     {
-      ide_task_return_boolean (task, TRUE);
-      return;
+      GbpCodeIndexBuilder *builder = g_ptr_array_index (state->builders, state->pos);
+      guint n_builders = MIN (state->n_workers, state->builders->len);
+
+      /* Split the workers between the builders running at once so that no
+       * more than n_workers files are in flight across all of them.
+       */
+      gbp_code_index_builder_set_max_active (builder, MAX (1, state->n_workers / n_builders));
+
+      state->pos++;
+      state->n_active++;
+
+      gbp_code_index_builder_run_async (builder,
+                                        ide_task_get_cancellable (task),
+                                        gbp_code_index_executor_run_cb,
+                                        g_object_ref (task));
     }
 
-  gbp_code_index_builder_run_async (g_ptr_array_index (state->builders, state->pos),
-                                    ide_task_get_cancellable (task),
-                                    gbp_code_index_executor_run_cb,
-                                    g_object_ref (task));
+  if (state->n_active == 0)
+    ide_task_return_boolean (task, TRUE);
 }
 
 void
@@ -217,6 +254,7 @@ gbp_code_index_executor_execute_async (GbpCodeIndexExecutor *self,
 {
   g_autoptr(IdeTask) task = NULL;
   g_autoptr(IdeContext) context = NULL;
+  g_autoptr(GSettings) settings = NULL;
   Execute *state;
 
   IDE_ENTRY;
@@ -247,6 +285,14 @@ gbp_code_index_executor_execute_async (GbpCodeIndexExecutor *self,
   state->pos = 0;
   ide_task_set_task_data (task, state, execute_free);
 
+  /* Indexers in this process use the indexer thread pool too, so keep it
+   * in sync with the number of workers we schedule for.
+   */
+  settings = g_settings_new ("org.gnome.builder.code-insight");
+  ide_thread_pool_set_max_threads (IDE_THREAD_POOL_INDEXER,
+                                   g_settings_get_uint (settings, "indexer-workers"));
+  state->n_workers = ide_thread_pool_get_max_threads (IDE_THREAD_POOL_INDEXER);
+
   ide_notification_set_has_progress (state->notif, TRUE);
   ide_notification_set_progress (state->notif, 0.0);
   ide_notification_set_progress_is_imprecise (state->notif, FALSE);
@@ -255,16 +301,7 @@ gbp_code_index_executor_execute_async (GbpCodeIndexExecutor *self,
                                gbp_code_index_executor_collect_cb,
                                task);
 
-  if (state->builders->len == 0)
-    {
-      ide_task_return_boolean (task, TRUE);
-      IDE_EXIT;
-    }
-
-  gbp_code_index_builder_run_async (g_ptr_array_index (state->builders, 0),
-                                    cancellable,
-                                    gbp_code_index_executor_run_cb,
-                                    g_steal_pointer (&task));
+  gbp_code_index_executor_run_next (task);
 
   IDE_EXIT;
 }
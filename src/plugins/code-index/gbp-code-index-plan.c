@@ -460,7 +460,8 @@ gbp_code_index_plan_populate_worker (IdeTask      *task,
                                G_FILE_ATTRIBUTE_STANDARD_NAME","
                                G_FILE_ATTRIBUTE_STANDARD_SIZE","
                                G_FILE_ATTRIBUTE_STANDARD_TYPE","
-                               G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                               G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                               G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
                                ".noindex",
                                cancellable,
                                gbp_code_index_plan_populate_cb,
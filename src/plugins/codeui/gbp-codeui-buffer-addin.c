@@ -41,9 +41,6 @@ gbp_codeui_buffer_addin_queue_diagnose (GbpCodeuiBufferAddin *self,
 {
   g_autoptr(IdeContext) context = NULL;
   IdeDiagnosticsManager *manager;
-  g_autoptr(GBytes) contents = NULL;
-  const gchar *lang_id;
-  GFile *file;
 
   g_assert (IDE_IS_MAIN_THREAD ());
   g_assert (GBP_IS_CODEUI_BUFFER_ADDIN (self));
@@ -51,24 +48,25 @@ gbp_codeui_buffer_addin_queue_diagnose (GbpCodeuiBufferAddin *self,
 
   context = ide_buffer_ref_context (buffer);
   manager = ide_diagnostics_manager_from_context (context);
-  file = ide_buffer_get_file (buffer);
-  lang_id = ide_buffer_get_language_id (buffer);
-  contents = ide_buffer_dup_content (buffer);
 
-  _ide_diagnostics_manager_file_changed (manager, file, contents, lang_id);
+  _ide_diagnostics_manager_buffer_changed (manager, buffer);
 }
 
 static void
-gbp_codeui_buffer_addin_change_settled (IdeBufferAddin *addin,
-                                        IdeBuffer      *buffer)
+gbp_codeui_buffer_addin_buffer_changed_cb (GbpCodeuiBufferAddin *self,
+                                           IdeBuffer            *buffer)
 {
-  GbpCodeuiBufferAddin *self = (GbpCodeuiBufferAddin *)addin;
-
   g_assert (IDE_IS_MAIN_THREAD ());
   g_assert (GBP_IS_CODEUI_BUFFER_ADDIN (self));
   g_assert (IDE_IS_BUFFER (buffer));
 
-  gbp_codeui_buffer_addin_queue_diagnose (self, buffer);
+  /*
+   * The diagnostics manager delays the diagnosis based on how long it
+   * takes for this file, so it is told about every change rather than
+   * when the buffer settles. File loading is handled in file_loaded().
+   */
+  if (!ide_buffer_get_loading (buffer))
+    gbp_codeui_buffer_addin_queue_diagnose (self, buffer);
 }
 
 static void
@@ -93,6 +91,7 @@ gbp_codeui_buffer_addin_file_loaded (IdeBufferAddin *addin,
   lang_id = ide_buffer_get_language_id (buffer);
 
   _ide_diagnostics_manager_file_opened (manager, file, lang_id);
+  _ide_diagnostics_manager_buffer_changed (manager, buffer);
 }
 
 static void
@@ -169,6 +168,12 @@ gbp_codeui_buffer_addin_load (IdeBufferAddin *addin,
 
   self->buffer = g_object_ref (buffer);
 
+  g_signal_connect_object (buffer,
+                           "changed",
+                           G_CALLBACK (gbp_codeui_buffer_addin_buffer_changed_cb),
+                           self,
+                           G_CONNECT_SWAPPED);
+
   g_signal_connect_object (manager,
                            "changed",
                            G_CALLBACK (gbp_codeui_buffer_addin_changed_cb),
@@ -193,6 +198,9 @@ gbp_codeui_buffer_addin_unload (IdeBufferAddin *addin,
   manager = ide_diagnostics_manager_from_context (context);
   file = ide_buffer_get_file (buffer);
 
+  g_signal_handlers_disconnect_by_func (buffer,
+                                        G_CALLBACK (gbp_codeui_buffer_addin_buffer_changed_cb),
+                                        self);
   g_signal_handlers_disconnect_by_func (manager,
                                         G_CALLBACK (gbp_codeui_buffer_addin_changed_cb),
                                         self);
@@ -205,7 +213,6 @@ gbp_codeui_buffer_addin_unload (IdeBufferAddin *addin,
 static void
 buffer_addin_iface_init (IdeBufferAddinInterface *iface)
 {
-  iface->change_settled = gbp_codeui_buffer_addin_change_settled;
   iface->file_saved = gbp_codeui_buffer_addin_file_saved;
   iface->file_loaded = gbp_codeui_buffer_addin_file_loaded;
   iface->language_set = gbp_codeui_buffer_addin_language_set;
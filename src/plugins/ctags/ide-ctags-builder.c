@@ -23,6 +23,7 @@
 #include <libide-vcs.h>
 
 #include "ide-ctags-builder.h"
+#include "ide-ctags-index.h"
 
 struct _IdeCtagsBuilder
 {
@@ -241,6 +242,13 @@ finish_subprocess:
       return FALSE;
     }
 
+  /* Save loading the index from having to parse and sort the tags */
+  if (!ide_ctags_index_write_sidecar (tags_file, cancellable, &error))
+    {
+      g_debug ("Failed to write ctags index for %s: %s", tags_path, error->message);
+      g_clear_error (&error);
+    }
+
   for (guint i = 0; i < directories->len; i++)
     {
       GFile *child = g_ptr_array_index (directories, i);
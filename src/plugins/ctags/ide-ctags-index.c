@@ -21,7 +21,9 @@
 #define G_LOG_DOMAIN "ide-ctags-index"
 
 #include <dazzle.h>
+#include <errno.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -41,8 +43,54 @@ struct _IdeCtagsIndex
   gchar     *path_root;
 
   guint64    mtime;
+
+  /* Set when the entries point into a mapped sidecar */
+  guint      is_mapped : 1;
+
+  /* Position of the first entry whose name starts with a byte >= the
+   * array position, so that lookups only search entries sharing the
+   * first character of the keyword.
+   */
+  guint32    first_byte[257];
 };
 
+/*
+ * The sidecar is written next to the tags file (as "tags.idx") by
+ * IdeCtagsBuilder. It contains the entries already sorted, with each
+ * field stored as a NUL-terminated string in a string pool, so loading
+ * it only requires mapping the file and pointing entries into it. It
+ * also records the size and mtime (with nanoseconds, as ctags may rewrite
+ * the file within the same second) of the tags file it was created from
+ * so that a stale sidecar is ignored in favor of the text format.
+ */
+
+#define SIDECAR_MAGIC   "IDECTAGS"
+#define SIDECAR_VERSION 2
+#define SIDECAR_NONE    G_MAXUINT32
+
+typedef struct
+{
+  gchar   magic[8];
+  guint32 version;
+  guint32 n_entries;
+  guint64 tags_size;
+  guint64 tags_mtime;
+  guint64 entries_offset;
+  guint64 strings_offset;
+  guint64 strings_length;
+  guint32 first_byte[257];
+  guint32 tags_mtime_nsec;
+} SidecarHeader;
+
+typedef struct
+{
+  guint32 name;
+  guint32 path;
+  guint32 pattern;
+  guint32 keyval;
+  guint32 kind;
+} SidecarEntry;
+
 enum {
   PROP_0,
   PROP_FILE,
@@ -188,32 +236,16 @@ ide_ctags_index_parse_line (gchar              *line,
   return TRUE;
 }
 
-static void
-ide_ctags_index_build_index (IdeTask      *task,
-                             gpointer      source_object,
-                             gpointer      task_data,
-                             GCancellable *cancellable)
+static GArray *
+ide_ctags_index_parse (gchar *contents,
+                       gsize  length)
 {
-  IdeCtagsIndex *self = source_object;
-  g_autoptr(GError) error = NULL;
   IdeLineReader reader;
-  GArray *index = NULL;
-  gchar *contents = NULL;
+  GArray *index;
   gchar *line;
-  gsize length = 0;
   gsize line_length;
 
-  IDE_ENTRY;
-
-  g_assert (IDE_IS_TASK (task));
-  g_assert (IDE_IS_CTAGS_INDEX (self));
-  g_assert (G_IS_FILE (self->file));
-
-  if (!g_file_load_contents (self->file, cancellable, &contents, &length, NULL, &error))
-    IDE_GOTO (failure);
-
-  if (length > G_MAXSSIZE)
-    IDE_GOTO (failure);
+  g_assert (contents != NULL);
 
   index = g_array_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry));
 
@@ -244,11 +276,175 @@ ide_ctags_index_build_index (IdeTask      *task,
 
   g_array_sort (index, ide_ctags_index_entry_compare);
 
+  return index;
+}
+
+static void
+build_first_byte (GArray  *index,
+                  guint32 *first_byte)
+{
+  guint pos = 0;
+
+  g_assert (index != NULL);
+  g_assert (first_byte != NULL);
+
+  for (guint c = 0; c < 256; c++)
+    {
+      while (pos < index->len &&
+             (guchar)g_array_index (index, IdeCtagsIndexEntry, pos).name[0] < c)
+        pos++;
+      first_byte[c] = pos;
+    }
+
+  first_byte[256] = index->len;
+}
+
+static gchar *
+get_sidecar_path (GFile *file)
+{
+  g_autofree gchar *path = g_file_get_path (file);
+
+  if (path == NULL)
+    return NULL;
+
+  return g_strdup_printf ("%s.idx", path);
+}
+
+static gboolean
+ide_ctags_index_load_sidecar (IdeCtagsIndex *self)
+{
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *sidecar_path = NULL;
+  const SidecarHeader *header;
+  const SidecarEntry *entries;
+  const gchar *strings;
+  const gchar *data;
+  GArray *index;
+  GStatBuf st;
+  gsize length;
+
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+
+  if (!(sidecar_path = get_sidecar_path (self->file)) ||
+      !(path = g_file_get_path (self->file)) ||
+      g_stat (path, &st) != 0 ||
+      !(mf = g_mapped_file_new (sidecar_path, FALSE, NULL)))
+    return FALSE;
+
+  bytes = g_mapped_file_get_bytes (mf);
+  data = g_bytes_get_data (bytes, &length);
+  header = (const SidecarHeader *)(gconstpointer)data;
+
+  if (length < sizeof *header ||
+      memcmp (header->magic, SIDECAR_MAGIC, sizeof header->magic) != 0 ||
+      header->version != SIDECAR_VERSION ||
+      header->tags_size != (guint64)st.st_size ||
+      header->tags_mtime != (guint64)st.st_mtime ||
+      header->tags_mtime_nsec != (guint32)st.st_mtim.tv_nsec ||
+      header->entries_offset != sizeof *header ||
+      header->strings_offset != header->entries_offset + (guint64)header->n_entries * sizeof (SidecarEntry) ||
+      header->strings_offset + header->strings_length != length ||
+      header->strings_length == 0 ||
+      header->strings_length > SIDECAR_NONE ||
+      data[length - 1] != '\0' ||
+      header->first_byte[256] != header->n_entries)
+    {
+      g_debug ("Ignoring stale or invalid sidecar %s", sidecar_path);
+      return FALSE;
+    }
+
+  /* Lookups use the first_byte table to index entries, so it must be
+   * non-decreasing and within bounds to be trusted.
+   */
+  for (guint c = 0; c < 256; c++)
+    {
+      if (header->first_byte[c] > header->first_byte[c + 1] ||
+          header->first_byte[c] > header->n_entries)
+        {
+          g_debug ("Ignoring sidecar %s with an invalid first byte table", sidecar_path);
+          return FALSE;
+        }
+    }
+
+  entries = (const SidecarEntry *)(gconstpointer)(data + header->entries_offset);
+  strings = data + header->strings_offset;
+
+  /* Since the string pool is terminated, every offset within it points
+   * at a valid C string. All that is left is to check the bounds.
+   */
+  index = g_array_sized_new (FALSE, FALSE, sizeof (IdeCtagsIndexEntry), header->n_entries);
+  g_array_set_size (index, header->n_entries);
+
+  for (guint32 i = 0; i < header->n_entries; i++)
+    {
+      const SidecarEntry *se = &entries[i];
+      IdeCtagsIndexEntry *entry = &g_array_index (index, IdeCtagsIndexEntry, i);
+
+      if (se->name >= header->strings_length ||
+          se->path >= header->strings_length ||
+          se->pattern >= header->strings_length ||
+          (se->keyval != SIDECAR_NONE && se->keyval >= header->strings_length))
+        {
+          g_array_unref (index);
+          return FALSE;
+        }
+
+      entry->name = strings + se->name;
+      entry->path = strings + se->path;
+      entry->pattern = strings + se->pattern;
+      entry->keyval = se->keyval != SIDECAR_NONE ? strings + se->keyval : NULL;
+      entry->kind = se->kind;
+      memset (entry->padding, 0, sizeof entry->padding);
+    }
+
+  memcpy (self->first_byte, header->first_byte, sizeof self->first_byte);
+
+  self->index = index;
+  self->buffer = g_steal_pointer (&bytes);
+  self->is_mapped = TRUE;
+
+  return TRUE;
+}
+
+static void
+ide_ctags_index_build_index (IdeTask      *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  IdeCtagsIndex *self = source_object;
+  g_autoptr(GError) error = NULL;
+  GArray *index = NULL;
+  gchar *contents = NULL;
+  gsize length = 0;
+
+  IDE_ENTRY;
+
+  g_assert (IDE_IS_TASK (task));
+  g_assert (IDE_IS_CTAGS_INDEX (self));
+  g_assert (G_IS_FILE (self->file));
+
+  /* Prefer the pre-sorted binary form which requires no parsing */
+  if (ide_ctags_index_load_sidecar (self))
+    IDE_GOTO (loaded);
+
+  if (!g_file_load_contents (self->file, cancellable, &contents, &length, NULL, &error))
+    IDE_GOTO (failure);
+
+  if (length > G_MAXSSIZE)
+    IDE_GOTO (failure);
+
+  index = ide_ctags_index_parse (contents, length);
+  build_first_byte (index, self->first_byte);
+
   self->index = index;
   self->buffer = g_bytes_new_take (contents, length);
 
-  DZL_COUNTER_ADD (index_entries, (gint64)index->len);
-  DZL_COUNTER_ADD (heap_size, (gint64)length);
+loaded:
+  DZL_COUNTER_ADD (index_entries, (gint64)self->index->len);
+  DZL_COUNTER_ADD (heap_size, (gint64)g_bytes_get_size (self->buffer));
 
   ide_task_return_boolean (task, TRUE);
 
@@ -269,6 +465,146 @@ failure:
   IDE_EXIT;
 }
 
+static guint32
+append_string (GByteArray  *strings,
+               const gchar *str)
+{
+  guint32 offset = strings->len;
+
+  g_byte_array_append (strings, (const guint8 *)str, strlen (str) + 1);
+
+  return offset;
+}
+
+/**
+ * ide_ctags_index_write_sidecar:
+ * @file: a #GFile containing ctags data
+ * @cancellable: (nullable): a #GCancellable
+ * @error: a location for a #GError, or %NULL
+ *
+ * Parses @file and writes the binary form of the index next to it, so
+ * that future loads of @file can map it rather than parse and sort the
+ * text format.
+ *
+ * This function performs blocking I/O and should be called from a thread.
+ *
+ * Returns: %TRUE if successful; otherwise %FALSE and @error is set.
+ */
+gboolean
+ide_ctags_index_write_sidecar (GFile         *file,
+                               GCancellable  *cancellable,
+                               GError       **error)
+{
+  g_autoptr(GFileOutputStream) stream = NULL;
+  g_autoptr(GHashTable) paths = NULL;
+  g_autoptr(GByteArray) strings = NULL;
+  g_autoptr(GArray) entries = NULL;
+  g_autoptr(GArray) index = NULL;
+  g_autoptr(GFile) sidecar = NULL;
+  g_autofree gchar *contents = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *sidecar_path = NULL;
+  SidecarHeader header = {{0}};
+  const gchar *last_name = NULL;
+  guint32 last_name_offset = 0;
+  GStatBuf st;
+  gsize length;
+
+  g_return_val_if_fail (G_IS_FILE (file), FALSE);
+  g_return_val_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable), FALSE);
+
+  if (!(path = g_file_get_path (file)) || !(sidecar_path = get_sidecar_path (file)))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "Only local tags files are supported");
+      return FALSE;
+    }
+
+  /* Stat before reading so a concurrent write leaves a stale sidecar */
+  if (g_stat (path, &st) != 0)
+    {
+      int errsv = errno;
+      g_set_error_literal (error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errsv),
+                           g_strerror (errsv));
+      return FALSE;
+    }
+
+  if (!g_file_get_contents (path, &contents, &length, error))
+    return FALSE;
+
+  index = ide_ctags_index_parse (contents, length);
+  entries = g_array_sized_new (FALSE, FALSE, sizeof (SidecarEntry), index->len);
+  strings = g_byte_array_new ();
+  paths = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Paths are shared by every tag within a file and names are repeated
+   * for overloads, so only store them once.
+   */
+  for (guint i = 0; i < index->len; i++)
+    {
+      const IdeCtagsIndexEntry *entry = &g_array_index (index, IdeCtagsIndexEntry, i);
+      SidecarEntry se;
+      gpointer offset;
+
+      if (last_name != NULL && strcmp (last_name, entry->name) == 0)
+        se.name = last_name_offset;
+      else
+        se.name = last_name_offset = append_string (strings, (last_name = entry->name));
+
+      if (g_hash_table_lookup_extended (paths, entry->path, NULL, &offset))
+        se.path = GPOINTER_TO_UINT (offset);
+      else
+        g_hash_table_insert (paths,
+                             (gchar *)entry->path,
+                             GUINT_TO_POINTER ((se.path = append_string (strings, entry->path))));
+
+      se.pattern = append_string (strings, entry->pattern);
+      se.keyval = entry->keyval ? append_string (strings, entry->keyval) : SIDECAR_NONE;
+      se.kind = entry->kind;
+
+      g_array_append_val (entries, se);
+
+      if (strings->len >= SIDECAR_NONE)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_NOT_SUPPORTED,
+                       "Tags file is too large for the index format");
+          return FALSE;
+        }
+    }
+
+  /* Keep the string pool terminated even when there are no entries */
+  if (strings->len == 0)
+    append_string (strings, "");
+
+  memcpy (header.magic, SIDECAR_MAGIC, sizeof header.magic);
+  header.version = SIDECAR_VERSION;
+  header.n_entries = index->len;
+  header.tags_size = st.st_size;
+  header.tags_mtime = st.st_mtime;
+  header.tags_mtime_nsec = st.st_mtim.tv_nsec;
+  header.entries_offset = sizeof header;
+  header.strings_offset = header.entries_offset + (guint64)entries->len * sizeof (SidecarEntry);
+  header.strings_length = strings->len;
+  build_first_byte (index, header.first_byte);
+
+  sidecar = g_file_new_for_path (sidecar_path);
+
+  if (!(stream = g_file_replace (sidecar, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, cancellable, error)) ||
+      !g_output_stream_write_all (G_OUTPUT_STREAM (stream), &header, sizeof header, NULL, cancellable, error) ||
+      !g_output_stream_write_all (G_OUTPUT_STREAM (stream), entries->data, entries->len * sizeof (SidecarEntry), NULL, cancellable, error) ||
+      !g_output_stream_write_all (G_OUTPUT_STREAM (stream), strings->data, strings->len, NULL, cancellable, error) ||
+      !g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, error))
+    return FALSE;
+
+  return TRUE;
+}
+
 GFile *
 ide_ctags_index_get_file (IdeCtagsIndex *self)
 {
@@ -516,6 +852,8 @@ ide_ctags_index_lookup_full (IdeCtagsIndex *self,
 {
   IdeCtagsIndexEntry key = { 0 };
   IdeCtagsIndexEntry *ret;
+  guint begin;
+  guint end;
 
   g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), NULL);
   g_return_val_if_fail (keyword != NULL, NULL);
@@ -528,9 +866,24 @@ ide_ctags_index_lookup_full (IdeCtagsIndex *self,
 
   key.name = keyword;
 
+  /* Narrow the search to entries sharing the first byte of @keyword */
+  if (keyword[0] != '\0')
+    {
+      begin = self->first_byte[(guchar)keyword[0]];
+      end = self->first_byte[(guchar)keyword[0] + 1];
+    }
+  else
+    {
+      begin = 0;
+      end = self->index->len;
+    }
+
+  if (begin >= end)
+    return NULL;
+
   ret = bsearch (&key,
-                 self->index->data,
-                 self->index->len,
+                 &g_array_index (self->index, IdeCtagsIndexEntry, begin),
+                 end - begin,
                  sizeof (IdeCtagsIndexEntry),
                  compare_func);
 
@@ -541,8 +894,8 @@ ide_ctags_index_lookup_full (IdeCtagsIndex *self,
       gsize count = 0;
       gsize i;
 
-      first = &g_array_index (self->index, IdeCtagsIndexEntry, 0);
-      last = &g_array_index (self->index, IdeCtagsIndexEntry, self->index->len - 1);
+      first = &g_array_index (self->index, IdeCtagsIndexEntry, begin);
+      last = &g_array_index (self->index, IdeCtagsIndexEntry, end - 1);
 
       /*
        * We might be smack in the middle of a group of items that match this keyword.
@@ -677,3 +1030,20 @@ ide_ctags_index_get_is_empty (IdeCtagsIndex *self)
 
   return self->index == NULL || self->index->len == 0;
 }
+
+/**
+ * ide_ctags_index_get_is_mapped:
+ * @self: an #IdeCtagsIndex
+ *
+ * Checks if the index was loaded from the binary sidecar rather than by
+ * parsing the tags file.
+ *
+ * Returns: %TRUE if the entries point into a mapped sidecar
+ */
+gboolean
+ide_ctags_index_get_is_mapped (IdeCtagsIndex *self)
+{
+  g_return_val_if_fail (IDE_IS_CTAGS_INDEX (self), FALSE);
+
+  return self->is_mapped;
+}
@@ -78,6 +78,7 @@ gchar                    *ide_ctags_index_resolve_path  (IdeCtagsIndex
                                                          const gchar              *path);
 GFile                    *ide_ctags_index_get_file      (IdeCtagsIndex            *self);
 gboolean                  ide_ctags_index_get_is_empty  (IdeCtagsIndex            *self);
+gboolean                  ide_ctags_index_get_is_mapped (IdeCtagsIndex            *self);
 gsize                     ide_ctags_index_get_size      (IdeCtagsIndex            *self);
 const gchar              *ide_ctags_index_get_path_root (IdeCtagsIndex            *self);
 const IdeCtagsIndexEntry *ide_ctags_index_lookup        (IdeCtagsIndex            *self,
@@ -89,6 +90,9 @@ const IdeCtagsIndexEntry *ide_ctags_index_lookup_prefix (IdeCtagsIndex
 guint64                   ide_ctags_index_get_mtime     (IdeCtagsIndex            *self);
 gint                      ide_ctags_index_entry_compare (gconstpointer             a,
                                                          gconstpointer             b);
+gboolean                  ide_ctags_index_write_sidecar (GFile                    *file,
+                                                         GCancellable             *cancellable,
+                                                         GError                  **error);
 IdeCtagsIndexEntry       *ide_ctags_index_entry_copy    (const IdeCtagsIndexEntry *entry);
 void                      ide_ctags_index_entry_free    (IdeCtagsIndexEntry       *entry);
 
@@ -18,7 +18,10 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <fcntl.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
 
 #include "ide-ctags-index.h"
 
@@ -34,6 +37,7 @@ init_cb (GObject      *object,
   const IdeCtagsIndexEntry *entries;
   gsize n_entries = 0xFFFFFFFF;
   GError *error = NULL;
+  gboolean expect_mapped = GPOINTER_TO_INT (user_data);
   gboolean ret;
   gsize i;
 
@@ -47,6 +51,7 @@ init_cb (GObject      *object,
   g_assert (IDE_IS_CTAGS_INDEX (index));
 
   g_assert_cmpint (28, ==, ide_ctags_index_get_size (index));
+  g_assert_cmpint (expect_mapped, ==, ide_ctags_index_get_is_mapped (index));
 
   entries = ide_ctags_index_lookup (index, "__NOTHING_SHOULD_MATCH_THIS__", &n_entries);
   g_assert_cmpint (n_entries, ==, 0);
@@ -74,37 +79,106 @@ init_cb (GObject      *object,
 }
 
 static void
-test_ctags_basic (void)
+load_and_check (GFile    *test_file,
+                gboolean  expect_mapped)
 {
   IdeCtagsIndex *index;
-  GFile *test_file;
-  gchar *path;
 
   main_loop = g_main_loop_new (NULL, FALSE);
 
-  path = g_build_filename (TEST_DATA_DIR, "../../plugins/ctags", "test-tags", NULL);
-  test_file = g_file_new_for_path (path);
-
   index = ide_ctags_index_new (test_file, NULL, 0);
 
   g_async_initable_init_async (G_ASYNC_INITABLE (index),
                                G_PRIORITY_DEFAULT,
                                NULL,
                                init_cb,
-                               NULL);
+                               GINT_TO_POINTER (expect_mapped));
 
   g_main_loop_run (main_loop);
 
   g_object_unref (index);
+  g_clear_pointer (&main_loop, g_main_loop_unref);
+}
+
+static void
+test_ctags_basic (void)
+{
+  GFile *test_file;
+  gchar *path;
+
+  path = g_build_filename (TEST_DATA_DIR, "../../plugins/ctags", "test-tags", NULL);
+  test_file = g_file_new_for_path (path);
+
+  load_and_check (test_file, FALSE);
+
   g_free (path);
   g_object_unref (test_file);
 }
 
+static void
+test_ctags_sidecar (void)
+{
+  GFile *test_file;
+  GError *error = NULL;
+  gchar *contents = NULL;
+  gchar *path;
+  gchar *tmpdir;
+  gchar *tags_path;
+  gchar *sidecar_path;
+  struct timespec times[2];
+  GStatBuf st;
+  gsize len;
+  gboolean r;
+
+  path = g_build_filename (TEST_DATA_DIR, "../../plugins/ctags", "test-tags", NULL);
+  r = g_file_get_contents (path, &contents, &len, &error);
+  g_assert_no_error (error);
+  g_assert_true (r);
+
+  tmpdir = g_dir_make_tmp ("test-ctags-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  tags_path = g_build_filename (tmpdir, "tags", NULL);
+  sidecar_path = g_build_filename (tmpdir, "tags.idx", NULL);
+  r = g_file_set_contents (tags_path, contents, len, &error);
+  g_assert_no_error (error);
+  g_assert_true (r);
+
+  test_file = g_file_new_for_path (tags_path);
+  r = ide_ctags_index_write_sidecar (test_file, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (r);
+  g_assert_true (g_file_test (sidecar_path, G_FILE_TEST_IS_REGULAR));
+
+  load_and_check (test_file, TRUE);
+
+  /* Rewritten within the same second, so only the nanoseconds differ */
+  g_assert_cmpint (g_stat (tags_path, &st), ==, 0);
+  times[0] = st.st_atim;
+  times[1] = st.st_mtim;
+  times[1].tv_nsec = (times[1].tv_nsec + 1) % 1000000000;
+  g_assert_cmpint (utimensat (AT_FDCWD, tags_path, times, 0), ==, 0);
+
+  load_and_check (test_file, FALSE);
+
+  g_unlink (sidecar_path);
+  g_unlink (tags_path);
+  g_rmdir (tmpdir);
+
+  g_object_unref (test_file);
+  g_free (sidecar_path);
+  g_free (tags_path);
+  g_free (tmpdir);
+  g_free (contents);
+  g_free (path);
+}
+
 gint
 main (gint   argc,
       gchar *argv[])
 {
   g_test_init (&argc, &argv, NULL);
   g_test_add_func ("/Ide/CTags/basic", test_ctags_basic);
+  g_test_add_func ("/Ide/CTags/sidecar", test_ctags_sidecar);
   return g_test_run ();
 }
@@ -29,18 +29,60 @@
 #include "gbp-file-search-index.h"
 #include "gbp-file-search-result.h"
 
+typedef struct
+{
+  gchar     *relpath;
+  gint64     mtime;
+  GPtrArray *files;
+  GPtrArray *dirs;
+} DirEntry;
+
+/* The fuzzy index along with the directory listings it was built from,
+ * which are used to find what changed when a directory is rescanned.
+ */
+typedef struct
+{
+  DzlFuzzyMutableIndex *fuzzy;
+  GHashTable           *dirs;
+  gsize                 n_paths;
+  gint                  max_depth;
+} Tree;
+
 struct _GbpFileSearchIndex
 {
   IdeObject             parent_instance;
 
   GFile                *root_directory;
-  DzlFuzzyMutableIndex *fuzzy;
+  Tree                 *tree;
+
+  /* Directories (relative paths) which need to be rescanned. An empty
+   * string is the root directory. If @dirty_all is set, every directory
+   * is checked for changes instead.
+   */
+  GHashTable           *dirty;
+  gint64                dirty_since;
+  guint                 dirty_all : 1;
+  guint                 updating : 1;
+  guint                 needs_save : 1;
+  guint                 update_source;
+  guint                 save_source;
 
   gint                  max_depth;
 };
 
 G_DEFINE_TYPE (GbpFileSearchIndex, gbp_file_search_index, IDE_TYPE_OBJECT)
 
+DZL_DEFINE_COUNTER (index_size, "FileSearchIndex", "N Paths", "Number of paths in file search indexes")
+DZL_DEFINE_COUNTER (rebuilds, "FileSearchIndex", "N Rebuilds", "Number of times a file search index was loaded or built")
+DZL_DEFINE_COUNTER (rebuild_usec, "FileSearchIndex", "Rebuild Time", "Total time spent loading or building file search indexes (usec)")
+DZL_DEFINE_COUNTER (updates, "FileSearchIndex", "N Updates", "Number of incremental updates to file search indexes")
+DZL_DEFINE_COUNTER (update_usec, "FileSearchIndex", "Update Latency", "Total time from a change on disk to it being indexed (usec)")
+
+#define CACHE_VERSION        1
+#define CACHE_TYPE_STRING    "(usia(sxasas))"
+#define UPDATE_DELAY_MSEC    250
+#define SAVE_DELAY_SECONDS   10
+
 enum {
   PROP_0,
   PROP_ROOT_DIRECTORY,
@@ -50,6 +92,584 @@ enum {
 
 static GParamSpec *properties [LAST_PROP];
 
+static DirEntry *
+dir_entry_new (const gchar *relpath)
+{
+  DirEntry *entry;
+
+  entry = g_slice_new0 (DirEntry);
+  entry->relpath = g_strdup (relpath);
+  entry->files = g_ptr_array_new_with_free_func (g_free);
+  entry->dirs = g_ptr_array_new_with_free_func (g_free);
+
+  return entry;
+}
+
+static void
+dir_entry_free (DirEntry *entry)
+{
+  /* Listings are stolen from arrays as they are applied */
+  if (entry == NULL)
+    return;
+
+  g_clear_pointer (&entry->relpath, g_free);
+  g_clear_pointer (&entry->files, g_ptr_array_unref);
+  g_clear_pointer (&entry->dirs, g_ptr_array_unref);
+  g_slice_free (DirEntry, entry);
+}
+
+static gchar *
+join_path (const gchar *relpath,
+           const gchar *name)
+{
+  if (relpath[0] == 0)
+    return g_strdup (name);
+  return g_build_filename (relpath, name, NULL);
+}
+
+static gint
+get_depth (const gchar *relpath)
+{
+  gint depth = 0;
+
+  if (relpath[0] == 0)
+    return 0;
+
+  for (const gchar *c = relpath; *c; c++)
+    {
+      if (*c == G_DIR_SEPARATOR)
+        depth++;
+    }
+
+  return depth + 1;
+}
+
+static Tree *
+tree_new (gint max_depth)
+{
+  Tree *tree;
+
+  tree = g_slice_new0 (Tree);
+  tree->fuzzy = dzl_fuzzy_mutable_index_new (FALSE);
+  tree->dirs = g_hash_table_new_full (g_str_hash,
+                                      g_str_equal,
+                                      NULL,
+                                      (GDestroyNotify)dir_entry_free);
+  tree->max_depth = max_depth;
+
+  return tree;
+}
+
+static void
+tree_free (Tree *tree)
+{
+  DZL_COUNTER_SUB (index_size, (gint64)tree->n_paths);
+
+  g_clear_pointer (&tree->fuzzy, dzl_fuzzy_mutable_index_unref);
+  g_clear_pointer (&tree->dirs, g_hash_table_unref);
+  g_slice_free (Tree, tree);
+}
+
+static void
+tree_insert (Tree        *tree,
+             const gchar *key)
+{
+  dzl_fuzzy_mutable_index_insert (tree->fuzzy, key, NULL);
+  DZL_COUNTER_INC (index_size);
+  tree->n_paths++;
+}
+
+static void
+tree_remove (Tree        *tree,
+             const gchar *key)
+{
+  dzl_fuzzy_mutable_index_remove (tree->fuzzy, key);
+  DZL_COUNTER_DEC (index_size);
+  tree->n_paths--;
+}
+
+static void
+tree_remove_directory (Tree        *tree,
+                       const gchar *relpath)
+{
+  g_autofree gchar *key = g_strdup_printf ("%s%s", relpath, G_DIR_SEPARATOR_S);
+  DirEntry *entry;
+
+  tree_remove (tree, key);
+
+  if (!(entry = g_hash_table_lookup (tree->dirs, relpath)))
+    return;
+
+  for (guint i = 0; i < entry->files->len; i++)
+    {
+      g_autofree gchar *path = join_path (relpath, g_ptr_array_index (entry->files, i));
+      tree_remove (tree, path);
+    }
+
+  for (guint i = 0; i < entry->dirs->len; i++)
+    {
+      g_autofree gchar *path = join_path (relpath, g_ptr_array_index (entry->dirs, i));
+      tree_remove_directory (tree, path);
+    }
+
+  g_hash_table_remove (tree->dirs, relpath);
+}
+
+static GHashTable *
+names_to_set (GPtrArray *names)
+{
+  GHashTable *set = g_hash_table_new (g_str_hash, g_str_equal);
+
+  if (names != NULL)
+    {
+      for (guint i = 0; i < names->len; i++)
+        g_hash_table_add (set, g_ptr_array_index (names, i));
+    }
+
+  return set;
+}
+
+/*
+ * Replaces the contents known for a directory with @listing, inserting
+ * and removing only the paths which changed.
+ */
+static gboolean
+tree_apply (Tree     *tree,
+            DirEntry *listing)
+{
+  g_autoptr(GHashTable) old_files = NULL;
+  g_autoptr(GHashTable) old_dirs = NULL;
+  GHashTableIter iter;
+  const gchar *name;
+  DirEntry *old;
+  gboolean changed = FALSE;
+
+  g_assert (tree != NULL);
+  g_assert (listing != NULL);
+
+  old = g_hash_table_lookup (tree->dirs, listing->relpath);
+  old_files = names_to_set (old ? old->files : NULL);
+  old_dirs = names_to_set (old ? old->dirs : NULL);
+
+  for (guint i = 0; i < listing->files->len; i++)
+    {
+      name = g_ptr_array_index (listing->files, i);
+
+      if (!g_hash_table_remove (old_files, name))
+        {
+          g_autofree gchar *path = join_path (listing->relpath, name);
+          tree_insert (tree, path);
+          changed = TRUE;
+        }
+    }
+
+  for (guint i = 0; i < listing->dirs->len; i++)
+    {
+      name = g_ptr_array_index (listing->dirs, i);
+
+      if (!g_hash_table_remove (old_dirs, name))
+        {
+          g_autofree gchar *path = join_path (listing->relpath, name);
+          g_autofree gchar *key = g_strdup_printf ("%s%s", path, G_DIR_SEPARATOR_S);
+          tree_insert (tree, key);
+          changed = TRUE;
+        }
+    }
+
+  g_hash_table_iter_init (&iter, old_files);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&name, NULL))
+    {
+      g_autofree gchar *path = join_path (listing->relpath, name);
+      tree_remove (tree, path);
+      changed = TRUE;
+    }
+
+  g_hash_table_iter_init (&iter, old_dirs);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&name, NULL))
+    {
+      g_autofree gchar *path = join_path (listing->relpath, name);
+      tree_remove_directory (tree, path);
+      changed = TRUE;
+    }
+
+  /* Sets above reference names within @old, so release them first */
+  g_clear_pointer (&old_files, g_hash_table_unref);
+  g_clear_pointer (&old_dirs, g_hash_table_unref);
+
+  g_hash_table_replace (tree->dirs, listing->relpath, listing);
+
+  return changed;
+}
+
+static gboolean
+tree_is_listed (Tree        *tree,
+                const gchar *relpath)
+{
+  g_autofree gchar *dirname = NULL;
+  g_autofree gchar *name = NULL;
+  DirEntry *parent;
+
+  if (relpath[0] == 0)
+    return TRUE;
+
+  dirname = g_path_get_dirname (relpath);
+  name = g_path_get_basename (relpath);
+
+  if (!(parent = g_hash_table_lookup (tree->dirs, g_str_equal (dirname, ".") ? "" : dirname)))
+    return FALSE;
+
+  for (guint i = 0; i < parent->dirs->len; i++)
+    {
+      if (g_str_equal (name, g_ptr_array_index (parent->dirs, i)))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Applies listings ordered parents first, dropping those for directories
+ * which an earlier listing removed from the tree.
+ */
+static gboolean
+tree_apply_listings (Tree      *tree,
+                     GPtrArray *listings)
+{
+  gboolean changed = FALSE;
+
+  for (guint i = 0; i < listings->len; i++)
+    {
+      DirEntry *listing = g_steal_pointer (&listings->pdata[i]);
+
+      if (tree_is_listed (tree, listing->relpath))
+        changed |= tree_apply (tree, listing);
+      else
+        dir_entry_free (listing);
+    }
+
+  return changed;
+}
+
+static gboolean
+query_mtime (GFile        *directory,
+             GCancellable *cancellable,
+             gint64       *mtime)
+{
+  g_autoptr(GFileInfo) info = NULL;
+
+  info = g_file_query_info (directory,
+                            G_FILE_ATTRIBUTE_STANDARD_TYPE","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                            cancellable,
+                            NULL);
+
+  if (info == NULL || g_file_info_get_file_type (info) != G_FILE_TYPE_DIRECTORY)
+    return FALSE;
+
+  *mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+           g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+  return TRUE;
+}
+
+/*
+ * Reads a single directory. Subdirectories are only listed if they are
+ * within the allowed depth of the index. The mtime is queried before
+ * enumerating so that changes made while enumerating are noticed the
+ * next time the directory is checked.
+ */
+static DirEntry *
+read_directory (IdeVcs       *vcs,
+                GFile        *root,
+                const gchar  *relpath,
+                gint          max_depth,
+                GCancellable *cancellable)
+{
+  g_autoptr(GFileEnumerator) enumerator = NULL;
+  g_autoptr(GFile) directory = NULL;
+  DirEntry *entry;
+  gpointer file_info_ptr;
+  gboolean with_dirs;
+  gint depth;
+  gint64 mtime;
+
+  g_assert (G_IS_FILE (root));
+  g_assert (relpath != NULL);
+
+  depth = get_depth (relpath);
+
+  if (depth >= max_depth)
+    return NULL;
+
+  with_dirs = depth + 1 < max_depth;
+  directory = relpath[0] ? g_file_get_child (root, relpath) : g_object_ref (root);
+
+  if (ide_vcs_is_ignored (vcs, directory, NULL) ||
+      !query_mtime (directory, cancellable, &mtime))
+    return NULL;
+
+  enumerator = g_file_enumerate_children (directory,
+                                          G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK","
+                                          G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME","
+                                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                          cancellable,
+                                          NULL);
+
+  if (enumerator == NULL)
+    return NULL;
+
+  entry = dir_entry_new (relpath);
+  entry->mtime = mtime;
+
+  while ((file_info_ptr = g_file_enumerator_next_file (enumerator, cancellable, NULL)))
+    {
+      g_autoptr(GFileInfo) file_info = file_info_ptr;
+      g_autoptr(GFile) file = NULL;
+      GFileType file_type;
+      const gchar *name;
+
+      if (g_file_info_get_is_symlink (file_info))
+        continue;
+
+      name = g_file_info_get_display_name (file_info);
+      file_type = g_file_info_get_file_type (file_info);
+
+      /* We only want to index regular files, and ignore symlinks.  If the
+       * symlink points to something else in-tree, we'll index it in the
+       * rightful place.
+       */
+      if (file_type != G_FILE_TYPE_REGULAR &&
+          (file_type != G_FILE_TYPE_DIRECTORY || !with_dirs))
+        continue;
+
+      file = g_file_get_child (directory, name);
+
+      if (ide_vcs_is_ignored (vcs, file, NULL))
+        continue;
+
+      if (file_type == G_FILE_TYPE_DIRECTORY)
+        g_ptr_array_add (entry->dirs, g_strdup (name));
+      else
+        g_ptr_array_add (entry->files, g_strdup (name));
+    }
+
+  return entry;
+}
+
+static void
+scan_directory (IdeVcs       *vcs,
+                GFile        *root,
+                const gchar  *relpath,
+                gint          max_depth,
+                GCancellable *cancellable,
+                GPtrArray    *listings)
+{
+  DirEntry *entry;
+
+  g_assert (listings != NULL);
+
+  if (g_cancellable_is_cancelled (cancellable))
+    return;
+
+  if (!(entry = read_directory (vcs, root, relpath, max_depth, cancellable)))
+    return;
+
+  g_ptr_array_add (listings, entry);
+
+  for (guint i = 0; i < entry->dirs->len; i++)
+    {
+      g_autofree gchar *path = join_path (relpath, g_ptr_array_index (entry->dirs, i));
+      scan_directory (vcs, root, path, max_depth, cancellable, listings);
+    }
+}
+
+typedef struct
+{
+  IdeVcs      *vcs;
+  GFile       *root;
+  gchar       *cache_path;
+  GHashTable  *known;
+  GPtrArray   *check;
+  GPtrArray   *listings;
+  Tree        *tree;
+  gint64       begin;
+  gint         max_depth;
+  guint        force : 1;
+} Update;
+
+static void
+update_free (Update *update)
+{
+  g_clear_object (&update->vcs);
+  g_clear_object (&update->root);
+  g_clear_pointer (&update->cache_path, g_free);
+  g_clear_pointer (&update->known, g_hash_table_unref);
+  g_clear_pointer (&update->check, g_ptr_array_unref);
+  g_clear_pointer (&update->listings, g_ptr_array_unref);
+  g_clear_pointer (&update->tree, tree_free);
+  g_slice_free (Update, update);
+}
+
+static gint
+compare_paths (gconstpointer a,
+               gconstpointer b)
+{
+  return strcmp (*(const gchar * const *)a, *(const gchar * const *)b);
+}
+
+/*
+ * Collects new listings for the directories in @update->check which have
+ * changed (or all of them if @update->force is set). Directories which
+ * were not previously known are scanned recursively. Listings are
+ * ordered so that parents come before their children.
+ */
+static void
+collect_changes (Update       *update,
+                 GCancellable *cancellable)
+{
+  g_assert (update != NULL);
+  g_assert (update->check != NULL);
+  g_assert (update->known != NULL);
+
+  g_ptr_array_sort (update->check, compare_paths);
+
+  for (guint i = 0; i < update->check->len; i++)
+    {
+      const gchar *relpath = g_ptr_array_index (update->check, i);
+      g_autoptr(GFile) directory = NULL;
+      const gint64 *known_mtime;
+      DirEntry *entry;
+      gint64 mtime;
+
+      if (g_cancellable_is_cancelled (cancellable))
+        return;
+
+      /* Removed directories are handled by their parent */
+      directory = relpath[0] ? g_file_get_child (update->root, relpath) : g_object_ref (update->root);
+      if (!query_mtime (directory, cancellable, &mtime))
+        continue;
+
+      known_mtime = g_hash_table_lookup (update->known, relpath);
+      if (!update->force && known_mtime != NULL && *known_mtime == mtime)
+        continue;
+
+      if (!(entry = read_directory (update->vcs, update->root, relpath, update->max_depth, cancellable)))
+        continue;
+
+      g_ptr_array_add (update->listings, entry);
+
+      for (guint j = 0; j < entry->dirs->len; j++)
+        {
+          g_autofree gchar *path = join_path (relpath, g_ptr_array_index (entry->dirs, j));
+
+          if (!g_hash_table_contains (update->known, path))
+            scan_directory (update->vcs, update->root, path, update->max_depth,
+                            cancellable, update->listings);
+        }
+    }
+}
+
+static gboolean
+load_cache (Update *update)
+{
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariantIter) dirs = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autofree gchar *root_path = NULL;
+  const gchar *cached_root = NULL;
+  const gchar *relpath;
+  const gchar **files;
+  const gchar **subdirs;
+  guint version = 0;
+  gint max_depth = 0;
+  gint64 mtime;
+
+  g_assert (update != NULL);
+  g_assert (update->tree != NULL);
+
+  if (update->cache_path == NULL ||
+      !(mf = g_mapped_file_new (update->cache_path, FALSE, NULL)))
+    return FALSE;
+
+  bytes = g_mapped_file_get_bytes (mf);
+  variant = g_variant_take_ref (g_variant_new_from_bytes (G_VARIANT_TYPE (CACHE_TYPE_STRING), bytes, FALSE));
+  root_path = g_file_get_path (update->root);
+
+  g_variant_get (variant, "(u&sia(sxasas))", &version, &cached_root, &max_depth, &dirs);
+
+  if (version != CACHE_VERSION ||
+      max_depth != update->max_depth ||
+      g_strcmp0 (root_path, cached_root) != 0)
+    return FALSE;
+
+  dzl_fuzzy_mutable_index_begin_bulk_insert (update->tree->fuzzy);
+
+  while (g_variant_iter_next (dirs, "(&sx^a&s^a&s)", &relpath, &mtime, &files, &subdirs))
+    {
+      DirEntry *entry = dir_entry_new (relpath);
+
+      entry->mtime = mtime;
+
+      for (guint i = 0; files[i]; i++)
+        g_ptr_array_add (entry->files, g_strdup (files[i]));
+
+      for (guint i = 0; subdirs[i]; i++)
+        g_ptr_array_add (entry->dirs, g_strdup (subdirs[i]));
+
+      tree_apply (update->tree, entry);
+
+      g_free (files);
+      g_free (subdirs);
+    }
+
+  dzl_fuzzy_mutable_index_end_bulk_insert (update->tree->fuzzy);
+
+  return g_hash_table_size (update->tree->dirs) > 0;
+}
+
+static GBytes *
+tree_serialize (Tree  *tree,
+                GFile *root)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autofree gchar *root_path = g_file_get_path (root);
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  DirEntry *entry;
+
+  g_assert (tree != NULL);
+  g_assert (G_IS_FILE (root));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sxasas)"));
+
+  g_hash_table_iter_init (&iter, tree->dirs);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry))
+    {
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("(sxasas)"));
+      g_variant_builder_add (&builder, "s", entry->relpath);
+      g_variant_builder_add (&builder, "x", entry->mtime);
+      g_variant_builder_add_value (&builder,
+                                   g_variant_new_strv ((const gchar * const *)entry->files->pdata,
+                                                       entry->files->len));
+      g_variant_builder_add_value (&builder,
+                                   g_variant_new_strv ((const gchar * const *)entry->dirs->pdata,
+                                                       entry->dirs->len));
+      g_variant_builder_close (&builder);
+    }
+
+  variant = g_variant_take_ref (g_variant_new ("(usia(sxasas))",
+                                               CACHE_VERSION,
+                                               root_path ? root_path : "",
+                                               tree->max_depth,
+                                               &builder));
+
+  return g_variant_get_data_as_bytes (variant);
+}
+
 static void
 gbp_file_search_index_set_root_directory (GbpFileSearchIndex *self,
                                          GFile             *root_directory)
@@ -59,19 +679,132 @@ gbp_file_search_index_set_root_directory (GbpFileSearchIndex *self,
 
   if (g_set_object (&self->root_directory, root_directory))
     {
-      g_clear_pointer (&self->fuzzy, dzl_fuzzy_mutable_index_unref);
+      g_clear_pointer (&self->tree, tree_free);
 
       g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_ROOT_DIRECTORY]);
     }
 }
 
+static gchar *
+gbp_file_search_index_get_cache_path (GbpFileSearchIndex *self)
+{
+  g_autoptr(IdeContext) context = NULL;
+
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (self));
+
+  if (!(context = ide_object_ref_context (IDE_OBJECT (self))))
+    return NULL;
+
+  return ide_context_cache_filename (context, "file-search", "index.gvariant", NULL);
+}
+
+static void
+gbp_file_search_index_save_cb (GObject      *object,
+                               GAsyncResult *result,
+                               gpointer      user_data)
+{
+  GFile *file = (GFile *)object;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (G_IS_FILE (file));
+  g_assert (G_IS_ASYNC_RESULT (result));
+
+  if (!g_file_replace_contents_finish (file, result, NULL, &error))
+    g_debug ("Failed to save file search index: %s", error->message);
+}
+
+static void
+gbp_file_search_index_save (GbpFileSearchIndex *self,
+                            gboolean            sync)
+{
+  g_autoptr(GFile) file = NULL;
+  g_autoptr(GFile) parent = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autofree gchar *path = NULL;
+
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (self));
+
+  g_clear_handle_id (&self->save_source, g_source_remove);
+
+  if (!self->needs_save || self->tree == NULL || self->root_directory == NULL)
+    return;
+
+  if (!(path = gbp_file_search_index_get_cache_path (self)))
+    return;
+
+  self->needs_save = FALSE;
+
+  bytes = tree_serialize (self->tree, self->root_directory);
+  file = g_file_new_for_path (path);
+  parent = g_file_get_parent (file);
+
+  g_file_make_directory_with_parents (parent, NULL, NULL);
+
+  if (sync)
+    g_file_replace_contents (file,
+                             g_bytes_get_data (bytes, NULL),
+                             g_bytes_get_size (bytes),
+                             NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL, NULL);
+  else
+    g_file_replace_contents_bytes_async (file,
+                                         bytes,
+                                         NULL,
+                                         FALSE,
+                                         G_FILE_CREATE_NONE,
+                                         NULL,
+                                         gbp_file_search_index_save_cb,
+                                         NULL);
+}
+
+static gboolean
+gbp_file_search_index_save_timeout (gpointer data)
+{
+  GbpFileSearchIndex *self = data;
+
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (self));
+
+  self->save_source = 0;
+  gbp_file_search_index_save (self, FALSE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+gbp_file_search_index_queue_save (GbpFileSearchIndex *self)
+{
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (self));
+
+  self->needs_save = TRUE;
+
+  if (self->save_source == 0)
+    self->save_source = g_timeout_add_seconds (SAVE_DELAY_SECONDS,
+                                               gbp_file_search_index_save_timeout,
+                                               self);
+}
+
+static void
+gbp_file_search_index_destroy (IdeObject *object)
+{
+  GbpFileSearchIndex *self = (GbpFileSearchIndex *)object;
+
+  /* Small enough to write out synchronously while shutting down */
+  if (self->needs_save)
+    gbp_file_search_index_save (self, TRUE);
+
+  g_clear_handle_id (&self->save_source, g_source_remove);
+  g_clear_handle_id (&self->update_source, g_source_remove);
+
+  IDE_OBJECT_CLASS (gbp_file_search_index_parent_class)->destroy (object);
+}
+
 static void
 gbp_file_search_index_finalize (GObject *object)
 {
   GbpFileSearchIndex *self = (GbpFileSearchIndex *)object;
 
   g_clear_object (&self->root_directory);
-  g_clear_pointer (&self->fuzzy, dzl_fuzzy_mutable_index_unref);
+  g_clear_pointer (&self->tree, tree_free);
+  g_clear_pointer (&self->dirty, g_hash_table_unref);
 
   G_OBJECT_CLASS (gbp_file_search_index_parent_class)->finalize (object);
 }
@@ -126,11 +859,14 @@ static void
 gbp_file_search_index_class_init (GbpFileSearchIndexClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  IdeObjectClass *i_object_class = IDE_OBJECT_CLASS (klass);
 
   object_class->finalize = gbp_file_search_index_finalize;
   object_class->get_property = gbp_file_search_index_get_property;
   object_class->set_property = gbp_file_search_index_set_property;
 
+  i_object_class->destroy = gbp_file_search_index_destroy;
+
   properties [PROP_ROOT_DIRECTORY] =
     g_param_spec_object ("root-directory",
                          "Root Directory",
@@ -148,152 +884,131 @@ gbp_file_search_index_class_init (GbpFileSearchIndexClass *klass)
 static void
 gbp_file_search_index_init (GbpFileSearchIndex *self)
 {
+  self->dirty = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
-static void
-populate_from_dir (DzlFuzzyMutableIndex *fuzzy,
-                   IdeVcs               *vcs,
-                   const gchar          *relpath,
-                   GFile                *directory,
-                   gint                  depth,
-                   GCancellable         *cancellable)
-{
-  GFileEnumerator *enumerator;
-  GPtrArray *children = NULL;
-  gpointer file_info_ptr;
+static Update *
+gbp_file_search_index_create_update (GbpFileSearchIndex *self)
+{
+  g_autoptr(IdeContext) context = NULL;
+  Update *update;
 
-  g_assert (fuzzy != NULL);
-  g_assert (G_IS_FILE (directory));
-  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (self));
+  g_assert (self->root_directory != NULL);
 
-  if (depth <= 0)
-    return;
+  context = ide_object_ref_context (IDE_OBJECT (self));
 
-  if (ide_vcs_is_ignored (vcs, directory, NULL))
-    return;
+  update = g_slice_new0 (Update);
+  update->vcs = ide_vcs_ref_from_context (context);
+  update->root = g_object_ref (self->root_directory);
+  update->max_depth = self->max_depth > 0 ? self->max_depth : G_MAXINT;
+  update->listings = g_ptr_array_new_with_free_func ((GDestroyNotify)dir_entry_free);
 
-  if (relpath != NULL)
-    {
-      g_autofree gchar *with_slash = g_strdup_printf ("%s%s", relpath, G_DIR_SEPARATOR_S);
-      dzl_fuzzy_mutable_index_insert (fuzzy, with_slash, NULL);
-    }
+  return update;
+}
 
-  enumerator = g_file_enumerate_children (directory,
-                                          G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK","
-                                          G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME","
-                                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
-                                          G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                          cancellable,
-                                          NULL);
+static void
+gbp_file_search_index_builder (IdeTask      *task,
+                              gpointer      source_object,
+                              gpointer      task_data,
+                              GCancellable *cancellable)
+{
+  Update *update = task_data;
+  gint64 begin;
+  gboolean changed = FALSE;
 
-  if (enumerator == NULL)
-    return;
+  g_assert (IDE_IS_TASK (task));
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (source_object));
+  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
+  g_assert (update != NULL);
 
-  while ((file_info_ptr = g_file_enumerator_next_file (enumerator, cancellable, NULL)))
-    {
-      g_autoptr(GFileInfo) file_info = file_info_ptr;
-      g_autofree gchar *path = NULL;
-      g_autoptr(GFile) file = NULL;
-      GFileType file_type;
-      const gchar *name;
+  begin = g_get_monotonic_time ();
 
-      if (g_file_info_get_is_symlink (file_info))
-        continue;
+  update->tree = tree_new (update->max_depth);
 
-      name = g_file_info_get_display_name (file_info);
-      file = g_file_get_child (directory, name);
+  /* Use the persisted index and only rescan the directories which have
+   * changed since it was saved. Otherwise crawl the whole tree.
+   */
+  if (load_cache (update))
+    {
+      GHashTableIter iter;
+      DirEntry *entry;
 
-      file_type = g_file_info_get_file_type (file_info);
+      update->known = g_hash_table_new (g_str_hash, g_str_equal);
+      update->check = g_ptr_array_new ();
 
-      if (file_type == G_FILE_TYPE_DIRECTORY)
+      g_hash_table_iter_init (&iter, update->tree->dirs);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry))
         {
-          if (children == NULL)
-            children = g_ptr_array_new_with_free_func (g_object_unref);
-          g_ptr_array_add (children, g_object_ref (file));
-          continue;
+          g_hash_table_insert (update->known, entry->relpath, &entry->mtime);
+          g_ptr_array_add (update->check, entry->relpath);
         }
 
-      /* We only want to index regular files, and ignore symlinks.  If the
-       * symlink points to something else in-tree, we'll index it in the
-       * rightful place.
-       */
-      if (file_type != G_FILE_TYPE_REGULAR)
-        continue;
+      collect_changes (update, cancellable);
 
-      if (ide_vcs_is_ignored (vcs, file, NULL))
-        continue;
+      /* known/check reference entries which tree_apply() may free */
+      g_clear_pointer (&update->known, g_hash_table_unref);
+      g_clear_pointer (&update->check, g_ptr_array_unref);
 
-      if (relpath != NULL)
-        name = path = g_build_filename (relpath, name, NULL);
+      changed = tree_apply_listings (update->tree, update->listings);
 
-      dzl_fuzzy_mutable_index_insert (fuzzy, name, NULL);
+      g_message ("File index loaded with %u changed directories in %lf seconds.",
+                 update->listings->len,
+                 (g_get_monotonic_time () - begin) / (gdouble)G_USEC_PER_SEC);
     }
-
-  g_clear_object (&enumerator);
-
-  if (children != NULL)
+  else
     {
-      gsize i;
+      g_clear_pointer (&update->tree, tree_free);
+      update->tree = tree_new (update->max_depth);
 
-      for (i = 0; i < children->len; i++)
-        {
-          g_autofree gchar *path = NULL;
-          g_autofree gchar *name = NULL;
-          GFile *child;
+      scan_directory (update->vcs, update->root, "", update->max_depth, cancellable, update->listings);
 
-          child = g_ptr_array_index (children, i);
-          name = g_file_get_basename (child);
+      dzl_fuzzy_mutable_index_begin_bulk_insert (update->tree->fuzzy);
+      tree_apply_listings (update->tree, update->listings);
+      dzl_fuzzy_mutable_index_end_bulk_insert (update->tree->fuzzy);
 
-          if (relpath != NULL)
-            path = g_build_filename (relpath, name, NULL);
+      changed = TRUE;
 
-          populate_from_dir (fuzzy, vcs, path ? path : name, child, depth - 1, cancellable);
-        }
+      g_message ("File index built in %lf seconds.",
+                 (g_get_monotonic_time () - begin) / (gdouble)G_USEC_PER_SEC);
     }
 
-  g_clear_pointer (&children, g_ptr_array_unref);
+  DZL_COUNTER_INC (rebuilds);
+  DZL_COUNTER_ADD (rebuild_usec, g_get_monotonic_time () - begin);
+
+  ide_task_return_boolean (task, changed);
 }
 
 static void
-gbp_file_search_index_builder (IdeTask      *task,
-                              gpointer      source_object,
-                              gpointer      task_data,
-                              GCancellable *cancellable)
+gbp_file_search_index_build_cb (GObject      *object,
+                                GAsyncResult *result,
+                                gpointer      user_data)
 {
-  GbpFileSearchIndex *self = source_object;
-  g_autoptr(GTimer) timer = NULL;
-  g_autoptr(IdeVcs) vcs = NULL;
-  g_autoptr(IdeContext) context = NULL;
-  GFile *directory = task_data;
-  DzlFuzzyMutableIndex *fuzzy;
-  gdouble elapsed;
-  gint max_depth;
+  GbpFileSearchIndex *self = (GbpFileSearchIndex *)object;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GError) error = NULL;
+  Update *update;
+  gboolean changed;
 
-  g_assert (IDE_IS_TASK (task));
   g_assert (GBP_IS_FILE_SEARCH_INDEX (self));
-  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
-  g_assert (G_IS_FILE (directory));
-
-  context = ide_object_ref_context (IDE_OBJECT (self));
-  vcs = ide_vcs_ref_from_context (context);
-
-  timer = g_timer_new ();
+  g_assert (IDE_IS_TASK (result));
+  g_assert (IDE_IS_TASK (task));
 
-  max_depth = self->max_depth;
-  if (max_depth <= 0)
-    max_depth = G_MAXINT;
+  changed = ide_task_propagate_boolean (IDE_TASK (result), &error);
 
-  fuzzy = dzl_fuzzy_mutable_index_new (FALSE);
-  dzl_fuzzy_mutable_index_begin_bulk_insert (fuzzy);
-  populate_from_dir (fuzzy, vcs, NULL, directory, max_depth, cancellable);
-  dzl_fuzzy_mutable_index_end_bulk_insert (fuzzy);
+  if (error != NULL)
+    {
+      ide_task_return_error (task, g_steal_pointer (&error));
+      return;
+    }
 
-  self->fuzzy = fuzzy;
+  update = ide_task_get_task_data (IDE_TASK (result));
 
-  g_timer_stop (timer);
-  elapsed = g_timer_elapsed (timer, NULL);
+  g_clear_pointer (&self->tree, tree_free);
+  self->tree = g_steal_pointer (&update->tree);
 
-  g_message ("File index built in %lf seconds.", elapsed);
+  if (changed)
+    gbp_file_search_index_queue_save (self);
 
   ide_task_return_boolean (task, TRUE);
 }
@@ -305,6 +1020,8 @@ gbp_file_search_index_build_async (GbpFileSearchIndex  *self,
                                    gpointer             user_data)
 {
   g_autoptr(IdeTask) task = NULL;
+  g_autoptr(IdeTask) worker = NULL;
+  Update *update;
 
   g_return_if_fail (GBP_IS_FILE_SEARCH_INDEX (self));
   g_return_if_fail (!cancellable || G_IS_CANCELLABLE (cancellable));
@@ -322,8 +1039,16 @@ gbp_file_search_index_build_async (GbpFileSearchIndex  *self,
       return;
     }
 
-  ide_task_set_task_data (task, g_object_ref (self->root_directory), g_object_unref);
-  ide_task_run_in_thread (task, gbp_file_search_index_builder);
+  update = gbp_file_search_index_create_update (self);
+  update->cache_path = gbp_file_search_index_get_cache_path (self);
+
+  /* The tree is swapped in from the main thread once it is complete */
+  worker = ide_task_new (self, cancellable, gbp_file_search_index_build_cb, g_steal_pointer (&task));
+  ide_task_set_source_tag (worker, gbp_file_search_index_builder);
+  ide_task_set_priority (worker, G_PRIORITY_LOW);
+  ide_task_set_kind (worker, IDE_TASK_KIND_IO);
+  ide_task_set_task_data (worker, update, update_free);
+  ide_task_run_in_thread (worker, gbp_file_search_index_builder);
 }
 
 gboolean
@@ -340,6 +1065,183 @@ gbp_file_search_index_build_finish (GbpFileSearchIndex  *self,
   return ide_task_propagate_boolean (task, error);
 }
 
+static void gbp_file_search_index_queue_update_source (GbpFileSearchIndex *self);
+
+static void
+gbp_file_search_index_update_worker (IdeTask      *task,
+                                     gpointer      source_object,
+                                     gpointer      task_data,
+                                     GCancellable *cancellable)
+{
+  Update *update = task_data;
+
+  g_assert (IDE_IS_TASK (task));
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (source_object));
+  g_assert (update != NULL);
+
+  collect_changes (update, cancellable);
+
+  ide_task_return_boolean (task, TRUE);
+}
+
+static void
+gbp_file_search_index_update_cb (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      user_data)
+{
+  GbpFileSearchIndex *self = (GbpFileSearchIndex *)object;
+  g_autoptr(GError) error = NULL;
+  Update *update;
+  gboolean changed = FALSE;
+
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (self));
+  g_assert (IDE_IS_TASK (result));
+
+  self->updating = FALSE;
+  update = ide_task_get_task_data (IDE_TASK (result));
+
+  if (!ide_task_propagate_boolean (IDE_TASK (result), &error))
+    {
+      g_debug ("Failed to update file search index: %s", error->message);
+      return;
+    }
+
+  if (self->tree != NULL)
+    changed = tree_apply_listings (self->tree, update->listings);
+
+  DZL_COUNTER_INC (updates);
+  DZL_COUNTER_ADD (update_usec, g_get_monotonic_time () - update->begin);
+
+  if (changed)
+    gbp_file_search_index_queue_save (self);
+
+  /* Pick up anything that changed while we were busy */
+  if (self->dirty_all || g_hash_table_size (self->dirty) > 0)
+    gbp_file_search_index_queue_update_source (self);
+}
+
+static gboolean
+gbp_file_search_index_update_timeout (gpointer data)
+{
+  GbpFileSearchIndex *self = data;
+  g_autoptr(IdeTask) task = NULL;
+  GHashTableIter iter;
+  DirEntry *entry;
+  Update *update;
+
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (self));
+
+  self->update_source = 0;
+
+  if (self->updating || self->tree == NULL || ide_object_in_destruction (IDE_OBJECT (self)))
+    return G_SOURCE_REMOVE;
+
+  update = gbp_file_search_index_create_update (self);
+  update->begin = self->dirty_since;
+  update->known = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  update->check = g_ptr_array_new_with_free_func (g_free);
+
+  /* Copy what the worker needs so the tree can be used meanwhile */
+  g_hash_table_iter_init (&iter, self->tree->dirs);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry))
+    g_hash_table_insert (update->known,
+                         g_strdup (entry->relpath),
+                         g_memdup2 (&entry->mtime, sizeof entry->mtime));
+
+  if (self->dirty_all)
+    {
+      g_hash_table_iter_init (&iter, self->tree->dirs);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&entry))
+        g_ptr_array_add (update->check, g_strdup (entry->relpath));
+    }
+  else
+    {
+      const gchar *relpath;
+
+      g_hash_table_iter_init (&iter, self->dirty);
+      while (g_hash_table_iter_next (&iter, (gpointer *)&relpath, NULL))
+        g_ptr_array_add (update->check, g_strdup (relpath));
+
+      update->force = TRUE;
+    }
+
+  g_hash_table_remove_all (self->dirty);
+  self->dirty_all = FALSE;
+  self->dirty_since = 0;
+  self->updating = TRUE;
+
+  task = ide_task_new (self, NULL, gbp_file_search_index_update_cb, NULL);
+  ide_task_set_source_tag (task, gbp_file_search_index_update_timeout);
+  ide_task_set_priority (task, G_PRIORITY_LOW);
+  ide_task_set_kind (task, IDE_TASK_KIND_IO);
+  ide_task_set_task_data (task, update, update_free);
+  ide_task_run_in_thread (task, gbp_file_search_index_update_worker);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+gbp_file_search_index_queue_update_source (GbpFileSearchIndex *self)
+{
+  g_assert (GBP_IS_FILE_SEARCH_INDEX (self));
+
+  if (self->dirty_since == 0)
+    self->dirty_since = g_get_monotonic_time ();
+
+  /* Coalesce bursts of events, such as when switching branches */
+  if (self->update_source == 0 && !self->updating)
+    self->update_source = g_timeout_add (UPDATE_DELAY_MSEC,
+                                         gbp_file_search_index_update_timeout,
+                                         self);
+}
+
+/**
+ * gbp_file_search_index_queue_update:
+ * @self: a #GbpFileSearchIndex
+ * @file: (nullable): a #GFile that changed, or %NULL
+ *
+ * Queues the directory containing @file to be rescanned. If @file is
+ * %NULL, every directory is checked and those whose modification time
+ * changed are rescanned.
+ */
+void
+gbp_file_search_index_queue_update (GbpFileSearchIndex *self,
+                                    GFile              *file)
+{
+  g_autoptr(GFile) parent = NULL;
+  g_autofree gchar *relpath = NULL;
+
+  g_return_if_fail (GBP_IS_FILE_SEARCH_INDEX (self));
+  g_return_if_fail (!file || G_IS_FILE (file));
+
+  if (self->root_directory == NULL || self->tree == NULL)
+    return;
+
+  if (file == NULL)
+    {
+      self->dirty_all = TRUE;
+      gbp_file_search_index_queue_update_source (self);
+      return;
+    }
+
+  if (!(parent = g_file_get_parent (file)))
+    return;
+
+  if (g_file_equal (parent, self->root_directory))
+    relpath = g_strdup ("");
+  else if (!(relpath = g_file_get_relative_path (self->root_directory, parent)))
+    return;
+
+  /* Changes within directories we do not index (such as those which are
+   * ignored) are not interesting, new directories show up in their parent.
+   */
+  if (!g_hash_table_contains (self->tree->dirs, relpath))
+    return;
+
+  g_hash_table_add (self->dirty, g_steal_pointer (&relpath));
+  gbp_file_search_index_queue_update_source (self);
+}
+
 GPtrArray *
 gbp_file_search_index_populate (GbpFileSearchIndex *self,
                                const gchar       *query,
@@ -355,7 +1257,7 @@ gbp_file_search_index_populate (GbpFileSearchIndex *self,
   g_return_val_if_fail (GBP_IS_FILE_SEARCH_INDEX (self), NULL);
   g_return_val_if_fail (query != NULL, NULL);
 
-  if (self->fuzzy == NULL)
+  if (self->tree == NULL)
     return g_ptr_array_new_with_free_func (g_object_unref);
 
   context = ide_object_get_context (IDE_OBJECT (self));
@@ -372,7 +1274,7 @@ gbp_file_search_index_populate (GbpFileSearchIndex *self,
         g_string_append_unichar (delimited, ch);
     }
 
-  ar = dzl_fuzzy_mutable_index_match (self->fuzzy, delimited->str, max_results);
+  ar = dzl_fuzzy_mutable_index_match (self->tree->fuzzy, delimited->str, max_results);
 
   for (i = 0; i < ar->len; i++)
     {
@@ -420,29 +1322,99 @@ gbp_file_search_index_contains (GbpFileSearchIndex *self,
 {
   g_return_val_if_fail (GBP_IS_FILE_SEARCH_INDEX (self), FALSE);
   g_return_val_if_fail (relative_path != NULL, FALSE);
-  g_return_val_if_fail (self->fuzzy != NULL, FALSE);
+  g_return_val_if_fail (self->tree != NULL, FALSE);
 
-  return dzl_fuzzy_mutable_index_contains (self->fuzzy, relative_path);
+  return dzl_fuzzy_mutable_index_contains (self->tree->fuzzy, relative_path);
+}
+
+static DirEntry *
+get_parent_entry (GbpFileSearchIndex  *self,
+                  const gchar         *relative_path,
+                  gchar              **name)
+{
+  g_autofree gchar *dirname = g_path_get_dirname (relative_path);
+
+  *name = g_path_get_basename (relative_path);
+
+  if (g_str_equal (dirname, "."))
+    return g_hash_table_lookup (self->tree->dirs, "");
+
+  return g_hash_table_lookup (self->tree->dirs, dirname);
 }
 
 void
 gbp_file_search_index_insert (GbpFileSearchIndex *self,
                              const gchar       *relative_path)
 {
+  g_autofree gchar *name = NULL;
+  DirEntry *entry;
+
   g_return_if_fail (GBP_IS_FILE_SEARCH_INDEX (self));
   g_return_if_fail (relative_path != NULL);
-  g_return_if_fail (self->fuzzy != NULL);
+  g_return_if_fail (self->tree != NULL);
+
+  /* Keep the listing in sync so that a later rescan sees no change */
+  if ((entry = get_parent_entry (self, relative_path, &name)))
+    {
+      for (guint i = 0; i < entry->files->len; i++)
+        {
+          if (g_str_equal (name, g_ptr_array_index (entry->files, i)))
+            return;
+        }
+
+      g_ptr_array_add (entry->files, g_steal_pointer (&name));
+    }
+  else if (dzl_fuzzy_mutable_index_contains (self->tree->fuzzy, relative_path))
+    {
+      /* Without a listing for the parent there is nothing to dedupe
+       * against but the fuzzy index itself. The directory will be
+       * listed (and the file found) by the next rescan.
+       */
+      return;
+    }
 
-  dzl_fuzzy_mutable_index_insert (self->fuzzy, relative_path, NULL);
+  tree_insert (self->tree, relative_path);
+  gbp_file_search_index_queue_save (self);
 }
 
 void
 gbp_file_search_index_remove (GbpFileSearchIndex *self,
                              const gchar       *relative_path)
 {
+  g_autofree gchar *name = NULL;
+  DirEntry *entry;
+
   g_return_if_fail (GBP_IS_FILE_SEARCH_INDEX (self));
   g_return_if_fail (relative_path != NULL);
-  g_return_if_fail (self->fuzzy != NULL);
+  g_return_if_fail (self->tree != NULL);
+
+  if ((entry = get_parent_entry (self, relative_path, &name)))
+    {
+      for (guint i = 0; i < entry->files->len; i++)
+        {
+          if (g_str_equal (name, g_ptr_array_index (entry->files, i)))
+            {
+              g_ptr_array_remove_index_fast (entry->files, i);
+              tree_remove (self->tree, relative_path);
+              gbp_file_search_index_queue_save (self);
+              return;
+            }
+        }
+
+      for (guint i = 0; i < entry->dirs->len; i++)
+        {
+          if (g_str_equal (name, g_ptr_array_index (entry->dirs, i)))
+            {
+              tree_remove_directory (self->tree, relative_path);
+              g_ptr_array_remove_index_fast (entry->dirs, i);
+              gbp_file_search_index_queue_save (self);
+              return;
+            }
+        }
+
+      return;
+    }
 
-  dzl_fuzzy_mutable_index_remove (self->fuzzy, relative_path);
+  if (dzl_fuzzy_mutable_index_contains (self->tree->fuzzy, relative_path))
+    tree_remove (self->tree, relative_path);
 }
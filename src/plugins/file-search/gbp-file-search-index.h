@@ -44,5 +44,7 @@ void       gbp_file_search_index_insert       (GbpFileSearchIndex    *self,
                                               const gchar          *relative_path);
 void       gbp_file_search_index_remove       (GbpFileSearchIndex    *self,
                                               const gchar          *relative_path);
+void       gbp_file_search_index_queue_update (GbpFileSearchIndex    *self,
+                                              GFile                *file);
 
 G_END_DECLS
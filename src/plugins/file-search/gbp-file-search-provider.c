@@ -168,6 +168,46 @@ on_file_trashed (GbpFileSearchProvider *self,
     gbp_file_search_index_remove (self->index, path);
 }
 
+static void
+on_monitor_changed (GbpFileSearchProvider *self,
+                    GFile                 *file,
+                    GFile                 *other_file,
+                    GFileMonitorEvent      event,
+                    IdeVcsMonitor         *monitor)
+{
+  g_assert (GBP_IS_FILE_SEARCH_PROVIDER (self));
+  g_assert (G_IS_FILE (file));
+  g_assert (!other_file || G_IS_FILE (other_file));
+  g_assert (IDE_IS_VCS_MONITOR (monitor));
+
+  if (self->index == NULL)
+    return;
+
+  switch (event)
+    {
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      if (other_file != NULL)
+        gbp_file_search_index_queue_update (self->index, other_file);
+      G_GNUC_FALLTHROUGH;
+
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+      gbp_file_search_index_queue_update (self->index, file);
+      break;
+
+    case G_FILE_MONITOR_EVENT_CHANGED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+    case G_FILE_MONITOR_EVENT_PRE_UNMOUNT:
+    case G_FILE_MONITOR_EVENT_UNMOUNTED:
+    case G_FILE_MONITOR_EVENT_MOVED:
+    default:
+      break;
+    }
+}
+
 static void
 gbp_file_search_provider_build_cb (GObject      *object,
                                   GAsyncResult *result,
@@ -214,6 +254,30 @@ gbp_file_search_provider_vcs_changed_cb (GbpFileSearchProvider *self,
       !g_file_has_prefix (workdir, projects_dir))
     max_depth = 5;
 
+  /* If we already have an index for this tree, only rescan directories
+   * which changed (such as after switching branches) instead of crawling
+   * the whole project again.
+   */
+  if (self->index != NULL)
+    {
+      GFile *root = NULL;
+      gint index_max_depth = 0;
+
+      g_object_get (self->index,
+                    "root-directory", &root,
+                    "max-depth", &index_max_depth,
+                    NULL);
+
+      if (root != NULL && g_file_equal (root, workdir) && index_max_depth == max_depth)
+        {
+          gbp_file_search_index_queue_update (self->index, NULL);
+          g_object_unref (root);
+          IDE_EXIT;
+        }
+
+      g_clear_object (&root);
+    }
+
   index = g_object_new (GBP_TYPE_FILE_SEARCH_INDEX,
                         "root-directory", workdir,
                         "max-depth", max_depth,
@@ -237,6 +301,7 @@ gbp_file_search_provider_parent_set (IdeObject *object,
   g_autoptr(GbpFileSearchIndex) index = NULL;
   g_autoptr(GFile) workdir = NULL;
   IdeBufferManager *bufmgr;
+  IdeVcsMonitor *monitor;
   IdeContext *context;
   IdeProject *project;
   IdeVcs *vcs;
@@ -252,6 +317,7 @@ gbp_file_search_provider_parent_set (IdeObject *object,
   bufmgr = ide_buffer_manager_from_context (context);
   project = ide_project_from_context (context);
   vcs = ide_vcs_from_context (context);
+  monitor = ide_vcs_monitor_from_context (context);
 
   workdir = ide_context_ref_workdir (context);
 
@@ -261,6 +327,13 @@ gbp_file_search_provider_parent_set (IdeObject *object,
                            self,
                            G_CONNECT_SWAPPED);
 
+  if (monitor != NULL)
+    g_signal_connect_object (monitor,
+                             "changed",
+                             G_CALLBACK (on_monitor_changed),
+                             self,
+                             G_CONNECT_SWAPPED);
+
   g_signal_connect_object (bufmgr,
                            "buffer-loaded",
                            G_CALLBACK (on_buffer_loaded),
@@ -402,6 +402,7 @@ register_downloads_stage (GbpFlatpakPipelineAddin  *self,
                           GError                  **error)
 {
   g_autoptr(IdePipelineStage) stage = NULL;
+  g_autofree gchar *downloads_dir = NULL;
   guint stage_id;
 
   g_assert (GBP_IS_FLATPAK_PIPELINE_ADDIN (self));
@@ -412,6 +413,17 @@ register_downloads_stage (GbpFlatpakPipelineAddin  *self,
                         "name", _("Downloading dependencies"),
                         "state-dir", self->state_dir,
                         NULL);
+
+  /*
+   * Downloads only write to the flatpak-builder state directory, so they
+   * may run alongside other stages that declare what they use, such as
+   * updating git submodules.
+   */
+  if (self->state_dir != NULL)
+    downloads_dir = g_build_filename (self->state_dir, "downloads", NULL);
+  else
+    downloads_dir = g_build_filename (ide_pipeline_get_srcdir (pipeline), ".flatpak-builder", "downloads", NULL);
+  ide_pipeline_stage_add_output (stage, downloads_dir);
   stage_id = ide_pipeline_attach (pipeline, IDE_PIPELINE_PHASE_DOWNLOADS, 0, stage);
   ide_pipeline_addin_track (IDE_PIPELINE_ADDIN (self), stage_id);
 
@@ -21,9 +21,17 @@
 #define G_LOG_DOMAIN "ipc-git-change-monitor-impl"
 
 #include <glib/gi18n.h>
+#include <string.h>
 
 #include "ipc-git-change-monitor-impl.h"
 #include "line-cache.h"
+#include "line-diff.h"
+
+/* Lines around an edit to compare, so that nearby hunks merge properly */
+#define EDIT_CONTEXT_LINES 3
+
+/* Windows larger than this are left for a full diff with libgit2 */
+#define MAX_INCREMENTAL_LINES 5000
 
 /* Some code from this file is loosely based around the git-diff
  * plugin from Atom. Namely, API usage for iterating through hunks
@@ -57,36 +65,54 @@ struct _IpcGitChangeMonitorImpl
   IpcGitChangeMonitorSkeleton  parent;
   gchar                       *path;
   GgitRepository              *repository;
-  GBytes                      *contents;
+
+  /*
+   * Our copy of the buffer contents, kept up to date with either
+   * UpdateContent or ApplyEdit, and the offset of each line within it.
+   */
+  GByteArray                  *contents;
+  GArray                      *starts;
+
+  /* The file from HEAD and the offset of each line within it */
   GgitObject                  *blob;
+  GArray                      *blob_starts;
+
+  /*
+   * The LineHunk differences between @blob and @contents. This is
+   * patched near each edit when possible, and is %NULL when a full
+   * diff is required.
+   */
+  GArray                      *hunks;
 };
 
-typedef struct
-{
-  gint old_start;
-  gint old_lines;
-  gint new_start;
-  gint new_lines;
-} Range;
-
 static gint
 diff_hunk_cb (GgitDiffDelta *delta,
               GgitDiffHunk  *hunk,
               gpointer       user_data)
 {
-  GArray *ranges = user_data;
-  Range range;
+  GArray *hunks = user_data;
+  LineHunk line_hunk;
+  gint old_start;
+  gint old_lines;
+  gint new_start;
+  gint new_lines;
 
   g_assert (delta != NULL);
   g_assert (hunk != NULL);
-  g_assert (ranges != NULL);
+  g_assert (hunks != NULL);
+
+  old_start = ggit_diff_hunk_get_old_start (hunk);
+  old_lines = ggit_diff_hunk_get_old_lines (hunk);
+  new_start = ggit_diff_hunk_get_new_start (hunk);
+  new_lines = ggit_diff_hunk_get_new_lines (hunk);
 
-  range.old_start = ggit_diff_hunk_get_old_start (hunk);
-  range.old_lines = ggit_diff_hunk_get_old_lines (hunk);
-  range.new_start = ggit_diff_hunk_get_new_start (hunk);
-  range.new_lines = ggit_diff_hunk_get_new_lines (hunk);
+  /* Empty ranges refer to the line before them, starting from one */
+  line_hunk.old_begin = old_lines ? old_start - 1 : old_start;
+  line_hunk.old_end = line_hunk.old_begin + old_lines;
+  line_hunk.new_begin = new_lines ? new_start - 1 : new_start;
+  line_hunk.new_end = line_hunk.new_begin + new_lines;
 
-  g_array_append_val (ranges, range);
+  g_array_append_val (hunks, line_hunk);
 
   return 0;
 }
@@ -131,6 +157,15 @@ ipc_git_change_monitor_impl_load_blob (IpcGitChangeMonitorImpl  *self,
 
   g_set_object (&self->blob, blob);
 
+  {
+    const guint8 *data;
+    gsize len = 0;
+
+    data = ggit_blob_get_raw_content (GGIT_BLOB (blob), &len);
+    g_clear_pointer (&self->blob_starts, g_array_unref);
+    self->blob_starts = line_starts_new ((const gchar *)data, len);
+  }
+
 cleanup:
   g_clear_pointer (&entry_oid, ggit_oid_free);
   g_clear_pointer (&entry, ggit_tree_entry_unref);
@@ -148,20 +183,226 @@ ipc_git_change_monitor_impl_handle_update_content (IpcGitChangeMonitor   *monito
                                                    const gchar           *contents)
 {
   IpcGitChangeMonitorImpl *self = (IpcGitChangeMonitorImpl *)monitor;
+  gsize len;
 
   g_assert (IPC_IS_GIT_CHANGE_MONITOR_IMPL (self));
   g_assert (G_IS_DBUS_METHOD_INVOCATION (invocation));
   g_assert (contents != NULL);
 
-  /* Make a copy, but retain the trailing \0 */
-  g_clear_pointer (&self->contents, g_bytes_unref);
-  self->contents = g_bytes_new_take (g_strdup (contents), strlen (contents));
+  len = strlen (contents);
+
+  g_clear_pointer (&self->contents, g_byte_array_unref);
+  g_clear_pointer (&self->starts, g_array_unref);
+  g_clear_pointer (&self->hunks, g_array_unref);
+
+  self->contents = g_byte_array_sized_new (len);
+  g_byte_array_append (self->contents, (const guint8 *)contents, len);
+  self->starts = line_starts_new (contents, len);
 
   ipc_git_change_monitor_complete_update_content (monitor, invocation);
 
   return TRUE;
 }
 
+/*
+ * Patches self->hunks for an edit which replaced the lines
+ * [first_line, last_line) of the contents with @n_lines_delta more (or
+ * fewer) lines. The window compared against the blob is grown until no
+ * existing hunk touches its edges, so that hunks outside of it are
+ * unaffected by the edit apart from being shifted.
+ */
+static gboolean
+ipc_git_change_monitor_impl_patch_hunks (IpcGitChangeMonitorImpl *self,
+                                         guint                    first_line,
+                                         guint                    last_line,
+                                         guint                    n_lines_before,
+                                         gint                     n_lines_delta)
+{
+  g_autoptr(GArray) hunks = NULL;
+  const guint8 *blob_data;
+  LineText blob_text;
+  LineText text;
+  gsize blob_len = 0;
+  guint window_begin;
+  guint window_end;
+  guint first_inside;
+  guint first_after;
+  gint old_delta_before = 0;
+  gint old_delta_inside = 0;
+  gboolean changed;
+
+  g_assert (IPC_IS_GIT_CHANGE_MONITOR_IMPL (self));
+  g_assert (self->hunks != NULL);
+  g_assert (self->blob != NULL);
+  g_assert (self->blob_starts != NULL);
+
+  window_begin = first_line > EDIT_CONTEXT_LINES ? first_line - EDIT_CONTEXT_LINES : 0;
+  window_end = MIN (last_line + EDIT_CONTEXT_LINES, n_lines_before);
+
+  do
+    {
+      changed = FALSE;
+
+      for (guint i = 0; i < self->hunks->len; i++)
+        {
+          const LineHunk *hunk = &g_array_index (self->hunks, LineHunk, i);
+
+          if (hunk->new_begin > window_end || hunk->new_end < window_begin)
+            continue;
+
+          if (hunk->new_begin < window_begin)
+            window_begin = hunk->new_begin, changed = TRUE;
+
+          if (hunk->new_end > window_end)
+            window_end = hunk->new_end, changed = TRUE;
+        }
+    }
+  while (changed);
+
+  /* Hunks are sorted, so they are split into before, inside, and after */
+  for (first_inside = 0; first_inside < self->hunks->len; first_inside++)
+    {
+      const LineHunk *hunk = &g_array_index (self->hunks, LineHunk, first_inside);
+
+      if (hunk->new_end >= window_begin)
+        break;
+
+      old_delta_before += (gint)(hunk->old_end - hunk->old_begin) - (gint)(hunk->new_end - hunk->new_begin);
+    }
+
+  for (first_after = first_inside; first_after < self->hunks->len; first_after++)
+    {
+      const LineHunk *hunk = &g_array_index (self->hunks, LineHunk, first_after);
+
+      if (hunk->new_begin > window_end)
+        break;
+
+      old_delta_inside += (gint)(hunk->old_end - hunk->old_begin) - (gint)(hunk->new_end - hunk->new_begin);
+    }
+
+  if (window_end - window_begin > MAX_INCREMENTAL_LINES ||
+      (gint)(window_end - window_begin) + n_lines_delta > MAX_INCREMENTAL_LINES)
+    return FALSE;
+
+  blob_data = ggit_blob_get_raw_content (GGIT_BLOB (self->blob), &blob_len);
+  blob_text.data = (const gchar *)blob_data;
+  blob_text.len = blob_len;
+  blob_text.starts = self->blob_starts;
+
+  text.data = (const gchar *)self->contents->data;
+  text.len = self->contents->len;
+  text.starts = self->starts;
+
+  hunks = g_array_sized_new (FALSE, FALSE, sizeof (LineHunk), self->hunks->len + 1);
+  g_array_append_vals (hunks, self->hunks->data, first_inside);
+
+  if (!line_diff (&blob_text,
+                  window_begin + old_delta_before,
+                  window_end + old_delta_before + old_delta_inside,
+                  &text,
+                  window_begin,
+                  window_end + n_lines_delta,
+                  hunks))
+    return FALSE;
+
+  for (guint i = first_after; i < self->hunks->len; i++)
+    {
+      LineHunk hunk = g_array_index (self->hunks, LineHunk, i);
+
+      hunk.new_begin += n_lines_delta;
+      hunk.new_end += n_lines_delta;
+
+      g_array_append_val (hunks, hunk);
+    }
+
+  g_clear_pointer (&self->hunks, g_array_unref);
+  self->hunks = g_steal_pointer (&hunks);
+
+  return TRUE;
+}
+
+static gboolean
+ipc_git_change_monitor_impl_handle_apply_edit (IpcGitChangeMonitor   *monitor,
+                                               GDBusMethodInvocation *invocation,
+                                               guint                  first_line,
+                                               guint                  n_removed,
+                                               const gchar           *contents,
+                                               guint                  n_lines)
+{
+  IpcGitChangeMonitorImpl *self = (IpcGitChangeMonitorImpl *)monitor;
+  guint n_lines_before;
+  guint last_line;
+  gsize begin_offset;
+  gsize end_offset;
+  gsize removed_len;
+  gsize old_len;
+  gsize len;
+
+  g_assert (IPC_IS_GIT_CHANGE_MONITOR_IMPL (self));
+  g_assert (G_IS_DBUS_METHOD_INVOCATION (invocation));
+  g_assert (contents != NULL);
+
+  len = strlen (contents);
+
+  if (self->contents == NULL ||
+      first_line >= self->starts->len ||
+      (n_removed < self->starts->len - first_line && len > 0 && contents[len - 1] != '\n'))
+    goto invalid;
+
+  n_lines_before = self->starts->len;
+  last_line = n_removed < n_lines_before - first_line ? first_line + n_removed : n_lines_before;
+  begin_offset = g_array_index (self->starts, guint, first_line);
+  end_offset = last_line < n_lines_before ? g_array_index (self->starts, guint, last_line) : self->contents->len;
+
+  /* Replace the lines in place, opening or closing the gap as necessary */
+  removed_len = end_offset - begin_offset;
+  old_len = self->contents->len;
+
+  if (len > removed_len)
+    g_byte_array_set_size (self->contents, old_len - removed_len + len);
+
+  memmove (self->contents->data + begin_offset + len,
+           self->contents->data + end_offset,
+           old_len - end_offset);
+  memcpy (self->contents->data + begin_offset, contents, len);
+
+  if (len < removed_len)
+    g_byte_array_set_size (self->contents, old_len - removed_len + len);
+
+  line_starts_splice (self->starts, first_line, last_line - first_line,
+                      removed_len, contents, len);
+
+  /* Make sure we agree with the peer about the contents */
+  if (self->starts->len != n_lines)
+    {
+      g_clear_pointer (&self->contents, g_byte_array_unref);
+      g_clear_pointer (&self->starts, g_array_unref);
+      goto invalid;
+    }
+
+  if (self->hunks != NULL &&
+      (self->blob == NULL ||
+       !ipc_git_change_monitor_impl_patch_hunks (self,
+                                                 first_line,
+                                                 last_line,
+                                                 n_lines_before,
+                                                 (gint)n_lines - (gint)n_lines_before)))
+    g_clear_pointer (&self->hunks, g_array_unref);
+
+  ipc_git_change_monitor_complete_apply_edit (monitor, invocation);
+
+  return TRUE;
+
+invalid:
+  g_clear_pointer (&self->hunks, g_array_unref);
+  g_dbus_method_invocation_return_error (invocation,
+                                         G_IO_ERROR,
+                                         G_IO_ERROR_INVALID_DATA,
+                                         _("The edit does not apply to the current contents"));
+
+  return TRUE;
+}
+
 static gboolean
 ipc_git_change_monitor_impl_handle_list_changes (IpcGitChangeMonitor   *monitor,
                                                  GDBusMethodInvocation *invocation)
@@ -169,12 +410,10 @@ ipc_git_change_monitor_impl_handle_list_changes (IpcGitChangeMonitor   *monitor,
   IpcGitChangeMonitorImpl *self = (IpcGitChangeMonitorImpl *)monitor;
   g_autoptr(GgitDiffOptions) options = NULL;
   g_autoptr(GgitObject) blob = NULL;
-  g_autoptr(GArray) ranges = NULL;
+  g_autoptr(GArray) hunks = NULL;
   g_autoptr(GError) error = NULL;
   g_autoptr(LineCache) cache = NULL;
   g_autoptr(GVariant) ret = NULL;
-  const guint8 *data;
-  gsize len = 0;
 
   g_assert (IPC_IS_GIT_CHANGE_MONITOR_IMPL (self));
   g_assert (G_IS_DBUS_METHOD_INVOCATION (invocation));
@@ -191,50 +430,52 @@ ipc_git_change_monitor_impl_handle_list_changes (IpcGitChangeMonitor   *monitor,
   if (!(blob = ipc_git_change_monitor_impl_load_blob (self, &error)))
     goto gerror;
 
-  ranges = g_array_new (FALSE, FALSE, sizeof (Range));
-  options = ggit_diff_options_new ();
-  ggit_diff_options_set_n_context_lines (options, 0);
-
-  data = g_bytes_get_data (self->contents, &len);
-
-  ggit_diff_blob_to_buffer (GGIT_BLOB (blob),
-                            self->path,
-                            data,
-                            len,
-                            self->path,
-                            options,
-                            NULL,         /* File Callback */
-                            NULL,         /* Binary Callback */
-                            diff_hunk_cb, /* Hunk Callback */
-                            NULL,
-                            ranges,
-                            &error);
-
-  if (error != NULL)
-    goto gerror;
+  /* Only diff the whole file if edits could not patch the hunks */
+  if (self->hunks == NULL)
+    {
+      hunks = g_array_new (FALSE, FALSE, sizeof (LineHunk));
+      options = ggit_diff_options_new ();
+      ggit_diff_options_set_n_context_lines (options, 0);
+
+      ggit_diff_blob_to_buffer (GGIT_BLOB (blob),
+                                self->path,
+                                self->contents->data,
+                                self->contents->len,
+                                self->path,
+                                options,
+                                NULL,         /* File Callback */
+                                NULL,         /* Binary Callback */
+                                diff_hunk_cb, /* Hunk Callback */
+                                NULL,
+                                hunks,
+                                &error);
+
+      if (error != NULL)
+        goto gerror;
+
+      self->hunks = g_steal_pointer (&hunks);
+    }
 
   cache = line_cache_new ();
 
-  for (guint i = 0; i < ranges->len; i++)
+  for (guint i = 0; i < self->hunks->len; i++)
     {
-      const Range *range = &g_array_index (ranges, Range, i);
-      gint start_line = range->new_start - 1;
-      gint end_line = range->new_start + range->new_lines - 1;
+      const LineHunk *hunk = &g_array_index (self->hunks, LineHunk, i);
 
-      if (range->old_lines == 0 && range->new_lines > 0)
+      if (hunk->old_begin == hunk->old_end && hunk->new_begin < hunk->new_end)
         {
-          line_cache_mark_range (cache, start_line, end_line, LINE_MARK_ADDED);
+          line_cache_mark_range (cache, hunk->new_begin, hunk->new_end, LINE_MARK_ADDED);
         }
-      else if (range->new_lines == 0 && range->old_lines > 0)
+      else if (hunk->new_begin == hunk->new_end && hunk->old_begin < hunk->old_end)
         {
-          if (start_line < 0)
+          if (hunk->new_begin == 0)
             line_cache_mark_range (cache, 0, 0, LINE_MARK_PREVIOUS_REMOVED);
           else
-            line_cache_mark_range (cache, start_line + 1, start_line + 1, LINE_MARK_REMOVED);
+            line_cache_mark_range (cache, hunk->new_begin, hunk->new_begin, LINE_MARK_REMOVED);
         }
       else
         {
-          line_cache_mark_range (cache, start_line, end_line, LINE_MARK_CHANGED);
+          line_cache_mark_range (cache, hunk->new_begin, hunk->new_end, LINE_MARK_CHANGED);
         }
     }
 
@@ -293,6 +534,7 @@ static void
 git_change_monitor_iface_init (IpcGitChangeMonitorIface *iface)
 {
   iface->handle_update_content = ipc_git_change_monitor_impl_handle_update_content;
+  iface->handle_apply_edit = ipc_git_change_monitor_impl_handle_apply_edit;
   iface->handle_list_changes = ipc_git_change_monitor_impl_handle_list_changes;
   iface->handle_close = ipc_git_change_monitor_impl_handle_close;
 }
@@ -307,7 +549,10 @@ ipc_git_change_monitor_impl_finalize (GObject *object)
 
   g_clear_object (&self->blob);
   g_clear_object (&self->repository);
-  g_clear_pointer (&self->contents, g_bytes_unref);
+  g_clear_pointer (&self->blob_starts, g_array_unref);
+  g_clear_pointer (&self->hunks, g_array_unref);
+  g_clear_pointer (&self->starts, g_array_unref);
+  g_clear_pointer (&self->contents, g_byte_array_unref);
   g_clear_pointer (&self->path, g_free);
 
   G_OBJECT_CLASS (ipc_git_change_monitor_impl_parent_class)->finalize (object);
@@ -346,4 +591,6 @@ ipc_git_change_monitor_impl_reset (IpcGitChangeMonitorImpl *self)
   g_return_if_fail (IPC_IS_GIT_CHANGE_MONITOR_IMPL (self));
 
   g_clear_object (&self->blob);
+  g_clear_pointer (&self->blob_starts, g_array_unref);
+  g_clear_pointer (&self->hunks, g_array_unref);
 }
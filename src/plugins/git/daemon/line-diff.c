@@ -0,0 +1,326 @@
+/* line-diff.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#define G_LOG_DOMAIN "line-diff"
+
+#include <string.h>
+
+#include "line-diff.h"
+
+/*
+ * This is a line-based implementation of Myers' O(ND) difference
+ * algorithm, used to refresh the hunks near an edit without asking
+ * libgit2 to diff the whole file again. We bail when the edit distance
+ * grows past MAX_EDIT_DISTANCE, at which point the caller should fall
+ * back to a full diff since the trace would become too large anyway.
+ */
+
+#define MAX_EDIT_DISTANCE 1000
+
+typedef struct
+{
+  const gchar *data;
+  guint        len;
+  guint        hash;
+} Line;
+
+static inline void
+get_line (const LineText *text,
+          guint           line,
+          Line           *out)
+{
+  const guint *starts = (const guint *)(gpointer)text->starts->data;
+  guint begin = starts[line];
+  guint end = line + 1 < text->starts->len ? starts[line + 1] : text->len;
+  guint hash = 5381;
+
+  out->data = text->data + begin;
+  out->len = end - begin;
+
+  for (guint i = 0; i < out->len; i++)
+    hash = (hash << 5) + hash + (guint8)out->data[i];
+
+  out->hash = hash;
+}
+
+static inline gboolean
+line_equal (const Line *a,
+            const Line *b)
+{
+  return a->hash == b->hash &&
+         a->len == b->len &&
+         memcmp (a->data, b->data, a->len) == 0;
+}
+
+GArray *
+line_starts_new (const gchar *data,
+                 gsize        len)
+{
+  GArray *starts = g_array_new (FALSE, FALSE, sizeof (guint));
+  guint pos = 0;
+
+  g_array_append_val (starts, pos);
+
+  for (const gchar *iter = data, *end = data + len;
+       (iter = memchr (iter, '\n', end - iter));
+       iter++)
+    {
+      pos = iter - data + 1;
+      g_array_append_val (starts, pos);
+    }
+
+  return starts;
+}
+
+/**
+ * line_starts_splice:
+ * @starts: the line starts of the text before the edit
+ * @first_line: the first line replaced
+ * @n_removed: the number of lines replaced, reaching the end of the
+ *   text when greater than the number remaining
+ * @removed_len: the number of bytes in the replaced lines
+ * @inserted: the replacement text
+ * @inserted_len: the length of @inserted
+ *
+ * Updates @starts after replacing whole lines of text. Unless the
+ * replacement reaches the end of the text, @inserted must be empty or
+ * end with a newline.
+ */
+void
+line_starts_splice (GArray      *starts,
+                    guint        first_line,
+                    guint        n_removed,
+                    gsize        removed_len,
+                    const gchar *inserted,
+                    gsize        inserted_len)
+{
+  g_autoptr(GArray) added = NULL;
+  gboolean to_end;
+  guint base;
+  gssize delta;
+
+  g_assert (starts != NULL);
+  g_assert (first_line < starts->len);
+
+  base = g_array_index (starts, guint, first_line);
+  to_end = n_removed >= starts->len - first_line;
+  delta = (gssize)inserted_len - (gssize)removed_len;
+
+  g_array_remove_range (starts, first_line, to_end ? starts->len - first_line : n_removed);
+
+  for (guint i = first_line; i < starts->len; i++)
+    g_array_index (starts, guint, i) += delta;
+
+  added = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  for (gsize i = 0; i < inserted_len; i++)
+    {
+      if (i == 0 || inserted[i - 1] == '\n')
+        {
+          guint pos = base + i;
+          g_array_append_val (added, pos);
+        }
+    }
+
+  /* The final line is empty when the text ends with a newline */
+  if (to_end && (inserted_len == 0 || inserted[inserted_len - 1] == '\n'))
+    {
+      guint pos = base + inserted_len;
+      g_array_append_val (added, pos);
+    }
+
+  g_array_insert_vals (starts, first_line, added->data, added->len);
+}
+
+static void
+add_hunk (GArray *hunks,
+          guint   old_begin,
+          guint   old_end,
+          guint   new_begin,
+          guint   new_end)
+{
+  LineHunk hunk = { old_begin, old_end, new_begin, new_end };
+
+  if (old_begin != old_end || new_begin != new_end)
+    g_array_append_val (hunks, hunk);
+}
+
+/**
+ * line_diff:
+ * @old_text: the original text
+ * @old_begin: the first line of @old_text to compare
+ * @old_end: the line after the last to compare
+ * @new_text: the modified text
+ * @new_begin: the first line of @new_text to compare
+ * @new_end: the line after the last to compare
+ * @hunks: (element-type LineHunk): an array to append hunks to
+ *
+ * Compares a range of lines from @old_text against a range of lines from
+ * @new_text, appending the differences in order to @hunks.
+ *
+ * Returns: %FALSE if the ranges are too different to compare cheaply,
+ *   in which case nothing is added to @hunks.
+ */
+gboolean
+line_diff (const LineText *old_text,
+           guint           old_begin,
+           guint           old_end,
+           const LineText *new_text,
+           guint           new_begin,
+           guint           new_end,
+           GArray         *hunks)
+{
+  g_autofree Line *a = NULL;
+  g_autofree Line *b = NULL;
+  g_autofree guint8 *a_changed = NULL;
+  g_autofree guint8 *b_changed = NULL;
+  g_autofree gint *v = NULL;
+  g_autoptr(GArray) trace = NULL;
+  guint n, m, max_d, i, j;
+  gint offset;
+  gint x, y, d;
+
+  g_assert (old_begin <= old_end && old_end <= old_text->starts->len);
+  g_assert (new_begin <= new_end && new_end <= new_text->starts->len);
+  g_assert (hunks != NULL);
+
+  n = old_end - old_begin;
+  m = new_end - new_begin;
+
+  a = g_new (Line, n);
+  b = g_new (Line, m);
+
+  for (i = 0; i < n; i++)
+    get_line (old_text, old_begin + i, &a[i]);
+
+  for (j = 0; j < m; j++)
+    get_line (new_text, new_begin + j, &b[j]);
+
+  /* Edits are usually small, so trimming common lines does most of the work */
+  for (i = 0; i < n && i < m && line_equal (&a[i], &b[i]); i++) { }
+  for (j = 0; j < n - i && j < m - i && line_equal (&a[n - j - 1], &b[m - j - 1]); j++) { }
+
+  if (i == n || i == m)
+    {
+      add_hunk (hunks, old_begin + i, old_end - j, new_begin + i, new_end - j);
+      return TRUE;
+    }
+
+  max_d = MIN (n + m - 2 * (i + j), MAX_EDIT_DISTANCE);
+  offset = max_d + 1;
+  v = g_new0 (gint, 2 * max_d + 3);
+  trace = g_array_new (FALSE, FALSE, sizeof (gint));
+  a_changed = g_malloc0 (n);
+  b_changed = g_malloc0 (m);
+
+#define A(k) (&a[i + (k)])
+#define B(k) (&b[i + (k)])
+#define TRACE(s,k) (g_array_index (trace, gint, (s) * (s) + (k) + (s)))
+
+  {
+    gint an = n - i - j;
+    gint bn = m - i - j;
+
+    for (d = 0; d <= (gint)max_d; d++)
+      {
+        for (gint k = -d; k <= d; k += 2)
+          {
+            if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+              x = v[offset + k + 1];
+            else
+              x = v[offset + k - 1] + 1;
+
+            y = x - k;
+
+            while (x < an && y < bn && line_equal (A (x), B (y)))
+              x++, y++;
+
+            v[offset + k] = x;
+
+            if (x >= an && y >= bn)
+              goto found;
+          }
+
+        g_array_append_vals (trace, &v[offset - d], 2 * d + 1);
+      }
+
+    return FALSE;
+
+  found:
+    x = an;
+    y = bn;
+
+    for (; d > 0; d--)
+      {
+        gint k = x - y;
+        gint prev_k;
+        gint prev_x;
+
+        if (k == -d || (k != d && TRACE (d - 1, k - 1) < TRACE (d - 1, k + 1)))
+          prev_k = k + 1;
+        else
+          prev_k = k - 1;
+
+        prev_x = TRACE (d - 1, prev_k);
+
+        if (prev_k == k + 1)
+          {
+            /* Insertion, moving down from the previous diagonal */
+            while (x > prev_x)
+              x--, y--;
+            b_changed[i + y - 1] = TRUE;
+            y--;
+          }
+        else
+          {
+            /* Deletion, moving right from the previous diagonal */
+            while (x > prev_x + 1)
+              x--, y--;
+            a_changed[i + x - 1] = TRUE;
+            x--;
+          }
+      }
+  }
+
+#undef A
+#undef B
+#undef TRACE
+
+  /* Walk both sides, pairing unchanged lines and grouping the rest */
+  for (guint p = 0, q = 0; p < n || q < m;)
+    {
+      guint p0 = p;
+      guint q0 = q;
+
+      while (p < n && a_changed[p])
+        p++;
+      while (q < m && b_changed[q])
+        q++;
+
+      add_hunk (hunks, old_begin + p0, old_begin + p, new_begin + q0, new_begin + q);
+
+      if (p < n && q < m)
+        p++, q++;
+      else
+        p = n, q = m;
+    }
+
+  return TRUE;
+}
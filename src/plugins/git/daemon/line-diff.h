@@ -0,0 +1,63 @@
+/* line-diff.h
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Lines are split after every \n, so a trailing newline results in a final
+ * empty line. This matches the line numbering of GtkTextBuffer.
+ */
+typedef struct
+{
+  const gchar *data;
+  gsize        len;
+  GArray      *starts;
+} LineText;
+
+/* Half-open ranges of lines, starting from zero */
+typedef struct
+{
+  guint old_begin;
+  guint old_end;
+  guint new_begin;
+  guint new_end;
+} LineHunk;
+
+GArray   *line_starts_new    (const gchar    *data,
+                              gsize           len);
+void      line_starts_splice (GArray         *starts,
+                              guint           first_line,
+                              guint           n_removed,
+                              gsize           removed_len,
+                              const gchar    *inserted,
+                              gsize           inserted_len);
+gboolean  line_diff          (const LineText *old_text,
+                              guint           old_begin,
+                              guint           old_end,
+                              const LineText *new_text,
+                              guint           new_begin,
+                              guint           new_end,
+                              GArray         *hunks);
+
+G_END_DECLS
@@ -0,0 +1,352 @@
+/* test-line-diff.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <libgit2-glib/ggit.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "line-diff.h"
+
+/* Must match MAX_EDIT_DISTANCE in line-diff.c */
+#define MAX_EDIT_DISTANCE 1000
+
+static GgitRepository *repository;
+static gchar *tmpdir;
+static guint next_line;
+
+/* Every line is unique so that there is exactly one smallest diff */
+static void
+append_fresh_lines (GString *str,
+                    guint    n_lines)
+{
+  for (guint i = 0; i < n_lines; i++)
+    g_string_append_printf (str, "line %u\n", next_line++);
+}
+
+static gint
+diff_hunk_cb (GgitDiffDelta *delta,
+              GgitDiffHunk  *hunk,
+              gpointer       user_data)
+{
+  GArray *hunks = user_data;
+  LineHunk line_hunk;
+  gint old_start = ggit_diff_hunk_get_old_start (hunk);
+  gint old_lines = ggit_diff_hunk_get_old_lines (hunk);
+  gint new_start = ggit_diff_hunk_get_new_start (hunk);
+  gint new_lines = ggit_diff_hunk_get_new_lines (hunk);
+
+  /* Same conversion as ipc-git-change-monitor-impl.c */
+  line_hunk.old_begin = old_lines ? old_start - 1 : old_start;
+  line_hunk.old_end = line_hunk.old_begin + old_lines;
+  line_hunk.new_begin = new_lines ? new_start - 1 : new_start;
+  line_hunk.new_end = line_hunk.new_begin + new_lines;
+
+  g_array_append_val (hunks, line_hunk);
+
+  return 0;
+}
+
+static GArray *
+full_diff (const GString *old_text,
+           const GString *new_text)
+{
+  g_autoptr(GgitDiffOptions) options = ggit_diff_options_new ();
+  g_autoptr(GgitBlob) blob = NULL;
+  g_autoptr(GError) error = NULL;
+  GArray *hunks = g_array_new (FALSE, FALSE, sizeof (LineHunk));
+  GgitOId *oid;
+
+  oid = ggit_repository_create_blob_from_buffer (repository, old_text->str, old_text->len, &error);
+  g_assert_no_error (error);
+
+  blob = ggit_repository_lookup_blob (repository, oid, &error);
+  g_assert_no_error (error);
+  ggit_oid_free (oid);
+
+  ggit_diff_options_set_n_context_lines (options, 0);
+  ggit_diff_blob_to_buffer (blob,
+                            "file.txt",
+                            (const guint8 *)new_text->str,
+                            new_text->len,
+                            "file.txt",
+                            options,
+                            NULL,
+                            NULL,
+                            diff_hunk_cb,
+                            NULL,
+                            hunks,
+                            &error);
+  g_assert_no_error (error);
+
+  return hunks;
+}
+
+static gchar *
+format_hunks (GArray *hunks)
+{
+  GString *str = g_string_new (NULL);
+
+  for (guint i = 0; i < hunks->len; i++)
+    {
+      const LineHunk *hunk = &g_array_index (hunks, LineHunk, i);
+
+      g_string_append_printf (str, "[%u,%u)->[%u,%u) ",
+                              hunk->old_begin, hunk->old_end,
+                              hunk->new_begin, hunk->new_end);
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+static gboolean
+line_diff_texts (const GString *old_str,
+                 const GString *new_str,
+                 GArray        *hunks)
+{
+  g_autoptr(GArray) old_starts = line_starts_new (old_str->str, old_str->len);
+  g_autoptr(GArray) new_starts = line_starts_new (new_str->str, new_str->len);
+  LineText old_text = { old_str->str, old_str->len, old_starts };
+  LineText new_text = { new_str->str, new_str->len, new_starts };
+
+  return line_diff (&old_text, 0, old_starts->len, &new_text, 0, new_starts->len, hunks);
+}
+
+static void
+assert_same_as_full_diff (const GString *old_str,
+                          const GString *new_str)
+{
+  g_autoptr(GArray) expected = full_diff (old_str, new_str);
+  g_autoptr(GArray) hunks = g_array_new (FALSE, FALSE, sizeof (LineHunk));
+  g_autofree gchar *expected_str = NULL;
+  g_autofree gchar *hunks_str = NULL;
+
+  g_assert_true (line_diff_texts (old_str, new_str, hunks));
+
+  expected_str = format_hunks (expected);
+  hunks_str = format_hunks (hunks);
+
+  g_assert_cmpstr (hunks_str, ==, expected_str);
+}
+
+/* Replaces @n_removed lines at @line with @n_added fresh lines */
+static GString *
+edit_lines (const GString *str,
+            guint          line,
+            guint          n_removed,
+            guint          n_added)
+{
+  g_autoptr(GArray) starts = line_starts_new (str->str, str->len);
+  GString *ret = g_string_new (NULL);
+  guint n_lines = starts->len - 1;
+  guint begin;
+  guint end;
+
+  g_assert (line <= n_lines);
+
+  n_removed = MIN (n_removed, n_lines - line);
+  begin = g_array_index (starts, guint, line);
+  end = g_array_index (starts, guint, line + n_removed);
+
+  g_string_append_len (ret, str->str, begin);
+  append_fresh_lines (ret, n_added);
+  g_string_append_len (ret, str->str + end, str->len - end);
+
+  return ret;
+}
+
+static void
+test_line_diff_random (void)
+{
+  for (guint round = 0; round < 500; round++)
+    {
+      g_autoptr(GString) old_str = g_string_new (NULL);
+      g_autoptr(GString) new_str = NULL;
+      guint n_edits = g_test_rand_int_range (1, 6);
+
+      append_fresh_lines (old_str, g_test_rand_int_range (0, 80));
+      new_str = g_string_new_len (old_str->str, old_str->len);
+
+      for (guint i = 0; i < n_edits; i++)
+        {
+          g_autoptr(GArray) starts = line_starts_new (new_str->str, new_str->len);
+          guint line = g_test_rand_int_range (0, starts->len);
+          GString *edited;
+
+          edited = edit_lines (new_str,
+                               line,
+                               g_test_rand_int_range (0, 5),
+                               g_test_rand_int_range (0, 5));
+          g_string_free (new_str, TRUE);
+          new_str = edited;
+        }
+
+      assert_same_as_full_diff (old_str, new_str);
+    }
+}
+
+static void
+test_line_diff_edges (void)
+{
+  g_autoptr(GString) empty = g_string_new (NULL);
+  g_autoptr(GString) text = g_string_new (NULL);
+  g_autoptr(GString) first = NULL;
+  g_autoptr(GString) appended = NULL;
+  g_autoptr(GString) truncated = NULL;
+
+  append_fresh_lines (text, 10);
+
+  /* Everything added, or everything removed */
+  assert_same_as_full_diff (empty, text);
+  assert_same_as_full_diff (text, empty);
+  assert_same_as_full_diff (text, text);
+
+  /* Edits touching the first and last lines */
+  first = edit_lines (text, 0, 1, 2);
+  assert_same_as_full_diff (text, first);
+
+  appended = edit_lines (text, 10, 0, 3);
+  assert_same_as_full_diff (text, appended);
+
+  truncated = edit_lines (text, 7, 3, 0);
+  assert_same_as_full_diff (text, truncated);
+}
+
+static void
+test_line_diff_max_edit_distance (void)
+{
+  g_autoptr(GString) old_str = g_string_new (NULL);
+  g_autoptr(GString) near = g_string_new (NULL);
+  g_autoptr(GString) far = g_string_new (NULL);
+  g_autoptr(GArray) hunks = g_array_new (FALSE, FALSE, sizeof (LineHunk));
+  g_auto(GStrv) lines = NULL;
+  LineHunk sentinel = { 1, 2, 3, 4 };
+
+  append_fresh_lines (old_str, 1600);
+  lines = g_strsplit (old_str->str, "\n", 0);
+
+  /* Replacing every other line costs two edits each, so 450 of them
+   * stay within the limit and 550 go past it.
+   */
+  for (guint i = 0; i < 1600; i++)
+    {
+      if (i % 2 == 1 && i < (MAX_EDIT_DISTANCE / 2 - 50) * 2)
+        append_fresh_lines (near, 1);
+      else
+        g_string_append_printf (near, "%s\n", lines[i]);
+
+      if (i % 2 == 1 && i < (MAX_EDIT_DISTANCE / 2 + 50) * 2)
+        append_fresh_lines (far, 1);
+      else
+        g_string_append_printf (far, "%s\n", lines[i]);
+    }
+
+  assert_same_as_full_diff (old_str, near);
+
+  /* Too far apart, the caller must fall back without partial results */
+  g_array_append_val (hunks, sentinel);
+  g_assert_false (line_diff_texts (old_str, far, hunks));
+  g_assert_cmpint (hunks->len, ==, 1);
+}
+
+static void
+test_line_starts_splice (void)
+{
+  for (guint round = 0; round < 2000; round++)
+    {
+      g_autoptr(GString) str = g_string_new (NULL);
+      g_autoptr(GString) inserted = g_string_new (NULL);
+      g_autoptr(GString) result = g_string_new (NULL);
+      g_autoptr(GArray) starts = NULL;
+      g_autoptr(GArray) expected = NULL;
+      guint first_line;
+      guint n_removed;
+      guint last_line;
+      gsize begin;
+      gsize end;
+      gboolean to_end;
+
+      append_fresh_lines (str, g_test_rand_int_range (0, 8));
+      /* Sometimes there is no trailing newline */
+      if (g_test_rand_bit ())
+        g_string_append (str, "tail");
+
+      starts = line_starts_new (str->str, str->len);
+      first_line = g_test_rand_int_range (0, starts->len);
+      n_removed = g_test_rand_int_range (0, starts->len - first_line + 3);
+      to_end = n_removed >= starts->len - first_line;
+      last_line = to_end ? starts->len : first_line + n_removed;
+
+      begin = g_array_index (starts, guint, first_line);
+      end = last_line < starts->len ? g_array_index (starts, guint, last_line) : str->len;
+
+      append_fresh_lines (inserted, g_test_rand_int_range (0, 4));
+      /* Only splices reaching the end may leave a partial line */
+      if (to_end && g_test_rand_bit ())
+        g_string_append (inserted, "partial");
+
+      g_string_append_len (result, str->str, begin);
+      g_string_append_len (result, inserted->str, inserted->len);
+      g_string_append_len (result, str->str + end, str->len - end);
+
+      line_starts_splice (starts, first_line, n_removed, end - begin, inserted->str, inserted->len);
+      expected = line_starts_new (result->str, result->len);
+
+      g_assert_cmpint (starts->len, ==, expected->len);
+      g_assert_cmpmem (starts->data, starts->len * sizeof (guint),
+                       expected->data, expected->len * sizeof (guint));
+    }
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GFile) location = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *command = NULL;
+  gint ret;
+
+  g_test_init (&argc, &argv, NULL);
+
+  ggit_init ();
+
+  tmpdir = g_dir_make_tmp ("test-line-diff-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  location = g_file_new_for_path (tmpdir);
+  repository = ggit_repository_init_repository (location, TRUE, &error);
+  g_assert_no_error (error);
+
+  g_test_add_func ("/Git/LineDiff/random", test_line_diff_random);
+  g_test_add_func ("/Git/LineDiff/edges", test_line_diff_edges);
+  g_test_add_func ("/Git/LineDiff/max-edit-distance", test_line_diff_max_edit_distance);
+  g_test_add_func ("/Git/LineDiff/splice", test_line_starts_splice);
+
+  ret = g_test_run ();
+
+  g_clear_object (&repository);
+
+  command = g_strdup_printf ("rm -rf '%s'", tmpdir);
+  if (system (command) != 0)
+    g_warning ("Failed to execute command: %s", command);
+  g_free (tmpdir);
+
+  return ret;
+}
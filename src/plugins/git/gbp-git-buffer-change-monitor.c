@@ -39,10 +39,30 @@ struct _GbpGitBufferChangeMonitor
   LineCache              *cache;
   guint                   last_change_count;
   guint                   queued_source;
+
+  /*
+   * The lines changed since the peer was last updated. Lines before
+   * @dirty_begin are unchanged, and the peer's lines from @dirty_old_end
+   * are now found from @dirty_new_end.
+   */
+  guint                   dirty_begin;
+  guint                   dirty_old_end;
+  guint                   dirty_new_end;
+
+  /* Stashed by the handlers running before an insertion or deletion */
+  guint                   edit_begin_line;
+  guint                   edit_end_line;
+
   guint                   delete_range_requires_recalculation : 1;
   guint                   not_found : 1;
+  guint                   has_dirty : 1;
+  guint                   needs_content : 1;
+  guint                   edits_unsupported : 1;
 };
 
+/* Larger changes are sent as the complete buffer contents */
+#define MAX_EDIT_LINES 2000
+
 enum { SLOW, FAST };
 static const guint g_delay[] = { 750, 50 };
 
@@ -87,6 +107,37 @@ gbp_git_buffer_change_monitor_queue_update (GbpGitBufferChangeMonitor *self,
                                   g_object_unref);
 }
 
+static void
+gbp_git_buffer_change_monitor_track (GbpGitBufferChangeMonitor *self,
+                                     guint                      begin_line,
+                                     guint                      old_end_line,
+                                     guint                      new_end_line)
+{
+  guint end_line = old_end_line + 1;
+
+  g_assert (GBP_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+  g_assert (begin_line <= old_end_line);
+
+  if (!self->has_dirty)
+    {
+      self->dirty_begin = begin_line;
+      self->dirty_old_end = end_line;
+      self->dirty_new_end = end_line;
+      self->has_dirty = TRUE;
+    }
+  else
+    {
+      guint union_end = MAX (self->dirty_new_end, end_line);
+
+      /* Lines after the dirty region map directly to the peer's lines */
+      self->dirty_begin = MIN (self->dirty_begin, begin_line);
+      self->dirty_old_end += union_end - self->dirty_new_end;
+      self->dirty_new_end = union_end;
+    }
+
+  self->dirty_new_end = self->dirty_new_end + new_end_line - old_end_line;
+}
+
 static void
 gbp_git_buffer_change_monitor_destroy (IdeObject *object)
 {
@@ -150,6 +201,11 @@ buffer_delete_range_after_cb (GbpGitBufferChangeMonitor *self,
   g_assert (end != NULL);
   g_assert (IDE_IS_BUFFER (buffer));
 
+  gbp_git_buffer_change_monitor_track (self,
+                                       self->edit_begin_line,
+                                       self->edit_end_line,
+                                       self->edit_begin_line);
+
   if (self->delete_range_requires_recalculation)
     {
       self->delete_range_requires_recalculation = FALSE;
@@ -172,6 +228,9 @@ buffer_delete_range_cb (GbpGitBufferChangeMonitor *self,
 
   begin_line = gtk_text_iter_get_line (begin);
 
+  self->edit_begin_line = begin_line;
+  self->edit_end_line = gtk_text_iter_get_line (end);
+
   /*
    * We need to recalculate the diff when text is deleted if:
    *
@@ -201,6 +260,20 @@ recalculate:
   self->delete_range_requires_recalculation = TRUE;
 }
 
+static void
+buffer_insert_text_cb (GbpGitBufferChangeMonitor *self,
+                       GtkTextIter               *location,
+                       gchar                     *text,
+                       gint                       len,
+                       IdeBuffer                 *buffer)
+{
+  g_assert (GBP_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+  g_assert (location != NULL);
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  self->edit_begin_line = gtk_text_iter_get_line (location);
+}
+
 static void
 buffer_insert_text_after_cb (GbpGitBufferChangeMonitor *self,
                              GtkTextIter               *location,
@@ -228,6 +301,8 @@ buffer_insert_text_after_cb (GbpGitBufferChangeMonitor *self,
 
   line = gtk_text_iter_get_line (location);
 
+  gbp_git_buffer_change_monitor_track (self, self->edit_begin_line, self->edit_begin_line, line);
+
   if (self->cache == NULL ||
       NULL != memmem (text, len, "\n", 1) ||
       !line_cache_get_mark (self->cache, line))
@@ -348,8 +423,14 @@ gbp_git_buffer_change_monitor_class_init (GbpGitBufferChangeMonitorClass *klass)
 static void
 gbp_git_buffer_change_monitor_init (GbpGitBufferChangeMonitor *self)
 {
+  self->needs_content = TRUE;
   self->buffer_signals = dzl_signal_group_new (IDE_TYPE_BUFFER);
 
+  dzl_signal_group_connect_object (self->buffer_signals,
+                                   "insert-text",
+                                   G_CALLBACK (buffer_insert_text_cb),
+                                   self,
+                                   G_CONNECT_SWAPPED);
   dzl_signal_group_connect_object (self->buffer_signals,
                                    "insert-text",
                                    G_CALLBACK (buffer_insert_text_after_cb),
@@ -469,6 +550,74 @@ gbp_git_buffer_change_monitor_wait_cb (GObject      *object,
     }
 }
 
+static void
+gbp_git_buffer_change_monitor_apply_edit_cb (GObject      *object,
+                                             GAsyncResult *result,
+                                             gpointer      user_data)
+{
+  IpcGitChangeMonitor *proxy = (IpcGitChangeMonitor *)object;
+  g_autoptr(GbpGitBufferChangeMonitor) self = user_data;
+  g_autoptr(GError) error = NULL;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (IPC_IS_GIT_CHANGE_MONITOR (proxy));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (GBP_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+
+  if (!ipc_git_change_monitor_call_apply_edit_finish (proxy, result, &error))
+    {
+      /*
+       * The peer could not apply the edit, such as when the buffer uses
+       * line endings other than \n. Stop sending edits for this buffer
+       * and provide the complete contents instead.
+       */
+      g_debug ("Falling back to sending complete contents: %s", error->message);
+
+      self->edits_unsupported = TRUE;
+      self->last_change_count = 0;
+      gbp_git_buffer_change_monitor_queue_update (self, FAST);
+    }
+}
+
+static void
+gbp_git_buffer_change_monitor_send_edit (GbpGitBufferChangeMonitor *self,
+                                         IdeBuffer                 *buffer)
+{
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
+  g_autofree gchar *text = NULL;
+  guint n_removed;
+
+  g_assert (IDE_IS_MAIN_THREAD ());
+  g_assert (GBP_IS_GIT_BUFFER_CHANGE_MONITOR (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (self->has_dirty);
+
+  /* The snapshot includes the implicit trailing newline, if any, so that
+   * the lines match those of ide_buffer_dup_content().
+   */
+  snapshot = ide_buffer_ref_snapshot (buffer);
+
+  if (self->dirty_new_end < gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (buffer)))
+    {
+      text = ide_buffer_snapshot_dup_lines (snapshot, self->dirty_begin, self->dirty_new_end);
+      n_removed = self->dirty_old_end - self->dirty_begin;
+    }
+  else
+    {
+      text = ide_buffer_snapshot_dup_lines (snapshot, self->dirty_begin, G_MAXUINT);
+      n_removed = G_MAXUINT32;
+    }
+
+  ipc_git_change_monitor_call_apply_edit (self->proxy,
+                                          self->dirty_begin,
+                                          n_removed,
+                                          text,
+                                          ide_buffer_snapshot_get_n_lines (snapshot),
+                                          NULL,
+                                          gbp_git_buffer_change_monitor_apply_edit_cb,
+                                          g_object_ref (self));
+}
+
 void
 gbp_git_buffer_change_monitor_wait_async (GbpGitBufferChangeMonitor *self,
                                           GCancellable              *cancellable,
@@ -493,16 +642,32 @@ gbp_git_buffer_change_monitor_wait_async (GbpGitBufferChangeMonitor *self,
   change_count = ide_buffer_get_change_count (buffer);
 
   /* Update the peer of buffer contents immediately in-case it does
-   * not yet have teh newest version.
+   * not yet have teh newest version. When we can, only the lines that
+   * changed are sent so that the peer can avoid diffing the whole file.
    */
   if (change_count != self->last_change_count)
     {
-      g_autoptr(GBytes) bytes = ide_buffer_dup_content (buffer);
-
       self->last_change_count = change_count;
-      ipc_git_change_monitor_call_update_content (self->proxy,
-                                                  (const gchar *)g_bytes_get_data (bytes, NULL),
-                                                  NULL, NULL, NULL);
+
+      if (self->needs_content ||
+          self->edits_unsupported ||
+          !self->has_dirty ||
+          self->dirty_new_end - self->dirty_begin > MAX_EDIT_LINES ||
+          self->dirty_old_end - self->dirty_begin > MAX_EDIT_LINES)
+        {
+          g_autoptr(GBytes) bytes = ide_buffer_dup_content (buffer);
+
+          ipc_git_change_monitor_call_update_content (self->proxy,
+                                                      (const gchar *)g_bytes_get_data (bytes, NULL),
+                                                      NULL, NULL, NULL);
+        }
+      else
+        {
+          gbp_git_buffer_change_monitor_send_edit (self, buffer);
+        }
+
+      self->needs_content = FALSE;
+      self->has_dirty = FALSE;
     }
 
   ipc_git_change_monitor_call_list_changes (self->proxy,
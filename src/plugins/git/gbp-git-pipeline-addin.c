@@ -54,6 +54,11 @@ gbp_git_pipeline_addin_load (IdePipelineAddin *addin,
     return;
 
   submodule = gbp_git_submodule_stage_new (context);
+
+  /* Only the source tree is updated, so other stages may run meanwhile */
+  ide_pipeline_stage_add_output (IDE_PIPELINE_STAGE (submodule),
+                                 ide_pipeline_get_srcdir (pipeline));
+
   stage_id = ide_pipeline_attach (pipeline,
                                   IDE_PIPELINE_PHASE_PREPARE | IDE_PIPELINE_PHASE_AFTER,
                                   100,
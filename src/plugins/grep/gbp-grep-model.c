@@ -22,16 +22,19 @@
 
 #include "config.h"
 
+#include <glib/gi18n.h>
 #include <libide-code.h>
+#include <libide-io.h>
 #include <libide-vcs.h>
 
 #include "gbp-grep-model.h"
 
-typedef struct
-{
-  GBytes    *bytes;
-  GPtrArray *rows;
-} Index;
+#define DEFAULT_MAX_RESULTS 100000
+
+/* Avoid pathological lines, such as minified sources, before copying
+ * them into the UI process.
+ */
+#define MAX_LINE_LENGTH     256
 
 struct _GbpGrepModel
 {
@@ -42,22 +45,13 @@ struct _GbpGrepModel
   /* The root directory to start searching from. */
   GFile *directory;
 
-  /* The query text, which we use to send to grep as well as use with
-   * GRegex to extract the match positions from a specific line.
-   */
+  /* The query text, which is either literal or a regex */
   gchar *query;
 
-  /* We need to do client-side processing to extract the exact message
-   * locations after grep gives us the matching lines. This allows us to
-   * create IdeTextEdit source ranges later as well as creating the
-   * match positions for highlighting in the treeview cell renderers.
-   */
-  GRegex *message_regex;
-
-  /* Our index of matches, which can be compiled off the main thread
-   * and then assigned to the model after it has completed building.
+  /* The search providing our rows. Each match is a row, and they are
+   * added to the model as the search delivers them.
    */
-  Index *index;
+  IdeContentSearch *search;
 
   /* We store the index of the toggled items here, and use that to
    * reverse their selection from a base "all" or "nothing" mode.
@@ -72,7 +66,11 @@ struct _GbpGrepModel
 
   guint mode;
 
+  /* Stop reading results after this many rows */
+  guint max_results;
+
   guint has_scanned : 1;
+  guint truncated : 1;
   guint use_regex : 1;
   guint recursive : 1;
   guint case_sensitive : 1;
@@ -102,17 +100,6 @@ enum {
 };
 
 static GParamSpec *properties [N_PROPS];
-static GRegex     *line_regex;
-
-static void
-index_free (gpointer data)
-{
-  Index *idx = data;
-
-  g_clear_pointer (&idx->rows, g_ptr_array_unref);
-  g_clear_pointer (&idx->bytes, g_bytes_unref);
-  g_slice_free (Index, idx);
-}
 
 static void
 clear_line (GbpGrepModelLine *cl)
@@ -123,88 +110,43 @@ clear_line (GbpGrepModelLine *cl)
   g_clear_pointer (&cl->matches, g_array_unref);
 }
 
-static gboolean
-gbp_grep_model_line_parse (GbpGrepModelLine *cl,
-                           const gchar      *line,
-                           GRegex           *message_regex)
+static void
+gbp_grep_model_line_init (GbpGrepModelLine            *cl,
+                          const IdeContentSearchMatch *match)
 {
-  g_autoptr(GMatchInfo) match = NULL;
-  gsize line_len;
-
   g_assert (cl != NULL);
-  g_assert (line != NULL);
-  g_assert (line_regex != NULL);
-  g_assert (message_regex != NULL);
+  g_assert (match != NULL);
 
-  line_len = strlen (line);
+  cl->start_of_line = match->text;
+  cl->start_of_message = match->text;
+  cl->path = g_strdup (match->path);
+  cl->line = match->line + 1;
+  cl->matches = g_array_sized_new (FALSE, FALSE, sizeof (GbpGrepModelMatch), match->ranges->len);
 
-  if (g_regex_match_full (line_regex, line, line_len, 0, 0, &match, NULL))
+  for (guint i = 0; i < match->ranges->len; i++)
     {
-      g_autofree gchar *pathstr = NULL;
-      g_autofree gchar *linestr = NULL;
-      gint msg_begin = -1;
-      gint msg_end = -1;
-
-      pathstr = g_match_info_fetch (match, 1);
-      linestr = g_match_info_fetch (match, 2);
-
-      if (g_match_info_fetch_pos (match, 3, &msg_begin, &msg_end))
-        {
-          g_autoptr(GMatchInfo) msg_match = NULL;
-          gsize msg_len;
-
-          /* Make sure we parsed the message offset */
-          if (msg_begin < 0)
-            return FALSE;
-
-          cl->start_of_line = line;
-          cl->start_of_message = line + msg_begin;
-          cl->path = g_steal_pointer (&pathstr);
-          cl->matches = g_array_new (FALSE, FALSE, sizeof (GbpGrepModelMatch));
-          cl->line = g_ascii_strtoll (linestr, NULL, 10);
-
-          /* Now parse the matches for the line so that we can highlight
-           * them in the treeview and also determine the IdeTextEdit
-           * source range when editing files.
-           */
-
-          msg_len = line_len - msg_begin;
-
-          if (g_regex_match_full (message_regex, cl->start_of_message, msg_len, 0, 0, &msg_match, NULL))
-            {
-              do
-                {
-                  gint match_begin = -1;
-                  gint match_end = -1;
-
-                  if (g_match_info_fetch_pos (msg_match, 0, &match_begin, &match_end))
-                    {
-                      GbpGrepModelMatch cm;
-
-                      /*
-                       * We need to convert match offsets from bytes into the
-                       * number of UTF-8 (unichar) characters) so that we get
-                       * proper columns into the target file. Otherwise we risk
-                       * corrupting non-ASCII files.
-                       */
-                      cm.match_begin = g_utf8_strlen (cl->start_of_message, match_begin);
-                      cm.match_end = g_utf8_strlen (cl->start_of_message, match_end);
-                      cm.match_begin_bytes = match_begin;
-                      cm.match_end_bytes = match_end;
-
-                      g_array_append_val (cl->matches, cm);
-                    }
-                }
-              while (g_match_info_next (msg_match, NULL));
-
-              g_clear_pointer (&msg_match, g_match_info_free);
-            }
-        }
+      const IdeContentSearchRange *range = &g_array_index (match->ranges, IdeContentSearchRange, i);
+      GbpGrepModelMatch cm;
+
+      /*
+       * We need to convert match offsets from bytes into the
+       * number of UTF-8 (unichar) characters) so that we get
+       * proper columns into the target file. Otherwise we risk
+       * corrupting non-ASCII files.
+       */
+      cm.match_begin = g_utf8_strlen (match->text, range->begin);
+      cm.match_end = g_utf8_strlen (match->text, range->end);
+      cm.match_begin_bytes = range->begin;
+      cm.match_end_bytes = range->end;
 
-      return TRUE;
+      g_array_append_val (cl->matches, cm);
     }
+}
 
-  return FALSE;
+static inline guint
+gbp_grep_model_get_n_rows (GbpGrepModel *self)
+{
+  return self->search ? ide_content_search_get_n_matches (self->search) : 0;
 }
 
 GbpGrepModel *
@@ -239,10 +181,9 @@ gbp_grep_model_finalize (GObject *object)
 
   g_clear_object (&self->context);
   g_clear_object (&self->directory);
-  g_clear_pointer (&self->index, index_free);
+  g_clear_object (&self->search);
   g_clear_pointer (&self->query, g_free);
   g_clear_pointer (&self->toggled, g_hash_table_unref);
-  g_clear_pointer (&self->message_regex, g_regex_unref);
 
   G_OBJECT_CLASS (gbp_grep_model_parent_class)->finalize (object);
 }
@@ -365,57 +306,16 @@ gbp_grep_model_class_init (GbpGrepModelClass *klass)
                          (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_properties (object_class, N_PROPS, properties);
-
-  line_regex = g_regex_new ("([a-zA-Z0-9\\+\\-\\.\\/_]+):(\\d+):(.*)", 0, 0, NULL);
-  g_assert (line_regex != NULL);
 }
 
 static void
 gbp_grep_model_init (GbpGrepModel *self)
 {
   self->mode = MODE_ALL;
+  self->max_results = DEFAULT_MAX_RESULTS;
   self->toggled = g_hash_table_new (NULL, NULL);
 }
 
-static void
-gbp_grep_model_clear_regex (GbpGrepModel *self)
-{
-  g_assert (GBP_IS_GREP_MODEL (self));
-
-  g_clear_pointer (&self->message_regex, g_regex_unref);
-}
-
-static gboolean
-gbp_grep_model_rebuild_regex (GbpGrepModel *self)
-{
-  GRegexCompileFlags compile_flags = G_REGEX_OPTIMIZE;
-  g_autoptr(GRegex) regex = NULL;
-  g_autoptr(GError) error = NULL;
-  g_autofree gchar *escaped = NULL;
-  const gchar *query;
-
-  g_assert (GBP_IS_GREP_MODEL (self));
-  g_assert (self->message_regex == NULL);
-
-  if (self->use_regex)
-    query = self->query;
-  else
-    query = escaped = g_regex_escape_string (self->query, -1);
-
-  if (!self->case_sensitive)
-    compile_flags |= G_REGEX_CASELESS;
-
-  if (!(regex = g_regex_new (query, compile_flags, 0, &error)))
-    {
-      g_warning ("Failed to compile regex for match: %s", error->message);
-      return FALSE;
-    }
-
-  self->message_regex = g_steal_pointer (&regex);
-
-  return TRUE;
-}
-
 const gchar *
 gbp_grep_model_get_query (GbpGrepModel *self)
 {
@@ -434,7 +334,6 @@ gbp_grep_model_set_query (GbpGrepModel *self,
     {
       g_free (self->query);
       self->query = g_strdup (query);
-      gbp_grep_model_clear_regex (self);
       g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_QUERY]);
     }
 }
@@ -485,7 +384,6 @@ gbp_grep_model_set_use_regex (GbpGrepModel *self,
   if (use_regex != self->use_regex)
     {
       self->use_regex = use_regex;
-      gbp_grep_model_clear_regex (self);
       g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_USE_REGEX]);
     }
 }
@@ -534,7 +432,6 @@ gbp_grep_model_set_case_sensitive (GbpGrepModel *self,
   if (case_sensitive != self->case_sensitive)
     {
       self->case_sensitive = case_sensitive;
-      gbp_grep_model_clear_regex (self);
       g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_CASE_SENSITIVE]);
     }
 }
@@ -559,208 +456,140 @@ gbp_grep_model_set_at_word_boundaries (GbpGrepModel *self,
   if (at_word_boundaries != self->at_word_boundaries)
     {
       self->at_word_boundaries = at_word_boundaries;
-      gbp_grep_model_clear_regex (self);
       g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_AT_WORD_BOUNDARIES]);
     }
 }
 
-static IdeSubprocessLauncher *
-gbp_grep_model_create_launcher (GbpGrepModel *self)
+guint
+gbp_grep_model_get_max_results (GbpGrepModel *self)
 {
-  g_autoptr(IdeSubprocessLauncher) launcher = NULL;
-  const gchar *path;
-  IdeVcs *vcs;
-  GFile *workdir;
-  GType git_vcs;
-  gboolean use_git_grep = FALSE;
-
-  g_assert (GBP_IS_GREP_MODEL (self));
-  g_assert (self->query != NULL);
-  g_assert (self->query[0] != '\0');
-
-  vcs = ide_vcs_from_context (self->context);
-  workdir = ide_vcs_get_workdir (vcs);
-  git_vcs = g_type_from_name ("GbpGitVcs");
-
-  if (self->directory != NULL)
-    path = g_file_peek_path (self->directory);
-  else
-    path = g_file_peek_path (workdir);
-
-  launcher = ide_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE);
-
-  /*
-   * Soft runtime check for Git support, so that we can use "git grep"
-   * instead of the system "grep".
-   */
-  if (git_vcs != G_TYPE_INVALID && G_TYPE_CHECK_INSTANCE_TYPE (vcs, git_vcs))
-    use_git_grep = TRUE;
+  g_return_val_if_fail (GBP_IS_GREP_MODEL (self), 0);
 
-  if (use_git_grep)
-    {
-      ide_subprocess_launcher_push_argv (launcher, "git");
-      ide_subprocess_launcher_push_argv (launcher, "grep");
-    }
-  else
-    {
-#ifdef __FreeBSD__
-      ide_subprocess_launcher_push_argv (launcher, "bsdgrep");
-#else
-      ide_subprocess_launcher_push_argv (launcher, "grep");
-#endif
-    }
-
-  ide_subprocess_launcher_push_argv (launcher, "-I");
-  ide_subprocess_launcher_push_argv (launcher, "-H");
-  ide_subprocess_launcher_push_argv (launcher, "-n");
-
-  if (!self->case_sensitive)
-    ide_subprocess_launcher_push_argv (launcher, "-i");
-
-  if (self->at_word_boundaries)
-    ide_subprocess_launcher_push_argv (launcher, "-w");
-
-  if (!use_git_grep)
-    {
-      if (self->recursive)
-        ide_subprocess_launcher_push_argv (launcher, "-r");
-    }
-  else
-    {
-      if (!self->recursive)
-        ide_subprocess_launcher_push_argv (launcher, "--max-depth=0");
-
-      /* Allow files that are untracked, but not ignored */
-      ide_subprocess_launcher_push_argv (launcher, "--untracked");
-    }
-
-  ide_subprocess_launcher_push_argv (launcher, "-E");
+  return self->max_results;
+}
 
-  if (!self->use_regex)
-    {
-      g_autofree gchar *escaped = NULL;
+/**
+ * gbp_grep_model_set_max_results:
+ * @self: a #GbpGrepModel
+ * @max_results: the max number of rows, or 0 for unlimited
+ *
+ * Sets the number of matching lines after which the search is stopped.
+ */
+void
+gbp_grep_model_set_max_results (GbpGrepModel *self,
+                                guint         max_results)
+{
+  g_return_if_fail (GBP_IS_GREP_MODEL (self));
+  g_return_if_fail (self->has_scanned == FALSE);
 
-      escaped = g_regex_escape_string (self->query, -1);
-      ide_subprocess_launcher_push_argv (launcher, "-e");
-      ide_subprocess_launcher_push_argv (launcher, escaped);
-    }
-  else
-    {
-      ide_subprocess_launcher_push_argv (launcher, "-e");
-      ide_subprocess_launcher_push_argv (launcher, self->query);
-    }
+  self->max_results = max_results;
+}
 
-  if (use_git_grep)
-    {
-      /* Avoid pathological lines up front before reading them into
-       * the UI process memory space.
-       *
-       * Note that we do this *after* our query match because it causes
-       * grep to have to look at every line up to it. So to do this in
-       * reverse order is incredibly slow.
-       */
-      ide_subprocess_launcher_push_argv (launcher, "--and");
-      ide_subprocess_launcher_push_argv (launcher, "-e");
-      ide_subprocess_launcher_push_argv (launcher, "^.{0,256}$");
-    }
+/**
+ * gbp_grep_model_get_truncated:
+ * @self: a #GbpGrepModel
+ *
+ * Checks if the search was stopped because the max number of results
+ * was reached.
+ *
+ * Returns: %TRUE if there were more results than displayed
+ */
+gboolean
+gbp_grep_model_get_truncated (GbpGrepModel *self)
+{
+  g_return_val_if_fail (GBP_IS_GREP_MODEL (self), FALSE);
 
-  if (g_file_test (path, G_FILE_TEST_IS_DIR))
-    {
-      ide_subprocess_launcher_set_cwd (launcher, path);
-      self->was_directory = TRUE;
-    }
-  else
-    {
-      g_autofree gchar *parent = g_path_get_dirname (path);
-      g_autofree gchar *name = g_path_get_basename (path);
+  return self->truncated;
+}
 
-      self->was_directory = FALSE;
+static gboolean
+gbp_grep_model_is_ignored (GFile    *file,
+                           gpointer  user_data)
+{
+  IdeVcs *vcs = user_data;
 
-      ide_subprocess_launcher_set_cwd (launcher, parent);
-      ide_subprocess_launcher_push_argv (launcher, name);
-    }
+  g_assert (G_IS_FILE (file));
+  g_assert (IDE_IS_VCS (vcs));
 
-  return g_steal_pointer (&launcher);
+  return ide_vcs_is_ignored (vcs, file, NULL);
 }
 
 static void
-gbp_grep_model_build_index (IdeTask      *task,
-                            gpointer      source_object,
-                            gpointer      task_data,
-                            GCancellable *cancellable)
+gbp_grep_model_matches_added_cb (GbpGrepModel     *self,
+                                 guint             position,
+                                 guint             n_added,
+                                 IdeContentSearch *search)
 {
-  GBytes *bytes = task_data;
-  IdeLineReader reader;
-  Index *idx;
-  gchar *buf;
-  gsize len;
-
-  g_assert (IDE_IS_TASK (task));
-  g_assert (GBP_IS_GREP_MODEL (source_object));
-  g_assert (bytes != NULL);
-  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
-
-  buf = (gchar *)g_bytes_get_data (bytes, &len);
-  ide_line_reader_init (&reader, buf, len);
-
-  idx = g_slice_new0 (Index);
-  idx->bytes = g_bytes_ref (bytes);
-  idx->rows = g_ptr_array_new ();
+  g_assert (GBP_IS_GREP_MODEL (self));
+  g_assert (IDE_IS_CONTENT_SEARCH (search));
 
-  while ((buf = ide_line_reader_next (&reader, &len)))
+  /* Let any attached view know about the new rows so results are displayed
+   * while the search is still running.
+   */
+  for (guint i = position; i < position + n_added; i++)
     {
-      g_ptr_array_add (idx->rows, buf);
-      buf[len] = 0;
-    }
+      g_autoptr(GtkTreePath) path = gtk_tree_path_new_from_indices (i, -1);
+      GtkTreeIter iter = { .user_data = GUINT_TO_POINTER (i) };
 
-  ide_task_return_pointer (task, idx, index_free);
+      gtk_tree_model_row_inserted (GTK_TREE_MODEL (self), path, &iter);
+    }
 }
 
 static void
-gbp_grep_model_scan_cb (GObject      *object,
-                        GAsyncResult *result,
-                        gpointer      user_data)
+gbp_grep_model_run_cb (GObject      *object,
+                       GAsyncResult *result,
+                       gpointer      user_data)
 {
-  IdeSubprocess *subprocess = (IdeSubprocess *)object;
+  IdeContentSearch *search = (IdeContentSearch *)object;
   g_autoptr(IdeTask) task = user_data;
-  g_autoptr(GBytes) bytes = NULL;
   g_autoptr(GError) error = NULL;
-  g_autofree gchar *stdout_buf = NULL;
-  gsize len;
+  GbpGrepModel *self;
 
   IDE_ENTRY;
 
-  g_assert (IDE_IS_SUBPROCESS (object));
+  g_assert (IDE_IS_CONTENT_SEARCH (search));
   g_assert (G_IS_ASYNC_RESULT (result));
   g_assert (IDE_IS_TASK (task));
 
-  if (!ide_subprocess_communicate_utf8_finish (subprocess, result, &stdout_buf, NULL, &error))
+  self = ide_task_get_source_object (task);
+
+  if (!ide_content_search_run_finish (search, result, &error))
     {
       ide_task_return_error (task, g_steal_pointer (&error));
       IDE_EXIT;
     }
 
-  if (stdout_buf == NULL)
-    stdout_buf = g_strdup ("");
+  if ((self->truncated = ide_content_search_get_truncated (search)))
+    ide_object_message (self->context,
+                        _("Find in files was limited to the first %u results"),
+                        self->max_results);
 
-  len = strlen (stdout_buf);
-  bytes = g_bytes_new_take (g_steal_pointer (&stdout_buf), len);
-  ide_task_set_task_data (task, g_steal_pointer (&bytes), g_bytes_unref);
-  ide_task_run_in_thread (task, gbp_grep_model_build_index);
+  ide_task_return_boolean (task, TRUE);
 
   IDE_EXIT;
 }
 
+/**
+ * gbp_grep_model_scan_async:
+ * @self: a #GbpGrepModel
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: a #GAsyncReadyCallback
+ * @user_data: closure data for @callback
+ *
+ * Searches the directory and streams the matching lines into the model.
+ * Rows are inserted as they are found, so the model may be attached to a
+ * view before the search has completed. Cancelling @cancellable stops the
+ * search workers.
+ */
 void
 gbp_grep_model_scan_async (GbpGrepModel        *self,
                            GCancellable        *cancellable,
                            GAsyncReadyCallback  callback,
                            gpointer             user_data)
 {
-  g_autoptr(IdeSubprocessLauncher) launcher = NULL;
-  g_autoptr(IdeSubprocess) subprocess = NULL;
   g_autoptr(IdeTask) task = NULL;
-  g_autoptr(GError) error = NULL;
+  IdeVcs *vcs;
+  GFile *workdir;
 
   IDE_ENTRY;
 
@@ -790,20 +619,40 @@ gbp_grep_model_scan_async (GbpGrepModel        *self,
 
   self->has_scanned = TRUE;
 
-  launcher = gbp_grep_model_create_launcher (self);
-  subprocess = ide_subprocess_launcher_spawn (launcher, cancellable, &error);
-
-  if (subprocess == NULL)
-    {
-      ide_task_return_error (task, g_steal_pointer (&error));
-      IDE_EXIT;
-    }
+  vcs = ide_vcs_from_context (self->context);
+  workdir = ide_vcs_get_workdir (vcs);
 
-  ide_subprocess_communicate_utf8_async (subprocess,
-                                         NULL,
-                                         cancellable,
-                                         gbp_grep_model_scan_cb,
-                                         g_steal_pointer (&task));
+  if (self->directory == NULL)
+    self->directory = g_object_ref (workdir);
+
+  self->was_directory = g_file_query_file_type (self->directory, 0, NULL) == G_FILE_TYPE_DIRECTORY;
+
+  self->search = ide_content_search_new (self->directory);
+  ide_content_search_set_query (self->search, self->query);
+  ide_content_search_set_use_regex (self->search, self->use_regex);
+  ide_content_search_set_case_sensitive (self->search, self->case_sensitive);
+  ide_content_search_set_at_word_boundaries (self->search, self->at_word_boundaries);
+  ide_content_search_set_recursive (self->search, self->recursive);
+  ide_content_search_set_max_results (self->search, self->max_results);
+  ide_content_search_set_max_line_length (self->search, MAX_LINE_LENGTH);
+
+  /* Skip files the VCS ignores, unless searching outside of the project */
+  if (g_file_equal (self->directory, workdir) || g_file_has_prefix (self->directory, workdir))
+    ide_content_search_set_ignore_func (self->search,
+                                        gbp_grep_model_is_ignored,
+                                        g_object_ref (vcs),
+                                        g_object_unref);
+
+  g_signal_connect_object (self->search,
+                           "matches-added",
+                           G_CALLBACK (gbp_grep_model_matches_added_cb),
+                           self,
+                           G_CONNECT_SWAPPED);
+
+  ide_content_search_run_async (self->search,
+                                cancellable,
+                                gbp_grep_model_run_cb,
+                                g_steal_pointer (&task));
 
   IDE_EXIT;
 }
@@ -815,17 +664,8 @@ gbp_grep_model_scan_finish (GbpGrepModel  *self,
 {
   g_return_val_if_fail (GBP_IS_GREP_MODEL (self), FALSE);
   g_return_val_if_fail (IDE_IS_TASK (result), FALSE);
-  g_return_val_if_fail (self->index == NULL, FALSE);
 
-  self->index = ide_task_propagate_pointer (IDE_TASK (result), error);
-
-  /*
-   * Normally, we might emit ::row-inserted() for each row. But that
-   * is expensive and our normal use case is that we don't attach the
-   * model until the search has completed.
-   */
-
-  return self->index != NULL;
+  return ide_task_propagate_boolean (IDE_TASK (result), error);
 }
 
 void
@@ -906,7 +746,7 @@ gbp_grep_model_get_iter (GtkTreeModel *tree_model,
   g_assert (iter != NULL);
   g_assert (path != NULL);
 
-  if (self->index == NULL || self->index->rows == NULL)
+  if (self->search == NULL)
     return FALSE;
 
   indicies = gtk_tree_path_get_indices_with_depth (path, &depth);
@@ -916,7 +756,7 @@ gbp_grep_model_get_iter (GtkTreeModel *tree_model,
 
   iter->user_data = GINT_TO_POINTER (indicies[0]);
 
-  return indicies[0] >= 0 && indicies[0] < self->index->rows->len;
+  return indicies[0] >= 0 && indicies[0] < gbp_grep_model_get_n_rows (self);
 }
 
 static GtkTreePath *
@@ -956,7 +796,7 @@ gbp_grep_model_get_value (GtkTreeModel *tree_model,
        * It saves us a serious amount of string copies.
        */
       g_value_set_static_string (value,
-                                 g_ptr_array_index (self->index->rows, index_));
+                                 ide_content_search_get_match (self->search, index_)->text);
     }
   else if (column == 1)
     {
@@ -977,7 +817,7 @@ gbp_grep_model_iter_next (GtkTreeModel *tree_model,
 
   g_assert (GBP_IS_GREP_MODEL (self));
 
-  if (self->index == NULL)
+  if (self->search == NULL)
     return FALSE;
 
   index_ = GPOINTER_TO_UINT (iter->user_data);
@@ -988,7 +828,7 @@ gbp_grep_model_iter_next (GtkTreeModel *tree_model,
 
   iter->user_data = GUINT_TO_POINTER (index_);
 
-  return index_ < self->index->rows->len;
+  return index_ < gbp_grep_model_get_n_rows (self);
 }
 
 static gboolean
@@ -1003,9 +843,7 @@ gbp_grep_model_iter_children (GtkTreeModel *tree_model,
 
   iter->user_data = NULL;
 
-  return parent == NULL &&
-         self->index != NULL &&
-         self->index->rows->len > 0;
+  return parent == NULL && gbp_grep_model_get_n_rows (self) > 0;
 }
 
 static gboolean
@@ -1017,7 +855,7 @@ gbp_grep_model_iter_has_child (GtkTreeModel *tree_model,
   g_assert (GBP_IS_GREP_MODEL (self));
 
   if (iter == NULL)
-    return self->index != NULL && self->index->rows->len > 0;
+    return gbp_grep_model_get_n_rows (self) > 0;
 
   return FALSE;
 }
@@ -1031,10 +869,7 @@ gbp_grep_model_iter_n_children (GtkTreeModel *tree_model,
   g_assert (GBP_IS_GREP_MODEL (self));
 
   if (iter == NULL)
-    {
-      if (self->index != NULL)
-        return self->index->rows->len;
-    }
+    return gbp_grep_model_get_n_rows (self);
 
   return 0;
 }
@@ -1050,10 +885,10 @@ gbp_grep_model_iter_nth_child (GtkTreeModel *tree_model,
   g_assert (GBP_IS_GREP_MODEL (self));
   g_assert (iter != NULL);
 
-  if (parent == NULL && self->index != NULL)
+  if (parent == NULL && self->search != NULL)
     {
       iter->user_data = GUINT_TO_POINTER (n);
-      return n < self->index->rows->len;
+      return n < gbp_grep_model_get_n_rows (self);
     }
 
   return FALSE;
@@ -1092,7 +927,7 @@ gbp_grep_model_foreach_selected (GbpGrepModel *self,
   g_assert (GBP_IS_GREP_MODEL (self));
   g_assert (callback != NULL);
 
-  if (self->index == NULL)
+  if (self->search == NULL)
     return;
 
   if (self->mode == MODE_NONE)
@@ -1106,7 +941,9 @@ gbp_grep_model_foreach_selected (GbpGrepModel *self,
     }
   else if (self->mode == MODE_ALL)
     {
-      for (guint i = 0; i < self->index->rows->len; i++)
+      guint n_rows = gbp_grep_model_get_n_rows (self);
+
+      for (guint i = 0; i < n_rows; i++)
         {
           if (!g_hash_table_contains (self->toggled, GINT_TO_POINTER (i)))
             callback (self, i, user_data);
@@ -1122,41 +959,35 @@ create_edits_cb (GbpGrepModel *self,
                  gpointer      user_data)
 {
   GPtrArray *edits = user_data;
+  g_autoptr(GFile) file = NULL;
   GbpGrepModelLine line = {0};
-  const gchar *row;
+  guint lineno;
 
   g_assert (GBP_IS_GREP_MODEL (self));
-  g_assert (self->message_regex != NULL);
   g_assert (edits != NULL);
 
-  row = g_ptr_array_index (self->index->rows, index_);
-
-  if (gbp_grep_model_line_parse (&line, row, self->message_regex))
-    {
-      g_autoptr(GFile) file = NULL;
-      guint lineno;
+  gbp_grep_model_line_init (&line, ide_content_search_get_match (self->search, index_));
 
-      file = gbp_grep_model_get_file (self, line.path);
-      g_assert (G_IS_FILE (file));
+  file = gbp_grep_model_get_file (self, line.path);
+  g_assert (G_IS_FILE (file));
 
-      lineno = line.line ? line.line - 1 : 0;
+  lineno = line.line ? line.line - 1 : 0;
 
-      for (guint i = 0; i < line.matches->len; i++)
-        {
-          const GbpGrepModelMatch *match = &g_array_index (line.matches, GbpGrepModelMatch, i);
-          g_autoptr(IdeTextEdit) edit = NULL;
-          g_autoptr(IdeRange) range = NULL;
-          g_autoptr(IdeLocation) begin = NULL;
-          g_autoptr(IdeLocation) end = NULL;
+  for (guint i = 0; i < line.matches->len; i++)
+    {
+      const GbpGrepModelMatch *match = &g_array_index (line.matches, GbpGrepModelMatch, i);
+      g_autoptr(IdeTextEdit) edit = NULL;
+      g_autoptr(IdeRange) range = NULL;
+      g_autoptr(IdeLocation) begin = NULL;
+      g_autoptr(IdeLocation) end = NULL;
 
-          begin = ide_location_new (file, lineno, match->match_begin);
-          end = ide_location_new (file, lineno, match->match_end);
-          range = ide_range_new (begin, end);
+      begin = ide_location_new (file, lineno, match->match_begin);
+      end = ide_location_new (file, lineno, match->match_end);
+      range = ide_range_new (begin, end);
 
-          edit = ide_text_edit_new (range, NULL);
+      edit = ide_text_edit_new (range, NULL);
 
-          g_ptr_array_add (edits, g_steal_pointer (&edit));
-        }
+      g_ptr_array_add (edits, g_steal_pointer (&edit));
     }
 
   clear_line (&line);
@@ -1175,12 +1006,6 @@ gbp_grep_model_create_edits (GbpGrepModel *self)
 
   g_return_val_if_fail (GBP_IS_GREP_MODEL (self), NULL);
 
-  if (self->message_regex == NULL)
-    {
-      if (!gbp_grep_model_rebuild_regex (self))
-        return NULL;
-    }
-
   edits = g_ptr_array_new_with_free_func (g_object_unref);
   gbp_grep_model_foreach_selected (self, create_edits_cb, edits);
 
@@ -1200,33 +1025,25 @@ gbp_grep_model_get_line (GbpGrepModel            *self,
                          GtkTreeIter             *iter,
                          const GbpGrepModelLine **line)
 {
-  const gchar *str;
+  const IdeContentSearchMatch *match;
   guint index_;
 
   g_return_if_fail (GBP_IS_GREP_MODEL (self));
   g_return_if_fail (iter != NULL);
   g_return_if_fail (line != NULL);
-  g_return_if_fail (self->index != NULL);
-  g_return_if_fail (self->index->rows != NULL);
+  g_return_if_fail (self->search != NULL);
 
   *line = NULL;
 
   index_ = GPOINTER_TO_UINT (iter->user_data);
-  g_return_if_fail (index_ < self->index->rows->len);
+  g_return_if_fail (index_ < gbp_grep_model_get_n_rows (self));
 
-  str = g_ptr_array_index (self->index->rows, index_);
+  match = ide_content_search_get_match (self->search, index_);
 
-  if (str != self->prev_line.start_of_line)
+  if (match->text != self->prev_line.start_of_line)
     {
       clear_line (&self->prev_line);
-
-      if (self->message_regex == NULL)
-        {
-          if (!gbp_grep_model_rebuild_regex (self))
-            return;
-        }
-
-      gbp_grep_model_line_parse (&self->prev_line, str, self->message_regex);
+      gbp_grep_model_line_init (&self->prev_line, match);
     }
 
   *line = &self->prev_line;
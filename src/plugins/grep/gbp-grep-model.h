@@ -61,6 +61,10 @@ void          gbp_grep_model_set_case_sensitive     (GbpGrepModel            *se
 gboolean      gbp_grep_model_get_at_word_boundaries (GbpGrepModel            *self);
 void          gbp_grep_model_set_at_word_boundaries (GbpGrepModel            *self,
                                                      gboolean                 at_word_boundaries);
+guint         gbp_grep_model_get_max_results        (GbpGrepModel            *self);
+void          gbp_grep_model_set_max_results        (GbpGrepModel            *self,
+                                                     guint                    max_results);
+gboolean      gbp_grep_model_get_truncated          (GbpGrepModel            *self);
 const gchar  *gbp_grep_model_get_query              (GbpGrepModel            *self);
 void          gbp_grep_model_set_query              (GbpGrepModel            *self,
                                                      const gchar             *query);
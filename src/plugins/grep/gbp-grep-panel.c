@@ -41,6 +41,9 @@ struct _GbpGrepPanel
   GtkButton         *replace_button;
   GtkEntry          *replace_entry;
   GtkSpinner        *spinner;
+
+  /* Cancelled when the panel is closed to stop any running search */
+  GCancellable      *cancellable;
 };
 
 enum {
@@ -355,6 +358,19 @@ gbp_grep_panel_replace_clicked_cb (GbpGrepPanel *self,
                                         g_object_ref (self));
 }
 
+static void
+gbp_grep_panel_destroy (GtkWidget *widget)
+{
+  GbpGrepPanel *self = (GbpGrepPanel *)widget;
+
+  g_assert (GBP_IS_GREP_PANEL (self));
+
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+
+  GTK_WIDGET_CLASS (gbp_grep_panel_parent_class)->destroy (widget);
+}
+
 static void
 gbp_grep_panel_get_property (GObject    *object,
                              guint       prop_id,
@@ -402,6 +418,8 @@ gbp_grep_panel_class_init (GbpGrepPanelClass *klass)
   object_class->get_property = gbp_grep_panel_get_property;
   object_class->set_property = gbp_grep_panel_set_property;
 
+  widget_class->destroy = gbp_grep_panel_destroy;
+
   properties [PROP_MODEL] =
     g_param_spec_object ("model", NULL, NULL,
                          GBP_TYPE_GREP_MODEL,
@@ -426,6 +444,8 @@ gbp_grep_panel_init (GbpGrepPanel *self)
 
   gtk_widget_init_template (GTK_WIDGET (self));
 
+  self->cancellable = g_cancellable_new ();
+
   g_signal_connect_object (self->close_button,
                            "clicked",
                            G_CALLBACK (gtk_widget_destroy),
@@ -518,8 +538,8 @@ gbp_grep_panel_set_model (GbpGrepPanel *self,
 
   if (model != NULL)
     {
-      /* Disable replace button if we have nothing to replace. We only
-       * support setting the model after it has scanned, so this is fine.
+      /* Disable replace button if we have nothing to replace. The model
+       * may be set again once the scan has completed to update this.
        */
       if (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (model), NULL) == 0)
         gtk_widget_set_sensitive (GTK_WIDGET (self->replace_button), FALSE);
@@ -542,6 +562,22 @@ gbp_grep_panel_get_model (GbpGrepPanel *self)
   return GBP_GREP_MODEL (gtk_tree_view_get_model (self->tree_view));
 }
 
+/**
+ * gbp_grep_panel_get_cancellable:
+ * @self: a #GbpGrepPanel
+ *
+ * Gets a cancellable that is cancelled when the panel is destroyed.
+ *
+ * Returns: (transfer none) (nullable): a #GCancellable
+ */
+GCancellable *
+gbp_grep_panel_get_cancellable (GbpGrepPanel *self)
+{
+  g_return_val_if_fail (GBP_IS_GREP_PANEL (self), NULL);
+
+  return self->cancellable;
+}
+
 GtkWidget *
 gbp_grep_panel_new (void)
 {
@@ -69,9 +69,16 @@ gbp_grep_popover_scan_cb (GObject      *object,
   g_assert (GBP_IS_GREP_PANEL (panel));
 
   if (!gbp_grep_model_scan_finish (model, result, &error))
-    g_warning ("Failed to find files: %s", error->message);
-  else
-    gbp_grep_panel_set_model (panel, model);
+    {
+      if (!ide_error_ignore (error))
+        g_warning ("Failed to find files: %s", error->message);
+      return;
+    }
+
+  /* Rows were streamed into the model while scanning, but the panel
+   * still needs to update the replace button.
+   */
+  gbp_grep_panel_set_model (panel, model);
 
   gtk_widget_grab_focus (GTK_WIDGET (panel));
 }
@@ -120,8 +127,11 @@ gbp_grep_popover_button_clicked_cb (GbpGrepPopover *self,
   gtk_container_add (GTK_CONTAINER (utils), panel);
   gtk_widget_show (panel);
 
+  /* Attach the model up front so results show up as they are found */
+  gbp_grep_panel_set_model (GBP_GREP_PANEL (panel), model);
+
   gbp_grep_model_scan_async (model,
-                             NULL,
+                             gbp_grep_panel_get_cancellable (GBP_GREP_PANEL (panel)),
                              gbp_grep_popover_scan_cb,
                              g_object_ref (panel));
 
@@ -232,7 +232,7 @@ gbp_meson_build_system_load_commands_config_cb (GObject      *object,
       return;
     }
 
-  compile_commands = ide_compile_commands_new ();
+  compile_commands = ide_compile_commands_new_for_builddir (ide_pipeline_get_builddir (pipeline));
   file = g_file_new_for_path (path);
   cancellable = ide_task_get_cancellable (task);
 
@@ -310,7 +310,7 @@ gbp_meson_build_system_load_commands_async (GbpMesonBuildSystem *self,
       g_autoptr(IdeCompileCommands) compile_commands = NULL;
       g_autoptr(GFile) file = NULL;
 
-      compile_commands = ide_compile_commands_new ();
+      compile_commands = ide_compile_commands_new_for_builddir (ide_pipeline_get_builddir (pipeline));
       file = g_file_new_for_path (path);
 
       ide_compile_commands_load_async (compile_commands,
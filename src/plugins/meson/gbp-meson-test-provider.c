@@ -86,6 +86,7 @@ gbp_meson_test_provider_load_json (GbpMesonTestProvider *self,
       JsonNode *element;
       JsonNode *member;
       guint timeout = 0;
+      gint priority = 0;
 
       if (NULL == (element = json_array_get_element (array, i)) ||
           !JSON_NODE_HOLDS_OBJECT (element) ||
@@ -99,6 +100,10 @@ gbp_meson_test_provider_load_json (GbpMesonTestProvider *self,
           JSON_NODE_HOLDS_VALUE (member))
         timeout = json_node_get_int (member);
 
+      if (NULL != (member = json_object_get_member (obj, "priority")) &&
+          JSON_NODE_HOLDS_VALUE (member))
+        priority = json_node_get_int (member);
+
       if (NULL != (member = json_object_get_member (obj, "suite")) &&
           JSON_NODE_HOLDS_ARRAY (member) &&
           NULL != (sub_array = json_node_get_array (member)) &&
@@ -160,6 +165,7 @@ gbp_meson_test_provider_load_json (GbpMesonTestProvider *self,
                            "environ", environ_,
                            "group", group,
                            "id", name,
+                           "priority", priority,
                            "timeout", timeout,
                            "workdir", workdir,
                            NULL);
@@ -28,14 +28,12 @@ struct _GbpMesonTest
   gchar     **environ;
   gchar     **command;
   GFile      *workdir;
-  guint       timeout;
 };
 
 enum {
   PROP_0,
   PROP_COMMAND,
   PROP_ENVIRON,
-  PROP_TIMEOUT,
   PROP_WORKDIR,
   N_PROPS
 };
@@ -74,10 +72,6 @@ gbp_meson_test_get_property (GObject    *object,
       g_value_set_boxed (value, self->environ);
       break;
 
-    case PROP_TIMEOUT:
-      g_value_set_uint (value, self->timeout);
-      break;
-
     case PROP_WORKDIR:
       g_value_set_object (value, self->workdir);
       break;
@@ -105,10 +99,6 @@ gbp_meson_test_set_property (GObject      *object,
       self->environ = g_value_dup_boxed (value);
       break;
 
-    case PROP_TIMEOUT:
-      self->timeout = g_value_get_uint (value);
-      break;
-
     case PROP_WORKDIR:
       self->workdir = g_value_dup_object (value);
       break;
@@ -141,15 +131,6 @@ gbp_meson_test_class_init (GbpMesonTestClass *klass)
                         G_TYPE_STRV,
                         (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
 
-  properties [PROP_TIMEOUT] =
-    g_param_spec_uint ("timeout",
-                       "Timeout",
-                       "The timeout in seconds, or 0 for none",
-                       0,
-                       G_MAXUINT,
-                       0,
-                       (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
-
   properties [PROP_WORKDIR] =
     g_param_spec_object ("workdir",
                          "Workdir",
@@ -186,7 +167,7 @@ gbp_meson_test_get_timeout (GbpMesonTest *self)
 {
   g_return_val_if_fail (GBP_IS_MESON_TEST (self), 0);
 
-  return self->timeout;
+  return ide_test_get_timeout (IDE_TEST (self));
 }
 
 const gchar * const *
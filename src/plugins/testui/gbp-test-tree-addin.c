@@ -59,6 +59,40 @@ run_test_free (RunTest *state)
   g_slice_free (RunTest, state);
 }
 
+static void
+gbp_test_tree_addin_update_test_node (IdeTreeNode *node,
+                                      GParamSpec  *pspec,
+                                      IdeTest     *test)
+{
+  const gchar *display_name;
+  gint64 duration;
+
+  g_assert (IDE_IS_TREE_NODE (node));
+  g_assert (IDE_IS_TEST (test));
+
+  display_name = ide_test_get_display_name (test);
+  duration = ide_test_get_duration (test);
+
+  if (duration > 0 && ide_test_get_status (test) != IDE_TEST_STATUS_RUNNING)
+    {
+      g_autofree gchar *markup = NULL;
+
+      /* translators: %s is the name of the unit test, %.1lf is the seconds it took to run */
+      markup = g_markup_printf_escaped (_("%s <span fgalpha='40000'>%.1lf s</span>"),
+                                        display_name ? display_name : "",
+                                        duration / (gdouble)G_USEC_PER_SEC);
+      ide_tree_node_set_display_name (node, markup);
+      ide_tree_node_set_use_markup (node, TRUE);
+    }
+  else
+    {
+      ide_tree_node_set_use_markup (node, FALSE);
+      ide_tree_node_set_display_name (node, display_name);
+    }
+
+  ide_tree_node_set_icon_name (node, ide_test_get_icon_name (test));
+}
+
 static void
 show_test_panel (GbpTestTreeAddin *self)
 {
@@ -146,10 +180,21 @@ gbp_test_tree_addin_build_paths_cb (GObject      *object,
 
       child = ide_tree_node_new ();
       ide_tree_node_set_children_possible (child, FALSE);
-      ide_tree_node_set_display_name (child, ide_test_get_display_name (test));
-      ide_tree_node_set_icon_name (child, ide_test_get_icon_name (test));
       ide_tree_node_set_item (child, test);
+      gbp_test_tree_addin_update_test_node (child, NULL, test);
       ide_tree_node_append (node, child);
+
+      /* Show results and timing as tests complete, such as from run-all */
+      g_signal_connect_object (test,
+                               "notify::status",
+                               G_CALLBACK (gbp_test_tree_addin_update_test_node),
+                               child,
+                               G_CONNECT_SWAPPED);
+      g_signal_connect_object (test,
+                               "notify::duration",
+                               G_CALLBACK (gbp_test_tree_addin_update_test_node),
+                               child,
+                               G_CONNECT_SWAPPED);
     }
 
   ide_task_return_boolean (task, TRUE);
@@ -22,6 +22,7 @@
 
 #include <libide-code.h>
 #include <libide-gui.h>
+#include <libide-io.h>
 #include <string.h>
 
 #include "gbp-todo-model.h"
@@ -46,9 +47,9 @@ struct _GbpTodoModel {
 
 typedef struct
 {
-  GFile *file;
-  GFile *workdir;
-  guint use_git_grep : 1;
+  IdeVcs *vcs;
+  GFile  *root;
+  GFile  *workdir;
 } Mine;
 
 typedef struct
@@ -66,8 +67,6 @@ enum {
 };
 
 static GParamSpec *properties [N_PROPS];
-static GRegex *line1;
-static GRegex *line2;
 
 static const gchar *exclude_dirs[] = {
   ".bzr",
@@ -92,17 +91,20 @@ static const gchar *exclude_files[] = {
   "Makecache",
 };
 
-static const gchar *keywords[] = {
-  "FIXME",
-  "XXX",
-  "TODO",
-  "HACK",
-};
+/* Each keyword is its own alternative so that the search can use the
+ * keywords as literals to find candidate lines.
+ */
+static const gchar *query = "FIXME(:| )|XXX(:| )|TODO(:| )|HACK(:| )";
+
+/* GbpTodoItem keeps the matching line and up to 4 following lines */
+#define CONTEXT_AFTER   4
+#define MAX_LINE_LENGTH 256
 
 static void
 mine_free (Mine *m)
 {
-  g_clear_object (&m->file);
+  g_clear_object (&m->vcs);
+  g_clear_object (&m->root);
   g_clear_object (&m->workdir);
   g_slice_free (Mine, m);
 }
@@ -258,7 +260,6 @@ static void
 gbp_todo_model_class_init (GbpTodoModelClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  g_autoptr(GError) error = NULL;
 
   object_class->dispose = gbp_todo_model_dispose;
   object_class->get_property = gbp_todo_model_get_property;
@@ -272,14 +273,6 @@ gbp_todo_model_class_init (GbpTodoModelClass *klass)
                          (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_properties (object_class, N_PROPS, properties);
-
-  line1 = g_regex_new ("([a-zA-Z0-9@\\+\\-\\.\\/_]+):(\\d+):(.*)", 0, 0, &error);
-  g_assert_no_error (error);
-  g_assert (line1 != NULL);
-
-  line2 = g_regex_new ("([a-zA-Z0-9@\\+\\-\\.\\/_]+)-(\\d+)-(.*)", 0, 0, &error);
-  g_assert_no_error (error);
-  g_assert (line2 != NULL);
 }
 
 static void
@@ -310,301 +303,130 @@ gbp_todo_model_new (IdeVcs *vcs)
                        NULL);
 }
 
-static void
-gbp_todo_model_mine_worker (IdeTask      *task,
-                            gpointer      source_object,
-                            gpointer      task_data,
-                            GCancellable *cancellable)
+static gboolean
+gbp_todo_model_is_ignored (GFile    *file,
+                           gpointer  user_data)
 {
-  g_autoptr(IdeSubprocessLauncher) launcher = NULL;
-  g_autoptr(IdeSubprocess) subprocess = NULL;
-  g_autoptr(GError) error = NULL;
-  g_autoptr(GPtrArray) items = NULL;
-  g_autoptr(GbpTodoItem) item = NULL;
-  g_autoptr(GBytes) bytes = NULL;
-  g_autoptr(GTimer) timer = g_timer_new ();
-  g_autofree gchar *workpath = NULL;
-  GbpTodoModel *self = source_object;
-  Mine *m = task_data;
-  IdeLineReader reader;
-  ResultInfo *info;
-  gchar *stdoutstr = NULL;
-  gchar *line;
-  gsize pathlen = 0;
-  gsize stdoutstr_len;
-  gsize len;
+  Mine *m = user_data;
+  g_autofree gchar *name = NULL;
 
-  g_assert (IDE_IS_TASK (task));
-  g_assert (GBP_IS_TODO_MODEL (self));
+  g_assert (G_IS_FILE (file));
   g_assert (m != NULL);
-  g_assert (G_IS_FILE (m->file));
-  g_assert (!cancellable || G_IS_CANCELLABLE (cancellable));
 
-  launcher = ide_subprocess_launcher_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE);
+  name = g_file_get_basename (file);
 
-  if (!(workpath = g_file_get_path (m->workdir)))
+  for (guint i = 0; i < G_N_ELEMENTS (exclude_dirs); i++)
     {
-      ide_task_return_new_error (task,
-                                 G_IO_ERROR,
-                                 G_IO_ERROR_NOT_SUPPORTED,
-                                 "Cannot run on non-native file-systems");
-      return;
+      if (g_strcmp0 (name, exclude_dirs[i]) == 0)
+        return TRUE;
     }
 
-  pathlen = strlen (workpath);
-  ide_subprocess_launcher_set_cwd (launcher, workpath);
-
-  if (m->use_git_grep)
+  for (guint i = 0; i < G_N_ELEMENTS (exclude_files); i++)
     {
-      ide_subprocess_launcher_push_argv (launcher, "git");
-      ide_subprocess_launcher_push_argv (launcher, "grep");
-    }
-  else
-    {
-#ifdef __FreeBSD__
-      ide_subprocess_launcher_push_argv (launcher, "bsdgrep");
-#else
-      ide_subprocess_launcher_push_argv (launcher, "grep");
-#endif
+      if (g_pattern_match_simple (exclude_files[i], name))
+        return TRUE;
     }
 
-  ide_subprocess_launcher_push_argv (launcher, "-A");
-  ide_subprocess_launcher_push_argv (launcher, "5");
-  ide_subprocess_launcher_push_argv (launcher, "-I");
-  ide_subprocess_launcher_push_argv (launcher, "-H");
-  ide_subprocess_launcher_push_argv (launcher, "-n");
+  /*
+   * m->vcs is only set at construction, so safe to access via a worker
+   * thread. ide_vcs_is_ignored() is expected to be thread-safe as well.
+   */
+  if (g_file_has_prefix (file, m->workdir))
+    return ide_vcs_is_ignored (m->vcs, file, NULL);
 
-  if (!m->use_git_grep)
-    ide_subprocess_launcher_push_argv (launcher, "-r");
+  return FALSE;
+}
 
-  ide_subprocess_launcher_push_argv (launcher, "-E");
+static GbpTodoItem *
+gbp_todo_model_create_item (Mine                        *m,
+                            const IdeContentSearchMatch *match)
+{
+  g_autoptr(GString) str = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GFile) file = NULL;
+  g_autofree gchar *path = NULL;
+  GbpTodoItem *item;
+  const gchar *iter;
+  guint n_lines = 1;
 
-  if (!m->use_git_grep)
-    {
-      for (guint i = 0; i < G_N_ELEMENTS (exclude_files); i++)
-        {
-          const gchar *exclude_file = exclude_files[i];
-          g_autofree gchar *arg = NULL;
+  g_assert (m != NULL);
+  g_assert (match != NULL);
 
-          arg = g_strdup_printf ("--exclude=%s", exclude_file);
-          ide_subprocess_launcher_push_argv (launcher, arg);
-        }
+  file = g_file_get_child (m->root, match->path);
 
-      for (guint i = 0; i < G_N_ELEMENTS (exclude_dirs); i++)
-        {
-          const gchar *exclude_dir = exclude_dirs[i];
-          g_autofree gchar *arg = NULL;
+  if (!(path = g_file_get_relative_path (m->workdir, file)))
+    path = g_file_get_path (file);
 
-          arg = g_strdup_printf ("--exclude-dir=%s", exclude_dir);
-          ide_subprocess_launcher_push_argv (launcher, arg);
-        }
-    }
+  /*
+   * To avoid lots of small string allocations, each item keeps a single
+   * buffer with the path and lines packed together, and raw pointers into
+   * that data.
+   */
+  str = g_string_new (path);
+  g_string_append_c (str, 0);
+  g_string_append (str, match->text);
+  g_string_append_c (str, 0);
 
-  for (guint i = 0; i < G_N_ELEMENTS (keywords); i++)
+  if (match->context_after != NULL)
     {
-      const gchar *keyword = keywords[i];
-      g_autofree gchar *arg = NULL;
-
-      arg = g_strdup_printf ("%s(:| )", keyword);
-      ide_subprocess_launcher_push_argv (launcher, "-e");
-      ide_subprocess_launcher_push_argv (launcher, arg);
-
-      if (m->use_git_grep)
+      for (guint i = 0; match->context_after[i]; i++)
         {
-          /* Avoid pathological lines up front before reading them into
-           * the UI process memory space.
-           *
-           * Note that we do this *after* our TODO: match because it causes
-           * grep to have to look at every line up to it. So to do this in
-           * reverse order is incredibly slow.
-           */
-          ide_subprocess_launcher_push_argv (launcher, "--and");
-          ide_subprocess_launcher_push_argv (launcher, "-e");
-          ide_subprocess_launcher_push_argv (launcher, "^.{0,256}$");
+          g_string_append (str, match->context_after[i]);
+          g_string_append_c (str, 0);
+          n_lines++;
         }
     }
 
-  if (g_file_query_file_type (m->file, 0, NULL) != G_FILE_TYPE_DIRECTORY)
-    {
-      g_autofree gchar *path = NULL;
+  bytes = g_string_free_to_bytes (g_steal_pointer (&str));
+  iter = g_bytes_get_data (bytes, NULL);
 
-      path = g_file_get_path (m->workdir);
-      ide_subprocess_launcher_push_argv (launcher, path);
-    }
+  item = gbp_todo_item_new (bytes);
+  gbp_todo_item_set_path (item, iter);
+  gbp_todo_item_set_lineno (item, match->line + 1);
 
-  /* Spawn our grep process */
-  if (NULL == (subprocess = ide_subprocess_launcher_spawn (launcher, cancellable, &error)))
+  for (guint i = 0; i < n_lines; i++)
     {
-      ide_task_return_error (task, g_steal_pointer (&error));
-      return;
+      iter += strlen (iter) + 1;
+      gbp_todo_item_add_line (item, iter);
     }
 
-  /* Read all of the output into a giant string */
-  if (!ide_subprocess_communicate_utf8 (subprocess, NULL, NULL, &stdoutstr, NULL, &error))
-    {
-      ide_task_return_error (task, g_steal_pointer (&error));
-      return;
-    }
+  return item;
+}
 
-  /*
-   * To avoid lots of string allocations in the model, we instead
-   * store GObjects which contain a reference to the whole buffer
-   * (the GBytes) and raw pointers into that data. We'll create
-   * the buffer up front, but still mutate the contents as we
-   * walk through it.
-   */
-  stdoutstr_len = strlen (stdoutstr);
-  bytes = g_bytes_new_take (stdoutstr, stdoutstr_len);
+static void
+gbp_todo_model_mine_cb (GObject      *object,
+                        GAsyncResult *result,
+                        gpointer      user_data)
+{
+  IdeContentSearch *search = (IdeContentSearch *)object;
+  g_autoptr(IdeTask) task = user_data;
+  g_autoptr(GPtrArray) items = NULL;
+  g_autoptr(GError) error = NULL;
+  ResultInfo *info;
+  guint n_matches;
+  Mine *m;
 
-  items = g_ptr_array_new_with_free_func (g_object_unref);
+  g_assert (IDE_IS_CONTENT_SEARCH (search));
+  g_assert (G_IS_ASYNC_RESULT (result));
+  g_assert (IDE_IS_TASK (task));
 
-  /*
-   * Process the STDOUT string iteratively, while trying to be tidy
-   * with additional allocations. If we overwrite the trailing \n to
-   * a \0, we can use it as a C string.
-   */
-  ide_line_reader_init (&reader, stdoutstr, stdoutstr_len);
-  while (NULL != (line = ide_line_reader_next (&reader, &len)))
+  if (!ide_content_search_run_finish (search, result, &error))
     {
-      g_autoptr(GMatchInfo) match_info1 = NULL;
-      g_autoptr(GMatchInfo) match_info2 = NULL;
-
-      line[len] = '\0';
-
-      /* We just finished a group of lines, flush this item
-       * to the list of items and get started processing the
-       * next result.
-       */
-      if (g_str_has_prefix (line, "--"))
-        {
-          if (item != NULL)
-            {
-              if (m->use_git_grep)
-                {
-                  g_ptr_array_add (items, g_steal_pointer (&item));
-                }
-              else
-                {
-                  const gchar *pathstr = gbp_todo_item_get_path (item);
-
-                  /*
-                   * self->vcs is only set at construction, so safe to
-                   * access via a worker thread. ide_vcs_path_is_ignored()
-                   * is expected to be thread-safe as well.
-                   */
-                  if (!ide_vcs_path_is_ignored (self->vcs, pathstr, NULL))
-                    g_ptr_array_add (items, g_steal_pointer (&item));
-                  else
-                    g_clear_object (&item);
-                }
-            }
-
-          continue;
-        }
-
-      if (dzl_str_empty0 (line) || len > 256)
-        {
-          /* cancel anything if the line is too long so that we don't get into
-           * pathological cases.
-           */
-          g_clear_object (&item);
-          continue;
-        }
-
-      /* Try to match the first line */
-      if (item == NULL)
-        {
-          if (g_regex_match_full (line1, line, len, 0, 0, &match_info1, NULL))
-            {
-              gint begin;
-              gint end;
-
-              item = gbp_todo_item_new (bytes);
-
-              /* Get the path */
-              if (g_match_info_fetch_pos (match_info1, 1, &begin, &end))
-                {
-                  const gchar *pathstr;
-
-                  line[end] = '\0';
-                  pathstr = &line[begin];
-
-                  if (pathlen == 0 || strncmp (workpath, pathstr, pathlen) == 0)
-                    {
-                      pathstr += pathlen;
-
-                      while (*pathstr == G_DIR_SEPARATOR)
-                        pathstr++;
-                    }
-
-                  gbp_todo_item_set_path (item, pathstr);
-                }
-
-              /* Get the line number */
-              if (g_match_info_fetch_pos (match_info1, 2, &begin, &end))
-                {
-                  gint64 lineno;
-
-                  line[end] = '\0';
-                  lineno = g_ascii_strtoll (&line[begin], NULL, 10);
-                  gbp_todo_item_set_lineno (item, lineno);
-                }
-
-              /* Get the message */
-              if (g_match_info_fetch_pos (match_info1, 3, &begin, &end))
-                {
-                  line[end] = '\0';
-                  gbp_todo_item_add_line (item, &line[begin]);
-                }
-            }
-
-          continue;
-        }
-
-      g_assert (item != NULL);
-
-      if (g_regex_match_full (line2, line, len, 0, 0, &match_info2, NULL))
-        {
-          gint begin;
-          gint end;
-
-          /* Get the message */
-          if (g_match_info_fetch_pos (match_info2, 3, &begin, &end))
-            {
-              line[end] = '\0';
-              gbp_todo_item_add_line (item, &line[begin]);
-            }
-        }
+      ide_task_return_error (task, g_steal_pointer (&error));
+      return;
     }
 
-  /* We might have a trailing item w/o final -- */
-  if (item != NULL)
-    {
-      if (m->use_git_grep)
-        {
-          g_ptr_array_add (items, g_steal_pointer (&item));
-        }
-      else
-        {
-          const gchar *pathstr = gbp_todo_item_get_path (item);
-
-          /*
-           * self->vcs is only set at construction, so safe to
-           * access via a worker thread. ide_vcs_path_is_ignored()
-           * is expected to be thread-safe as well.
-           */
-          if (!ide_vcs_path_is_ignored (self->vcs, pathstr, NULL))
-            g_ptr_array_add (items, g_steal_pointer (&item));
-          else
-            g_clear_object (&item);
-        }
-    }
+  m = ide_task_get_task_data (task);
+  n_matches = ide_content_search_get_n_matches (search);
+  items = g_ptr_array_new_full (n_matches, g_object_unref);
 
-  g_debug ("Located %u TODO items in %0.4lf seconds",
-           items->len, g_timer_elapsed (timer, NULL));
+  for (guint i = 0; i < n_matches; i++)
+    g_ptr_array_add (items, gbp_todo_model_create_item (m, ide_content_search_get_match (search, i)));
+
+  g_debug ("Located %u TODO items", items->len);
 
   info = g_slice_new0 (ResultInfo);
-  info->self = g_object_ref (source_object);
+  info->self = g_object_ref (ide_task_get_source_object (task));
   info->items = g_steal_pointer (&items);
 
   gdk_threads_add_idle_full (G_PRIORITY_LOW + 100,
@@ -614,13 +436,6 @@ gbp_todo_model_mine_worker (IdeTask      *task,
   ide_task_return_boolean (task, TRUE);
 }
 
-static gboolean
-is_typed (IdeVcs      *vcs,
-          const gchar *name)
-{
-  return g_strcmp0 (G_OBJECT_TYPE_NAME (vcs), name) == 0;
-}
-
 /**
  * gbp_todo_model_mine_async:
  * @self: a #GbpTodoModel
@@ -647,8 +462,8 @@ gbp_todo_model_mine_async (GbpTodoModel        *self,
                            GAsyncReadyCallback  callback,
                            gpointer             user_data)
 {
+  g_autoptr(IdeContentSearch) search = NULL;
   g_autoptr(IdeTask) task = NULL;
-  GFile *workdir;
   Mine *m;
 
   g_return_if_fail (GBP_IS_TODO_MODEL (self));
@@ -658,7 +473,6 @@ gbp_todo_model_mine_async (GbpTodoModel        *self,
   task = ide_task_new (self, cancellable, callback, user_data);
   ide_task_set_priority (task, G_PRIORITY_LOW + 100);
   ide_task_set_source_tag (task, gbp_todo_model_mine_async);
-  ide_task_set_kind (task, IDE_TASK_KIND_INDEXER);
 
   if (!g_file_is_native (file))
     {
@@ -669,15 +483,30 @@ gbp_todo_model_mine_async (GbpTodoModel        *self,
       return;
     }
 
-  workdir = ide_vcs_get_workdir (self->vcs);
-
   m = g_slice_new0 (Mine);
-  m->file = g_object_ref (file);
-  m->workdir = g_object_ref (workdir);
-  m->use_git_grep = is_typed (self->vcs, "IdeGitVcs");
+  m->vcs = g_object_ref (self->vcs);
+  m->workdir = g_object_ref (ide_vcs_get_workdir (self->vcs));
+
+  /* Match paths are relative to the directory, or the parent of a file */
+  if (g_file_query_file_type (file, 0, NULL) == G_FILE_TYPE_DIRECTORY)
+    m->root = g_object_ref (file);
+  else
+    m->root = g_file_get_parent (file);
+
   ide_task_set_task_data (task, m, mine_free);
 
-  ide_task_run_in_thread (task, gbp_todo_model_mine_worker);
+  search = ide_content_search_new (file);
+  ide_content_search_set_query (search, query);
+  ide_content_search_set_use_regex (search, TRUE);
+  ide_content_search_set_case_sensitive (search, TRUE);
+  ide_content_search_set_context_after (search, CONTEXT_AFTER);
+  ide_content_search_set_max_line_length (search, MAX_LINE_LENGTH);
+  ide_content_search_set_ignore_func (search, gbp_todo_model_is_ignored, m, NULL);
+
+  ide_content_search_run_async (search,
+                                cancellable,
+                                gbp_todo_model_mine_cb,
+                                g_steal_pointer (&task));
 }
 
 /**
@@ -0,0 +1,202 @@
+/* bench-word-index.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <gtksourceview/gtksource.h>
+#include <stdlib.h>
+
+#include "gbp-word-index.h"
+
+/*
+ * Types a line into the middle of a large buffer, one character at a
+ * time, querying the word index for the word at the cursor after every
+ * keystroke. For comparison, a few keystrokes are also served with the
+ * whole-buffer regex scan the words provider used to perform.
+ */
+
+#define DEFAULT_N_LINES 50000
+#define N_BASELINE      5
+#define TYPED_TEXT      "  gtk_widget_queue_resize_no_redraw (widget_priv);"
+
+typedef struct
+{
+  guint n_words;
+} Query;
+
+static gboolean
+count_word (const gchar *word,
+            guint        count,
+            gpointer     user_data)
+{
+  Query *query = user_data;
+
+  query->n_words++;
+
+  return TRUE;
+}
+
+static void
+fill_buffer (GtkTextBuffer *buffer,
+             guint          n_lines)
+{
+  static const gchar *lines[] = {
+    "  gtk_widget_set_visible (GTK_WIDGET (self->%s_%u), TRUE);\n",
+    "  g_signal_connect_object (%s_%u, \"notify\", G_CALLBACK (on_notify_cb), self, 0);\n",
+    "static void %s_dispose_%u (GObject *object)\n",
+    "  /* Make sure the %s %u is cleared before chaining up */\n",
+    "  g_clear_object (&priv->%s_%u);\n",
+    "\n",
+  };
+  static const gchar *names[] = { "widget", "label", "button", "stack", "revealer", "popover" };
+  g_autoptr(GString) str = g_string_new (NULL);
+  GtkTextIter iter;
+
+  for (guint i = 0; i < n_lines; i++)
+    g_string_append_printf (str,
+                            lines[i % G_N_ELEMENTS (lines)],
+                            names[(i / G_N_ELEMENTS (lines)) % G_N_ELEMENTS (names)],
+                            i % 997);
+
+  gtk_text_buffer_get_start_iter (buffer, &iter);
+  gtk_text_buffer_insert (buffer, &iter, str->str, str->len);
+}
+
+static gchar *
+word_before (GtkTextBuffer     *buffer,
+             const GtkTextIter *location)
+{
+  GtkTextIter begin = *location;
+
+  while (gtk_text_iter_backward_char (&begin))
+    {
+      gunichar ch = gtk_text_iter_get_char (&begin);
+
+      if (!g_unichar_isalnum (ch) && ch != '_')
+        {
+          gtk_text_iter_forward_char (&begin);
+          break;
+        }
+    }
+
+  return gtk_text_iter_get_slice (&begin, location);
+}
+
+static guint
+regex_scan (GtkSourceBuffer *buffer,
+            const gchar     *word)
+{
+  g_autoptr(GtkSourceSearchSettings) settings = gtk_source_search_settings_new ();
+  g_autoptr(GtkSourceSearchContext) search = NULL;
+  g_autofree gchar *search_text = g_strconcat (word, "[a-zA-Z0-9_]*", NULL);
+  GtkTextIter iter, begin, end;
+  gboolean wrapped = FALSE;
+  guint n_matches = 0;
+
+  gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+  gtk_source_search_settings_set_at_word_boundaries (settings, TRUE);
+  gtk_source_search_settings_set_search_text (settings, search_text);
+
+  search = gtk_source_search_context_new (buffer, settings);
+  gtk_source_search_context_set_highlight (search, FALSE);
+
+  gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &iter);
+
+  while (gtk_source_search_context_forward (search, &iter, &begin, &end, &wrapped) && !wrapped)
+    {
+      n_matches++;
+      iter = end;
+    }
+
+  return n_matches;
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GtkSourceBuffer) buffer = NULL;
+  g_autoptr(GbpWordIndex) index = NULL;
+  GtkTextIter iter;
+  guint n_lines = DEFAULT_N_LINES;
+  gint64 max_usec = 0;
+  gint64 total_usec = 0;
+  gint64 begin;
+  guint n_keys = 0;
+
+  gtk_init_check (&argc, &argv);
+
+  if (argc > 1)
+    n_lines = MAX (1, g_ascii_strtoull (argv[1], NULL, 10));
+
+  buffer = gtk_source_buffer_new (NULL);
+  fill_buffer (GTK_TEXT_BUFFER (buffer), n_lines);
+
+  index = gbp_word_index_new (GTK_TEXT_BUFFER (buffer));
+
+  begin = g_get_monotonic_time ();
+  gbp_word_index_ensure (index);
+  g_print ("{\"phase\": \"build\", \"lines\": %u, \"words\": %u, \"msec\": %.2lf}\n",
+           n_lines, gbp_word_index_get_n_words (index),
+           (g_get_monotonic_time () - begin) / 1000.0);
+
+  gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &iter, n_lines / 2);
+  gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, "\n", 1);
+  gtk_text_iter_backward_char (&iter);
+
+  for (const gchar *c = TYPED_TEXT; *c; c++, n_keys++)
+    {
+      g_autofree gchar *word = NULL;
+      Query query = {0};
+      gint64 usec;
+
+      begin = g_get_monotonic_time ();
+
+      gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, c, 1);
+
+      if ((word = word_before (GTK_TEXT_BUFFER (buffer), &iter)) && *word)
+        gbp_word_index_foreach_prefix (index, word, count_word, &query);
+
+      usec = g_get_monotonic_time () - begin;
+      total_usec += usec;
+      max_usec = MAX (max_usec, usec);
+    }
+
+  g_print ("{\"phase\": \"typing\", \"lines\": %u, \"keystrokes\": %u, "
+           "\"avg_usec\": %.1lf, \"max_usec\": %" G_GINT64_FORMAT "}\n",
+           n_lines, n_keys, (gdouble)total_usec / n_keys, max_usec);
+
+  /* Every word we typed must now be indexed */
+  g_assert_cmpint (gbp_word_index_get_count (index, "gtk_widget_queue_resize_no_redraw"), ==, 1);
+  g_assert_cmpint (gbp_word_index_get_count (index, "widget_priv"), ==, 1);
+  g_assert_cmpint (gbp_word_index_get_count (index, "gtk_widget_queue_resize_no_redra"), ==, 0);
+
+  total_usec = 0;
+
+  for (guint i = 0; i < N_BASELINE; i++)
+    {
+      begin = g_get_monotonic_time ();
+      regex_scan (buffer, "gtk_wid");
+      total_usec += g_get_monotonic_time () - begin;
+    }
+
+  g_print ("{\"phase\": \"regex-scan\", \"lines\": %u, \"keystrokes\": %u, \"avg_usec\": %.1lf}\n",
+           n_lines, N_BASELINE, (gdouble)total_usec / N_BASELINE);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/* gbp-word-buffer-addin.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-word-buffer-addin"
+
+#include "config.h"
+
+#include "gbp-word-buffer-addin.h"
+
+struct _GbpWordBufferAddin
+{
+  GObject       parent_instance;
+  GbpWordIndex *index;
+};
+
+static void
+gbp_word_buffer_addin_load (IdeBufferAddin *addin,
+                            IdeBuffer      *buffer)
+{
+  GbpWordBufferAddin *self = (GbpWordBufferAddin *)addin;
+
+  g_assert (GBP_IS_WORD_BUFFER_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  self->index = gbp_word_index_new (GTK_TEXT_BUFFER (buffer));
+}
+
+static void
+gbp_word_buffer_addin_unload (IdeBufferAddin *addin,
+                              IdeBuffer      *buffer)
+{
+  GbpWordBufferAddin *self = (GbpWordBufferAddin *)addin;
+
+  g_assert (GBP_IS_WORD_BUFFER_ADDIN (self));
+  g_assert (IDE_IS_BUFFER (buffer));
+
+  g_clear_object (&self->index);
+}
+
+static void
+buffer_addin_iface_init (IdeBufferAddinInterface *iface)
+{
+  iface->load = gbp_word_buffer_addin_load;
+  iface->unload = gbp_word_buffer_addin_unload;
+}
+
+G_DEFINE_TYPE_WITH_CODE (GbpWordBufferAddin, gbp_word_buffer_addin, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (IDE_TYPE_BUFFER_ADDIN, buffer_addin_iface_init))
+
+static void
+gbp_word_buffer_addin_class_init (GbpWordBufferAddinClass *klass)
+{
+}
+
+static void
+gbp_word_buffer_addin_init (GbpWordBufferAddin *self)
+{
+}
+
+/**
+ * gbp_word_buffer_addin_get_index:
+ * @self: a #GbpWordBufferAddin
+ *
+ * Returns: (transfer none) (nullable): the #GbpWordIndex for the buffer,
+ *   or %NULL if the addin has been unloaded
+ */
+GbpWordIndex *
+gbp_word_buffer_addin_get_index (GbpWordBufferAddin *self)
+{
+  g_return_val_if_fail (GBP_IS_WORD_BUFFER_ADDIN (self), NULL);
+
+  return self->index;
+}
@@ -123,8 +123,9 @@ gbp_word_completion_provider_populate_async (IdeCompletionProvider *provider,
     self->proposals = gbp_word_proposals_new ();
 
   /*
-   * Avoid extra processing unless the user requested completion, since
-   * scanning the buffer is rather expensive.
+   * Only offer words when the user requested completion. Looking them up
+   * is cheap now that buffers are indexed, but they would otherwise crowd
+   * out proposals from language-aware providers.
    */
   activation = ide_completion_context_get_activation (context);
   if (activation != IDE_COMPLETION_USER_REQUESTED)
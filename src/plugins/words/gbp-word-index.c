@@ -0,0 +1,469 @@
+/* gbp-word-index.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gbp-word-index"
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gbp-word-index.h"
+
+/*
+ * Shorter words are not worth completing and longer ones are almost
+ * always encoded data rather than something a user would type.
+ */
+#define MIN_WORD_LEN 2
+#define MAX_WORD_LEN 128
+
+struct _GbpWordIndex
+{
+  GObject        parent_instance;
+
+  /* Unowned reference to the buffer, cleared when it is disposed */
+  GtkTextBuffer *buffer;
+
+  /*
+   * Maps the word to a Word containing the number of times it occurs
+   * in the buffer. Words are removed when that drops to zero.
+   */
+  GHashTable    *words;
+
+  /*
+   * The same Word structures, sorted so that a prefix query is a binary
+   * search followed by walking forward while the prefix still matches.
+   */
+  GSequence     *sorted;
+
+  /* Scratch space to NUL-terminate a word found within a line */
+  GString       *scratch;
+
+  /*
+   * The line where an insertion or deletion began, stashed by the
+   * handler running before the buffer is changed.
+   */
+  gint           pending_line;
+
+  /*
+   * The buffer is not tokenized until the first query, so that buffers
+   * where completion is never requested cost nothing.
+   */
+  guint          built : 1;
+};
+
+typedef struct
+{
+  gchar         *word;
+  GSequenceIter *iter;
+  guint          count;
+} Word;
+
+G_DEFINE_TYPE (GbpWordIndex, gbp_word_index, G_TYPE_OBJECT)
+
+static void
+word_free (gpointer data)
+{
+  Word *word = data;
+
+  g_free (word->word);
+  g_slice_free (Word, word);
+}
+
+/*
+ * Words are ordered ignoring case first, so that case-insensitive prefix
+ * queries (matching the regex search this replaced) are a contiguous run.
+ */
+static gint
+word_compare (gconstpointer a,
+              gconstpointer b,
+              gpointer      user_data)
+{
+  const Word *wa = a;
+  const Word *wb = b;
+  gint ret;
+
+  if ((ret = g_ascii_strcasecmp (wa->word, wb->word)) == 0)
+    ret = strcmp (wa->word, wb->word);
+
+  return ret;
+}
+
+static gint
+word_compare_prefix (gconstpointer a,
+                     gconstpointer b,
+                     gpointer      user_data)
+{
+  const Word *wa = a;
+  const Word *wb = b;
+  gint ret = g_ascii_strcasecmp (wa->word, wb->word);
+
+  /* Sort an exact match after the prefix so that we land before it */
+  return ret == 0 ? 1 : ret;
+}
+
+static inline gboolean
+is_word_char (guchar ch)
+{
+  /* Treat all non-ASCII as word characters to keep identifiers intact */
+  return g_ascii_isalnum (ch) || ch == '_' || ch >= 0x80;
+}
+
+static void
+gbp_word_index_adjust (GbpWordIndex *self,
+                       const gchar  *str,
+                       gsize         len,
+                       gint          delta)
+{
+  Word *word;
+
+  g_assert (GBP_IS_WORD_INDEX (self));
+  g_assert (str != NULL);
+  g_assert (delta == 1 || delta == -1);
+
+  g_string_truncate (self->scratch, 0);
+  g_string_append_len (self->scratch, str, len);
+
+  if ((word = g_hash_table_lookup (self->words, self->scratch->str)))
+    {
+      if (delta > 0)
+        {
+          word->count++;
+        }
+      else if (--word->count == 0)
+        {
+          g_sequence_remove (word->iter);
+          g_hash_table_remove (self->words, self->scratch->str);
+        }
+    }
+  else if (delta > 0)
+    {
+      word = g_slice_new0 (Word);
+      word->word = g_strndup (str, len);
+      word->count = 1;
+      word->iter = g_sequence_insert_sorted (self->sorted, word, word_compare, NULL);
+      g_hash_table_insert (self->words, word->word, word);
+    }
+}
+
+static void
+gbp_word_index_apply (GbpWordIndex *self,
+                      const gchar  *text,
+                      gint          delta)
+{
+  const gchar *iter = text;
+
+  g_assert (GBP_IS_WORD_INDEX (self));
+  g_assert (text != NULL);
+
+  while (*iter)
+    {
+      const gchar *begin;
+
+      while (*iter && !is_word_char (*iter))
+        iter++;
+
+      if (*iter == 0)
+        break;
+
+      begin = iter;
+
+      while (is_word_char (*iter))
+        iter++;
+
+      /* Skip numbers, they are not worth completing */
+      if (g_ascii_isdigit (*begin))
+        continue;
+
+      if (iter - begin >= MIN_WORD_LEN && iter - begin <= MAX_WORD_LEN)
+        gbp_word_index_adjust (self, begin, iter - begin, delta);
+    }
+}
+
+static void
+gbp_word_index_apply_lines (GbpWordIndex *self,
+                            gint          first_line,
+                            gint          last_line,
+                            gint          delta)
+{
+  g_autofree gchar *text = NULL;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_assert (GBP_IS_WORD_INDEX (self));
+  g_assert (first_line <= last_line);
+
+  gtk_text_buffer_get_iter_at_line (self->buffer, &begin, first_line);
+  gtk_text_buffer_get_iter_at_line (self->buffer, &end, last_line);
+
+  if (!gtk_text_iter_ends_line (&end))
+    gtk_text_iter_forward_to_line_end (&end);
+
+  text = gtk_text_iter_get_slice (&begin, &end);
+  gbp_word_index_apply (self, text, delta);
+}
+
+static void
+gbp_word_index_insert_text_cb (GbpWordIndex  *self,
+                               GtkTextIter   *location,
+                               const gchar   *text,
+                               gint           len,
+                               GtkTextBuffer *buffer)
+{
+  g_assert (GBP_IS_WORD_INDEX (self));
+  g_assert (location != NULL);
+  g_assert (GTK_IS_TEXT_BUFFER (buffer));
+
+  if (!self->built)
+    return;
+
+  /* The line is about to change, so forget what it contained */
+  self->pending_line = gtk_text_iter_get_line (location);
+  gbp_word_index_apply_lines (self, self->pending_line, self->pending_line, -1);
+}
+
+static void
+gbp_word_index_after_insert_text_cb (GbpWordIndex  *self,
+                                     GtkTextIter   *location,
+                                     const gchar   *text,
+                                     gint           len,
+                                     GtkTextBuffer *buffer)
+{
+  g_assert (GBP_IS_WORD_INDEX (self));
+  g_assert (location != NULL);
+  g_assert (GTK_IS_TEXT_BUFFER (buffer));
+
+  if (!self->built)
+    return;
+
+  /* @location is now after the inserted text, which may span lines */
+  gbp_word_index_apply_lines (self,
+                              self->pending_line,
+                              gtk_text_iter_get_line (location),
+                              1);
+}
+
+static void
+gbp_word_index_delete_range_cb (GbpWordIndex  *self,
+                                GtkTextIter   *begin,
+                                GtkTextIter   *end,
+                                GtkTextBuffer *buffer)
+{
+  g_assert (GBP_IS_WORD_INDEX (self));
+  g_assert (begin != NULL);
+  g_assert (end != NULL);
+  g_assert (GTK_IS_TEXT_BUFFER (buffer));
+
+  if (!self->built)
+    return;
+
+  self->pending_line = MIN (gtk_text_iter_get_line (begin), gtk_text_iter_get_line (end));
+  gbp_word_index_apply_lines (self,
+                              self->pending_line,
+                              MAX (gtk_text_iter_get_line (begin), gtk_text_iter_get_line (end)),
+                              -1);
+}
+
+static void
+gbp_word_index_after_delete_range_cb (GbpWordIndex  *self,
+                                      GtkTextIter   *begin,
+                                      GtkTextIter   *end,
+                                      GtkTextBuffer *buffer)
+{
+  g_assert (GBP_IS_WORD_INDEX (self));
+  g_assert (GTK_IS_TEXT_BUFFER (buffer));
+
+  if (!self->built)
+    return;
+
+  /* Whatever remains of the deleted lines has been joined together */
+  gbp_word_index_apply_lines (self, self->pending_line, self->pending_line, 1);
+}
+
+static void
+gbp_word_index_dispose (GObject *object)
+{
+  GbpWordIndex *self = (GbpWordIndex *)object;
+
+  g_clear_weak_pointer (&self->buffer);
+
+  G_OBJECT_CLASS (gbp_word_index_parent_class)->dispose (object);
+}
+
+static void
+gbp_word_index_finalize (GObject *object)
+{
+  GbpWordIndex *self = (GbpWordIndex *)object;
+
+  g_clear_pointer (&self->sorted, g_sequence_free);
+  g_clear_pointer (&self->words, g_hash_table_unref);
+  g_string_free (self->scratch, TRUE);
+
+  G_OBJECT_CLASS (gbp_word_index_parent_class)->finalize (object);
+}
+
+static void
+gbp_word_index_class_init (GbpWordIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = gbp_word_index_dispose;
+  object_class->finalize = gbp_word_index_finalize;
+}
+
+static void
+gbp_word_index_init (GbpWordIndex *self)
+{
+  self->words = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, word_free);
+  self->sorted = g_sequence_new (NULL);
+  self->scratch = g_string_new (NULL);
+}
+
+/**
+ * gbp_word_index_new:
+ * @buffer: a #GtkTextBuffer
+ *
+ * Creates a new index of the words within @buffer. The index is built
+ * upon the first call to gbp_word_index_ensure() and afterwards kept up
+ * to date by re-tokenizing only the lines touched by each change.
+ *
+ * Returns: (transfer full): a #GbpWordIndex
+ */
+GbpWordIndex *
+gbp_word_index_new (GtkTextBuffer *buffer)
+{
+  GbpWordIndex *self;
+
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+
+  self = g_object_new (GBP_TYPE_WORD_INDEX, NULL);
+  g_set_weak_pointer (&self->buffer, buffer);
+
+  g_signal_connect_object (buffer,
+                           "insert-text",
+                           G_CALLBACK (gbp_word_index_insert_text_cb),
+                           self,
+                           G_CONNECT_SWAPPED);
+  g_signal_connect_object (buffer,
+                           "insert-text",
+                           G_CALLBACK (gbp_word_index_after_insert_text_cb),
+                           self,
+                           G_CONNECT_SWAPPED | G_CONNECT_AFTER);
+  g_signal_connect_object (buffer,
+                           "delete-range",
+                           G_CALLBACK (gbp_word_index_delete_range_cb),
+                           self,
+                           G_CONNECT_SWAPPED);
+  g_signal_connect_object (buffer,
+                           "delete-range",
+                           G_CALLBACK (gbp_word_index_after_delete_range_cb),
+                           self,
+                           G_CONNECT_SWAPPED | G_CONNECT_AFTER);
+
+  return g_steal_pointer (&self);
+}
+
+/**
+ * gbp_word_index_ensure:
+ * @self: a #GbpWordIndex
+ *
+ * Tokenizes the whole buffer if that has not yet been done.
+ */
+void
+gbp_word_index_ensure (GbpWordIndex *self)
+{
+  g_autofree gchar *text = NULL;
+  GtkTextIter begin;
+  GtkTextIter end;
+
+  g_return_if_fail (GBP_IS_WORD_INDEX (self));
+
+  if (self->built || self->buffer == NULL)
+    return;
+
+  gtk_text_buffer_get_bounds (self->buffer, &begin, &end);
+  text = gtk_text_iter_get_slice (&begin, &end);
+  gbp_word_index_apply (self, text, 1);
+
+  self->built = TRUE;
+}
+
+guint
+gbp_word_index_get_n_words (GbpWordIndex *self)
+{
+  g_return_val_if_fail (GBP_IS_WORD_INDEX (self), 0);
+
+  return g_hash_table_size (self->words);
+}
+
+guint
+gbp_word_index_get_count (GbpWordIndex *self,
+                          const gchar  *word)
+{
+  const Word *w;
+
+  g_return_val_if_fail (GBP_IS_WORD_INDEX (self), 0);
+  g_return_val_if_fail (word != NULL, 0);
+
+  if ((w = g_hash_table_lookup (self->words, word)))
+    return w->count;
+
+  return 0;
+}
+
+/**
+ * gbp_word_index_foreach_prefix:
+ * @self: a #GbpWordIndex
+ * @prefix: the prefix of the words to find
+ * @foreach_func: (scope call): a #GbpWordIndexForeach
+ * @user_data: closure data for @foreach_func
+ *
+ * Calls @foreach_func for every word starting with @prefix, ignoring
+ * ASCII case, in sorted order until it returns %FALSE. The index must have been built with
+ * gbp_word_index_ensure() first.
+ */
+void
+gbp_word_index_foreach_prefix (GbpWordIndex        *self,
+                               const gchar         *prefix,
+                               GbpWordIndexForeach  foreach_func,
+                               gpointer             user_data)
+{
+  Word needle = { (gchar *)prefix };
+  GSequenceIter *iter;
+  gsize prefix_len;
+
+  g_return_if_fail (GBP_IS_WORD_INDEX (self));
+  g_return_if_fail (prefix != NULL);
+  g_return_if_fail (foreach_func != NULL);
+
+  prefix_len = strlen (prefix);
+
+  for (iter = g_sequence_search (self->sorted, &needle, word_compare_prefix, NULL);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    {
+      const Word *word = g_sequence_get (iter);
+
+      if (g_ascii_strncasecmp (word->word, prefix, prefix_len) != 0)
+        break;
+
+      if (!foreach_func (word->word, word->count, user_data))
+        break;
+    }
+}
@@ -0,0 +1,53 @@
+/* gbp-word-index.h
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define GBP_TYPE_WORD_INDEX (gbp_word_index_get_type())
+
+G_DECLARE_FINAL_TYPE (GbpWordIndex, gbp_word_index, GBP, WORD_INDEX, GObject)
+
+/**
+ * GbpWordIndexForeach:
+ * @word: a word starting with the requested prefix
+ * @count: the number of times @word occurs in the buffer
+ * @user_data: closure data
+ *
+ * Returns: %FALSE to stop iterating
+ */
+typedef gboolean (*GbpWordIndexForeach) (const gchar *word,
+                                         guint        count,
+                                         gpointer     user_data);
+
+GbpWordIndex *gbp_word_index_new            (GtkTextBuffer       *buffer);
+void          gbp_word_index_ensure         (GbpWordIndex        *self);
+guint         gbp_word_index_get_n_words    (GbpWordIndex        *self);
+guint         gbp_word_index_get_count      (GbpWordIndex        *self,
+                                             const gchar         *word);
+void          gbp_word_index_foreach_prefix (GbpWordIndex        *self,
+                                             const gchar         *prefix,
+                                             GbpWordIndexForeach  foreach_func,
+                                             gpointer             user_data);
+
+G_END_DECLS
@@ -25,9 +25,17 @@
 
 #include <libide-sourceview.h>
 
+#include "gbp-word-buffer-addin.h"
+#include "gbp-word-index.h"
 #include "gbp-word-proposal.h"
 #include "gbp-word-proposals.h"
 
+/*
+ * Short prefixes can match most of the words in a project, far more than
+ * anyone would scroll through. Refiltering narrows within this set.
+ */
+#define MAX_PROPOSALS 5000
+
 struct _GbpWordProposals
 {
   GObject parent_instance;
@@ -74,27 +82,11 @@ typedef struct
   guint        priority;
 } Item;
 
-typedef struct
-{
-  GtkTextMark *mark;
-  guint wrapped : 1;
-} State;
-
 static void list_model_iface_init (GListModelInterface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (GbpWordProposals, gbp_word_proposals, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL, list_model_iface_init))
 
-static void
-state_free (gpointer data)
-{
-  State *state = data;
-
-  gtk_text_buffer_delete_mark (gtk_text_mark_get_buffer (state->mark), state->mark);
-  g_object_unref (state->mark);
-  g_slice_free (State, state);
-}
-
 static void
 gbp_word_proposals_finalize (GObject *object)
 {
@@ -147,81 +139,58 @@ gbp_word_proposals_add (GbpWordProposals *self,
   g_hash_table_add (self->words_dedup, (gchar *)word);
 }
 
-static void
-gbp_word_proposals_backward_cb (GObject      *object,
-                                GAsyncResult *result,
-                                gpointer      user_data)
+typedef struct
 {
-  GtkSourceSearchContext *search = (GtkSourceSearchContext *)object;
-  g_autoptr(IdeTask) task = user_data;
-  g_autoptr(GError) error = NULL;
-  g_autofree gchar *word = NULL;
-  GbpWordProposals *self;
-  GtkTextBuffer *buffer;
-  GCancellable *cancellable;
-  GtkTextIter begin, end;
-  gboolean wrapped = FALSE;
-  State *state;
-
-  g_assert (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
-  g_assert (G_IS_ASYNC_RESULT (result));
-  g_assert (IDE_IS_TASK (task));
-
-  buffer = GTK_TEXT_BUFFER (gtk_source_search_context_get_buffer (search));
-
-  if (ide_source_search_context_backward_finish2 (search, result, &begin, &end, &wrapped, &error))
-    {
-      guint line;
-      guint line_offset;
-
-      line = gtk_text_iter_get_line (&begin);
-      line_offset = gtk_text_iter_get_line_offset (&begin);
-      gtk_text_buffer_get_iter_at_line_offset (buffer, &begin, line, line_offset);
-
-      line = gtk_text_iter_get_line (&end);
-      line_offset = gtk_text_iter_get_line_offset (&end);
-      gtk_text_buffer_get_iter_at_line_offset (buffer, &end, line, line_offset);
+  GbpWordProposals  *self;
+  GtkTextBuffer     *buffer;
+  GtkSourceLanguage *language;
+  const gchar       *prefix;
+  const gchar       *current;
+} Collect;
+
+static gboolean
+collect_word (const gchar *word,
+              guint        count,
+              gpointer     user_data)
+{
+  Collect *collect = user_data;
 
-      word = gtk_text_iter_get_slice (&begin, &end);
-    }
-  else
-    {
-      if (error != NULL)
-        ide_task_return_error (task, g_steal_pointer (&error));
-      else
-        ide_task_return_boolean (task, TRUE);
-      return;
-    }
+  /* Skip the word being typed unless it also occurs elsewhere */
+  if (count > 1 || g_strcmp0 (word, collect->current) != 0)
+    gbp_word_proposals_add (collect->self, word);
 
-  if (ide_task_return_error_if_cancelled (task))
-    return;
+  return collect->self->unfiltered->len < MAX_PROPOSALS;
+}
 
-  self = ide_task_get_source_object (task);
-  cancellable = ide_task_get_cancellable (task);
-  state = ide_task_get_task_data (task);
+static GbpWordIndex *
+find_index (IdeBuffer *buffer)
+{
+  IdeBufferAddin *addin;
 
-  state->wrapped |= wrapped;
+  if ((addin = ide_buffer_addin_find_by_module_name (buffer, "words")))
+    return gbp_word_buffer_addin_get_index (GBP_WORD_BUFFER_ADDIN (addin));
 
-  if (state->wrapped)
-    {
-      GtkTextIter iter;
+  return NULL;
+}
 
-      gtk_text_buffer_get_iter_at_mark (buffer, &iter, state->mark);
+static void
+collect_from_buffer (IdeBuffer *buffer,
+                     gpointer   user_data)
+{
+  Collect *collect = user_data;
+  GbpWordIndex *index;
 
-      if (gtk_text_iter_compare (&begin, &iter) <= 0)
-        {
-          ide_task_return_boolean (task, TRUE);
-          return;
-        }
-    }
+  g_assert (IDE_IS_BUFFER (buffer));
+  g_assert (collect != NULL);
 
-  gbp_word_proposals_add (self, word);
+  if (GTK_TEXT_BUFFER (buffer) == collect->buffer ||
+      gtk_source_buffer_get_language (GTK_SOURCE_BUFFER (buffer)) != collect->language ||
+      collect->self->unfiltered->len >= MAX_PROPOSALS ||
+      !(index = find_index (buffer)))
+    return;
 
-  ide_source_search_context_backward_async (search,
-                                            &begin,
-                                            cancellable,
-                                            gbp_word_proposals_backward_cb,
-                                            g_steal_pointer (&task));
+  gbp_word_index_ensure (index);
+  gbp_word_index_foreach_prefix (index, collect->prefix, collect_word, collect);
 }
 
 void
@@ -232,12 +201,12 @@ gbp_word_proposals_populate_async (GbpWordProposals     *self,
                                    gpointer              user_data)
 {
   g_autoptr(IdeTask) task = NULL;
-  g_autoptr(GtkSourceSearchContext) search = NULL;
-  g_autoptr(GtkSourceSearchSettings) settings = NULL;
-  g_autofree gchar *search_text = NULL;
+  g_autoptr(IdeContext) ide_context = NULL;
+  g_autofree gchar *current = NULL;
   GtkTextBuffer *buffer;
-  State *state;
+  GbpWordIndex *index;
   GtkTextIter begin, end;
+  Collect collect;
   guint old_len;
 
   g_assert (GBP_IS_WORD_PROPOSALS (self));
@@ -266,7 +235,10 @@ gbp_word_proposals_populate_async (GbpWordProposals     *self,
    * we'd just create a list of every word in the file. While that might
    * be interesting, it's more work than we want to do currently.
    */
-  if (!ide_completion_context_get_bounds (context, &begin, &end))
+  buffer = ide_completion_context_get_buffer (context);
+  if (!IDE_IS_BUFFER (buffer) ||
+      !ide_completion_context_get_bounds (context, &begin, &end) ||
+      !(index = find_index (IDE_BUFFER (buffer))))
     {
       ide_task_return_boolean (task, TRUE);
       return;
@@ -274,27 +246,53 @@ gbp_word_proposals_populate_async (GbpWordProposals     *self,
 
   self->last_word = gtk_text_iter_get_slice (&begin, &end);
 
-  settings = gtk_source_search_settings_new ();
-  gtk_source_search_settings_set_regex_enabled (settings, TRUE);
-  gtk_source_search_settings_set_at_word_boundaries (settings, TRUE);
-  search_text = g_strconcat (self->last_word, "[a-zA-Z0-9_]*", NULL);
-  gtk_source_search_settings_set_search_text (settings, search_text);
-  gtk_source_search_settings_set_wrap_around (settings, TRUE);
+  /* The whole word at the cursor, which the index already contains */
+  while (!gtk_text_iter_is_end (&end) &&
+         (g_unichar_isalnum (gtk_text_iter_get_char (&end)) ||
+          gtk_text_iter_get_char (&end) == '_'))
+    gtk_text_iter_forward_char (&end);
+  current = gtk_text_iter_get_slice (&begin, &end);
+
+  collect.self = self;
+  collect.buffer = buffer;
+  collect.language = gtk_source_buffer_get_language (GTK_SOURCE_BUFFER (buffer));
+  collect.prefix = self->last_word;
+  collect.current = current;
+
+  gbp_word_index_ensure (index);
+  gbp_word_index_foreach_prefix (index, self->last_word, collect_word, &collect);
+
+  /* Then the other open buffers sharing our language */
+  collect.current = NULL;
+  ide_context = ide_buffer_ref_context (IDE_BUFFER (buffer));
+  ide_buffer_manager_foreach (ide_buffer_manager_from_context (ide_context),
+                              collect_from_buffer,
+                              &collect);
+
+  ide_task_return_boolean (task, TRUE);
+}
 
-  buffer = ide_completion_context_get_buffer (context);
-  search = gtk_source_search_context_new (GTK_SOURCE_BUFFER (buffer), settings);
-  gtk_source_search_context_set_highlight (search, FALSE);
-
-  state = g_slice_new0 (State);
-  state->mark = gtk_text_buffer_create_mark (buffer, NULL, &begin, TRUE);
-  g_object_ref (state->mark);
-  ide_task_set_task_data (task, state, state_free);
-
-  ide_source_search_context_backward_async (search,
-                                            &begin,
-                                            NULL,
-                                            gbp_word_proposals_backward_cb,
-                                            g_steal_pointer (&task));
+static void
+gbp_word_proposals_match_all (GbpWordProposals *self,
+                              const gchar      *word)
+{
+  g_autoptr(GArray) matches = NULL;
+
+  g_assert (GBP_IS_WORD_PROPOSALS (self));
+  g_assert (word != NULL);
+
+  matches = ide_completion_fuzzy_match_batch ((const gchar * const *)self->unfiltered->pdata,
+                                              self->unfiltered->len,
+                                              word,
+                                              0);
+
+  for (guint i = 0; i < matches->len; i++)
+    {
+      const IdeCompletionFuzzyMatch *match = &g_array_index (matches, IdeCompletionFuzzyMatch, i);
+      Item item = { g_ptr_array_index (self->unfiltered, match->index), match->priority };
+
+      g_array_append_val (self->items, item);
+    }
 }
 
 gboolean
@@ -313,17 +311,7 @@ gbp_word_proposals_populate_finish (GbpWordProposals  *self,
 
   word = self->last_word ? self->last_word : "";
 
-  for (guint i = 0; i < self->unfiltered->len; i++)
-    {
-      const gchar *element = g_ptr_array_index (self->unfiltered, i);
-      guint priority;
-
-      if (ide_completion_fuzzy_match (element, word, &priority))
-        {
-          Item item = { element, priority };
-          g_array_append_val (self->items, item);
-        }
-    }
+  gbp_word_proposals_match_all (self, word);
 
   if (old_len || self->items->len)
     g_list_model_items_changed (G_LIST_MODEL (self), 0, old_len, self->items->len);
@@ -372,17 +360,7 @@ gbp_word_proposals_refilter (GbpWordProposals *self,
       if (old_len)
         g_array_remove_range (self->items, 0, old_len);
 
-      for (guint i = 0; i < self->unfiltered->len; i++)
-        {
-          const gchar *element = g_ptr_array_index (self->unfiltered, i);
-          guint priority;
-
-          if (ide_completion_fuzzy_match (element, word, &priority))
-            {
-              Item item = { element, priority };
-              g_array_append_val (self->items, item);
-            }
-        }
+      gbp_word_proposals_match_all (self, word);
     }
 
   g_array_sort (self->items, compare_item);
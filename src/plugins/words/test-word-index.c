@@ -0,0 +1,177 @@
+/* test-word-index.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <gtk/gtk.h>
+
+#include "gbp-word-index.h"
+
+static const gchar *fragments[] = {
+  "a", "ab", "gtk_widget", "Widget", "widget_priv", "x1", "_", "é", "ñandú",
+  " ", "  ", "(", ");", ", ", ".", "->", "\n", "\n\n", "  /* comment */\n",
+};
+
+static gboolean
+append_word (const gchar *word,
+             guint        count,
+             gpointer     user_data)
+{
+  GString *str = user_data;
+
+  g_string_append_printf (str, "%s=%u\n", word, count);
+
+  return TRUE;
+}
+
+static gchar *
+dump_index (GbpWordIndex *index)
+{
+  GString *str = g_string_new (NULL);
+
+  gbp_word_index_foreach_prefix (index, "", append_word, str);
+
+  return g_string_free (str, FALSE);
+}
+
+/* The incremental index must match one built from scratch */
+static void
+assert_index (GtkTextBuffer *buffer,
+              GbpWordIndex  *index)
+{
+  g_autoptr(GbpWordIndex) fresh = gbp_word_index_new (buffer);
+  g_autofree gchar *expected = NULL;
+  g_autofree gchar *actual = NULL;
+
+  gbp_word_index_ensure (fresh);
+
+  expected = dump_index (fresh);
+  actual = dump_index (index);
+
+  g_assert_cmpstr (actual, ==, expected);
+  g_assert_cmpint (gbp_word_index_get_n_words (index), ==, gbp_word_index_get_n_words (fresh));
+}
+
+static void
+insert_random (GtkTextBuffer *buffer)
+{
+  g_autoptr(GString) str = g_string_new (NULL);
+  guint n_fragments = g_test_rand_int_range (1, 8);
+  GtkTextIter iter;
+
+  for (guint i = 0; i < n_fragments; i++)
+    g_string_append (str, fragments[g_test_rand_int_range (0, G_N_ELEMENTS (fragments))]);
+
+  gtk_text_buffer_get_iter_at_offset (buffer,
+                                      &iter,
+                                      g_test_rand_int_range (0, gtk_text_buffer_get_char_count (buffer) + 1));
+  gtk_text_buffer_insert (buffer, &iter, str->str, str->len);
+}
+
+static void
+delete_random (GtkTextBuffer *buffer)
+{
+  guint n_chars = gtk_text_buffer_get_char_count (buffer);
+  guint begin_offset = g_test_rand_int_range (0, n_chars);
+  guint end_offset = MIN (n_chars, begin_offset + g_test_rand_int_range (1, 30));
+  GtkTextIter begin, end;
+
+  gtk_text_buffer_get_iter_at_offset (buffer, &begin, begin_offset);
+  gtk_text_buffer_get_iter_at_offset (buffer, &end, end_offset);
+  gtk_text_buffer_delete (buffer, &begin, &end);
+}
+
+/* Deletes from within one line to within another, joining the two */
+static void
+delete_lines_random (GtkTextBuffer *buffer)
+{
+  guint n_lines = gtk_text_buffer_get_line_count (buffer);
+  guint begin_line = g_test_rand_int_range (0, n_lines);
+  guint end_line = MIN (n_lines - 1, begin_line + g_test_rand_int_range (1, 5));
+  GtkTextIter begin, end;
+
+  gtk_text_buffer_get_iter_at_line (buffer, &begin, begin_line);
+  gtk_text_buffer_get_iter_at_line (buffer, &end, end_line);
+
+  gtk_text_iter_forward_chars (&begin, g_test_rand_int_range (0, gtk_text_iter_get_chars_in_line (&begin) + 1));
+  gtk_text_iter_forward_chars (&end, g_test_rand_int_range (0, gtk_text_iter_get_chars_in_line (&end) + 1));
+
+  gtk_text_buffer_delete (buffer, &begin, &end);
+}
+
+static void
+test_word_index_words (void)
+{
+  g_autoptr(GtkTextBuffer) buffer = gtk_text_buffer_new (NULL);
+  g_autoptr(GbpWordIndex) index = gbp_word_index_new (buffer);
+  GtkTextIter begin, end;
+
+  gtk_text_buffer_set_text (buffer, "foo bar_1 foo\nx Foo ñandú\n", -1);
+  gbp_word_index_ensure (index);
+
+  g_assert_cmpint (gbp_word_index_get_count (index, "foo"), ==, 2);
+  g_assert_cmpint (gbp_word_index_get_count (index, "Foo"), ==, 1);
+  g_assert_cmpint (gbp_word_index_get_count (index, "bar_1"), ==, 1);
+  g_assert_cmpint (gbp_word_index_get_count (index, "ñandú"), ==, 1);
+  /* Too short to be worth completing */
+  g_assert_cmpint (gbp_word_index_get_count (index, "x"), ==, 0);
+
+  /* Joining two lines joins the words at either end */
+  gtk_text_buffer_get_iter_at_line_offset (buffer, &begin, 0, 13);
+  gtk_text_buffer_get_iter_at_line_offset (buffer, &end, 1, 2);
+  gtk_text_buffer_delete (buffer, &begin, &end);
+
+  g_assert_cmpint (gbp_word_index_get_count (index, "foo"), ==, 1);
+  g_assert_cmpint (gbp_word_index_get_count (index, "Foo"), ==, 0);
+  g_assert_cmpint (gbp_word_index_get_count (index, "fooFoo"), ==, 1);
+  assert_index (buffer, index);
+}
+
+static void
+test_word_index_random (void)
+{
+  g_autoptr(GtkTextBuffer) buffer = gtk_text_buffer_new (NULL);
+  g_autoptr(GbpWordIndex) index = gbp_word_index_new (buffer);
+
+  gbp_word_index_ensure (index);
+
+  for (guint i = 0; i < 2000; i++)
+    {
+      guint n_chars = gtk_text_buffer_get_char_count (buffer);
+      guint op = g_test_rand_int_range (0, 10);
+
+      if (n_chars == 0 || op < 5)
+        insert_random (buffer);
+      else if (op < 8)
+        delete_random (buffer);
+      else
+        delete_lines_random (buffer);
+
+      assert_index (buffer, index);
+    }
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/WordIndex/words", test_word_index_words);
+  g_test_add_func ("/Ide/WordIndex/random", test_word_index_random);
+  return g_test_run ();
+}
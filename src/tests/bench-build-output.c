@@ -0,0 +1,660 @@
+/* bench-build-output.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <json-glib/json-glib.h>
+#include <libide-foundry.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ide-build-private.h"
+#include "ide-config-private.h"
+
+/*
+ * Replays recorded build transcripts through a real IdePipeline. A
+ * launcher stage re-executes this program with --replay, which writes
+ * the transcript at --rate bytes per second. The transcripts are only a
+ * few dozen lines, so they are looped to --size bytes (8MiB by default)
+ * and the JSON reports how many copies that took.
+ *
+ * That output takes the same path as a real build's: through IdeBuildLog
+ * observers when the stage does not use a PTY, or through the PTY
+ * intercept (on or off the main thread) when it does. The terminal side
+ * of the PTY is drained from the main loop like a VteTerminal would.
+ *
+ * While the build runs, a timeout samples how late the main loop is
+ * to dispatch it, along with how many worker lines the IdeBuildLog is
+ * still holding. One JSON object is printed per transcript and mode.
+ */
+
+#define DEFAULT_SIZE (8 * 1024 * 1024)
+#define WRITE_SIZE   4096
+#define SAMPLE_MSEC  1
+#define QUIET_MSEC   250
+
+#define BENCH_TYPE_CONFIG       (bench_config_get_type())
+#define BENCH_TYPE_BUILD_SYSTEM (bench_build_system_get_type())
+
+G_DECLARE_FINAL_TYPE (BenchConfig, bench_config, BENCH, CONFIG, IdeConfig)
+G_DECLARE_FINAL_TYPE (BenchBuildSystem, bench_build_system, BENCH, BUILD_SYSTEM, IdeObject)
+
+struct _BenchConfig
+{
+  IdeConfig parent_instance;
+};
+
+struct _BenchBuildSystem
+{
+  IdeObject parent_instance;
+};
+
+typedef struct
+{
+  GMainLoop   *main_loop;
+  GArray      *stalls;
+  GError      *error;
+  IdeBuildLog *log;
+  gint64       last_sample;
+  gint64       last_diagnostic;
+  gsize        terminal_bytes;
+  gsize        max_backlog;
+  guint        n_diagnostics;
+} Run;
+
+static const gchar *transcripts[] = {
+  "gcc.txt",
+  "clang.txt",
+  "meson.txt",
+  "cargo.txt",
+  "valac.txt",
+};
+
+static const struct {
+  const gchar *name;
+  gboolean     use_pty;
+  gboolean     in_thread;
+} modes[] = {
+  { "log",        FALSE, FALSE },
+  { "pty",        TRUE,  FALSE },
+  { "pty-thread", TRUE,  TRUE },
+};
+
+/* As registered by the gcc and vala plugins */
+static const struct {
+  const gchar        *regex;
+  GRegexCompileFlags  flags;
+} formats[] = {
+  { "(?<filename>[a-zA-Z0-9\\+\\-\\.\\/_]+):"
+    "(?<line>\\d+):"
+    "(?<column>\\d+): "
+    "(?<level>[\\w\\s]+): "
+    "(?<message>.*)",
+    G_REGEX_CASELESS },
+  { "(?<filename>[a-zA-Z0-9\\-\\.\\/_]+.vala):"
+    "(?<line>\\d+).(?<column>\\d+)-(?<line2>\\d+).(?<column2>\\d+): "
+    "(?<level>[\\w\\s]+): "
+    "(?<message>.*)",
+    0 },
+};
+
+static gint64 rate;
+static gint64 size = DEFAULT_SIZE;
+static gchar *replay;
+static gchar *workdir;
+
+static const GOptionEntry entries[] = {
+  { "rate", 'r', 0, G_OPTION_ARG_INT64, &rate, "Bytes per second to write, or 0 for no limit", "BYTES" },
+  { "size", 's', 0, G_OPTION_ARG_INT64, &size, "Bytes of output per run, looping the transcript to reach it", "BYTES" },
+  { "replay", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &replay, NULL, NULL },
+  { NULL }
+};
+
+G_DEFINE_TYPE (BenchConfig, bench_config, IDE_TYPE_CONFIG)
+
+static void
+bench_config_class_init (BenchConfigClass *klass)
+{
+}
+
+static void
+bench_config_init (BenchConfig *self)
+{
+}
+
+static gchar *
+bench_build_system_get_builddir (IdeBuildSystem *build_system,
+                                 IdePipeline    *pipeline)
+{
+  return g_build_filename (workdir, "_build", NULL);
+}
+
+static void
+build_system_iface_init (IdeBuildSystemInterface *iface)
+{
+  iface->get_builddir = bench_build_system_get_builddir;
+}
+
+G_DEFINE_TYPE_WITH_CODE (BenchBuildSystem, bench_build_system, IDE_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (IDE_TYPE_BUILD_SYSTEM, build_system_iface_init))
+
+static void
+bench_build_system_class_init (BenchBuildSystemClass *klass)
+{
+}
+
+static void
+bench_build_system_init (BenchBuildSystem *self)
+{
+}
+
+/*
+ * The transcripts are short recordings, so they are repeated back to back
+ * until there are at least @max_size bytes, enough for the throughput and
+ * stalls to be measured over a sustained build. Each copy ends with a
+ * newline so that lines are never joined across copies.
+ */
+static GBytes *
+create_output (const gchar  *path,
+               gsize         max_size,
+               guint        *n_lines,
+               guint        *n_copies,
+               GError      **error)
+{
+  g_autofree gchar *contents = NULL;
+  GString *str;
+  guint lines_per_copy = 0;
+  gsize len;
+
+  if (!g_file_get_contents (path, &contents, &len, error))
+    return NULL;
+
+  if (len == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s is empty", path);
+      return NULL;
+    }
+
+  if (contents[len - 1] != '\n')
+    {
+      gchar *with_newline = g_strconcat (contents, "\n", NULL);
+
+      g_free (contents);
+      contents = with_newline;
+      len++;
+    }
+
+  for (const gchar *iter = contents; (iter = memchr (iter, '\n', contents + len - iter)); iter++)
+    lines_per_copy++;
+
+  str = g_string_sized_new (max_size + len);
+
+  if (n_lines != NULL)
+    *n_lines = 0;
+
+  if (n_copies != NULL)
+    *n_copies = 0;
+
+  while (str->len < max_size)
+    {
+      g_string_append_len (str, contents, len);
+
+      if (n_lines != NULL)
+        *n_lines += lines_per_copy;
+
+      if (n_copies != NULL)
+        (*n_copies)++;
+    }
+
+  return g_string_free_to_bytes (str);
+}
+
+static gint
+replay_output (void)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) error = NULL;
+  const guint8 *data;
+  gint64 begin;
+  gsize pos = 0;
+  gsize len;
+
+  if (!(bytes = create_output (replay, size, NULL, NULL, &error)))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  data = g_bytes_get_data (bytes, &len);
+  begin = g_get_monotonic_time ();
+
+  while (pos < len)
+    {
+      gssize n_written = write (STDOUT_FILENO, data + pos, MIN (WRITE_SIZE, len - pos));
+
+      if (n_written < 0)
+        {
+          if (errno == EINTR || errno == EAGAIN)
+            continue;
+          return EXIT_FAILURE;
+        }
+
+      pos += n_written;
+
+      if (rate > 0)
+        {
+          gint64 due = begin + (gint64)pos * G_USEC_PER_SEC / rate;
+          gint64 now = g_get_monotonic_time ();
+
+          if (due > now)
+            g_usleep (due - now);
+        }
+    }
+
+  return EXIT_SUCCESS;
+}
+
+static gboolean
+sample_cb (gpointer user_data)
+{
+  Run *run = user_data;
+  gint64 now = g_get_monotonic_time ();
+  gint64 stall = MAX (0, now - run->last_sample - SAMPLE_MSEC * 1000);
+
+  g_array_append_val (run->stalls, stall);
+  run->last_sample = now;
+
+  run->max_backlog = MAX (run->max_backlog, ide_build_log_get_backlog (run->log));
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+quiet_cb (gpointer user_data)
+{
+  Run *run = user_data;
+
+  /* Diagnostics are delivered from an idle after extraction finishes */
+  if (g_get_monotonic_time () - run->last_diagnostic >= QUIET_MSEC * 1000)
+    {
+      g_main_loop_quit (run->main_loop);
+      return G_SOURCE_REMOVE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+drain_cb (gint         fd,
+          GIOCondition condition,
+          gpointer     user_data)
+{
+  Run *run = user_data;
+  gchar buf[8192];
+  gssize n_read;
+
+  while ((n_read = read (fd, buf, sizeof buf)) > 0 || (n_read < 0 && errno == EINTR))
+    {
+      if (n_read > 0)
+        run->terminal_bytes += n_read;
+    }
+
+  if (n_read == 0 || errno != EAGAIN)
+    return G_SOURCE_REMOVE;
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+diagnostic_cb (IdePipeline   *pipeline,
+               IdeDiagnostic *diagnostic,
+               Run           *run)
+{
+  run->n_diagnostics++;
+  run->last_diagnostic = g_get_monotonic_time ();
+}
+
+static void
+build_cb (GObject      *object,
+          GAsyncResult *result,
+          gpointer      user_data)
+{
+  Run *run = user_data;
+
+  ide_pipeline_build_finish (IDE_PIPELINE (object), result, &run->error);
+  g_main_loop_quit (run->main_loop);
+}
+
+/*
+ * getrusage() only reports the high-water mark of the whole process, which
+ * would include the runs before this one. Writing 5 to clear_refs resets
+ * VmHWM to the current RSS, so that each run can report its own peak.
+ */
+static gboolean
+reset_peak_rss (void)
+{
+  gboolean ret;
+  gint fd;
+
+  if (-1 == (fd = open ("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC)))
+    return FALSE;
+
+  ret = write (fd, "5", 1) == 1;
+  close (fd);
+
+  return ret;
+}
+
+static gint64
+get_peak_rss_kb (void)
+{
+  g_autofree gchar *contents = NULL;
+  const gchar *line;
+
+  if (!g_file_get_contents ("/proc/self/status", &contents, NULL, NULL) ||
+      !(line = strstr (contents, "\nVmHWM:")))
+    return -1;
+
+  return g_ascii_strtoll (line + strlen ("\nVmHWM:"), NULL, 10);
+}
+
+static void
+add_int_member (JsonBuilder *builder,
+                const gchar *name,
+                gint64       value)
+{
+  json_builder_set_member_name (builder, name);
+  json_builder_add_int_value (builder, value);
+}
+
+static void
+add_double_member (JsonBuilder *builder,
+                   const gchar *name,
+                   gdouble      value)
+{
+  json_builder_set_member_name (builder, name);
+  json_builder_add_double_value (builder, value);
+}
+
+static gint
+compare_stall (gconstpointer a,
+               gconstpointer b)
+{
+  const gint64 *astall = a;
+  const gint64 *bstall = b;
+
+  return (*astall > *bstall) - (*astall < *bstall);
+}
+
+static gdouble
+percentile_msec (GArray *stalls,
+                 guint   percent)
+{
+  if (stalls->len == 0)
+    return 0.0;
+
+  return g_array_index (stalls, gint64, MIN (stalls->len - 1, stalls->len * percent / 100)) / 1000.0;
+}
+
+static void
+run_one (IdeContext  *context,
+         IdeConfig   *config,
+         IdeDevice   *device,
+         IdeRuntime  *runtime,
+         const gchar *exe,
+         const gchar *path,
+         guint        mode)
+{
+  g_autoptr(IdeSubprocessLauncher) launcher = NULL;
+  g_autoptr(IdePipelineStage) stage = NULL;
+  g_autoptr(IdePipeline) pipeline = NULL;
+  g_autoptr(GSettings) settings = NULL;
+  g_autoptr(JsonBuilder) builder = NULL;
+  g_autoptr(JsonGenerator) generator = NULL;
+  g_autoptr(JsonNode) root = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *name = NULL;
+  g_autofree gchar *size_str = NULL;
+  g_autofree gchar *rate_str = NULL;
+  g_autofree gchar *json = NULL;
+  gboolean rss_reset;
+  gint64 rss_begin;
+  gint64 rss_peak;
+  Run run = {0};
+  guint n_lines = 0;
+  guint n_copies = 0;
+  gsize n_dropped;
+  guint drain_source;
+  guint sample_source;
+  gint64 begin;
+  gdouble msec;
+
+  /* Only used to count lines, the replay process creates its own */
+  if (!(bytes = create_output (path, size, &n_lines, &n_copies, &error)))
+    g_error ("%s", error->message);
+
+  rss_reset = reset_peak_rss ();
+  rss_begin = get_peak_rss_kb ();
+
+  settings = g_settings_new ("org.gnome.builder.build");
+  g_settings_set_boolean (settings, "intercept-pty-in-thread", modes[mode].in_thread);
+
+  pipeline = g_object_new (IDE_TYPE_PIPELINE,
+                           "config", config,
+                           "device", device,
+                           NULL);
+  ide_object_append (IDE_OBJECT (context), IDE_OBJECT (pipeline));
+  _ide_pipeline_set_runtime (pipeline, runtime);
+
+  if (!g_initable_init (G_INITABLE (pipeline), NULL, &error))
+    g_error ("%s", error->message);
+
+  while (!ide_pipeline_is_ready (pipeline))
+    g_main_context_iteration (NULL, TRUE);
+
+  for (guint i = 0; i < G_N_ELEMENTS (formats); i++)
+    ide_pipeline_add_error_format (pipeline, formats[i].regex, formats[i].flags);
+
+  size_str = g_strdup_printf ("%"G_GINT64_FORMAT, size);
+  rate_str = g_strdup_printf ("%"G_GINT64_FORMAT, rate);
+
+  launcher = ide_subprocess_launcher_new (0);
+  ide_subprocess_launcher_push_argv (launcher, exe);
+  ide_subprocess_launcher_push_argv (launcher, "--replay");
+  ide_subprocess_launcher_push_argv (launcher, path);
+  ide_subprocess_launcher_push_argv (launcher, "--size");
+  ide_subprocess_launcher_push_argv (launcher, size_str);
+  ide_subprocess_launcher_push_argv (launcher, "--rate");
+  ide_subprocess_launcher_push_argv (launcher, rate_str);
+
+  stage = ide_pipeline_stage_launcher_new (context, launcher);
+  ide_pipeline_stage_launcher_set_use_pty (IDE_PIPELINE_STAGE_LAUNCHER (stage), modes[mode].use_pty);
+  ide_pipeline_attach (pipeline, IDE_PIPELINE_PHASE_BUILD, 0, stage);
+
+  run.main_loop = g_main_loop_new (NULL, FALSE);
+  run.stalls = g_array_new (FALSE, FALSE, sizeof (gint64));
+  run.log = _ide_pipeline_get_build_log (pipeline);
+
+  g_signal_connect (pipeline, "diagnostic", G_CALLBACK (diagnostic_cb), &run);
+
+  g_unix_set_fd_nonblocking (vte_pty_get_fd (ide_pipeline_get_pty (pipeline)), TRUE, NULL);
+  drain_source = g_unix_fd_add (vte_pty_get_fd (ide_pipeline_get_pty (pipeline)),
+                                G_IO_IN,
+                                drain_cb,
+                                &run);
+
+  begin = run.last_sample = g_get_monotonic_time ();
+  sample_source = g_timeout_add (SAMPLE_MSEC, sample_cb, &run);
+
+  ide_pipeline_build_async (pipeline, IDE_PIPELINE_PHASE_BUILD, NULL, build_cb, &run);
+  g_main_loop_run (run.main_loop);
+
+  msec = (g_get_monotonic_time () - begin) / 1000.0;
+  g_source_remove (sample_source);
+
+  if (run.error != NULL)
+    g_error ("%s", run.error->message);
+
+  /* Wait for the last of the diagnostics to be extracted */
+  run.last_diagnostic = g_get_monotonic_time ();
+  g_timeout_add (QUIET_MSEC / 5, quiet_cb, &run);
+  g_main_loop_run (run.main_loop);
+
+  g_source_remove (drain_source);
+
+  /* The pipeline drops its log when destroyed */
+  n_dropped = ide_build_log_get_n_dropped (run.log);
+  run.log = NULL;
+
+  ide_object_destroy (IDE_OBJECT (pipeline));
+
+  rss_peak = get_peak_rss_kb ();
+
+  g_array_sort (run.stalls, compare_stall);
+
+  name = g_path_get_basename (path);
+  if (g_str_has_suffix (name, ".txt"))
+    name[strlen (name) - 4] = 0;
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "transcript");
+  json_builder_add_string_value (builder, name);
+  json_builder_set_member_name (builder, "mode");
+  json_builder_add_string_value (builder, modes[mode].name);
+  add_int_member (builder, "bytes", g_bytes_get_size (bytes));
+  add_int_member (builder, "copies", n_copies);
+  add_int_member (builder, "lines", n_lines);
+  add_int_member (builder, "rate", rate);
+  add_double_member (builder, "msec", msec);
+  add_double_member (builder, "lines_per_sec", n_lines / (msec / 1000.0));
+  add_double_member (builder, "stall_p50_msec", percentile_msec (run.stalls, 50));
+  add_double_member (builder, "stall_p99_msec", percentile_msec (run.stalls, 99));
+  add_double_member (builder, "stall_max_msec", percentile_msec (run.stalls, 100));
+  add_int_member (builder, "diagnostics", run.n_diagnostics);
+  add_int_member (builder, "terminal_bytes", run.terminal_bytes);
+  add_int_member (builder, "log_backlog_max", run.max_backlog);
+  add_int_member (builder, "log_dropped", n_dropped);
+  add_int_member (builder, "peak_rss_kb", rss_peak);
+
+  /* Without a reset, the peak may come from an earlier run */
+  json_builder_set_member_name (builder, "peak_rss_increase_kb");
+  if (rss_reset && rss_begin >= 0 && rss_peak >= 0)
+    json_builder_add_int_value (builder, rss_peak - rss_begin);
+  else
+    json_builder_add_null_value (builder);
+
+  json_builder_end_object (builder);
+
+  root = json_builder_get_root (builder);
+  generator = json_generator_new ();
+  json_generator_set_root (generator, root);
+  json = json_generator_to_data (generator, NULL);
+
+  g_print ("%s\n", json);
+
+  g_array_unref (run.stalls);
+  g_main_loop_unref (run.main_loop);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GOptionContext) option_context = NULL;
+  g_autoptr(IdeContext) context = NULL;
+  g_autoptr(IdeConfig) config = NULL;
+  g_autoptr(IdeDevice) device = NULL;
+  g_autoptr(IdeRuntime) runtime = NULL;
+  g_autoptr(IdeObject) build_system = NULL;
+  g_autoptr(IdeTriplet) triplet = NULL;
+  g_autoptr(GFile) file = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *exe = NULL;
+  g_autofree gchar *builddir = NULL;
+  g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func (g_free);
+
+  /* Each run changes intercept-pty-in-thread, which must not persist */
+  g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+  option_context = g_option_context_new ("[TRANSCRIPT…] - replay build output through IdePipeline");
+  g_option_context_add_main_entries (option_context, entries, NULL);
+
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    g_error ("%s", error->message);
+
+  if (replay != NULL)
+    return replay_output ();
+
+  if (!(exe = g_file_read_link ("/proc/self/exe", NULL)))
+    exe = g_canonicalize_filename (argv[0], NULL);
+
+  for (gint i = 1; i < argc; i++)
+    g_ptr_array_add (paths, g_canonicalize_filename (argv[i], NULL));
+
+  if (paths->len == 0)
+    {
+      for (guint i = 0; i < G_N_ELEMENTS (transcripts); i++)
+        g_ptr_array_add (paths, g_build_filename (TEST_DATA_DIR, "build-output", transcripts[i], NULL));
+    }
+
+  if (!(workdir = g_dir_make_tmp ("bench-build-output-XXXXXX", &error)))
+    g_error ("%s", error->message);
+
+  context = ide_context_new ();
+  file = g_file_new_for_path (workdir);
+  ide_context_set_workdir (context, file);
+
+  build_system = g_object_new (BENCH_TYPE_BUILD_SYSTEM, NULL);
+  ide_object_append (IDE_OBJECT (context), build_system);
+
+  runtime = ide_runtime_new ("host", "Host");
+  ide_runtime_manager_add (ide_runtime_manager_from_context (context), runtime);
+
+  config = g_object_new (BENCH_TYPE_CONFIG,
+                         "id", "bench",
+                         "runtime-id", "host",
+                         NULL);
+  ide_object_append (IDE_OBJECT (context), IDE_OBJECT (config));
+  _ide_config_attach (config);
+
+  triplet = ide_triplet_new_from_system ();
+  device = g_object_new (IDE_TYPE_LOCAL_DEVICE,
+                         "triplet", triplet,
+                         NULL);
+  ide_object_append (IDE_OBJECT (context), IDE_OBJECT (device));
+
+  for (guint i = 0; i < paths->len; i++)
+    {
+      for (guint mode = 0; mode < G_N_ELEMENTS (modes); mode++)
+        run_one (context, config, device, runtime, exe, g_ptr_array_index (paths, i), mode);
+    }
+
+  ide_object_destroy (IDE_OBJECT (context));
+
+  builddir = g_build_filename (workdir, "_build", NULL);
+  g_rmdir (builddir);
+  g_rmdir (workdir);
+  g_clear_pointer (&workdir, g_free);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/* bench-completion-fuzzy.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libide-sourceview.h>
+#include <stdlib.h>
+
+/*
+ * Filters a set of labels shaped like those from clang and language
+ * servers, first one ide_completion_fuzzy_match() call at a time as the
+ * completion providers used to, then with ide_completion_fuzzy_match_batch()
+ * both unbounded and limited to what a completion window can show.
+ */
+
+#define DEFAULT_N_LABELS 100000
+#define N_ROUNDS         10
+#define TOP_K            100
+
+static const gchar *needles[] = { "g", "gtkw", "get_prop", "sigcon", "xyzzy" };
+
+static GPtrArray *
+create_labels (guint n_labels)
+{
+  static const gchar *prefixes[] = {
+    "gtk_widget_", "GtkWidget", "g_signal_", "GTK_IS_", "std::vector<", "_gtk_",
+    "pango_layout_", "G_OBJECT_CLASS", "ide_buffer_", "clang_getCursor",
+  };
+  static const gchar *suffixes[] = {
+    "get_property", "set_property", "new", "connect_object", "> &",
+    "Kind", "show_all", "(GObject *object)", "_unlocked", "queue_draw",
+  };
+  GPtrArray *labels = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = 0; i < n_labels; i++)
+    g_ptr_array_add (labels,
+                     g_strdup_printf ("%s%x%s",
+                                      prefixes[i % G_N_ELEMENTS (prefixes)],
+                                      (i * 2654435761u) >> 20,
+                                      suffixes[(i / G_N_ELEMENTS (prefixes)) % G_N_ELEMENTS (suffixes)]));
+
+  return labels;
+}
+
+static gint
+compare_matches (gconstpointer a,
+                 gconstpointer b)
+{
+  const IdeCompletionFuzzyMatch *ma = a;
+  const IdeCompletionFuzzyMatch *mb = b;
+
+  return (gint)ma->priority - (gint)mb->priority;
+}
+
+static gdouble
+run_single (GPtrArray   *labels,
+            const gchar *needle,
+            guint       *n_matches)
+{
+  gint64 begin = g_get_monotonic_time ();
+
+  for (guint round = 0; round < N_ROUNDS; round++)
+    {
+      g_autoptr(GArray) matches = g_array_new (FALSE, FALSE, sizeof (IdeCompletionFuzzyMatch));
+
+      for (guint i = 0; i < labels->len; i++)
+        {
+          IdeCompletionFuzzyMatch match = { i, 0 };
+
+          if (ide_completion_fuzzy_match (g_ptr_array_index (labels, i), needle, &match.priority))
+            g_array_append_val (matches, match);
+        }
+
+      g_array_sort (matches, compare_matches);
+      *n_matches = matches->len;
+    }
+
+  return (g_get_monotonic_time () - begin) / 1000.0 / N_ROUNDS;
+}
+
+static gdouble
+run_batch (GPtrArray   *labels,
+           const gchar *needle,
+           guint        max_results,
+           guint       *n_matches)
+{
+  gint64 begin = g_get_monotonic_time ();
+
+  for (guint round = 0; round < N_ROUNDS; round++)
+    {
+      g_autoptr(GArray) matches = NULL;
+
+      matches = ide_completion_fuzzy_match_batch ((const gchar * const *)labels->pdata,
+                                                  labels->len,
+                                                  needle,
+                                                  max_results);
+      *n_matches = matches->len;
+    }
+
+  return (g_get_monotonic_time () - begin) / 1000.0 / N_ROUNDS;
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GPtrArray) labels = NULL;
+  guint n_labels = DEFAULT_N_LABELS;
+
+  if (argc > 1)
+    n_labels = MAX (1, g_ascii_strtoull (argv[1], NULL, 10));
+
+  labels = create_labels (n_labels);
+
+  for (guint i = 0; i < G_N_ELEMENTS (needles); i++)
+    {
+      const gchar *needle = needles[i];
+      guint n_single;
+      guint n_batch;
+      guint n_top;
+      gdouble msec;
+
+      msec = run_single (labels, needle, &n_single);
+      g_print ("{\"mode\": \"single\", \"labels\": %u, \"needle\": \"%s\", \"matches\": %u, \"msec\": %.3lf}\n",
+               n_labels, needle, n_single, msec);
+
+      msec = run_batch (labels, needle, 0, &n_batch);
+      g_assert_cmpint (n_batch, ==, n_single);
+      g_print ("{\"mode\": \"batch\", \"labels\": %u, \"needle\": \"%s\", \"matches\": %u, \"msec\": %.3lf}\n",
+               n_labels, needle, n_batch, msec);
+
+      msec = run_batch (labels, needle, TOP_K, &n_top);
+      g_assert_cmpint (n_top, ==, MIN (TOP_K, n_single));
+      g_print ("{\"mode\": \"batch-top-%u\", \"labels\": %u, \"needle\": \"%s\", \"matches\": %u, \"msec\": %.3lf}\n",
+               TOP_K, n_labels, needle, n_top, msec);
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+/* bench-content-search.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libide-io.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Searches a synthetic tree of source-like files with IdeContentSearch,
+ * and with grep -r for comparison when it is available. Every
+ * NEEDLE_INTERVAL'th file contains a single matching line.
+ */
+
+#define DEFAULT_N_FILES  100000
+#define FILES_PER_DIR    100
+#define LINES_PER_FILE   60
+#define NEEDLE_INTERVAL  10
+#define N_ROUNDS         3
+#define QUERY            "needle_[0-9]+\\("
+
+typedef struct
+{
+  GMainLoop *main_loop;
+  gint64     begin;
+  gint64     first_match;
+} Run;
+
+static gchar *
+create_tree (guint n_files)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GString) str = g_string_new (NULL);
+  gchar *root;
+
+  if (!(root = g_dir_make_tmp ("bench-content-search-XXXXXX", &error)))
+    g_error ("%s", error->message);
+
+  for (guint i = 0; i < n_files; i++)
+    {
+      g_autofree gchar *dir = g_strdup_printf ("%s/dir%u", root, i / FILES_PER_DIR);
+      g_autofree gchar *path = g_strdup_printf ("%s/file%u.c", dir, i);
+
+      if (i % FILES_PER_DIR == 0)
+        g_mkdir_with_parents (dir, 0750);
+
+      g_string_truncate (str, 0);
+
+      for (guint j = 0; j < LINES_PER_FILE; j++)
+        {
+          if (i % NEEDLE_INTERVAL == 0 && j == LINES_PER_FILE / 2)
+            g_string_append_printf (str, "  result = needle_%u (self, %u);\n", i, j);
+          else
+            g_string_append_printf (str, "  result = haystack_%u_%u (self, result, %u);\n", i, j, j * 7);
+        }
+
+      if (!g_file_set_contents (path, str->str, str->len, &error))
+        g_error ("%s", error->message);
+    }
+
+  return root;
+}
+
+static void
+remove_tree (const gchar *root,
+             guint        n_files)
+{
+  for (guint i = 0; i < n_files; i++)
+    {
+      g_autofree gchar *dir = g_strdup_printf ("%s/dir%u", root, i / FILES_PER_DIR);
+      g_autofree gchar *path = g_strdup_printf ("%s/file%u.c", dir, i);
+
+      g_unlink (path);
+
+      if ((i + 1) % FILES_PER_DIR == 0 || i + 1 == n_files)
+        g_rmdir (dir);
+    }
+
+  g_rmdir (root);
+}
+
+static void
+matches_added_cb (IdeContentSearch *search,
+                  guint             position,
+                  guint             n_added,
+                  Run              *run)
+{
+  if (run->first_match == 0)
+    run->first_match = g_get_monotonic_time ();
+}
+
+static void
+run_cb (GObject      *object,
+        GAsyncResult *result,
+        gpointer      user_data)
+{
+  Run *run = user_data;
+  g_autoptr(GError) error = NULL;
+
+  if (!ide_content_search_run_finish (IDE_CONTENT_SEARCH (object), result, &error))
+    g_error ("%s", error->message);
+
+  g_main_loop_quit (run->main_loop);
+}
+
+static gdouble
+run_search (const gchar *root,
+            guint       *n_matches,
+            gdouble     *first_match_msec)
+{
+  g_autoptr(IdeContentSearch) search = NULL;
+  g_autoptr(GFile) directory = g_file_new_for_path (root);
+  Run run = {0};
+
+  run.main_loop = g_main_loop_new (NULL, FALSE);
+  run.begin = g_get_monotonic_time ();
+
+  search = ide_content_search_new (directory);
+  ide_content_search_set_query (search, QUERY);
+  ide_content_search_set_use_regex (search, TRUE);
+  ide_content_search_set_case_sensitive (search, TRUE);
+  g_signal_connect (search, "matches-added", G_CALLBACK (matches_added_cb), &run);
+  ide_content_search_run_async (search, NULL, run_cb, &run);
+
+  g_main_loop_run (run.main_loop);
+  g_main_loop_unref (run.main_loop);
+
+  *n_matches = ide_content_search_get_n_matches (search);
+  *first_match_msec = (run.first_match - run.begin) / 1000.0;
+
+  return (g_get_monotonic_time () - run.begin) / 1000.0;
+}
+
+static gdouble
+run_grep (const gchar *root,
+          guint       *n_matches)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *stdout_buf = NULL;
+  const gchar *argv[] = { "grep", "-r", "-I", "-H", "-n", "-E", "-e", QUERY, ".", NULL };
+  gint64 begin = g_get_monotonic_time ();
+  gint64 end;
+
+  if (!g_spawn_sync (root, (gchar **)argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL,
+                     &stdout_buf, NULL, NULL, &error))
+    g_error ("%s", error->message);
+
+  end = g_get_monotonic_time ();
+
+  *n_matches = 0;
+  for (const gchar *iter = stdout_buf; (iter = strchr (iter, '\n')); iter++)
+    (*n_matches)++;
+
+  return (end - begin) / 1000.0;
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autofree gchar *root = NULL;
+  g_autofree gchar *grep = g_find_program_in_path ("grep");
+  guint n_files = DEFAULT_N_FILES;
+  guint expected;
+
+  if (argc > 1)
+    n_files = MAX (1, g_ascii_strtoull (argv[1], NULL, 10));
+
+  expected = (n_files + NEEDLE_INTERVAL - 1) / NEEDLE_INTERVAL;
+  root = create_tree (n_files);
+
+  for (guint round = 0; round < N_ROUNDS; round++)
+    {
+      gdouble first_match_msec;
+      gdouble msec;
+      guint n_matches;
+
+      msec = run_search (root, &n_matches, &first_match_msec);
+      g_assert_cmpint (n_matches, ==, expected);
+
+      g_print ("{\"engine\": \"content-search\", \"files\": %u, \"round\": %u, \"matches\": %u, "
+               "\"msec\": %.2lf, \"first_match_msec\": %.2lf, \"files_per_sec\": %.0lf}\n",
+               n_files, round, n_matches, msec, first_match_msec,
+               n_files / (msec / 1000.0));
+
+      if (grep != NULL)
+        {
+          msec = run_grep (root, &n_matches);
+          g_assert_cmpint (n_matches, ==, expected);
+
+          g_print ("{\"engine\": \"grep\", \"files\": %u, \"round\": %u, \"matches\": %u, "
+                   "\"msec\": %.2lf, \"files_per_sec\": %.0lf}\n",
+                   n_files, round, n_matches, msec, n_files / (msec / 1000.0));
+        }
+    }
+
+  remove_tree (root, n_files);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,202 @@
+/* bench-drafts-store.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libide-code.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ide-drafts-store-private.h"
+
+/*
+ * Saves a set of large modified buffers repeatedly, changing one line in
+ * each buffer between saves. Every round is saved both as one file per
+ * draft, as drafts used to be, and with the chunked drafts journal. The
+ * journal is then loaded back and compared with the last contents.
+ */
+
+#define DEFAULT_N_DRAFTS 40
+#define DRAFT_SIZE       (2 * 1024 * 1024)
+#define N_ROUNDS         10
+
+static GBytes *
+create_content (guint draft,
+                guint round)
+{
+  GString *str = g_string_new (NULL);
+  guint line = 0;
+
+  while (str->len < DRAFT_SIZE)
+    {
+      /* One line near the middle changes every round */
+      if (line == 20000)
+        g_string_append_printf (str, "  /* edited in round %u */\n", round);
+      else
+        g_string_append_printf (str, "  result = generated_%u_%u (self, result, %u);\n",
+                                draft, line, line * 7);
+      line++;
+    }
+
+  return g_string_free_to_bytes (str);
+}
+
+static gdouble
+save_files (const gchar *dir,
+            GPtrArray   *uris,
+            GPtrArray   *contents)
+{
+  g_autoptr(GString) manifest = g_string_new (NULL);
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *manifest_path = g_build_filename (dir, "manifest", NULL);
+  gint64 begin = g_get_monotonic_time ();
+
+  for (guint i = 0; i < uris->len; i++)
+    {
+      const gchar *uri = g_ptr_array_index (uris, i);
+      GBytes *bytes = g_ptr_array_index (contents, i);
+      g_autofree gchar *hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+      g_autofree gchar *path = g_build_filename (dir, hash, NULL);
+
+      g_string_append_printf (manifest, "%s\n", uri);
+
+      if (!g_file_set_contents (path,
+                                g_bytes_get_data (bytes, NULL),
+                                g_bytes_get_size (bytes),
+                                &error))
+        g_error ("%s", error->message);
+    }
+
+  if (!g_file_set_contents (manifest_path, manifest->str, manifest->len, &error))
+    g_error ("%s", error->message);
+
+  return (g_get_monotonic_time () - begin) / 1000.0;
+}
+
+static void
+remove_files (const gchar *dir,
+              GPtrArray   *uris)
+{
+  g_autofree gchar *manifest_path = g_build_filename (dir, "manifest", NULL);
+
+  for (guint i = 0; i < uris->len; i++)
+    {
+      g_autofree gchar *hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, g_ptr_array_index (uris, i), -1);
+      g_autofree gchar *path = g_build_filename (dir, hash, NULL);
+
+      g_unlink (path);
+    }
+
+  g_unlink (manifest_path);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(IdeDraftsStore) store = NULL;
+  g_autoptr(IdeDraftsStore) reader = NULL;
+  g_autoptr(GHashTable) loaded = NULL;
+  g_autoptr(GPtrArray) uris = NULL;
+  g_autoptr(GPtrArray) contents = NULL;
+  g_autoptr(GArray) drafts = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *files_dir = NULL;
+  g_autofree gchar *store_dir = NULL;
+  g_autofree gchar *journal_path = NULL;
+  guint n_drafts = DEFAULT_N_DRAFTS;
+  gint64 begin;
+
+  if (argc > 1)
+    n_drafts = MAX (1, g_ascii_strtoull (argv[1], NULL, 10));
+
+  if (!(files_dir = g_dir_make_tmp ("bench-drafts-files-XXXXXX", &error)) ||
+      !(store_dir = g_dir_make_tmp ("bench-drafts-store-XXXXXX", &error)))
+    g_error ("%s", error->message);
+
+  store = _ide_drafts_store_new (store_dir);
+  uris = g_ptr_array_new_with_free_func (g_free);
+  contents = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+  drafts = g_array_new (FALSE, FALSE, sizeof (IdeDraft));
+
+  for (guint i = 0; i < n_drafts; i++)
+    {
+      g_ptr_array_add (uris, g_strdup_printf ("file:///home/user/project/generated/file%u.c", i));
+      g_ptr_array_add (contents, NULL);
+    }
+
+  for (guint round = 0; round < N_ROUNDS; round++)
+    {
+      IdeDraftsStoreStats stats;
+      gdouble msec;
+
+      g_array_set_size (drafts, 0);
+
+      for (guint i = 0; i < n_drafts; i++)
+        {
+          IdeDraft draft;
+
+          g_clear_pointer (&g_ptr_array_index (contents, i), g_bytes_unref);
+          g_ptr_array_index (contents, i) = create_content (i, round);
+
+          draft.uri = g_ptr_array_index (uris, i);
+          draft.content = g_ptr_array_index (contents, i);
+          g_array_append_val (drafts, draft);
+        }
+
+      msec = save_files (files_dir, uris, contents);
+      g_print ("{\"format\": \"files\", \"drafts\": %u, \"round\": %u, "
+               "\"bytes_written\": %"G_GSIZE_FORMAT", \"msec\": %.2lf}\n",
+               n_drafts, round, (gsize)n_drafts * DRAFT_SIZE, msec);
+
+      begin = g_get_monotonic_time ();
+      if (!_ide_drafts_store_save (store, (const IdeDraft *)(gpointer)drafts->data, drafts->len, &stats, &error))
+        g_error ("%s", error->message);
+      msec = (g_get_monotonic_time () - begin) / 1000.0;
+
+      g_print ("{\"format\": \"journal\", \"drafts\": %u, \"round\": %u, \"drafts_written\": %u, "
+               "\"chunks_written\": %u, \"bytes_written\": %"G_GSIZE_FORMAT", \"msec\": %.2lf}\n",
+               n_drafts, round, stats.n_written, stats.n_chunks_written, stats.bytes_written, msec);
+    }
+
+  /* A new store reads the journal as it would when a project is opened */
+  begin = g_get_monotonic_time ();
+  reader = _ide_drafts_store_new (store_dir);
+  if (!(loaded = _ide_drafts_store_load (reader, &error)))
+    g_error ("%s", error->message);
+  g_print ("{\"format\": \"journal\", \"drafts\": %u, \"load_msec\": %.2lf}\n",
+           n_drafts, (g_get_monotonic_time () - begin) / 1000.0);
+
+  g_assert_cmpint (g_hash_table_size (loaded), ==, n_drafts);
+
+  for (guint i = 0; i < n_drafts; i++)
+    {
+      GBytes *bytes = g_hash_table_lookup (loaded, g_ptr_array_index (uris, i));
+
+      g_assert_nonnull (bytes);
+      g_assert_true (g_bytes_equal (bytes, g_ptr_array_index (contents, i)));
+    }
+
+  remove_files (files_dir, uris);
+  g_rmdir (files_dir);
+
+  journal_path = g_build_filename (store_dir, "journal", NULL);
+  g_unlink (journal_path);
+  g_rmdir (store_dir);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,220 @@
+/* bench-error-formats.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libide-foundry.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ide-error-matcher-private.h"
+
+/*
+ * Replays a build log through the error formats registered by the gcc,
+ * vala and mono plugins, with and without the literal prefilter. The
+ * log is read from the file given on the command line, or a synthetic
+ * GCC-style log of about 50 MB is generated.
+ *
+ * The log is fed to _ide_error_matcher_match() directly, in 64 KiB
+ * chunks. No pipeline, PTY or line reader is involved, so the numbers
+ * only cover matching and not how the output reaches the matcher.
+ */
+
+#define DEFAULT_LOG_SIZE (50 * 1024 * 1024)
+#define CHUNK_SIZE       (64 * 1024)
+#define WARNING_INTERVAL 200
+#define N_ROUNDS         3
+
+static const struct {
+  const gchar        *regex;
+  GRegexCompileFlags  flags;
+} formats[] = {
+  { "(?<filename>[a-zA-Z0-9\\+\\-\\.\\/_]+):"
+    "(?<line>\\d+):"
+    "(?<column>\\d+): "
+    "(?<level>[\\w\\s]+): "
+    "(?<message>.*)",
+    G_REGEX_CASELESS },
+  { "(?<filename>[a-zA-Z0-9\\-\\.\\/_]+.vala):"
+    "(?<line>\\d+).(?<column>\\d+)-(?<line2>\\d+).(?<column2>\\d+): "
+    "(?<level>[\\w\\s]+): "
+    "(?<message>.*)",
+    0 },
+  { "(?<filename>[a-zA-Z0-9\\-\\.\\/_]+.cs)"
+    "\\((?<line>\\d+),(?<column>\\d+)\\): "
+    "(?<level>[\\w\\s]+) "
+    "(?<code>CS[0-9]+): "
+    "(?<message>.*)",
+    0 },
+};
+
+typedef struct
+{
+  guint n_matches;
+  guint n_directories;
+} Counts;
+
+static GString *
+create_log (gsize size)
+{
+  GString *str = g_string_sized_new (size + 1024);
+  guint n_files = 0;
+
+  while (str->len < size)
+    {
+      guint dir = n_files / 50;
+
+      if (n_files % 50 == 0)
+        g_string_append_printf (str, "make[2]: Entering directory '/home/user/project/_build/src/dir%u'\n", dir);
+
+      g_string_append_printf (str, "[%u/100000] Compiling C object src/dir%u/libdir%u.a.p/file%u.c.o\n",
+                              n_files, dir, dir, n_files);
+      g_string_append_printf (str,
+                              "cc -Isrc/dir%u/libdir%u.a.p -Isrc/dir%u -I../src/dir%u -I/usr/include/glib-2.0 "
+                              "-I/usr/lib64/glib-2.0/include -fdiagnostics-color=always -pipe "
+                              "-D_FILE_OFFSET_BITS=64 -Wall -Winvalid-pch -std=gnu11 -O2 -g -fPIC "
+                              "-MD -MQ src/dir%u/libdir%u.a.p/file%u.c.o -MF src/dir%u/libdir%u.a.p/file%u.c.o.d "
+                              "-o src/dir%u/libdir%u.a.p/file%u.c.o -c ../src/dir%u/file%u.c\n",
+                              dir, dir, dir, dir, dir, dir, n_files, dir, dir, n_files,
+                              dir, dir, n_files, dir, n_files);
+
+      if (n_files % WARNING_INTERVAL == 0)
+        g_string_append_printf (str,
+                                "../src/dir%u/file%u.c: In function 'file%u_init':\n"
+                                "../src/dir%u/file%u.c:%u:%u: warning: unused variable 'ret' [-Wunused-variable]\n"
+                                "  %u |   gint ret;\n"
+                                "     |        ^~~\n",
+                                dir, n_files, n_files, dir, n_files, 100 + n_files % 900, 8,
+                                100 + n_files % 900);
+
+      n_files++;
+    }
+
+  return str;
+}
+
+static void
+directory_changed_cb (const gchar *directory,
+                      gsize        directory_len,
+                      gpointer     user_data)
+{
+  Counts *counts = user_data;
+
+  counts->n_directories++;
+}
+
+static gboolean
+matched_cb (GMatchInfo *match_info,
+            gpointer    user_data)
+{
+  Counts *counts = user_data;
+
+  counts->n_matches++;
+
+  return TRUE;
+}
+
+static const IdeErrorMatcherCallbacks callbacks = {
+  directory_changed_cb,
+  matched_cb,
+};
+
+/* Feeds @data in chunks ending at line boundaries, as a PTY would mostly do */
+static gdouble
+replay (IdeErrorMatcher *matcher,
+        const gchar     *data,
+        gsize            len,
+        Counts          *counts)
+{
+  const gchar *end = data + len;
+  gint64 begin = g_get_monotonic_time ();
+
+  while (data < end)
+    {
+      const gchar *chunk_end = data + MIN (CHUNK_SIZE, end - data);
+      const gchar *nl;
+
+      if (chunk_end < end && (nl = memrchr (data, '\n', chunk_end - data)))
+        chunk_end = nl + 1;
+
+      _ide_error_matcher_match (matcher, data, chunk_end - data, &callbacks, counts);
+
+      data = chunk_end;
+    }
+
+  return (g_get_monotonic_time () - begin) / 1000.0;
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(IdeErrorMatcher) matcher = _ide_error_matcher_new ();
+  g_autoptr(GMappedFile) mapped = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GString) generated = NULL;
+  const gchar *data;
+  Counts expected = {0};
+  gsize len;
+
+  if (argc > 1)
+    {
+      if (!(mapped = g_mapped_file_new (argv[1], FALSE, &error)))
+        g_error ("%s", error->message);
+
+      data = g_mapped_file_get_contents (mapped);
+      len = g_mapped_file_get_length (mapped);
+    }
+  else
+    {
+      generated = create_log (DEFAULT_LOG_SIZE);
+      data = generated->str;
+      len = generated->len;
+    }
+
+  for (guint i = 0; i < G_N_ELEMENTS (formats); i++)
+    {
+      if (!_ide_error_matcher_add (matcher, formats[i].regex, formats[i].flags, &error))
+        g_error ("%s", error->message);
+    }
+
+  for (guint round = 0; round < N_ROUNDS; round++)
+    {
+      for (guint prefilter = 0; prefilter <= 1; prefilter++)
+        {
+          Counts counts = {0};
+          gdouble msec;
+
+          _ide_error_matcher_set_prefilter (matcher, prefilter);
+          msec = replay (matcher, data, len, &counts);
+
+          /* Both modes must find exactly the same things */
+          if (round == 0 && prefilter == 0)
+            expected = counts;
+
+          g_assert_cmpint (counts.n_matches, ==, expected.n_matches);
+          g_assert_cmpint (counts.n_directories, ==, expected.n_directories);
+
+          g_print ("{\"prefilter\": %s, \"round\": %u, \"bytes\": %"G_GSIZE_FORMAT", "
+                   "\"matches\": %u, \"directories\": %u, \"msec\": %.2lf, \"mb_per_sec\": %.1lf}\n",
+                   prefilter ? "true" : "false", round, len,
+                   counts.n_matches, counts.n_directories, msec,
+                   len / (1024.0 * 1024.0) / (msec / 1000.0));
+        }
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+/* bench-highlight-index.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libide-code.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Compares the hash table based highlight index with its compact form,
+ * both for memory used and lookup speed. The default word count is about
+ * what an index for a file including <gtk/gtk.h> contains.
+ */
+
+#define DEFAULT_N_WORDS 60000
+#define N_LOOKUPS       5000000
+
+static const gchar *tags[] = {
+  "c:type", "def:function", "c:enum-name", "c:macro-name",
+  "c:common-defines", "c:boolean", "c:storage-class",
+};
+
+static gsize
+get_rss (void)
+{
+  g_autofree gchar *contents = NULL;
+  gsize size = 0;
+  gsize resident = 0;
+
+  if (g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    sscanf (contents, "%" G_GSIZE_FORMAT " %" G_GSIZE_FORMAT, &size, &resident);
+
+  return resident * ide_get_system_page_size ();
+}
+
+static GPtrArray *
+create_words (guint n_words)
+{
+  static const gchar *prefixes[] = { "gtk_widget_", "GTK_", "Gtk", "gdk_", "g_", "_gtk_", "pango_" };
+  GPtrArray *words = g_ptr_array_new_with_free_func (g_free);
+
+  for (guint i = 0; i < n_words; i++)
+    g_ptr_array_add (words,
+                     g_strdup_printf ("%s%x_%s",
+                                      prefixes[i % G_N_ELEMENTS (prefixes)],
+                                      i * 2654435761u,
+                                      i % 3 ? "get_property" : "new"));
+
+  return words;
+}
+
+static gdouble
+run_lookups (IdeHighlightIndex *index,
+             GPtrArray         *words,
+             guint             *n_found)
+{
+  gint64 begin = g_get_monotonic_time ();
+
+  *n_found = 0;
+
+  /* Every other lookup misses, as most identifiers in a file do */
+  for (guint i = 0; i < N_LOOKUPS; i++)
+    {
+      const gchar *word = g_ptr_array_index (words, i % words->len);
+      gsize len = strlen (word);
+
+      if (ide_highlight_index_lookup_len (index, word, i & 1 ? len - 1 : len))
+        (*n_found)++;
+    }
+
+  return (g_get_monotonic_time () - begin) / 1000.0;
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(IdeHighlightIndex) hashed = NULL;
+  g_autoptr(IdeHighlightIndex) decoded = NULL;
+  g_autoptr(IdeHighlightIndex) compact = NULL;
+  g_autoptr(GPtrArray) words = NULL;
+  g_autoptr(GMappedFile) mf = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GBytes) mapped = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = NULL;
+  guint n_words = DEFAULT_N_WORDS;
+  gdouble msec;
+  gint64 begin;
+  gsize rss;
+  guint n_found;
+  gint fd;
+
+  if (argc > 1)
+    n_words = MAX (1, g_ascii_strtoull (argv[1], NULL, 10));
+
+  words = create_words (n_words);
+
+  rss = get_rss ();
+  hashed = ide_highlight_index_new ();
+  for (guint i = 0; i < words->len; i++)
+    ide_highlight_index_insert (hashed, g_ptr_array_index (words, i), (gpointer)tags[i % G_N_ELEMENTS (tags)]);
+  g_print ("{\"format\": \"hash\", \"words\": %u, \"rss_bytes\": %" G_GSIZE_FORMAT "}\n",
+           n_words, get_rss () - rss);
+
+  /* What the client used to do for every reply from the daemon */
+  begin = g_get_monotonic_time ();
+  variant = g_variant_ref_sink (ide_highlight_index_to_variant (hashed));
+  rss = get_rss ();
+  decoded = ide_highlight_index_new_from_variant (variant);
+  g_print ("{\"format\": \"variant\", \"words\": %u, \"rss_bytes\": %" G_GSIZE_FORMAT ", "
+           "\"wire_bytes\": %" G_GSIZE_FORMAT ", \"roundtrip_msec\": %.2lf}\n",
+           n_words, get_rss () - rss, g_variant_get_size (variant),
+           (g_get_monotonic_time () - begin) / 1000.0);
+
+  begin = g_get_monotonic_time ();
+  bytes = ide_highlight_index_to_bytes (hashed);
+
+  if ((fd = g_file_open_tmp ("bench-highlight-index-XXXXXX.idx", &path, &error)) == -1 ||
+      !g_file_set_contents (path, g_bytes_get_data (bytes, NULL), g_bytes_get_size (bytes), &error))
+    g_error ("%s", error->message);
+
+  g_close (fd, NULL);
+
+  rss = get_rss ();
+
+  if (!(mf = g_mapped_file_new (path, FALSE, &error)))
+    g_error ("%s", error->message);
+
+  mapped = g_mapped_file_get_bytes (mf);
+
+  if (!(compact = ide_highlight_index_new_from_bytes (mapped, &error)))
+    g_error ("%s", error->message);
+
+  g_print ("{\"format\": \"compact\", \"words\": %u, \"rss_bytes\": %" G_GSIZE_FORMAT ", "
+           "\"file_bytes\": %" G_GSIZE_FORMAT ", \"roundtrip_msec\": %.2lf}\n",
+           n_words, get_rss () - rss, g_bytes_get_size (bytes),
+           (g_get_monotonic_time () - begin) / 1000.0);
+
+  msec = run_lookups (hashed, words, &n_found);
+  g_print ("{\"format\": \"hash\", \"lookups\": %u, \"found\": %u, \"msec\": %.2lf}\n",
+           N_LOOKUPS, n_found, msec);
+
+  msec = run_lookups (compact, words, &n_found);
+  g_print ("{\"format\": \"compact\", \"lookups\": %u, \"found\": %u, \"msec\": %.2lf}\n",
+           N_LOOKUPS, n_found, msec);
+
+  for (guint i = 0; i < words->len; i++)
+    {
+      const gchar *word = g_ptr_array_index (words, i);
+
+      g_assert_cmpstr (ide_highlight_index_lookup (compact, word), ==, ide_highlight_index_lookup (hashed, word));
+      g_assert_cmpstr (ide_highlight_index_lookup (decoded, word), ==, ide_highlight_index_lookup (hashed, word));
+    }
+
+  g_unlink (path);
+
+  return EXIT_SUCCESS;
+}
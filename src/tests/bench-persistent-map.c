@@ -0,0 +1,209 @@
+/* bench-persistent-map.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libide-io.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Compares lookup throughput of version 2 (binary search over sorted keys)
+ * and version 3 (fingerprint hash table) persistent maps. The version 2
+ * file is derived from the version 3 file by dropping the "slots" table so
+ * both contain exactly the same keys and values.
+ */
+
+#define DEFAULT_N_KEYS 1000000
+#define N_ROUNDS       3
+
+static gchar *
+make_key (guint i)
+{
+  /* Roughly the shape of the USRs produced by the clang indexer */
+  return g_strdup_printf ("c:@N@ns%u@S@Type%u@F@method_%u#I#*C#", i % 97, i % 7919, i);
+}
+
+static GFile *
+write_v3 (guint n_keys)
+{
+  g_autoptr(IdePersistentMapBuilder) builder = ide_persistent_map_builder_new ();
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = NULL;
+  g_autoptr(GFile) file = NULL;
+  gint fd;
+
+  if (-1 == (fd = g_file_open_tmp ("bench-persistent-map-v3-XXXXXX", &path, &error)))
+    g_error ("%s", error->message);
+  close (fd);
+
+  for (guint i = 0; i < n_keys; i++)
+    {
+      g_autofree gchar *key = make_key (i);
+
+      ide_persistent_map_builder_insert (builder,
+                                         key,
+                                         g_variant_new ("(uuuu)", i, i % 1000, i % 80, 0),
+                                         FALSE);
+    }
+
+  file = g_file_new_for_path (path);
+
+  if (!ide_persistent_map_builder_write (builder, file, G_PRIORITY_DEFAULT, NULL, &error))
+    g_error ("%s", error->message);
+
+  return g_steal_pointer (&file);
+}
+
+static GFile *
+write_v2 (GFile *v3)
+{
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GVariant) data = NULL;
+  g_autoptr(GVariant) v2 = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = NULL;
+  GVariantDict dict;
+  gint fd;
+
+  if (!(bytes = g_file_load_bytes (v3, NULL, NULL, &error)))
+    g_error ("%s", error->message);
+
+  data = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE));
+
+  g_variant_dict_init (&dict, data);
+  g_variant_dict_remove (&dict, "slots");
+  g_variant_dict_insert (&dict, "version", "i", 2);
+  v2 = g_variant_ref_sink (g_variant_dict_end (&dict));
+
+  if (-1 == (fd = g_file_open_tmp ("bench-persistent-map-v2-XXXXXX", &path, &error)))
+    g_error ("%s", error->message);
+  close (fd);
+
+  if (!g_file_set_contents (path, g_variant_get_data (v2), g_variant_get_size (v2), &error))
+    g_error ("%s", error->message);
+
+  return g_file_new_for_path (path);
+}
+
+static IdePersistentMap *
+load (GFile *file)
+{
+  g_autoptr(IdePersistentMap) map = ide_persistent_map_new ();
+  g_autoptr(GError) error = NULL;
+
+  if (!ide_persistent_map_load_file (map, file, NULL, &error))
+    g_error ("%s", error->message);
+
+  return g_steal_pointer (&map);
+}
+
+static gdouble
+run (IdePersistentMap  *map,
+     gchar            **keys,
+     guint              n_keys,
+     guint             *n_found)
+{
+  gint64 begin;
+  gint64 end;
+
+  *n_found = 0;
+
+  begin = g_get_monotonic_time ();
+
+  for (guint i = 0; i < n_keys; i++)
+    {
+      g_autoptr(GVariant) value = ide_persistent_map_lookup_value (map, keys[i]);
+
+      if (value != NULL)
+        (*n_found)++;
+    }
+
+  end = g_get_monotonic_time ();
+
+  return (gdouble)n_keys / ((end - begin) / (gdouble)G_USEC_PER_SEC);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(IdePersistentMap) map_v2 = NULL;
+  g_autoptr(IdePersistentMap) map_v3 = NULL;
+  g_autoptr(GFile) file_v2 = NULL;
+  g_autoptr(GFile) file_v3 = NULL;
+  g_autoptr(GRand) rand = g_rand_new_with_seed (0);
+  gchar **keys;
+  guint n_keys = DEFAULT_N_KEYS;
+
+  if (argc > 1)
+    n_keys = MAX (1, g_ascii_strtoull (argv[1], NULL, 10));
+
+  file_v3 = write_v3 (n_keys);
+  file_v2 = write_v2 (file_v3);
+
+  map_v2 = load (file_v2);
+  map_v3 = load (file_v3);
+
+  /* Lookup every key in random order, plus as many misses */
+  keys = g_new0 (gchar *, n_keys * 2 + 1);
+
+  for (guint i = 0; i < n_keys; i++)
+    {
+      keys[i * 2] = make_key (i);
+      keys[i * 2 + 1] = g_strdup_printf ("c:@F@missing_%u#", i);
+    }
+
+  for (guint i = n_keys * 2 - 1; i > 0; i--)
+    {
+      guint j = g_rand_int_range (rand, 0, i + 1);
+      gchar *tmp = keys[i];
+
+      keys[i] = keys[j];
+      keys[j] = tmp;
+    }
+
+  /* Both versions must agree on every lookup */
+  for (guint i = 0; i < n_keys * 2; i++)
+    {
+      g_autoptr(GVariant) a = ide_persistent_map_lookup_value (map_v2, keys[i]);
+      g_autoptr(GVariant) b = ide_persistent_map_lookup_value (map_v3, keys[i]);
+
+      g_assert_true ((a == NULL) == (b == NULL));
+      g_assert_true (a == NULL || g_variant_equal (a, b));
+    }
+
+  for (guint round = 0; round < N_ROUNDS; round++)
+    {
+      guint found_v2;
+      guint found_v3;
+      gdouble v2 = run (map_v2, keys, n_keys * 2, &found_v2);
+      gdouble v3 = run (map_v3, keys, n_keys * 2, &found_v3);
+
+      g_assert_cmpint (found_v2, ==, n_keys);
+      g_assert_cmpint (found_v3, ==, n_keys);
+
+      g_print ("{\"keys\": %u, \"round\": %u, \"v2_lookups_per_sec\": %.0lf, "
+               "\"v3_lookups_per_sec\": %.0lf, \"speedup\": %.2lf}\n",
+               n_keys, round, v2, v3, v3 / v2);
+    }
+
+  g_file_delete (file_v2, NULL, NULL);
+  g_file_delete (file_v3, NULL, NULL);
+  g_strfreev (keys);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,430 @@
+/* test-buffer-snapshot.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <libide-code.h>
+#include <string.h>
+
+#include "ide-buffer-snapshot-private.h"
+
+/*
+ * The piece table is kept in sync with a GtkTextBuffer, the same way that
+ * IdeBuffer does, and every snapshot is compared against the text of the
+ * GtkTextBuffer.
+ */
+
+static const gchar *fragments[] = {
+  "a", "xyz", " ", "\n", "\n\n", "é", "€", "𝄞", "ñandú\n", "line\n", "日本語",
+};
+
+typedef struct
+{
+  GtkTextBuffer   *buffer;
+  IdeBufferPieces *pieces;
+  guint            change_count;
+} Mirror;
+
+static void
+mirror_init (Mirror *mirror)
+{
+  mirror->buffer = gtk_text_buffer_new (NULL);
+  mirror->pieces = _ide_buffer_pieces_new ();
+  mirror->change_count = 0;
+}
+
+static void
+mirror_clear (Mirror *mirror)
+{
+  g_clear_object (&mirror->buffer);
+  g_clear_pointer (&mirror->pieces, _ide_buffer_pieces_free);
+}
+
+static gsize
+get_byte_offset (GtkTextBuffer     *buffer,
+                 const GtkTextIter *iter)
+{
+  g_autofree gchar *text = NULL;
+  GtkTextIter begin;
+
+  gtk_text_buffer_get_start_iter (buffer, &begin);
+  text = gtk_text_buffer_get_text (buffer, &begin, iter, TRUE);
+
+  return strlen (text);
+}
+
+static gchar *
+get_text (GtkTextBuffer *buffer)
+{
+  GtkTextIter begin, end;
+
+  gtk_text_buffer_get_bounds (buffer, &begin, &end);
+
+  return gtk_text_buffer_get_text (buffer, &begin, &end, TRUE);
+}
+
+static void
+mirror_insert (Mirror      *mirror,
+               guint        char_offset,
+               const gchar *text)
+{
+  GtkTextIter iter;
+
+  gtk_text_buffer_get_iter_at_offset (mirror->buffer, &iter, char_offset);
+  _ide_buffer_pieces_insert (mirror->pieces,
+                             get_byte_offset (mirror->buffer, &iter),
+                             text,
+                             strlen (text));
+  gtk_text_buffer_insert (mirror->buffer, &iter, text, -1);
+  mirror->change_count++;
+}
+
+static void
+mirror_delete (Mirror *mirror,
+               guint   begin_char,
+               guint   end_char)
+{
+  GtkTextIter begin, end;
+
+  gtk_text_buffer_get_iter_at_offset (mirror->buffer, &begin, begin_char);
+  gtk_text_buffer_get_iter_at_offset (mirror->buffer, &end, end_char);
+  _ide_buffer_pieces_delete (mirror->pieces,
+                             get_byte_offset (mirror->buffer, &begin),
+                             get_byte_offset (mirror->buffer, &end));
+  gtk_text_buffer_delete (mirror->buffer, &begin, &end);
+  mirror->change_count++;
+}
+
+static void
+assert_snapshot (Mirror   *mirror,
+                 gboolean  implicit_newline)
+{
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
+  g_autofree gchar *buffer_text = get_text (mirror->buffer);
+  g_autofree gchar *copy = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GString) expected = g_string_new (buffer_text);
+  guint n_lines = gtk_text_buffer_get_line_count (mirror->buffer);
+  gsize len;
+
+  snapshot = _ide_buffer_pieces_snapshot (mirror->pieces, implicit_newline, mirror->change_count);
+
+  /* GtkSourceBuffer shows an implicit newline after the last line */
+  if (implicit_newline && (expected->len == 0 || expected->str[expected->len - 1] != '\n'))
+    {
+      g_string_append_c (expected, '\n');
+      n_lines++;
+    }
+
+  g_assert_cmpuint (ide_buffer_snapshot_get_change_count (snapshot), ==, mirror->change_count);
+  g_assert_cmpuint (ide_buffer_snapshot_get_length (snapshot), ==, expected->len);
+  g_assert_cmpuint (ide_buffer_snapshot_get_n_lines (snapshot), ==, n_lines);
+
+  copy = ide_buffer_snapshot_dup_range (snapshot, 0, G_MAXSIZE);
+  g_assert_cmpstr (copy, ==, expected->str);
+
+  bytes = ide_buffer_snapshot_dup_bytes (snapshot);
+  g_assert_cmpmem (g_bytes_get_data (bytes, &len), len, expected->str, expected->len);
+
+  /* Line offsets, compared with the iters of the GtkTextBuffer */
+  for (guint line = 0; line < gtk_text_buffer_get_line_count (mirror->buffer); line++)
+    {
+      GtkTextIter iter;
+      gsize offset;
+
+      gtk_text_buffer_get_iter_at_line (mirror->buffer, &iter, line);
+      offset = get_byte_offset (mirror->buffer, &iter);
+
+      g_assert_cmpuint (ide_buffer_snapshot_get_line_offset (snapshot, line), ==, offset);
+      g_assert_cmpuint (_ide_buffer_pieces_get_line_offset (mirror->pieces, line), ==, offset);
+    }
+
+  g_assert_cmpuint (ide_buffer_snapshot_get_line_offset (snapshot, n_lines), ==, expected->len);
+
+  /* Random ranges of lines, with their newlines */
+  for (guint i = 0; i < 10; i++)
+    {
+      g_autofree gchar *lines = NULL;
+      g_autofree gchar *buffer_lines = NULL;
+      guint begin_line = g_test_rand_int_range (0, n_lines + 1);
+      guint end_line = g_test_rand_int_range (begin_line, n_lines + 2);
+      gsize begin = ide_buffer_snapshot_get_line_offset (snapshot, begin_line);
+      gsize end = ide_buffer_snapshot_get_line_offset (snapshot, end_line);
+
+      lines = ide_buffer_snapshot_dup_lines (snapshot, begin_line, end_line);
+      buffer_lines = g_strndup (expected->str + begin, end - begin);
+
+      g_assert_cmpstr (lines, ==, buffer_lines);
+    }
+
+  /* Random byte slices, which may split characters and pieces */
+  for (guint i = 0; i < 10; i++)
+    {
+      g_autofree gchar *slice = NULL;
+      gsize begin = g_test_rand_int_range (0, expected->len + 1);
+      gsize end = g_test_rand_int_range (begin, expected->len + 2);
+
+      slice = ide_buffer_snapshot_dup_range (snapshot, begin, end);
+      end = MIN (end, expected->len);
+
+      g_assert_cmpmem (slice, strlen (slice), expected->str + begin, end - begin);
+    }
+}
+
+static void
+test_buffer_snapshot_empty (void)
+{
+  Mirror mirror;
+
+  mirror_init (&mirror);
+
+  assert_snapshot (&mirror, FALSE);
+  assert_snapshot (&mirror, TRUE);
+
+  /* Back to empty after an edit */
+  mirror_insert (&mirror, 0, "abc\n");
+  mirror_delete (&mirror, 0, 4);
+  assert_snapshot (&mirror, FALSE);
+  assert_snapshot (&mirror, TRUE);
+
+  mirror_clear (&mirror);
+}
+
+static void
+test_buffer_snapshot_trailing_newline (void)
+{
+  Mirror mirror;
+
+  mirror_init (&mirror);
+
+  mirror_insert (&mirror, 0, "first\nsecond");
+  assert_snapshot (&mirror, FALSE);
+  assert_snapshot (&mirror, TRUE);
+
+  /* The implicit newline is not added twice */
+  mirror_insert (&mirror, 12, "\n");
+  assert_snapshot (&mirror, FALSE);
+  assert_snapshot (&mirror, TRUE);
+
+  mirror_insert (&mirror, 13, "\n\n");
+  assert_snapshot (&mirror, FALSE);
+  assert_snapshot (&mirror, TRUE);
+
+  mirror_clear (&mirror);
+}
+
+static void
+test_buffer_snapshot_multibyte (void)
+{
+  Mirror mirror;
+
+  mirror_init (&mirror);
+
+  mirror_insert (&mirror, 0, "日本語\n𝄞 clef\nñandú");
+  assert_snapshot (&mirror, FALSE);
+
+  /* Edits between multibyte characters */
+  mirror_insert (&mirror, 1, "€");
+  mirror_delete (&mirror, 5, 7);
+  mirror_insert (&mirror, 6, "é\n");
+  assert_snapshot (&mirror, FALSE);
+  assert_snapshot (&mirror, TRUE);
+
+  mirror_clear (&mirror);
+}
+
+static void
+test_buffer_snapshot_random (void)
+{
+  Mirror mirror;
+
+  mirror_init (&mirror);
+
+  for (guint i = 0; i < 5000; i++)
+    {
+      guint n_chars = gtk_text_buffer_get_char_count (mirror.buffer);
+
+      if (n_chars > 0 && g_test_rand_int_range (0, 10) < 3)
+        {
+          guint begin = g_test_rand_int_range (0, n_chars);
+          guint end = MIN (n_chars, begin + g_test_rand_int_range (1, 20));
+
+          mirror_delete (&mirror, begin, end);
+        }
+      else
+        {
+          g_autoptr(GString) str = g_string_new (NULL);
+          guint n_fragments = g_test_rand_int_range (1, 8);
+
+          for (guint j = 0; j < n_fragments; j++)
+            g_string_append (str, fragments[g_test_rand_int_range (0, G_N_ELEMENTS (fragments))]);
+
+          mirror_insert (&mirror, g_test_rand_int_range (0, n_chars + 1), str->str);
+        }
+
+      /* Snapshots share pieces, so older ones must stay unchanged */
+      if (i % 50 == 0)
+        assert_snapshot (&mirror, g_test_rand_bit ());
+    }
+
+  assert_snapshot (&mirror, FALSE);
+  assert_snapshot (&mirror, TRUE);
+
+  mirror_clear (&mirror);
+}
+
+static void
+test_buffer_snapshot_large_insert (void)
+{
+  g_autoptr(GString) str = g_string_new (NULL);
+  Mirror mirror;
+
+  mirror_init (&mirror);
+
+  /* Large insertions get an indexed chunk of their own */
+  for (guint i = 0; i < 2000; i++)
+    g_string_append_printf (str, "line %u €\n", i);
+
+  mirror_insert (&mirror, 0, "before\nafter\n");
+  mirror_insert (&mirror, 7, str->str);
+  assert_snapshot (&mirror, FALSE);
+
+  /* Split the large piece, and delete across pieces */
+  mirror_insert (&mirror, 1000, "split\n");
+  mirror_delete (&mirror, 500, 1500);
+  assert_snapshot (&mirror, FALSE);
+
+  mirror_clear (&mirror);
+}
+
+static void
+test_buffer_snapshot_compaction (void)
+{
+  g_autoptr(IdeBufferSnapshot) before = NULL;
+  g_autofree gchar *before_text = NULL;
+  g_autofree gchar *after_text = NULL;
+  Mirror mirror;
+
+  mirror_init (&mirror);
+
+  mirror_insert (&mirror, 0, "0123456789\n");
+
+  /* Every insertion in the middle of a piece splits it, so this goes
+   * well past the number of pieces that triggers compaction.
+   */
+  for (guint i = 0; i < 3000; i++)
+    {
+      guint n_chars = gtk_text_buffer_get_char_count (mirror.buffer);
+
+      mirror_insert (&mirror, 1 + (i * 7) % (n_chars - 1), i % 10 ? "x" : "\n");
+
+      if (i == 1000)
+        {
+          before = _ide_buffer_pieces_snapshot (mirror.pieces, FALSE, mirror.change_count);
+          before_text = get_text (mirror.buffer);
+        }
+
+      if (i % 250 == 0)
+        assert_snapshot (&mirror, FALSE);
+    }
+
+  assert_snapshot (&mirror, FALSE);
+
+  /* A snapshot taken before compaction is unaffected by it */
+  after_text = ide_buffer_snapshot_dup_range (before, 0, G_MAXSIZE);
+  g_assert_cmpstr (after_text, ==, before_text);
+
+  mirror_clear (&mirror);
+}
+
+static void
+test_buffer_snapshot_for_text (void)
+{
+  static const gchar text[] = "a\nb€\n\nc";
+  g_autoptr(IdeBufferSnapshot) snapshot = NULL;
+  g_autofree gchar *copy = NULL;
+
+  snapshot = _ide_buffer_snapshot_new_for_text (text, strlen (text), TRUE, 3);
+  copy = ide_buffer_snapshot_dup_range (snapshot, 0, G_MAXSIZE);
+
+  g_assert_cmpstr (copy, ==, "a\nb€\n\nc\n");
+  g_assert_cmpuint (ide_buffer_snapshot_get_n_lines (snapshot), ==, 5);
+  g_assert_cmpuint (ide_buffer_snapshot_get_line_offset (snapshot, 2), ==, 7);
+  g_assert_cmpuint (ide_buffer_snapshot_get_change_count (snapshot), ==, 3);
+}
+
+static void
+buffer_changed_cb (IdeBuffer *buffer,
+                   guint     *n_changed)
+{
+  g_autoptr(IdeBufferSnapshot) snapshot = ide_buffer_ref_snapshot (buffer);
+  g_autofree gchar *text = get_text (GTK_TEXT_BUFFER (buffer));
+  g_autofree gchar *copy = ide_buffer_snapshot_dup_range (snapshot, 0, G_MAXSIZE);
+
+  g_assert_cmpstr (copy, ==, text);
+
+  (*n_changed)++;
+}
+
+static void
+test_buffer_snapshot_changed (void)
+{
+  g_autoptr(GFile) file = g_file_new_for_path ("test-buffer-snapshot.txt");
+  g_autoptr(IdeBuffer) buffer = NULL;
+  GtkTextIter begin, end;
+  guint n_changed = 0;
+
+  buffer = g_object_new (IDE_TYPE_BUFFER,
+                         "file", file,
+                         NULL);
+  gtk_source_buffer_set_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer), FALSE);
+
+  /* Snapshots taken while "changed" is emitted see the edit */
+  g_signal_connect (buffer, "changed", G_CALLBACK (buffer_changed_cb), &n_changed);
+
+  gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "first\nsecond €\nthird\n", -1);
+
+  gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &begin, 1, 3);
+  gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &begin, "日本\n", -1);
+
+  gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &begin, 0, 2);
+  gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &end, 2, 4);
+  gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &begin, &end);
+
+  gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (buffer), &end);
+  gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &end, "last", -1);
+
+  g_assert_cmpint (n_changed, >=, 4);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  gtk_init (&argc, &argv);
+  g_test_add_func ("/Ide/BufferSnapshot/empty", test_buffer_snapshot_empty);
+  g_test_add_func ("/Ide/BufferSnapshot/trailing-newline", test_buffer_snapshot_trailing_newline);
+  g_test_add_func ("/Ide/BufferSnapshot/multibyte", test_buffer_snapshot_multibyte);
+  g_test_add_func ("/Ide/BufferSnapshot/random", test_buffer_snapshot_random);
+  g_test_add_func ("/Ide/BufferSnapshot/large-insert", test_buffer_snapshot_large_insert);
+  g_test_add_func ("/Ide/BufferSnapshot/compaction", test_buffer_snapshot_compaction);
+  g_test_add_func ("/Ide/BufferSnapshot/for-text", test_buffer_snapshot_for_text);
+  g_test_add_func ("/Ide/BufferSnapshot/changed", test_buffer_snapshot_changed);
+  return g_test_run ();
+}
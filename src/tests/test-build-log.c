@@ -0,0 +1,163 @@
+/* test-build-log.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <libide-foundry.h>
+#include <string.h>
+
+#include "ide-build-log-private.h"
+
+/* RING_SIZE in ide-build-log.c */
+#define RING_SIZE (4 * 1024 * 1024)
+
+typedef struct
+{
+  IdeBuildLog *log;
+  guint        n_lines;
+  gsize        line_len;
+} Writer;
+
+typedef struct
+{
+  guint n_lines;
+  guint next;
+  guint n_out_of_order;
+} Received;
+
+static gpointer
+writer_thread (gpointer data)
+{
+  Writer *writer = data;
+  gchar *line = g_malloc (writer->line_len + 1);
+
+  for (guint i = 0; i < writer->n_lines; i++)
+    {
+      gint len = g_snprintf (line, writer->line_len + 1, "%u ", i);
+
+      memset (line + len, 'x', writer->line_len - len);
+      line[writer->line_len] = 0;
+
+      ide_build_log_observer (IDE_BUILD_LOG_STDOUT, line, writer->line_len, writer->log);
+    }
+
+  g_free (line);
+
+  return NULL;
+}
+
+static void
+write_from_thread (IdeBuildLog *log,
+                   guint        n_lines,
+                   gsize        line_len)
+{
+  Writer writer = { log, n_lines, line_len };
+
+  g_thread_join (g_thread_new ("writer", writer_thread, &writer));
+}
+
+static void
+received_cb (IdeBuildLogStream  stream,
+             const gchar       *message,
+             gssize             message_len,
+             gpointer           user_data)
+{
+  Received *received = user_data;
+  guint64 index = g_ascii_strtoull (message, NULL, 10);
+
+  if (index < received->next)
+    received->n_out_of_order++;
+
+  received->next = index + 1;
+  received->n_lines++;
+}
+
+static void
+dispatch_all (IdeBuildLog *log)
+{
+  while (ide_build_log_get_backlog (log) > 0)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_build_log_backlog (void)
+{
+  g_autoptr(IdeBuildLog) log = ide_build_log_new ();
+  Received received = {0};
+
+  ide_build_log_add_observer (log, received_cb, &received, NULL);
+
+  /* Lines from the main thread are delivered immediately */
+  ide_build_log_observer (IDE_BUILD_LOG_STDOUT, "0 main", -1, log);
+  g_assert_cmpint (received.n_lines, ==, 1);
+  g_assert_cmpint (ide_build_log_get_backlog (log), ==, 0);
+
+  /* Lines from a worker wait for the main loop */
+  received.next = 0;
+  write_from_thread (log, 10000, 40);
+  g_assert_cmpint (ide_build_log_get_backlog (log), ==, 10000);
+  g_assert_cmpint (received.n_lines, ==, 1);
+
+  dispatch_all (log);
+  g_assert_cmpint (received.n_lines, ==, 10001);
+  g_assert_cmpint (received.n_out_of_order, ==, 0);
+  g_assert_cmpint (ide_build_log_get_n_dropped (log), ==, 0);
+}
+
+static void
+test_build_log_dropped (void)
+{
+  g_autoptr(IdeBuildLog) log = ide_build_log_new ();
+  Received received = {0};
+  gsize line_len = 64 * 1024;
+  guint n_lines = 2 * RING_SIZE / line_len;
+  gsize n_dropped;
+
+  ide_build_log_add_observer (log, received_cb, &received, NULL);
+
+  /* Twice what the ring can hold while the main loop is not running */
+  write_from_thread (log, n_lines, line_len);
+
+  n_dropped = ide_build_log_get_n_dropped (log);
+  g_assert_cmpint (n_dropped, >, 0);
+  g_assert_cmpint (n_dropped, <, n_lines);
+  g_assert_cmpint (ide_build_log_get_backlog (log) + n_dropped, ==, n_lines);
+
+  dispatch_all (log);
+  g_assert_cmpint (received.n_lines + n_dropped, ==, n_lines);
+  g_assert_cmpint (received.n_out_of_order, ==, 0);
+
+  /* Once dispatched, the ring has room again */
+  received.next = 0;
+  write_from_thread (log, 10, line_len);
+  g_assert_cmpint (ide_build_log_get_n_dropped (log), ==, n_dropped);
+  g_assert_cmpint (ide_build_log_get_backlog (log), ==, 10);
+
+  dispatch_all (log);
+  g_assert_cmpint (received.n_lines + n_dropped, ==, n_lines + 10);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/BuildLog/backlog", test_build_log_backlog);
+  g_test_add_func ("/Ide/BuildLog/dropped", test_build_log_dropped);
+  return g_test_run ();
+}
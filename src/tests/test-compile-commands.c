@@ -18,7 +18,11 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <fcntl.h>
+#include <glib/gstdio.h>
 #include <libide-foundry.h>
+#include <string.h>
+#include <sys/stat.h>
 
 static void
 test_compile_commands_basic (void)
@@ -70,11 +74,210 @@ test_compile_commands_basic (void)
   g_assert_cmpstr (valastrv[3], ==, "gtksourceview-4");
 }
 
+static gchar *
+copy_test_data (const gchar *tmpdir)
+{
+  g_autofree gchar *data_path = NULL;
+  g_autofree gchar *contents = NULL;
+  g_autoptr(GError) error = NULL;
+  gchar *path;
+  gsize len;
+
+  data_path = g_build_filename (TEST_DATA_DIR, "test-compile-commands.json", NULL);
+  g_file_get_contents (data_path, &contents, &len, &error);
+  g_assert_no_error (error);
+
+  path = g_build_filename (tmpdir, "compile_commands.json", NULL);
+  g_file_set_contents (path, contents, len, &error);
+  g_assert_no_error (error);
+
+  return path;
+}
+
+/* Replaces the contents of @path without changing its mtime */
+static void
+replace_contents (const gchar *path,
+                  const gchar *contents,
+                  gsize        len)
+{
+  g_autoptr(GError) error = NULL;
+  struct timespec times[2];
+  GStatBuf st;
+
+  g_assert_cmpint (g_stat (path, &st), ==, 0);
+  g_file_set_contents (path, contents, len, &error);
+  g_assert_no_error (error);
+
+  times[0] = st.st_atim;
+  times[1] = st.st_mtim;
+  g_assert_cmpint (utimensat (AT_FDCWD, path, times, 0), ==, 0);
+}
+
+static IdeCompileCommands *
+load_with_cache (GFile   *file,
+                 GFile   *cache_file,
+                 GError **error)
+{
+  g_autoptr(IdeCompileCommands) commands = ide_compile_commands_new ();
+
+  ide_compile_commands_set_cache_file (commands, cache_file);
+
+  if (!ide_compile_commands_load (commands, file, NULL, error))
+    return NULL;
+
+  return g_steal_pointer (&commands);
+}
+
+static void
+test_compile_commands_cache (void)
+{
+  static const gchar *system_includes[] = { "/usr/include/test", NULL };
+  g_autoptr(IdeCompileCommands) uncached = NULL;
+  g_autoptr(IdeCompileCommands) cached = NULL;
+  g_autoptr(GFile) json_file = NULL;
+  g_autoptr(GFile) cache_file = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *json_path = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  g_autofree gchar *cache_path = NULL;
+  g_autofree gchar *garbage = NULL;
+  const gchar *paths[] = {
+    "/build/gnome-builder/subprojects/libgd/libgd/gd-types-catalog.c",
+    "/build/gnome-builder/subprojects/libgd/libgd/gd-types-catalog.h",
+    "whatever.vala",
+    "missing.c",
+  };
+  GStatBuf st;
+
+  tmpdir = g_dir_make_tmp ("test-compile-commands-XXXXXX", &error);
+  g_assert_no_error (error);
+  cache_path = g_build_filename (tmpdir, "compile_commands.cache", NULL);
+  cache_file = g_file_new_for_path (cache_path);
+  json_path = copy_test_data (tmpdir);
+  json_file = g_file_new_for_path (json_path);
+
+  /* The first load parses the JSON and writes the cache */
+  uncached = load_with_cache (json_file, cache_file, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (uncached);
+  g_assert (g_file_test (cache_path, G_FILE_TEST_IS_REGULAR));
+
+  /* Keep the size and mtime, but make the JSON unparsable so that only
+   * the cache can give the same results.
+   */
+  g_assert_cmpint (g_stat (json_path, &st), ==, 0);
+  garbage = g_malloc (st.st_size);
+  memset (garbage, 'x', st.st_size);
+  replace_contents (json_path, garbage, st.st_size);
+
+  cached = load_with_cache (json_file, cache_file, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (cached);
+
+  for (guint i = 0; i < G_N_ELEMENTS (paths); i++)
+    {
+      g_autoptr(GFile) file = g_file_new_for_path (paths[i]);
+      g_autoptr(GFile) dir1 = NULL;
+      g_autoptr(GFile) dir2 = NULL;
+      g_auto(GStrv) strv1 = NULL;
+      g_auto(GStrv) strv2 = NULL;
+
+      strv1 = ide_compile_commands_lookup (uncached, file, system_includes, &dir1, NULL);
+      strv2 = ide_compile_commands_lookup (cached, file, system_includes, &dir2, NULL);
+
+      g_assert_cmpint (strv1 == NULL, ==, strv2 == NULL);
+
+      if (strv1 != NULL)
+        {
+          g_assert_cmpint (g_strv_length (strv1), ==, g_strv_length (strv2));
+          for (guint j = 0; strv1[j]; j++)
+            g_assert_cmpstr (strv1[j], ==, strv2[j]);
+          g_assert (g_file_equal (dir1, dir2));
+        }
+    }
+
+  g_unlink (json_path);
+  g_unlink (cache_path);
+  g_rmdir (tmpdir);
+}
+
+static void
+test_compile_commands_cache_invalidate (void)
+{
+  g_autoptr(IdeCompileCommands) commands = NULL;
+  g_autoptr(GFile) json_file = NULL;
+  g_autoptr(GFile) cache_file = NULL;
+  g_autoptr(GFile) source = NULL;
+  g_autoptr(GString) changed = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *json_path = NULL;
+  g_autofree gchar *tmpdir = NULL;
+  g_autofree gchar *cache_path = NULL;
+  g_autofree gchar *contents = NULL;
+  g_autofree gchar *garbage = NULL;
+  g_auto(GStrv) strv = NULL;
+  struct timespec times[2];
+  const gchar *flag;
+  GStatBuf st;
+  gsize len;
+
+  tmpdir = g_dir_make_tmp ("test-compile-commands-XXXXXX", &error);
+  g_assert_no_error (error);
+  cache_path = g_build_filename (tmpdir, "compile_commands.cache", NULL);
+  cache_file = g_file_new_for_path (cache_path);
+  json_path = copy_test_data (tmpdir);
+  json_file = g_file_new_for_path (json_path);
+  source = g_file_new_for_path ("/build/gnome-builder/subprojects/libgd/libgd/gd-types-catalog.c");
+
+  commands = load_with_cache (json_file, cache_file, &error);
+  g_assert_no_error (error);
+  g_clear_object (&commands);
+
+  /* A different size with the same mtime is parsed again */
+  g_file_get_contents (json_path, &contents, &len, &error);
+  g_assert_no_error (error);
+  flag = strstr (contents, "gd@sha ");
+  g_assert_nonnull (flag);
+  changed = g_string_new_len (contents, len);
+  g_string_insert (changed, flag - contents + strlen ("gd@sha"), "-changed");
+  replace_contents (json_path, changed->str, changed->len);
+
+  commands = load_with_cache (json_file, cache_file, &error);
+  g_assert_no_error (error);
+  strv = ide_compile_commands_lookup (commands, source, NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_cmpstr (strv[0], ==, "-I/build/gnome-builder/build/subprojects/libgd/libgd/gd@sha-changed");
+  g_clear_object (&commands);
+
+  /* A different mtime with the same size is parsed again, so the
+   * garbage is rejected rather than the cache being used.
+   */
+  g_assert_cmpint (g_stat (json_path, &st), ==, 0);
+  garbage = g_malloc (st.st_size);
+  memset (garbage, 'x', st.st_size);
+  g_file_set_contents (json_path, garbage, st.st_size, &error);
+  g_assert_no_error (error);
+  times[0] = st.st_atim;
+  times[1] = st.st_mtim;
+  times[1].tv_sec++;
+  g_assert_cmpint (utimensat (AT_FDCWD, json_path, times, 0), ==, 0);
+
+  commands = load_with_cache (json_file, cache_file, &error);
+  g_assert_nonnull (error);
+  g_assert_null (commands);
+
+  g_unlink (json_path);
+  g_unlink (cache_path);
+  g_rmdir (tmpdir);
+}
+
 gint
 main (gint argc,
       gchar *argv[])
 {
   g_test_init (&argc, &argv, NULL);
   g_test_add_func ("/Ide/CompileCommands/basic", test_compile_commands_basic);
+  g_test_add_func ("/Ide/CompileCommands/cache", test_compile_commands_cache);
+  g_test_add_func ("/Ide/CompileCommands/cache-invalidate", test_compile_commands_cache_invalidate);
   return g_test_run ();
 }
@@ -60,11 +60,74 @@ test_fuzzy_match (void)
     }
 }
 
+static void
+test_fuzzy_match_batch (void)
+{
+  static const gchar *haystacks[] = {
+    "endianness", "Endianness", NULL, "", "GtkWidget", "gtk_widget_show",
+    "end", "zzzzzzzzzzzzzzzzend", "énd_ünicode", "Ende",
+  };
+  static const gchar *needles[] = { "end", "gtkw", "z", "End", "ünic", "" };
+
+  for (guint i = 0; i < G_N_ELEMENTS (needles); i++)
+    {
+      g_autoptr(GArray) all = NULL;
+      g_autoptr(GArray) top = NULL;
+      guint n_matched = 0;
+
+      all = ide_completion_fuzzy_match_batch (haystacks, G_N_ELEMENTS (haystacks), needles[i], 0);
+
+      /* Every match must agree with ide_completion_fuzzy_match() */
+      for (guint j = 0; j < G_N_ELEMENTS (haystacks); j++)
+        {
+          guint priority = 0;
+
+          if (ide_completion_fuzzy_match (haystacks[j], needles[i], &priority))
+            {
+              gboolean found = FALSE;
+
+              for (guint k = 0; k < all->len; k++)
+                {
+                  const IdeCompletionFuzzyMatch *match = &g_array_index (all, IdeCompletionFuzzyMatch, k);
+
+                  if (match->index == j)
+                    {
+                      g_assert_cmpint (match->priority, ==, priority);
+                      found = TRUE;
+                    }
+                }
+
+              g_assert_true (found);
+              n_matched++;
+            }
+        }
+
+      g_assert_cmpint (all->len, ==, n_matched);
+
+      for (guint k = 1; k < all->len; k++)
+        g_assert_cmpint (g_array_index (all, IdeCompletionFuzzyMatch, k - 1).priority, <=,
+                         g_array_index (all, IdeCompletionFuzzyMatch, k).priority);
+
+      /* The bounded result must be a prefix of the complete one */
+      top = ide_completion_fuzzy_match_batch (haystacks, G_N_ELEMENTS (haystacks), needles[i], 2);
+      g_assert_cmpint (top->len, ==, MIN (2, all->len));
+
+      for (guint k = 0; k < top->len; k++)
+        {
+          g_assert_cmpint (g_array_index (top, IdeCompletionFuzzyMatch, k).index, ==,
+                           g_array_index (all, IdeCompletionFuzzyMatch, k).index);
+          g_assert_cmpint (g_array_index (top, IdeCompletionFuzzyMatch, k).priority, ==,
+                           g_array_index (all, IdeCompletionFuzzyMatch, k).priority);
+        }
+    }
+}
+
 gint
 main (gint argc,
       gchar *argv[])
 {
   g_test_init (&argc, &argv, NULL);
   g_test_add_func ("/Ide/Completion/fuzzy_match", test_fuzzy_match);
+  g_test_add_func ("/Ide/Completion/fuzzy_match_batch", test_fuzzy_match_batch);
   return g_test_run ();
 }
@@ -0,0 +1,317 @@
+/* test-content-search.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <glib/gstdio.h>
+#include <libide-io.h>
+#include <string.h>
+
+static gchar *tmpdir;
+
+static void
+write_file (const gchar *relative,
+            const gchar *contents,
+            gssize       len)
+{
+  g_autofree gchar *path = g_build_filename (tmpdir, relative, NULL);
+  g_autofree gchar *dir = g_path_get_dirname (path);
+  g_autoptr(GError) error = NULL;
+
+  g_mkdir_with_parents (dir, 0750);
+  g_file_set_contents (path, contents, len, &error);
+  g_assert_no_error (error);
+}
+
+static void
+remove_tree (const gchar *path)
+{
+  GDir *dir;
+
+  if ((dir = g_dir_open (path, 0, NULL)))
+    {
+      const gchar *name;
+
+      while ((name = g_dir_read_name (dir)))
+        {
+          g_autofree gchar *child = g_build_filename (path, name, NULL);
+
+          if (g_file_test (child, G_FILE_TEST_IS_DIR))
+            remove_tree (child);
+          else
+            g_unlink (child);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_rmdir (path);
+}
+
+static void
+run_cb (GObject      *object,
+        GAsyncResult *result,
+        gpointer      user_data)
+{
+  g_autoptr(GError) error = NULL;
+  GMainLoop *main_loop = user_data;
+  gboolean r;
+
+  r = ide_content_search_run_finish (IDE_CONTENT_SEARCH (object), result, &error);
+  g_assert_no_error (error);
+  g_assert_true (r);
+
+  g_main_loop_quit (main_loop);
+}
+
+static IdeContentSearch *
+create_search (const gchar *query)
+{
+  g_autoptr(GFile) directory = g_file_new_for_path (tmpdir);
+  IdeContentSearch *search = ide_content_search_new (directory);
+
+  ide_content_search_set_query (search, query);
+  ide_content_search_set_recursive (search, TRUE);
+
+  return search;
+}
+
+static void
+run_search (IdeContentSearch *search)
+{
+  g_autoptr(GMainLoop) main_loop = g_main_loop_new (NULL, FALSE);
+
+  ide_content_search_run_async (search, NULL, run_cb, main_loop);
+  g_main_loop_run (main_loop);
+}
+
+/* Returns the matches as sorted "path:line:begin-end,…" strings, since
+ * files are searched in parallel and may complete in any order.
+ */
+static gchar *
+format_matches (IdeContentSearch *search)
+{
+  g_autoptr(GPtrArray) strv = g_ptr_array_new_with_free_func (g_free);
+  guint n_matches = ide_content_search_get_n_matches (search);
+
+  for (guint i = 0; i < n_matches; i++)
+    {
+      const IdeContentSearchMatch *match = ide_content_search_get_match (search, i);
+      GString *str = g_string_new (NULL);
+
+      g_string_append_printf (str, "%s:%u:", match->path, match->line);
+
+      for (guint j = 0; j < match->ranges->len; j++)
+        {
+          const IdeContentSearchRange *range = &g_array_index (match->ranges, IdeContentSearchRange, j);
+
+          g_string_append_printf (str, "%s%u-%u", j ? "," : "", range->begin, range->end);
+        }
+
+      g_ptr_array_add (strv, g_string_free (str, FALSE));
+    }
+
+  g_ptr_array_sort (strv, (GCompareFunc)g_strcmp0);
+  g_ptr_array_add (strv, NULL);
+
+  return g_strjoinv (";", (gchar **)strv->pdata);
+}
+
+static void
+test_content_search_literal (void)
+{
+  g_autoptr(IdeContentSearch) search = create_search ("needle");
+  g_autofree gchar *matches = NULL;
+
+  run_search (search);
+  matches = format_matches (search);
+
+  g_assert_cmpstr (matches, ==, "a.txt:0:4-10;a.txt:2:0-6,7-13;sub/b.txt:0:3-9;words.txt:1:0-6");
+  g_assert_false (ide_content_search_get_truncated (search));
+}
+
+static void
+test_content_search_regex (void)
+{
+  g_autoptr(IdeContentSearch) search = create_search ("ne+dle [0-9]+");
+  g_autofree gchar *matches = NULL;
+
+  ide_content_search_set_use_regex (search, TRUE);
+  run_search (search);
+  matches = format_matches (search);
+
+  g_assert_cmpstr (matches, ==, "sub/b.txt:0:3-12");
+
+  /* Without use-regex the query is a literal */
+  g_clear_object (&search);
+  search = create_search ("ne+dle [0-9]+");
+  run_search (search);
+  g_assert_cmpuint (ide_content_search_get_n_matches (search), ==, 0);
+}
+
+static void
+test_content_search_caseless (void)
+{
+  g_autoptr(IdeContentSearch) search = create_search ("NEEDLE");
+  g_autofree gchar *matches = NULL;
+
+  ide_content_search_set_case_sensitive (search, TRUE);
+  run_search (search);
+  g_assert_cmpuint (ide_content_search_get_n_matches (search), ==, 0);
+
+  g_clear_object (&search);
+  search = create_search ("NEEDLE");
+  ide_content_search_set_case_sensitive (search, FALSE);
+  run_search (search);
+  matches = format_matches (search);
+
+  g_assert_cmpstr (matches, ==, "a.txt:0:4-10;a.txt:2:0-6,7-13;a.txt:3:0-6;sub/b.txt:0:3-9;words.txt:1:0-6");
+}
+
+static void
+test_content_search_word_boundaries (void)
+{
+  g_autoptr(IdeContentSearch) search = create_search ("need");
+  g_autofree gchar *matches = NULL;
+
+  ide_content_search_set_at_word_boundaries (search, TRUE);
+  run_search (search);
+  matches = format_matches (search);
+
+  /* "needle" and "needles" must not match */
+  g_assert_cmpstr (matches, ==, "words.txt:0:5-9");
+}
+
+static void
+test_content_search_max_results (void)
+{
+  g_autoptr(IdeContentSearch) search = create_search ("line");
+  g_autoptr(GString) str = g_string_new (NULL);
+
+  for (guint i = 0; i < 100; i++)
+    g_string_append_printf (str, "line %u\n", i);
+  write_file ("many/lines.txt", str->str, str->len);
+
+  ide_content_search_set_max_results (search, 10);
+  run_search (search);
+
+  g_assert_cmpuint (ide_content_search_get_n_matches (search), ==, 10);
+  g_assert_true (ide_content_search_get_truncated (search));
+}
+
+static void
+test_content_search_binary (void)
+{
+  static const gchar binary[] = "needle\0needle\n";
+  g_autoptr(IdeContentSearch) search = create_search ("needle");
+  g_autofree gchar *matches = NULL;
+
+  write_file ("binary/data.bin", binary, sizeof binary - 1);
+
+  run_search (search);
+  matches = format_matches (search);
+
+  /* Files with a NUL byte are skipped, like grep -I */
+  g_assert_null (strstr (matches, "data.bin"));
+}
+
+static void
+test_content_search_crlf (void)
+{
+  g_autoptr(IdeContentSearch) search = create_search ("crlf$");
+  const IdeContentSearchMatch *match;
+
+  write_file ("dos/dos.txt", "first crlf\r\nsecond crlf\r\n", -1);
+
+  ide_content_search_set_use_regex (search, TRUE);
+  run_search (search);
+
+  g_assert_cmpuint (ide_content_search_get_n_matches (search), ==, 2);
+
+  for (guint i = 0; i < 2; i++)
+    {
+      match = ide_content_search_get_match (search, i);
+      g_assert_null (strchr (match->text, '\r'));
+      g_assert_true (g_str_has_suffix (match->text, "crlf"));
+    }
+}
+
+static gboolean
+ignore_build_dir (GFile    *file,
+                  gpointer  user_data)
+{
+  g_autofree gchar *name = g_file_get_basename (file);
+  g_autofree gchar *path = g_file_get_path (file);
+  gint *n_inside = user_data;
+
+  /* Nothing below an ignored directory should be looked at */
+  if (strstr (path, "/_build/") != NULL)
+    g_atomic_int_inc (n_inside);
+
+  return g_str_equal (name, "_build");
+}
+
+static void
+test_content_search_ignore (void)
+{
+  g_autoptr(IdeContentSearch) search = create_search ("needle");
+  g_autofree gchar *matches = NULL;
+  gint n_inside = 0;
+
+  write_file ("_build/gen/needle.c", "needle\n", -1);
+
+  ide_content_search_set_ignore_func (search, ignore_build_dir, &n_inside, NULL);
+  run_search (search);
+  matches = format_matches (search);
+
+  g_assert_null (strstr (matches, "_build"));
+  g_assert_cmpint (n_inside, ==, 0);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GError) error = NULL;
+  gint ret;
+
+  g_test_init (&argc, &argv, NULL);
+
+  tmpdir = g_dir_make_tmp ("test-content-search-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  write_file ("a.txt", "the needle\nhay\nneedle needle\nNeedle\n", -1);
+  write_file ("sub/b.txt", "a  needle 42\nhay\n", -1);
+  write_file ("words.txt", "some need here\nneedles\n", -1);
+
+  g_test_add_func ("/Ide/ContentSearch/literal", test_content_search_literal);
+  g_test_add_func ("/Ide/ContentSearch/regex", test_content_search_regex);
+  g_test_add_func ("/Ide/ContentSearch/caseless", test_content_search_caseless);
+  g_test_add_func ("/Ide/ContentSearch/word-boundaries", test_content_search_word_boundaries);
+  g_test_add_func ("/Ide/ContentSearch/max-results", test_content_search_max_results);
+  g_test_add_func ("/Ide/ContentSearch/binary", test_content_search_binary);
+  g_test_add_func ("/Ide/ContentSearch/crlf", test_content_search_crlf);
+  g_test_add_func ("/Ide/ContentSearch/ignore", test_content_search_ignore);
+
+  ret = g_test_run ();
+
+  remove_tree (tmpdir);
+  g_free (tmpdir);
+
+  return ret;
+}
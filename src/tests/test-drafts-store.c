@@ -0,0 +1,258 @@
+/* test-drafts-store.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <libide-code.h>
+#include <glib/gstdio.h>
+
+#include "ide-drafts-store-private.h"
+
+/* MIN_COMPACT_SIZE in ide-drafts-store.c */
+#define COMPACT_SIZE (4 * 1024 * 1024)
+
+static gchar *
+create_directory (void)
+{
+  g_autoptr(GError) error = NULL;
+  gchar *dir;
+
+  dir = g_dir_make_tmp ("test-drafts-store-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  return dir;
+}
+
+static void
+remove_directory (const gchar *dir)
+{
+  g_autofree gchar *path = g_build_filename (dir, "journal", NULL);
+
+  g_remove (path);
+  g_rmdir (dir);
+}
+
+static goffset
+get_journal_size (const gchar *dir)
+{
+  g_autofree gchar *path = g_build_filename (dir, "journal", NULL);
+  GStatBuf st;
+
+  g_assert_cmpint (g_stat (path, &st), ==, 0);
+
+  return st.st_size;
+}
+
+static GBytes *
+create_content (guint seed,
+                gsize size)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (seed);
+  GString *str = g_string_new (NULL);
+
+  while (str->len < size)
+    g_string_append_printf (str, "line %u: %08x\n", (guint)str->len, g_rand_int (rand));
+
+  return g_string_free_to_bytes (str);
+}
+
+static void
+save_drafts (IdeDraftsStore *store,
+             const IdeDraft *drafts,
+             guint           n_drafts)
+{
+  g_autoptr(GError) error = NULL;
+  gboolean r;
+
+  r = _ide_drafts_store_save (store, drafts, n_drafts, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (r);
+}
+
+static GHashTable *
+load_drafts (const gchar *dir)
+{
+  g_autoptr(IdeDraftsStore) store = _ide_drafts_store_new (dir);
+  g_autoptr(GError) error = NULL;
+  GHashTable *ret;
+
+  ret = _ide_drafts_store_load (store, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (ret);
+
+  return ret;
+}
+
+static void
+assert_draft (GHashTable  *drafts,
+              const gchar *uri,
+              GBytes      *expected)
+{
+  GBytes *content = g_hash_table_lookup (drafts, uri);
+
+  g_assert_nonnull (content);
+  g_assert_true (g_bytes_equal (content, expected));
+}
+
+static void
+test_drafts_store_truncated (void)
+{
+  g_autofree gchar *dir = create_directory ();
+  g_autofree gchar *path = g_build_filename (dir, "journal", NULL);
+  g_autoptr(IdeDraftsStore) store = NULL;
+  g_autoptr(GHashTable) drafts = NULL;
+  g_autoptr(GBytes) a1 = create_content (1, 20000);
+  g_autoptr(GBytes) a2 = create_content (2, 20000);
+  g_autoptr(GBytes) a3 = create_content (3, 20000);
+  g_autoptr(GBytes) b = create_content (4, 20000);
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *data = NULL;
+  gsize len = 0;
+
+  store = _ide_drafts_store_new (dir);
+  save_drafts (store, (IdeDraft[]) { { "file:///a", a1 }, { "file:///b", b } }, 2);
+  save_drafts (store, (IdeDraft[]) { { "file:///a", a2 }, { "file:///b", b } }, 2);
+  g_clear_pointer (&store, _ide_drafts_store_free);
+
+  /* Cut the draft record of the last save short, as a crash would */
+  g_file_get_contents (path, &data, &len, &error);
+  g_assert_no_error (error);
+  g_file_set_contents (path, data, len - 3, &error);
+  g_assert_no_error (error);
+
+  drafts = load_drafts (dir);
+  g_assert_cmpint (g_hash_table_size (drafts), ==, 2);
+  assert_draft (drafts, "file:///a", a1);
+  assert_draft (drafts, "file:///b", b);
+  g_clear_pointer (&drafts, g_hash_table_unref);
+
+  /* The next save overwrites the partial record */
+  store = _ide_drafts_store_new (dir);
+  save_drafts (store, (IdeDraft[]) { { "file:///a", a3 }, { "file:///b", b } }, 2);
+  g_clear_pointer (&store, _ide_drafts_store_free);
+
+  drafts = load_drafts (dir);
+  g_assert_cmpint (g_hash_table_size (drafts), ==, 2);
+  assert_draft (drafts, "file:///a", a3);
+  assert_draft (drafts, "file:///b", b);
+
+  remove_directory (dir);
+}
+
+static void
+test_drafts_store_compaction (void)
+{
+  g_autofree gchar *dir = create_directory ();
+  g_autoptr(IdeDraftsStore) store = NULL;
+  g_autoptr(GHashTable) drafts = NULL;
+  g_autoptr(GBytes) b = create_content (1000, 100000);
+  g_autoptr(GBytes) a = NULL;
+  goffset last_size = 0;
+  gboolean compacted = FALSE;
+
+  store = _ide_drafts_store_new (dir);
+
+  /* Every save replaces all of a, so most of the journal becomes garbage */
+  for (guint i = 0; i < 16; i++)
+    {
+      goffset size;
+
+      g_clear_pointer (&a, g_bytes_unref);
+      a = create_content (i, 512 * 1024);
+
+      save_drafts (store, (IdeDraft[]) { { "file:///a", a }, { "file:///b", b } }, 2);
+
+      size = get_journal_size (dir);
+      g_assert_cmpint (size, <, COMPACT_SIZE + 2 * 512 * 1024);
+
+      if (size < last_size)
+        compacted = TRUE;
+      last_size = size;
+    }
+
+  g_assert_true (compacted);
+
+  /* The store keeps working with the offsets of the compacted journal */
+  g_clear_pointer (&a, g_bytes_unref);
+  a = create_content (100, 512 * 1024);
+  save_drafts (store, (IdeDraft[]) { { "file:///a", a }, { "file:///b", b } }, 2);
+  g_clear_pointer (&store, _ide_drafts_store_free);
+
+  drafts = load_drafts (dir);
+  g_assert_cmpint (g_hash_table_size (drafts), ==, 2);
+  assert_draft (drafts, "file:///a", a);
+  assert_draft (drafts, "file:///b", b);
+
+  remove_directory (dir);
+}
+
+static void
+test_drafts_store_remove_unloaded (void)
+{
+  g_autofree gchar *dir = create_directory ();
+  g_autoptr(IdeDraftsStore) store = NULL;
+  g_autoptr(GHashTable) drafts = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GBytes) a = create_content (1, 20000);
+  g_autoptr(GBytes) b = create_content (2, 20000);
+  g_autoptr(GBytes) c = create_content (3, 20000);
+
+  store = _ide_drafts_store_new (dir);
+  save_drafts (store, (IdeDraft[]) { { "file:///a", a }, { "file:///b", b }, { "file:///c", c } }, 3);
+  g_clear_pointer (&store, _ide_drafts_store_free);
+
+  /* Removed before the journal was read, then loaded */
+  store = _ide_drafts_store_new (dir);
+  _ide_drafts_store_remove (store, "file:///a");
+  drafts = _ide_drafts_store_load (store, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (g_hash_table_size (drafts), ==, 2);
+  g_assert_false (g_hash_table_contains (drafts, "file:///a"));
+  save_drafts (store, (IdeDraft[]) { { "file:///b", b }, { "file:///c", c } }, 2);
+  g_clear_pointer (&store, _ide_drafts_store_free);
+  g_clear_pointer (&drafts, g_hash_table_unref);
+
+  drafts = load_drafts (dir);
+  g_assert_cmpint (g_hash_table_size (drafts), ==, 2);
+  assert_draft (drafts, "file:///b", b);
+  assert_draft (drafts, "file:///c", c);
+  g_clear_pointer (&drafts, g_hash_table_unref);
+
+  /* Removed before the journal was read, then saved without loading */
+  store = _ide_drafts_store_new (dir);
+  _ide_drafts_store_remove (store, "file:///b");
+  save_drafts (store, (IdeDraft[]) { { "file:///c", c } }, 1);
+  g_clear_pointer (&store, _ide_drafts_store_free);
+
+  drafts = load_drafts (dir);
+  g_assert_cmpint (g_hash_table_size (drafts), ==, 1);
+  assert_draft (drafts, "file:///c", c);
+
+  remove_directory (dir);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/DraftsStore/truncated", test_drafts_store_truncated);
+  g_test_add_func ("/Ide/DraftsStore/compaction", test_drafts_store_compaction);
+  g_test_add_func ("/Ide/DraftsStore/remove-unloaded", test_drafts_store_remove_unloaded);
+  return g_test_run ();
+}
@@ -0,0 +1,305 @@
+/* test-error-formats.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "ide-error-matcher-private.h"
+#include "ide-regex-private.h"
+
+/* The formats registered by the gcc, vala and mono plugins */
+#define GCC_FORMAT                         \
+  "(?<filename>[a-zA-Z0-9\\+\\-\\.\\/_]+):" \
+  "(?<line>\\d+):"                          \
+  "(?<column>\\d+): "                       \
+  "(?<level>[\\w\\s]+): "                   \
+  "(?<message>.*)"
+#define VALAC_FORMAT                                                        \
+  "(?<filename>[a-zA-Z0-9\\-\\.\\/_]+.vala):"                               \
+  "(?<line>\\d+).(?<column>\\d+)-(?<line2>\\d+).(?<column2>\\d+): "         \
+  "(?<level>[\\w\\s]+): "                                                   \
+  "(?<message>.*)"
+#define MCS_FORMAT                                   \
+  "(?<filename>[a-zA-Z0-9\\-\\.\\/_]+.cs)"           \
+  "\\((?<line>\\d+),(?<column>\\d+)\\): "            \
+  "(?<level>[\\w\\s]+) "                             \
+  "(?<code>CS[0-9]+): "                              \
+  "(?<message>.*)"
+/* Errors from meson.build files and build systems driven by make */
+#define MESON_FORMAT                                                 \
+  "(?<filename>[^:\\s]+):(?<line>\\d+):(?<column>\\d+): ERROR: "   \
+  "(?<message>.*)"
+#define MAKE_FORMAT                                 \
+  "make\\[\\d+\\]: \\*\\*\\* (?<message>.*)"
+#define RUSTC_FORMAT                                \
+  "(?<level>error|warning)\\[E\\d+\\]: (?<message>.*)"
+
+static const struct {
+  const gchar *pattern;
+  gboolean     caseless;
+  /* Literals joined with "|", or %NULL if there must be none */
+  const gchar *expected;
+} literal_tests[] = {
+  /* Real formats */
+  { GCC_FORMAT, TRUE, ": " },
+  { VALAC_FORMAT, FALSE, "vala" },
+  { MCS_FORMAT, FALSE, "): " },
+  { MESON_FORMAT, FALSE, ": ERROR: " },
+  { MAKE_FORMAT, FALSE, "]: *** " },
+  { RUSTC_FORMAT, FALSE, "]: " },
+
+  /* Alternation */
+  { "error|warning", FALSE, "error|warning" },
+  { "(?:fatal error|error): ", FALSE, ": " },
+  { "abc(de|fg)hi", FALSE, "abc" },
+  { "(error|warning", FALSE, NULL },
+
+  /* Named and other groups */
+  { "(?'file'[^:]+):(?P<line>\\d+): note", FALSE, ": note" },
+  { "(?<a>needle)", FALSE, "needle" },
+  { "foo(bar)?baz", FALSE, "foo" },
+  { "(?=abc)def", FALSE, "def" },
+  { "x(?#c)y", FALSE, "x" },
+
+  /* Classes and quantifiers */
+  { "[:]error", FALSE, "error" },
+  { "[]x]error", FALSE, "error" },
+  { "x{2,3}yz", FALSE, "yz" },
+  { "a+bc*d", FALSE, "a" },
+  { "^(?<filename>.+\\.rs):(?<line>\\d+)", FALSE, ".rs" },
+  { "a*", FALSE, NULL },
+
+  /* Escapes */
+  { "\\.\\.\\.", FALSE, "..." },
+  { "\\bword\\b", FALSE, "word" },
+  { "a\\x41b", FALSE, NULL },
+  { "a\\Q.\\E", FALSE, NULL },
+
+  /* Caseless input */
+  { "(?i)error", FALSE, NULL },
+  { "Error: x", TRUE, "Error: x" },
+  { "Erro\xe2\x82\xacr: x", TRUE, NULL },
+  { "Erro\xe2\x82\xacr: x", FALSE, "Erro\xe2\x82\xacr: x" },
+
+  /* Quantifiers apply to whole characters */
+  { "caf\xc3\xa9?s", FALSE, "caf" },
+  { "na\xc3\xafve+", FALSE, "na\xc3\xafve" },
+  { "x\\\xe2\x82\xac{2}yz", FALSE, "yz" },
+};
+
+static void
+test_error_formats_literals (void)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (literal_tests); i++)
+    {
+      g_auto(GStrv) literals = _ide_regex_extract_literals (literal_tests[i].pattern,
+                                                           literal_tests[i].caseless);
+      g_autofree gchar *joined = literals ? g_strjoinv ("|", literals) : NULL;
+
+      g_test_message ("%s", literal_tests[i].pattern);
+      g_assert_cmpstr (joined, ==, literal_tests[i].expected);
+    }
+}
+
+static const struct {
+  const gchar *pattern;
+  gboolean     caseless;
+  const gchar *line;
+} sample_tests[] = {
+  { GCC_FORMAT, TRUE, "../src/main.c:12:5: warning: unused variable 'ret' [-Wunused-variable]" },
+  { GCC_FORMAT, TRUE, "/usr/include/stdio.h:27:10: fatal error: 'foo.h' file not found" },
+  { GCC_FORMAT, TRUE, "../SRC/MAIN.C:1:1: ERROR: EXPECTED ';'" },
+  { VALAC_FORMAT, FALSE, "src/app.vala:40.9-40.20: error: The name `foo' does not exist" },
+  { MCS_FORMAT, FALSE, "Program.cs(10,24): error CS1002: ; expected" },
+  { MESON_FORMAT, FALSE, "meson.build:12:0: ERROR: Unknown variable \"foo\"." },
+  { MAKE_FORMAT, FALSE, "make[2]: *** [Makefile:500: all] Error 2" },
+  { RUSTC_FORMAT, FALSE, "error[E0425]: cannot find value `x` in this scope" },
+  { "^caf\xc3\xa9?: (?<message>.*)", FALSE, "caf: closed" },
+};
+
+/* Every line matching a format must contain one of its literals */
+static void
+test_error_formats_samples (void)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (sample_tests); i++)
+    {
+      GRegexCompileFlags flags = sample_tests[i].caseless ? G_REGEX_CASELESS : 0;
+      g_autoptr(GRegex) regex = g_regex_new (sample_tests[i].pattern, flags, 0, NULL);
+      g_auto(GStrv) literals = _ide_regex_extract_literals (sample_tests[i].pattern,
+                                                           sample_tests[i].caseless);
+      g_autofree gchar *line = NULL;
+      gboolean found = FALSE;
+
+      g_assert_nonnull (regex);
+      g_assert_nonnull (literals);
+      g_assert_true (g_regex_match (regex, sample_tests[i].line, 0, NULL));
+
+      line = sample_tests[i].caseless ? g_ascii_strdown (sample_tests[i].line, -1)
+                                      : g_strdup (sample_tests[i].line);
+
+      for (guint j = 0; literals[j] && !found; j++)
+        {
+          g_autofree gchar *literal = sample_tests[i].caseless ? g_ascii_strdown (literals[j], -1)
+                                                               : g_strdup (literals[j]);
+          found = strstr (line, literal) != NULL;
+        }
+
+      g_assert_true (found);
+    }
+}
+
+static const gchar transcript[] =
+  "ninja: Entering directory `_build'\n"
+  "make[1]: Entering directory '/home/user/project/_build/src'\n"
+  "[1/4] Compiling C object src/app.p/main.c.o\n"
+  "../src/main.c: In function 'main':\n"
+  "../src/main.c:12:5: warning: unused variable 'ret' [-Wunused-variable]\n"
+  "   12 |   int ret;\n"
+  "      |       ^~~\n"
+  "../SRC/MAIN.C:1:1: ERROR: EXPECTED ';'\r\n"
+  "/usr/include/stdio.h:27:10: fatal error: 'foo.h' file not found\n"
+  "[2/4] Compiling Vala source src/app.vala\n"
+  "src/app.vala:40.9-40.20: error: The name `foo' does not exist\n"
+  "Compilation failed: 1 error(s), 0 warning(s)\n"
+  "Program.cs(10,24): error CS1002: ; expected\n"
+  "make[1]: Leaving directory '/home/user/project/_build/src'\n"
+  "meson.build:12:0: ERROR: Unknown variable \"foo\".\n"
+  "make[2]: Entering directory '/home/user/project/_build/po'\n"
+  "make[2]: *** [Makefile:500: all] Error 2\n"
+  "error[E0425]: cannot find value `x` in this scope\n"
+  "Build failed\n";
+
+static void
+collect_directory_cb (const gchar *directory,
+                      gsize        directory_len,
+                      gpointer     user_data)
+{
+  GString *str = user_data;
+
+  g_string_append (str, "dir ");
+  g_string_append_len (str, directory, directory_len);
+  g_string_append_c (str, '\n');
+}
+
+static gboolean
+collect_matched_cb (GMatchInfo *match_info,
+                    gpointer    user_data)
+{
+  g_autofree gchar *match = g_match_info_fetch (match_info, 0);
+  g_autofree gchar *message = g_match_info_fetch_named (match_info, "message");
+  GString *str = user_data;
+
+  g_string_append_printf (str, "match %s [%s]\n", match, message);
+
+  return TRUE;
+}
+
+static const IdeErrorMatcherCallbacks collect_callbacks = {
+  collect_directory_cb,
+  collect_matched_cb,
+};
+
+static gchar *
+collect (IdeErrorMatcher *matcher,
+         gboolean         by_line)
+{
+  GString *str = g_string_new (NULL);
+
+  if (by_line)
+    {
+      g_auto(GStrv) lines = g_strsplit (transcript, "\n", 0);
+
+      for (guint i = 0; lines[i]; i++)
+        {
+          g_autofree gchar *line = g_strconcat (lines[i], "\n", NULL);
+
+          _ide_error_matcher_match (matcher, line, strlen (line), &collect_callbacks, str);
+        }
+    }
+  else
+    {
+      _ide_error_matcher_match (matcher, transcript, strlen (transcript), &collect_callbacks, str);
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+/* The prefilter must only skip work, never change what is found */
+static void
+test_error_formats_prefilter (void)
+{
+  static const struct {
+    const gchar        *regex;
+    GRegexCompileFlags  flags;
+  } formats[] = {
+    { GCC_FORMAT, G_REGEX_CASELESS },
+    { VALAC_FORMAT, 0 },
+    { MCS_FORMAT, 0 },
+    { MESON_FORMAT, 0 },
+    { MAKE_FORMAT, 0 },
+    { RUSTC_FORMAT, 0 },
+  };
+  g_autoptr(IdeErrorMatcher) matcher = _ide_error_matcher_new ();
+
+  for (guint i = 0; i < G_N_ELEMENTS (formats); i++)
+    {
+      g_autoptr(GError) error = NULL;
+
+      _ide_error_matcher_add (matcher, formats[i].regex, formats[i].flags, &error);
+      g_assert_no_error (error);
+    }
+
+  for (guint by_line = 0; by_line <= 1; by_line++)
+    {
+      g_autofree gchar *without = NULL;
+      g_autofree gchar *with = NULL;
+
+      _ide_error_matcher_set_prefilter (matcher, FALSE);
+      without = collect (matcher, by_line);
+
+      _ide_error_matcher_set_prefilter (matcher, TRUE);
+      with = collect (matcher, by_line);
+
+      g_assert_cmpstr (with, ==, without);
+
+      /* Make sure the transcript actually exercises every format */
+      g_assert_nonnull (strstr (with, "dir /home/user/project/_build/src\n"));
+      g_assert_nonnull (strstr (with, "dir /home/user/project/_build/po\n"));
+      g_assert_nonnull (strstr (with, "[unused variable 'ret' [-Wunused-variable]]"));
+      g_assert_nonnull (strstr (with, "[EXPECTED ';'"));
+      g_assert_nonnull (strstr (with, "['foo.h' file not found]"));
+      g_assert_nonnull (strstr (with, "[The name `foo' does not exist]"));
+      g_assert_nonnull (strstr (with, "[; expected]"));
+      g_assert_nonnull (strstr (with, "[Unknown variable \"foo\".]"));
+      g_assert_nonnull (strstr (with, "[[Makefile:500: all] Error 2]"));
+      g_assert_nonnull (strstr (with, "[cannot find value `x` in this scope]"));
+      g_assert_null (strstr (with, "Build failed"));
+    }
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  g_test_add_func ("/Ide/ErrorFormats/literals", test_error_formats_literals);
+  g_test_add_func ("/Ide/ErrorFormats/samples", test_error_formats_samples);
+  g_test_add_func ("/Ide/ErrorFormats/prefilter", test_error_formats_prefilter);
+  return g_test_run ();
+}
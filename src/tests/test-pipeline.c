@@ -0,0 +1,582 @@
+/* test-pipeline.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <glib/gstdio.h>
+#include <libide-foundry.h>
+#include <string.h>
+
+#include "ide-build-private.h"
+#include "ide-config-private.h"
+
+/*
+ * Runs fake stages through a real IdePipeline, recording when each of
+ * them begins and ends to check how they were scheduled.
+ */
+
+#define TEST_TYPE_CONFIG       (test_config_get_type())
+#define TEST_TYPE_BUILD_SYSTEM (test_build_system_get_type())
+#define TEST_TYPE_STAGE        (test_stage_get_type())
+
+G_DECLARE_FINAL_TYPE (TestConfig, test_config, TEST, CONFIG, IdeConfig)
+G_DECLARE_FINAL_TYPE (TestBuildSystem, test_build_system, TEST, BUILD_SYSTEM, IdeObject)
+G_DECLARE_FINAL_TYPE (TestStage, test_stage, TEST, STAGE, IdePipelineStage)
+
+struct _TestConfig
+{
+  IdeConfig parent_instance;
+};
+
+struct _TestBuildSystem
+{
+  IdeObject parent_instance;
+};
+
+struct _TestStage
+{
+  IdePipelineStage  parent_instance;
+  guint             delay_msec;
+  guint             n_builds;
+  guint             fail : 1;
+  guint             chains : 1;
+  guint             logs : 1;
+};
+
+typedef struct
+{
+  GMainLoop *main_loop;
+  GError    *error;
+} Build;
+
+static IdeContext *context;
+static IdeConfig *config;
+static IdeDevice *device;
+static IdeRuntime *runtime;
+static gchar *workdir;
+
+/* "+name" when a stage begins and "-name" when it ends */
+static GPtrArray *events;
+static guint n_active;
+static guint max_active;
+
+G_DEFINE_TYPE (TestConfig, test_config, IDE_TYPE_CONFIG)
+
+static void
+test_config_class_init (TestConfigClass *klass)
+{
+}
+
+static void
+test_config_init (TestConfig *self)
+{
+}
+
+static gchar *
+test_build_system_get_builddir (IdeBuildSystem *build_system,
+                                IdePipeline    *pipeline)
+{
+  return g_build_filename (workdir, "_build", NULL);
+}
+
+static void
+build_system_iface_init (IdeBuildSystemInterface *iface)
+{
+  iface->get_builddir = test_build_system_get_builddir;
+}
+
+G_DEFINE_TYPE_WITH_CODE (TestBuildSystem, test_build_system, IDE_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (IDE_TYPE_BUILD_SYSTEM, build_system_iface_init))
+
+static void
+test_build_system_class_init (TestBuildSystemClass *klass)
+{
+}
+
+static void
+test_build_system_init (TestBuildSystem *self)
+{
+}
+
+G_DEFINE_TYPE (TestStage, test_stage, IDE_TYPE_PIPELINE_STAGE)
+
+static gboolean
+test_stage_complete_cb (gpointer user_data)
+{
+  g_autoptr(IdeTask) task = user_data;
+  TestStage *self = ide_task_get_source_object (task);
+
+  g_ptr_array_add (events, g_strdup_printf ("-%s", ide_pipeline_stage_get_name (IDE_PIPELINE_STAGE (self))));
+  n_active--;
+
+  if (self->logs)
+    ide_pipeline_stage_log (IDE_PIPELINE_STAGE (self), IDE_BUILD_LOG_STDOUT, "main.c:1: failed", -1);
+
+  if (self->fail)
+    ide_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "%s failed",
+                               ide_pipeline_stage_get_name (IDE_PIPELINE_STAGE (self)));
+  else
+    ide_task_return_boolean (task, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_stage_build_async (IdePipelineStage    *stage,
+                        IdePipeline         *pipeline,
+                        GCancellable        *cancellable,
+                        GAsyncReadyCallback  callback,
+                        gpointer             user_data)
+{
+  TestStage *self = (TestStage *)stage;
+  IdeTask *task;
+
+  task = ide_task_new (self, cancellable, callback, user_data);
+  ide_task_set_source_tag (task, test_stage_build_async);
+
+  g_ptr_array_add (events, g_strdup_printf ("+%s", ide_pipeline_stage_get_name (stage)));
+  self->n_builds++;
+
+  /* Like a recursive make, so the diagnostic is relative to a subdirectory */
+  if (self->logs)
+    {
+      g_autofree gchar *top = g_strdup_printf ("make: Entering directory '%s'", workdir);
+      g_autofree gchar *subdir = g_strdup_printf ("make[1]: Entering directory '%s/%s'",
+                                                  workdir, ide_pipeline_stage_get_name (stage));
+
+      ide_pipeline_stage_log (stage, IDE_BUILD_LOG_STDOUT, top, -1);
+      ide_pipeline_stage_log (stage, IDE_BUILD_LOG_STDOUT, subdir, -1);
+    }
+  n_active++;
+  max_active = MAX (max_active, n_active);
+
+  g_timeout_add (self->delay_msec, test_stage_complete_cb, task);
+}
+
+static gboolean
+test_stage_build_finish (IdePipelineStage  *stage,
+                         GAsyncResult      *result,
+                         GError           **error)
+{
+  return ide_task_propagate_boolean (IDE_TASK (result), error);
+}
+
+static gboolean
+test_stage_chain (IdePipelineStage *stage,
+                  IdePipelineStage *next)
+{
+  return TEST_STAGE (stage)->chains && TEST_IS_STAGE (next) && TEST_STAGE (next)->chains;
+}
+
+static void
+test_stage_class_init (TestStageClass *klass)
+{
+  IdePipelineStageClass *stage_class = IDE_PIPELINE_STAGE_CLASS (klass);
+
+  stage_class->build_async = test_stage_build_async;
+  stage_class->build_finish = test_stage_build_finish;
+  stage_class->chain = test_stage_chain;
+}
+
+static void
+test_stage_init (TestStage *self)
+{
+}
+
+static TestStage *
+add_stage (IdePipeline *pipeline,
+           const gchar *name,
+           guint        delay_msec)
+{
+  TestStage *stage;
+  guint priority;
+
+  /* Keep the stages in the order they are added */
+  priority = g_list_model_get_n_items (G_LIST_MODEL (pipeline));
+
+  stage = g_object_new (TEST_TYPE_STAGE,
+                        "name", name,
+                        NULL);
+  stage->delay_msec = delay_msec;
+
+  ide_pipeline_attach (pipeline, IDE_PIPELINE_PHASE_BUILD, priority, IDE_PIPELINE_STAGE (stage));
+
+  /* The pipeline holds the reference */
+  g_object_unref (stage);
+
+  return stage;
+}
+
+static IdePipeline *
+create_pipeline (void)
+{
+  g_autoptr(GError) error = NULL;
+  IdePipeline *pipeline;
+
+  pipeline = g_object_new (IDE_TYPE_PIPELINE,
+                           "config", config,
+                           "device", device,
+                           NULL);
+  ide_object_append (IDE_OBJECT (context), IDE_OBJECT (pipeline));
+  _ide_pipeline_set_runtime (pipeline, runtime);
+
+  if (!g_initable_init (G_INITABLE (pipeline), NULL, &error))
+    g_error ("%s", error->message);
+
+  while (!ide_pipeline_is_ready (pipeline))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_ptr_array_set_size (events, 0);
+  n_active = 0;
+  max_active = 0;
+
+  return pipeline;
+}
+
+static void
+log_observer (IdeBuildLogStream  stream,
+              const gchar       *message,
+              gssize             message_len,
+              gpointer           user_data)
+{
+  gboolean *critical_path = user_data;
+
+  if (g_str_has_prefix (message, "Critical path"))
+    *critical_path = TRUE;
+}
+
+static void
+diagnostic_cb (IdePipeline   *pipeline,
+               IdeDiagnostic *diagnostic,
+               GPtrArray     *paths)
+{
+  GFile *file = ide_location_get_file (ide_diagnostic_get_location (diagnostic));
+
+  g_ptr_array_add (paths, g_file_get_path (file));
+}
+
+static void
+build_cb (GObject      *object,
+          GAsyncResult *result,
+          gpointer      user_data)
+{
+  Build *build = user_data;
+
+  ide_pipeline_build_finish (IDE_PIPELINE (object), result, &build->error);
+  g_main_loop_quit (build->main_loop);
+}
+
+static gboolean
+run_build (IdePipeline  *pipeline,
+           GError      **error)
+{
+  Build build = {0};
+
+  build.main_loop = g_main_loop_new (NULL, FALSE);
+  ide_pipeline_build_async (pipeline, IDE_PIPELINE_PHASE_BUILD, NULL, build_cb, &build);
+  g_main_loop_run (build.main_loop);
+  g_main_loop_unref (build.main_loop);
+
+  g_assert_cmpint (n_active, ==, 0);
+
+  if (build.error != NULL)
+    {
+      g_propagate_error (error, build.error);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gint
+event_index (const gchar *event)
+{
+  guint index;
+
+  if (g_ptr_array_find_with_equal_func (events, event, g_str_equal, &index))
+    return index;
+
+  return -1;
+}
+
+static gchar *
+format_events (void)
+{
+  g_autoptr(GString) str = g_string_new (NULL);
+
+  for (guint i = 0; i < events->len; i++)
+    g_string_append_printf (str, "%s%s", i ? " " : "", (const gchar *)g_ptr_array_index (events, i));
+
+  return g_strdup (str->str);
+}
+
+static void
+test_pipeline_sequential (void)
+{
+  g_autoptr(IdePipeline) pipeline = create_pipeline ();
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *order = NULL;
+  gboolean critical_path = FALSE;
+
+  ide_pipeline_add_log_observer (pipeline, log_observer, &critical_path, NULL);
+
+  /* Stages that declare nothing keep running one at a time, in order */
+  add_stage (pipeline, "a", 30);
+  add_stage (pipeline, "b", 10);
+  add_stage (pipeline, "c", 20);
+
+  g_assert_true (run_build (pipeline, &error));
+  g_assert_no_error (error);
+
+  order = format_events ();
+  g_assert_cmpstr (order, ==, "+a -a +b -b +c -c");
+  g_assert_cmpuint (max_active, ==, 1);
+  g_assert_false (critical_path);
+
+  ide_object_destroy (IDE_OBJECT (pipeline));
+}
+
+static void
+test_pipeline_dependencies (void)
+{
+  g_autoptr(IdePipeline) pipeline = create_pipeline ();
+  g_autoptr(GError) error = NULL;
+  gboolean critical_path = FALSE;
+  TestStage *fetch1, *fetch2, *configure, *build, *install;
+
+  ide_pipeline_add_log_observer (pipeline, log_observer, &critical_path, NULL);
+
+  /* fetch1 and fetch2 may overlap, configure reads what they write,
+   * build depends on configure, and install declares nothing.
+   */
+  fetch1 = add_stage (pipeline, "fetch1", 50);
+  ide_pipeline_stage_add_output (IDE_PIPELINE_STAGE (fetch1), "src/one");
+
+  fetch2 = add_stage (pipeline, "fetch2", 20);
+  ide_pipeline_stage_add_output (IDE_PIPELINE_STAGE (fetch2), "src/two");
+
+  configure = add_stage (pipeline, "configure", 10);
+  ide_pipeline_stage_add_input (IDE_PIPELINE_STAGE (configure), "src/one");
+  ide_pipeline_stage_add_input (IDE_PIPELINE_STAGE (configure), "src/two");
+
+  build = add_stage (pipeline, "build", 10);
+  ide_pipeline_stage_add_dependency (IDE_PIPELINE_STAGE (build), IDE_PIPELINE_STAGE (configure));
+
+  install = add_stage (pipeline, "install", 10);
+
+  g_assert_true (run_build (pipeline, &error));
+  g_assert_no_error (error);
+
+  g_assert_cmpuint (max_active, ==, 2);
+  g_assert_cmpint (event_index ("+fetch2"), <, event_index ("-fetch1"));
+  g_assert_cmpint (event_index ("-fetch1"), <, event_index ("+configure"));
+  g_assert_cmpint (event_index ("-fetch2"), <, event_index ("+configure"));
+  g_assert_cmpint (event_index ("-configure"), <, event_index ("+build"));
+  g_assert_cmpint (event_index ("-build"), <, event_index ("+install"));
+
+  {
+    TestStage *stages[] = { fetch1, fetch2, configure, build, install };
+
+    for (guint i = 0; i < G_N_ELEMENTS (stages); i++)
+      {
+        g_assert_cmpuint (stages[i]->n_builds, ==, 1);
+        g_assert_true (ide_pipeline_stage_get_completed (IDE_PIPELINE_STAGE (stages[i])));
+      }
+  }
+
+  g_assert_true (critical_path);
+
+  ide_object_destroy (IDE_OBJECT (pipeline));
+}
+
+static void
+test_pipeline_error_formats (void)
+{
+  g_autoptr(IdePipeline) pipeline = create_pipeline ();
+  g_autoptr(GPtrArray) paths = g_ptr_array_new_with_free_func (g_free);
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *order = NULL;
+  g_autofree gchar *path_a = g_build_filename (workdir, "a", "main.c", NULL);
+  g_autofree gchar *path_b = g_build_filename (workdir, "b", "main.c", NULL);
+  gboolean critical_path = FALSE;
+  TestStage *stage;
+
+  ide_pipeline_add_log_observer (pipeline, log_observer, &critical_path, NULL);
+  ide_pipeline_add_error_format (pipeline, "(?<filename>[^:]+):(?<line>\\d+): (?<message>.*)", 0);
+  g_signal_connect (pipeline, "diagnostic", G_CALLBACK (diagnostic_cb), paths);
+
+  /* Stages log their own output, so they overlap even though it is parsed */
+  stage = add_stage (pipeline, "a", 30);
+  stage->logs = TRUE;
+  ide_pipeline_stage_add_output (IDE_PIPELINE_STAGE (stage), "a");
+
+  stage = add_stage (pipeline, "b", 10);
+  stage->logs = TRUE;
+  ide_pipeline_stage_add_output (IDE_PIPELINE_STAGE (stage), "b");
+
+  g_assert_true (run_build (pipeline, &error));
+  g_assert_no_error (error);
+
+  order = format_events ();
+  g_assert_cmpstr (order, ==, "+a +b -b -a");
+  g_assert_cmpuint (max_active, ==, 2);
+  g_assert_true (critical_path);
+
+  /* b entered its directory after a did, but each keeps its own */
+  g_assert_cmpuint (paths->len, ==, 2);
+  g_assert_cmpstr (g_ptr_array_index (paths, 0), ==, path_b);
+  g_assert_cmpstr (g_ptr_array_index (paths, 1), ==, path_a);
+
+  ide_object_destroy (IDE_OBJECT (pipeline));
+}
+
+static void
+test_pipeline_failure (void)
+{
+  g_autoptr(IdePipeline) pipeline = create_pipeline ();
+  g_autoptr(GError) error = NULL;
+  TestStage *broken, *slow, *after, *last;
+
+  broken = add_stage (pipeline, "broken", 10);
+  broken->fail = TRUE;
+  ide_pipeline_stage_add_output (IDE_PIPELINE_STAGE (broken), "broken");
+
+  slow = add_stage (pipeline, "slow", 50);
+  ide_pipeline_stage_add_output (IDE_PIPELINE_STAGE (slow), "slow");
+
+  after = add_stage (pipeline, "after", 10);
+  ide_pipeline_stage_add_output (IDE_PIPELINE_STAGE (after), "after");
+  ide_pipeline_stage_add_dependency (IDE_PIPELINE_STAGE (after), IDE_PIPELINE_STAGE (broken));
+
+  last = add_stage (pipeline, "last", 10);
+
+  g_assert_false (run_build (pipeline, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_cmpstr (error->message, ==, "broken failed");
+
+  /* The running stage finishes, but nothing new starts */
+  g_assert_cmpuint (slow->n_builds, ==, 1);
+  g_assert_cmpint (event_index ("-slow"), >, event_index ("-broken"));
+  g_assert_cmpuint (after->n_builds, ==, 0);
+  g_assert_cmpuint (last->n_builds, ==, 0);
+
+  g_assert_false (ide_pipeline_stage_get_completed (IDE_PIPELINE_STAGE (broken)));
+  g_assert_true (ide_pipeline_stage_get_completed (IDE_PIPELINE_STAGE (slow)));
+
+  ide_object_destroy (IDE_OBJECT (pipeline));
+}
+
+static void
+test_pipeline_chain (void)
+{
+  g_autoptr(IdePipeline) pipeline = create_pipeline ();
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *order = NULL;
+  TestStage *first, *chained, *declared, *after;
+
+  first = add_stage (pipeline, "first", 10);
+  first->chains = TRUE;
+
+  chained = add_stage (pipeline, "chained", 10);
+  chained->chains = TRUE;
+
+  /* Stages that declare dependencies are never chained */
+  declared = add_stage (pipeline, "declared", 10);
+  declared->chains = TRUE;
+  ide_pipeline_stage_add_output (IDE_PIPELINE_STAGE (declared), "declared");
+
+  after = add_stage (pipeline, "after", 10);
+
+  g_assert_true (run_build (pipeline, &error));
+  g_assert_no_error (error);
+
+  order = format_events ();
+  g_assert_cmpstr (order, ==, "+first -first +declared -declared +after -after");
+
+  g_assert_cmpuint (first->n_builds, ==, 1);
+  g_assert_cmpuint (chained->n_builds, ==, 0);
+  g_assert_cmpuint (declared->n_builds, ==, 1);
+  g_assert_cmpuint (after->n_builds, ==, 1);
+
+  /* The chained stage was built along with the first one */
+  g_assert_true (ide_pipeline_stage_get_completed (IDE_PIPELINE_STAGE (chained)));
+
+  ide_object_destroy (IDE_OBJECT (pipeline));
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(IdeObject) build_system = NULL;
+  g_autoptr(IdeTriplet) triplet = NULL;
+  g_autoptr(GFile) file = NULL;
+  g_autoptr(GError) error = NULL;
+  gint ret;
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (!(workdir = g_dir_make_tmp ("test-pipeline-XXXXXX", &error)))
+    g_error ("%s", error->message);
+
+  events = g_ptr_array_new_with_free_func (g_free);
+
+  context = ide_context_new ();
+  file = g_file_new_for_path (workdir);
+  ide_context_set_workdir (context, file);
+
+  build_system = g_object_new (TEST_TYPE_BUILD_SYSTEM, NULL);
+  ide_object_append (IDE_OBJECT (context), build_system);
+
+  runtime = ide_runtime_new ("host", "Host");
+  ide_runtime_manager_add (ide_runtime_manager_from_context (context), runtime);
+
+  config = g_object_new (TEST_TYPE_CONFIG,
+                         "id", "test",
+                         "runtime-id", "host",
+                         NULL);
+  ide_object_append (IDE_OBJECT (context), IDE_OBJECT (config));
+  _ide_config_attach (config);
+
+  triplet = ide_triplet_new_from_system ();
+  device = g_object_new (IDE_TYPE_LOCAL_DEVICE,
+                         "triplet", triplet,
+                         NULL);
+  ide_object_append (IDE_OBJECT (context), IDE_OBJECT (device));
+
+  g_test_add_func ("/Ide/Pipeline/sequential", test_pipeline_sequential);
+  g_test_add_func ("/Ide/Pipeline/dependencies", test_pipeline_dependencies);
+  g_test_add_func ("/Ide/Pipeline/error-formats", test_pipeline_error_formats);
+  g_test_add_func ("/Ide/Pipeline/failure", test_pipeline_failure);
+  g_test_add_func ("/Ide/Pipeline/chain", test_pipeline_chain);
+
+  ret = g_test_run ();
+
+  ide_object_destroy (IDE_OBJECT (context));
+
+  g_clear_object (&device);
+  g_clear_object (&config);
+  g_clear_object (&runtime);
+  g_clear_object (&context);
+  g_clear_pointer (&events, g_ptr_array_unref);
+
+  g_rmdir (workdir);
+  g_free (workdir);
+
+  return ret;
+}
@@ -0,0 +1,149 @@
+/* test-test-manager.c
+ *
+ * Copyright 2019 Christian Hergert <chergert@redhat.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <libide-foundry.h>
+
+#include "ide-test-private.h"
+
+static IdeContext *context;
+
+static IdeTest *
+create_test (const gchar *id,
+             gint         priority,
+             guint        timeout,
+             gint64       duration)
+{
+  IdeTest *test = ide_test_new ();
+
+  ide_test_set_group (test, "group");
+  ide_test_set_id (test, id);
+  ide_test_set_priority (test, priority);
+  ide_test_set_timeout (test, timeout);
+  ide_test_set_duration (test, duration);
+
+  return test;
+}
+
+static void
+write_durations (void)
+{
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *dir = NULL;
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sx}"));
+  g_variant_builder_add (&builder, "{sx}", "group/stored", (gint64)50 * G_USEC_PER_SEC);
+  variant = g_variant_take_ref (g_variant_builder_end (&builder));
+
+  path = ide_context_cache_filename (context, "tests", "durations.gvariant", NULL);
+  dir = g_path_get_dirname (path);
+  g_assert_cmpint (g_mkdir_with_parents (dir, 0750), ==, 0);
+
+  g_file_set_contents (path,
+                       g_variant_get_data (variant),
+                       g_variant_get_size (variant),
+                       &error);
+  g_assert_no_error (error);
+}
+
+static void
+test_test_manager_sort (void)
+{
+  g_autoptr(IdeTestManager) manager = NULL;
+  g_autoptr(GPtrArray) tests = g_ptr_array_new_with_free_func (g_object_unref);
+  static const gchar *expected[] = { "urgent", "measured", "timeout", "stored", "default" };
+
+  write_durations ();
+
+  manager = g_object_new (IDE_TYPE_TEST_MANAGER, NULL);
+  ide_object_append (IDE_OBJECT (context), IDE_OBJECT (manager));
+
+  /* Default timeout of 30 seconds */
+  g_ptr_array_add (tests, create_test ("default", 0, 0, 0));
+  /* Stored 50 seconds wins over the timeout */
+  g_ptr_array_add (tests, create_test ("stored", 0, 10, 0));
+  /* Measured this session, wins over everything else */
+  g_ptr_array_add (tests, create_test ("measured", 0, 10, (gint64)200 * G_USEC_PER_SEC));
+  g_ptr_array_add (tests, create_test ("timeout", 0, 100, 0));
+  /* Priority wins over any duration */
+  g_ptr_array_add (tests, create_test ("urgent", 1, 1, 0));
+
+  _ide_test_manager_sort_tests (manager, tests);
+
+  g_assert_cmpint (tests->len, ==, G_N_ELEMENTS (expected));
+  for (guint i = 0; i < tests->len; i++)
+    g_assert_cmpstr (ide_test_get_id (g_ptr_array_index (tests, i)), ==, expected[i]);
+
+  ide_object_destroy (IDE_OBJECT (manager));
+}
+
+static void
+test_test_manager_max_active (void)
+{
+  g_autoptr(IdeTestManager) manager = g_object_new (IDE_TYPE_TEST_MANAGER, NULL);
+  g_autoptr(GSettings) settings = g_settings_new ("org.gnome.builder.build");
+  guint n_cpu = g_get_num_processors ();
+  guint max_active;
+
+  g_settings_set_int (settings, "test-parallel", 3);
+  g_assert_cmpint (_ide_test_manager_get_max_active (manager), ==, 3);
+
+  g_settings_set_int (settings, "test-parallel", 0);
+  g_assert_cmpint (_ide_test_manager_get_max_active (manager), ==, n_cpu);
+
+  /* Limited by available memory, but always at least one */
+  g_settings_set_int (settings, "test-parallel", -1);
+  max_active = _ide_test_manager_get_max_active (manager);
+  g_assert_cmpint (max_active, >=, 1);
+  g_assert_cmpint (max_active, <=, n_cpu);
+
+  g_settings_reset (settings, "test-parallel");
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *cachedir = NULL;
+  gint ret;
+
+  /* Keep the durations cache out of the user's cache directory */
+  if (!(cachedir = g_dir_make_tmp ("test-test-manager-XXXXXX", &error)))
+    g_error ("%s", error->message);
+  g_setenv ("XDG_CACHE_HOME", cachedir, TRUE);
+
+  g_test_init (&argc, &argv, NULL);
+
+  context = ide_context_new ();
+  ide_context_set_project_id (context, "test-test-manager");
+
+  g_test_add_func ("/Ide/TestManager/sort", test_test_manager_sort);
+  g_test_add_func ("/Ide/TestManager/max-active", test_test_manager_max_active);
+
+  ret = g_test_run ();
+
+  ide_object_destroy (IDE_OBJECT (context));
+  g_clear_object (&context);
+
+  return ret;
+}